@@ -0,0 +1,341 @@
+/**
+* @file bench_cbc.c
+* @brief Benchmark of the CBC interpreter dispatch loops, fused pairs and the template JIT on small kernels
+*
+* @author Low Level Team
+*/
+
+#include <coil/cbc.h>
+#include <coil/jit.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define BENCH_CBC_DEPTH 256
+#define BENCH_CBC_RUNS 5
+#define BENCH_CBC_WORDS 512
+
+/**
+* @brief A kernel ready to run
+*/
+typedef struct bench_cbc_kernel {
+  const char *name;            ///< Kernel name
+  coil_section_t code;         ///< Encoded instructions
+  coil_u64_t syms[4];          ///< Labels and data addresses
+  coil_u64_t entry;            ///< Entry offset
+  coil_u32_t words;            ///< 32-bit words of memory the kernel works on
+} bench_cbc_kernel_t;
+
+/**
+* @brief Encode an instruction, aborting on failure
+*/
+static void bench_cbc_emit(bench_cbc_kernel_t *k, coil_cbc_opcode_t op, coil_u8_t cond, int count,
+                           coil_cbc_operand_t a, coil_cbc_operand_t b) {
+  if (coil_cbc_encode(&k->code, op, cond, count > 0 ? &a : NULL, count > 1 ? &b : NULL) != COIL_ERR_GOOD) {
+    fprintf(stderr, "Encoding opcode %u of %s failed\n", (unsigned)op, k->name);
+    exit(1);
+  }
+}
+
+#define R(n) coil_cbc_reg(n)
+#define I(v) coil_cbc_imm(v)
+#define M(n, d) coil_cbc_mem_reg(n, d)
+#define NO coil_cbc_imm(0)
+#define OP0(op) bench_cbc_emit(k, op, COIL_INSTRFLAG_NONE, 0, NO, NO)
+#define OP1(op, a) bench_cbc_emit(k, op, COIL_INSTRFLAG_NONE, 1, a, NO)
+#define OP2(op, a, b) bench_cbc_emit(k, op, COIL_INSTRFLAG_NONE, 2, a, b)
+#define BR(cond, label) bench_cbc_emit(k, COIL_COP_BRqS, cond, 1, coil_cbc_sym(label), NO)
+#define LABEL(label) (k->syms[label] = k->code.size)
+
+/**
+* @brief Sum of 1..n
+*/
+static void bench_cbc_sum(bench_cbc_kernel_t *k) {
+  OP2(COIL_COP_MOVqRI, R(0), I(0));
+  OP2(COIL_COP_MOVqRI, R(1), I(2000000));
+  LABEL(0);
+  OP2(COIL_COP_ADDqRR, R(0), R(1));
+  OP2(COIL_COP_DECqRR, R(1), R(1));
+  OP2(COIL_COP_CMPqRI, R(1), I(0));
+  BR(COIL_INSTRFLAG_GT, 0);
+  OP0(COIL_COP_RET);
+}
+
+/**
+* @brief Iterative Fibonacci modulo 2^64
+*/
+static void bench_cbc_fib(bench_cbc_kernel_t *k) {
+  OP2(COIL_COP_MOVqRI, R(0), I(0));
+  OP2(COIL_COP_MOVqRI, R(1), I(1));
+  OP2(COIL_COP_MOVqRI, R(2), I(1000000));
+  LABEL(0);
+  OP2(COIL_COP_MOVqRR, R(3), R(1));
+  OP2(COIL_COP_ADDqRR, R(1), R(0));
+  OP2(COIL_COP_MOVqRR, R(0), R(3));
+  OP2(COIL_COP_SUBqRI, R(2), I(1));
+  OP2(COIL_COP_CMPqRI, R(2), I(0));
+  BR(COIL_INSTRFLAG_GT, 0);
+  OP0(COIL_COP_RET);
+}
+
+/**
+* @brief Polynomial checksum over memory, repeated
+*/
+static void bench_cbc_checksum(bench_cbc_kernel_t *k) {
+  k->words = BENCH_CBC_WORDS;
+  k->syms[2] = 0;
+  OP2(COIL_COP_MOVqRI, R(0), I(0));
+  OP2(COIL_COP_MOVqRI, R(6), I(1000));
+  LABEL(0);
+  OP2(COIL_COP_LEAqRS, R(1), coil_cbc_sym(2));
+  OP2(COIL_COP_MOVqRI, R(2), I(BENCH_CBC_WORDS));
+  LABEL(1);
+  OP2(COIL_COP_MOVlROR, R(3), M(1, 0));
+  OP2(COIL_COP_MULqRI, R(0), I(31));
+  OP2(COIL_COP_ADDqRR, R(0), R(3));
+  OP2(COIL_COP_ADDqRI, R(1), I(4));
+  OP2(COIL_COP_SUBqRI, R(2), I(1));
+  OP2(COIL_COP_CMPqRI, R(2), I(0));
+  BR(COIL_INSTRFLAG_GT, 1);
+  OP2(COIL_COP_SUBqRI, R(6), I(1));
+  OP2(COIL_COP_CMPqRI, R(6), I(0));
+  BR(COIL_INSTRFLAG_GT, 0);
+  OP0(COIL_COP_RET);
+}
+
+/**
+* @brief Bubble sort of signed 32-bit words
+*/
+static void bench_cbc_sort(bench_cbc_kernel_t *k) {
+  k->words = BENCH_CBC_WORDS;
+  k->syms[3] = 0;
+  OP2(COIL_COP_MOVqRI, R(1), I(BENCH_CBC_WORDS - 1));
+  LABEL(0);
+  OP2(COIL_COP_LEAqRS, R(2), coil_cbc_sym(3));
+  OP2(COIL_COP_MOVqRR, R(3), R(1));
+  LABEL(1);
+  OP2(COIL_COP_MOVlROR, R(4), M(2, 0));
+  OP2(COIL_COP_MOVlROR, R(5), M(2, 4));
+  OP2(COIL_COP_CMPlRR, R(4), R(5));
+  BR(COIL_INSTRFLAG_LTE, 2);
+  OP2(COIL_COP_MOVlORR, M(2, 0), R(5));
+  OP2(COIL_COP_MOVlORR, M(2, 4), R(4));
+  LABEL(2);
+  OP2(COIL_COP_ADDqRI, R(2), I(4));
+  OP2(COIL_COP_SUBqRI, R(3), I(1));
+  OP2(COIL_COP_CMPqRI, R(3), I(0));
+  BR(COIL_INSTRFLAG_GT, 1);
+  OP2(COIL_COP_SUBqRI, R(1), I(1));
+  OP2(COIL_COP_CMPqRI, R(1), I(0));
+  BR(COIL_INSTRFLAG_GT, 0);
+  OP0(COIL_COP_RET);
+}
+
+/**
+* @brief Recursive Fibonacci, exercising CALL, RET, PUSH and POP
+*/
+static void bench_cbc_recursive(bench_cbc_kernel_t *k) {
+  OP2(COIL_COP_MOVqRI, R(0), I(25));
+  OP1(COIL_COP_CALLqS, coil_cbc_sym(0));
+  OP0(COIL_COP_RET);
+  LABEL(0);
+  OP2(COIL_COP_CMPqRI, R(0), I(2));
+  BR(COIL_INSTRFLAG_LT, 1);
+  OP1(COIL_COP_PUSHqR, R(0));
+  OP2(COIL_COP_SUBqRI, R(0), I(1));
+  OP1(COIL_COP_CALLqS, coil_cbc_sym(0));
+  OP1(COIL_COP_POPqR, R(1));
+  OP1(COIL_COP_PUSHqR, R(0));
+  OP2(COIL_COP_MOVqRR, R(0), R(1));
+  OP2(COIL_COP_SUBqRI, R(0), I(2));
+  OP1(COIL_COP_CALLqS, coil_cbc_sym(0));
+  OP1(COIL_COP_POPqR, R(1));
+  OP2(COIL_COP_ADDqRR, R(0), R(1));
+  LABEL(1);
+  OP0(COIL_COP_RET);
+}
+
+/**
+* @brief Seconds on the monotonic clock
+*/
+static double bench_cbc_now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+/**
+* @brief How a kernel is run
+*/
+typedef enum bench_cbc_mode_e {
+  BENCH_CBC_SWITCH,            ///< Switch dispatch
+  BENCH_CBC_THREADED,          ///< Threaded dispatch
+  BENCH_CBC_JIT,               ///< Compiled (steps are not counted)
+} bench_cbc_mode_t;
+
+/**
+* @brief Best of several runs of one dispatch loop or of the compiled code
+*/
+static double bench_cbc_time(bench_cbc_kernel_t *k, const coil_cbc_program_t *prog, const coil_jit_t *jit,
+                             bench_cbc_mode_t mode, coil_u64_t *steps, coil_u64_t *fused, coil_u64_t *result) {
+  coil_size_t size = (coil_size_t)k->words * 4;
+  coil_i32_t *memory = (coil_i32_t *)malloc(size + 4);
+  double best = 0;
+  
+  for (int run = 0; run < BENCH_CBC_RUNS; run++) {
+    // Same pseudo-random contents every run
+    coil_u32_t seed = 12345;
+    for (coil_u32_t i = 0; i < k->words; i++) {
+      seed = seed * 1103515245u + 12345u;
+      memory[i] = (coil_i32_t)(seed >> 8) - (1 << 23);
+    }
+    
+    coil_cbc_vm_t vm;
+    coil_cbc_vm_init(&vm, (coil_byte_t *)memory, size, BENCH_CBC_DEPTH);
+    
+    double start = bench_cbc_now();
+    coil_err_t err = mode == BENCH_CBC_JIT ? coil_jit_run(jit, &vm, k->entry, 0)
+                   : mode == BENCH_CBC_THREADED ? coil_cbc_run(&vm, prog, k->entry, 0)
+                   : coil_cbc_run_switch(&vm, prog, k->entry, 0);
+    double elapsed = bench_cbc_now() - start;
+    
+    if (err != COIL_ERR_GOOD) {
+      fprintf(stderr, "%s failed at offset %llu\n", k->name, (unsigned long long)vm.fault);
+      exit(1);
+    }
+    
+    *steps = vm.steps;
+    *fused = vm.fused;
+    *result = vm.regs[0].lo ^ (k->words != 0 ? (coil_u64_t)(coil_u32_t)memory[k->words / 2] : 0);
+    if (run == 0 || elapsed < best) {
+      best = elapsed;
+    }
+    coil_cbc_vm_cleanup(&vm);
+  }
+  
+  free(memory);
+  return best;
+}
+
+/**
+* @brief Print the most frequent opcode pairs of all kernels
+*/
+static void bench_cbc_pairs(bench_cbc_kernel_t *kernels, coil_size_t count) {
+  coil_cbc_pair_profile_t profile;
+  coil_cbc_pair_profile_init(&profile);
+  for (coil_size_t i = 0; i < count; i++) {
+    coil_cbc_pair_profile_add(&profile, kernels[i].code.data, kernels[i].code.size);
+  }
+  coil_cbc_pair_profile_sort(&profile);
+  
+  printf("%llu static pairs, %llu with a fused opcode\n", (unsigned long long)profile.total,
+         (unsigned long long)profile.fusable);
+  for (coil_u32_t i = 0; i < profile.count && i < 8; i++) {
+    const coil_cbc_pair_t *pair = &profile.pairs[i];
+    const coil_cbc_info_t *a = coil_cbc_info(pair->first);
+    const coil_cbc_info_t *b = coil_cbc_info(pair->second);
+    coil_cbc_opcode_t op;
+    printf("  %5u %5u  operations %2u/%u + %2u/%u  x%llu%s\n", (unsigned)pair->first, (unsigned)pair->second,
+           (unsigned)a->operation, (unsigned)a->width, (unsigned)b->operation, (unsigned)b->width,
+           (unsigned long long)pair->count,
+           coil_cbc_fused_for(pair->first, pair->second, &op) == COIL_ERR_GOOD ? "  fused" : "");
+  }
+  printf("\n");
+  coil_cbc_pair_profile_cleanup(&profile);
+}
+
+int main(void) {
+  void (*builders[])(bench_cbc_kernel_t *) = {
+    bench_cbc_sum, bench_cbc_fib, bench_cbc_checksum, bench_cbc_sort, bench_cbc_recursive,
+  };
+  const char *names[] = { "sum", "fib", "checksum", "bubble sort", "recursive fib" };
+  const coil_size_t count = sizeof(builders) / sizeof(builders[0]);
+  bench_cbc_kernel_t kernels[sizeof(builders) / sizeof(builders[0])];
+  int failed = 0;
+  
+  for (coil_size_t i = 0; i < count; i++) {
+    memset(&kernels[i], 0, sizeof(kernels[i]));
+    kernels[i].name = names[i];
+    coil_section_init(&kernels[i].code, 256);
+    builders[i](&kernels[i]);
+  }
+  
+  bench_cbc_pairs(kernels, count);
+  
+  printf("%-14s %12s %10s %10s %10s %8s %8s\n", "kernel", "instructions", "switch", "threaded", "jit", "speedup", "jit");
+  
+  for (coil_size_t i = 0; i < count; i++) {
+    bench_cbc_kernel_t *k = &kernels[i];
+    
+    coil_cbc_program_t prog;
+    if (coil_cbc_program_init(&prog, k->code.data, k->code.size, k->syms, 4) != COIL_ERR_GOOD) {
+      fprintf(stderr, "Predecoding %s failed\n", k->name);
+      return 1;
+    }
+    
+    coil_jit_t jit;
+    coil_err_t compiled = coil_jit_compile(&jit, k->code.data, k->code.size, k->syms, 4);
+    
+    coil_u64_t steps, fused, result, reference_steps, reference, jit_steps, jit_result;
+    double switched = bench_cbc_time(k, &prog, NULL, BENCH_CBC_SWITCH, &reference_steps, &fused, &reference);
+    double threaded = bench_cbc_time(k, &prog, NULL, BENCH_CBC_THREADED, &steps, &fused, &result);
+    if (steps != reference_steps || result != reference) {
+      fprintf(stderr, "%s: dispatch loops disagree\n", k->name);
+      failed = 1;
+    }
+    
+    // Hosts without the JIT only report the interpreters
+    double native = 0;
+    if (compiled == COIL_ERR_GOOD) {
+      native = bench_cbc_time(k, &prog, &jit, BENCH_CBC_JIT, &jit_steps, &fused, &jit_result);
+      if (jit_result != reference) {
+        fprintf(stderr, "%s: compiled code disagrees\n", k->name);
+        failed = 1;
+      }
+      coil_jit_cleanup(&jit);
+    }
+    
+    printf("%-14s %12llu %8.2fns %8.2fns %8.2fns %7.2fx %7.2fx\n", k->name, (unsigned long long)steps,
+           switched * 1e9 / (double)steps, threaded * 1e9 / (double)steps, native * 1e9 / (double)steps,
+           switched / threaded, native > 0 ? threaded / native : 0.0);
+    
+    coil_cbc_program_cleanup(&prog);
+  }
+  
+  // The same kernels with their common pairs fused
+  printf("\n%-14s %6s %12s %12s %9s %10s %10s\n", "kernel", "pairs", "dispatches", "fused", "saved", "threaded", "fused");
+  
+  for (coil_size_t i = 0; i < count; i++) {
+    bench_cbc_kernel_t *k = &kernels[i];
+    coil_cbc_program_t plain, fused_prog;
+    coil_u64_t steps, fused, result, fused_steps, pairs_run, fused_result;
+    
+    coil_cbc_program_init(&plain, k->code.data, k->code.size, k->syms, 4);
+    double threaded = bench_cbc_time(k, &plain, NULL, BENCH_CBC_THREADED, &steps, &fused, &result);
+    coil_cbc_program_cleanup(&plain);
+    
+    coil_u32_t pairs = 0;
+    if (coil_cbc_fuse(k->code.data, k->code.size, &pairs) != COIL_ERR_GOOD ||
+        coil_cbc_program_init(&fused_prog, k->code.data, k->code.size, k->syms, 4) != COIL_ERR_GOOD) {
+      fprintf(stderr, "Fusing %s failed\n", k->name);
+      return 1;
+    }
+    double fast = bench_cbc_time(k, &fused_prog, NULL, BENCH_CBC_THREADED, &fused_steps, &pairs_run, &fused_result);
+    coil_u64_t switch_steps, switch_pairs, switch_result;
+    bench_cbc_time(k, &fused_prog, NULL, BENCH_CBC_SWITCH, &switch_steps, &switch_pairs, &switch_result);
+    if (fused_steps != steps || fused_result != result || switch_pairs != pairs_run || switch_result != result) {
+      fprintf(stderr, "%s: fused pairs disagree\n", k->name);
+      failed = 1;
+    }
+    
+    printf("%-14s %6u %12llu %12llu %8.1f%% %8.2fms %8.2fms\n", k->name, (unsigned)pairs,
+           (unsigned long long)steps, (unsigned long long)(steps - pairs_run),
+           100.0 * (double)pairs_run / (double)steps, threaded * 1e3, fast * 1e3);
+    
+    coil_cbc_program_cleanup(&fused_prog);
+    coil_section_cleanup(&k->code);
+  }
+  
+  return failed;
+}
@@ -0,0 +1,127 @@
+/**
+* @file bench_cfg.c
+* @brief Benchmark of building control-flow graphs across thread counts
+*
+* @author Low Level Team
+*/
+
+#include <coil/cfg.h>
+#include <coil/instr.h>
+#include <coil/par.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define BENCH_CFG_FUNCTIONS 20000
+#define BENCH_CFG_LABELS 8
+#define BENCH_CFG_RUNS 3
+
+/**
+* @brief Monotonic time in seconds
+*/
+static double bench_cfg_now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+/**
+* @brief Encode an operand with 8 bytes of data
+*/
+static void bench_cfg_operand(coil_section_t *ir, coil_u8_t type, coil_u8_t value_type, coil_u64_t value) {
+  coil_operand_encode(ir, type, value_type, COIL_MOD_NONE);
+  coil_operand_encode_data(ir, &value, 8);
+}
+
+/**
+* @brief Functions of mixed sizes with branches between their own labels
+*/
+static void bench_cfg_build(coil_section_t *ir, coil_lower_func_t *funcs, coil_u64_t *syms) {
+  coil_u64_t state = 0x2545F4914F6CDD1Dull;
+  
+  for (int f = 0; f < BENCH_CFG_FUNCTIONS; f++) {
+    funcs[f].offset = ir->size;
+    state ^= state << 13; state ^= state >> 7; state ^= state << 17;
+    int length = f % 500 == 0 ? 20000 : 20 + (int)(state % 200);
+    int step = length / BENCH_CFG_LABELS;
+    
+    for (int i = 0; i < length; i++) {
+      if (i % step == 0 && i / step < BENCH_CFG_LABELS) {
+        syms[f * BENCH_CFG_LABELS + i / step] = ir->size;
+      }
+      state ^= state << 13; state ^= state >> 7; state ^= state << 17;
+      coil_u64_t label = (coil_u64_t)f * BENCH_CFG_LABELS + (state >> 8) % BENCH_CFG_LABELS;
+      switch ((state >> 16) % 8) {
+        case 0:
+          coil_instrflag_encode(ir, COIL_OP_BR, (coil_u8_t)(1 + (state >> 24) % 6));
+          bench_cfg_operand(ir, COIL_TYPEOP_SYM, COIL_VAL_SYM, label);
+          break;
+        case 1:
+          coil_instr_encode(ir, COIL_OP_JMP);
+          bench_cfg_operand(ir, COIL_TYPEOP_SYM, COIL_VAL_SYM, label);
+          break;
+        default:
+          coil_instrflag_encode(ir, COIL_OP_ADD, COIL_INSTRFLAG_NONE);
+          bench_cfg_operand(ir, COIL_TYPEOP_VAR, COIL_VAL_I64, (state >> 32) % 16);
+          bench_cfg_operand(ir, COIL_TYPEOP_IMM, COIL_VAL_I64, state >> 40);
+          break;
+      }
+    }
+    coil_instr_encode(ir, COIL_OP_RET);
+    funcs[f].size = ir->size - funcs[f].offset;
+  }
+}
+
+int main(void) {
+  coil_section_t ir;
+  coil_section_init(&ir, (coil_size_t)64 << 20);
+  coil_lower_func_t *funcs = (coil_lower_func_t *)malloc(BENCH_CFG_FUNCTIONS * sizeof(coil_lower_func_t));
+  coil_u64_t *syms = (coil_u64_t *)malloc(BENCH_CFG_FUNCTIONS * BENCH_CFG_LABELS * sizeof(coil_u64_t));
+  coil_cfg_t *cfgs = (coil_cfg_t *)malloc(BENCH_CFG_FUNCTIONS * sizeof(coil_cfg_t));
+  bench_cfg_build(&ir, funcs, syms);
+  
+  coil_u32_t counts[] = { 1, 2, 4, coil_par_default_threads() };
+  double serial = 0;
+  
+  printf("%llu functions, %.1f MiB of COIL\n", (unsigned long long)BENCH_CFG_FUNCTIONS, (double)ir.size / (1 << 20));
+  printf("%-8s %10s %10s %10s %8s\n", "threads", "time", "MiB/s", "blocks", "speedup");
+  
+  for (coil_size_t i = 0; i < sizeof(counts) / sizeof(counts[0]); i++) {
+    double best = 0;
+    coil_u64_t blocks = 0;
+    
+    for (int run = 0; run < BENCH_CFG_RUNS; run++) {
+      coil_u64_t fault = 0;
+      double start = bench_cfg_now();
+      coil_err_t err = coil_cfg_build_all(cfgs, &ir, funcs, BENCH_CFG_FUNCTIONS, syms,
+                                          BENCH_CFG_FUNCTIONS * BENCH_CFG_LABELS, counts[i], &fault);
+      double elapsed = bench_cfg_now() - start;
+      
+      if (err != COIL_ERR_GOOD) {
+        fprintf(stderr, "Graph build failed at offset %llu\n", (unsigned long long)fault);
+        return 1;
+      }
+      if (run == 0 || elapsed < best) {
+        best = elapsed;
+      }
+      
+      blocks = 0;
+      for (int f = 0; f < BENCH_CFG_FUNCTIONS; f++) {
+        blocks += cfgs[f].count;
+        coil_cfg_cleanup(&cfgs[f]);
+      }
+    }
+    
+    if (i == 0) {
+      serial = best;
+    }
+    printf("%-8u %8.2fms %10.1f %10llu %7.2fx\n", (unsigned)counts[i], best * 1e3,
+           (double)ir.size / (1 << 20) / best, (unsigned long long)blocks, serial / best);
+  }
+  
+  free(cfgs);
+  free(syms);
+  free(funcs);
+  coil_section_cleanup(&ir);
+  return 0;
+}
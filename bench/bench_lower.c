@@ -0,0 +1,139 @@
+/**
+* @file bench_lower.c
+* @brief Benchmark of lowering COIL to CBC across thread counts
+*
+* @author Low Level Team
+*/
+
+#include <coil/lower.h>
+#include <coil/instr.h>
+#include <coil/par.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define BENCH_LOWER_FUNCTIONS 20000
+#define BENCH_LOWER_RUNS 3
+
+/**
+* @brief Monotonic time in seconds
+*/
+static double bench_lower_now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+/**
+* @brief Encode an operand with 4 or 8 bytes of data
+*/
+static void bench_lower_operand(coil_section_t *ir, coil_u8_t type, coil_u8_t value_type, coil_u64_t value) {
+  coil_operand_encode(ir, type, value_type, COIL_MOD_NONE);
+  if (value_type == COIL_VAL_I32) {
+    coil_u32_t v = (coil_u32_t)value;
+    coil_operand_encode_data(ir, &v, 4);
+  } else {
+    coil_operand_encode_data(ir, &value, 8);
+  }
+}
+
+/**
+* @brief Functions of mixed sizes (mostly small, a few very large)
+*/
+static void bench_lower_build(coil_section_t *ir, coil_lower_func_t *funcs) {
+  static const coil_u8_t ops[] = { COIL_OP_MOV, COIL_OP_ADD, COIL_OP_SUB, COIL_OP_AND, COIL_OP_XOR, COIL_OP_CMP };
+  coil_u64_t state = 0x2545F4914F6CDD1Dull;
+  
+  for (int f = 0; f < BENCH_LOWER_FUNCTIONS; f++) {
+    funcs[f].offset = ir->size;
+    state ^= state << 13; state ^= state >> 7; state ^= state << 17;
+    int length = f % 500 == 0 ? 20000 : 20 + (int)(state % 200);
+    
+    for (int i = 0; i < length; i++) {
+      state ^= state << 13; state ^= state >> 7; state ^= state << 17;
+      coil_u8_t type = state & 1 ? COIL_VAL_I32 : COIL_VAL_I64;
+      switch ((state >> 8) % 8) {
+        case 0:
+          coil_instrflag_encode(ir, COIL_OP_BR, (coil_u8_t)(1 + (state >> 16) % 6));
+          bench_lower_operand(ir, COIL_TYPEOP_SYM, COIL_VAL_SYM, (state >> 24) % 64);
+          break;
+        case 1:
+          coil_instr_encode(ir, COIL_OP_CVT);
+          bench_lower_operand(ir, COIL_TYPEOP_VAR, COIL_VAL_I64, (state >> 16) % 32);
+          bench_lower_operand(ir, COIL_TYPEOP_REG, COIL_VAL_I32, (state >> 24) % 16);
+          break;
+        default:
+          coil_instrflag_encode(ir, ops[(state >> 16) % 6], COIL_INSTRFLAG_NONE);
+          bench_lower_operand(ir, (state >> 24) & 1 ? COIL_TYPEOP_VAR : COIL_TYPEOP_REG, type, (state >> 32) % 16);
+          bench_lower_operand(ir, (state >> 25) & 1 ? COIL_TYPEOP_IMM : COIL_TYPEOP_REG, type, (state >> 40) % 16);
+          break;
+      }
+    }
+    coil_instr_encode(ir, COIL_OP_RET);
+    funcs[f].size = ir->size - funcs[f].offset;
+  }
+}
+
+int main(void) {
+  coil_section_t ir;
+  coil_section_init(&ir, (coil_size_t)64 << 20);
+  coil_lower_func_t *funcs = (coil_lower_func_t *)malloc(BENCH_LOWER_FUNCTIONS * sizeof(coil_lower_func_t));
+  bench_lower_build(&ir, funcs);
+  
+  coil_u32_t counts[] = { 1, 2, 4, coil_par_default_threads() };
+  coil_section_t reference;
+  coil_section_init(&reference, 0);
+  double serial = 0;
+  int failed = 0;
+  
+  printf("%llu functions, %.1f MiB of COIL\n", (unsigned long long)BENCH_LOWER_FUNCTIONS, (double)ir.size / (1 << 20));
+  printf("%-8s %10s %10s %8s\n", "threads", "time", "MiB/s", "speedup");
+  
+  for (coil_size_t i = 0; i < sizeof(counts) / sizeof(counts[0]); i++) {
+    coil_lower_options_t options;
+    coil_lower_options_init(&options);
+    options.threads = counts[i];
+    
+    double best = 0;
+    for (int run = 0; run < BENCH_LOWER_RUNS; run++) {
+      coil_section_t out;
+      coil_lower_t lower;
+      coil_section_init(&out, 0);
+      
+      double start = bench_lower_now();
+      coil_err_t err = coil_lower_section(&lower, &out, &ir, funcs, BENCH_LOWER_FUNCTIONS, &options);
+      double elapsed = bench_lower_now() - start;
+      
+      if (err != COIL_ERR_GOOD) {
+        fprintf(stderr, "Lowering failed at offset %llu\n", (unsigned long long)lower.fault);
+        return 1;
+      }
+      if (run == 0 || elapsed < best) {
+        best = elapsed;
+      }
+      
+      if (i == 0 && run == 0) {
+        coil_size_t written;
+        coil_section_write(&reference, out.data, out.size, &written);
+      } else if (out.size != reference.size || memcmp(out.data, reference.data, out.size) != 0) {
+        fprintf(stderr, "%u threads produced different code\n", (unsigned)counts[i]);
+        failed = 1;
+      }
+      
+      coil_lower_cleanup(&lower);
+      coil_section_cleanup(&out);
+    }
+    
+    if (i == 0) {
+      serial = best;
+    }
+    printf("%-8u %8.2fms %10.1f %7.2fx\n", (unsigned)counts[i], best * 1e3,
+           (double)ir.size / (1 << 20) / best, serial / best);
+  }
+  
+  coil_section_cleanup(&reference);
+  coil_section_cleanup(&ir);
+  free(funcs);
+  return failed;
+}
@@ -0,0 +1,208 @@
+/**
+* @file bench_peep.c
+* @brief Benchmark of the peephole pass and of the code it leaves to lower and run
+*
+* @author Low Level Team
+*/
+
+#include <coil/peep.h>
+#include <coil/lower.h>
+#include <coil/instr.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define BENCH_PEEP_BLOCKS 200000
+#define BENCH_PEEP_MEMORY 65536
+#define BENCH_PEEP_ITERATIONS 1000000
+
+/**
+* @brief Monotonic time in seconds
+*/
+static double bench_peep_now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+/**
+* @brief Encode an operand with 8 bytes of data
+*/
+static void bench_peep_operand(coil_section_t *ir, coil_u8_t type, coil_u64_t value) {
+  coil_operand_encode(ir, type, type == COIL_TYPEOP_SYM ? COIL_VAL_SYM : COIL_VAL_I64, COIL_MOD_NONE);
+  coil_operand_encode_data(ir, &value, 8);
+}
+
+/**
+* @brief Encode a two-operand instruction
+*/
+static void bench_peep_op(coil_section_t *ir, coil_u8_t opcode, coil_u8_t dst_type, coil_u64_t dst,
+                          coil_u8_t src_type, coil_u64_t src) {
+  coil_instrflag_encode(ir, opcode, COIL_INSTRFLAG_NONE);
+  bench_peep_operand(ir, dst_type, dst);
+  bench_peep_operand(ir, src_type, src);
+}
+
+/**
+* @brief Blocks of the copies and constant arithmetic naive lowering leaves behind
+*/
+static void bench_peep_build(coil_section_t *ir) {
+  for (coil_u64_t i = 0; i < BENCH_PEEP_BLOCKS; i++) {
+    coil_u64_t a = i % 16, b = (i + 5) % 16;
+    bench_peep_op(ir, COIL_OP_MOV, COIL_TYPEOP_VAR, a, COIL_TYPEOP_IMM, i);
+    bench_peep_op(ir, COIL_OP_ADD, COIL_TYPEOP_VAR, a, COIL_TYPEOP_IMM, 8);
+    bench_peep_op(ir, COIL_OP_SHL, COIL_TYPEOP_VAR, a, COIL_TYPEOP_IMM, 3);
+    bench_peep_op(ir, COIL_OP_MOV, COIL_TYPEOP_VAR, b, COIL_TYPEOP_VAR, a);
+    bench_peep_op(ir, COIL_OP_MOV, COIL_TYPEOP_VAR, a, COIL_TYPEOP_VAR, b);
+    bench_peep_op(ir, COIL_OP_ADD, COIL_TYPEOP_VAR, b, COIL_TYPEOP_VAR, a);
+    bench_peep_op(ir, COIL_OP_ADD, COIL_TYPEOP_VAR, b, COIL_TYPEOP_IMM, 0);
+    bench_peep_op(ir, COIL_OP_CMP, COIL_TYPEOP_VAR, b, COIL_TYPEOP_IMM, 100);
+    coil_instrflag_encode(ir, COIL_OP_BR, COIL_INSTRFLAG_EQ);
+    bench_peep_operand(ir, COIL_TYPEOP_SYM, 0);
+    bench_peep_op(ir, COIL_OP_CMP, COIL_TYPEOP_VAR, b, COIL_TYPEOP_IMM, 100);
+    coil_instrflag_encode(ir, COIL_OP_BR, COIL_INSTRFLAG_LT);
+    bench_peep_operand(ir, COIL_TYPEOP_SYM, 0);
+    if (i % 4 == 0) {
+      coil_instr_encode(ir, COIL_OP_NOP);
+    }
+  }
+  coil_instr_encode(ir, COIL_OP_RET);
+}
+
+/**
+* @brief Time lowering a section and return the size of the bytecode
+*/
+static double bench_peep_lower(coil_section_t *code, coil_size_t *size) {
+  coil_section_t out;
+  coil_lower_t lower;
+  coil_section_init(&out, code->size * 2);
+  double start = bench_peep_now();
+  coil_err_t err = coil_lower_section(&lower, &out, code, NULL, 0, NULL);
+  double elapsed = bench_peep_now() - start;
+  *size = out.size;
+  if (err == COIL_ERR_GOOD) {
+    coil_lower_cleanup(&lower);
+  }
+  coil_section_cleanup(&out);
+  return err == COIL_ERR_GOOD ? elapsed : -1;
+}
+
+/**
+* @brief Lower a function and time it in the interpreter
+*/
+static double bench_peep_run(coil_section_t *code, coil_u64_t loop, coil_byte_t *memory, coil_u64_t *result) {
+  coil_section_t out;
+  coil_lower_t lower;
+  coil_u64_t syms[2] = {0};
+  coil_section_init(&out, code->size * 2);
+  if (coil_lower_section(&lower, &out, code, NULL, 0, NULL) != COIL_ERR_GOOD ||
+      coil_lower_offset(&lower, loop, &syms[1]) != COIL_ERR_GOOD) {
+    return -1;
+  }
+  
+  coil_cbc_program_t prog;
+  coil_cbc_vm_t vm;
+  double elapsed = -1;
+  memset(memory, 0, BENCH_PEEP_MEMORY);
+  if (coil_cbc_program_init(&prog, out.data, out.size, syms, 2) == COIL_ERR_GOOD) {
+    if (coil_cbc_vm_init(&vm, memory, BENCH_PEEP_MEMORY, 16) == COIL_ERR_GOOD) {
+      vm.regs[COIL_LOWER_FRAME_REG].lo = 1024;
+      double start = bench_peep_now();
+      if (coil_cbc_run(&vm, &prog, 0, 0) == COIL_ERR_GOOD) {
+        elapsed = bench_peep_now() - start;
+        memcpy(result, memory, sizeof(*result));
+      }
+      coil_cbc_vm_cleanup(&vm);
+    }
+    coil_cbc_program_cleanup(&prog);
+  }
+  coil_lower_cleanup(&lower);
+  coil_section_cleanup(&out);
+  return elapsed;
+}
+
+int main(void) {
+  static const char *names[] = { "nop", "mov-self", "mov-back", "mov-dead", "identity", "fold", "combine", "cmp" };
+  coil_section_t ir, out;
+  coil_section_init(&ir, (coil_size_t)64 << 20);
+  coil_section_init(&out, (coil_size_t)64 << 20);
+  bench_peep_build(&ir);
+  
+  coil_peep_t peep;
+  double start = bench_peep_now();
+  coil_err_t err = coil_peep_section(&peep, &out, &ir, 0, ir.size, NULL, 0, COIL_PEEP_ALL);
+  double elapsed = bench_peep_now() - start;
+  if (err != COIL_ERR_GOOD) {
+    fprintf(stderr, "Peephole pass failed at offset %llu\n", (unsigned long long)peep.fault);
+    return 1;
+  }
+  
+  printf("Peephole: %u instructions, %.2f MiB\n", (unsigned)peep.instr_count, (double)ir.size / (1 << 20));
+  printf("%-12s %8.2fms %12.0f instrs/s %8.2f MiB/s\n", "pass", elapsed * 1e3, peep.instr_count / elapsed,
+         (double)ir.size / (1 << 20) / elapsed);
+  printf("%-12s %8u of %u (%.1f%%), %llu to %llu bytes\n", "removed", (unsigned)peep.removed,
+         (unsigned)peep.instr_count, 100.0 * peep.removed / peep.instr_count, (unsigned long long)ir.size,
+         (unsigned long long)out.size);
+  for (int i = 0; i < COIL_PEEP_RULE_COUNT; i++) {
+    printf("  %-10s %8u\n", names[i], (unsigned)peep.hits[i]);
+  }
+  coil_peep_cleanup(&peep);
+  
+  coil_size_t before_size = 0, after_size = 0;
+  double before = bench_peep_lower(&ir, &before_size);
+  double after = bench_peep_lower(&out, &after_size);
+  printf("\nLowering to CBC\n");
+  printf("%-12s %8.2fms %10llu bytes\n", "original", before * 1e3, (unsigned long long)before_size);
+  printf("%-12s %8.2fms %10llu bytes\n", "optimized", after * 1e3, (unsigned long long)after_size);
+  coil_section_cleanup(&out);
+  coil_section_cleanup(&ir);
+  
+  // for (v1 = n; v1 > 0; v1--) { v2 = 3; v2 += 4; v2 <<= 1; v0 += v2; v3 = v0; v0 = v3; v0 += 0 }
+  coil_section_t loop, optimized;
+  coil_section_init(&loop, 1024);
+  coil_section_init(&optimized, 1024);
+  bench_peep_op(&loop, COIL_OP_MOV, COIL_TYPEOP_VAR, 0, COIL_TYPEOP_IMM, 0);
+  bench_peep_op(&loop, COIL_OP_MOV, COIL_TYPEOP_VAR, 1, COIL_TYPEOP_IMM, BENCH_PEEP_ITERATIONS);
+  coil_u64_t top = loop.size;
+  bench_peep_op(&loop, COIL_OP_MOV, COIL_TYPEOP_VAR, 2, COIL_TYPEOP_IMM, 3);
+  bench_peep_op(&loop, COIL_OP_ADD, COIL_TYPEOP_VAR, 2, COIL_TYPEOP_IMM, 4);
+  bench_peep_op(&loop, COIL_OP_SHL, COIL_TYPEOP_VAR, 2, COIL_TYPEOP_IMM, 1);
+  bench_peep_op(&loop, COIL_OP_ADD, COIL_TYPEOP_VAR, 0, COIL_TYPEOP_VAR, 2);
+  bench_peep_op(&loop, COIL_OP_MOV, COIL_TYPEOP_VAR, 3, COIL_TYPEOP_VAR, 0);
+  bench_peep_op(&loop, COIL_OP_MOV, COIL_TYPEOP_VAR, 0, COIL_TYPEOP_VAR, 3);
+  bench_peep_op(&loop, COIL_OP_ADD, COIL_TYPEOP_VAR, 0, COIL_TYPEOP_IMM, 0);
+  bench_peep_op(&loop, COIL_OP_SUB, COIL_TYPEOP_VAR, 1, COIL_TYPEOP_IMM, 1);
+  bench_peep_op(&loop, COIL_OP_CMP, COIL_TYPEOP_VAR, 1, COIL_TYPEOP_IMM, 0);
+  coil_instrflag_encode(&loop, COIL_OP_BR, COIL_INSTRFLAG_GT);
+  bench_peep_operand(&loop, COIL_TYPEOP_SYM, 1);
+  coil_offset_t at = { 0, 0, 0 };
+  coil_instrflag_encode(&loop, COIL_OP_MOV, COIL_INSTRFLAG_NONE);
+  coil_operand_encode_off(&loop, COIL_TYPEOP_OFF, COIL_VAL_SYM, COIL_MOD_NONE, &at);
+  coil_u64_t data = 0;
+  coil_operand_encode_data(&loop, &data, 8);
+  bench_peep_operand(&loop, COIL_TYPEOP_VAR, 0);
+  coil_instr_encode(&loop, COIL_OP_RET);
+  
+  coil_u64_t loop_syms[2] = { 0, top }, moved = 0;
+  if (coil_peep_section(&peep, &optimized, &loop, 0, loop.size, loop_syms, 2, COIL_PEEP_ALL) != COIL_ERR_GOOD ||
+      coil_peep_offset(&peep, top, &moved) != COIL_ERR_GOOD) {
+    fprintf(stderr, "Loop optimization failed\n");
+    return 1;
+  }
+  
+  static coil_byte_t memory[BENCH_PEEP_MEMORY];
+  coil_u64_t original_result = 0, optimized_result = 0;
+  double original = bench_peep_run(&loop, top, memory, &original_result);
+  double faster = bench_peep_run(&optimized, moved, memory, &optimized_result);
+  printf("\nInterpreted loop: %d iterations, %u of %u instructions removed\n", BENCH_PEEP_ITERATIONS,
+         (unsigned)peep.removed, (unsigned)peep.instr_count);
+  printf("%-12s %8.2fms\n", "original", original * 1e3);
+  printf("%-12s %8.2fms %s\n", "optimized", faster * 1e3,
+         original_result == optimized_result ? "(same result)" : "(MISMATCH)");
+  
+  coil_peep_cleanup(&peep);
+  coil_section_cleanup(&optimized);
+  coil_section_cleanup(&loop);
+  return 0;
+}
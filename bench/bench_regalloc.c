@@ -0,0 +1,209 @@
+/**
+* @file bench_regalloc.c
+* @brief Benchmark of linear-scan allocation per target and of running allocated code
+*
+* @author Low Level Team
+*/
+
+#include <coil/regalloc.h>
+#include <coil/lower.h>
+#include <coil/instr.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define BENCH_REGALLOC_BLOCKS 20000
+#define BENCH_REGALLOC_WINDOW 48
+#define BENCH_REGALLOC_MEMORY 65536
+#define BENCH_REGALLOC_ITERATIONS 1000000
+
+/**
+* @brief Monotonic time in seconds
+*/
+static double bench_regalloc_now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+/**
+* @brief Encode an operand with 8 bytes of data
+*/
+static void bench_regalloc_operand(coil_section_t *ir, coil_u8_t type, coil_u64_t value) {
+  coil_operand_encode(ir, type, type == COIL_TYPEOP_SYM ? COIL_VAL_SYM : COIL_VAL_I64, COIL_MOD_NONE);
+  coil_operand_encode_data(ir, &value, 8);
+}
+
+/**
+* @brief Encode a two-operand instruction
+*/
+static void bench_regalloc_op(coil_section_t *ir, coil_u8_t opcode, coil_u8_t dst_type, coil_u64_t dst,
+                              coil_u8_t src_type, coil_u64_t src) {
+  coil_instrflag_encode(ir, opcode, COIL_INSTRFLAG_NONE);
+  bench_regalloc_operand(ir, dst_type, dst);
+  bench_regalloc_operand(ir, src_type, src);
+}
+
+/**
+* @brief Blocks over a sliding window of variables, looping back every 10 blocks and calling every 25
+*
+* Block i defines the variable entering the window, so each is live over
+* the blocks that use it rather than from the function entry.
+*/
+static void bench_regalloc_build(coil_section_t *ir, coil_u64_t *syms) {
+  for (coil_u64_t v = 0; v + 1 < BENCH_REGALLOC_WINDOW; v++) {
+    bench_regalloc_op(ir, COIL_OP_MOV, COIL_TYPEOP_VAR, v, COIL_TYPEOP_IMM, v);
+  }
+  for (coil_u64_t i = 0; i < BENCH_REGALLOC_BLOCKS; i++) {
+    syms[i] = ir->size;
+    bench_regalloc_op(ir, COIL_OP_MOV, COIL_TYPEOP_VAR, i + BENCH_REGALLOC_WINDOW - 1, COIL_TYPEOP_IMM, i);
+    for (coil_u64_t k = 0; k < 8; k++) {
+      coil_u64_t dst = i + (k * 7) % BENCH_REGALLOC_WINDOW;
+      bench_regalloc_op(ir, k % 3 ? COIL_OP_ADD : COIL_OP_MOV, COIL_TYPEOP_VAR, dst,
+                        COIL_TYPEOP_VAR, i + (k * 13 + 5) % BENCH_REGALLOC_WINDOW);
+    }
+    if (i % 25 == 24) {
+      coil_instrflag_encode(ir, COIL_OP_CALL, COIL_INSTRFLAG_NONE);
+      bench_regalloc_operand(ir, COIL_TYPEOP_SYM, 0);
+    }
+    if (i % 10 == 9) {
+      coil_instrflag_encode(ir, COIL_OP_BR, COIL_INSTRFLAG_NEQ);
+      bench_regalloc_operand(ir, COIL_TYPEOP_SYM, i - 5);
+    }
+  }
+  coil_instr_encode(ir, COIL_OP_RET);
+}
+
+/**
+* @brief Lower a function and time it in the interpreter
+*/
+static double bench_regalloc_run(coil_section_t *code, coil_u64_t loop, coil_byte_t *memory, coil_u64_t *result) {
+  coil_section_t out;
+  coil_lower_t lower;
+  coil_u64_t syms[2] = {0};
+  coil_section_init(&out, code->size * 2);
+  if (coil_lower_section(&lower, &out, code, NULL, 0, NULL) != COIL_ERR_GOOD ||
+      coil_lower_offset(&lower, loop, &syms[1]) != COIL_ERR_GOOD) {
+    return -1;
+  }
+  
+  coil_cbc_program_t prog;
+  coil_cbc_vm_t vm;
+  double elapsed = -1;
+  memset(memory, 0, BENCH_REGALLOC_MEMORY);
+  if (coil_cbc_program_init(&prog, out.data, out.size, syms, 2) == COIL_ERR_GOOD) {
+    if (coil_cbc_vm_init(&vm, memory, BENCH_REGALLOC_MEMORY, 16) == COIL_ERR_GOOD) {
+      vm.regs[COIL_LOWER_FRAME_REG].lo = 1024;
+      double start = bench_regalloc_now();
+      if (coil_cbc_run(&vm, &prog, 0, 0) == COIL_ERR_GOOD) {
+        elapsed = bench_regalloc_now() - start;
+        memcpy(result, memory, sizeof(*result));
+      }
+      coil_cbc_vm_cleanup(&vm);
+    }
+    coil_cbc_program_cleanup(&prog);
+  }
+  coil_lower_cleanup(&lower);
+  coil_section_cleanup(&out);
+  return elapsed;
+}
+
+int main(void) {
+  coil_section_t ir;
+  coil_section_init(&ir, (coil_size_t)16 << 20);
+  coil_u64_t *syms = (coil_u64_t *)malloc(BENCH_REGALLOC_BLOCKS * sizeof(coil_u64_t));
+  bench_regalloc_build(&ir, syms);
+  
+  coil_cfg_t cfg;
+  if (coil_cfg_build(&cfg, &ir, 0, ir.size, syms, BENCH_REGALLOC_BLOCKS) != COIL_ERR_GOOD) {
+    fprintf(stderr, "Graph build failed at offset %llu\n", (unsigned long long)cfg.fault);
+    return 1;
+  }
+  
+  static const coil_u8_t archs[] = { COIL_CPU_x86_32, COIL_CPU_x86_64, COIL_CPU_ARM32, COIL_CPU_ARM64, COIL_CPU_NONE };
+  static const char *names[] = { "x86", "x86-64", "arm", "arm64", "cbc" };
+  printf("Allocation: %u blocks, window of %d variables\n", (unsigned)cfg.count, BENCH_REGALLOC_WINDOW);
+  printf("%-8s %5s %10s %10s %8s %8s %8s %12s\n", "target", "regs", "allocate", "rewrite", "splits", "spills",
+         "slots", "instrs/s");
+  for (int i = 0; i < 5; i++) {
+    coil_regalloc_t ra;
+    coil_regalloc_options_t options;
+    coil_regalloc_options_init(&options);
+    options.arch = archs[i];
+    
+    double start = bench_regalloc_now();
+    coil_err_t err = coil_regalloc_build(&ra, &cfg, &ir, &options);
+    double allocate = bench_regalloc_now() - start;
+    if (err != COIL_ERR_GOOD) {
+      fprintf(stderr, "Allocation failed\n");
+      return 1;
+    }
+    
+    coil_section_t out;
+    coil_section_init(&out, ir.size * 2);
+    start = bench_regalloc_now();
+    err = coil_regalloc_rewrite(&ra, &out, &ir);
+    double rewrite = bench_regalloc_now() - start;
+    if (err != COIL_ERR_GOOD) {
+      fprintf(stderr, "Rewrite failed\n");
+      return 1;
+    }
+    printf("%-8s %5u %8.2fms %8.2fms %8u %8u %8u %12.0f\n", names[i], (unsigned)ra.reg_count, allocate * 1e3,
+           rewrite * 1e3, (unsigned)ra.splits, (unsigned)ra.spills, (unsigned)ra.slots, ra.instr_count / allocate);
+    coil_section_cleanup(&out);
+    coil_regalloc_cleanup(&ra);
+  }
+  coil_cfg_cleanup(&cfg);
+  free(syms);
+  coil_section_cleanup(&ir);
+  
+  // for (v1 = n; v1 > 0; v1--) { v0 += v1; v2 ^= v0; v0 += v2 }
+  coil_section_t loop;
+  coil_section_init(&loop, 1024);
+  bench_regalloc_op(&loop, COIL_OP_MOV, COIL_TYPEOP_VAR, 0, COIL_TYPEOP_IMM, 0);
+  bench_regalloc_op(&loop, COIL_OP_MOV, COIL_TYPEOP_VAR, 1, COIL_TYPEOP_IMM, BENCH_REGALLOC_ITERATIONS);
+  bench_regalloc_op(&loop, COIL_OP_MOV, COIL_TYPEOP_VAR, 2, COIL_TYPEOP_IMM, 1);
+  coil_u64_t top = loop.size;
+  bench_regalloc_op(&loop, COIL_OP_ADD, COIL_TYPEOP_VAR, 0, COIL_TYPEOP_VAR, 1);
+  bench_regalloc_op(&loop, COIL_OP_XOR, COIL_TYPEOP_VAR, 2, COIL_TYPEOP_VAR, 0);
+  bench_regalloc_op(&loop, COIL_OP_ADD, COIL_TYPEOP_VAR, 0, COIL_TYPEOP_VAR, 2);
+  bench_regalloc_op(&loop, COIL_OP_SUB, COIL_TYPEOP_VAR, 1, COIL_TYPEOP_IMM, 1);
+  bench_regalloc_op(&loop, COIL_OP_CMP, COIL_TYPEOP_VAR, 1, COIL_TYPEOP_IMM, 0);
+  coil_instrflag_encode(&loop, COIL_OP_BR, COIL_INSTRFLAG_GT);
+  bench_regalloc_operand(&loop, COIL_TYPEOP_SYM, 1);
+  coil_offset_t at = { 0, 0, 0 };
+  coil_instrflag_encode(&loop, COIL_OP_MOV, COIL_INSTRFLAG_NONE);
+  coil_operand_encode_off(&loop, COIL_TYPEOP_OFF, COIL_VAL_SYM, COIL_MOD_NONE, &at);
+  coil_u64_t data = 0;
+  coil_operand_encode_data(&loop, &data, 8);
+  bench_regalloc_operand(&loop, COIL_TYPEOP_VAR, 0);
+  coil_instr_encode(&loop, COIL_OP_RET);
+  
+  coil_u64_t loop_syms[2] = { 0, top };
+  coil_cfg_t loop_cfg;
+  coil_regalloc_t ra;
+  coil_section_t allocated;
+  coil_section_init(&allocated, 1024);
+  if (coil_cfg_build(&loop_cfg, &loop, 0, loop.size, loop_syms, 2) != COIL_ERR_GOOD ||
+      coil_regalloc_build(&ra, &loop_cfg, &loop, NULL) != COIL_ERR_GOOD ||
+      coil_regalloc_rewrite(&ra, &allocated, &loop) != COIL_ERR_GOOD ||
+      coil_regalloc_offset(&ra, top, &top) != COIL_ERR_GOOD) {
+    fprintf(stderr, "Loop allocation failed\n");
+    return 1;
+  }
+  
+  static coil_byte_t memory[BENCH_REGALLOC_MEMORY];
+  coil_u64_t slots_result = 0, regs_result = 0;
+  double slots = bench_regalloc_run(&loop, loop_syms[1], memory, &slots_result);
+  double regs = bench_regalloc_run(&allocated, top, memory, &regs_result);
+  printf("\nInterpreted loop: %d iterations\n", BENCH_REGALLOC_ITERATIONS);
+  printf("%-10s %8.2fms\n", "slots", slots * 1e3);
+  printf("%-10s %8.2fms %s\n", "registers", regs * 1e3, slots_result == regs_result ? "(same result)" : "(MISMATCH)");
+  
+  coil_regalloc_cleanup(&ra);
+  coil_cfg_cleanup(&loop_cfg);
+  coil_section_cleanup(&allocated);
+  coil_section_cleanup(&loop);
+  return 0;
+}
@@ -19,14 +19,58 @@
 */
 #include <coil/instr.h>
 
+/**
+* @brief COIL CBC Interface
+*/
+#include <coil/cbc.h>
+
+/**
+* @brief COIL CBC JIT Interface
+*/
+#include <coil/jit.h>
+
+/**
+* @brief COIL to CBC Lowering Interface
+*/
+#include <coil/lower.h>
+#include <coil/cfg.h>
+#include <coil/dflow.h>
+#include <coil/regalloc.h>
+#include <coil/peep.h>
+
 /**
 * @brief COIL Object Section Interface
 */
 #include <coil/sect.h>
 
+/**
+* @brief COIL Target Interface
+*/
+#include <coil/target.h>
+
 /**
 * @brief COIL Object Interface
 */
 #include <coil/obj.h>
 
+/**
+* @brief COIL String Table Interface
+*/
+#include <coil/strtab.h>
+
+/**
+* @brief COIL Symbol Table Interface
+*/
+#include <coil/sym.h>
+
+/**
+* @brief COIL Relocation Interface
+*/
+#include <coil/reloc.h>
+
+/**
+* @brief COIL Archive Interface
+*/
+#include <coil/archive.h>
+
 #endif /* __COIL_INCLUDE_GUARD_H */
\ No newline at end of file
@@ -0,0 +1,277 @@
+/**
+* @file archive.h
+* @brief COIL archive (multi-object container) functionality for libcoil-dev
+*
+* Archive Format
+*   [coil_archive_header_t]
+*   [member objects, each starting on a member_align boundary]
+*   [coil_archive_member_t...(member_count)]
+*   [coil_archive_symbol_t...(symbol_count), sorted by name hash]
+*   [member names (string table)]
+*
+* Opening an archive is a single mmap. Members are page aligned so each one
+* is mapped straight from the archive file with coil_obj_mmap_range, no
+* extra descriptors or header reads.
+*/
+
+#ifndef __COIL_INCLUDE_GUARD_ARCHIVE_H
+#define __COIL_INCLUDE_GUARD_ARCHIVE_H
+
+#include <coil/base.h>
+#include <coil/obj.h>
+#include <coil/strtab.h>
+#include <coil/sym.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+* @brief Archive magic bytes
+*/
+#define COIL_ARCHIVE_MAGIC_BYTES {'C', 'A', 'R', 'C'}
+
+/**
+* @brief Current archive format version
+*/
+#define COIL_ARCHIVE_VERSION 1
+
+/**
+* @brief Smallest member alignment (raised to the page size on larger-page systems)
+*/
+#define COIL_ARCHIVE_MIN_ALIGN 4096
+
+/**
+* @brief Archive header
+*/
+typedef struct coil_archive_header {
+  coil_u8_t magic[4];          ///< Magic number (COIL_ARCHIVE_MAGIC_BYTES)
+  coil_u16_t version;          ///< Format version
+  coil_u16_t reserved;         ///< Reserved, must be zero
+  coil_u32_t member_align;     ///< Alignment of member offsets
+  coil_u32_t member_count;     ///< Number of members
+  coil_u32_t symbol_count;     ///< Number of symbol index entries
+  coil_u32_t reserved2;        ///< Reserved, must be zero
+  coil_u64_t member_offset;    ///< Offset of the member index
+  coil_u64_t symbol_offset;    ///< Offset of the symbol index
+  coil_u64_t names_offset;     ///< Offset of the member name table
+  coil_u64_t names_size;       ///< Size of the member name table
+  coil_u64_t file_size;        ///< Complete archive size
+} coil_archive_header_t;
+
+/**
+* @brief Member index entry
+*/
+typedef struct coil_archive_member {
+  coil_u64_t offset;           ///< Offset of the member object in the archive
+  coil_u64_t size;             ///< Size of the member object
+  coil_u64_t name_hash;        ///< Name hash (coil_obj_hash_name)
+  coil_strref_t name;          ///< Name in the member name table
+} coil_archive_member_t;
+
+/**
+* @brief Symbol index entry
+*/
+typedef struct coil_archive_symbol {
+  coil_u64_t name_hash;        ///< Symbol name hash (coil_obj_hash_name)
+  coil_u32_t member;           ///< Index of the defining member
+  coil_u32_t reserved;         ///< Reserved, must be zero
+} coil_archive_symbol_t;
+
+/**
+* @brief Archive writer
+*/
+typedef struct coil_archive_writer {
+  coil_descriptor_t fd;                ///< Output file (not owned)
+  coil_u64_t offset;                   ///< End of the last member
+  coil_u32_t align;                    ///< Member alignment
+
+  coil_archive_member_t *members;      ///< Member index being built
+  coil_u32_t *member_names;            ///< Name string id per member
+  coil_u32_t member_count;             ///< Number of members
+  coil_u32_t member_capacity;          ///< Allocated members
+
+  coil_archive_symbol_t *symbols;      ///< Symbol index being built
+  coil_u32_t symbol_count;             ///< Number of symbols
+  coil_u32_t symbol_capacity;          ///< Allocated symbols
+
+  coil_strtab_t names;                 ///< Member names
+} coil_archive_writer_t;
+
+/**
+* @brief Open archive
+*/
+typedef struct coil_archive {
+  coil_byte_t *memory;                 ///< Mapping of the whole archive
+  coil_size_t size;                    ///< Size of the mapping
+  coil_descriptor_t fd;                ///< Archive file (not owned, used to map members)
+
+  const coil_archive_header_t *header; ///< Header (in the mapping)
+  const coil_archive_member_t *members; ///< Member index (in the mapping)
+  const coil_archive_symbol_t *symbols; ///< Symbol index (in the mapping)
+  coil_section_t names;                ///< View of the member name table
+} coil_archive_t;
+
+// -------------------------------- Writer -------------------------------- //
+
+/**
+* @brief Start writing an archive
+*
+* The archive is written from the start of the file.
+*
+* @param w Writer to initialize
+* @param fd Output file (must stay open until coil_archive_writer_finish)
+*
+* @return coil_err_t COIL_ERR_GOOD on success
+* @return coil_err_t COIL_ERR_INVAL if parameters are invalid
+* @return coil_err_t COIL_ERR_NOMEM if memory allocation fails
+*/
+coil_err_t coil_archive_writer_init(coil_archive_writer_t *w, coil_descriptor_t fd);
+
+/**
+* @brief Release a writer (does not close the file)
+*
+* @param w Writer to release
+*/
+void coil_archive_writer_cleanup(coil_archive_writer_t *w);
+
+/**
+* @brief Append an object as a new member
+*
+* @param w Writer
+* @param name Member name (unique within the archive)
+* @param obj Object to store (saved with coil_obj_save_file)
+* @param member Receives the member index (may be NULL)
+*
+* @return coil_err_t COIL_ERR_GOOD on success
+* @return coil_err_t COIL_ERR_INVAL if parameters are invalid
+* @return coil_err_t COIL_ERR_EXISTS if a member with that name exists
+* @return coil_err_t COIL_ERR_IO if the object cannot be written
+* @return coil_err_t COIL_ERR_NOMEM if memory allocation fails
+*/
+coil_err_t coil_archive_writer_add(coil_archive_writer_t *w, const char *name, coil_object_t *obj, coil_u32_t *member);
+
+/**
+* @brief Record that a member defines a symbol
+*
+* @param w Writer
+* @param member Member index
+* @param name_hash Symbol name hash (coil_obj_hash_name)
+*
+* @return coil_err_t COIL_ERR_GOOD on success
+* @return coil_err_t COIL_ERR_INVAL if parameters are invalid
+* @return coil_err_t COIL_ERR_NOMEM if memory allocation fails
+*/
+coil_err_t coil_archive_writer_add_symbol(coil_archive_writer_t *w, coil_u32_t member, coil_u64_t name_hash);
+
+/**
+* @brief Record every defined global or weak symbol of a member's symbol table
+*
+* @param w Writer
+* @param member Member index
+* @param symtab Symbol table of the member
+*
+* @return coil_err_t COIL_ERR_GOOD on success
+* @return coil_err_t COIL_ERR_INVAL if parameters are invalid
+* @return coil_err_t COIL_ERR_NOMEM if memory allocation fails
+*/
+coil_err_t coil_archive_writer_add_symtab(coil_archive_writer_t *w, coil_u32_t member, const coil_symtab_view_t *symtab);
+
+/**
+* @brief Write the indices and the header
+*
+* @param w Writer (can only be cleaned up afterwards)
+*
+* @return coil_err_t COIL_ERR_GOOD on success
+* @return coil_err_t COIL_ERR_INVAL if w is NULL
+* @return coil_err_t COIL_ERR_IO if the file cannot be written
+* @return coil_err_t COIL_ERR_NOMEM if memory allocation fails
+*/
+coil_err_t coil_archive_writer_finish(coil_archive_writer_t *w);
+
+// -------------------------------- Reader -------------------------------- //
+
+/**
+* @brief Open an archive
+*
+* @param ar Archive to populate
+* @param fd Archive file (must stay open while members are being opened)
+*
+* @return coil_err_t COIL_ERR_GOOD on success
+* @return coil_err_t COIL_ERR_INVAL if parameters are invalid
+* @return coil_err_t COIL_ERR_IO if the file cannot be mapped
+* @return coil_err_t COIL_ERR_FORMAT if the archive is malformed
+*/
+coil_err_t coil_archive_open(coil_archive_t *ar, coil_descriptor_t fd);
+
+/**
+* @brief Close an archive (does not close the file)
+*
+* Objects opened from the archive stay valid.
+*
+* @param ar Archive to close
+*/
+void coil_archive_close(coil_archive_t *ar);
+
+/**
+* @brief Find a member by name
+*
+* @param ar Archive
+* @param name Member name
+* @param member Receives the member index
+*
+* @return coil_err_t COIL_ERR_GOOD on success
+* @return coil_err_t COIL_ERR_INVAL if parameters are invalid
+* @return coil_err_t COIL_ERR_NOTFOUND if there is no such member
+*/
+coil_err_t coil_archive_find_member(const coil_archive_t *ar, const char *name, coil_u32_t *member);
+
+/**
+* @brief Find the member defining a symbol
+*
+* Binary search over the sorted symbol index. When several members define
+* the symbol the one added first is returned.
+*
+* @param ar Archive
+* @param name_hash Symbol name hash (coil_obj_hash_name)
+* @param member Receives the member index
+*
+* @return coil_err_t COIL_ERR_GOOD on success
+* @return coil_err_t COIL_ERR_INVAL if parameters are invalid
+* @return coil_err_t COIL_ERR_NOTFOUND if no member defines the symbol
+*/
+coil_err_t coil_archive_find_symbol(const coil_archive_t *ar, coil_u64_t name_hash, coil_u32_t *member);
+
+/**
+* @brief Get the name of a member
+*
+* @param ar Archive
+* @param member Member index
+* @param name Receives a pointer into the archive mapping
+*
+* @return coil_err_t COIL_ERR_GOOD on success
+* @return coil_err_t COIL_ERR_INVAL if parameters are invalid
+* @return coil_err_t COIL_ERR_FORMAT if the name is malformed
+*/
+coil_err_t coil_archive_member_name(const coil_archive_t *ar, coil_u32_t member, const char **name);
+
+/**
+* @brief Open a member as a memory mapped object
+*
+* @param ar Archive
+* @param member Member index
+* @param obj Object to populate (release with coil_obj_cleanup)
+*
+* @return coil_err_t COIL_ERR_GOOD on success
+* @return coil_err_t COIL_ERR_INVAL if parameters are invalid
+* @return coil_err_t COIL_ERR_NOTSUP if members are not aligned to this system's page size
+* @return coil_err_t COIL_ERR_IO if the member cannot be mapped
+* @return coil_err_t COIL_ERR_FORMAT if the member is malformed
+*/
+coil_err_t coil_archive_open_member(const coil_archive_t *ar, coil_u32_t member, coil_object_t *obj);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // __COIL_INCLUDE_GUARD_ARCHIVE_H
@@ -9,6 +9,8 @@
 #include <coil/deps.h>
 #include <coil/types.h>
 #include <coil/mem.h>
+#include <coil/pool.h>
+#include <coil/par.h>
 #include <coil/err.h>
 #include <coil/log.h>
 #include <coil/file.h>
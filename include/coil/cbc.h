@@ -0,0 +1,525 @@
+/**
+* @file cbc.h
+* @brief COIL CBC (coil_cbc_opcode_t) bytecode encoding and interpreter for libcoil-dev
+*
+* Instruction Format
+*   [coil_cbc_opcode_t opcode]
+*   [coil_u8_t condition]             BR only (COIL_INSTRFLAG_*)
+*   [operand...]                      one per operand form in the opcode name
+*
+* Operand Forms
+*   I   immediate of the operand width (b 1, w 2, l 4, q 8, o 16 bytes)
+*   S   u32 symbol, the memory at the symbol's value
+*   R   u8 register
+*   OS  u32 symbol + i32 displacement, the memory at value + displacement
+*   OR  u8 register + i32 displacement, the memory at register + displacement
+*
+* Fields are stored in host byte order. The first operand is the destination
+* (dst op= src). Branch targets are byte offsets into the code: an S target
+* is the symbol's value, R, OS and OR targets are read from the operand.
+*
+* Execution is defined on a flat memory buffer, symbol values and register
+* contents used as addresses are offsets into it. Integers are two's
+* complement, CMP, DIV and MOD are signed. Results narrower than a register
+* are zero extended into it.
+*
+* Fused Pairs
+*   An opcode in the COIL_COP_FUSED range encodes like the first instruction
+*   of a common pair (CMP + BR, MOV + register arithmetic) and says that the
+*   instruction after it is the second. The second keeps its own encoding,
+*   so fusing never moves code and branches to the second still work. The
+*   interpreter runs a fused pair with one dispatch.
+*/
+
+#ifndef __COIL_INCLUDE_GUARD_CBC_H
+#define __COIL_INCLUDE_GUARD_CBC_H
+
+#include <coil/base.h>
+#include <coil/sect.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+* @brief Number of opcodes in the CBC CPU opcode space
+*/
+#define COIL_CBC_OPCODE_COUNT (COIL_COP_RDTSCoOR + 1)
+
+/**
+* @brief Number of CBC registers
+*/
+#define COIL_CBC_REGISTERS 32
+
+/**
+* @brief Longest encoded CBC instruction (opcode and two 16 byte immediates)
+*/
+#define COIL_CBC_MAX_LENGTH 34
+
+/**
+* @brief Number of fused opcodes in use from COIL_COP_FUSED
+*/
+#define COIL_CBC_FUSED_COUNT 72
+
+/**
+* @brief Slot value for code offsets that do not start an instruction
+*/
+#define COIL_CBC_NO_SLOT ((coil_u32_t)0xFFFFFFFF)
+
+/**
+* @brief Operation performed by a CBC opcode, independent of width and operand forms
+*/
+typedef enum coil_cbc_operation_e {
+  COIL_CBC_NOP,
+  COIL_CBC_JMP,
+  COIL_CBC_BR,
+  COIL_CBC_CALL,
+  COIL_CBC_RET,
+  COIL_CBC_CMP,
+  COIL_CBC_TEST,
+  COIL_CBC_MOV,
+  COIL_CBC_PUSH,
+  COIL_CBC_POP,
+  COIL_CBC_LEA,
+  COIL_CBC_PUSHFD,
+  COIL_CBC_POPFD,
+  COIL_CBC_PUSHA,
+  COIL_CBC_POPA,
+  COIL_CBC_SCOPE,
+  COIL_CBC_SCOPL,
+  COIL_CBC_ADD,
+  COIL_CBC_SUB,
+  COIL_CBC_MUL,
+  COIL_CBC_DIV,
+  COIL_CBC_MOD,
+  COIL_CBC_INC,
+  COIL_CBC_DEC,
+  COIL_CBC_NEG,
+  COIL_CBC_AND,
+  COIL_CBC_OR,
+  COIL_CBC_XOR,
+  COIL_CBC_NOT,
+  COIL_CBC_SHL,
+  COIL_CBC_SHR,
+  COIL_CBC_SAL,
+  COIL_CBC_SAR,
+  COIL_CBC_CVT,
+  COIL_CBC_INT,
+  COIL_CBC_IRET,
+  COIL_CBC_CLI,
+  COIL_CBC_STI,
+  COIL_CBC_SYSCALL,
+  COIL_CBC_SYSRET,
+  COIL_CBC_RDTSC,
+  COIL_CBC_OPERATION_COUNT
+} coil_cbc_operation_t;
+
+/**
+* @brief Operand forms
+*/
+typedef enum coil_cbc_form_e {
+  COIL_CBC_FORM_NONE = 0,      ///< No operand
+  COIL_CBC_FORM_I = 1,         ///< Immediate
+  COIL_CBC_FORM_S = 2,         ///< Symbol
+  COIL_CBC_FORM_R = 3,         ///< Register
+  COIL_CBC_FORM_OS = 4,        ///< Symbol with displacement
+  COIL_CBC_FORM_OR = 5,        ///< Register with displacement
+} coil_cbc_form_t;
+
+/**
+* @brief Comparison results kept by the interpreter (coil_cbc_vm_t.flags)
+*/
+typedef enum coil_cbc_flag_e {
+  COIL_CBC_FLAG_EQ = 1 << 0,   ///< Operands were equal (TEST: result was zero)
+  COIL_CBC_FLAG_LT = 1 << 1,   ///< First operand was less, signed (TEST: result was negative)
+} coil_cbc_flag_t;
+
+/**
+* @brief Decomposition of an opcode
+*/
+typedef struct coil_cbc_info {
+  coil_u8_t operation;         ///< Operation (coil_cbc_operation_t)
+  coil_u8_t width;             ///< Operand width in bytes (0 without operands)
+  coil_u8_t form[2];           ///< Operand forms (COIL_CBC_FORM_NONE when absent)
+} coil_cbc_info_t;
+
+/**
+* @brief Decomposition of a fused opcode
+*/
+typedef struct coil_cbc_fusion {
+  coil_cbc_opcode_t first;     ///< Opcode of the first instruction
+  coil_u8_t operation;         ///< Operation of the second instruction (coil_cbc_operation_t)
+  coil_u8_t form[2];           ///< Operand forms of the second instruction
+} coil_cbc_fusion_t;
+
+/**
+* @brief Encoded operand
+*/
+typedef struct coil_cbc_operand {
+  coil_u8_t form;              ///< Operand form (COIL_CBC_FORM_*)
+  coil_u8_t reg;               ///< Register (R, OR)
+  coil_u32_t symbol;           ///< Symbol (S, OS)
+  coil_i32_t disp;             ///< Displacement (OS, OR)
+  coil_u64_t imm;              ///< Immediate, low 64 bits (I)
+  coil_u64_t imm_hi;           ///< Immediate, high 64 bits (I with o width)
+} coil_cbc_operand_t;
+
+/**
+* @brief Decoded instruction
+*/
+typedef struct coil_cbc_insn {
+  coil_cbc_opcode_t opcode;    ///< Opcode
+  coil_u8_t cond;              ///< Branch condition (COIL_INSTRFLAG_*, BR only)
+  coil_u8_t length;            ///< Encoded length in bytes
+  coil_cbc_info_t info;        ///< Decomposition of the opcode
+  coil_cbc_operand_t operands[2]; ///< Operands
+} coil_cbc_insn_t;
+
+/**
+* @brief Register or stack value (128 bits for o width operations)
+*/
+typedef struct coil_cbc_value {
+  coil_u64_t lo;               ///< Low 64 bits
+  coil_u64_t hi;               ///< High 64 bits
+} coil_cbc_value_t;
+
+/**
+* @brief Interpreter state
+*/
+typedef struct coil_cbc_vm {
+  coil_cbc_value_t regs[COIL_CBC_REGISTERS]; ///< Register file
+  coil_u8_t flags;                     ///< Result of the last CMP or TEST (coil_cbc_flag_t)
+
+  coil_byte_t *memory;                 ///< Memory addressed by the program (not owned)
+  coil_size_t memory_size;             ///< Size of the memory
+
+  coil_cbc_value_t *stack;             ///< Value stack (PUSH, POP, PUSHA, PUSHFD)
+  coil_u32_t stack_depth;              ///< Capacity of the value stack
+  coil_u32_t sp;                       ///< Number of values on the stack
+
+  coil_u32_t *calls;                   ///< Return slots
+  coil_u32_t call_depth;               ///< Capacity of the call stack
+  coil_u32_t csp;                      ///< Number of active calls
+
+  coil_u64_t steps;                    ///< Instructions retired (read by RDTSC)
+  coil_u64_t fused;                    ///< Fused pairs run, each saving a dispatch
+  coil_u64_t fault;                    ///< Offset of the instruction that stopped execution with an error
+} coil_cbc_vm_t;
+
+/**
+* @brief Predecoded instruction (internal layout)
+*/
+typedef struct coil_cbc_slot coil_cbc_slot_t;
+
+/**
+* @brief Predecoded program
+*
+* Instructions are decoded, validated and resolved once: operand forms
+* become direct register, immediate or address accesses and static branch
+* targets become slot indices. Execution then never looks at the encoding.
+*/
+typedef struct coil_cbc_program {
+  coil_cbc_slot_t *slots;              ///< Predecoded instructions, plus one that stops execution
+  coil_u32_t count;                    ///< Number of instructions
+  coil_u32_t *slot_of;                 ///< Slot per code offset (COIL_CBC_NO_SLOT inside instructions)
+  coil_size_t code_size;               ///< Size of the code in bytes
+} coil_cbc_program_t;
+
+/**
+* @brief Adjacent opcode pair and how often it was seen
+*/
+typedef struct coil_cbc_pair {
+  coil_cbc_opcode_t first;     ///< Opcode of the first instruction
+  coil_cbc_opcode_t second;    ///< Opcode of the second instruction
+  coil_u64_t count;            ///< Occurrences
+} coil_cbc_pair_t;
+
+/**
+* @brief Pair frequencies over a corpus of CBC code
+*/
+typedef struct coil_cbc_pair_profile {
+  coil_cbc_pair_t *pairs;              ///< Distinct pairs (most frequent first after coil_cbc_pair_profile_sort)
+  coil_u32_t count;                    ///< Number of distinct pairs
+  coil_u32_t capacity;                 ///< Capacity of pairs
+  coil_u32_t *index;                   ///< Open addressing table of pair indices plus one
+  coil_u32_t buckets;                  ///< Size of the table (a power of two)
+  coil_u64_t total;                    ///< Pairs seen
+  coil_u64_t fusable;                  ///< Pairs seen that have a fused opcode
+} coil_cbc_pair_profile_t;
+
+// -------------------------------- Opcodes -------------------------------- //
+
+/**
+* @brief Decompose an opcode
+*
+* @param op Opcode
+*
+* @return const coil_cbc_info_t* Decomposition (that of the first instruction for fused opcodes), NULL for
+*                                unknown opcodes
+*/
+const coil_cbc_info_t *coil_cbc_info(coil_cbc_opcode_t op);
+
+/**
+* @brief Find the opcode for an operation, width and operand forms
+*
+* @param operation Operation (coil_cbc_operation_t)
+* @param width Operand width in bytes (1, 2, 4, 8, 16, or 0 for operations without operands)
+* @param form_a First operand form
+* @param form_b Second operand form
+* @param op Receives the opcode
+*
+* @return coil_err_t COIL_ERR_GOOD on success
+* @return coil_err_t COIL_ERR_INVAL if op is NULL
+* @return coil_err_t COIL_ERR_NOTFOUND if no opcode has that shape
+*/
+coil_err_t coil_cbc_opcode_for(coil_u8_t operation, coil_u8_t width, coil_u8_t form_a, coil_u8_t form_b, coil_cbc_opcode_t *op);
+
+/**
+* @brief Immediate operand
+*/
+static inline coil_cbc_operand_t coil_cbc_imm(coil_u64_t value) {
+  coil_cbc_operand_t operand = {COIL_CBC_FORM_I, 0, 0, 0, value, 0};
+  return operand;
+}
+
+/**
+* @brief Register operand
+*/
+static inline coil_cbc_operand_t coil_cbc_reg(coil_u8_t reg) {
+  coil_cbc_operand_t operand = {COIL_CBC_FORM_R, reg, 0, 0, 0, 0};
+  return operand;
+}
+
+/**
+* @brief Symbol operand
+*/
+static inline coil_cbc_operand_t coil_cbc_sym(coil_u32_t symbol) {
+  coil_cbc_operand_t operand = {COIL_CBC_FORM_S, 0, symbol, 0, 0, 0};
+  return operand;
+}
+
+/**
+* @brief Memory operand at a symbol plus displacement
+*/
+static inline coil_cbc_operand_t coil_cbc_mem_sym(coil_u32_t symbol, coil_i32_t disp) {
+  coil_cbc_operand_t operand = {COIL_CBC_FORM_OS, 0, symbol, disp, 0, 0};
+  return operand;
+}
+
+/**
+* @brief Memory operand at a register plus displacement
+*/
+static inline coil_cbc_operand_t coil_cbc_mem_reg(coil_u8_t reg, coil_i32_t disp) {
+  coil_cbc_operand_t operand = {COIL_CBC_FORM_OR, reg, 0, disp, 0, 0};
+  return operand;
+}
+
+// -------------------------------- Encoding -------------------------------- //
+
+/**
+* @brief Encode a CBC instruction
+*
+* A fused opcode takes the operands of its first instruction, the second
+* instruction has to be encoded right after it.
+*
+* @param sect Section to append to
+* @param op Opcode
+* @param cond Branch condition (COIL_INSTRFLAG_*, ignored unless op is a BR)
+* @param a First operand (NULL if the opcode has none)
+* @param b Second operand (NULL if the opcode has at most one)
+*
+* @return coil_err_t COIL_ERR_GOOD on success
+* @return coil_err_t COIL_ERR_INVAL if the operands do not match the opcode's forms
+* @return coil_err_t COIL_ERR_BADSTATE if the section is read-only
+* @return coil_err_t COIL_ERR_NOMEM if the section cannot grow
+*/
+coil_err_t coil_cbc_encode(coil_section_t *sect, coil_cbc_opcode_t op, coil_u8_t cond,
+                           const coil_cbc_operand_t *a, const coil_cbc_operand_t *b);
+
+/**
+* @brief Decode the CBC instruction at an offset
+*
+* A fused instruction decodes as its first instruction, insn->opcode keeps
+* the fused opcode.
+*
+* @param code Encoded instructions
+* @param size Size of the code
+* @param offset Offset of the instruction
+* @param insn Receives the instruction
+*
+* @return coil_err_t COIL_ERR_GOOD on success
+* @return coil_err_t COIL_ERR_INVAL if parameters are invalid
+* @return coil_err_t COIL_ERR_FORMAT if the opcode is unknown, the instruction is truncated or a fused
+*                    instruction is not followed by its second instruction
+*/
+coil_err_t coil_cbc_decode(const coil_byte_t *code, coil_size_t size, coil_size_t offset, coil_cbc_insn_t *insn);
+
+// -------------------------------- Fusion -------------------------------- //
+
+/**
+* @brief Decompose a fused opcode
+*
+* @param op Opcode
+*
+* @return const coil_cbc_fusion_t* Decomposition, NULL for opcodes that are not fused
+*/
+const coil_cbc_fusion_t *coil_cbc_fusion(coil_cbc_opcode_t op);
+
+/**
+* @brief Find the fused opcode of a pair
+*
+* @param first Opcode of the first instruction
+* @param second Opcode of the second instruction
+* @param op Receives the fused opcode
+*
+* @return coil_err_t COIL_ERR_GOOD on success
+* @return coil_err_t COIL_ERR_INVAL if op is NULL
+* @return coil_err_t COIL_ERR_NOTFOUND if the pair has no fused opcode
+*/
+coil_err_t coil_cbc_fused_for(coil_cbc_opcode_t first, coil_cbc_opcode_t second, coil_cbc_opcode_t *op);
+
+/**
+* @brief Fuse every pair with a fused opcode, in place
+*
+* Only first opcodes are rewritten, the size and instruction offsets of the
+* code stay the same. Code that is already fused is left as it is.
+*
+* @param code Encoded instructions
+* @param size Size of the code
+* @param fused Receives the number of pairs fused (may be NULL)
+*
+* @return coil_err_t COIL_ERR_GOOD on success
+* @return coil_err_t COIL_ERR_INVAL if parameters are invalid
+* @return coil_err_t COIL_ERR_FORMAT if an instruction is malformed (nothing is rewritten)
+*/
+coil_err_t coil_cbc_fuse(coil_byte_t *code, coil_size_t size, coil_u32_t *fused);
+
+/**
+* @brief Initialize an empty pair profile
+*
+* @param profile Profile to initialize
+*
+* @return coil_err_t COIL_ERR_GOOD on success
+* @return coil_err_t COIL_ERR_INVAL if profile is NULL
+*/
+coil_err_t coil_cbc_pair_profile_init(coil_cbc_pair_profile_t *profile);
+
+/**
+* @brief Count the adjacent instruction pairs of some code
+*
+* Fused opcodes count as their first instruction.
+*
+* @param profile Profile to add to
+* @param code Encoded instructions
+* @param size Size of the code
+*
+* @return coil_err_t COIL_ERR_GOOD on success
+* @return coil_err_t COIL_ERR_INVAL if parameters are invalid
+* @return coil_err_t COIL_ERR_FORMAT if an instruction is malformed (nothing is counted)
+* @return coil_err_t COIL_ERR_NOMEM if memory allocation fails
+*/
+coil_err_t coil_cbc_pair_profile_add(coil_cbc_pair_profile_t *profile, const coil_byte_t *code, coil_size_t size);
+
+/**
+* @brief Order the pairs most frequent first (ties by opcodes)
+*
+* @param profile Profile to sort
+*/
+void coil_cbc_pair_profile_sort(coil_cbc_pair_profile_t *profile);
+
+/**
+* @brief Release a pair profile
+*
+* @param profile Profile to release
+*/
+void coil_cbc_pair_profile_cleanup(coil_cbc_pair_profile_t *profile);
+
+// -------------------------------- Interpreter -------------------------------- //
+
+/**
+* @brief Predecode a CBC program
+*
+* @param prog Program to initialize
+* @param code Encoded instructions
+* @param size Size of the code
+* @param symvals Symbol values (data addresses or code offsets)
+* @param symcount Number of symbol values
+*
+* @return coil_err_t COIL_ERR_GOOD on success
+* @return coil_err_t COIL_ERR_INVAL if parameters are invalid
+* @return coil_err_t COIL_ERR_FORMAT if an instruction is malformed, uses an unknown register or symbol,
+*                    an operand form its operation cannot take or branches into an instruction
+* @return coil_err_t COIL_ERR_NOTSUP if an instruction needs privileged state or 128-bit arithmetic
+*                    the compiler does not provide
+* @return coil_err_t COIL_ERR_NOMEM if memory allocation fails
+*/
+coil_err_t coil_cbc_program_init(coil_cbc_program_t *prog, const coil_byte_t *code, coil_size_t size,
+                                 const coil_u64_t *symvals, coil_u32_t symcount);
+
+/**
+* @brief Release a predecoded program
+*
+* @param prog Program to release
+*/
+void coil_cbc_program_cleanup(coil_cbc_program_t *prog);
+
+/**
+* @brief Initialize an interpreter
+*
+* @param vm Interpreter to initialize (registers and flags start at zero)
+* @param memory Memory addressed by programs (may be NULL when size is 0)
+* @param memory_size Size of the memory
+* @param depth Capacity of the value and call stacks
+*
+* @return coil_err_t COIL_ERR_GOOD on success
+* @return coil_err_t COIL_ERR_INVAL if parameters are invalid
+* @return coil_err_t COIL_ERR_NOMEM if memory allocation fails
+*/
+coil_err_t coil_cbc_vm_init(coil_cbc_vm_t *vm, coil_byte_t *memory, coil_size_t memory_size, coil_u32_t depth);
+
+/**
+* @brief Release an interpreter (the memory stays with the caller)
+*
+* @param vm Interpreter to release
+*/
+void coil_cbc_vm_cleanup(coil_cbc_vm_t *vm);
+
+/**
+* @brief Run a program until the outermost RET
+*
+* Uses threaded dispatch (every handler jumps straight to the next one)
+* when the compiler supports computed goto, coil_cbc_run_switch otherwise.
+* On error vm->fault holds the offset of the failing instruction.
+*
+* @param vm Interpreter
+* @param prog Predecoded program
+* @param entry Code offset to start at
+* @param max_steps Instruction budget, checked on taken branches and calls (0 for none)
+*
+* @return coil_err_t COIL_ERR_GOOD when the outermost RET is reached
+* @return coil_err_t COIL_ERR_INVAL if entry does not start an instruction
+* @return coil_err_t COIL_ERR_BADSTATE on bad memory accesses, stack overflow or underflow, division by zero,
+*                    an exhausted budget, a dynamic branch into an instruction or running past the end
+*/
+coil_err_t coil_cbc_run(coil_cbc_vm_t *vm, const coil_cbc_program_t *prog, coil_u64_t entry, coil_u64_t max_steps);
+
+/**
+* @brief Run a program with a plain switch dispatch loop
+*
+* Same semantics as coil_cbc_run. Kept as the reference loop and for
+* comparing dispatch strategies.
+*
+* @param vm Interpreter
+* @param prog Predecoded program
+* @param entry Code offset to start at
+* @param max_steps Instruction budget, checked on taken branches and calls (0 for none)
+*
+* @return coil_err_t Same as coil_cbc_run
+*/
+coil_err_t coil_cbc_run_switch(coil_cbc_vm_t *vm, const coil_cbc_program_t *prog, coil_u64_t entry, coil_u64_t max_steps);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // __COIL_INCLUDE_GUARD_CBC_H
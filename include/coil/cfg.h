@@ -0,0 +1,163 @@
+/**
+* @file cfg.h
+* @brief Control-flow graphs over COIL instruction streams for libcoil-dev
+*
+* A function is decoded once, front to back. Blocks start at the function
+* entry, at every branch target inside the function and after every BR, JMP
+* and RET. CALL does not end a block.
+*
+* Branch targets are symbols, resolved with the symbol values given to the
+* builder (offsets in the same section). A target outside the function
+* leaves it (COIL_CFG_BLOCK_EXIT), a register, variable or memory target is
+* not followed (COIL_CFG_BLOCK_INDIRECT).
+*
+* Everything is kept in flat arrays indexed by block, block 0 is the entry.
+* Edges are in CSR form: the successors of block b are
+* succ[succ_index[b]] to succ[succ_index[b + 1] - 1], a conditional branch
+* lists its target before the fall-through block. Predecessors are laid out
+* the same way, in block order.
+*
+* Immediate dominators are computed with the Cooper-Harvey-Kennedy
+* iterative algorithm over the reverse postorder, then expanded into one
+* dominator bitset per block so dominance is a single bit test.
+*/
+
+#ifndef __COIL_INCLUDE_GUARD_CFG_H
+#define __COIL_INCLUDE_GUARD_CFG_H
+
+#include <coil/base.h>
+#include <coil/sect.h>
+#include <coil/lower.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+* @brief Block value for no block (unreachable blocks have no dominator)
+*/
+#define COIL_CFG_NONE ((coil_u32_t)0xFFFFFFFF)
+
+/**
+* @brief Largest block count that gets dominator bitsets (a larger one uses the dominator tree)
+*/
+#define COIL_CFG_DOM_MAX 4096
+
+/**
+* @brief Block flags
+*/
+typedef enum coil_cfg_block_flag_e {
+  COIL_CFG_BLOCK_RETURN = 1 << 0,      ///< Ends with RET
+  COIL_CFG_BLOCK_EXIT = 1 << 1,        ///< Branches out of the function or runs off its end
+  COIL_CFG_BLOCK_INDIRECT = 1 << 2,    ///< Ends with a branch to a register, variable or memory target
+  COIL_CFG_BLOCK_CALL = 1 << 3,        ///< Contains a CALL
+  COIL_CFG_BLOCK_REACHABLE = 1 << 4,   ///< Reachable from the entry
+} coil_cfg_block_flag_t;
+
+/**
+* @brief Control-flow graph of one function
+*/
+typedef struct coil_cfg {
+  coil_u64_t offset;           ///< Offset of the function in the section
+  coil_u64_t size;             ///< Size of the function in bytes
+  coil_u32_t count;            ///< Number of blocks
+
+  coil_u64_t *start;           ///< Offset of each block's first instruction
+  coil_u64_t *end;             ///< Offset past each block's last instruction
+  coil_u8_t *flags;            ///< Block flags (coil_cfg_block_flag_t)
+
+  coil_u32_t *succ_index;      ///< Start of each block's successors (count + 1 entries)
+  coil_u32_t *succ;            ///< Successor blocks
+  coil_u32_t *pred_index;      ///< Start of each block's predecessors (count + 1 entries)
+  coil_u32_t *pred;            ///< Predecessor blocks
+
+  coil_u32_t *rpo;             ///< Reachable blocks in reverse postorder (entry first)
+  coil_u32_t rpo_count;        ///< Number of reachable blocks
+  coil_u32_t *order;           ///< Position of each block in rpo (COIL_CFG_NONE if unreachable)
+  coil_u32_t *idom;            ///< Immediate dominator (the entry's is itself, COIL_CFG_NONE if unreachable)
+  coil_u64_t *dom;             ///< Dominators of each block, dom_words words per block (NULL above COIL_CFG_DOM_MAX blocks)
+  coil_u32_t dom_words;        ///< Words per dominator bitset
+
+  coil_u64_t fault;            ///< Offset of the instruction that failed to decode or resolve
+} coil_cfg_t;
+
+/**
+* @brief Build the control-flow graph of a function
+*
+* @param cfg Graph to initialize
+* @param ir Section holding the COIL instructions
+* @param offset Offset of the function's first instruction
+* @param size Size of the function in bytes
+* @param symvals Symbol values (offsets in ir for code symbols)
+* @param symcount Number of symbol values
+*
+* @return coil_err_t COIL_ERR_GOOD on success
+* @return coil_err_t COIL_ERR_INVAL if parameters are invalid or the function leaves the section
+* @return coil_err_t COIL_ERR_BADSTATE if ir is chunked
+* @return coil_err_t COIL_ERR_FORMAT if an instruction is malformed, crosses the end of the function, names an
+*                    unknown symbol or branches into an instruction (cfg->fault names it)
+* @return coil_err_t COIL_ERR_NOMEM if memory allocation fails
+*/
+coil_err_t coil_cfg_build(coil_cfg_t *cfg, coil_section_t *ir, coil_u64_t offset, coil_u64_t size,
+                          const coil_u64_t *symvals, coil_u32_t symcount);
+
+/**
+* @brief Build the control-flow graphs of many functions in parallel
+*
+* Functions are handed out largest first. Nothing is kept when any
+* function fails.
+*
+* @param cfgs Graphs to initialize, one per function
+* @param ir Section holding the COIL instructions
+* @param funcs Functions
+* @param count Number of functions
+* @param symvals Symbol values (offsets in ir for code symbols)
+* @param symcount Number of symbol values
+* @param threads Threads including the caller (0 for coil_par_default_threads)
+* @param fault Receives the offset of the failing instruction of the first function that failed (may be NULL)
+*
+* @return coil_err_t COIL_ERR_GOOD on success
+* @return coil_err_t The first error in function order as coil_cfg_build reports it otherwise
+*/
+coil_err_t coil_cfg_build_all(coil_cfg_t *cfgs, coil_section_t *ir, const coil_lower_func_t *funcs, coil_u32_t count,
+                              const coil_u64_t *symvals, coil_u32_t symcount, coil_u32_t threads, coil_u64_t *fault);
+
+/**
+* @brief Find the block holding an offset
+*
+* @param cfg Graph
+* @param offset Offset in the section
+* @param block Receives the block
+*
+* @return coil_err_t COIL_ERR_GOOD on success
+* @return coil_err_t COIL_ERR_INVAL if parameters are invalid
+* @return coil_err_t COIL_ERR_NOTFOUND if the offset is outside the function
+*/
+coil_err_t coil_cfg_block_of(const coil_cfg_t *cfg, coil_u64_t offset, coil_u32_t *block);
+
+/**
+* @brief Check whether one block dominates another
+*
+* Every block dominates itself, nothing dominates or is dominated by an
+* unreachable block.
+*
+* @param cfg Graph
+* @param a Dominating block
+* @param b Dominated block
+*
+* @return int Non-zero if a dominates b
+*/
+int coil_cfg_dominates(const coil_cfg_t *cfg, coil_u32_t a, coil_u32_t b);
+
+/**
+* @brief Release a control-flow graph
+*
+* @param cfg Graph to release
+*/
+void coil_cfg_cleanup(coil_cfg_t *cfg);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // __COIL_INCLUDE_GUARD_CFG_H
@@ -20,5 +20,6 @@
 // Linux
 #include <unistd.h> // universal
 #include <sys/mman.h> // mmap, munmap, MAP_*, PROT_*
+#include <sys/uio.h> // writev, struct iovec
 
 #endif // __COIL_INCLUDE_GUARD_DEPS_H
\ No newline at end of file
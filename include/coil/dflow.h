@@ -0,0 +1,350 @@
+/**
+* @file dflow.h
+* @brief Bitset dataflow over control-flow graphs and variable liveness for libcoil-dev
+*
+* A problem has one set of facts (bit indices below a fact count) per
+* block for each of gen, kill, in and out. Solving applies
+*   forward:  in = meet(out of predecessors), out = gen | (in & ~kill)
+*   backward: out = meet(in of successors),  in = gen | (out & ~kill)
+* until nothing changes. Blocks are taken from a worklist in reverse
+* postorder for forward problems and in postorder for backward ones, so
+* most blocks see their inputs final on the first visit.
+*
+* The boundary (before the entry, after blocks that return, exit or branch
+* indirectly) is the empty set. Union problems start empty, intersection
+* problems start full. Unreachable blocks are not solved.
+*
+* Sets are dense bitsets by default; the union, intersection and
+* difference kernels use AVX2 when the host has it. When the dense sets
+* would exceed COIL_DFLOW_DENSE_MAX bytes, union problems keep each set as
+* a sorted list of facts instead, so functions with tens of thousands of
+* variables and blocks stay within memory.
+*
+* Liveness is the backward union problem over COIL_TYPEOP_VAR operands:
+* gen holds the variables a block reads before writing them, kill the ones
+* it writes. Variable ids are mapped to dense fact indices in ascending
+* order.
+*/
+
+#ifndef __COIL_INCLUDE_GUARD_DFLOW_H
+#define __COIL_INCLUDE_GUARD_DFLOW_H
+
+#include <coil/base.h>
+#include <coil/sect.h>
+#include <coil/cfg.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+* @brief Largest dense set storage in bytes before union problems switch to sorted lists
+*/
+#define COIL_DFLOW_DENSE_MAX ((coil_size_t)64 << 20)
+
+/**
+* @brief Direction of a problem
+*/
+typedef enum coil_dflow_dir_e {
+  COIL_DFLOW_FORWARD,          ///< Facts flow from predecessors to successors
+  COIL_DFLOW_BACKWARD,         ///< Facts flow from successors to predecessors
+} coil_dflow_dir_t;
+
+/**
+* @brief Meet of a problem
+*/
+typedef enum coil_dflow_meet_e {
+  COIL_DFLOW_UNION,            ///< A fact holds if it holds along any edge
+  COIL_DFLOW_INTERSECT,        ///< A fact holds if it holds along every edge
+} coil_dflow_meet_t;
+
+/**
+* @brief Set representation
+*/
+typedef enum coil_dflow_rep_e {
+  COIL_DFLOW_AUTO,             ///< Dense unless a union problem exceeds COIL_DFLOW_DENSE_MAX
+  COIL_DFLOW_DENSE,            ///< Bitsets of words 64-bit words
+  COIL_DFLOW_SPARSE,           ///< Sorted fact lists (union problems only)
+} coil_dflow_rep_t;
+
+/**
+* @brief Sets of a block
+*/
+typedef enum coil_dflow_set_e {
+  COIL_DFLOW_GEN,              ///< Facts the block generates
+  COIL_DFLOW_KILL,             ///< Facts the block kills
+  COIL_DFLOW_IN,               ///< Facts at the block's entry
+  COIL_DFLOW_OUT,              ///< Facts at the block's exit
+} coil_dflow_set_t;
+
+/**
+* @brief How an instruction accesses its first operand
+*/
+typedef enum coil_live_access_e {
+  COIL_LIVE_READ,              ///< Read only
+  COIL_LIVE_WRITE,             ///< Written without being read
+  COIL_LIVE_UPDATE,            ///< Read, then written
+} coil_live_access_t;
+
+/**
+* @brief Sorted fact list (sparse sets)
+*/
+typedef struct coil_dflow_list {
+  coil_u32_t *items;           ///< Facts in ascending order
+  coil_u32_t count;            ///< Number of facts
+  coil_u32_t capacity;         ///< Allocated facts
+} coil_dflow_list_t;
+
+/**
+* @brief Dataflow problem over a control-flow graph
+*/
+typedef struct coil_dflow {
+  const coil_cfg_t *cfg;       ///< Graph (must outlive the problem)
+  coil_u32_t facts;            ///< Number of facts
+  coil_u8_t dir;               ///< coil_dflow_dir_t
+  coil_u8_t meet;              ///< coil_dflow_meet_t
+  coil_u8_t sparse;            ///< Sets are sorted lists
+  coil_u8_t dirty;             ///< Sparse gen or kill lists need sorting
+  coil_u32_t words;            ///< 64-bit words per dense set
+  coil_u64_t *bits;            ///< Dense sets, gen, kill, in and out of each block in turn
+  coil_dflow_list_t *lists;    ///< Sparse sets, gen, kill, in and out of each block in turn
+  coil_u64_t visits;           ///< Blocks evaluated by the last solve
+} coil_dflow_t;
+
+/**
+* @brief Variable liveness of a function
+*/
+typedef struct coil_live {
+  coil_dflow_t flow;           ///< Backward union problem, in is live-in and out is live-out
+  coil_u64_t *vars;            ///< Variable id of each fact, ascending
+  coil_u32_t var_count;        ///< Number of variables
+} coil_live_t;
+
+// -------------------------------- Bitsets -------------------------------- //
+
+/**
+* @brief dst = a | b
+*
+* dst may be a or b.
+*
+* @param dst Destination
+* @param a First operand
+* @param b Second operand
+* @param words Number of 64-bit words
+*
+* @return int Non-zero if dst changed
+*/
+int coil_dflow_union(coil_u64_t *dst, const coil_u64_t *a, const coil_u64_t *b, coil_size_t words);
+
+/**
+* @brief dst = a & b
+*
+* dst may be a or b.
+*
+* @param dst Destination
+* @param a First operand
+* @param b Second operand
+* @param words Number of 64-bit words
+*
+* @return int Non-zero if dst changed
+*/
+int coil_dflow_intersect(coil_u64_t *dst, const coil_u64_t *a, const coil_u64_t *b, coil_size_t words);
+
+/**
+* @brief dst = a & ~b
+*
+* dst may be a or b.
+*
+* @param dst Destination
+* @param a First operand
+* @param b Second operand
+* @param words Number of 64-bit words
+*
+* @return int Non-zero if dst changed
+*/
+int coil_dflow_diff(coil_u64_t *dst, const coil_u64_t *a, const coil_u64_t *b, coil_size_t words);
+
+/**
+* @brief dst = gen | (src & ~kill), the transfer function
+*
+* dst must not overlap the operands.
+*
+* @param dst Destination
+* @param gen Generated facts
+* @param src Incoming facts
+* @param kill Killed facts
+* @param words Number of 64-bit words
+*
+* @return int Non-zero if dst changed
+*/
+int coil_dflow_transfer(coil_u64_t *dst, const coil_u64_t *gen, const coil_u64_t *src, const coil_u64_t *kill,
+                        coil_size_t words);
+
+/**
+* @brief Check whether the bitset kernels use AVX2
+*
+* @return int Non-zero if the host has AVX2 and the kernels use it
+*/
+int coil_dflow_simd(void);
+
+// -------------------------------- Problems -------------------------------- //
+
+/**
+* @brief Initialize a problem with empty gen and kill sets
+*
+* @param flow Problem to initialize
+* @param cfg Graph the problem is over
+* @param facts Number of facts
+* @param dir Direction
+* @param meet Meet
+* @param rep Set representation
+*
+* @return coil_err_t COIL_ERR_GOOD on success
+* @return coil_err_t COIL_ERR_INVAL if parameters are invalid
+* @return coil_err_t COIL_ERR_NOTSUP if sparse sets are requested for an intersection problem
+* @return coil_err_t COIL_ERR_NOMEM if memory allocation fails
+*/
+coil_err_t coil_dflow_init(coil_dflow_t *flow, const coil_cfg_t *cfg, coil_u32_t facts,
+                           coil_dflow_dir_t dir, coil_dflow_meet_t meet, coil_dflow_rep_t rep);
+
+/**
+* @brief Add a fact to a block's gen or kill set
+*
+* @param flow Problem
+* @param set COIL_DFLOW_GEN or COIL_DFLOW_KILL
+* @param block Block
+* @param fact Fact
+*
+* @return coil_err_t COIL_ERR_GOOD on success
+* @return coil_err_t COIL_ERR_INVAL if parameters are invalid
+* @return coil_err_t COIL_ERR_NOMEM if memory allocation fails
+*/
+coil_err_t coil_dflow_add(coil_dflow_t *flow, coil_dflow_set_t set, coil_u32_t block, coil_u32_t fact);
+
+/**
+* @brief Solve the problem
+*
+* May be called again after more facts are added.
+*
+* @param flow Problem
+*
+* @return coil_err_t COIL_ERR_GOOD on success
+* @return coil_err_t COIL_ERR_INVAL if parameters are invalid
+* @return coil_err_t COIL_ERR_NOMEM if memory allocation fails
+*/
+coil_err_t coil_dflow_solve(coil_dflow_t *flow);
+
+/**
+* @brief Check whether a fact is in a block's set
+*
+* @param flow Problem
+* @param set Set
+* @param block Block
+* @param fact Fact
+*
+* @return int Non-zero if the fact is in the set
+*/
+int coil_dflow_has(const coil_dflow_t *flow, coil_dflow_set_t set, coil_u32_t block, coil_u32_t fact);
+
+/**
+* @brief Find the first fact of a block's set at or after another
+*
+* @param flow Problem
+* @param set Set
+* @param block Block
+* @param from First fact to consider
+* @param fact Receives the fact
+*
+* @return int Non-zero if a fact was found
+*/
+int coil_dflow_next(const coil_dflow_t *flow, coil_dflow_set_t set, coil_u32_t block, coil_u32_t from,
+                    coil_u32_t *fact);
+
+/**
+* @brief Release a problem
+*
+* @param flow Problem to release
+*/
+void coil_dflow_cleanup(coil_dflow_t *flow);
+
+// -------------------------------- Liveness -------------------------------- //
+
+/**
+* @brief How an instruction accesses its first operand
+*
+* Every other operand is only read.
+*
+* @param opcode Opcode (coil_opcode_t)
+*
+* @return coil_live_access_t Access (COIL_LIVE_READ for unknown opcodes)
+*/
+coil_live_access_t coil_live_access(coil_u8_t opcode);
+
+/**
+* @brief Compute variable liveness of a function
+*
+* The first operand of MOV, LEA, CVT and POP is written; the first operand
+* of the arithmetic and bitwise instructions is read, then written. Every
+* other variable operand, and every variable an offset operand is based
+* on, is read. Flagged (conditional) writes do not kill.
+*
+* @param live Liveness to initialize
+* @param cfg Graph of the function
+* @param ir Section holding the COIL instructions the graph was built from
+* @param rep Set representation
+*
+* @return coil_err_t COIL_ERR_GOOD on success
+* @return coil_err_t COIL_ERR_INVAL if parameters are invalid
+* @return coil_err_t COIL_ERR_BADSTATE if ir is chunked
+* @return coil_err_t COIL_ERR_FORMAT if an instruction fails to decode
+* @return coil_err_t COIL_ERR_NOMEM if memory allocation fails
+*/
+coil_err_t coil_live_build(coil_live_t *live, const coil_cfg_t *cfg, coil_section_t *ir, coil_dflow_rep_t rep);
+
+/**
+* @brief Find the fact index of a variable
+*
+* @param live Liveness
+* @param var Variable id
+* @param fact Receives the fact index
+*
+* @return coil_err_t COIL_ERR_GOOD on success
+* @return coil_err_t COIL_ERR_INVAL if parameters are invalid
+* @return coil_err_t COIL_ERR_NOTFOUND if the function does not reference the variable
+*/
+coil_err_t coil_live_index(const coil_live_t *live, coil_u64_t var, coil_u32_t *fact);
+
+/**
+* @brief Check whether a variable is live at a block's entry
+*
+* @param live Liveness
+* @param block Block
+* @param var Variable id
+*
+* @return int Non-zero if live
+*/
+int coil_live_in(const coil_live_t *live, coil_u32_t block, coil_u64_t var);
+
+/**
+* @brief Check whether a variable is live at a block's exit
+*
+* @param live Liveness
+* @param block Block
+* @param var Variable id
+*
+* @return int Non-zero if live
+*/
+int coil_live_out(const coil_live_t *live, coil_u32_t block, coil_u64_t var);
+
+/**
+* @brief Release liveness
+*
+* @param live Liveness to release
+*/
+void coil_live_cleanup(coil_live_t *live);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // __COIL_INCLUDE_GUARD_DFLOW_H
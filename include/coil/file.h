@@ -8,6 +8,7 @@
 
 #include <coil/types.h>
 #include <coil/err.h>
+#include <coil/mem.h>
 
 #ifdef __cplusplus
 extern "C" {
@@ -38,6 +39,60 @@ coil_err_t coil_read(coil_descriptor_t fd, coil_byte_t *byte, coil_size_t byteco
 */
 coil_err_t coil_seek(coil_descriptor_t fd, long int pos, int whence);
 
+/**
+* @brief Give the kernel an access pattern hint for a range of a descriptor
+*
+* COIL_ADVICE_WILLNEED starts asynchronous readahead of the range into the page cache.
+*
+* @param fd Descriptor the hint applies to
+* @param offset Start of the range in bytes
+* @param len Length of the range in bytes (0 for the rest of the file)
+* @param advice Access pattern hint (COIL_ADVICE_*)
+*/
+coil_err_t coil_fadvise(coil_descriptor_t fd, coil_u64_t offset, coil_size_t len, coil_advice_t advice);
+
+/**
+* @brief Copy a range of one descriptor to the current position of another
+*
+* Uses copy_file_range (reflinks where the filesystem supports them), then
+* sendfile, then a read/write loop. The output position advances past the
+* copied bytes, the input position is left alone. Overlapping ranges of
+* one file are rejected with COIL_ERR_BADSTATE.
+*
+* @param in Source descriptor
+* @param offset Start of the range in the source
+* @param out Destination descriptor
+* @param len Number of bytes to copy
+*/
+coil_err_t coil_copy_range(coil_descriptor_t in, coil_u64_t offset, coil_descriptor_t out, coil_size_t len);
+
+/**
+* @brief Copy a range of one descriptor to an offset in another
+*
+* Like coil_copy_range but positional (no sendfile step), neither file
+* position moves, so several threads can fill one output concurrently.
+*
+* @param in Source descriptor
+* @param offset Start of the range in the source
+* @param out Destination descriptor
+* @param out_offset Destination offset
+* @param len Number of bytes to copy
+*/
+coil_err_t coil_copy_range_at(coil_descriptor_t in, coil_u64_t offset, coil_descriptor_t out, 
+                              coil_u64_t out_offset, coil_size_t len);
+
+/**
+* @brief Write a whole buffer at an offset, retrying short writes
+*
+* The file position does not move.
+*
+* @param fd Destination descriptor
+* @param offset Destination offset
+* @param bytes Data to write
+* @param len Number of bytes to write
+*/
+coil_err_t coil_write_at(coil_descriptor_t fd, coil_u64_t offset, const void *bytes, coil_size_t len);
+
 #ifdef __cplusplus
 }
 #endif
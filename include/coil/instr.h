@@ -164,6 +164,9 @@ coil_err_t coil_operand_encode_data(coil_section_t *sect, void *data, coil_size_
 
 // -------------------------------- De-Serialization -------------------------------- //
 
+// Decoders read the section buffer in place, chunked sections fail with
+// COIL_ERR_BADSTATE until they are flattened (coil_section_flatten).
+
 /**
 * @brief Decode an instruction header 
 *
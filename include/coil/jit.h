@@ -0,0 +1,115 @@
+/**
+* @file jit.h
+* @brief COIL CBC template JIT for x86-64 hosts for libcoil-dev
+*
+* Every CBC instruction is translated by a fixed machine code template:
+* register operands live in the interpreter's register file (coil_cbc_vm_t),
+* memory operands are bounds checked against the interpreter's memory and
+* CBC calls become native calls. The generated code runs from an anonymous
+* mapping that is never writable and executable at the same time.
+*
+* Supported subset
+*   Widths      b, w, l, q
+*   Operations  NOP, SCOPE, SCOPL, JMP, BR, CALL (symbol targets), RET,
+*               CMP, TEST, MOV, LEA, PUSH, POP, PUSHFD, POPFD, ADD, SUB,
+*               MUL, AND, OR, XOR, SHL, SAL, SHR, SAR, INC, DEC, NEG, NOT,
+*               CVT
+*
+* Semantics are those of coil_cbc_run, except that instructions are not
+* counted (vm->steps is left alone) and the budget counts taken branches
+* and calls instead of instructions. coil_jit_eval is a plain
+* decode-and-execute evaluator with exactly the JIT's semantics, kept as
+* the reference the generated code is tested against.
+*/
+
+#ifndef __COIL_INCLUDE_GUARD_JIT_H
+#define __COIL_INCLUDE_GUARD_JIT_H
+
+#include <coil/base.h>
+#include <coil/cbc.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+* @brief Native offset value for CBC offsets that do not start an instruction
+*/
+#define COIL_JIT_NO_CODE ((coil_u32_t)0xFFFFFFFF)
+
+/**
+* @brief Compiled CBC program
+*/
+typedef struct coil_jit {
+  coil_byte_t *code;           ///< Executable mapping (entry stub followed by the translated instructions)
+  coil_size_t map_size;        ///< Length of the mapping
+  coil_size_t code_size;       ///< Bytes of machine code
+  coil_u32_t *native_of;       ///< Native offset per CBC offset (COIL_JIT_NO_CODE inside instructions)
+  coil_size_t cbc_size;        ///< Size of the CBC code
+} coil_jit_t;
+
+/**
+* @brief Translate a CBC program to x86-64 machine code
+*
+* @param jit Compiled program to initialize
+* @param code Encoded CBC instructions
+* @param size Size of the code
+* @param symvals Symbol values (data addresses or code offsets)
+* @param symcount Number of symbol values
+*
+* @return coil_err_t COIL_ERR_GOOD on success
+* @return coil_err_t COIL_ERR_INVAL if parameters are invalid
+* @return coil_err_t COIL_ERR_FORMAT if an instruction is malformed, uses an unknown register or symbol,
+*                    an operand form its operation cannot take or branches into an instruction
+* @return coil_err_t COIL_ERR_NOTSUP if the host is not x86-64 or an instruction is outside the supported subset
+* @return coil_err_t COIL_ERR_NOMEM if memory allocation or mapping fails
+*/
+coil_err_t coil_jit_compile(coil_jit_t *jit, const coil_byte_t *code, coil_size_t size,
+                            const coil_u64_t *symvals, coil_u32_t symcount);
+
+/**
+* @brief Run a compiled program until the outermost RET
+*
+* @param jit Compiled program
+* @param vm Interpreter state to run on (registers, flags, memory and stacks)
+* @param entry CBC offset to start at
+* @param max_branches Budget of taken branches and calls (0 for none)
+*
+* @return coil_err_t COIL_ERR_GOOD when the outermost RET is reached
+* @return coil_err_t COIL_ERR_INVAL if parameters are invalid or entry does not start an instruction
+* @return coil_err_t COIL_ERR_BADSTATE on bad memory accesses, stack overflow or underflow,
+*                    an exhausted budget or running past the end (vm->fault names the instruction)
+*/
+coil_err_t coil_jit_run(const coil_jit_t *jit, coil_cbc_vm_t *vm, coil_u64_t entry, coil_u64_t max_branches);
+
+/**
+* @brief Release a compiled program
+*
+* @param jit Compiled program to release
+*/
+void coil_jit_cleanup(coil_jit_t *jit);
+
+/**
+* @brief Evaluate a CBC program the way the JIT would run it
+*
+* Accepts exactly the programs coil_jit_compile accepts (on any host) and
+* leaves the interpreter in the same state coil_jit_run would.
+*
+* @param vm Interpreter state to run on
+* @param code Encoded CBC instructions
+* @param size Size of the code
+* @param symvals Symbol values (data addresses or code offsets)
+* @param symcount Number of symbol values
+* @param entry CBC offset to start at
+* @param max_branches Budget of taken branches and calls (0 for none)
+*
+* @return coil_err_t Same as coil_jit_compile for rejected programs, same as coil_jit_run otherwise
+*/
+coil_err_t coil_jit_eval(coil_cbc_vm_t *vm, const coil_byte_t *code, coil_size_t size,
+                         const coil_u64_t *symvals, coil_u32_t symcount, coil_u64_t entry, coil_u64_t max_branches);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // __COIL_INCLUDE_GUARD_JIT_H
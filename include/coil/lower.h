@@ -0,0 +1,151 @@
+/**
+* @file lower.h
+* @brief Lowering of COIL instructions (COIL_OP_*) to CBC for libcoil-dev
+*
+* Every COIL instruction becomes at most two CBC instructions. The CBC
+* opcode is selected from the operation, the operand width and the operand
+* forms:
+*   IMM            I   (extended by its value type, then cut to the width)
+*   REG            R
+*   VAR            the variable's home, or OR frame_reg + id * var_slot
+*   SYM            S   (the memory at the symbol, or the branch target)
+*   OFF of REG     OR  register + disp + index * scale
+*   OFF of SYM     OS  symbol + disp + index * scale
+*
+* The width is that of the first register or memory operand with an integer
+* value type, then that of the first immediate, q when no operand has one.
+* Pointer and size types are q. CBC arithmetic is signed, signedness only
+* matters for CVT and immediate extension.
+*
+* Functions are independent: they are lowered concurrently with coil_par_for
+* (largest first) and then laid out in section order.
+*/
+
+#ifndef __COIL_INCLUDE_GUARD_LOWER_H
+#define __COIL_INCLUDE_GUARD_LOWER_H
+
+#include <coil/base.h>
+#include <coil/sect.h>
+#include <coil/cbc.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+* @brief CBC offset value for COIL offsets that do not start an instruction
+*/
+#define COIL_LOWER_NO_CODE ((coil_u32_t)0xFFFFFFFF)
+
+/**
+* @brief Default base register of variable slots
+*/
+#define COIL_LOWER_FRAME_REG 30
+
+/**
+* @brief Default scratch register (CVT through memory)
+*/
+#define COIL_LOWER_SCRATCH_REG 31
+
+/**
+* @brief Default size of a variable slot in bytes
+*/
+#define COIL_LOWER_VAR_SLOT 16
+
+/**
+* @brief Function to lower
+*/
+typedef struct coil_lower_func {
+  coil_u64_t offset;           ///< Offset of the first instruction in the COIL section
+  coil_u64_t size;             ///< Size of the function in bytes
+} coil_lower_func_t;
+
+/**
+* @brief Lowering options
+*/
+typedef struct coil_lower_options {
+  coil_u32_t threads;                  ///< Threads including the caller (0 for coil_par_default_threads)
+  coil_u8_t frame_reg;                 ///< Base register of variable slots
+  coil_u8_t scratch_reg;               ///< Register reserved for the lowering
+  coil_u32_t var_slot;                 ///< Bytes per variable slot
+  const coil_cbc_operand_t *homes;     ///< Home of every variable below home_count (R, S, OS or OR, may be NULL)
+  coil_u64_t home_count;               ///< Number of homes
+} coil_lower_options_t;
+
+/**
+* @brief Result of a lowering
+*/
+typedef struct coil_lower {
+  coil_u32_t *cbc_of;          ///< CBC offset per COIL offset (COIL_LOWER_NO_CODE inside instructions and between functions)
+  coil_size_t ir_size;         ///< Size of the COIL section
+  coil_size_t code_size;       ///< Bytes of CBC appended to the output section
+  coil_u64_t fault;            ///< Offset of the COIL instruction that failed to lower
+} coil_lower_t;
+
+/**
+* @brief Default options (every variable in a slot off COIL_LOWER_FRAME_REG)
+*/
+static inline void coil_lower_options_init(coil_lower_options_t *options) {
+  options->threads = 0;
+  options->frame_reg = COIL_LOWER_FRAME_REG;
+  options->scratch_reg = COIL_LOWER_SCRATCH_REG;
+  options->var_slot = COIL_LOWER_VAR_SLOT;
+  options->homes = NULL;
+  options->home_count = 0;
+}
+
+/**
+* @brief Lower COIL functions to CBC
+*
+* Functions are appended to out in the order given, nothing is appended
+* when any instruction fails to lower.
+*
+* @param lower Result to initialize
+* @param out Section to append the CBC to
+* @param ir Section holding the COIL instructions
+* @param funcs Functions in ascending, non-overlapping order (NULL for the whole section as one function)
+* @param count Number of functions
+* @param options Lowering options (NULL for coil_lower_options_init)
+*
+* @return coil_err_t COIL_ERR_GOOD on success
+* @return coil_err_t COIL_ERR_INVAL if parameters are invalid or functions overlap or leave the section
+* @return coil_err_t COIL_ERR_BADSTATE if ir is chunked or out is read-only
+* @return coil_err_t COIL_ERR_FORMAT if an instruction is malformed, crosses the end of its function, uses an
+*                    unknown register or symbol or has operand forms no CBC opcode takes (lower->fault names it)
+* @return coil_err_t COIL_ERR_NOTSUP if an instruction has no CBC equivalent: ABI and expression directives,
+*                    flagged non-branch instructions, immediate branch targets, floating point or data-less
+*                    value types and displacements beyond 32 bits (lower->fault names it)
+* @return coil_err_t COIL_ERR_NOMEM if memory allocation fails
+*/
+coil_err_t coil_lower_section(coil_lower_t *lower, coil_section_t *out, coil_section_t *ir,
+                              const coil_lower_func_t *funcs, coil_u32_t count,
+                              const coil_lower_options_t *options);
+
+/**
+* @brief Find the CBC offset of a COIL offset
+*
+* Function ends map to the end of their code, so symbol values and sizes
+* can be rewritten with it.
+*
+* @param lower Result of coil_lower_section
+* @param ir_offset Offset in the COIL section
+* @param cbc_offset Receives the offset in the output section
+*
+* @return coil_err_t COIL_ERR_GOOD on success
+* @return coil_err_t COIL_ERR_INVAL if parameters are invalid
+* @return coil_err_t COIL_ERR_NOTFOUND if ir_offset does not start an instruction or end a function
+*/
+coil_err_t coil_lower_offset(const coil_lower_t *lower, coil_u64_t ir_offset, coil_u64_t *cbc_offset);
+
+/**
+* @brief Release a lowering result
+*
+* @param lower Result to release
+*/
+void coil_lower_cleanup(coil_lower_t *lower);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // __COIL_INCLUDE_GUARD_LOWER_H
@@ -45,6 +45,31 @@ void* coil_mmap(coil_size_t size, coil_size_t alignment);
 */
 coil_err_t coil_munmap(void *ptr, coil_size_t size);
 
+/**
+* @brief Access pattern hints for mapped memory and file ranges
+*/
+typedef enum coil_advice_e {
+  COIL_ADVICE_NORMAL = 0,      ///< No special treatment
+  COIL_ADVICE_SEQUENTIAL = 1,  ///< Expect sequential access (aggressive readahead)
+  COIL_ADVICE_RANDOM = 2,      ///< Expect random access (disable readahead)
+  COIL_ADVICE_WILLNEED = 3,    ///< Expect access soon (start reading ahead asynchronously)
+  COIL_ADVICE_DONTNEED = 4,    ///< Do not expect access soon (release cached pages)
+} coil_advice_t;
+
+/**
+* @brief Give the kernel an access pattern hint for a range of mapped memory
+* 
+* The range is widened to page boundaries before the hint is issued.
+* 
+* @param ptr Start of the range (must be inside a memory mapping)
+* @param size Size of the range in bytes
+* @param advice Access pattern hint (COIL_ADVICE_*)
+* @return coil_err_t COIL_ERR_GOOD on success, COIL_ERR_INVAL for invalid parameters or a rejected hint
+* 
+* @note COIL_ADVICE_DONTNEED discards private modifications of the range, only use it on clean views
+*/
+coil_err_t coil_madvise(void *ptr, coil_size_t size, coil_advice_t advice);
+
 /**
 * @brief Align a value up to the nearest multiple of alignment
 * 
@@ -8,6 +8,7 @@
 
 #include <coil/base.h>
 #include <coil/sect.h>
+#include <coil/target.h>
 
 #ifdef __cplusplus
 extern "C" {
@@ -26,6 +27,63 @@ typedef struct coil_object_header {
   coil_u8_t reserved[8];       ///< Reserved for future use
 } coil_object_header_t;
 
+/**
+* @brief Index map entry for sections removed by coil_obj_compact_sections
+*/
+#define COIL_SECTION_INDEX_NONE ((coil_u16_t)0xFFFF)
+
+/**
+* @brief Cached result of coil_obj_select_target_section for one group
+*/
+typedef struct coil_obj_target_choice {
+  coil_u16_t group;            ///< Variant group
+  coil_u16_t index;            ///< Selected section (COIL_SECTION_INDEX_NONE if nothing runs on the host)
+} coil_obj_target_choice_t;
+
+/**
+* @brief Target query fields (coil_target_query_t.match)
+*/
+typedef enum coil_target_match_e {
+  COIL_TARGET_MATCH_PU = 1 << 0,        ///< Processing unit must equal pu
+  COIL_TARGET_MATCH_ARCH = 1 << 1,      ///< Architecture must equal arch
+  COIL_TARGET_MATCH_FEATURES = 1 << 2,  ///< Required features must be a subset of max_features
+} coil_target_match_t;
+
+/**
+* @brief Query over section target metadata
+*/
+typedef struct coil_target_query {
+  int match;                   ///< Fields to compare (coil_target_match_t)
+  coil_pu_t pu;                ///< Processing unit
+  coil_u8_t arch;              ///< Architecture
+  coil_u64_t max_features;     ///< Features sections may require
+} coil_target_query_t;
+
+/**
+* @brief Bitmap index of section target metadata
+*
+* Every bitmap has one bit per section index and words 64-bit words.
+* Bitmaps are stored back to back: live sections, the 64 feature bits,
+* one per processing unit present, one per architecture value present.
+*/
+typedef struct coil_target_index {
+  coil_u64_t *bits;            ///< Every bitmap in one block
+  coil_u32_t words;            ///< 64-bit words per bitmap
+  coil_u16_t sections;         ///< Number of sections covered
+  coil_u16_t pu_count;         ///< Number of processing unit bitmaps
+  coil_pu_t *pu_keys;          ///< Processing unit of each processing unit bitmap
+  coil_u16_t arch_slot[256];   ///< Architecture bitmap per raw_arch value, plus one (0 if absent)
+  coil_u64_t features;         ///< Union of the features required by any section
+} coil_target_index_t;
+
+/**
+* @brief Executable mapping created by coil_obj_map_exec
+*/
+typedef struct coil_obj_exec_map {
+  coil_byte_t *base;           ///< Start of the mapping (page aligned)
+  coil_size_t size;            ///< Length of the mapping
+} coil_obj_exec_map_t;
+
 /**
 * @brief COIL Object
 * 
@@ -44,16 +102,30 @@ typedef struct coil_object {
   coil_section_header_t *sectheaders;  ///< Array of section headers
   coil_section_t *sections;            ///< Array of loaded sections (may be NULL if not loaded)
   coil_u16_t loaded_count;             ///< Number of currently loaded sections
+  coil_u16_t deleted_count;            ///< Number of deleted sections awaiting compaction
 
   // Object Memory
   coil_byte_t *memory;                 ///< Memory for the object (may be memory mapped)
   coil_descriptor_t fd;                ///< File descriptor for memory mapping
   int is_mapped;                       ///< Flag indicating if memory is mapped
+  int read_only;                       ///< Flag indicating the mapping cannot be written (COW sections are copied)
+  int owns_memory;                     ///< Flag indicating memory is a heap buffer released with the object
   
   // Default target metadata for new sections
   coil_pu_t default_pu;                ///< Default processing unit for target
   coil_u8_t default_arch;              ///< Default architecture for target
   coil_u64_t default_features;         ///< Default feature flags for target
+  
+  // Host variant selection and target index, dropped whenever sections are added, removed or retargeted
+  coil_obj_target_choice_t *target_cache; ///< Selected section per group
+  coil_u16_t target_cache_count;       ///< Number of cached groups
+  coil_u16_t target_cache_capacity;    ///< Allocated cache entries
+  coil_target_index_t *target_index;   ///< Target metadata index (NULL until first queried)
+  
+  // Executable mappings of native sections, released with the object
+  coil_obj_exec_map_t *exec_maps;      ///< Live executable mappings
+  coil_u32_t exec_count;               ///< Number of live mappings
+  coil_u32_t exec_capacity;            ///< Allocated mapping entries
 } coil_object_t;
 
 /**
@@ -64,6 +136,15 @@ typedef enum coil_obj_init_flag_e {
   COIL_OBJ_INIT_EMPTY = 1 << 0,   ///< Initialize as empty object (for creation)
 } coil_obj_init_flag_t;
 
+/**
+* @brief In-memory load flags (coil_obj_load_memory)
+*/
+typedef enum coil_obj_memory_flag_e {
+  COIL_OBJ_MEM_BORROW = 0,        ///< Use the buffer in place, it must outlive the object
+  COIL_OBJ_MEM_COPY = 1 << 0,     ///< Copy the buffer, the object owns the copy
+  COIL_OBJ_MEM_TAKE = 1 << 1,     ///< Take over a coil_malloc'd buffer, freed with the object
+} coil_obj_memory_flag_t;
+
 /**
 * @brief Section loading modes
 */
@@ -71,6 +152,11 @@ typedef enum coil_section_load_mode_e {
   COIL_SLOAD_DEFAULT = 0,         ///< Default loading (copy section data)
   COIL_SLOAD_VIEW = 1 << 0,       ///< View mode (direct pointer to object memory)
   COIL_SLOAD_MMAP = 1 << 1,       ///< Use memory mapping when possible
+  COIL_SLOAD_SEQUENTIAL = 1 << 2, ///< Hint sequential access over the section range
+  COIL_SLOAD_RANDOM = 1 << 3,     ///< Hint random access over the section range
+  COIL_SLOAD_WILLNEED = 1 << 4,   ///< Start reading the section range ahead of use
+  COIL_SLOAD_DONTNEED = 1 << 5,   ///< Release cached pages of the section range once loaded
+  COIL_SLOAD_COW = 1 << 6,        ///< Writable view, mapped pages are copied on first write
 } coil_section_load_mode_t;
 
 /**
@@ -142,12 +228,87 @@ coil_err_t coil_obj_load_file(coil_object_t *obj, coil_descriptor_t fd);
 */
 coil_err_t coil_obj_mmap(coil_object_t *obj, coil_descriptor_t fd);
 
+/**
+* @brief Map an object stored inside a larger file
+*
+* Used for archive members. Only the object's own range is mapped and the
+* descriptor is not taken over, it may be closed once the object is mapped.
+* 
+* @param obj Object to populate
+* @param fd File descriptor of the containing file
+* @param offset Offset of the object in the file (must be page aligned)
+* @param size Size of the object in bytes
+* 
+* @return COIL_ERR_GOOD on success
+* @return COIL_ERR_INVAL if parameters are invalid or offset is not page aligned
+* @return COIL_ERR_IO if the range cannot be mapped
+* @return COIL_ERR_FORMAT if the object format is invalid
+*/
+coil_err_t coil_obj_mmap_range(coil_object_t *obj, coil_descriptor_t fd, coil_u64_t offset, coil_size_t size);
+
+/**
+* @brief Load an object from a buffer already in memory
+*
+* No descriptor and no syscalls: section views point straight into the
+* buffer and copied sections are read out of it. Borrowed buffers are never
+* written, COIL_SLOAD_COW on them copies the section instead.
+* 
+* @param obj Object to populate
+* @param ptr Object image
+* @param len Size of the image in bytes
+* @param flags Ownership of the buffer (COIL_OBJ_MEM_*)
+* 
+* @return COIL_ERR_GOOD on success
+* @return COIL_ERR_INVAL if parameters are invalid
+* @return COIL_ERR_NOMEM if memory allocation fails
+* @return COIL_ERR_FORMAT if the object format is invalid (a taken buffer is then left with the caller)
+*/
+coil_err_t coil_obj_load_memory(coil_object_t *obj, const void *ptr, coil_size_t len, int flags);
+
+/**
+* @brief Serialize an object into a sealed memfd
+*
+* The image is written with coil_obj_save_file into an anonymous memory
+* file, which is then sealed against writes, growth and shrinking. Pass the
+* descriptor to another process (fork, SCM_RIGHTS) and open it there with
+* coil_obj_import_memfd: no filesystem round trip and no copies.
+* 
+* @param obj Object to export
+* @param fd Receives the sealed descriptor (close-on-exec, owned by the caller)
+* 
+* @return COIL_ERR_GOOD on success
+* @return COIL_ERR_INVAL if parameters are invalid
+* @return COIL_ERR_IO if the memfd cannot be created, written or sealed
+* @return COIL_ERR_NOTSUP if sealed memfds are not available on this platform
+*/
+coil_err_t coil_obj_export_memfd(coil_object_t *obj, coil_descriptor_t *fd);
+
+/**
+* @brief Map an object from a sealed memfd
+*
+* Like coil_obj_mmap, but the descriptor must carry the write and shrink
+* seals so the image cannot change while it is mapped. The image is mapped
+* read-only: views share its pages, COW sections are read out as private
+* copies.
+* 
+* @param obj Object to populate
+* @param fd Sealed descriptor (owned by the object on success)
+* 
+* @return COIL_ERR_GOOD on success
+* @return COIL_ERR_INVAL if obj or fd is invalid
+* @return COIL_ERR_BADSTATE if the descriptor is not sealed
+* @return COIL_ERR_IO if the image cannot be mapped
+* @return COIL_ERR_FORMAT if the object format is invalid
+* @return COIL_ERR_NOTSUP if sealed memfds are not available on this platform
+*/
+coil_err_t coil_obj_import_memfd(coil_object_t *obj, coil_descriptor_t fd);
+
 /**
 * @brief Convert a memory-mapped object to a regular object
 *
 * This function copies all data from the memory-mapped object to a regular
 * object with standard memory allocation. After conversion, the object
-* is no longer tied to the file mapping.
+* is no longer tied to the file mapping (or the buffer it was loaded from).
 *
 * @param obj Object to convert
 *
@@ -160,15 +321,52 @@ coil_err_t coil_obj_unmap(coil_object_t *obj);
 /**
 * @brief Save object to file
 * 
+* Deleted sections are compacted away first (see coil_obj_compact_sections)
+* and the section fields of SYMTAB and RELTAB sections are renumbered to
+* match: symbols defined in a deleted section become undefined and
+* relocations into one are dropped.
+* Memory mapped objects stay mapped: sections that were never loaded are
+* streamed straight from the mapping and COW sections write out their
+* (partially copied) pages as they are.
+* Saving over the object's own file reads every section into memory first
+* and releases the mapping, so views into it must not be used afterwards;
+* it fails with COIL_ERR_BADSTATE while code is mapped with coil_obj_map_exec.
+* 
+* The object is written at the current file position and the position is
+* left at the end of the object, so objects can be appended to a container.
+* COIL_SECTION_FLAG_TARGET sections, and the first section after each, start
+* on a page boundary so coil_obj_map_exec can map the code from the file.
+* 
 * @param obj Object to save
 * @param fd File descriptor for the file to create or overwrite
 * 
 * @return COIL_ERR_GOOD on success
 * @return COIL_ERR_INVAL if obj or fd is invalid
+* @return COIL_ERR_NOMEM if the header table cannot be allocated
 * @return COIL_ERR_IO if file cannot be written
+* @return COIL_ERR_BADSTATE if fd is the object's own file and code is mapped from it
 */
 coil_err_t coil_obj_save_file(coil_object_t *obj, coil_descriptor_t fd);
 
+/**
+* @brief Save object to file, writing sections concurrently
+*
+* Produces the same file as coil_obj_save_file. The layout is computed up
+* front, the final size is preallocated with fallocate where supported, and
+* worker threads write (or kernel-copy) every section at its offset with
+* positional writes. The header table is written last.
+* 
+* @param obj Object to save
+* @param fd File descriptor for the file to create or overwrite (must be seekable)
+* @param threads Maximum number of threads (0 for one per CPU)
+* 
+* @return COIL_ERR_GOOD on success
+* @return COIL_ERR_INVAL if obj or fd is invalid
+* @return COIL_ERR_NOMEM if the header table cannot be allocated
+* @return COIL_ERR_IO if file cannot be written
+*/
+coil_err_t coil_obj_save_file_parallel(coil_object_t *obj, coil_descriptor_t fd, coil_u32_t threads);
+
 /**
 * @brief Load a section by index
 * 
@@ -177,6 +375,15 @@ coil_err_t coil_obj_save_file(coil_object_t *obj, coil_descriptor_t fd);
 * @param sect Pointer to section structure to populate
 * @param mode Section access mode (COIL_SECT_MODE_*) and loading mode (COIL_SLOAD_*)
 * 
+* The COIL_SLOAD_SEQUENTIAL, COIL_SLOAD_RANDOM, COIL_SLOAD_WILLNEED and COIL_SLOAD_DONTNEED
+* hints are applied to the section's range of the mapping or descriptor.
+* 
+* COIL_SLOAD_COW returns a COIL_SECT_MODE_COW section over the object mapping (or over
+* its own mapping with COIL_SLOAD_MMAP). When no mapping is available the data is copied.
+* 
+* COIL_SLOAD_VIEW likewise points into the object image. Without one the data is read
+* into a COIL_SECT_MODE_MODIFY section the caller releases with coil_section_cleanup.
+* 
 * @return COIL_ERR_GOOD on success
 * @return COIL_ERR_INVAL if parameters are invalid
 * @return COIL_ERR_NOTFOUND if section index is out of range
@@ -184,11 +391,47 @@ coil_err_t coil_obj_save_file(coil_object_t *obj, coil_descriptor_t fd);
 */
 coil_err_t coil_obj_load_section(coil_object_t *obj, coil_u16_t index, coil_section_t *sect, int mode);
 
+/**
+* @brief Make a loaded view section writable without copying it
+* 
+* Views into the object mapping become COIL_SECT_MODE_COW in place, the object is
+* mapped privately so only written pages are copied. Other sections are promoted
+* with coil_section_promote. The object's own record of the section follows.
+* 
+* @param obj Object the section was loaded from
+* @param index Section index
+* @param sect Section previously returned by coil_obj_load_section
+* 
+* @return COIL_ERR_GOOD on success
+* @return COIL_ERR_INVAL if parameters are invalid
+* @return COIL_ERR_NOTFOUND if section index is out of range
+* @return COIL_ERR_NOMEM if the section has to be copied and allocation fails
+*/
+coil_err_t coil_obj_promote_section(coil_object_t *obj, coil_u16_t index, coil_section_t *sect);
+
+/**
+* @brief Start reading a set of sections ahead of use
+* 
+* Issues asynchronous readahead for the file ranges of the given sections so
+* later loads and views do not stall on page faults. Uses madvise on mapped
+* objects and posix_fadvise on descriptor backed objects. Returns without
+* waiting for the reads to complete.
+* 
+* @param obj Object containing the sections
+* @param indices Section indices to prefetch (NULL for all sections)
+* @param count Number of entries in indices
+* 
+* @return COIL_ERR_GOOD on success
+* @return COIL_ERR_INVAL if obj is NULL
+* @return COIL_ERR_NOTFOUND if a section index is out of range
+*/
+coil_err_t coil_obj_prefetch_sections(coil_object_t *obj, const coil_u16_t *indices, coil_u16_t count);
+
 /**
 * @brief Create a new section in the object
 * 
 * @param obj Object to add section to
-* @param type Section type (COIL_SECTION_*)
+* @param type Section type (COIL_SECTION_*, COIL_SECTION_NULL marks deleted sections and is rejected)
 * @param name Section name
 * @param flags Section flags (COIL_SECTION_FLAG_*)
 * @param sect Pre-initialized section to copy data from (can be NULL for empty section)
@@ -207,15 +450,200 @@ coil_err_t coil_obj_create_section(coil_object_t *obj, coil_u8_t type, const cha
 /**
 * @brief Delete a section from the object
 * 
+* The section is released and its header turned into a tombstone
+* (COIL_SECTION_NULL) in O(1), every other section keeps its index.
+* Tombstones are removed by coil_obj_compact_sections, which
+* coil_obj_save_file runs when any are left (renumbering symbol and
+* relocation tables with the index map).
+* 
 * @param obj Object containing the section
 * @param index Section index to delete
 * 
 * @return COIL_ERR_GOOD on success
 * @return COIL_ERR_INVAL if obj is NULL
-* @return COIL_ERR_NOTFOUND if section index is out of range
+* @return COIL_ERR_NOTFOUND if section index is out of range or already deleted
 */
 coil_err_t coil_obj_delete_section(coil_object_t *obj, coil_u16_t index);
 
+/**
+* @brief Check if a section index refers to a deleted section
+* 
+* @param obj Object containing the section
+* @param index Section index (must be below header.section_count)
+* @return int Non-zero if the section is a tombstone
+*/
+static inline int coil_obj_section_deleted(const coil_object_t *obj, coil_u16_t index) {
+  return obj->sectheaders[index].type == COIL_SECTION_NULL;
+}
+
+/**
+* @brief Remove deleted sections and renumber the remaining ones
+* 
+* Runs in a single pass over the section table. When index_map is given it
+* receives, for every index before compaction, the new index of the section
+* or COIL_SECTION_INDEX_NONE if it was deleted, so callers can rewrite
+* references (symbols, relocations) in one go.
+* 
+* @param obj Object to compact
+* @param index_map Array of at least header.section_count entries (may be NULL)
+* 
+* @return COIL_ERR_GOOD on success
+* @return COIL_ERR_INVAL if obj is NULL
+*/
+coil_err_t coil_obj_compact_sections(coil_object_t *obj, coil_u16_t *index_map);
+
+/**
+* @brief Set the target metadata of a section
+*
+* Drops the cached host selections of the object.
+* 
+* @param obj Object containing the section
+* @param index Section index
+* @param pu Processing unit the section targets
+* @param arch Architecture the section targets
+* @param features Feature flags the section requires
+* @param group Variant group (sections in one group are alternatives to one another)
+* 
+* @return COIL_ERR_GOOD on success
+* @return COIL_ERR_INVAL if obj is NULL
+* @return COIL_ERR_NOTFOUND if the index is out of range or deleted
+*/
+coil_err_t coil_obj_set_section_target(coil_object_t *obj, coil_u16_t index, coil_pu_t pu, coil_u8_t arch,
+                                       coil_u64_t features, coil_u16_t group);
+
+/**
+* @brief Pick the most capable section of a group that runs on a machine
+*
+* Candidates are the sections of the group that carry
+* COIL_SECTION_FLAG_TARGET and a target processing unit.
+* Among those compatible with the machine (coil_target_compatible) the one
+* with the highest coil_target_rank wins, the lowest index on ties.
+* Compatible sections come from the target index, not a header scan.
+* 
+* @param obj Object to search
+* @param group Variant group
+* @param machine Machine the section has to run on
+* @param index Receives the section index
+* 
+* @return COIL_ERR_GOOD on success
+* @return COIL_ERR_INVAL if parameters are invalid
+* @return COIL_ERR_NOTFOUND if no section of the group runs on the machine
+* @return COIL_ERR_NOMEM if the target index cannot be built
+*/
+coil_err_t coil_obj_select_section_for(coil_object_t *obj, coil_u16_t group, const coil_target_t *machine,
+                                       coil_u16_t *index);
+
+/**
+* @brief Get the target metadata index of an object
+*
+* Built on first use and kept until sections are added, removed or
+* retargeted. The pointer is invalidated by those changes.
+* 
+* @param obj Object to index
+* @param index Receives the index
+* 
+* @return COIL_ERR_GOOD on success
+* @return COIL_ERR_INVAL if parameters are invalid
+* @return COIL_ERR_NOMEM if memory allocation fails
+*/
+coil_err_t coil_obj_target_index(coil_object_t *obj, const coil_target_index_t **index);
+
+/**
+* @brief Evaluate a query against a target index
+*
+* Combines whole bitmaps word by word, the section headers are not read.
+* Deleted sections never match.
+* 
+* @param index Target index
+* @param query Query to evaluate
+* @param bits Receives the matching sections (index->words words)
+* 
+* @return COIL_ERR_GOOD on success
+* @return COIL_ERR_INVAL if parameters are invalid
+*/
+coil_err_t coil_target_index_query(const coil_target_index_t *index, const coil_target_query_t *query, coil_u64_t *bits);
+
+/**
+* @brief List the sections matching a target query
+*
+* Matches are written in increasing index order. count receives the total
+* number of matches, which may exceed capacity.
+* 
+* @param obj Object to search
+* @param query Query to evaluate
+* @param indices Receives up to capacity section indices (may be NULL when capacity is 0)
+* @param capacity Number of entries in indices
+* @param count Receives the number of matching sections
+* 
+* @return COIL_ERR_GOOD on success
+* @return COIL_ERR_INVAL if parameters are invalid
+* @return COIL_ERR_NOMEM if memory allocation fails
+*/
+coil_err_t coil_obj_find_targets(coil_object_t *obj, const coil_target_query_t *query, coil_u16_t *indices,
+                                 coil_u16_t capacity, coil_u16_t *count);
+
+/**
+* @brief Pick the most capable section of a group that runs on this host
+*
+* Like coil_obj_select_section_for with coil_host_target(). The result is
+* cached in the object until its sections change.
+* 
+* @param obj Object to search
+* @param group Variant group
+* @param index Receives the section index
+* 
+* @return COIL_ERR_GOOD on success
+* @return COIL_ERR_INVAL if parameters are invalid
+* @return COIL_ERR_NOTFOUND if no section of the group runs on the host
+* @return COIL_ERR_NOMEM if the cache cannot grow
+*/
+coil_err_t coil_obj_select_target_section(coil_object_t *obj, coil_u16_t group, coil_u16_t *index);
+
+/**
+* @brief Map a native section for execution
+*
+* The section must carry COIL_SECTION_FLAG_TARGET and target metadata that
+* runs on this host. Unmodified sections of objects backed by a descriptor
+* are mapped straight from the file, other sections are copied into an
+* anonymous mapping. Relocations targeting the section (from every
+* COIL_SECTION_RELTAB of the object) are applied while the private mapping
+* is still writable, then it is switched to read and execute. The mapping
+* is never writable and executable at once.
+*
+* Only the section's own pages are mapped from the file: coil_obj_save_file
+* starts native sections and the data after them on a fresh page. Other
+* layouts, and files whose pages cannot be made executable, are copied.
+* 
+* @param obj Object containing the section
+* @param index Section index
+* @param symvals Symbol values indexed by coil_reloc_t.symbol (may be NULL without relocations)
+* @param symcount Number of symbol values
+* @param entry Receives the address of the first byte of the section
+* 
+* @return COIL_ERR_GOOD on success
+* @return COIL_ERR_INVAL if parameters are invalid or the section is empty
+* @return COIL_ERR_NOTFOUND if the index is out of range or deleted
+* @return COIL_ERR_BADSTATE if the section is not native code or has no data
+* @return COIL_ERR_NOTSUP if the section does not run on this host
+* @return COIL_ERR_FORMAT if a relocation is malformed
+* @return COIL_ERR_IO if the mapping cannot be created or protected
+* @return COIL_ERR_NOMEM if memory allocation fails
+*/
+coil_err_t coil_obj_map_exec(coil_object_t *obj, coil_u16_t index, const coil_u64_t *symvals,
+                             coil_u32_t symcount, void **entry);
+
+/**
+* @brief Release a mapping created by coil_obj_map_exec before the object is cleaned up
+* 
+* @param obj Object the section was mapped from
+* @param entry Address returned by coil_obj_map_exec
+* 
+* @return COIL_ERR_GOOD on success
+* @return COIL_ERR_INVAL if obj is NULL
+* @return COIL_ERR_NOTFOUND if entry is not inside a mapping of the object
+*/
+coil_err_t coil_obj_unmap_exec(coil_object_t *obj, void *entry);
+
 /**
 * @brief Find a section by name
 * 
@@ -0,0 +1,58 @@
+/**
+* @file par.h
+* @brief Minimal parallel loop helper for libcoil-dev
+*
+* Work items are handed out one at a time from a shared counter, so uneven
+* items (sections of very different sizes) still balance across threads.
+* The calling thread takes part in the loop.
+*/
+
+#ifndef __COIL_INCLUDE_GUARD_PAR_H
+#define __COIL_INCLUDE_GUARD_PAR_H
+
+#include <coil/types.h>
+#include <coil/err.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+* @brief Work item callback
+*
+* @param ctx User context
+* @param index Index of the work item
+*
+* @return coil_err_t COIL_ERR_GOOD on success, anything else is reported by coil_par_for
+*/
+typedef coil_err_t (*coil_par_fn_t)(void *ctx, coil_size_t index);
+
+/**
+* @brief Get the number of threads used when none is specified
+*
+* @return coil_u32_t Number of online CPUs (at least 1)
+*/
+coil_u32_t coil_par_default_threads(void);
+
+/**
+* @brief Run fn for every index in [0, count) across threads
+*
+* Items run in no particular order. Every item runs even if an earlier one
+* fails; the first failure is returned.
+*
+* @param count Number of work items
+* @param threads Maximum number of threads including the caller (0 for coil_par_default_threads)
+* @param fn Work item callback
+* @param ctx User context passed to fn
+*
+* @return coil_err_t COIL_ERR_GOOD if every item succeeded
+* @return coil_err_t COIL_ERR_INVAL if fn is NULL
+* @return coil_err_t The first error returned by fn otherwise
+*/
+coil_err_t coil_par_for(coil_size_t count, coil_u32_t threads, coil_par_fn_t fn, void *ctx);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // __COIL_INCLUDE_GUARD_PAR_H
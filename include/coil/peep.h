@@ -0,0 +1,137 @@
+/**
+* @file peep.h
+* @brief Peephole optimization and constant folding of COIL instructions for libcoil-dev
+*
+* One pass over an instruction stream with a window of two instructions.
+* Each instruction is matched against a table of rules keyed on the
+* opcode classes of the pair, and the surviving instructions are written
+* to a new section:
+*
+* - NOP is dropped.
+* - MOV a, a is dropped, as is MOV b, a right after MOV a, b.
+* - MOV a, x is dropped when the next instruction is MOV a, y and y does
+*   not read a.
+* - ADD, SUB, OR, XOR and shifts by zero, MUL by one and AND with all ones
+*   are dropped.
+* - MOV a, imm followed by ADD, SUB, MUL, AND, OR, XOR, SHL, SHR, SAL or
+*   SAR of an immediate into a (or INC, DEC, NEG, NOT of a) folds into one
+*   MOV at the width of a, for every integer COIL_VAL_* of up to 64 bits.
+*   Folded MOVs fold again with the next instruction, so a chain ends up
+*   as one MOV.
+* - Two immediate ADD/SUB, MUL, AND, OR or XOR into the same place
+*   combine into one, as do two shifts whose counts add up to less than
+*   the width.
+* - A CMP or TEST repeating the last one is dropped when only conditional
+*   branches and NOPs came in between.
+*
+* Rules rewrite registers and variables of integer value types. Memory
+* operands, operands with volatile or atomic modifiers and flagged
+* (conditional) non-branch instructions are never touched. Every symbol
+* value inside the range is treated as an entry: no rule spans one, and
+* no CMP is carried past one.
+*
+* Operands are values of their value type. CBC zero extends register
+* writes, so a dropped instruction on a register leaves bits above its
+* width alone where it would have cleared them.
+*/
+
+#ifndef __COIL_INCLUDE_GUARD_PEEP_H
+#define __COIL_INCLUDE_GUARD_PEEP_H
+
+#include <coil/base.h>
+#include <coil/sect.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+* @brief Number of rules
+*/
+#define COIL_PEEP_RULE_COUNT 8
+
+/**
+* @brief Rules (bit positions index coil_peep_t.hits)
+*/
+typedef enum coil_peep_rule_e {
+  COIL_PEEP_NOP = 1 << 0,              ///< Drop NOP
+  COIL_PEEP_MOV_SELF = 1 << 1,         ///< Drop MOV a, a
+  COIL_PEEP_MOV_BACK = 1 << 2,         ///< Drop MOV b, a after MOV a, b
+  COIL_PEEP_MOV_DEAD = 1 << 3,         ///< Drop MOV a, x before MOV a, y
+  COIL_PEEP_IDENTITY = 1 << 4,         ///< Drop ADD a, 0 and the other identities
+  COIL_PEEP_FOLD = 1 << 5,             ///< Fold MOV a, imm and an operation on a into one MOV
+  COIL_PEEP_COMBINE = 1 << 6,          ///< Combine two immediate operations on a into one
+  COIL_PEEP_CMP = 1 << 7,              ///< Drop a CMP or TEST repeating the last one
+  COIL_PEEP_ALL = (1 << COIL_PEEP_RULE_COUNT) - 1,
+} coil_peep_rule_t;
+
+/**
+* @brief Result of a peephole pass
+*/
+typedef struct coil_peep {
+  coil_u64_t offset;                   ///< Offset of the range in the COIL section
+  coil_u64_t size;                     ///< Size of the range in bytes
+  coil_u32_t *instrs;                  ///< Offset of each instruction from the range start
+  coil_u32_t *moved;                   ///< Offset of each instruction in the output, plus the end
+  coil_u32_t instr_count;              ///< Number of instructions read
+  coil_u32_t removed;                  ///< Number of instructions dropped
+  coil_u32_t hits[COIL_PEEP_RULE_COUNT]; ///< Times each rule applied
+  coil_size_t code_base;               ///< Offset of the output in its section
+  coil_size_t code_size;               ///< Size of the output
+  coil_u64_t fault;                    ///< Offset of the instruction that failed to decode
+} coil_peep_t;
+
+/**
+* @brief Optimize a range of COIL instructions into another section
+*
+* Nothing is appended on failure. The result is overwritten without being
+* released, so a result from an earlier call needs coil_peep_cleanup first.
+*
+* @param peep Result to initialize
+* @param out Section to append the instructions to
+* @param ir Section holding the COIL instructions
+* @param offset Offset of the first instruction
+* @param size Size of the range in bytes
+* @param symvals Symbol values (offsets in ir for code symbols, may be NULL when symcount is 0)
+* @param symcount Number of symbol values
+* @param rules Mask of rules to apply (coil_peep_rule_t)
+*
+* @return coil_err_t COIL_ERR_GOOD on success
+* @return coil_err_t COIL_ERR_INVAL if parameters are invalid or the range leaves the section
+* @return coil_err_t COIL_ERR_BADSTATE if ir is chunked or out is read-only
+* @return coil_err_t COIL_ERR_FORMAT if an instruction is malformed or crosses the end of the range
+*                    (peep->fault names it)
+* @return coil_err_t COIL_ERR_NOTSUP if the range is 4 GiB or more
+* @return coil_err_t COIL_ERR_NOMEM if memory allocation fails
+*/
+coil_err_t coil_peep_section(coil_peep_t *peep, coil_section_t *out, coil_section_t *ir, coil_u64_t offset,
+                             coil_u64_t size, const coil_u64_t *symvals, coil_u32_t symcount, coil_u32_t rules);
+
+/**
+* @brief Find the output offset of an offset in the range
+*
+* Dropped instructions map to the next instruction kept and the range end
+* to the output end, so symbol values and sizes can be rewritten with it.
+*
+* @param peep Result of coil_peep_section
+* @param ir_offset Offset in the COIL section
+* @param out_offset Receives the offset in the output section
+*
+* @return coil_err_t COIL_ERR_GOOD on success
+* @return coil_err_t COIL_ERR_INVAL if parameters are invalid
+* @return coil_err_t COIL_ERR_NOTFOUND if ir_offset does not start an instruction or end the range
+*/
+coil_err_t coil_peep_offset(const coil_peep_t *peep, coil_u64_t ir_offset, coil_u64_t *out_offset);
+
+/**
+* @brief Release a result
+*
+* @param peep Result to release
+*/
+void coil_peep_cleanup(coil_peep_t *peep);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // __COIL_INCLUDE_GUARD_PEEP_H
@@ -0,0 +1,131 @@
+/**
+* @file pool.h
+* @brief Thread-local size-classed buffer pool for libcoil-dev
+*
+* Buffers are grouped into power-of-two size classes and cached per thread,
+* so short-lived scratch sections reuse memory instead of going back to
+* malloc. Classes at or above COIL_POOL_MMAP_THRESHOLD are backed by
+* coil_mmap. Each thread owns its cache, which is drained when the thread
+* exits. coil_pool_trim hands blocks back earlier.
+*/
+
+#ifndef __COIL_INCLUDE_GUARD_POOL_H
+#define __COIL_INCLUDE_GUARD_POOL_H
+
+#include <coil/types.h>
+#include <coil/err.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+* @brief Smallest size class (as a power of two)
+*/
+#define COIL_POOL_MIN_SHIFT 6
+
+/**
+* @brief Largest size class (as a power of two), bigger requests bypass the cache
+*/
+#define COIL_POOL_MAX_SHIFT 24
+
+/**
+* @brief Number of size classes
+*/
+#define COIL_POOL_CLASS_COUNT (COIL_POOL_MAX_SHIFT - COIL_POOL_MIN_SHIFT + 1)
+
+/**
+* @brief Blocks of at least this size are allocated with coil_mmap
+*/
+#define COIL_POOL_MMAP_THRESHOLD ((coil_size_t)1 << 16)
+
+/**
+* @brief Maximum number of cached blocks per size class
+*/
+#define COIL_POOL_CLASS_LIMIT 16
+
+/**
+* @brief Maximum number of bytes cached per thread
+*/
+#define COIL_POOL_RETAIN_LIMIT ((coil_size_t)64 << 20)
+
+/**
+* @brief Pool counters for the calling thread
+*/
+typedef struct coil_pool_stats {
+  coil_u64_t hits;             ///< Allocations served from the cache
+  coil_u64_t misses;           ///< Allocations that went to malloc/mmap
+  coil_u64_t releases;         ///< Frees that were kept in the cache
+  coil_u64_t drops;            ///< Frees that went straight back to the system
+  coil_size_t bytes_retained;  ///< Bytes currently cached
+  coil_size_t blocks_retained; ///< Blocks currently cached
+} coil_pool_stats_t;
+
+/**
+* @brief Get the capacity the pool hands out for a request
+*
+* @param size Requested size in bytes
+* @return coil_size_t Size class capacity (requests past the largest class are returned unchanged)
+*/
+coil_size_t coil_pool_class_size(coil_size_t size);
+
+/**
+* @brief Allocate a buffer from the calling thread's pool
+*
+* @param size Requested size in bytes (0 selects the smallest class)
+* @param capacity Receives the usable capacity of the block (may be NULL)
+* @return void* Pointer to the block or NULL on failure
+*
+* @note The block must be returned with coil_pool_free using the reported capacity
+*/
+void* coil_pool_alloc(coil_size_t size, coil_size_t *capacity);
+
+/**
+* @brief Return a buffer to the calling thread's pool
+*
+* Blocks may be freed on a different thread than they were allocated on.
+*
+* @param ptr Block returned by coil_pool_alloc (NULL is ignored)
+* @param capacity Capacity reported by coil_pool_alloc
+*/
+void coil_pool_free(void *ptr, coil_size_t capacity);
+
+/**
+* @brief Release cached blocks until at most keep_bytes remain
+*
+* Larger classes are released first.
+*
+* @param keep_bytes Number of cached bytes to keep (0 empties the cache)
+* @return coil_size_t Number of bytes handed back to the system
+*/
+coil_size_t coil_pool_trim(coil_size_t keep_bytes);
+
+/**
+* @brief Get pool counters for the calling thread
+*
+* @param stats Structure to fill
+* @return coil_err_t COIL_ERR_GOOD on success, COIL_ERR_INVAL if stats is NULL
+*/
+coil_err_t coil_pool_get_stats(coil_pool_stats_t *stats);
+
+/**
+* @brief Reset hit/miss/release/drop counters for the calling thread
+*/
+void coil_pool_reset_stats(void);
+
+/**
+* @brief Fraction of allocations served from the cache
+*
+* @param stats Counters from coil_pool_get_stats
+* @return double Hit rate in [0, 1] (0 when nothing was allocated)
+*/
+static inline double coil_pool_hit_rate(const coil_pool_stats_t *stats) {
+  coil_u64_t total = stats->hits + stats->misses;
+  return total > 0 ? (double)stats->hits / (double)total : 0.0;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // __COIL_INCLUDE_GUARD_POOL_H
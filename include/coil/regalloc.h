@@ -0,0 +1,260 @@
+/**
+* @file regalloc.h
+* @brief Linear-scan register allocation of COIL variables for libcoil-dev
+*
+* A function is decoded once into flat instruction and variable reference
+* arrays. Each variable gets one live interval over instruction positions
+* in section order (two per instruction, reads at 2i and writes at 2i + 1),
+* widened with the liveness at block boundaries. Intervals are then handed
+* CBC registers in order of their start, after Poletto and Sarkar:
+*
+* - Registers the function names (REG operands and offset bases), the
+*   lowering's frame and scratch registers and any reserved ones are never
+*   handed out. At most the target's register count is used
+*   (coil_regalloc_target_registers).
+* - When no register is free, the interval that ends last is split at the
+*   current position. Its head keeps the register, its tail lives in a
+*   spill slot. An interval that ends after every active one is spilled
+*   whole.
+* - A CALL may clobber every register, so intervals live across one are
+*   split after it.
+* - A split never leaves a loop: when a branch from the tail reaches a
+*   block before the split where the variable is live, the split moves to
+*   that block's start. Every write in the head also stores to the slot,
+*   so the slot is current wherever the tail is entered from.
+* - Variables with volatile or atomic operands stay in their slot.
+*
+* Spill slots are packed by a second linear scan over the spilled
+* intervals and numbered as variables from slot_base on, so the lowering
+* places them in the first variable slots of the frame.
+*
+* The rewritten function replaces every variable operand with its register
+* (REG, or an offset based on the register) or its slot (VAR), keeping the
+* value type and modifiers. Variables are function-local: a read before any
+* write sees an unspecified value. Registers are caller-saved: a callee may
+* clobber registers it does not name, unless they are reserved.
+*/
+
+#ifndef __COIL_INCLUDE_GUARD_REGALLOC_H
+#define __COIL_INCLUDE_GUARD_REGALLOC_H
+
+#include <coil/base.h>
+#include <coil/sect.h>
+#include <coil/cbc.h>
+#include <coil/cfg.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+* @brief Index value for none (no spill slot, never split)
+*/
+#define COIL_REGALLOC_NONE ((coil_u32_t)0xFFFFFFFF)
+
+/**
+* @brief Register value for none (spilled whole)
+*/
+#define COIL_REGALLOC_NO_REG ((coil_u8_t)0xFF)
+
+/**
+* @brief Variable reference flags
+*/
+typedef enum coil_regalloc_ref_flag_e {
+  COIL_REGALLOC_READ = 1 << 0,         ///< The instruction reads the variable
+  COIL_REGALLOC_WRITE = 1 << 1,        ///< The instruction writes the variable
+  COIL_REGALLOC_BASE = 1 << 2,         ///< The variable is the base of an offset operand
+} coil_regalloc_ref_flag_t;
+
+/**
+* @brief Interval flags
+*/
+typedef enum coil_regalloc_flag_e {
+  COIL_REGALLOC_MEMORY = 1 << 0,       ///< Has volatile or atomic operands, never in a register
+  COIL_REGALLOC_BASED = 1 << 1,        ///< Is an offset base somewhere (split only when nothing else can be)
+} coil_regalloc_flag_t;
+
+/**
+* @brief Allocation options
+*/
+typedef struct coil_regalloc_options {
+  coil_u8_t arch;                      ///< Target architecture (coil_cpu_t) deciding the register count
+  coil_u32_t registers;                ///< Registers to use at most (0 for the target's count)
+  coil_u32_t reserved;                 ///< Mask of CBC registers never handed out
+  coil_u8_t frame_reg;                 ///< Base register of variable slots in the lowering (never handed out)
+  coil_u8_t scratch_reg;               ///< Register reserved by the lowering (never handed out)
+  coil_u64_t slot_base;                ///< Variable id of the first spill slot
+} coil_regalloc_options_t;
+
+/**
+* @brief Decoded instruction
+*/
+typedef struct coil_regalloc_instr {
+  coil_u32_t offset;           ///< Offset from the function start
+  coil_u32_t ref;              ///< Index of the first variable reference
+  coil_u8_t ref_count;         ///< Number of variable references
+  coil_u8_t opcode;            ///< Opcode (coil_opcode_t)
+} coil_regalloc_instr_t;
+
+/**
+* @brief Variable operand of an instruction
+*/
+typedef struct coil_regalloc_ref {
+  coil_u32_t interval;         ///< Interval of the variable
+  coil_u32_t offset;           ///< Offset of the operand from the function start
+  coil_u8_t size;              ///< Encoded size of the operand
+  coil_u8_t flags;             ///< coil_regalloc_ref_flag_t
+  coil_u8_t value_type;        ///< Value type of the operand (COIL_VAL_VAR for offset bases)
+  coil_u8_t modifier;          ///< Modifiers of the operand
+} coil_regalloc_ref_t;
+
+/**
+* @brief Live interval of a variable and where it was placed
+*/
+typedef struct coil_regalloc_interval {
+  coil_u64_t var;              ///< Variable id
+  coil_u32_t start;            ///< First position
+  coil_u32_t end;              ///< Last position
+  coil_u32_t split;            ///< First instruction that finds the variable in its slot (COIL_REGALLOC_NONE if never)
+  coil_u32_t slot;             ///< Spill slot (COIL_REGALLOC_NONE if never spilled)
+  coil_u8_t reg;               ///< Register before the split (COIL_REGALLOC_NO_REG if spilled whole)
+  coil_u8_t flags;             ///< coil_regalloc_flag_t
+} coil_regalloc_interval_t;
+
+/**
+* @brief Register allocation of one function
+*/
+typedef struct coil_regalloc {
+  coil_u64_t offset;                   ///< Offset of the function in the section
+  coil_u64_t size;                     ///< Size of the function in bytes
+  coil_u64_t slot_base;                ///< Variable id of the first spill slot
+
+  coil_regalloc_instr_t *instrs;       ///< Instructions in section order
+  coil_u32_t instr_count;              ///< Number of instructions
+  coil_regalloc_ref_t *refs;           ///< Variable operands in instruction order
+  coil_u32_t ref_count;                ///< Number of variable operands
+  coil_u32_t *blocks;                  ///< First instruction of each block (block count + 1 entries)
+  coil_u32_t block_count;              ///< Number of blocks
+
+  coil_regalloc_interval_t *intervals; ///< Interval of each variable, ascending by variable id
+  coil_u32_t count;                    ///< Number of intervals
+  coil_u8_t regs[COIL_CBC_REGISTERS];  ///< Registers that may be handed out, in order of preference
+  coil_u32_t reg_count;                ///< Number of registers that may be handed out
+  coil_u32_t used;                     ///< Mask of registers handed out
+  coil_u32_t slots;                    ///< Spill slots used
+  coil_u32_t splits;                   ///< Intervals split
+  coil_u32_t spills;                   ///< Intervals spilled whole
+
+  coil_u32_t *moved;                   ///< Rewritten offset of each instruction, plus the end (after coil_regalloc_rewrite)
+  coil_size_t code_base;               ///< Offset of the rewritten function in its output section
+  coil_size_t code_size;               ///< Size of the rewritten function
+  coil_u64_t fault;                    ///< Offset of the instruction that failed to decode or rewrite
+} coil_regalloc_t;
+
+/**
+* @brief Default options (every CBC register the lowering leaves free)
+*/
+static inline void coil_regalloc_options_init(coil_regalloc_options_t *options) {
+  options->arch = COIL_CPU_NONE;
+  options->registers = 0;
+  options->reserved = 0;
+  options->frame_reg = COIL_LOWER_FRAME_REG;
+  options->scratch_reg = COIL_LOWER_SCRATCH_REG;
+  options->slot_base = 0;
+}
+
+/**
+* @brief Get the number of registers a target offers for allocation
+*
+* General purpose registers, less the stack, frame, link and
+* platform-reserved ones. Architectures without a register file (WASM)
+* and unknown ones offer every CBC register.
+*
+* @param arch Architecture (coil_cpu_t)
+*
+* @return coil_u32_t Register count
+*/
+coil_u32_t coil_regalloc_target_registers(coil_u8_t arch);
+
+/**
+* @brief Allocate registers for the variables of a function
+*
+* @param ra Allocation to initialize
+* @param cfg Graph of the function
+* @param ir Section holding the COIL instructions the graph was built from
+* @param options Allocation options (NULL for coil_regalloc_options_init)
+*
+* @return coil_err_t COIL_ERR_GOOD on success
+* @return coil_err_t COIL_ERR_INVAL if parameters or options are invalid
+* @return coil_err_t COIL_ERR_BADSTATE if ir is chunked
+* @return coil_err_t COIL_ERR_FORMAT if an instruction fails to decode (ra->fault names it)
+* @return coil_err_t COIL_ERR_NOTSUP if the function has more than 2^30 instructions
+* @return coil_err_t COIL_ERR_NOMEM if memory allocation fails
+*/
+coil_err_t coil_regalloc_build(coil_regalloc_t *ra, const coil_cfg_t *cfg, coil_section_t *ir,
+                               const coil_regalloc_options_t *options);
+
+/**
+* @brief Find where a variable is at an instruction
+*
+* @param ra Allocation
+* @param var Variable id
+* @param ir_offset Offset of the instruction in the section
+* @param reg Receives the register (COIL_REGALLOC_NO_REG when the variable is in its slot)
+* @param slot Receives the variable id of the spill slot (may be NULL, unchanged when there is none)
+*
+* @return coil_err_t COIL_ERR_GOOD on success
+* @return coil_err_t COIL_ERR_INVAL if parameters are invalid
+* @return coil_err_t COIL_ERR_NOTFOUND if the function does not reference the variable or ir_offset does not
+*                    start an instruction
+*/
+coil_err_t coil_regalloc_find(const coil_regalloc_t *ra, coil_u64_t var, coil_u64_t ir_offset, coil_u8_t *reg,
+                              coil_u64_t *slot);
+
+/**
+* @brief Append the function with variables replaced by their registers and slots
+*
+* Nothing is appended on failure.
+*
+* @param ra Allocation
+* @param out Section to append the function to
+* @param ir Section holding the COIL instructions
+*
+* @return coil_err_t COIL_ERR_GOOD on success
+* @return coil_err_t COIL_ERR_INVAL if parameters are invalid
+* @return coil_err_t COIL_ERR_BADSTATE if ir is chunked or out is read-only
+* @return coil_err_t COIL_ERR_NOTSUP if a register or slot id does not fit the value type of a variable operand
+*                    (ra->fault names the instruction)
+* @return coil_err_t COIL_ERR_NOMEM if memory allocation fails
+*/
+coil_err_t coil_regalloc_rewrite(coil_regalloc_t *ra, coil_section_t *out, coil_section_t *ir);
+
+/**
+* @brief Find the rewritten offset of an offset in the function
+*
+* The function end maps to the end of the rewritten code, so symbol values
+* and sizes can be rewritten with it.
+*
+* @param ra Allocation that was rewritten
+* @param ir_offset Offset in the COIL section
+* @param out_offset Receives the offset in the output section
+*
+* @return coil_err_t COIL_ERR_GOOD on success
+* @return coil_err_t COIL_ERR_INVAL if parameters are invalid
+* @return coil_err_t COIL_ERR_BADSTATE if the function has not been rewritten
+* @return coil_err_t COIL_ERR_NOTFOUND if ir_offset does not start an instruction or end the function
+*/
+coil_err_t coil_regalloc_offset(const coil_regalloc_t *ra, coil_u64_t ir_offset, coil_u64_t *out_offset);
+
+/**
+* @brief Release an allocation
+*
+* @param ra Allocation to release
+*/
+void coil_regalloc_cleanup(coil_regalloc_t *ra);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // __COIL_INCLUDE_GUARD_REGALLOC_H
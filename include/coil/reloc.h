@@ -0,0 +1,164 @@
+/**
+* @file reloc.h
+* @brief COIL relocation functionality for libcoil-dev
+*
+* A COIL_SECTION_RELTAB section is an array of fixed-width coil_reloc_t
+* entries sorted by target section and offset. Sorted tables are applied in
+* one forward sweep per section, touching each target cache line once, and
+* independent sections are patched in parallel.
+*/
+
+#ifndef __COIL_INCLUDE_GUARD_RELOC_H
+#define __COIL_INCLUDE_GUARD_RELOC_H
+
+#include <coil/base.h>
+#include <coil/sect.h>
+#include <coil/obj.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+* @brief Relocation types
+*
+* S is the symbol value, A the addend and P the address of the patched field
+* (section base + offset). Fields are written in host byte order.
+*/
+typedef enum coil_reloc_type_e {
+  COIL_RELOC_NONE = 0,         ///< No relocation
+  COIL_RELOC_ABS64 = 1,        ///< 64-bit S + A
+  COIL_RELOC_ABS32 = 2,        ///< 32-bit S + A (must fit unsigned)
+  COIL_RELOC_PC32 = 3,         ///< 32-bit S + A - P (must fit signed)
+  COIL_RELOC_PC64 = 4,         ///< 64-bit S + A - P
+  COIL_RELOC_TYPE_COUNT = 5    ///< Number of relocation types
+} coil_reloc_type_t;
+
+/**
+* @brief Largest offset that can be sorted (offsets share the sort key with the section index)
+*/
+#define COIL_RELOC_MAX_OFFSET (((coil_u64_t)1 << 48) - 1)
+
+/**
+* @brief Relocation entry
+*
+* Fixed width (24 bytes) and free of implicit padding so mapped tables can
+* be applied in place.
+*/
+typedef struct coil_reloc {
+  coil_u64_t offset;           ///< Offset of the field in the target section
+  coil_i64_t addend;           ///< Constant added to the symbol value
+  coil_u32_t symbol;           ///< Index into the symbol value array
+  coil_u16_t section;          ///< Target section index
+  coil_u8_t type;              ///< Relocation type (coil_reloc_type_t)
+  coil_u8_t reserved;          ///< Reserved, must be zero
+} coil_reloc_t;
+
+/**
+* @brief Sort relocations by target section and offset
+*
+* Stable LSD radix sort, passes whose digit is the same for every entry
+* are skipped.
+*
+* @param relocs Relocations to sort in place
+* @param count Number of relocations
+*
+* @return coil_err_t COIL_ERR_GOOD on success
+* @return coil_err_t COIL_ERR_INVAL if parameters are invalid or an offset exceeds COIL_RELOC_MAX_OFFSET
+* @return coil_err_t COIL_ERR_NOMEM if memory allocation fails
+*/
+coil_err_t coil_reloc_sort(coil_reloc_t *relocs, coil_size_t count);
+
+/**
+* @brief Check whether relocations are sorted by target section and offset
+*
+* @param relocs Relocations to check
+* @param count Number of relocations
+*
+* @return int 1 if sorted, 0 otherwise
+*/
+int coil_reloc_is_sorted(const coil_reloc_t *relocs, coil_size_t count);
+
+/**
+* @brief Apply relocations to a single section
+*
+* All entries must target this section and be sorted by offset. The batch
+* is validated in one pass before anything is written, so a bad entry or
+* a value that overflows its field leaves the section untouched.
+*
+* @param sect Section to patch (must be writable and contiguous)
+* @param base Address the section is placed at (used for P)
+* @param relocs Sorted relocations
+* @param count Number of relocations
+* @param symvals Symbol values indexed by coil_reloc_t.symbol
+* @param symcount Number of symbol values
+*
+* @return coil_err_t COIL_ERR_GOOD on success
+* @return coil_err_t COIL_ERR_INVAL if parameters are invalid
+* @return coil_err_t COIL_ERR_FORMAT if an entry is unsorted, out of bounds, has an unknown type or symbol
+* @return coil_err_t COIL_ERR_BADSTATE if the section is read-only or chunked
+* @return coil_err_t COIL_ERR_NOTSUP if a value overflowed its field
+*/
+coil_err_t coil_reloc_apply_batch(coil_section_t *sect, coil_u64_t base,
+                                  const coil_reloc_t *relocs, coil_size_t count,
+                                  const coil_u64_t *symvals, coil_u32_t symcount);
+
+/**
+* @brief Apply relocations to many sections in parallel
+*
+* Relocations are split into per-section runs and each section is patched
+* by one thread.
+*
+* @param sects Sections indexed by coil_reloc_t.section (NULL entries must not be targeted)
+* @param sect_count Number of entries in sects
+* @param bases Section addresses indexed like sects (NULL places every section at 0)
+* @param relocs Relocations sorted by section and offset
+* @param count Number of relocations
+* @param symvals Symbol values indexed by coil_reloc_t.symbol
+* @param symcount Number of symbol values
+* @param threads Maximum number of threads (0 for one per CPU)
+*
+* @return coil_err_t COIL_ERR_GOOD on success
+* @return coil_err_t Any error from coil_reloc_apply_batch otherwise
+*/
+coil_err_t coil_reloc_apply_sections(coil_section_t **sects, coil_u16_t sect_count, const coil_u64_t *bases,
+                                     const coil_reloc_t *relocs, coil_size_t count,
+                                     const coil_u64_t *symvals, coil_u32_t symcount, coil_u32_t threads);
+
+/**
+* @brief Add relocations to an object as a COIL_SECTION_RELTAB section
+*
+* @param obj Object to add the section to
+* @param name Name of the section
+* @param relocs Sorted relocations
+* @param count Number of relocations
+* @param index Receives the section index (may be NULL)
+*
+* @return coil_err_t COIL_ERR_GOOD on success
+* @return coil_err_t COIL_ERR_INVAL if parameters are invalid
+* @return coil_err_t COIL_ERR_FORMAT if the relocations are not sorted
+* @return coil_err_t COIL_ERR_EXISTS if the section name is taken
+* @return coil_err_t COIL_ERR_NOMEM if memory allocation fails
+*/
+coil_err_t coil_reloc_emit(coil_object_t *obj, const char *name, const coil_reloc_t *relocs,
+                           coil_size_t count, coil_u16_t *index);
+
+/**
+* @brief Get the relocations stored in a section without copying
+*
+* @param sect Relocation table section
+* @param relocs Receives a pointer into the section data
+* @param count Receives the number of relocations
+*
+* @return coil_err_t COIL_ERR_GOOD on success
+* @return coil_err_t COIL_ERR_INVAL if parameters are invalid
+* @return coil_err_t COIL_ERR_FORMAT if the data is truncated or misaligned
+* @return coil_err_t COIL_ERR_BADSTATE if the section is chunked
+*/
+coil_err_t coil_reloc_view(const coil_section_t *sect, const coil_reloc_t **relocs, coil_size_t *count);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // __COIL_INCLUDE_GUARD_RELOC_H
@@ -26,6 +26,7 @@ typedef struct coil_section_header {
   coil_u8_t type;              ///< Section type
   coil_pu_t pu;                ///< Target processing unit type (CPU, GPU, etc.)
   coil_u8_t raw_arch;          ///< Target architecture
+  coil_u16_t group;            ///< Variant group (native sections sharing a group are alternatives to one another)
   coil_u64_t features;         ///< Feature flags for the target architecture
 } coil_section_header_t;
 
@@ -49,10 +50,62 @@ typedef struct coil_section {
   int is_mapped;               ///< Flag indicating if section is memory mapped
   coil_size_t map_size;        ///< Original size of mapped memory (may differ from size due to alignment)
   void *map_base;              ///< Base address of mapped memory (may differ from data due to alignment)
+
+  int is_pooled;               ///< Flag indicating if data came from the thread's buffer pool
+
+  coil_byte_t **chunks;        ///< Chunk table of a chunked section (NULL for contiguous data)
+  coil_size_t chunk_count;     ///< Number of allocated chunks
+  coil_size_t chunk_size;      ///< Size of every chunk in bytes
 } coil_section_t;
 
+/**
+* @brief Section buffer growth policy
+* 
+* Applies process wide to every section that grows through writes or
+* coil_section_ensure_capacity. Heap buffers grow with realloc, buffers at
+* or above mmap_threshold live in anonymous mappings and grow with mremap.
+*/
+typedef struct coil_section_growth {
+  coil_u32_t factor_percent;   ///< New capacity as a percentage of the old one (must be above 100)
+  coil_size_t max_step;        ///< Largest number of bytes added by a single growth (0 for no cap)
+  coil_size_t mmap_threshold;  ///< Capacity from which buffers are memory mapped (0 to never map)
+  int page_round;              ///< Report the whole page rounded mapping as capacity
+} coil_section_growth_t;
+
 // -------------------------------- Section Operations -------------------------------- //
 
+/**
+* @brief Check if a section owns (and must free) its data buffer
+* 
+* VIEW and COW sections borrow memory from a mapping and never free it.
+* 
+* @param sect Section to check
+* @return int Non-zero if the section owns its buffer
+*/
+static inline int coil_section_owns_data(const coil_section_t *sect) {
+  return sect->mode == COIL_SECT_MODE_CREATE || sect->mode == COIL_SECT_MODE_MODIFY;
+}
+
+/**
+* @brief Check if a section stores its data in chunks
+* 
+* @param sect Section to check
+* @return int Non-zero if the section is chunked (data is NULL, see coil_section_get_chunk)
+*/
+static inline int coil_section_is_chunked(const coil_section_t *sect) {
+  return sect->chunks != NULL;
+}
+
+/**
+* @brief Check if a section holds any data buffer (contiguous or chunked)
+* 
+* @param sect Section to check
+* @return int Non-zero if the section has data
+*/
+static inline int coil_section_has_data(const coil_section_t *sect) {
+  return sect->data != NULL || sect->chunks != NULL;
+}
+
 /**
 * @brief Initialize coil section (COIL_SECT_MODE_CREATE)
 *
@@ -63,6 +116,97 @@ typedef struct coil_section {
 */
 coil_err_t coil_section_init(coil_section_t *sect, coil_size_t capacity);
 
+/**
+* @brief Set the section growth policy
+* 
+* The defaults are a factor of 200%, no step cap, mapped buffers from 1 MiB
+* and page rounding. The policy is process wide and not synchronized, set it
+* before sections are grown concurrently.
+* 
+* @param policy New policy, or NULL to restore the defaults
+* 
+* @return coil_err_t COIL_ERR_GOOD on success, COIL_ERR_INVAL if the factor is not above 100
+*/
+coil_err_t coil_section_set_growth(const coil_section_growth_t *policy);
+
+/**
+* @brief Get the section growth policy
+* 
+* @param policy Structure to fill
+* 
+* @return coil_err_t COIL_ERR_GOOD on success, COIL_ERR_INVAL if policy is NULL
+*/
+coil_err_t coil_section_get_growth(coil_section_growth_t *policy);
+
+/**
+* @brief Initialize coil section with a buffer from the thread's pool (COIL_SECT_MODE_CREATE)
+*
+* Behaves like coil_section_init but takes its buffer (and any later growth)
+* from the size-classed pool in coil/pool.h, and hands it back on cleanup.
+* The capacity is rounded up to the size class.
+*
+* @param sect Pointer to section to populate
+* @param capacity The beginning capacity
+* 
+* @return coil_err_t COIL_ERR_GOOD on success, COIL_ERR_NOMEM if memory allocation fails
+*/
+coil_err_t coil_section_init_pooled(coil_section_t *sect, coil_size_t capacity);
+
+/**
+* @brief Initialize a chunked coil section (COIL_SECT_MODE_CREATE)
+*
+* Data is kept in a chain of fixed size chunks instead of one buffer. Growth
+* only adds chunks, written bytes never move, so appending to a huge section
+* has no copy and no 2x peak. coil_section_write, coil_section_read and
+* coil_section_serialize work as usual (serialize uses writev per chunk).
+* Code that needs a contiguous buffer (coil_section_getstr, instruction
+* decoding) must call coil_section_flatten first.
+*
+* @param sect Pointer to section to populate
+* @param chunk_size Size of each chunk (0 for the default of 64 KiB)
+* 
+* @return coil_err_t COIL_ERR_GOOD on success, COIL_ERR_NOMEM if memory allocation fails
+*/
+coil_err_t coil_section_init_chunked(coil_section_t *sect, coil_size_t chunk_size);
+
+/**
+* @brief Get the number of chunks holding section data
+*
+* A contiguous section with data counts as a single chunk.
+*
+* @param sect Section to inspect
+* @return coil_size_t Number of chunks that hold data
+*/
+coil_size_t coil_section_chunk_count(const coil_section_t *sect);
+
+/**
+* @brief Get one chunk of section data
+*
+* @param sect Section to inspect
+* @param index Chunk index (below coil_section_chunk_count)
+* @param data Receives a pointer to the chunk data
+* @param size Receives the number of bytes used in the chunk
+* 
+* @return coil_err_t COIL_ERR_GOOD on success
+* @return coil_err_t COIL_ERR_INVAL if parameters are invalid
+* @return coil_err_t COIL_ERR_NOTFOUND if index is out of range
+*/
+coil_err_t coil_section_get_chunk(const coil_section_t *sect, coil_size_t index, 
+                                  const coil_byte_t **data, coil_size_t *size);
+
+/**
+* @brief Convert a chunked section into a contiguous one
+*
+* Contiguous sections are left untouched.
+*
+* @param sect Section to flatten
+* 
+* @return coil_err_t COIL_ERR_GOOD on success
+* @return coil_err_t COIL_ERR_INVAL if sect is NULL
+* @return coil_err_t COIL_ERR_NOMEM if memory allocation fails
+*/
+coil_err_t coil_section_flatten(coil_section_t *sect);
+
 /**
 * @brief Clean up section resources
 * 
@@ -190,6 +334,41 @@ coil_err_t coil_section_seek_read(coil_section_t *sect, coil_size_t pos);
 */
 coil_err_t coil_section_seek_write(coil_section_t *sect, coil_size_t pos);
 
+/**
+* @brief Make a VIEW section writable without copying it
+* 
+* A section owning a private mapping (see coil_section_loadv) is switched to
+* COIL_SECT_MODE_COW: the mapping becomes writable and the kernel copies only
+* the pages that are written. Writes that need more capacity than the mapping
+* provides copy the section into an owned buffer (COIL_SECT_MODE_MODIFY).
+* Views that borrow memory from elsewhere are copied into an owned buffer.
+* Sections that are already writable are left untouched.
+* 
+* @param sect Section to promote
+* 
+* @return coil_err_t COIL_ERR_GOOD on success
+* @return coil_err_t COIL_ERR_INVAL if sect is NULL
+* @return coil_err_t COIL_ERR_IO if the mapping cannot be made writable
+* @return coil_err_t COIL_ERR_NOMEM if the fallback copy fails
+*/
+coil_err_t coil_section_promote(coil_section_t *sect);
+
+/**
+* @brief Give the kernel an access pattern hint for a memory mapped section
+* 
+* Only sections that own a mapping (see coil_section_loadv) can be advised.
+* COIL_ADVICE_DONTNEED is refused for COIL_SECT_MODE_COW sections: their
+* written pages live only in the private mapping and would be discarded.
+* 
+* @param sect Section to advise
+* @param advice Access pattern hint (COIL_ADVICE_*)
+* 
+* @return coil_err_t COIL_ERR_GOOD on success
+* @return coil_err_t COIL_ERR_INVAL if sect is NULL or the hint is rejected
+* @return coil_err_t COIL_ERR_BADSTATE if the section is not memory mapped or is COW and advice is DONTNEED
+*/
+coil_err_t coil_section_advise(coil_section_t *sect, coil_advice_t advice);
+
 // -------------------------------- Serialization -------------------------------- //
 
 /**
@@ -204,6 +383,22 @@ coil_err_t coil_section_seek_write(coil_section_t *sect, coil_size_t pos);
 */
 coil_err_t coil_section_serialize(coil_section_t *sect, coil_descriptor_t fd);
 
+/**
+* @brief Serialize a section at an offset of an object file
+*
+* Positional (pwrite/pwritev), the file position does not move, so several
+* sections can be written to one file concurrently.
+* 
+* @param sect Section to serialize
+* @param fd File descriptor for writing
+* @param offset Offset to write the section data at
+* 
+* @return coil_err_t COIL_ERR_GOOD on success
+* @return coil_err_t COIL_ERR_IO on file write errors
+* @return coil_err_t COIL_ERR_INVAL for invalid parameters
+*/
+coil_err_t coil_section_serialize_at(coil_section_t *sect, coil_descriptor_t fd, coil_u64_t offset);
+
 // -------------------------------- De-Serialization -------------------------------- //
 
 /**
@@ -0,0 +1,260 @@
+/**
+* @file strtab.h
+* @brief COIL string table functionality for libcoil-dev
+*
+* A COIL_SECTION_STRTAB section is a run of null-terminated strings that
+* starts with the empty string at offset 0. The builder interns strings so
+* every distinct string is stored once and, when finalized, places strings
+* that are a suffix of a longer one inside it (tail merging), e.g. "bar"
+* shares the bytes of "foobar".
+*
+* References are coil_strref_t values carrying both the offset and the
+* length, so mapped tables can be used in place and compared without strlen.
+*/
+
+#ifndef __COIL_INCLUDE_GUARD_STRTAB_H
+#define __COIL_INCLUDE_GUARD_STRTAB_H
+
+#include <coil/base.h>
+#include <coil/sect.h>
+#include <coil/obj.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+* @brief String table reference (offset in the low 32 bits, length in the high 32 bits)
+*/
+typedef coil_u64_t coil_strref_t;
+
+/**
+* @brief Reference to the empty string at offset 0
+*/
+#define COIL_STRREF_EMPTY ((coil_strref_t)0)
+
+/**
+* @brief Build a string reference
+*/
+static inline coil_strref_t coil_strref_make(coil_u32_t offset, coil_u32_t length) {
+  return (coil_strref_t)offset | ((coil_strref_t)length << 32);
+}
+
+/**
+* @brief Offset of a referenced string
+*/
+static inline coil_u32_t coil_strref_offset(coil_strref_t ref) {
+  return (coil_u32_t)ref;
+}
+
+/**
+* @brief Length of a referenced string (without the null terminator)
+*/
+static inline coil_u32_t coil_strref_length(coil_strref_t ref) {
+  return (coil_u32_t)(ref >> 32);
+}
+
+/**
+* @brief Interned string entry
+*/
+typedef struct coil_strtab_entry {
+  coil_u64_t hash;             ///< Hash of the string (same as coil_obj_hash_name)
+  coil_u32_t arena;            ///< Offset of the interned copy in the builder arena
+  coil_u32_t length;           ///< Length of the string (without the null terminator)
+  coil_u32_t offset;           ///< Offset in the finalized table
+  coil_u32_t reserved;         ///< Padding
+} coil_strtab_entry_t;
+
+/**
+* @brief String table builder
+*/
+typedef struct coil_strtab {
+  coil_byte_t *arena;          ///< Interned string bytes (null-terminated copies)
+  coil_size_t arena_size;      ///< Bytes used in the arena
+  coil_size_t arena_capacity;  ///< Bytes allocated for the arena
+
+  coil_strtab_entry_t *entries; ///< Interned strings, indexed by string id
+  coil_u32_t count;            ///< Number of interned strings
+  coil_u32_t capacity;         ///< Allocated entries
+
+  coil_u32_t *slots;           ///< Open addressing table of string id + 1 (0 is empty)
+  coil_u32_t slot_count;       ///< Number of slots (power of two)
+
+  coil_byte_t *data;           ///< Finalized table contents (NULL until finalized)
+  coil_size_t size;            ///< Size of the finalized contents
+} coil_strtab_t;
+
+// -------------------------------- Builder -------------------------------- //
+
+/**
+* @brief Hash a string of a given length
+*
+* Gives the same value as coil_obj_hash_name for the same string, so symbol
+* name hashes can be produced without a second pass over the name.
+*
+* @param str String bytes
+* @param length Number of bytes
+*
+* @return coil_u64_t Hash value
+*/
+coil_u64_t coil_strtab_hash(const char *str, coil_size_t length);
+
+/**
+* @brief Initialize a string table builder
+*
+* @param tab Builder to initialize
+* @param capacity Number of strings to reserve (0 for a small default)
+*
+* @return coil_err_t COIL_ERR_GOOD on success
+* @return coil_err_t COIL_ERR_INVAL if tab is NULL
+* @return coil_err_t COIL_ERR_NOMEM if memory allocation fails
+*/
+coil_err_t coil_strtab_init(coil_strtab_t *tab, coil_u32_t capacity);
+
+/**
+* @brief Release a string table builder
+*
+* @param tab Builder to release
+*/
+void coil_strtab_cleanup(coil_strtab_t *tab);
+
+/**
+* @brief Intern a string
+*
+* Adding a string that is already present returns its existing id. Adding a
+* new string drops a previously finalized table. When adding fails the table
+* is left as it was.
+*
+* @param tab Builder to add to
+* @param str String bytes (need not be null-terminated, must not contain null bytes)
+* @param length Number of bytes
+* @param id Receives the string id (may be NULL)
+*
+* @return coil_err_t COIL_ERR_GOOD on success
+* @return coil_err_t COIL_ERR_INVAL if parameters are invalid
+* @return coil_err_t COIL_ERR_NOMEM if memory allocation fails
+*/
+coil_err_t coil_strtab_add(coil_strtab_t *tab, const char *str, coil_size_t length, coil_u32_t *id);
+
+/**
+* @brief Intern a null-terminated string
+*
+* @param tab Builder to add to
+* @param str Null-terminated string
+* @param id Receives the string id (may be NULL)
+*
+* @return coil_err_t COIL_ERR_GOOD on success
+* @return coil_err_t COIL_ERR_INVAL if parameters are invalid
+* @return coil_err_t COIL_ERR_NOMEM if memory allocation fails
+*/
+coil_err_t coil_strtab_add_cstr(coil_strtab_t *tab, const char *str, coil_u32_t *id);
+
+/**
+* @brief Find an interned string
+*
+* @param tab Builder to search
+* @param str String bytes
+* @param length Number of bytes
+* @param id Receives the string id
+*
+* @return coil_err_t COIL_ERR_GOOD on success
+* @return coil_err_t COIL_ERR_INVAL if parameters are invalid
+* @return coil_err_t COIL_ERR_NOTFOUND if the string was never added
+*/
+coil_err_t coil_strtab_find(const coil_strtab_t *tab, const char *str, coil_size_t length, coil_u32_t *id);
+
+/**
+* @brief Lay out the table, sharing suffixes between strings
+*
+* @param tab Builder to finalize
+*
+* @return coil_err_t COIL_ERR_GOOD on success
+* @return coil_err_t COIL_ERR_INVAL if tab is NULL
+* @return coil_err_t COIL_ERR_NOMEM if memory allocation fails
+*/
+coil_err_t coil_strtab_finalize(coil_strtab_t *tab);
+
+/**
+* @brief Get the reference of an interned string in the finalized table
+*
+* @param tab Finalized builder
+* @param id String id from coil_strtab_add
+* @param ref Receives the reference
+*
+* @return coil_err_t COIL_ERR_GOOD on success
+* @return coil_err_t COIL_ERR_INVAL if parameters are invalid
+* @return coil_err_t COIL_ERR_BADSTATE if the builder was not finalized
+*/
+coil_err_t coil_strtab_ref(const coil_strtab_t *tab, coil_u32_t id, coil_strref_t *ref);
+
+/**
+* @brief Add the finalized table to an object as a COIL_SECTION_STRTAB section
+*
+* @param obj Object to add the section to
+* @param tab Finalized builder
+* @param name Name of the section
+* @param index Receives the section index (may be NULL)
+*
+* @return coil_err_t COIL_ERR_GOOD on success
+* @return coil_err_t COIL_ERR_INVAL if parameters are invalid
+* @return coil_err_t COIL_ERR_BADSTATE if the builder was not finalized
+* @return coil_err_t COIL_ERR_EXISTS if the section name is taken
+* @return coil_err_t COIL_ERR_NOMEM if memory allocation fails
+*/
+coil_err_t coil_strtab_emit(coil_object_t *obj, const coil_strtab_t *tab, const char *name, coil_u16_t *index);
+
+// -------------------------------- Lookup -------------------------------- //
+
+/**
+* @brief Resolve a reference against string table section data
+*
+* Checks bounds and the null terminator only, no scanning, so it is O(1)
+* on a mapped section.
+*
+* @param sect String table section
+* @param ref Reference to resolve
+* @param str Receives a pointer into the section data
+*
+* @return coil_err_t COIL_ERR_GOOD on success
+* @return coil_err_t COIL_ERR_INVAL if parameters are invalid
+* @return coil_err_t COIL_ERR_FORMAT if the reference does not name a string in the section
+* @return coil_err_t COIL_ERR_BADSTATE if the section is chunked
+*/
+coil_err_t coil_strtab_get(const coil_section_t *sect, coil_strref_t ref, const char **str);
+
+/**
+* @brief Resolve a plain offset against string table section data
+*
+* For producers that only store offsets. The length is found with memchr,
+* bounded by the section size.
+*
+* @param sect String table section
+* @param offset Offset of the string
+* @param ref Receives the full reference (offset and length)
+*
+* @return coil_err_t COIL_ERR_GOOD on success
+* @return coil_err_t COIL_ERR_INVAL if parameters are invalid
+* @return coil_err_t COIL_ERR_FORMAT if the string is not terminated inside the section
+* @return coil_err_t COIL_ERR_BADSTATE if the section is chunked
+*/
+coil_err_t coil_strtab_ref_at(const coil_section_t *sect, coil_u32_t offset, coil_strref_t *ref);
+
+/**
+* @brief Compare a referenced string with a buffer
+*
+* Lengths are compared first, so most mismatches never touch the bytes.
+*
+* @param sect String table section
+* @param ref Reference to compare
+* @param str String bytes
+* @param length Number of bytes
+*
+* @return int 1 if equal, 0 otherwise (including invalid references)
+*/
+int coil_strtab_equals(const coil_section_t *sect, coil_strref_t ref, const char *str, coil_size_t length);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // __COIL_INCLUDE_GUARD_STRTAB_H
@@ -0,0 +1,236 @@
+/**
+* @file sym.h
+* @brief COIL symbol table functionality for libcoil-dev
+*
+* Symbols are stored as an array of fixed-width coil_symbol_t entries in a
+* COIL_SECTION_SYMTAB section. A companion COIL_SECTION_HASH section holds a
+* GNU-style index (bloom filter, buckets and hash chains) so a mapped object
+* can be searched in O(1) without parsing or building anything at load time.
+*/
+
+#ifndef __COIL_INCLUDE_GUARD_SYM_H
+#define __COIL_INCLUDE_GUARD_SYM_H
+
+#include <coil/base.h>
+#include <coil/sect.h>
+#include <coil/obj.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+* @brief Symbol index meaning "no symbol" (empty hash bucket, failed lookups)
+*/
+#define COIL_SYMBOL_INDEX_NONE ((coil_u32_t)0xFFFFFFFF)
+
+/**
+* @brief Symbol table entry
+*
+* Fixed width (40 bytes), naturally aligned and free of implicit padding so
+* the table can be used in place from a mapped object.
+*/
+typedef struct coil_symbol {
+  coil_u64_t name;             ///< Name in the string table (coil_strref_t)
+  coil_u64_t name_hash;        ///< Name hash (coil_obj_hash_name)
+  coil_u64_t value;            ///< Offset in the defining section or absolute value
+  coil_u64_t size;             ///< Size of the symbol in bytes
+  coil_u16_t section;          ///< Defining section index (COIL_SECTION_INDEX_NONE if undefined)
+  coil_u8_t type;              ///< Symbol type (COIL_SYMBOL_*)
+  coil_u8_t binding;           ///< Symbol binding (COIL_SYMBOL_LOCAL/GLOBAL/WEAK)
+  coil_u32_t reserved;         ///< Reserved, must be zero
+} coil_symbol_t;
+
+/**
+* @brief Header of a COIL_SECTION_HASH section
+*
+* Followed by coil_u64_t bloom[bloom_size], coil_u32_t buckets[bucket_count]
+* and coil_u32_t chain[symbol_count]. Symbols are ordered by bucket, a bucket
+* holds the index of its first symbol and chain entries hold the 32-bit hash
+* with the low bit set on the last symbol of a bucket.
+*/
+typedef struct coil_symhash_header {
+  coil_u32_t bucket_count;     ///< Number of hash buckets
+  coil_u32_t symbol_count;     ///< Number of symbols covered (matches the symbol table)
+  coil_u32_t bloom_size;       ///< Number of 64-bit bloom filter words (power of two)
+  coil_u32_t bloom_shift;      ///< Shift used to derive the second bloom bit
+  coil_u64_t reserved;         ///< Reserved, must be zero
+} coil_symhash_header_t;
+
+/**
+* @brief Symbol table builder
+*/
+typedef struct coil_symtab {
+  coil_symbol_t *symbols;      ///< Symbol entries
+  coil_u32_t count;            ///< Number of symbols
+  coil_u32_t capacity;         ///< Allocated symbol entries
+
+  coil_byte_t *hash;           ///< Hash section contents (NULL until finalized)
+  coil_size_t hash_size;       ///< Size of the hash section contents
+} coil_symtab_t;
+
+/**
+* @brief Read-only view over a symbol table and its hash index
+*
+* Points straight into section data, nothing is copied.
+*/
+typedef struct coil_symtab_view {
+  const coil_symbol_t *symbols;        ///< Symbol entries
+  coil_u32_t count;                    ///< Number of symbols
+
+  const coil_symhash_header_t *hash;   ///< Hash header (NULL if there is no index)
+  const coil_u64_t *bloom;             ///< Bloom filter words
+  const coil_u32_t *buckets;           ///< First symbol of every bucket
+  const coil_u32_t *chain;             ///< Per-symbol hash chain values
+} coil_symtab_view_t;
+
+// -------------------------------- Builder -------------------------------- //
+
+/**
+* @brief Initialize a symbol table builder
+*
+* @param tab Builder to initialize
+* @param capacity Number of symbols to reserve (0 for a small default)
+*
+* @return coil_err_t COIL_ERR_GOOD on success
+* @return coil_err_t COIL_ERR_INVAL if tab is NULL
+* @return coil_err_t COIL_ERR_NOMEM if memory allocation fails
+*/
+coil_err_t coil_symtab_init(coil_symtab_t *tab, coil_u32_t capacity);
+
+/**
+* @brief Release a symbol table builder
+*
+* @param tab Builder to release
+*/
+void coil_symtab_cleanup(coil_symtab_t *tab);
+
+/**
+* @brief Add a symbol
+*
+* Adding a symbol drops a previously built hash index.
+*
+* @param tab Builder to add to
+* @param sym Symbol to add (copied)
+* @param index Receives the symbol index (may be NULL)
+*
+* @return coil_err_t COIL_ERR_GOOD on success
+* @return coil_err_t COIL_ERR_INVAL if parameters are invalid
+* @return coil_err_t COIL_ERR_NOMEM if memory allocation fails
+*/
+coil_err_t coil_symtab_add(coil_symtab_t *tab, const coil_symbol_t *sym, coil_u32_t *index);
+
+/**
+* @brief Add many symbols with a single reservation and copy
+*
+* @param tab Builder to add to
+* @param syms Symbols to add (copied)
+* @param count Number of symbols
+*
+* @return coil_err_t COIL_ERR_GOOD on success
+* @return coil_err_t COIL_ERR_INVAL if parameters are invalid
+* @return coil_err_t COIL_ERR_NOMEM if memory allocation fails
+*/
+coil_err_t coil_symtab_add_bulk(coil_symtab_t *tab, const coil_symbol_t *syms, coil_u32_t count);
+
+/**
+* @brief Order the symbols by hash bucket and build the hash index
+*
+* Symbols are reordered (stable within a bucket). index_map receives the new
+* index of every symbol so references can be rewritten.
+*
+* @param tab Builder to finalize
+* @param index_map Array of at least tab->count entries (may be NULL)
+*
+* @return coil_err_t COIL_ERR_GOOD on success
+* @return coil_err_t COIL_ERR_INVAL if tab is NULL
+* @return coil_err_t COIL_ERR_NOMEM if memory allocation fails
+*/
+coil_err_t coil_symtab_finalize(coil_symtab_t *tab, coil_u32_t *index_map);
+
+/**
+* @brief Add the symbol table and its hash index to an object
+*
+* Creates a COIL_SECTION_SYMTAB and a COIL_SECTION_HASH section. The builder
+* is left untouched and can be released afterwards.
+*
+* @param obj Object to add the sections to
+* @param tab Finalized builder
+* @param symtab_name Name of the symbol table section
+* @param hash_name Name of the hash section
+* @param symtab_index Receives the symbol table section index (may be NULL)
+* @param hash_index Receives the hash section index (may be NULL)
+*
+* @return coil_err_t COIL_ERR_GOOD on success
+* @return coil_err_t COIL_ERR_INVAL if parameters are invalid
+* @return coil_err_t COIL_ERR_BADSTATE if the builder was not finalized
+* @return coil_err_t COIL_ERR_EXISTS if a section name is taken
+* @return coil_err_t COIL_ERR_NOMEM if memory allocation fails
+*/
+coil_err_t coil_symtab_emit(coil_object_t *obj, const coil_symtab_t *tab,
+                            const char *symtab_name, const char *hash_name,
+                            coil_u16_t *symtab_index, coil_u16_t *hash_index);
+
+// -------------------------------- Lookup -------------------------------- //
+
+/**
+* @brief Build a view over symbol table and hash section data
+*
+* Section data must be 8-byte aligned, which holds for mapped objects and
+* loaded copies (coil_obj_save_file aligns section data).
+*
+* @param view View to populate
+* @param symtab Symbol table section
+* @param hash Hash section (may be NULL, lookups then fall back to a linear scan)
+*
+* @return coil_err_t COIL_ERR_GOOD on success
+* @return coil_err_t COIL_ERR_INVAL if parameters are invalid
+* @return coil_err_t COIL_ERR_FORMAT if the data is malformed or misaligned
+* @return coil_err_t COIL_ERR_BADSTATE if a section is chunked
+*/
+coil_err_t coil_symtab_view(coil_symtab_view_t *view, const coil_section_t *symtab, const coil_section_t *hash);
+
+/**
+* @brief Build a view over a finalized builder
+*
+* @param view View to populate
+* @param tab Builder (the hash index is used once finalized)
+*
+* @return coil_err_t COIL_ERR_GOOD on success, COIL_ERR_INVAL if parameters are invalid
+*/
+coil_err_t coil_symtab_view_builder(coil_symtab_view_t *view, const coil_symtab_t *tab);
+
+/**
+* @brief Find a symbol by name hash
+*
+* Uses the bloom filter and hash chains when present, so misses usually cost
+* a single cache line.
+*
+* @param view View to search
+* @param name_hash Hash of the name (coil_obj_hash_name)
+* @param index Receives the symbol index
+*
+* @return coil_err_t COIL_ERR_GOOD on success
+* @return coil_err_t COIL_ERR_INVAL if parameters are invalid
+* @return coil_err_t COIL_ERR_NOTFOUND if no symbol has that name
+*/
+coil_err_t coil_symtab_lookup(const coil_symtab_view_t *view, coil_u64_t name_hash, coil_u32_t *index);
+
+/**
+* @brief Find a symbol by name
+*
+* @param view View to search
+* @param name Symbol name
+* @param index Receives the symbol index
+*
+* @return coil_err_t COIL_ERR_GOOD on success
+* @return coil_err_t COIL_ERR_INVAL if parameters are invalid
+* @return coil_err_t COIL_ERR_NOTFOUND if no symbol has that name
+*/
+coil_err_t coil_symtab_lookup_name(const coil_symtab_view_t *view, const char *name, coil_u32_t *index);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // __COIL_INCLUDE_GUARD_SYM_H
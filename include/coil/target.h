@@ -0,0 +1,71 @@
+/**
+* @file target.h
+* @brief COIL target description and host detection for libcoil-dev
+*
+* Native sections carry a processing unit, an architecture and the feature
+* flags they require (coil_cpu_x86_feature_t, coil_cpu_arm_feature_t). A
+* coil_target_t describes a machine in the same terms, so a section can run
+* on a machine when the unit and architecture match and every required
+* feature is present.
+*/
+
+#ifndef __COIL_INCLUDE_GUARD_TARGET_H
+#define __COIL_INCLUDE_GUARD_TARGET_H
+
+#include <coil/types.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+* @brief Target machine description
+*/
+typedef struct coil_target {
+  coil_pu_t pu;                ///< Processing unit type
+  coil_u8_t arch;              ///< Architecture (coil_cpu_t for CPUs)
+  coil_u64_t features;         ///< Available feature flags
+} coil_target_t;
+
+/**
+* @brief Get the machine this process runs on
+*
+* Detected on first use (cpuid/xgetbv on x86, getauxval on ARM) and cached
+* for the lifetime of the process. Features the operating system does not
+* enable (AVX state saving, for instance) are not reported.
+*
+* @return const coil_target_t* Host description (never NULL)
+*/
+const coil_target_t *coil_host_target(void);
+
+/**
+* @brief Check whether code built for a target runs on a machine
+*
+* @param machine Machine to run on
+* @param pu Processing unit the code targets
+* @param arch Architecture the code targets
+* @param features Feature flags the code requires
+*
+* @return int 1 if compatible, 0 otherwise
+*/
+int coil_target_compatible(const coil_target_t *machine, coil_pu_t pu, coil_u8_t arch, coil_u64_t features);
+
+/**
+* @brief Rank how capable code built with a feature set is
+*
+* The widest vector extension required decides first (SSE2 < AVX < AVX2 <
+* AVX-512F on x86, NEON < SVE < SVE2 on ARM), the number of required
+* flags breaks ties. Higher ranks are preferred.
+*
+* @param arch Architecture the code targets
+* @param features Feature flags the code requires
+*
+* @return coil_u32_t Rank (0 for no features)
+*/
+coil_u32_t coil_target_rank(coil_u8_t arch, coil_u64_t features);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // __COIL_INCLUDE_GUARD_TARGET_H
@@ -55,7 +55,8 @@ typedef enum coil_section_type_e {
   COIL_SECTION_RELTAB = 4,      ///< Relocation entries
   COIL_SECTION_NOBITS = 5,      ///< Program space with no data (bss)
   COIL_SECTION_DEBUG = 6,       ///< Debug information
-  COIL_SECTION_TARGET = 7       ///< Section with specific target architecture (explicitly for native machine code)
+  COIL_SECTION_TARGET = 7,      ///< Section with specific target architecture (explicitly for native machine code)
+  COIL_SECTION_HASH = 8         ///< Symbol hash index (bloom filter, buckets and chains)
 } coil_section_type_t;
 
 /**
@@ -99,6 +100,7 @@ typedef enum coil_section_mode_e {
   COIL_SECT_MODE_CREATE, // New object (RW)
   COIL_SECT_MODE_MODIFY, // Loaded object (RW)
   COIL_SECT_MODE_VIEW,   // Loaded object (R)
+  COIL_SECT_MODE_COW,    // Loaded object mapped privately (RW in place, pages copied on first write)
 } coil_section_mode_t;
 
 // -------------------------------- Instructions -------------------------------- //
@@ -296,8 +298,8 @@ enum coil_value_type_e {
   COIL_VAL_U128  = 0x14,  ///< 128-bit unsigned integer
   
   // Floating Point (0x20-0x2F)
-  // COIL_VAL_F32  = 0x20,  ///< 32-bit float (IEEE-754)
-  // COIL_VAL_F64  = 0x21,  ///< 64-bit float (IEEE-754)
+  COIL_VAL_F32  = 0x20,  ///< 32-bit float (IEEE-754)
+  COIL_VAL_F64  = 0x21,  ///< 64-bit float (IEEE-754)
   
   // Reserved (0x30-BF)
 
@@ -494,6 +496,9 @@ typedef enum coil_cbc_cpu_opcode_e {
       // TODO.
     // GPU
       // TODO.
+
+  // Fused pairs (0xF000 - 0xFFFF), an instruction that runs together with the one after it (see cbc.h)
+  COIL_COP_FUSED = 0xF000,
 };
 typedef coil_u16_t coil_cbc_opcode_t;
 
@@ -0,0 +1,396 @@
+/**
+* @file archive.c
+* @brief COIL archive functionality implementation for libcoil-dev
+*/
+
+#include <coil/base.h>
+#include <coil/archive.h>
+#include "srcdeps.h"
+
+/**
+* @brief Archive magic bytes
+*/
+static const coil_u8_t COIL_ARCHIVE_MAGIC[4] = COIL_ARCHIVE_MAGIC_BYTES;
+
+/**
+* @brief Alignment of the index tables
+*/
+#define COIL_ARCHIVE_TABLE_ALIGN 8
+
+/**
+* @brief Order symbol index entries by hash, then by member
+*/
+static int coil_archive_compare_symbol(const void *a, const void *b) {
+  const coil_archive_symbol_t *sa = (const coil_archive_symbol_t *)a;
+  const coil_archive_symbol_t *sb = (const coil_archive_symbol_t *)b;
+  
+  if (sa->name_hash != sb->name_hash) {
+    return sa->name_hash < sb->name_hash ? -1 : 1;
+  }
+  return (sa->member > sb->member) - (sa->member < sb->member);
+}
+
+/**
+* @brief Start writing an archive
+*/
+coil_err_t coil_archive_writer_init(coil_archive_writer_t *w, coil_descriptor_t fd) {
+  if (w == NULL || fd < 0) {
+    return COIL_ERROR(COIL_ERR_INVAL, "Invalid parameters");
+  }
+  
+  coil_memset(w, 0, sizeof(coil_archive_writer_t));
+  w->fd = fd;
+  w->offset = sizeof(coil_archive_header_t);
+  
+  coil_size_t page_size = coil_get_page_size();
+  w->align = page_size > COIL_ARCHIVE_MIN_ALIGN ? (coil_u32_t)page_size : COIL_ARCHIVE_MIN_ALIGN;
+  
+  return coil_strtab_init(&w->names, 0);
+}
+
+/**
+* @brief Release a writer (does not close the file)
+*/
+void coil_archive_writer_cleanup(coil_archive_writer_t *w) {
+  if (w == NULL) {
+    return;
+  }
+  
+  coil_free(w->members);
+  coil_free(w->member_names);
+  coil_free(w->symbols);
+  coil_strtab_cleanup(&w->names);
+  coil_memset(w, 0, sizeof(coil_archive_writer_t));
+  w->fd = -1;
+}
+
+/**
+* @brief Append an object as a new member
+*/
+coil_err_t coil_archive_writer_add(coil_archive_writer_t *w, const char *name, coil_object_t *obj, coil_u32_t *member) {
+  if (w == NULL || name == NULL || obj == NULL || w->fd < 0) {
+    return COIL_ERROR(COIL_ERR_INVAL, "Invalid parameters");
+  }
+  
+  coil_size_t length = strlen(name);
+  coil_u32_t name_id;
+  if (coil_strtab_find(&w->names, name, length, &name_id) == COIL_ERR_GOOD) {
+    return COIL_ERROR(COIL_ERR_EXISTS, "Archive member already exists");
+  }
+  
+  if (w->member_count == w->member_capacity) {
+    coil_u32_t capacity = w->member_capacity > 0 ? w->member_capacity * 2 : 16;
+    coil_archive_member_t *members = (coil_archive_member_t *)coil_realloc(w->members, capacity * sizeof(coil_archive_member_t));
+    if (members == NULL) {
+      return COIL_ERROR(COIL_ERR_NOMEM, "Failed to grow member index");
+    }
+    w->members = members;
+    
+    coil_u32_t *names = (coil_u32_t *)coil_realloc(w->member_names, capacity * sizeof(coil_u32_t));
+    if (names == NULL) {
+      return COIL_ERROR(COIL_ERR_NOMEM, "Failed to grow member index");
+    }
+    w->member_names = names;
+    w->member_capacity = capacity;
+  }
+  
+  // Every member starts on a page so it can be mapped on its own
+  coil_u64_t start = coil_align_up(w->offset, w->align);
+  coil_err_t err = coil_seek(w->fd, start, SEEK_SET);
+  if (err != COIL_ERR_GOOD) {
+    return err;
+  }
+  
+  err = coil_obj_save_file(obj, w->fd);
+  if (err != COIL_ERR_GOOD) {
+    return err;
+  }
+  
+  off_t end = lseek(w->fd, 0, SEEK_CUR);
+  if (end == -1 || (coil_u64_t)end < start) {
+    return COIL_ERROR(COIL_ERR_IO, "Failed to get current file position");
+  }
+  
+  err = coil_strtab_add(&w->names, name, length, &name_id);
+  if (err != COIL_ERR_GOOD) {
+    return err;
+  }
+  
+  coil_archive_member_t *entry = &w->members[w->member_count];
+  entry->offset = start;
+  entry->size = (coil_u64_t)end - start;
+  entry->name_hash = coil_strtab_hash(name, length);
+  entry->name = COIL_STRREF_EMPTY;
+  w->member_names[w->member_count] = name_id;
+  w->offset = (coil_u64_t)end;
+  
+  if (member != NULL) {
+    *member = w->member_count;
+  }
+  w->member_count++;
+  return COIL_ERR_GOOD;
+}
+
+/**
+* @brief Record that a member defines a symbol
+*/
+coil_err_t coil_archive_writer_add_symbol(coil_archive_writer_t *w, coil_u32_t member, coil_u64_t name_hash) {
+  if (w == NULL || member >= w->member_count) {
+    return COIL_ERROR(COIL_ERR_INVAL, "Invalid parameters");
+  }
+  
+  if (w->symbol_count == w->symbol_capacity) {
+    coil_u32_t capacity = w->symbol_capacity > 0 ? w->symbol_capacity * 2 : 64;
+    coil_archive_symbol_t *symbols = (coil_archive_symbol_t *)coil_realloc(w->symbols, capacity * sizeof(coil_archive_symbol_t));
+    if (symbols == NULL) {
+      return COIL_ERROR(COIL_ERR_NOMEM, "Failed to grow symbol index");
+    }
+    w->symbols = symbols;
+    w->symbol_capacity = capacity;
+  }
+  
+  coil_archive_symbol_t *entry = &w->symbols[w->symbol_count++];
+  entry->name_hash = name_hash;
+  entry->member = member;
+  entry->reserved = 0;
+  return COIL_ERR_GOOD;
+}
+
+/**
+* @brief Record every defined global or weak symbol of a member's symbol table
+*/
+coil_err_t coil_archive_writer_add_symtab(coil_archive_writer_t *w, coil_u32_t member, const coil_symtab_view_t *symtab) {
+  if (w == NULL || symtab == NULL) {
+    return COIL_ERROR(COIL_ERR_INVAL, "Invalid parameters");
+  }
+  
+  for (coil_u32_t i = 0; i < symtab->count; i++) {
+    const coil_symbol_t *sym = &symtab->symbols[i];
+    if (sym->binding == COIL_SYMBOL_LOCAL || sym->section == COIL_SECTION_INDEX_NONE) {
+      continue;
+    }
+    
+    coil_err_t err = coil_archive_writer_add_symbol(w, member, sym->name_hash);
+    if (err != COIL_ERR_GOOD) {
+      return err;
+    }
+  }
+  
+  return COIL_ERR_GOOD;
+}
+
+/**
+* @brief Write the indices and the header
+*/
+coil_err_t coil_archive_writer_finish(coil_archive_writer_t *w) {
+  if (w == NULL || w->fd < 0) {
+    return COIL_ERROR(COIL_ERR_INVAL, "Invalid parameters");
+  }
+  
+  coil_err_t err = coil_strtab_finalize(&w->names);
+  if (err != COIL_ERR_GOOD) {
+    return err;
+  }
+  
+  for (coil_u32_t i = 0; i < w->member_count; i++) {
+    coil_strtab_ref(&w->names, w->member_names[i], &w->members[i].name);
+  }
+  
+  if (w->symbol_count > 1) {
+    qsort(w->symbols, w->symbol_count, sizeof(coil_archive_symbol_t), coil_archive_compare_symbol);
+  }
+  
+  coil_archive_header_t header;
+  coil_memset(&header, 0, sizeof(header));
+  coil_memcpy(header.magic, COIL_ARCHIVE_MAGIC, sizeof(COIL_ARCHIVE_MAGIC));
+  header.version = COIL_ARCHIVE_VERSION;
+  header.member_align = w->align;
+  header.member_count = w->member_count;
+  header.symbol_count = w->symbol_count;
+  header.member_offset = coil_align_up(w->offset, COIL_ARCHIVE_TABLE_ALIGN);
+  header.symbol_offset = header.member_offset + (coil_u64_t)w->member_count * sizeof(coil_archive_member_t);
+  header.names_offset = header.symbol_offset + (coil_u64_t)w->symbol_count * sizeof(coil_archive_symbol_t);
+  header.names_size = w->names.size;
+  header.file_size = header.names_offset + header.names_size;
+  
+  err = coil_write_at(w->fd, header.member_offset, w->members, w->member_count * sizeof(coil_archive_member_t));
+  if (err == COIL_ERR_GOOD) {
+    err = coil_write_at(w->fd, header.symbol_offset, w->symbols, w->symbol_count * sizeof(coil_archive_symbol_t));
+  }
+  if (err == COIL_ERR_GOOD) {
+    err = coil_write_at(w->fd, header.names_offset, w->names.data, w->names.size);
+  }
+  if (err == COIL_ERR_GOOD) {
+    err = coil_write_at(w->fd, 0, &header, sizeof(header));
+  }
+  if (err != COIL_ERR_GOOD) {
+    return err;
+  }
+  
+  // Drop anything left over from a previous, longer file
+  if (ftruncate(w->fd, (off_t)header.file_size) != 0) {
+    return COIL_ERROR(COIL_ERR_IO, "Failed to set archive size");
+  }
+  
+  return COIL_ERR_GOOD;
+}
+
+/**
+* @brief Check that a table lies inside the archive
+*/
+static int coil_archive_table_ok(coil_u64_t offset, coil_u64_t count, coil_u64_t entry_size, coil_u64_t file_size) {
+  return offset % COIL_ARCHIVE_TABLE_ALIGN == 0 && offset <= file_size &&
+         count <= (file_size - offset) / entry_size;
+}
+
+/**
+* @brief Open an archive
+*/
+coil_err_t coil_archive_open(coil_archive_t *ar, coil_descriptor_t fd) {
+  if (ar == NULL || fd < 0) {
+    return COIL_ERROR(COIL_ERR_INVAL, "Invalid parameters");
+  }
+  
+  coil_memset(ar, 0, sizeof(coil_archive_t));
+  ar->fd = -1;
+  
+  off_t file_size = lseek(fd, 0, SEEK_END);
+  if (file_size == -1) {
+    return COIL_ERROR(COIL_ERR_IO, "Failed to determine file size");
+  }
+  if ((coil_size_t)file_size < sizeof(coil_archive_header_t)) {
+    return COIL_ERROR(COIL_ERR_FORMAT, "Archive is smaller than its header");
+  }
+  
+  void *memory = mmap(NULL, (coil_size_t)file_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  if (memory == MAP_FAILED) {
+    return COIL_ERROR(COIL_ERR_IO, "Failed to memory map archive");
+  }
+  
+  const coil_archive_header_t *header = (const coil_archive_header_t *)memory;
+  coil_u64_t size = (coil_u64_t)file_size;
+  if (coil_memcmp(header->magic, COIL_ARCHIVE_MAGIC, sizeof(COIL_ARCHIVE_MAGIC)) != 0 ||
+      header->version != COIL_ARCHIVE_VERSION || header->file_size > size ||
+      header->member_align == 0 ||
+      !coil_archive_table_ok(header->member_offset, header->member_count, sizeof(coil_archive_member_t), size) ||
+      !coil_archive_table_ok(header->symbol_offset, header->symbol_count, sizeof(coil_archive_symbol_t), size) ||
+      header->names_offset > size || header->names_size > size - header->names_offset) {
+    coil_munmap(memory, (coil_size_t)file_size);
+    return COIL_ERROR(COIL_ERR_FORMAT, "Invalid archive header");
+  }
+  
+  const coil_archive_member_t *members = (const coil_archive_member_t *)((coil_byte_t *)memory + header->member_offset);
+  for (coil_u32_t i = 0; i < header->member_count; i++) {
+    if (members[i].offset % header->member_align != 0 || members[i].offset > size ||
+        members[i].size > size - members[i].offset) {
+      coil_munmap(memory, (coil_size_t)file_size);
+      return COIL_ERROR(COIL_ERR_FORMAT, "Archive member out of bounds");
+    }
+  }
+  
+  ar->memory = (coil_byte_t *)memory;
+  ar->size = (coil_size_t)file_size;
+  ar->fd = fd;
+  ar->header = header;
+  ar->members = members;
+  ar->symbols = (const coil_archive_symbol_t *)(ar->memory + header->symbol_offset);
+  ar->names.data = ar->memory + header->names_offset;
+  ar->names.size = header->names_size;
+  ar->names.capacity = header->names_size;
+  ar->names.mode = COIL_SECT_MODE_VIEW;
+  
+  return COIL_ERR_GOOD;
+}
+
+/**
+* @brief Close an archive (does not close the file)
+*/
+void coil_archive_close(coil_archive_t *ar) {
+  if (ar == NULL) {
+    return;
+  }
+  
+  if (ar->memory != NULL) {
+    coil_munmap(ar->memory, ar->size);
+  }
+  coil_memset(ar, 0, sizeof(coil_archive_t));
+  ar->fd = -1;
+}
+
+/**
+* @brief Find a member by name
+*/
+coil_err_t coil_archive_find_member(const coil_archive_t *ar, const char *name, coil_u32_t *member) {
+  if (ar == NULL || ar->header == NULL || name == NULL || member == NULL) {
+    return COIL_ERROR(COIL_ERR_INVAL, "Invalid parameters");
+  }
+  
+  coil_size_t length = strlen(name);
+  coil_u64_t name_hash = coil_strtab_hash(name, length);
+  
+  // Hashes filter, the stored name settles collisions
+  for (coil_u32_t i = 0; i < ar->header->member_count; i++) {
+    if (ar->members[i].name_hash == name_hash &&
+        coil_strtab_equals(&ar->names, ar->members[i].name, name, length)) {
+      *member = i;
+      return COIL_ERR_GOOD;
+    }
+  }
+  
+  return COIL_ERROR(COIL_ERR_NOTFOUND, "Archive member not found");
+}
+
+/**
+* @brief Find the member defining a symbol
+*/
+coil_err_t coil_archive_find_symbol(const coil_archive_t *ar, coil_u64_t name_hash, coil_u32_t *member) {
+  if (ar == NULL || ar->header == NULL || member == NULL) {
+    return COIL_ERROR(COIL_ERR_INVAL, "Invalid parameters");
+  }
+  
+  // Lower bound, so the first member defining the symbol wins
+  coil_u32_t lo = 0;
+  coil_u32_t hi = ar->header->symbol_count;
+  while (lo < hi) {
+    coil_u32_t mid = lo + (hi - lo) / 2;
+    if (ar->symbols[mid].name_hash < name_hash) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+  
+  if (lo == ar->header->symbol_count || ar->symbols[lo].name_hash != name_hash) {
+    return COIL_ERROR(COIL_ERR_NOTFOUND, "Symbol not found in archive");
+  }
+  
+  *member = ar->symbols[lo].member;
+  return COIL_ERR_GOOD;
+}
+
+/**
+* @brief Get the name of a member
+*/
+coil_err_t coil_archive_member_name(const coil_archive_t *ar, coil_u32_t member, const char **name) {
+  if (ar == NULL || ar->header == NULL || name == NULL || member >= ar->header->member_count) {
+    return COIL_ERROR(COIL_ERR_INVAL, "Invalid parameters");
+  }
+  
+  return coil_strtab_get(&ar->names, ar->members[member].name, name);
+}
+
+/**
+* @brief Open a member as a memory mapped object
+*/
+coil_err_t coil_archive_open_member(const coil_archive_t *ar, coil_u32_t member, coil_object_t *obj) {
+  if (ar == NULL || ar->header == NULL || obj == NULL || member >= ar->header->member_count) {
+    return COIL_ERROR(COIL_ERR_INVAL, "Invalid parameters");
+  }
+  
+  if (ar->header->member_align % coil_get_page_size() != 0) {
+    return COIL_ERROR(COIL_ERR_NOTSUP, "Archive members are not page aligned on this system");
+  }
+  
+  const coil_archive_member_t *entry = &ar->members[member];
+  return coil_obj_mmap_range(obj, ar->fd, entry->offset, entry->size);
+}
@@ -0,0 +1,1506 @@
+/**
+* @file cbc.c
+* @brief COIL CBC bytecode encoding and interpreter implementation for libcoil-dev
+*/
+
+#include <coil/base.h>
+#include <coil/cbc.h>
+#include "srcdeps.h"
+#include <pthread.h>
+#include <string.h>
+
+#if defined(__GNUC__)
+#define COIL_CBC_THREADED 1
+#else
+#define COIL_CBC_THREADED 0
+#endif
+
+#ifdef __SIZEOF_INT128__
+__extension__ typedef unsigned __int128 coil_cbc_wide_t;
+__extension__ typedef __int128 coil_cbc_swide_t;
+#define COIL_CBC_WIDE_BYTES 16
+#else
+typedef coil_u64_t coil_cbc_wide_t;
+typedef coil_i64_t coil_cbc_swide_t;
+#define COIL_CBC_WIDE_BYTES 8
+#endif
+
+// -------------------------------- Opcode Space -------------------------------- //
+
+/**
+* @brief How an operation is laid out in the opcode space (the __COIL_HELPER_COP_INSTR_* macros)
+*/
+typedef enum coil_cbc_shape_e {
+  COIL_CBC_SHAPE_NONE,         ///< One opcode without operands
+  COIL_CBC_SHAPE_ONE,          ///< One operand of any form, per width
+  COIL_CBC_SHAPE_ONEI,         ///< One operand that is not an immediate, per width
+  COIL_CBC_SHAPE_TWO,          ///< Destination and source, per width
+  COIL_CBC_SHAPE_TWOI,         ///< Two operands of any form, per width
+  COIL_CBC_SHAPE_IMM32,        ///< One opcode with a 32-bit immediate
+} coil_cbc_shape_t;
+
+/**
+* @brief Opcodes per width of each shape
+*/
+static const coil_u8_t coil_cbc_shape_forms[] = { 1, 5, 4, 20, 25, 1 };
+
+/**
+* @brief Shape of every operation, in opcode order
+*/
+static const coil_u8_t coil_cbc_shapes[COIL_CBC_OPERATION_COUNT] = {
+  [COIL_CBC_NOP] = COIL_CBC_SHAPE_NONE,
+  [COIL_CBC_JMP] = COIL_CBC_SHAPE_ONEI,
+  [COIL_CBC_BR] = COIL_CBC_SHAPE_ONEI,
+  [COIL_CBC_CALL] = COIL_CBC_SHAPE_ONEI,
+  [COIL_CBC_RET] = COIL_CBC_SHAPE_NONE,
+  [COIL_CBC_CMP] = COIL_CBC_SHAPE_TWOI,
+  [COIL_CBC_TEST] = COIL_CBC_SHAPE_TWOI,
+  [COIL_CBC_MOV] = COIL_CBC_SHAPE_TWO,
+  [COIL_CBC_PUSH] = COIL_CBC_SHAPE_ONE,
+  [COIL_CBC_POP] = COIL_CBC_SHAPE_ONEI,
+  [COIL_CBC_LEA] = COIL_CBC_SHAPE_TWO,
+  [COIL_CBC_PUSHFD] = COIL_CBC_SHAPE_NONE,
+  [COIL_CBC_POPFD] = COIL_CBC_SHAPE_NONE,
+  [COIL_CBC_PUSHA] = COIL_CBC_SHAPE_NONE,
+  [COIL_CBC_POPA] = COIL_CBC_SHAPE_NONE,
+  [COIL_CBC_SCOPE] = COIL_CBC_SHAPE_NONE,
+  [COIL_CBC_SCOPL] = COIL_CBC_SHAPE_NONE,
+  [COIL_CBC_ADD] = COIL_CBC_SHAPE_TWO,
+  [COIL_CBC_SUB] = COIL_CBC_SHAPE_TWO,
+  [COIL_CBC_MUL] = COIL_CBC_SHAPE_TWO,
+  [COIL_CBC_DIV] = COIL_CBC_SHAPE_TWO,
+  [COIL_CBC_MOD] = COIL_CBC_SHAPE_TWO,
+  [COIL_CBC_INC] = COIL_CBC_SHAPE_TWO,
+  [COIL_CBC_DEC] = COIL_CBC_SHAPE_TWO,
+  [COIL_CBC_NEG] = COIL_CBC_SHAPE_TWO,
+  [COIL_CBC_AND] = COIL_CBC_SHAPE_TWO,
+  [COIL_CBC_OR] = COIL_CBC_SHAPE_TWO,
+  [COIL_CBC_XOR] = COIL_CBC_SHAPE_TWO,
+  [COIL_CBC_NOT] = COIL_CBC_SHAPE_ONE,
+  [COIL_CBC_SHL] = COIL_CBC_SHAPE_TWO,
+  [COIL_CBC_SHR] = COIL_CBC_SHAPE_TWO,
+  [COIL_CBC_SAL] = COIL_CBC_SHAPE_TWO,
+  [COIL_CBC_SAR] = COIL_CBC_SHAPE_TWO,
+  [COIL_CBC_CVT] = COIL_CBC_SHAPE_TWO,
+  [COIL_CBC_INT] = COIL_CBC_SHAPE_IMM32,
+  [COIL_CBC_IRET] = COIL_CBC_SHAPE_NONE,
+  [COIL_CBC_CLI] = COIL_CBC_SHAPE_NONE,
+  [COIL_CBC_STI] = COIL_CBC_SHAPE_NONE,
+  [COIL_CBC_SYSCALL] = COIL_CBC_SHAPE_NONE,
+  [COIL_CBC_SYSRET] = COIL_CBC_SHAPE_NONE,
+  [COIL_CBC_RDTSC] = COIL_CBC_SHAPE_ONE,
+};
+
+/**
+* @brief A family of fused pairs, one fused opcode per width of the first instruction (b to q)
+*/
+typedef struct coil_cbc_family {
+  coil_u8_t first;             ///< Operation of the first instruction (register destination)
+  coil_u8_t first_form;        ///< Source form of the first instruction
+  coil_u8_t second;            ///< Operation of the second instruction
+  coil_u8_t second_form[2];    ///< Operand forms of the second instruction
+} coil_cbc_family_t;
+
+/**
+* @brief Fused pair families, in fused opcode order
+*
+* The pairs the lowering emits most: a compare feeding a branch, and a
+* register copy feeding register arithmetic (dst = x op y).
+*/
+static const coil_cbc_family_t coil_cbc_families[COIL_CBC_FUSED_COUNT / 4] = {
+  { COIL_CBC_CMP, COIL_CBC_FORM_R, COIL_CBC_BR, { COIL_CBC_FORM_S, COIL_CBC_FORM_NONE } },
+  { COIL_CBC_CMP, COIL_CBC_FORM_I, COIL_CBC_BR, { COIL_CBC_FORM_S, COIL_CBC_FORM_NONE } },
+  { COIL_CBC_MOV, COIL_CBC_FORM_R, COIL_CBC_ADD, { COIL_CBC_FORM_R, COIL_CBC_FORM_R } },
+  { COIL_CBC_MOV, COIL_CBC_FORM_R, COIL_CBC_ADD, { COIL_CBC_FORM_R, COIL_CBC_FORM_I } },
+  { COIL_CBC_MOV, COIL_CBC_FORM_R, COIL_CBC_SUB, { COIL_CBC_FORM_R, COIL_CBC_FORM_R } },
+  { COIL_CBC_MOV, COIL_CBC_FORM_R, COIL_CBC_SUB, { COIL_CBC_FORM_R, COIL_CBC_FORM_I } },
+  { COIL_CBC_MOV, COIL_CBC_FORM_R, COIL_CBC_MUL, { COIL_CBC_FORM_R, COIL_CBC_FORM_R } },
+  { COIL_CBC_MOV, COIL_CBC_FORM_R, COIL_CBC_MUL, { COIL_CBC_FORM_R, COIL_CBC_FORM_I } },
+  { COIL_CBC_MOV, COIL_CBC_FORM_R, COIL_CBC_AND, { COIL_CBC_FORM_R, COIL_CBC_FORM_R } },
+  { COIL_CBC_MOV, COIL_CBC_FORM_R, COIL_CBC_AND, { COIL_CBC_FORM_R, COIL_CBC_FORM_I } },
+  { COIL_CBC_MOV, COIL_CBC_FORM_R, COIL_CBC_OR, { COIL_CBC_FORM_R, COIL_CBC_FORM_R } },
+  { COIL_CBC_MOV, COIL_CBC_FORM_R, COIL_CBC_OR, { COIL_CBC_FORM_R, COIL_CBC_FORM_I } },
+  { COIL_CBC_MOV, COIL_CBC_FORM_R, COIL_CBC_XOR, { COIL_CBC_FORM_R, COIL_CBC_FORM_R } },
+  { COIL_CBC_MOV, COIL_CBC_FORM_R, COIL_CBC_XOR, { COIL_CBC_FORM_R, COIL_CBC_FORM_I } },
+  { COIL_CBC_MOV, COIL_CBC_FORM_R, COIL_CBC_SHL, { COIL_CBC_FORM_R, COIL_CBC_FORM_R } },
+  { COIL_CBC_MOV, COIL_CBC_FORM_R, COIL_CBC_SHL, { COIL_CBC_FORM_R, COIL_CBC_FORM_I } },
+  { COIL_CBC_MOV, COIL_CBC_FORM_R, COIL_CBC_SHR, { COIL_CBC_FORM_R, COIL_CBC_FORM_R } },
+  { COIL_CBC_MOV, COIL_CBC_FORM_R, COIL_CBC_SHR, { COIL_CBC_FORM_R, COIL_CBC_FORM_I } },
+};
+
+/**
+* @brief Decomposition of every opcode, built on first use
+*/
+static coil_cbc_info_t coil_cbc_infos[COIL_CBC_OPCODE_COUNT];
+
+/**
+* @brief Decomposition of every fused opcode, built with the opcode decompositions
+*/
+static coil_cbc_fusion_t coil_cbc_fusions[COIL_CBC_FUSED_COUNT];
+
+/**
+* @brief First opcode of every operation
+*/
+static coil_cbc_opcode_t coil_cbc_firsts[COIL_CBC_OPERATION_COUNT];
+
+/**
+* @brief Guards the one-time table construction
+*/
+static pthread_once_t coil_cbc_infos_once = PTHREAD_ONCE_INIT;
+
+/**
+* @brief Find the opcode of a shape once the tables are built
+*/
+static int coil_cbc_lookup(coil_u8_t operation, coil_u8_t width, coil_u8_t form_a, coil_u8_t form_b, coil_cbc_opcode_t *op) {
+  if (operation >= COIL_CBC_OPERATION_COUNT || form_a > COIL_CBC_FORM_OR || form_b > COIL_CBC_FORM_OR) {
+    return 0;
+  }
+  
+  coil_u8_t shape = coil_cbc_shapes[operation];
+  if (shape == COIL_CBC_SHAPE_NONE || shape == COIL_CBC_SHAPE_IMM32) {
+    const coil_cbc_info_t *info = &coil_cbc_infos[coil_cbc_firsts[operation]];
+    if (width != info->width || form_a != info->form[0] || form_b != info->form[1]) {
+      return 0;
+    }
+    *op = coil_cbc_firsts[operation];
+    return 1;
+  }
+  
+  if (width == 0 || width > 16 || (width & (width - 1)) != 0) {
+    return 0;
+  }
+  coil_u32_t w = (coil_u32_t)__builtin_ctz(width);
+  
+  coil_u32_t f;
+  switch (shape) {
+    case COIL_CBC_SHAPE_ONE:
+      if (form_a < COIL_CBC_FORM_I || form_b != COIL_CBC_FORM_NONE) return 0;
+      f = form_a - COIL_CBC_FORM_I;
+      break;
+    case COIL_CBC_SHAPE_ONEI:
+      if (form_a < COIL_CBC_FORM_S || form_b != COIL_CBC_FORM_NONE) return 0;
+      f = form_a - COIL_CBC_FORM_S;
+      break;
+    case COIL_CBC_SHAPE_TWO:
+      if (form_a < COIL_CBC_FORM_S || form_b < COIL_CBC_FORM_I) return 0;
+      f = (form_a - COIL_CBC_FORM_S) * 5 + (form_b - COIL_CBC_FORM_I);
+      break;
+    default:
+      if (form_a < COIL_CBC_FORM_I || form_b < COIL_CBC_FORM_I) return 0;
+      f = (form_a - COIL_CBC_FORM_I) * 5 + (form_b - COIL_CBC_FORM_I);
+      break;
+  }
+  
+  *op = (coil_cbc_opcode_t)(coil_cbc_firsts[operation] + w * coil_cbc_shape_forms[shape] + f);
+  return 1;
+}
+
+/**
+* @brief Walk the shapes in opcode order and decompose every opcode
+*/
+static void coil_cbc_build_infos(void) {
+  coil_u32_t op = 0;
+  
+  for (coil_u8_t operation = 0; operation < COIL_CBC_OPERATION_COUNT; operation++) {
+    coil_u8_t shape = coil_cbc_shapes[operation];
+    coil_cbc_firsts[operation] = (coil_cbc_opcode_t)op;
+    
+    if (shape == COIL_CBC_SHAPE_NONE || shape == COIL_CBC_SHAPE_IMM32) {
+      coil_cbc_info_t *info = &coil_cbc_infos[op++];
+      info->operation = operation;
+      info->width = shape == COIL_CBC_SHAPE_IMM32 ? 4 : 0;
+      info->form[0] = shape == COIL_CBC_SHAPE_IMM32 ? COIL_CBC_FORM_I : COIL_CBC_FORM_NONE;
+      info->form[1] = COIL_CBC_FORM_NONE;
+      continue;
+    }
+    
+    for (coil_u8_t w = 0; w < 5; w++) {
+      for (coil_u8_t f = 0; f < coil_cbc_shape_forms[shape]; f++) {
+        coil_cbc_info_t *info = &coil_cbc_infos[op++];
+        info->operation = operation;
+        info->width = (coil_u8_t)(1u << w);
+        
+        switch (shape) {
+          case COIL_CBC_SHAPE_ONE:
+            info->form[0] = (coil_u8_t)(COIL_CBC_FORM_I + f);
+            info->form[1] = COIL_CBC_FORM_NONE;
+            break;
+          case COIL_CBC_SHAPE_ONEI:
+            info->form[0] = (coil_u8_t)(COIL_CBC_FORM_S + f);
+            info->form[1] = COIL_CBC_FORM_NONE;
+            break;
+          case COIL_CBC_SHAPE_TWO:
+            info->form[0] = (coil_u8_t)(COIL_CBC_FORM_S + f / 5);
+            info->form[1] = (coil_u8_t)(COIL_CBC_FORM_I + f % 5);
+            break;
+          default:
+            info->form[0] = (coil_u8_t)(COIL_CBC_FORM_I + f / 5);
+            info->form[1] = (coil_u8_t)(COIL_CBC_FORM_I + f % 5);
+            break;
+        }
+      }
+    }
+  }
+  
+  for (coil_u32_t i = 0; i < COIL_CBC_FUSED_COUNT; i++) {
+    const coil_cbc_family_t *family = &coil_cbc_families[i / 4];
+    coil_cbc_fusion_t *fusion = &coil_cbc_fusions[i];
+    coil_cbc_lookup(family->first, (coil_u8_t)(1u << (i % 4)), COIL_CBC_FORM_R, family->first_form, &fusion->first);
+    fusion->operation = family->second;
+    fusion->form[0] = family->second_form[0];
+    fusion->form[1] = family->second_form[1];
+  }
+}
+
+/**
+* @brief Decompose an opcode
+*/
+const coil_cbc_info_t *coil_cbc_info(coil_cbc_opcode_t op) {
+  if (op >= COIL_CBC_OPCODE_COUNT && (op < COIL_COP_FUSED || op >= COIL_COP_FUSED + COIL_CBC_FUSED_COUNT)) {
+    return NULL;
+  }
+  
+  pthread_once(&coil_cbc_infos_once, coil_cbc_build_infos);
+  if (op >= COIL_COP_FUSED) {
+    return &coil_cbc_infos[coil_cbc_fusions[op - COIL_COP_FUSED].first];
+  }
+  return &coil_cbc_infos[op];
+}
+
+/**
+* @brief Find the opcode for an operation, width and operand forms
+*/
+coil_err_t coil_cbc_opcode_for(coil_u8_t operation, coil_u8_t width, coil_u8_t form_a, coil_u8_t form_b, coil_cbc_opcode_t *op) {
+  if (op == NULL) {
+    return COIL_ERROR(COIL_ERR_INVAL, "Opcode pointer is NULL");
+  }
+  
+  pthread_once(&coil_cbc_infos_once, coil_cbc_build_infos);
+  return coil_cbc_lookup(operation, width, form_a, form_b, op) ? COIL_ERR_GOOD : COIL_ERR_NOTFOUND;
+}
+
+/**
+* @brief Whether an opcode can follow a fused opcode as its second instruction
+*/
+static int coil_cbc_partner(const coil_cbc_fusion_t *fusion, coil_cbc_opcode_t second) {
+  if (second >= COIL_CBC_OPCODE_COUNT) {
+    return 0;
+  }
+  
+  const coil_cbc_info_t *info = &coil_cbc_infos[second];
+  return info->operation == fusion->operation && info->width <= 8 &&
+         info->form[0] == fusion->form[0] && info->form[1] == fusion->form[1];
+}
+
+// -------------------------------- Encoding -------------------------------- //
+
+/**
+* @brief Encoded size of an operand
+*/
+static coil_size_t coil_cbc_operand_size(coil_u8_t form, coil_u8_t width) {
+  switch (form) {
+    case COIL_CBC_FORM_I:  return width;
+    case COIL_CBC_FORM_S:  return 4;
+    case COIL_CBC_FORM_R:  return 1;
+    case COIL_CBC_FORM_OS: return 8;
+    case COIL_CBC_FORM_OR: return 5;
+    default:               return 0;
+  }
+}
+
+/**
+* @brief Store an operand's fields
+*/
+static coil_byte_t *coil_cbc_put_operand(coil_byte_t *p, const coil_cbc_operand_t *operand, coil_u8_t width) {
+  switch (operand->form) {
+    case COIL_CBC_FORM_I:
+      switch (width) {
+        case 1: { coil_u8_t v = (coil_u8_t)operand->imm; memcpy(p, &v, 1); break; }
+        case 2: { coil_u16_t v = (coil_u16_t)operand->imm; memcpy(p, &v, 2); break; }
+        case 4: { coil_u32_t v = (coil_u32_t)operand->imm; memcpy(p, &v, 4); break; }
+        case 8: memcpy(p, &operand->imm, 8); break;
+        default:
+          memcpy(p, &operand->imm, 8);
+          memcpy(p + 8, &operand->imm_hi, 8);
+          break;
+      }
+      return p + width;
+    case COIL_CBC_FORM_S:
+      memcpy(p, &operand->symbol, 4);
+      return p + 4;
+    case COIL_CBC_FORM_R:
+      *p = (coil_byte_t)operand->reg;
+      return p + 1;
+    case COIL_CBC_FORM_OS:
+      memcpy(p, &operand->symbol, 4);
+      memcpy(p + 4, &operand->disp, 4);
+      return p + 8;
+    default:
+      *p = (coil_byte_t)operand->reg;
+      memcpy(p + 1, &operand->disp, 4);
+      return p + 5;
+  }
+}
+
+/**
+* @brief Load an operand's fields
+*/
+static void coil_cbc_get_operand(const coil_byte_t *p, coil_cbc_operand_t *operand, coil_u8_t form, coil_u8_t width) {
+  memset(operand, 0, sizeof(coil_cbc_operand_t));
+  operand->form = form;
+  
+  switch (form) {
+    case COIL_CBC_FORM_I:
+      switch (width) {
+        case 1: { coil_u8_t v; memcpy(&v, p, 1); operand->imm = v; break; }
+        case 2: { coil_u16_t v; memcpy(&v, p, 2); operand->imm = v; break; }
+        case 4: { coil_u32_t v; memcpy(&v, p, 4); operand->imm = v; break; }
+        case 8: memcpy(&operand->imm, p, 8); break;
+        default:
+          memcpy(&operand->imm, p, 8);
+          memcpy(&operand->imm_hi, p + 8, 8);
+          break;
+      }
+      break;
+    case COIL_CBC_FORM_S:
+      memcpy(&operand->symbol, p, 4);
+      break;
+    case COIL_CBC_FORM_R:
+      operand->reg = (coil_u8_t)*p;
+      break;
+    case COIL_CBC_FORM_OS:
+      memcpy(&operand->symbol, p, 4);
+      memcpy(&operand->disp, p + 4, 4);
+      break;
+    case COIL_CBC_FORM_OR:
+      operand->reg = (coil_u8_t)*p;
+      memcpy(&operand->disp, p + 1, 4);
+      break;
+    default:
+      // Empty slots have no encoded bytes, p may already be past the end of the code
+      break;
+  }
+}
+
+/**
+* @brief Encode a CBC instruction
+*/
+coil_err_t coil_cbc_encode(coil_section_t *sect, coil_cbc_opcode_t op, coil_u8_t cond,
+                           const coil_cbc_operand_t *a, const coil_cbc_operand_t *b) {
+  if (sect == NULL) {
+    return COIL_ERROR(COIL_ERR_INVAL, "Section pointer is NULL");
+  }
+  
+  const coil_cbc_info_t *info = coil_cbc_info(op);
+  if (info == NULL) {
+    return COIL_ERROR(COIL_ERR_INVAL, "Unknown CBC opcode");
+  }
+  
+  const coil_cbc_operand_t *operands[2] = { a, b };
+  for (int i = 0; i < 2; i++) {
+    if (info->form[i] == COIL_CBC_FORM_NONE ? operands[i] != NULL
+                                            : operands[i] == NULL || operands[i]->form != info->form[i]) {
+      return COIL_ERROR(COIL_ERR_INVAL, "Operands do not match the opcode");
+    }
+  }
+  
+  if (info->operation == COIL_CBC_BR && cond > COIL_INSTRFLAG_LTE) {
+    return COIL_ERROR(COIL_ERR_INVAL, "Unknown branch condition");
+  }
+  
+  coil_byte_t buf[COIL_CBC_MAX_LENGTH];
+  coil_byte_t *p = buf;
+  
+  memcpy(p, &op, sizeof(op));
+  p += sizeof(op);
+  if (info->operation == COIL_CBC_BR) {
+    *p++ = (coil_byte_t)cond;
+  }
+  
+  for (int i = 0; i < 2 && operands[i] != NULL; i++) {
+    p = coil_cbc_put_operand(p, operands[i], info->width);
+  }
+  
+  coil_size_t written;
+  return coil_section_write(sect, buf, (coil_size_t)(p - buf), &written);
+}
+
+/**
+* @brief Decode the CBC instruction at an offset
+*/
+coil_err_t coil_cbc_decode(const coil_byte_t *code, coil_size_t size, coil_size_t offset, coil_cbc_insn_t *insn) {
+  if (code == NULL || insn == NULL) {
+    return COIL_ERROR(COIL_ERR_INVAL, "Invalid parameters");
+  }
+  
+  if (offset > size || size - offset < sizeof(coil_cbc_opcode_t)) {
+    return COIL_ERROR(COIL_ERR_FORMAT, "Truncated CBC instruction");
+  }
+  
+  const coil_byte_t *p = code + offset;
+  const coil_byte_t *end = code + size;
+  
+  memcpy(&insn->opcode, p, sizeof(insn->opcode));
+  p += sizeof(insn->opcode);
+  
+  const coil_cbc_info_t *info = coil_cbc_info(insn->opcode);
+  if (info == NULL) {
+    return COIL_ERROR(COIL_ERR_FORMAT, "Unknown CBC opcode");
+  }
+  insn->info = *info;
+  insn->cond = COIL_INSTRFLAG_NONE;
+  
+  if (info->operation == COIL_CBC_BR) {
+    if (p == end || (coil_u8_t)*p > COIL_INSTRFLAG_LTE) {
+      return COIL_ERROR(COIL_ERR_FORMAT, "Bad branch condition");
+    }
+    insn->cond = (coil_u8_t)*p++;
+  }
+  
+  for (int i = 0; i < 2; i++) {
+    coil_size_t need = coil_cbc_operand_size(info->form[i], info->width);
+    if ((coil_size_t)(end - p) < need) {
+      return COIL_ERROR(COIL_ERR_FORMAT, "Truncated CBC instruction");
+    }
+    coil_cbc_get_operand(p, &insn->operands[i], info->form[i], info->width);
+    p += need;
+  }
+  
+  // The second instruction is decoded on its own, only its opcode is checked here
+  const coil_cbc_fusion_t *fusion = coil_cbc_fusion(insn->opcode);
+  if (fusion != NULL) {
+    coil_cbc_opcode_t second;
+    if ((coil_size_t)(end - p) < sizeof(second)) {
+      return COIL_ERROR(COIL_ERR_FORMAT, "Fused instruction at the end of the code");
+    }
+    memcpy(&second, p, sizeof(second));
+    if (!coil_cbc_partner(fusion, second)) {
+      return COIL_ERROR(COIL_ERR_FORMAT, "Fused instruction is not followed by its pair");
+    }
+  }
+  
+  insn->length = (coil_u8_t)(p - (code + offset));
+  return COIL_ERR_GOOD;
+}
+
+// -------------------------------- Fusion -------------------------------- //
+
+/**
+* @brief Decompose a fused opcode
+*/
+const coil_cbc_fusion_t *coil_cbc_fusion(coil_cbc_opcode_t op) {
+  if (op < COIL_COP_FUSED || op >= COIL_COP_FUSED + COIL_CBC_FUSED_COUNT) {
+    return NULL;
+  }
+  
+  pthread_once(&coil_cbc_infos_once, coil_cbc_build_infos);
+  return &coil_cbc_fusions[op - COIL_COP_FUSED];
+}
+
+/**
+* @brief Find the fused opcode of a pair
+*/
+coil_err_t coil_cbc_fused_for(coil_cbc_opcode_t first, coil_cbc_opcode_t second, coil_cbc_opcode_t *op) {
+  if (op == NULL) {
+    return COIL_ERROR(COIL_ERR_INVAL, "Opcode pointer is NULL");
+  }
+  
+  if (first >= COIL_CBC_OPCODE_COUNT || second >= COIL_CBC_OPCODE_COUNT) {
+    return COIL_ERR_NOTFOUND;
+  }
+  
+  pthread_once(&coil_cbc_infos_once, coil_cbc_build_infos);
+  
+  const coil_cbc_info_t *info = &coil_cbc_infos[first];
+  if (info->width == 0 || info->width > 8 || info->form[0] != COIL_CBC_FORM_R) {
+    return COIL_ERR_NOTFOUND;
+  }
+  coil_u32_t w = (coil_u32_t)__builtin_ctz(info->width);
+  
+  for (coil_u32_t f = 0; f < COIL_CBC_FUSED_COUNT / 4; f++) {
+    const coil_cbc_family_t *family = &coil_cbc_families[f];
+    if (family->first == info->operation && family->first_form == info->form[1] &&
+        coil_cbc_partner(&coil_cbc_fusions[f * 4 + w], second)) {
+      *op = (coil_cbc_opcode_t)(COIL_COP_FUSED + f * 4 + w);
+      return COIL_ERR_GOOD;
+    }
+  }
+  
+  return COIL_ERR_NOTFOUND;
+}
+
+/**
+* @brief Check that code decodes from start to end
+*/
+static coil_err_t coil_cbc_validate(const coil_byte_t *code, coil_size_t size) {
+  coil_cbc_insn_t insn;
+  
+  for (coil_size_t offset = 0; offset < size; offset += insn.length) {
+    coil_err_t err = coil_cbc_decode(code, size, offset, &insn);
+    if (err != COIL_ERR_GOOD) {
+      return err;
+    }
+  }
+  return COIL_ERR_GOOD;
+}
+
+/**
+* @brief Fuse every pair with a fused opcode, in place
+*/
+coil_err_t coil_cbc_fuse(coil_byte_t *code, coil_size_t size, coil_u32_t *fused) {
+  if (code == NULL && size != 0) {
+    return COIL_ERROR(COIL_ERR_INVAL, "Invalid parameters");
+  }
+  
+  coil_err_t err = coil_cbc_validate(code, size);
+  if (err != COIL_ERR_GOOD) {
+    return err;
+  }
+  
+  // No family's second instruction is another's first, so fusing left to right finds every pair
+  coil_cbc_insn_t insn;
+  coil_size_t prev = 0;
+  coil_cbc_opcode_t prev_op = 0;
+  int free_prev = 0;
+  int second = 0;
+  coil_u32_t count = 0;
+  
+  for (coil_size_t offset = 0; offset < size; offset += insn.length) {
+    coil_cbc_decode(code, size, offset, &insn);
+    
+    // The second instruction of an existing pair stays as it is
+    if (second) {
+      second = 0;
+      free_prev = 0;
+      continue;
+    }
+    
+    coil_cbc_opcode_t op;
+    if (free_prev && coil_cbc_fused_for(prev_op, insn.opcode, &op) == COIL_ERR_GOOD) {
+      memcpy(code + prev, &op, sizeof(op));
+      count++;
+      free_prev = 0;
+      continue;
+    }
+    
+    prev = offset;
+    prev_op = insn.opcode;
+    free_prev = coil_cbc_fusion(insn.opcode) == NULL;
+    second = !free_prev;
+  }
+  
+  if (fused != NULL) {
+    *fused = count;
+  }
+  return COIL_ERR_GOOD;
+}
+
+/**
+* @brief Initial size of the pair table
+*/
+#define COIL_CBC_PAIR_BUCKETS 256
+
+/**
+* @brief Bucket of a pair key
+*/
+static inline coil_u32_t coil_cbc_pair_bucket(coil_u32_t key, coil_u32_t buckets) {
+  return (coil_u32_t)((key * 0x9E3779B1u) >> 7) & (buckets - 1);
+}
+
+/**
+* @brief Enter every pair in an empty table
+*/
+static void coil_cbc_pair_fill(const coil_cbc_pair_profile_t *profile, coil_u32_t *index, coil_u32_t buckets) {
+  for (coil_u32_t i = 0; i < profile->count; i++) {
+    coil_u32_t key = ((coil_u32_t)profile->pairs[i].first << 16) | profile->pairs[i].second;
+    coil_u32_t b = coil_cbc_pair_bucket(key, buckets);
+    while (index[b] != 0) {
+      b = (b + 1) & (buckets - 1);
+    }
+    index[b] = i + 1;
+  }
+}
+
+/**
+* @brief Rebuild the pair table at a size
+*/
+static coil_err_t coil_cbc_pair_rehash(coil_cbc_pair_profile_t *profile, coil_u32_t buckets) {
+  coil_u32_t *index = (coil_u32_t *)coil_calloc(buckets, sizeof(coil_u32_t));
+  if (index == NULL) {
+    return COIL_ERROR(COIL_ERR_NOMEM, "Failed to allocate pair table");
+  }
+  
+  coil_cbc_pair_fill(profile, index, buckets);
+  coil_free(profile->index);
+  profile->index = index;
+  profile->buckets = buckets;
+  return COIL_ERR_GOOD;
+}
+
+/**
+* @brief Count one pair
+*/
+static coil_err_t coil_cbc_pair_count(coil_cbc_pair_profile_t *profile, coil_cbc_opcode_t first, coil_cbc_opcode_t second) {
+  coil_u32_t key = ((coil_u32_t)first << 16) | second;
+  coil_u32_t b = coil_cbc_pair_bucket(key, profile->buckets);
+  
+  while (profile->index[b] != 0) {
+    coil_cbc_pair_t *pair = &profile->pairs[profile->index[b] - 1];
+    if (pair->first == first && pair->second == second) {
+      pair->count++;
+      return COIL_ERR_GOOD;
+    }
+    b = (b + 1) & (profile->buckets - 1);
+  }
+  
+  if (profile->count == profile->capacity) {
+    coil_u32_t capacity = profile->capacity * 2;
+    coil_cbc_pair_t *pairs = (coil_cbc_pair_t *)coil_realloc(profile->pairs, capacity * sizeof(coil_cbc_pair_t));
+    if (pairs == NULL) {
+      return COIL_ERROR(COIL_ERR_NOMEM, "Failed to grow pair profile");
+    }
+    profile->pairs = pairs;
+    profile->capacity = capacity;
+  }
+  
+  coil_cbc_pair_t *pair = &profile->pairs[profile->count++];
+  pair->first = first;
+  pair->second = second;
+  pair->count = 1;
+  profile->index[b] = profile->count;
+  
+  // Keep the table at most half full
+  if (profile->count * 2 > profile->buckets) {
+    return coil_cbc_pair_rehash(profile, profile->buckets * 2);
+  }
+  return COIL_ERR_GOOD;
+}
+
+/**
+* @brief Initialize an empty pair profile
+*/
+coil_err_t coil_cbc_pair_profile_init(coil_cbc_pair_profile_t *profile) {
+  if (profile == NULL) {
+    return COIL_ERROR(COIL_ERR_INVAL, "Profile pointer is NULL");
+  }
+  
+  memset(profile, 0, sizeof(coil_cbc_pair_profile_t));
+  return COIL_ERR_GOOD;
+}
+
+/**
+* @brief Count the adjacent instruction pairs of some code
+*/
+coil_err_t coil_cbc_pair_profile_add(coil_cbc_pair_profile_t *profile, const coil_byte_t *code, coil_size_t size) {
+  if (profile == NULL || (code == NULL && size != 0)) {
+    return COIL_ERROR(COIL_ERR_INVAL, "Invalid parameters");
+  }
+  
+  coil_err_t err = coil_cbc_validate(code, size);
+  if (err != COIL_ERR_GOOD) {
+    return err;
+  }
+  
+  if (profile->pairs == NULL) {
+    profile->pairs = (coil_cbc_pair_t *)coil_malloc(COIL_CBC_PAIR_BUCKETS / 2 * sizeof(coil_cbc_pair_t));
+    if (profile->pairs == NULL) {
+      return COIL_ERROR(COIL_ERR_NOMEM, "Failed to allocate pair profile");
+    }
+    profile->capacity = COIL_CBC_PAIR_BUCKETS / 2;
+    err = coil_cbc_pair_rehash(profile, COIL_CBC_PAIR_BUCKETS);
+    if (err != COIL_ERR_GOOD) {
+      return err;
+    }
+  }
+  
+  coil_cbc_insn_t insn;
+  coil_cbc_opcode_t prev = 0;
+  for (coil_size_t offset = 0; offset < size; offset += insn.length) {
+    coil_cbc_decode(code, size, offset, &insn);
+    
+    const coil_cbc_fusion_t *fusion = coil_cbc_fusion(insn.opcode);
+    coil_cbc_opcode_t op = fusion != NULL ? fusion->first : insn.opcode;
+    
+    if (offset != 0) {
+      coil_cbc_opcode_t fused_op;
+      err = coil_cbc_pair_count(profile, prev, op);
+      if (err != COIL_ERR_GOOD) {
+        return err;
+      }
+      profile->total++;
+      profile->fusable += coil_cbc_fused_for(prev, op, &fused_op) == COIL_ERR_GOOD;
+    }
+    prev = op;
+  }
+  
+  return COIL_ERR_GOOD;
+}
+
+/**
+* @brief Order pairs by count, most frequent first, then by opcodes
+*/
+static int coil_cbc_pair_compare(const void *a, const void *b) {
+  const coil_cbc_pair_t *pa = (const coil_cbc_pair_t *)a;
+  const coil_cbc_pair_t *pb = (const coil_cbc_pair_t *)b;
+  
+  if (pa->count != pb->count) {
+    return pa->count > pb->count ? -1 : 1;
+  }
+  if (pa->first != pb->first) {
+    return pa->first < pb->first ? -1 : 1;
+  }
+  return pa->second < pb->second ? -1 : pa->second > pb->second;
+}
+
+/**
+* @brief Order the pairs most frequent first
+*/
+void coil_cbc_pair_profile_sort(coil_cbc_pair_profile_t *profile) {
+  if (profile == NULL || profile->count == 0) {
+    return;
+  }
+  
+  qsort(profile->pairs, profile->count, sizeof(coil_cbc_pair_t), coil_cbc_pair_compare);
+  
+  // Indices moved, the table is refilled in place
+  memset(profile->index, 0, profile->buckets * sizeof(coil_u32_t));
+  coil_cbc_pair_fill(profile, profile->index, profile->buckets);
+}
+
+/**
+* @brief Release a pair profile
+*/
+void coil_cbc_pair_profile_cleanup(coil_cbc_pair_profile_t *profile) {
+  if (profile == NULL) {
+    return;
+  }
+  
+  coil_free(profile->pairs);
+  coil_free(profile->index);
+  memset(profile, 0, sizeof(coil_cbc_pair_profile_t));
+}
+
+// -------------------------------- Predecoded Form -------------------------------- //
+
+/**
+* @brief Resolved operand kinds
+*/
+typedef enum coil_cbc_ref_e {
+  COIL_CBC_REF_NONE,           ///< No operand
+  COIL_CBC_REF_IMM,            ///< Immediate value
+  COIL_CBC_REF_REG,            ///< Register
+  COIL_CBC_REF_MEM,            ///< Memory at a fixed address (S, OS)
+  COIL_CBC_REF_MEMR,           ///< Memory at a register plus displacement (OR)
+} coil_cbc_ref_kind_t;
+
+/**
+* @brief Resolved operand
+*/
+typedef struct coil_cbc_ref {
+  coil_u8_t kind;              ///< Operand kind (coil_cbc_ref_kind_t)
+  coil_u8_t reg;               ///< Register (REG, MEMR)
+  coil_u64_t addr;             ///< Address (MEM) or sign extended displacement (MEMR)
+  coil_cbc_value_t imm;        ///< Immediate (IMM)
+} coil_cbc_ref_t;
+
+/**
+* @brief Handler kinds, a specialised handler per common operand shape
+*
+* The _RR and _RI kinds cover register destinations with a register or
+* immediate source up to 64 bits. Every binary _RR kind is directly
+* followed by its _RI kind. Fused kinds run their slot and the next one,
+* the MOV_ kinds are in the same order as the arithmetic kinds they fuse.
+*/
+#define COIL_CBC_KINDS(X) \
+  X(END) X(NOP) X(JMP) X(JMPD) X(BR) X(BRD) X(CALL) X(CALLD) X(RET) \
+  X(CMP_RR) X(CMP_RI) X(CMP) X(TEST) \
+  X(MOV_RR) X(MOV_RI) X(MOV) X(PUSH) X(POP) X(LEA) X(PUSHFD) X(POPFD) X(PUSHA) X(POPA) \
+  X(ADD_RR) X(ADD_RI) X(SUB_RR) X(SUB_RI) X(MUL_RR) X(MUL_RI) \
+  X(AND_RR) X(AND_RI) X(OR_RR) X(OR_RI) X(XOR_RR) X(XOR_RI) \
+  X(SHL_RR) X(SHL_RI) X(SHR_RR) X(SHR_RI) \
+  X(ALU) X(UNARY) X(CVT) X(RDTSC) \
+  X(CMP_RR_BR) X(CMP_RI_BR) \
+  X(MOV_ADD_RR) X(MOV_ADD_RI) X(MOV_SUB_RR) X(MOV_SUB_RI) X(MOV_MUL_RR) X(MOV_MUL_RI) \
+  X(MOV_AND_RR) X(MOV_AND_RI) X(MOV_OR_RR) X(MOV_OR_RI) X(MOV_XOR_RR) X(MOV_XOR_RI) \
+  X(MOV_SHL_RR) X(MOV_SHL_RI) X(MOV_SHR_RR) X(MOV_SHR_RI)
+
+#define COIL_CBC_KIND_ENUM(name) COIL_CBC_K_##name,
+
+typedef enum coil_cbc_kind_e {
+  COIL_CBC_KINDS(COIL_CBC_KIND_ENUM)
+  COIL_CBC_KIND_COUNT
+} coil_cbc_kind_t;
+
+/**
+* @brief Register/register handler of the operations with a fast path
+*/
+static const coil_u8_t coil_cbc_fast_kinds[COIL_CBC_OPERATION_COUNT] = {
+  [COIL_CBC_ADD] = COIL_CBC_K_ADD_RR,
+  [COIL_CBC_SUB] = COIL_CBC_K_SUB_RR,
+  [COIL_CBC_MUL] = COIL_CBC_K_MUL_RR,
+  [COIL_CBC_AND] = COIL_CBC_K_AND_RR,
+  [COIL_CBC_OR] = COIL_CBC_K_OR_RR,
+  [COIL_CBC_XOR] = COIL_CBC_K_XOR_RR,
+  [COIL_CBC_SHL] = COIL_CBC_K_SHL_RR,
+  [COIL_CBC_SAL] = COIL_CBC_K_SHL_RR,
+  [COIL_CBC_SHR] = COIL_CBC_K_SHR_RR,
+};
+
+/**
+* @brief Predecoded instruction
+*/
+struct coil_cbc_slot {
+  const void *handler;         ///< Handler address (threaded dispatch)
+  coil_u8_t kind;              ///< Handler kind (coil_cbc_kind_t)
+  coil_u8_t operation;         ///< Operation (coil_cbc_operation_t)
+  coil_u8_t width;             ///< Operand width in bytes
+  coil_u8_t cond;              ///< Branch condition
+  coil_u8_t shift;             ///< Operand width in bits minus one
+  coil_u32_t target;           ///< Slot of a static branch target
+  coil_u64_t mask;             ///< Operand width mask (up to 64 bits)
+  coil_u64_t offset;           ///< Code offset of the instruction
+  coil_cbc_ref_t a;            ///< First operand
+  coil_cbc_ref_t b;            ///< Second operand
+};
+
+/**
+* @brief Whether a branch is taken, by condition and flags
+*/
+static const coil_u8_t coil_cbc_taken[COIL_INSTRFLAG_LTE + 1][4] = {
+  { 1, 1, 1, 1 },              // NONE
+  { 0, 1, 0, 1 },              // EQ
+  { 1, 0, 1, 0 },              // NEQ
+  { 1, 0, 0, 0 },              // GT
+  { 1, 1, 0, 1 },              // GTE
+  { 0, 0, 1, 1 },              // LT
+  { 0, 1, 1, 1 },              // LTE
+};
+
+/**
+* @brief Mask of an operand width
+*/
+static inline coil_cbc_wide_t coil_cbc_mask(coil_u8_t width) {
+  return width >= COIL_CBC_WIDE_BYTES ? ~(coil_cbc_wide_t)0 : ((coil_cbc_wide_t)1 << (width * 8)) - 1;
+}
+
+/**
+* @brief Sign extend a value of an operand width
+*/
+static inline coil_cbc_swide_t coil_cbc_sext(coil_cbc_wide_t value, coil_u8_t width) {
+  unsigned bits = (COIL_CBC_WIDE_BYTES - width) * 8;
+  return bits == 0 ? (coil_cbc_swide_t)value : (coil_cbc_swide_t)(value << bits) >> bits;
+}
+
+/**
+* @brief Widen a register or stack value
+*/
+static inline coil_cbc_wide_t coil_cbc_widen(const coil_cbc_value_t *value) {
+#ifdef __SIZEOF_INT128__
+  return ((coil_cbc_wide_t)value->hi << 64) | value->lo;
+#else
+  return value->lo;
+#endif
+}
+
+/**
+* @brief Split a wide value into a register or stack value
+*/
+static inline coil_cbc_value_t coil_cbc_split(coil_cbc_wide_t wide) {
+  coil_cbc_value_t value;
+  value.lo = (coil_u64_t)wide;
+#ifdef __SIZEOF_INT128__
+  value.hi = (coil_u64_t)(wide >> 64);
+#else
+  value.hi = 0;
+#endif
+  return value;
+}
+
+/**
+* @brief Resolve the address of a memory operand, checking it against the memory
+*/
+static inline int coil_cbc_address(const coil_cbc_vm_t *vm, const coil_cbc_ref_t *ref, coil_u8_t width, coil_u64_t *addr) {
+  coil_u64_t at = ref->kind == COIL_CBC_REF_MEMR ? vm->regs[ref->reg].lo + ref->addr : ref->addr;
+  if (at > vm->memory_size || width > vm->memory_size - at) {
+    return 0;
+  }
+  *addr = at;
+  return 1;
+}
+
+/**
+* @brief Read an operand
+*/
+static inline int coil_cbc_load(const coil_cbc_vm_t *vm, const coil_cbc_ref_t *ref, coil_u8_t width, coil_cbc_wide_t *out) {
+  if (ref->kind == COIL_CBC_REF_IMM) {
+    *out = coil_cbc_widen(&ref->imm) & coil_cbc_mask(width);
+    return 1;
+  }
+  if (ref->kind == COIL_CBC_REF_REG) {
+    *out = coil_cbc_widen(&vm->regs[ref->reg]) & coil_cbc_mask(width);
+    return 1;
+  }
+  
+  coil_u64_t addr;
+  if (!coil_cbc_address(vm, ref, width, &addr)) {
+    return 0;
+  }
+  
+  const coil_byte_t *p = vm->memory + addr;
+  switch (width) {
+    case 1: { coil_u8_t v; memcpy(&v, p, 1); *out = v; break; }
+    case 2: { coil_u16_t v; memcpy(&v, p, 2); *out = v; break; }
+    case 4: { coil_u32_t v; memcpy(&v, p, 4); *out = v; break; }
+    case 8: { coil_u64_t v; memcpy(&v, p, 8); *out = v; break; }
+    default: {
+      coil_cbc_value_t v;
+      memcpy(&v.lo, p, 8);
+      memcpy(&v.hi, p + 8, 8);
+      *out = coil_cbc_widen(&v);
+      break;
+    }
+  }
+  return 1;
+}
+
+/**
+* @brief Write an operand (register writes are zero extended)
+*/
+static inline int coil_cbc_store(coil_cbc_vm_t *vm, const coil_cbc_ref_t *ref, coil_u8_t width, coil_cbc_wide_t value) {
+  if (ref->kind == COIL_CBC_REF_REG) {
+    vm->regs[ref->reg] = coil_cbc_split(value & coil_cbc_mask(width));
+    return 1;
+  }
+  
+  coil_u64_t addr;
+  if (!coil_cbc_address(vm, ref, width, &addr)) {
+    return 0;
+  }
+  
+  coil_byte_t *p = vm->memory + addr;
+  switch (width) {
+    case 1: { coil_u8_t v = (coil_u8_t)value; memcpy(p, &v, 1); break; }
+    case 2: { coil_u16_t v = (coil_u16_t)value; memcpy(p, &v, 2); break; }
+    case 4: { coil_u32_t v = (coil_u32_t)value; memcpy(p, &v, 4); break; }
+    case 8: { coil_u64_t v = (coil_u64_t)value; memcpy(p, &v, 8); break; }
+    default: {
+      coil_cbc_value_t v = coil_cbc_split(value);
+      memcpy(p, &v.lo, 8);
+      memcpy(p + 8, &v.hi, 8);
+      break;
+    }
+  }
+  return 1;
+}
+
+/**
+* @brief Compute an arithmetic or bitwise operation at an operand width
+*
+* Unary operations (INC, DEC, NEG, NOT) take their operand in y.
+*
+* @return int 0 on division by zero
+*/
+static inline int coil_cbc_alu(coil_u8_t operation, coil_u8_t width, coil_cbc_wide_t x, coil_cbc_wide_t y, coil_cbc_wide_t *out) {
+  unsigned count = (unsigned)(y & (coil_cbc_wide_t)(width * 8 - 1));
+  coil_cbc_wide_t r;
+  
+  switch (operation) {
+    case COIL_CBC_ADD: r = x + y; break;
+    case COIL_CBC_SUB: r = x - y; break;
+    case COIL_CBC_MUL: r = x * y; break;
+    case COIL_CBC_DIV:
+    case COIL_CBC_MOD: {
+      if (y == 0) {
+        return 0;
+      }
+      coil_cbc_swide_t sx = coil_cbc_sext(x, width);
+      coil_cbc_swide_t sy = coil_cbc_sext(y, width);
+      if (sy == -1) {
+        // Avoids the overflow of the most negative value divided by -1
+        r = operation == COIL_CBC_DIV ? (coil_cbc_wide_t)0 - x : 0;
+      } else {
+        r = (coil_cbc_wide_t)(operation == COIL_CBC_DIV ? sx / sy : sx % sy);
+      }
+      break;
+    }
+    case COIL_CBC_AND: r = x & y; break;
+    case COIL_CBC_OR:  r = x | y; break;
+    case COIL_CBC_XOR: r = x ^ y; break;
+    case COIL_CBC_SHL:
+    case COIL_CBC_SAL: r = x << count; break;
+    case COIL_CBC_SHR: r = x >> count; break;
+    case COIL_CBC_SAR: r = (coil_cbc_wide_t)(coil_cbc_sext(x, width) >> count); break;
+    case COIL_CBC_INC: r = y + 1; break;
+    case COIL_CBC_DEC: r = y - 1; break;
+    case COIL_CBC_NEG: r = (coil_cbc_wide_t)0 - y; break;
+    default:           r = ~y; break;
+  }
+  
+  *out = r & coil_cbc_mask(width);
+  return 1;
+}
+
+/**
+* @brief Flags of a signed comparison
+*/
+static inline coil_u8_t coil_cbc_compare(coil_cbc_wide_t x, coil_cbc_wide_t y, coil_u8_t width) {
+  coil_cbc_swide_t sx = coil_cbc_sext(x, width);
+  coil_cbc_swide_t sy = coil_cbc_sext(y, width);
+  return (coil_u8_t)((sx == sy ? COIL_CBC_FLAG_EQ : 0) | (sx < sy ? COIL_CBC_FLAG_LT : 0));
+}
+
+/**
+* @brief Flags of a bitwise test
+*/
+static inline coil_u8_t coil_cbc_test(coil_cbc_wide_t x, coil_cbc_wide_t y, coil_u8_t width) {
+  coil_cbc_wide_t r = x & y;
+  return (coil_u8_t)((r == 0 ? COIL_CBC_FLAG_EQ : 0) | (coil_cbc_sext(r, width) < 0 ? COIL_CBC_FLAG_LT : 0));
+}
+
+/**
+* @brief Resolve the slot of a dynamic branch target
+*/
+static inline int coil_cbc_target(const coil_cbc_vm_t *vm, const coil_cbc_program_t *prog,
+                                  const coil_cbc_slot_t *slot, coil_u32_t *target) {
+  coil_cbc_wide_t offset;
+  if (!coil_cbc_load(vm, &slot->a, slot->width, &offset) || offset > prog->code_size) {
+    return 0;
+  }
+  *target = prog->slot_of[(coil_size_t)offset];
+  return *target != COIL_CBC_NO_SLOT;
+}
+
+/**
+* @brief Signed comparison of register values up to 64 bits (shift is the width in bits minus one)
+*/
+static inline coil_u8_t coil_cbc_compare64(coil_u64_t x, coil_u64_t y, coil_u8_t shift) {
+  unsigned s = 63u - shift;
+  coil_i64_t sx = (coil_i64_t)(x << s) >> s;
+  coil_i64_t sy = (coil_i64_t)(y << s) >> s;
+  return (coil_u8_t)((sx == sy ? COIL_CBC_FLAG_EQ : 0) | (sx < sy ? COIL_CBC_FLAG_LT : 0));
+}
+
+// -------------------------------- Dispatch Loops -------------------------------- //
+
+#if COIL_CBC_THREADED
+
+// Label addresses and computed goto are GNU extensions
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wpedantic"
+
+#define COIL_CBC_LABEL(name) &&coil_cbc_op_##name,
+#define COIL_CBC_CASE(name) coil_cbc_op_##name:
+#define COIL_CBC_DISPATCH() do { steps++; goto *ip->handler; } while (0)
+#define COIL_CBC_LOOP_BEGIN
+#define COIL_CBC_LOOP_END
+
+/**
+* @brief Threaded dispatch loop, every handler jumps straight to the next one
+*
+* Called with labels set it only hands out its handler addresses, which
+* program init stores in the slots.
+*/
+static coil_err_t coil_cbc_loop_threaded(coil_cbc_vm_t *vm, const coil_cbc_program_t *prog, coil_u32_t entry,
+                                         coil_u64_t max_steps, const void *const **labels) {
+  static const void *const table[COIL_CBC_KIND_COUNT] = { COIL_CBC_KINDS(COIL_CBC_LABEL) };
+  
+  if (labels != NULL) {
+    *labels = table;
+    return COIL_ERR_GOOD;
+  }
+  
+#include "cbc_loop.h"
+}
+
+#undef COIL_CBC_LABEL
+#undef COIL_CBC_CASE
+#undef COIL_CBC_DISPATCH
+#undef COIL_CBC_LOOP_BEGIN
+#undef COIL_CBC_LOOP_END
+
+#pragma GCC diagnostic pop
+
+#endif
+
+#define COIL_CBC_CASE(name) case COIL_CBC_K_##name:
+#define COIL_CBC_DISPATCH() goto coil_cbc_dispatch
+#define COIL_CBC_LOOP_BEGIN coil_cbc_dispatch: steps++; switch ((coil_cbc_kind_t)ip->kind) {
+#define COIL_CBC_LOOP_END default: COIL_CBC_FAULT(COIL_ERR_BADSTATE, "Unknown handler"); }
+
+/**
+* @brief Switch dispatch loop
+*/
+static coil_err_t coil_cbc_loop_switch(coil_cbc_vm_t *vm, const coil_cbc_program_t *prog, coil_u32_t entry,
+                                       coil_u64_t max_steps) {
+#include "cbc_loop.h"
+}
+
+#undef COIL_CBC_CASE
+#undef COIL_CBC_DISPATCH
+#undef COIL_CBC_LOOP_BEGIN
+#undef COIL_CBC_LOOP_END
+
+// -------------------------------- Programs -------------------------------- //
+
+/**
+* @brief Resolve an operand against the symbol values
+*/
+static coil_err_t coil_cbc_resolve(coil_cbc_ref_t *ref, const coil_cbc_operand_t *operand,
+                                   const coil_u64_t *symvals, coil_u32_t symcount) {
+  memset(ref, 0, sizeof(coil_cbc_ref_t));
+  
+  switch (operand->form) {
+    case COIL_CBC_FORM_NONE:
+      return COIL_ERR_GOOD;
+    case COIL_CBC_FORM_I:
+      ref->kind = COIL_CBC_REF_IMM;
+      ref->imm.lo = operand->imm;
+      ref->imm.hi = operand->imm_hi;
+      return COIL_ERR_GOOD;
+    case COIL_CBC_FORM_R:
+    case COIL_CBC_FORM_OR:
+      if (operand->reg >= COIL_CBC_REGISTERS) {
+        return COIL_ERROR(COIL_ERR_FORMAT, "Unknown CBC register");
+      }
+      ref->kind = operand->form == COIL_CBC_FORM_R ? COIL_CBC_REF_REG : COIL_CBC_REF_MEMR;
+      ref->reg = operand->reg;
+      ref->addr = (coil_u64_t)(coil_i64_t)operand->disp;
+      return COIL_ERR_GOOD;
+    default:
+      if (operand->symbol >= symcount) {
+        return COIL_ERROR(COIL_ERR_FORMAT, "Unknown CBC symbol");
+      }
+      ref->kind = COIL_CBC_REF_MEM;
+      ref->addr = symvals[operand->symbol] + (coil_u64_t)(coil_i64_t)operand->disp;
+      return COIL_ERR_GOOD;
+  }
+}
+
+/**
+* @brief Turn a decoded instruction into a slot
+*/
+static coil_err_t coil_cbc_predecode(coil_cbc_slot_t *slot, const coil_cbc_insn_t *insn, coil_u64_t offset,
+                                     const coil_u64_t *symvals, coil_u32_t symcount,
+                                     const coil_u32_t *slot_of, coil_size_t size) {
+  const coil_cbc_info_t *info = &insn->info;
+  
+  if (info->width > COIL_CBC_WIDE_BYTES) {
+    return COIL_ERROR(COIL_ERR_NOTSUP, "128-bit operations need compiler support");
+  }
+  
+  slot->operation = info->operation;
+  slot->width = info->width;
+  slot->cond = insn->cond;
+  slot->offset = offset;
+  slot->shift = info->width != 0 ? (coil_u8_t)(info->width * 8 - 1) : 0;
+  slot->mask = info->width != 0 && info->width <= 8 ? (coil_u64_t)coil_cbc_mask(info->width) : ~(coil_u64_t)0;
+  
+  coil_err_t err = coil_cbc_resolve(&slot->a, &insn->operands[0], symvals, symcount);
+  if (err != COIL_ERR_GOOD) {
+    return err;
+  }
+  err = coil_cbc_resolve(&slot->b, &insn->operands[1], symvals, symcount);
+  if (err != COIL_ERR_GOOD) {
+    return err;
+  }
+  
+  int fast = info->width <= 8 && info->form[0] == COIL_CBC_FORM_R &&
+             (info->form[1] == COIL_CBC_FORM_R || info->form[1] == COIL_CBC_FORM_I);
+  int imm = info->form[1] == COIL_CBC_FORM_I;
+  
+  switch (info->operation) {
+    case COIL_CBC_NOP:
+    case COIL_CBC_SCOPE:
+    case COIL_CBC_SCOPL:
+      slot->kind = COIL_CBC_K_NOP;
+      break;
+    case COIL_CBC_JMP:
+    case COIL_CBC_BR:
+    case COIL_CBC_CALL: {
+      coil_u8_t base = info->operation == COIL_CBC_JMP ? COIL_CBC_K_JMP
+                     : info->operation == COIL_CBC_BR ? COIL_CBC_K_BR : COIL_CBC_K_CALL;
+      if (info->form[0] != COIL_CBC_FORM_S) {
+        slot->kind = (coil_u8_t)(base + 1);
+        break;
+      }
+      
+      // Symbol targets are code offsets, resolved to slots once
+      coil_u64_t target = slot->a.addr;
+      if (target > size || slot_of[target] == COIL_CBC_NO_SLOT) {
+        return COIL_ERROR(COIL_ERR_FORMAT, "Branch target is not an instruction");
+      }
+      slot->kind = base;
+      slot->target = slot_of[target];
+      break;
+    }
+    case COIL_CBC_RET:
+      slot->kind = COIL_CBC_K_RET;
+      break;
+    case COIL_CBC_CMP:
+      slot->kind = fast ? (imm ? COIL_CBC_K_CMP_RI : COIL_CBC_K_CMP_RR) : COIL_CBC_K_CMP;
+      break;
+    case COIL_CBC_TEST:
+      slot->kind = COIL_CBC_K_TEST;
+      break;
+    case COIL_CBC_MOV:
+      slot->kind = fast ? (imm ? COIL_CBC_K_MOV_RI : COIL_CBC_K_MOV_RR) : COIL_CBC_K_MOV;
+      break;
+    case COIL_CBC_PUSH:
+      slot->kind = COIL_CBC_K_PUSH;
+      break;
+    case COIL_CBC_POP:
+      slot->kind = COIL_CBC_K_POP;
+      break;
+    case COIL_CBC_LEA:
+      if (info->form[1] == COIL_CBC_FORM_I || info->form[1] == COIL_CBC_FORM_R) {
+        return COIL_ERROR(COIL_ERR_FORMAT, "LEA needs a memory source");
+      }
+      slot->kind = COIL_CBC_K_LEA;
+      break;
+    case COIL_CBC_PUSHFD:
+      slot->kind = COIL_CBC_K_PUSHFD;
+      break;
+    case COIL_CBC_POPFD:
+      slot->kind = COIL_CBC_K_POPFD;
+      break;
+    case COIL_CBC_PUSHA:
+      slot->kind = COIL_CBC_K_PUSHA;
+      break;
+    case COIL_CBC_POPA:
+      slot->kind = COIL_CBC_K_POPA;
+      break;
+    case COIL_CBC_ADD:
+    case COIL_CBC_SUB:
+    case COIL_CBC_MUL:
+    case COIL_CBC_AND:
+    case COIL_CBC_OR:
+    case COIL_CBC_XOR:
+    case COIL_CBC_SHL:
+    case COIL_CBC_SAL:
+    case COIL_CBC_SHR:
+      slot->kind = fast ? (coil_u8_t)(coil_cbc_fast_kinds[info->operation] + imm) : COIL_CBC_K_ALU;
+      break;
+    case COIL_CBC_DIV:
+    case COIL_CBC_MOD:
+    case COIL_CBC_SAR:
+      slot->kind = COIL_CBC_K_ALU;
+      break;
+    case COIL_CBC_NOT:
+      if (info->form[0] == COIL_CBC_FORM_I) {
+        return COIL_ERROR(COIL_ERR_FORMAT, "NOT needs a writable operand");
+      }
+      slot->b = slot->a;
+      slot->kind = COIL_CBC_K_UNARY;
+      break;
+    case COIL_CBC_INC:
+    case COIL_CBC_DEC:
+    case COIL_CBC_NEG:
+      slot->kind = COIL_CBC_K_UNARY;
+      break;
+    case COIL_CBC_CVT:
+      if (info->form[0] != COIL_CBC_FORM_R) {
+        return COIL_ERROR(COIL_ERR_FORMAT, "CVT needs a register destination");
+      }
+      slot->kind = COIL_CBC_K_CVT;
+      break;
+    case COIL_CBC_RDTSC:
+      if (info->form[0] == COIL_CBC_FORM_I) {
+        return COIL_ERROR(COIL_ERR_FORMAT, "RDTSC needs a writable operand");
+      }
+      slot->kind = COIL_CBC_K_RDTSC;
+      break;
+    default:
+      return COIL_ERROR(COIL_ERR_NOTSUP, "Privileged CBC operations cannot be interpreted");
+  }
+  
+  return COIL_ERR_GOOD;
+}
+
+/**
+* @brief Give the first slot of a fused pair its fused handler
+*
+* Decoding checked the pair's shape, so both slots got fast handlers. The
+* second slot keeps its own handler for branches that land on it.
+*/
+static void coil_cbc_fuse_slots(coil_cbc_slot_t *first, const coil_cbc_slot_t *second) {
+  if (second->kind == COIL_CBC_K_BR && (first->kind == COIL_CBC_K_CMP_RR || first->kind == COIL_CBC_K_CMP_RI)) {
+    first->kind = first->kind == COIL_CBC_K_CMP_RR ? COIL_CBC_K_CMP_RR_BR : COIL_CBC_K_CMP_RI_BR;
+  } else if (first->kind == COIL_CBC_K_MOV_RR && second->kind >= COIL_CBC_K_ADD_RR && second->kind <= COIL_CBC_K_SHR_RI) {
+    first->kind = (coil_u8_t)(COIL_CBC_K_MOV_ADD_RR + (second->kind - COIL_CBC_K_ADD_RR));
+  }
+}
+
+/**
+* @brief Predecode a CBC program
+*/
+coil_err_t coil_cbc_program_init(coil_cbc_program_t *prog, const coil_byte_t *code, coil_size_t size,
+                                 const coil_u64_t *symvals, coil_u32_t symcount) {
+  if (prog == NULL || (code == NULL && size != 0) || (symvals == NULL && symcount != 0)) {
+    return COIL_ERROR(COIL_ERR_INVAL, "Invalid parameters");
+  }
+  
+  if (size >= COIL_CBC_NO_SLOT) {
+    return COIL_ERROR(COIL_ERR_INVAL, "CBC code is too large");
+  }
+  
+  memset(prog, 0, sizeof(coil_cbc_program_t));
+  
+  prog->slot_of = (coil_u32_t *)coil_malloc((size + 1) * sizeof(coil_u32_t));
+  if (prog->slot_of == NULL) {
+    return COIL_ERROR(COIL_ERR_NOMEM, "Failed to allocate slot map");
+  }
+  memset(prog->slot_of, 0xFF, (size + 1) * sizeof(coil_u32_t));
+  
+  // Instruction boundaries first, so branch targets can be resolved in one pass
+  coil_cbc_insn_t insn;
+  coil_u32_t count = 0;
+  coil_err_t err;
+  for (coil_size_t offset = 0; offset < size; offset += insn.length) {
+    err = coil_cbc_decode(code, size, offset, &insn);
+    if (err != COIL_ERR_GOOD) {
+      coil_cbc_program_cleanup(prog);
+      return err;
+    }
+    prog->slot_of[offset] = count++;
+  }
+  prog->slot_of[size] = count;
+  
+  prog->slots = (coil_cbc_slot_t *)coil_calloc((coil_size_t)count + 1, sizeof(coil_cbc_slot_t));
+  if (prog->slots == NULL) {
+    coil_cbc_program_cleanup(prog);
+    return COIL_ERROR(COIL_ERR_NOMEM, "Failed to allocate slots");
+  }
+  prog->count = count;
+  prog->code_size = size;
+  
+  coil_size_t offset = 0;
+  int fused = 0;
+  for (coil_u32_t i = 0; i < count; i++) {
+    coil_cbc_decode(code, size, offset, &insn);
+    err = coil_cbc_predecode(&prog->slots[i], &insn, offset, symvals, symcount, prog->slot_of, size);
+    if (err != COIL_ERR_GOOD) {
+      coil_cbc_program_cleanup(prog);
+      return err;
+    }
+    if (fused) {
+      coil_cbc_fuse_slots(&prog->slots[i - 1], &prog->slots[i]);
+    }
+    fused = coil_cbc_fusion(insn.opcode) != NULL;
+    offset += insn.length;
+  }
+  
+  // Running past the last instruction stops at this slot
+  prog->slots[count].kind = COIL_CBC_K_END;
+  prog->slots[count].offset = size;
+  
+#if COIL_CBC_THREADED
+  const void *const *labels;
+  coil_cbc_loop_threaded(NULL, NULL, 0, 0, &labels);
+  for (coil_u32_t i = 0; i <= count; i++) {
+    prog->slots[i].handler = labels[prog->slots[i].kind];
+  }
+#endif
+  
+  return COIL_ERR_GOOD;
+}
+
+/**
+* @brief Release a predecoded program
+*/
+void coil_cbc_program_cleanup(coil_cbc_program_t *prog) {
+  if (prog == NULL) {
+    return;
+  }
+  
+  coil_free(prog->slots);
+  coil_free(prog->slot_of);
+  memset(prog, 0, sizeof(coil_cbc_program_t));
+}
+
+// -------------------------------- Interpreter -------------------------------- //
+
+/**
+* @brief Initialize an interpreter
+*/
+coil_err_t coil_cbc_vm_init(coil_cbc_vm_t *vm, coil_byte_t *memory, coil_size_t memory_size, coil_u32_t depth) {
+  if (vm == NULL || (memory == NULL && memory_size != 0) || depth == 0) {
+    return COIL_ERROR(COIL_ERR_INVAL, "Invalid parameters");
+  }
+  
+  memset(vm, 0, sizeof(coil_cbc_vm_t));
+  
+  vm->stack = (coil_cbc_value_t *)coil_calloc(depth, sizeof(coil_cbc_value_t));
+  vm->calls = (coil_u32_t *)coil_calloc(depth, sizeof(coil_u32_t));
+  if (vm->stack == NULL || vm->calls == NULL) {
+    coil_free(vm->stack);
+    coil_free(vm->calls);
+    vm->stack = NULL;
+    vm->calls = NULL;
+    return COIL_ERROR(COIL_ERR_NOMEM, "Failed to allocate interpreter stacks");
+  }
+  
+  vm->memory = memory;
+  vm->memory_size = memory_size;
+  vm->stack_depth = depth;
+  vm->call_depth = depth;
+  return COIL_ERR_GOOD;
+}
+
+/**
+* @brief Release an interpreter
+*/
+void coil_cbc_vm_cleanup(coil_cbc_vm_t *vm) {
+  if (vm == NULL) {
+    return;
+  }
+  
+  coil_free(vm->stack);
+  coil_free(vm->calls);
+  memset(vm, 0, sizeof(coil_cbc_vm_t));
+}
+
+/**
+* @brief Check run parameters and find the entry slot
+*/
+static coil_err_t coil_cbc_entry(const coil_cbc_vm_t *vm, const coil_cbc_program_t *prog, coil_u64_t entry, coil_u32_t *slot) {
+  if (vm == NULL || prog == NULL || prog->slots == NULL) {
+    return COIL_ERROR(COIL_ERR_INVAL, "Invalid parameters");
+  }
+  
+  if (entry >= prog->code_size || prog->slot_of[entry] == COIL_CBC_NO_SLOT) {
+    return COIL_ERROR(COIL_ERR_INVAL, "Entry does not start an instruction");
+  }
+  
+  *slot = prog->slot_of[entry];
+  return COIL_ERR_GOOD;
+}
+
+/**
+* @brief Run a program until the outermost RET
+*/
+coil_err_t coil_cbc_run(coil_cbc_vm_t *vm, const coil_cbc_program_t *prog, coil_u64_t entry, coil_u64_t max_steps) {
+  coil_u32_t slot;
+  coil_err_t err = coil_cbc_entry(vm, prog, entry, &slot);
+  if (err != COIL_ERR_GOOD) {
+    return err;
+  }
+  
+#if COIL_CBC_THREADED
+  return coil_cbc_loop_threaded(vm, prog, slot, max_steps, NULL);
+#else
+  return coil_cbc_loop_switch(vm, prog, slot, max_steps);
+#endif
+}
+
+/**
+* @brief Run a program with a plain switch dispatch loop
+*/
+coil_err_t coil_cbc_run_switch(coil_cbc_vm_t *vm, const coil_cbc_program_t *prog, coil_u64_t entry, coil_u64_t max_steps) {
+  coil_u32_t slot;
+  coil_err_t err = coil_cbc_entry(vm, prog, entry, &slot);
+  if (err != COIL_ERR_GOOD) {
+    return err;
+  }
+  
+  return coil_cbc_loop_switch(vm, prog, slot, max_steps);
+}
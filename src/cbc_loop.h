@@ -0,0 +1,244 @@
+/**
+* @file cbc_loop.h
+* @brief CBC interpreter loop body, included by cbc.c once per dispatch strategy
+*
+* The includer defines COIL_CBC_CASE(kind) to start a handler,
+* COIL_CBC_DISPATCH() to run the instruction at ip, and COIL_CBC_LOOP_BEGIN
+* and COIL_CBC_LOOP_END around the handlers. The body expects vm, prog,
+* entry and max_steps in scope and returns from the enclosing function.
+*/
+
+  coil_cbc_value_t *regs = vm->regs;
+  const coil_cbc_slot_t *slots = prog->slots;
+  const coil_cbc_slot_t *ip = slots + entry;
+  coil_u64_t steps = vm->steps;
+  coil_u64_t fused = vm->fused;
+  coil_u64_t limit = max_steps != 0 ? vm->steps + max_steps : ~(coil_u64_t)0;
+  coil_u8_t flags = vm->flags;
+  coil_err_t status = COIL_ERR_GOOD;
+  const char *reason = NULL;
+  coil_cbc_wide_t x, y, r;
+  coil_u32_t t;
+  
+#define COIL_CBC_NEXT() do { ip++; COIL_CBC_DISPATCH(); } while (0)
+#define COIL_CBC_PAIR() do { ip++; steps++; fused++; } while (0)
+#define COIL_CBC_FAULT(code, msg) do { status = (code); reason = (msg); goto coil_cbc_fault; } while (0)
+#define COIL_CBC_JUMP(slot) do { \
+  if (steps > limit) COIL_CBC_FAULT(COIL_ERR_BADSTATE, "Step budget exhausted"); \
+  ip = slots + (slot); \
+  COIL_CBC_DISPATCH(); \
+} while (0)
+#define COIL_CBC_FAST(name, expr) \
+  COIL_CBC_CASE(name##_RR) { \
+    coil_u64_t a = regs[ip->a.reg].lo, b = regs[ip->b.reg].lo; \
+    regs[ip->a.reg].lo = (expr) & ip->mask; \
+    regs[ip->a.reg].hi = 0; \
+    COIL_CBC_NEXT(); \
+  } \
+  COIL_CBC_CASE(name##_RI) { \
+    coil_u64_t a = regs[ip->a.reg].lo, b = ip->b.imm.lo; \
+    regs[ip->a.reg].lo = (expr) & ip->mask; \
+    regs[ip->a.reg].hi = 0; \
+    COIL_CBC_NEXT(); \
+  }
+#define COIL_CBC_FUSED_MOV(name, expr) \
+  COIL_CBC_CASE(MOV_##name##_RR) { \
+    regs[ip->a.reg].lo = regs[ip->b.reg].lo & ip->mask; \
+    regs[ip->a.reg].hi = 0; \
+    COIL_CBC_PAIR(); \
+    coil_u64_t a = regs[ip->a.reg].lo, b = regs[ip->b.reg].lo; \
+    regs[ip->a.reg].lo = (expr) & ip->mask; \
+    regs[ip->a.reg].hi = 0; \
+    COIL_CBC_NEXT(); \
+  } \
+  COIL_CBC_CASE(MOV_##name##_RI) { \
+    regs[ip->a.reg].lo = regs[ip->b.reg].lo & ip->mask; \
+    regs[ip->a.reg].hi = 0; \
+    COIL_CBC_PAIR(); \
+    coil_u64_t a = regs[ip->a.reg].lo, b = ip->b.imm.lo; \
+    regs[ip->a.reg].lo = (expr) & ip->mask; \
+    regs[ip->a.reg].hi = 0; \
+    COIL_CBC_NEXT(); \
+  }
+  
+  COIL_CBC_DISPATCH();
+  
+  COIL_CBC_LOOP_BEGIN
+  
+  // Control flow
+  COIL_CBC_CASE(END)
+    COIL_CBC_FAULT(COIL_ERR_BADSTATE, "Ran past the end of the code");
+  COIL_CBC_CASE(NOP)
+    COIL_CBC_NEXT();
+  COIL_CBC_CASE(JMP)
+    COIL_CBC_JUMP(ip->target);
+  COIL_CBC_CASE(JMPD)
+    if (!coil_cbc_target(vm, prog, ip, &t)) COIL_CBC_FAULT(COIL_ERR_BADSTATE, "Bad branch target");
+    COIL_CBC_JUMP(t);
+  COIL_CBC_CASE(BR)
+    if (coil_cbc_taken[ip->cond][flags]) COIL_CBC_JUMP(ip->target);
+    COIL_CBC_NEXT();
+  COIL_CBC_CASE(BRD)
+    if (!coil_cbc_taken[ip->cond][flags]) COIL_CBC_NEXT();
+    if (!coil_cbc_target(vm, prog, ip, &t)) COIL_CBC_FAULT(COIL_ERR_BADSTATE, "Bad branch target");
+    COIL_CBC_JUMP(t);
+  COIL_CBC_CASE(CALL)
+    if (vm->csp == vm->call_depth) COIL_CBC_FAULT(COIL_ERR_BADSTATE, "Call stack overflow");
+    vm->calls[vm->csp++] = (coil_u32_t)(ip - slots) + 1;
+    COIL_CBC_JUMP(ip->target);
+  COIL_CBC_CASE(CALLD)
+    if (!coil_cbc_target(vm, prog, ip, &t)) COIL_CBC_FAULT(COIL_ERR_BADSTATE, "Bad branch target");
+    if (vm->csp == vm->call_depth) COIL_CBC_FAULT(COIL_ERR_BADSTATE, "Call stack overflow");
+    vm->calls[vm->csp++] = (coil_u32_t)(ip - slots) + 1;
+    COIL_CBC_JUMP(t);
+  COIL_CBC_CASE(RET)
+    if (vm->csp == 0) goto coil_cbc_done;
+    ip = slots + vm->calls[--vm->csp];
+    COIL_CBC_DISPATCH();
+  
+  // Comparison
+  COIL_CBC_CASE(CMP_RR)
+    flags = coil_cbc_compare64(regs[ip->a.reg].lo, regs[ip->b.reg].lo, ip->shift);
+    COIL_CBC_NEXT();
+  COIL_CBC_CASE(CMP_RI)
+    flags = coil_cbc_compare64(regs[ip->a.reg].lo, ip->b.imm.lo, ip->shift);
+    COIL_CBC_NEXT();
+  COIL_CBC_CASE(CMP)
+    if (!coil_cbc_load(vm, &ip->a, ip->width, &x) || !coil_cbc_load(vm, &ip->b, ip->width, &y)) {
+      COIL_CBC_FAULT(COIL_ERR_BADSTATE, "Memory access out of bounds");
+    }
+    flags = coil_cbc_compare(x, y, ip->width);
+    COIL_CBC_NEXT();
+  COIL_CBC_CASE(TEST)
+    if (!coil_cbc_load(vm, &ip->a, ip->width, &x) || !coil_cbc_load(vm, &ip->b, ip->width, &y)) {
+      COIL_CBC_FAULT(COIL_ERR_BADSTATE, "Memory access out of bounds");
+    }
+    flags = coil_cbc_test(x, y, ip->width);
+    COIL_CBC_NEXT();
+  
+  // Data movement
+  COIL_CBC_CASE(MOV_RR)
+    regs[ip->a.reg].lo = regs[ip->b.reg].lo & ip->mask;
+    regs[ip->a.reg].hi = 0;
+    COIL_CBC_NEXT();
+  COIL_CBC_CASE(MOV_RI)
+    regs[ip->a.reg].lo = ip->b.imm.lo & ip->mask;
+    regs[ip->a.reg].hi = 0;
+    COIL_CBC_NEXT();
+  COIL_CBC_CASE(MOV)
+    if (!coil_cbc_load(vm, &ip->b, ip->width, &y) || !coil_cbc_store(vm, &ip->a, ip->width, y)) {
+      COIL_CBC_FAULT(COIL_ERR_BADSTATE, "Memory access out of bounds");
+    }
+    COIL_CBC_NEXT();
+  COIL_CBC_CASE(PUSH)
+    if (vm->sp == vm->stack_depth) COIL_CBC_FAULT(COIL_ERR_BADSTATE, "Stack overflow");
+    if (!coil_cbc_load(vm, &ip->a, ip->width, &x)) COIL_CBC_FAULT(COIL_ERR_BADSTATE, "Memory access out of bounds");
+    vm->stack[vm->sp++] = coil_cbc_split(x);
+    COIL_CBC_NEXT();
+  COIL_CBC_CASE(POP)
+    if (vm->sp == 0) COIL_CBC_FAULT(COIL_ERR_BADSTATE, "Stack underflow");
+    if (!coil_cbc_store(vm, &ip->a, ip->width, coil_cbc_widen(&vm->stack[vm->sp - 1]))) {
+      COIL_CBC_FAULT(COIL_ERR_BADSTATE, "Memory access out of bounds");
+    }
+    vm->sp--;
+    COIL_CBC_NEXT();
+  COIL_CBC_CASE(LEA)
+    y = ip->b.kind == COIL_CBC_REF_MEMR ? regs[ip->b.reg].lo + ip->b.addr : ip->b.addr;
+    if (!coil_cbc_store(vm, &ip->a, ip->width, y)) COIL_CBC_FAULT(COIL_ERR_BADSTATE, "Memory access out of bounds");
+    COIL_CBC_NEXT();
+  COIL_CBC_CASE(PUSHFD)
+    if (vm->sp == vm->stack_depth) COIL_CBC_FAULT(COIL_ERR_BADSTATE, "Stack overflow");
+    vm->stack[vm->sp].lo = flags;
+    vm->stack[vm->sp++].hi = 0;
+    COIL_CBC_NEXT();
+  COIL_CBC_CASE(POPFD)
+    if (vm->sp == 0) COIL_CBC_FAULT(COIL_ERR_BADSTATE, "Stack underflow");
+    flags = (coil_u8_t)(vm->stack[--vm->sp].lo & (COIL_CBC_FLAG_EQ | COIL_CBC_FLAG_LT));
+    COIL_CBC_NEXT();
+  COIL_CBC_CASE(PUSHA)
+    if (vm->stack_depth - vm->sp < COIL_CBC_REGISTERS) COIL_CBC_FAULT(COIL_ERR_BADSTATE, "Stack overflow");
+    memcpy(vm->stack + vm->sp, regs, sizeof(vm->regs));
+    vm->sp += COIL_CBC_REGISTERS;
+    COIL_CBC_NEXT();
+  COIL_CBC_CASE(POPA)
+    if (vm->sp < COIL_CBC_REGISTERS) COIL_CBC_FAULT(COIL_ERR_BADSTATE, "Stack underflow");
+    vm->sp -= COIL_CBC_REGISTERS;
+    memcpy(regs, vm->stack + vm->sp, sizeof(vm->regs));
+    COIL_CBC_NEXT();
+  
+  // Register arithmetic up to 64 bits
+  COIL_CBC_FAST(ADD, a + b)
+  COIL_CBC_FAST(SUB, a - b)
+  COIL_CBC_FAST(MUL, a * b)
+  COIL_CBC_FAST(AND, a & b)
+  COIL_CBC_FAST(OR, a | b)
+  COIL_CBC_FAST(XOR, a ^ b)
+  COIL_CBC_FAST(SHL, a << (b & ip->shift))
+  COIL_CBC_FAST(SHR, (a & ip->mask) >> (b & ip->shift))
+  
+  // Every other operand shape
+  COIL_CBC_CASE(ALU)
+    if (!coil_cbc_load(vm, &ip->a, ip->width, &x) || !coil_cbc_load(vm, &ip->b, ip->width, &y)) {
+      COIL_CBC_FAULT(COIL_ERR_BADSTATE, "Memory access out of bounds");
+    }
+    if (!coil_cbc_alu(ip->operation, ip->width, x, y, &r)) COIL_CBC_FAULT(COIL_ERR_BADSTATE, "Division by zero");
+    if (!coil_cbc_store(vm, &ip->a, ip->width, r)) COIL_CBC_FAULT(COIL_ERR_BADSTATE, "Memory access out of bounds");
+    COIL_CBC_NEXT();
+  COIL_CBC_CASE(UNARY)
+    if (!coil_cbc_load(vm, &ip->b, ip->width, &y)) COIL_CBC_FAULT(COIL_ERR_BADSTATE, "Memory access out of bounds");
+    coil_cbc_alu(ip->operation, ip->width, 0, y, &r);
+    if (!coil_cbc_store(vm, &ip->a, ip->width, r)) COIL_CBC_FAULT(COIL_ERR_BADSTATE, "Memory access out of bounds");
+    COIL_CBC_NEXT();
+  COIL_CBC_CASE(CVT)
+    if (!coil_cbc_load(vm, &ip->b, ip->width, &y)) COIL_CBC_FAULT(COIL_ERR_BADSTATE, "Memory access out of bounds");
+    regs[ip->a.reg] = coil_cbc_split((coil_cbc_wide_t)coil_cbc_sext(y, ip->width));
+#ifndef __SIZEOF_INT128__
+    regs[ip->a.reg].hi = (coil_i64_t)regs[ip->a.reg].lo < 0 ? ~(coil_u64_t)0 : 0;
+#endif
+    COIL_CBC_NEXT();
+  COIL_CBC_CASE(RDTSC)
+    if (!coil_cbc_store(vm, &ip->a, ip->width, steps)) COIL_CBC_FAULT(COIL_ERR_BADSTATE, "Memory access out of bounds");
+    COIL_CBC_NEXT();
+  
+  // Fused pairs, the second slot runs without a dispatch of its own
+  COIL_CBC_CASE(CMP_RR_BR)
+    flags = coil_cbc_compare64(regs[ip->a.reg].lo, regs[ip->b.reg].lo, ip->shift);
+    COIL_CBC_PAIR();
+    if (coil_cbc_taken[ip->cond][flags]) COIL_CBC_JUMP(ip->target);
+    COIL_CBC_NEXT();
+  COIL_CBC_CASE(CMP_RI_BR)
+    flags = coil_cbc_compare64(regs[ip->a.reg].lo, ip->b.imm.lo, ip->shift);
+    COIL_CBC_PAIR();
+    if (coil_cbc_taken[ip->cond][flags]) COIL_CBC_JUMP(ip->target);
+    COIL_CBC_NEXT();
+  COIL_CBC_FUSED_MOV(ADD, a + b)
+  COIL_CBC_FUSED_MOV(SUB, a - b)
+  COIL_CBC_FUSED_MOV(MUL, a * b)
+  COIL_CBC_FUSED_MOV(AND, a & b)
+  COIL_CBC_FUSED_MOV(OR, a | b)
+  COIL_CBC_FUSED_MOV(XOR, a ^ b)
+  COIL_CBC_FUSED_MOV(SHL, a << (b & ip->shift))
+  COIL_CBC_FUSED_MOV(SHR, (a & ip->mask) >> (b & ip->shift))
+  
+  COIL_CBC_LOOP_END
+  
+coil_cbc_fault:
+  // The faulting instruction does not retire
+  steps--;
+  vm->fault = ip->offset;
+  
+coil_cbc_done:
+  vm->steps = steps;
+  vm->fused = fused;
+  vm->flags = flags;
+  if (status != COIL_ERR_GOOD) {
+    return COIL_ERROR(status, reason);
+  }
+  return COIL_ERR_GOOD;
+  
+#undef COIL_CBC_NEXT
+#undef COIL_CBC_FAULT
+#undef COIL_CBC_JUMP
+#undef COIL_CBC_FAST
+#undef COIL_CBC_PAIR
+#undef COIL_CBC_FUSED_MOV
@@ -0,0 +1,699 @@
+/**
+* @file cfg.c
+* @brief Control-flow graphs over COIL instruction streams for libcoil-dev
+*/
+
+#include <coil/base.h>
+#include <coil/cfg.h>
+#include <coil/instr.h>
+#include <coil/par.h>
+#include "srcdeps.h"
+#include <stdlib.h>
+#include <string.h>
+
+/**
+* @brief Where a branch goes
+*/
+typedef enum coil_cfg_target_e {
+  COIL_CFG_TARGET_NONE,        ///< No target (RET, CALL)
+  COIL_CFG_TARGET_LOCAL,       ///< Instruction inside the function
+  COIL_CFG_TARGET_EXIT,        ///< Outside the function
+  COIL_CFG_TARGET_INDIRECT,    ///< Register, variable or memory
+} coil_cfg_target_t;
+
+/**
+* @brief Control instruction found by the decode pass
+*/
+typedef struct coil_cfg_control {
+  coil_u64_t at;               ///< Offset of the instruction
+  coil_u64_t next;             ///< Offset past the instruction
+  coil_u64_t target;           ///< Symbol index, then the resolved offset for local targets
+  coil_u8_t opcode;            ///< COIL_OP_BR, COIL_OP_JMP, COIL_OP_CALL or COIL_OP_RET
+  coil_u8_t conditional;       ///< Flagged BR (falls through when not taken)
+  coil_u8_t kind;              ///< coil_cfg_target_t
+} coil_cfg_control_t;
+
+/**
+* @brief Scratch state of one build
+*/
+typedef struct coil_cfg_scan {
+  coil_u64_t *starts;                  ///< Instruction starts, one bit per byte of the function
+  coil_u64_t *leaders;                 ///< Block starts, one bit per byte of the function
+  coil_cfg_control_t *controls;        ///< Control instructions in order
+  coil_u32_t control_count;            ///< Number of control instructions
+  coil_u32_t control_capacity;         ///< Allocated control instructions
+} coil_cfg_scan_t;
+
+/**
+* @brief Function ordering entry (largest first)
+*/
+typedef struct coil_cfg_rank {
+  coil_u64_t size;             ///< Size of the function
+  coil_u32_t index;            ///< Index of the function
+} coil_cfg_rank_t;
+
+/**
+* @brief Shared state of a parallel build
+*/
+typedef struct coil_cfg_ctx {
+  coil_cfg_t *cfgs;                    ///< Graphs
+  coil_section_t *ir;                  ///< COIL instructions
+  const coil_lower_func_t *funcs;      ///< Functions
+  const coil_cfg_rank_t *ranks;        ///< Order the functions are handed out in
+  const coil_u64_t *symvals;           ///< Symbol values
+  coil_u32_t symcount;                 ///< Number of symbol values
+  coil_err_t *errs;                    ///< Per-function results
+} coil_cfg_ctx_t;
+
+// -------------------------------- Decoding -------------------------------- //
+
+/**
+* @brief Set a bit of a function-relative bitmap
+*/
+static inline void coil_cfg_bit_set(coil_u64_t *bits, coil_u64_t index) {
+  bits[index >> 6] |= (coil_u64_t)1 << (index & 63);
+}
+
+/**
+* @brief Test a bit of a function-relative bitmap
+*/
+static inline int coil_cfg_bit_test(const coil_u64_t *bits, coil_u64_t index) {
+  return (int)((bits[index >> 6] >> (index & 63)) & 1);
+}
+
+/**
+* @brief Decode an operand, returning its type and value
+*/
+static coil_err_t coil_cfg_operand(coil_section_t *ir, coil_u64_t *pos, coil_u64_t end,
+                                   coil_u8_t *type, coil_u64_t *value) {
+  coil_operand_header_t header;
+  coil_offset_t offset;
+  coil_size_t next = coil_operand_decode(ir, *pos, &header, &offset);
+  if (next == 0) {
+    return coil_error_get_last();
+  }
+  
+  coil_byte_t data[16];
+  coil_size_t valsize;
+  next = coil_operand_decode_data(ir, next, data, sizeof(data), &valsize, &header);
+  if (next == 0) {
+    return coil_error_get_last();
+  }
+  if (next > end) {
+    return COIL_ERROR(COIL_ERR_FORMAT, "Operand crosses the end of its function");
+  }
+  *pos = next;
+  
+  *type = header.type;
+  *value = 0;
+  switch (valsize) {
+    case 0: break;
+    case 1: { coil_u8_t v; memcpy(&v, data, 1); *value = v; break; }
+    case 2: { coil_u16_t v; memcpy(&v, data, 2); *value = v; break; }
+    case 4: { coil_u32_t v; memcpy(&v, data, 4); *value = v; break; }
+    default: memcpy(value, data, 8); break;
+  }
+  return COIL_ERR_GOOD;
+}
+
+/**
+* @brief Append a control instruction
+*/
+static coil_err_t coil_cfg_control_add(coil_cfg_scan_t *scan, const coil_cfg_control_t *control) {
+  if (scan->control_count == scan->control_capacity) {
+    coil_u32_t capacity = scan->control_capacity ? scan->control_capacity * 2 : 16;
+    coil_cfg_control_t *controls = (coil_cfg_control_t *)coil_realloc(scan->controls,
+                                                                     capacity * sizeof(coil_cfg_control_t));
+    if (controls == NULL) {
+      return COIL_ERROR(COIL_ERR_NOMEM, "Failed to allocate control instructions");
+    }
+    scan->controls = controls;
+    scan->control_capacity = capacity;
+  }
+  
+  scan->controls[scan->control_count++] = *control;
+  return COIL_ERR_GOOD;
+}
+
+/**
+* @brief Decode the function once, marking instruction starts and collecting control instructions
+*/
+static coil_err_t coil_cfg_decode(coil_cfg_t *cfg, coil_section_t *ir, coil_cfg_scan_t *scan) {
+  coil_u64_t pos = cfg->offset;
+  coil_u64_t end = cfg->offset + cfg->size;
+  
+  while (pos < end) {
+    coil_u64_t at = pos;
+    cfg->fault = at;
+    
+    coil_instrmem_t instr;
+    coil_instrfmt_t fmt;
+    coil_size_t next = coil_instr_decode(ir, pos, &instr, &fmt);
+    if (next == 0) {
+      return coil_error_get_last();
+    }
+    if (next > end) {
+      return COIL_ERROR(COIL_ERR_FORMAT, "Instruction crosses the end of its function");
+    }
+    coil_cfg_bit_set(scan->starts, at - cfg->offset);
+    
+    coil_u8_t flag = COIL_INSTRFLAG_NONE;
+    int count = 0;
+    switch (fmt) {
+      case COIL_INSTRFMT_VALUE:
+      case COIL_INSTRFMT_UNARY:
+        count = 1;
+        break;
+      case COIL_INSTRFMT_BINARY:
+        count = 2;
+        break;
+      case COIL_INSTRFMT_TENARY:
+        count = 3;
+        break;
+      case COIL_INSTRFMT_FLAG_UNARY:
+        flag = ((coil_instrflag_t *)&instr)->flag;
+        count = 1;
+        break;
+      case COIL_INSTRFMT_FLAG_BINARY:
+        flag = ((coil_instrflag_t *)&instr)->flag;
+        count = 2;
+        break;
+      case COIL_INSTRFMT_FLAG_TENARY:
+        flag = ((coil_instrflag_t *)&instr)->flag;
+        count = 3;
+        break;
+      default:
+        break;
+    }
+    
+    coil_cfg_control_t control = { at, 0, 0, instr.opcode, 0, COIL_CFG_TARGET_NONE };
+    int is_control = instr.opcode == COIL_OP_BR || instr.opcode == COIL_OP_JMP ||
+                     instr.opcode == COIL_OP_CALL || instr.opcode == COIL_OP_RET;
+    
+    // Only the first operand of a branch names its target, the rest are skipped
+    pos = next;
+    for (int i = 0; i < count; i++) {
+      coil_u8_t type = COIL_TYPEOP_NONE;
+      coil_u64_t value = 0;
+      coil_err_t err = coil_cfg_operand(ir, &pos, end, &type, &value);
+      if (err != COIL_ERR_GOOD) {
+        return err;
+      }
+      if (i == 0 && is_control) {
+        control.kind = type == COIL_TYPEOP_SYM ? COIL_CFG_TARGET_LOCAL : COIL_CFG_TARGET_INDIRECT;
+        control.target = value;
+      }
+    }
+    
+    if (is_control) {
+      control.next = pos;
+      control.conditional = instr.opcode == COIL_OP_BR && flag != COIL_INSTRFLAG_NONE;
+      coil_err_t err = coil_cfg_control_add(scan, &control);
+      if (err != COIL_ERR_GOOD) {
+        return err;
+      }
+    }
+  }
+  
+  return COIL_ERR_GOOD;
+}
+
+/**
+* @brief Resolve symbol targets and mark block leaders
+*/
+static coil_err_t coil_cfg_resolve(coil_cfg_t *cfg, coil_cfg_scan_t *scan,
+                                   const coil_u64_t *symvals, coil_u32_t symcount) {
+  coil_u64_t end = cfg->offset + cfg->size;
+  
+  if (cfg->size > 0) {
+    coil_cfg_bit_set(scan->leaders, 0);
+  }
+  
+  for (coil_u32_t i = 0; i < scan->control_count; i++) {
+    coil_cfg_control_t *control = &scan->controls[i];
+    
+    if (control->opcode != COIL_OP_CALL && control->next < end) {
+      coil_cfg_bit_set(scan->leaders, control->next - cfg->offset);
+    }
+    if (control->kind != COIL_CFG_TARGET_LOCAL) {
+      continue;
+    }
+    
+    if (control->target >= symcount) {
+      cfg->fault = control->at;
+      return COIL_ERROR(COIL_ERR_FORMAT, "Branch to an unknown symbol");
+    }
+    coil_u64_t target = symvals[control->target];
+    
+    // A call always leaves the function, its target is not part of the graph
+    if (control->opcode == COIL_OP_CALL || target < cfg->offset || target >= end) {
+      control->kind = COIL_CFG_TARGET_EXIT;
+      continue;
+    }
+    if (!coil_cfg_bit_test(scan->starts, target - cfg->offset)) {
+      cfg->fault = control->at;
+      return COIL_ERROR(COIL_ERR_FORMAT, "Branch into the middle of an instruction");
+    }
+    
+    control->target = target;
+    coil_cfg_bit_set(scan->leaders, target - cfg->offset);
+  }
+  
+  return COIL_ERR_GOOD;
+}
+
+// -------------------------------- Graph -------------------------------- //
+
+/**
+* @brief Carve the graph arrays out of one allocation
+*/
+static coil_err_t coil_cfg_alloc(coil_cfg_t *cfg, coil_u32_t count) {
+  coil_size_t n = count;
+  cfg->dom_words = count <= COIL_CFG_DOM_MAX ? (count + 63) / 64 : 0;
+  
+  // 64-bit arrays first so every array stays aligned
+  coil_size_t words = n * 2 + n * cfg->dom_words;
+  coil_size_t halves = (n + 1) * 2 + n * 2 * 2 + n * 3;
+  coil_byte_t *base = (coil_byte_t *)coil_malloc(words * 8 + halves * 4 + n + 1);
+  if (base == NULL) {
+    return COIL_ERROR(COIL_ERR_NOMEM, "Failed to allocate control-flow graph");
+  }
+  
+  coil_u64_t *w = (coil_u64_t *)base;
+  cfg->start = w;
+  cfg->end = w + n;
+  cfg->dom = cfg->dom_words ? w + n * 2 : NULL;
+  
+  coil_u32_t *h = (coil_u32_t *)(w + words);
+  cfg->succ_index = h;
+  cfg->pred_index = h + n + 1;
+  cfg->succ = h + (n + 1) * 2;
+  cfg->pred = cfg->succ + n * 2;
+  cfg->rpo = cfg->pred + n * 2;
+  cfg->order = cfg->rpo + n;
+  cfg->idom = cfg->order + n;
+  
+  cfg->flags = (coil_u8_t *)(h + halves);
+  memset(cfg->flags, 0, n);
+  return COIL_ERR_GOOD;
+}
+
+/**
+* @brief Form blocks from the leaders and connect them
+*/
+static void coil_cfg_edges(coil_cfg_t *cfg, const coil_cfg_scan_t *scan) {
+  coil_u32_t count = cfg->count;
+  coil_u64_t end = cfg->offset + cfg->size;
+  coil_u64_t words = (cfg->size >> 6) + 1;
+  
+  coil_u32_t b = 0;
+  for (coil_u64_t w = 0; w < words; w++) {
+    coil_u64_t bits = scan->leaders[w];
+    while (bits != 0) {
+      cfg->start[b++] = cfg->offset + (w << 6) + (coil_u64_t)__builtin_ctzll(bits);
+      bits &= bits - 1;
+    }
+  }
+  for (b = 0; b < count; b++) {
+    cfg->end[b] = b + 1 < count ? cfg->start[b + 1] : end;
+  }
+  
+  // Control instructions are in order, so blocks are walked alongside them
+  coil_u32_t e = 0;
+  coil_u32_t c = 0;
+  for (b = 0; b < count; b++) {
+    cfg->succ_index[b] = e;
+    int falls = 1;
+    
+    for (; c < scan->control_count && scan->controls[c].at < cfg->end[b]; c++) {
+      const coil_cfg_control_t *control = &scan->controls[c];
+      if (control->opcode == COIL_OP_CALL) {
+        cfg->flags[b] |= COIL_CFG_BLOCK_CALL;
+        continue;
+      }
+      if (control->opcode == COIL_OP_RET) {
+        cfg->flags[b] |= COIL_CFG_BLOCK_RETURN;
+        falls = 0;
+        continue;
+      }
+      
+      switch (control->kind) {
+        case COIL_CFG_TARGET_LOCAL: {
+          coil_u32_t target;
+          coil_cfg_block_of(cfg, control->target, &target);
+          cfg->succ[e++] = target;
+          break;
+        }
+        case COIL_CFG_TARGET_EXIT:
+          cfg->flags[b] |= COIL_CFG_BLOCK_EXIT;
+          break;
+        default:
+          cfg->flags[b] |= COIL_CFG_BLOCK_INDIRECT;
+          break;
+      }
+      falls = control->conditional;
+    }
+    
+    if (falls) {
+      if (b + 1 == count) {
+        cfg->flags[b] |= COIL_CFG_BLOCK_EXIT;
+      } else if (e == cfg->succ_index[b] || cfg->succ[e - 1] != b + 1) {
+        cfg->succ[e++] = b + 1;
+      }
+    }
+  }
+  cfg->succ_index[count] = e;
+  
+  // Predecessors by counting sort, which keeps them in block order
+  memset(cfg->pred_index, 0, (count + 1) * sizeof(coil_u32_t));
+  for (coil_u32_t i = 0; i < e; i++) {
+    cfg->pred_index[cfg->succ[i] + 1]++;
+  }
+  for (b = 0; b < count; b++) {
+    cfg->pred_index[b + 1] += cfg->pred_index[b];
+  }
+  for (b = 0; b < count; b++) {
+    for (coil_u32_t i = cfg->succ_index[b]; i < cfg->succ_index[b + 1]; i++) {
+      coil_u32_t s = cfg->succ[i];
+      cfg->pred[cfg->pred_index[s]++] = b;
+    }
+  }
+  for (b = count; b > 0; b--) {
+    cfg->pred_index[b] = cfg->pred_index[b - 1];
+  }
+  cfg->pred_index[0] = 0;
+}
+
+/**
+* @brief Number the reachable blocks in reverse postorder
+*
+* @param stack Scratch of count entries
+* @param next Scratch of count entries
+*/
+static void coil_cfg_rpo(coil_cfg_t *cfg, coil_u32_t *stack, coil_u32_t *next) {
+  coil_u32_t count = cfg->count;
+  memset(cfg->order, 0xFF, count * sizeof(coil_u32_t));
+  cfg->rpo_count = 0;
+  if (count == 0) {
+    return;
+  }
+  
+  // Postorder fills rpo from the back, reachable blocks end up at its front
+  coil_u32_t depth = 0;
+  coil_u32_t post = count;
+  stack[depth++] = 0;
+  next[0] = cfg->succ_index[0];
+  cfg->flags[0] |= COIL_CFG_BLOCK_REACHABLE;
+  
+  while (depth > 0) {
+    coil_u32_t b = stack[depth - 1];
+    if (next[b] < cfg->succ_index[b + 1]) {
+      coil_u32_t s = cfg->succ[next[b]++];
+      if (!(cfg->flags[s] & COIL_CFG_BLOCK_REACHABLE)) {
+        cfg->flags[s] |= COIL_CFG_BLOCK_REACHABLE;
+        next[s] = cfg->succ_index[s];
+        stack[depth++] = s;
+      }
+    } else {
+      cfg->rpo[--post] = b;
+      depth--;
+    }
+  }
+  
+  cfg->rpo_count = count - post;
+  memmove(cfg->rpo, cfg->rpo + post, cfg->rpo_count * sizeof(coil_u32_t));
+  for (coil_u32_t i = 0; i < cfg->rpo_count; i++) {
+    cfg->order[cfg->rpo[i]] = i;
+  }
+}
+
+/**
+* @brief Immediate dominators (Cooper, Harvey and Kennedy) and dominator bitsets
+*/
+static void coil_cfg_dominators(coil_cfg_t *cfg) {
+  coil_u32_t count = cfg->count;
+  memset(cfg->idom, 0xFF, count * sizeof(coil_u32_t));
+  if (cfg->rpo_count == 0) {
+    return;
+  }
+  cfg->idom[0] = 0;
+  
+  int changed = 1;
+  while (changed) {
+    changed = 0;
+    for (coil_u32_t i = 1; i < cfg->rpo_count; i++) {
+      coil_u32_t b = cfg->rpo[i];
+      coil_u32_t idom = COIL_CFG_NONE;
+      
+      for (coil_u32_t p = cfg->pred_index[b]; p < cfg->pred_index[b + 1]; p++) {
+        coil_u32_t other = cfg->pred[p];
+        if (cfg->idom[other] == COIL_CFG_NONE) {
+          continue;
+        }
+        if (idom == COIL_CFG_NONE) {
+          idom = other;
+          continue;
+        }
+        
+        // Walk both fingers up the tree until they meet
+        while (other != idom) {
+          while (cfg->order[other] > cfg->order[idom]) {
+            other = cfg->idom[other];
+          }
+          while (cfg->order[idom] > cfg->order[other]) {
+            idom = cfg->idom[idom];
+          }
+        }
+      }
+      
+      if (cfg->idom[b] != idom) {
+        cfg->idom[b] = idom;
+        changed = 1;
+      }
+    }
+  }
+  
+  if (cfg->dom == NULL) {
+    return;
+  }
+  
+  // Each block's dominators are its immediate dominator's plus itself
+  coil_u32_t words = cfg->dom_words;
+  memset(cfg->dom, 0, (coil_size_t)count * words * sizeof(coil_u64_t));
+  cfg->dom[0] = 1;
+  for (coil_u32_t i = 1; i < cfg->rpo_count; i++) {
+    coil_u32_t b = cfg->rpo[i];
+    coil_u64_t *row = cfg->dom + (coil_size_t)b * words;
+    memcpy(row, cfg->dom + (coil_size_t)cfg->idom[b] * words, words * sizeof(coil_u64_t));
+    coil_cfg_bit_set(row, b);
+  }
+}
+
+/**
+* @brief Build the control-flow graph of a function
+*/
+coil_err_t coil_cfg_build(coil_cfg_t *cfg, coil_section_t *ir, coil_u64_t offset, coil_u64_t size,
+                          const coil_u64_t *symvals, coil_u32_t symcount) {
+  if (cfg == NULL) {
+    return COIL_ERROR(COIL_ERR_INVAL, "Invalid parameters");
+  }
+  memset(cfg, 0, sizeof(coil_cfg_t));
+  
+  if (ir == NULL || (symvals == NULL && symcount != 0)) {
+    return COIL_ERROR(COIL_ERR_INVAL, "Invalid parameters");
+  }
+  if (coil_section_is_chunked(ir)) {
+    return COIL_ERROR(COIL_ERR_BADSTATE, "Cannot build a graph from a chunked section");
+  }
+  if (offset > ir->size || size > ir->size - offset || size >= COIL_CFG_NONE) {
+    return COIL_ERROR(COIL_ERR_INVAL, "Function leaves the section");
+  }
+  cfg->offset = offset;
+  cfg->size = size;
+  cfg->fault = offset;
+  
+  coil_cfg_scan_t scan;
+  memset(&scan, 0, sizeof(scan));
+  coil_u64_t words = (size >> 6) + 1;
+  scan.starts = (coil_u64_t *)coil_calloc(words * 2, sizeof(coil_u64_t));
+  if (scan.starts == NULL) {
+    return COIL_ERROR(COIL_ERR_NOMEM, "Failed to allocate control-flow scan");
+  }
+  scan.leaders = scan.starts + words;
+  
+  coil_err_t err = coil_cfg_decode(cfg, ir, &scan);
+  if (err == COIL_ERR_GOOD) {
+    err = coil_cfg_resolve(cfg, &scan, symvals, symcount);
+  }
+  
+  coil_u32_t *stack = NULL;
+  if (err == COIL_ERR_GOOD) {
+    coil_u64_t count = 0;
+    for (coil_u64_t w = 0; w < words; w++) {
+      count += (coil_u64_t)__builtin_popcountll(scan.leaders[w]);
+    }
+    cfg->count = (coil_u32_t)count;
+    err = coil_cfg_alloc(cfg, cfg->count);
+    
+    stack = (coil_u32_t *)coil_malloc((count > 0 ? count : 1) * 2 * sizeof(coil_u32_t));
+    if (err == COIL_ERR_GOOD && stack == NULL) {
+      err = COIL_ERROR(COIL_ERR_NOMEM, "Failed to allocate control-flow scan");
+    }
+  }
+  
+  if (err == COIL_ERR_GOOD) {
+    coil_cfg_edges(cfg, &scan);
+    coil_cfg_rpo(cfg, stack, stack + cfg->count);
+    coil_cfg_dominators(cfg);
+  }
+  
+  coil_free(stack);
+  coil_free(scan.controls);
+  coil_free(scan.starts);
+  
+  if (err != COIL_ERR_GOOD) {
+    coil_u64_t fault = cfg->fault;
+    coil_cfg_cleanup(cfg);
+    cfg->fault = fault;
+    return err;
+  }
+  return COIL_ERR_GOOD;
+}
+
+/**
+* @brief Build one function's graph (coil_par_fn_t)
+*/
+static coil_err_t coil_cfg_build_one(void *arg, coil_size_t index) {
+  coil_cfg_ctx_t *ctx = (coil_cfg_ctx_t *)arg;
+  coil_u32_t f = ctx->ranks[index].index;
+  
+  ctx->errs[f] = coil_cfg_build(&ctx->cfgs[f], ctx->ir, ctx->funcs[f].offset, ctx->funcs[f].size,
+                                ctx->symvals, ctx->symcount);
+  return ctx->errs[f];
+}
+
+/**
+* @brief Order functions by decreasing size, then by position
+*/
+static int coil_cfg_compare_rank(const void *a, const void *b) {
+  const coil_cfg_rank_t *x = (const coil_cfg_rank_t *)a;
+  const coil_cfg_rank_t *y = (const coil_cfg_rank_t *)b;
+  
+  if (x->size != y->size) {
+    return x->size > y->size ? -1 : 1;
+  }
+  return x->index < y->index ? -1 : x->index > y->index;
+}
+
+/**
+* @brief Build the control-flow graphs of many functions in parallel
+*/
+coil_err_t coil_cfg_build_all(coil_cfg_t *cfgs, coil_section_t *ir, const coil_lower_func_t *funcs, coil_u32_t count,
+                              const coil_u64_t *symvals, coil_u32_t symcount, coil_u32_t threads, coil_u64_t *fault) {
+  if (cfgs == NULL || ir == NULL || (funcs == NULL && count != 0)) {
+    return COIL_ERROR(COIL_ERR_INVAL, "Invalid parameters");
+  }
+  memset(cfgs, 0, count * sizeof(coil_cfg_t));
+  
+  coil_err_t *errs = (coil_err_t *)coil_calloc(count > 0 ? count : 1, sizeof(coil_err_t));
+  coil_cfg_rank_t *ranks = (coil_cfg_rank_t *)coil_malloc((count > 0 ? count : 1) * sizeof(coil_cfg_rank_t));
+  if (errs == NULL || ranks == NULL) {
+    coil_free(ranks);
+    coil_free(errs);
+    return COIL_ERROR(COIL_ERR_NOMEM, "Failed to allocate control-flow state");
+  }
+  
+  // Largest functions go first so a long one does not start last
+  for (coil_u32_t i = 0; i < count; i++) {
+    ranks[i].size = funcs[i].size;
+    ranks[i].index = i;
+  }
+  qsort(ranks, count, sizeof(coil_cfg_rank_t), coil_cfg_compare_rank);
+  
+  coil_cfg_ctx_t ctx = { cfgs, ir, funcs, ranks, symvals, symcount, errs };
+  coil_err_t err = coil_par_for(count, threads, coil_cfg_build_one, &ctx);
+  
+  // Report the first failing function in section order, whichever thread hit it
+  if (err != COIL_ERR_GOOD) {
+    for (coil_u32_t i = 0; i < count; i++) {
+      if (errs[i] != COIL_ERR_GOOD) {
+        err = errs[i];
+        if (fault != NULL) {
+          *fault = cfgs[i].fault;
+        }
+        break;
+      }
+    }
+    for (coil_u32_t i = 0; i < count; i++) {
+      coil_cfg_cleanup(&cfgs[i]);
+    }
+  }
+  
+  coil_free(ranks);
+  coil_free(errs);
+  
+  if (err != COIL_ERR_GOOD) {
+    return COIL_ERROR(err, "Failed to build control-flow graphs");
+  }
+  return COIL_ERR_GOOD;
+}
+
+/**
+* @brief Find the block holding an offset
+*/
+coil_err_t coil_cfg_block_of(const coil_cfg_t *cfg, coil_u64_t offset, coil_u32_t *block) {
+  if (cfg == NULL || block == NULL) {
+    return COIL_ERROR(COIL_ERR_INVAL, "Invalid parameters");
+  }
+  if (cfg->count == 0 || offset < cfg->offset || offset >= cfg->offset + cfg->size) {
+    return COIL_ERROR(COIL_ERR_NOTFOUND, "Offset is outside the function");
+  }
+  
+  // Last block starting at or before the offset
+  coil_u32_t lo = 0;
+  coil_u32_t hi = cfg->count;
+  while (hi - lo > 1) {
+    coil_u32_t mid = lo + (hi - lo) / 2;
+    if (cfg->start[mid] <= offset) {
+      lo = mid;
+    } else {
+      hi = mid;
+    }
+  }
+  
+  *block = lo;
+  return COIL_ERR_GOOD;
+}
+
+/**
+* @brief Check whether one block dominates another
+*/
+int coil_cfg_dominates(const coil_cfg_t *cfg, coil_u32_t a, coil_u32_t b) {
+  if (cfg == NULL || a >= cfg->count || b >= cfg->count ||
+      cfg->order[a] == COIL_CFG_NONE || cfg->order[b] == COIL_CFG_NONE) {
+    return 0;
+  }
+  
+  if (cfg->dom != NULL) {
+    return coil_cfg_bit_test(cfg->dom + (coil_size_t)b * cfg->dom_words, a);
+  }
+  
+  // Dominators come earlier in reverse postorder than what they dominate
+  while (cfg->order[b] > cfg->order[a]) {
+    b = cfg->idom[b];
+  }
+  return b == a;
+}
+
+/**
+* @brief Release a control-flow graph
+*/
+void coil_cfg_cleanup(coil_cfg_t *cfg) {
+  if (cfg == NULL) {
+    return;
+  }
+  
+  // Every array lives in the allocation that starts with the block starts
+  coil_free(cfg->start);
+  memset(cfg, 0, sizeof(coil_cfg_t));
+}
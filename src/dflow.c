@@ -0,0 +1,1078 @@
+/**
+* @file dflow.c
+* @brief Bitset dataflow over control-flow graphs and variable liveness for libcoil-dev
+*/
+
+#include <coil/base.h>
+#include <coil/dflow.h>
+#include <coil/instr.h>
+#include <coil/target.h>
+#include "srcdeps.h"
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+/**
+* @brief Bitset kernel
+*/
+typedef int (*coil_dflow_kernel_t)(coil_u64_t *dst, const coil_u64_t *a, const coil_u64_t *b, coil_size_t words);
+
+/**
+* @brief Transfer kernel
+*/
+typedef int (*coil_dflow_transfer_t)(coil_u64_t *dst, const coil_u64_t *gen, const coil_u64_t *src,
+                                     const coil_u64_t *kill, coil_size_t words);
+
+/**
+* @brief Kernels selected for the host
+*/
+typedef struct coil_dflow_kernels {
+  coil_dflow_kernel_t set_union;       ///< dst = a | b
+  coil_dflow_kernel_t set_intersect;   ///< dst = a & b
+  coil_dflow_kernel_t set_diff;        ///< dst = a & ~b
+  coil_dflow_transfer_t transfer;      ///< dst = gen | (src & ~kill)
+  int simd;                            ///< AVX2 kernels
+} coil_dflow_kernels_t;
+
+/**
+* @brief Variable reference found by the liveness scan
+*/
+typedef struct coil_live_ref {
+  coil_u64_t var;              ///< Variable id, then its fact index
+  coil_u32_t block;            ///< Block of the instruction
+  coil_u8_t write;             ///< Write (1) or read (0)
+} coil_live_ref_t;
+
+/**
+* @brief Variable references of a function
+*/
+typedef struct coil_live_scan {
+  coil_live_ref_t *refs;       ///< References in instruction order, reads of an instruction before its write
+  coil_size_t count;           ///< Number of references
+  coil_size_t capacity;        ///< Allocated references
+} coil_live_scan_t;
+
+// -------------------------------- Bitsets -------------------------------- //
+
+/**
+* @brief Define a scalar bitset kernel from a word expression of a and b
+*/
+#define COIL_DFLOW_SCALAR(name, expr) \
+  static int name(coil_u64_t *dst, const coil_u64_t *a, const coil_u64_t *b, coil_size_t words) { \
+    coil_u64_t changed = 0; \
+    for (coil_size_t i = 0; i < words; i++) { \
+      coil_u64_t x = a[i], y = b[i]; \
+      coil_u64_t r = (expr); \
+      changed |= r ^ dst[i]; \
+      dst[i] = r; \
+    } \
+    return changed != 0; \
+  }
+
+COIL_DFLOW_SCALAR(coil_dflow_union_scalar, x | y)
+COIL_DFLOW_SCALAR(coil_dflow_intersect_scalar, x & y)
+COIL_DFLOW_SCALAR(coil_dflow_diff_scalar, x & ~y)
+
+/**
+* @brief dst = gen | (src & ~kill) a word at a time
+*/
+static int coil_dflow_transfer_scalar(coil_u64_t *dst, const coil_u64_t *gen, const coil_u64_t *src,
+                                      const coil_u64_t *kill, coil_size_t words) {
+  coil_u64_t changed = 0;
+  for (coil_size_t i = 0; i < words; i++) {
+    coil_u64_t r = gen[i] | (src[i] & ~kill[i]);
+    changed |= r ^ dst[i];
+    dst[i] = r;
+  }
+  return changed != 0;
+}
+
+#if defined(__x86_64__)
+
+/**
+* @brief Define an AVX2 bitset kernel, four words per step and the tail a word at a time
+*/
+#define COIL_DFLOW_AVX2(name, vexpr, expr) \
+  __attribute__((target("avx2"))) \
+  static int name(coil_u64_t *dst, const coil_u64_t *a, const coil_u64_t *b, coil_size_t words) { \
+    __m256i changed = _mm256_setzero_si256(); \
+    coil_size_t i = 0; \
+    for (; i + 4 <= words; i += 4) { \
+      __m256i x = _mm256_loadu_si256((const __m256i *)(a + i)); \
+      __m256i y = _mm256_loadu_si256((const __m256i *)(b + i)); \
+      __m256i r = (vexpr); \
+      changed = _mm256_or_si256(changed, _mm256_xor_si256(r, _mm256_loadu_si256((const __m256i *)(dst + i)))); \
+      _mm256_storeu_si256((__m256i *)(dst + i), r); \
+    } \
+    coil_u64_t tail = 0; \
+    for (; i < words; i++) { \
+      coil_u64_t x = a[i], y = b[i]; \
+      coil_u64_t r = (expr); \
+      tail |= r ^ dst[i]; \
+      dst[i] = r; \
+    } \
+    return !_mm256_testz_si256(changed, changed) || tail != 0; \
+  }
+
+COIL_DFLOW_AVX2(coil_dflow_union_avx2, _mm256_or_si256(x, y), x | y)
+COIL_DFLOW_AVX2(coil_dflow_intersect_avx2, _mm256_and_si256(x, y), x & y)
+COIL_DFLOW_AVX2(coil_dflow_diff_avx2, _mm256_andnot_si256(y, x), x & ~y)
+
+/**
+* @brief dst = gen | (src & ~kill) four words at a time
+*/
+__attribute__((target("avx2")))
+static int coil_dflow_transfer_avx2(coil_u64_t *dst, const coil_u64_t *gen, const coil_u64_t *src,
+                                    const coil_u64_t *kill, coil_size_t words) {
+  __m256i changed = _mm256_setzero_si256();
+  coil_size_t i = 0;
+  for (; i + 4 <= words; i += 4) {
+    __m256i g = _mm256_loadu_si256((const __m256i *)(gen + i));
+    __m256i s = _mm256_loadu_si256((const __m256i *)(src + i));
+    __m256i k = _mm256_loadu_si256((const __m256i *)(kill + i));
+    __m256i r = _mm256_or_si256(g, _mm256_andnot_si256(k, s));
+    changed = _mm256_or_si256(changed, _mm256_xor_si256(r, _mm256_loadu_si256((const __m256i *)(dst + i))));
+    _mm256_storeu_si256((__m256i *)(dst + i), r);
+  }
+  
+  coil_u64_t tail = 0;
+  for (; i < words; i++) {
+    coil_u64_t r = gen[i] | (src[i] & ~kill[i]);
+    tail |= r ^ dst[i];
+    dst[i] = r;
+  }
+  return !_mm256_testz_si256(changed, changed) || tail != 0;
+}
+
+#endif
+
+/**
+* @brief Kernels in use
+*/
+static coil_dflow_kernels_t coil_dflow_kernels = {
+  coil_dflow_union_scalar, coil_dflow_intersect_scalar, coil_dflow_diff_scalar, coil_dflow_transfer_scalar, 0
+};
+
+/**
+* @brief Guards the one-time kernel selection
+*/
+static pthread_once_t coil_dflow_once = PTHREAD_ONCE_INIT;
+
+/**
+* @brief Pick the widest kernels the host runs
+*/
+static void coil_dflow_select(void) {
+#if defined(__x86_64__)
+  if (coil_host_target()->features & COIL_CPU_X86_AVX2) {
+    coil_dflow_kernels.set_union = coil_dflow_union_avx2;
+    coil_dflow_kernels.set_intersect = coil_dflow_intersect_avx2;
+    coil_dflow_kernels.set_diff = coil_dflow_diff_avx2;
+    coil_dflow_kernels.transfer = coil_dflow_transfer_avx2;
+    coil_dflow_kernels.simd = 1;
+  }
+#endif
+}
+
+/**
+* @brief Kernels for the host
+*/
+static inline const coil_dflow_kernels_t *coil_dflow_get_kernels(void) {
+  pthread_once(&coil_dflow_once, coil_dflow_select);
+  return &coil_dflow_kernels;
+}
+
+/**
+* @brief dst = a | b
+*/
+int coil_dflow_union(coil_u64_t *dst, const coil_u64_t *a, const coil_u64_t *b, coil_size_t words) {
+  return coil_dflow_get_kernels()->set_union(dst, a, b, words);
+}
+
+/**
+* @brief dst = a & b
+*/
+int coil_dflow_intersect(coil_u64_t *dst, const coil_u64_t *a, const coil_u64_t *b, coil_size_t words) {
+  return coil_dflow_get_kernels()->set_intersect(dst, a, b, words);
+}
+
+/**
+* @brief dst = a & ~b
+*/
+int coil_dflow_diff(coil_u64_t *dst, const coil_u64_t *a, const coil_u64_t *b, coil_size_t words) {
+  return coil_dflow_get_kernels()->set_diff(dst, a, b, words);
+}
+
+/**
+* @brief dst = gen | (src & ~kill)
+*/
+int coil_dflow_transfer(coil_u64_t *dst, const coil_u64_t *gen, const coil_u64_t *src, const coil_u64_t *kill,
+                        coil_size_t words) {
+  return coil_dflow_get_kernels()->transfer(dst, gen, src, kill, words);
+}
+
+/**
+* @brief Check whether the bitset kernels use AVX2
+*/
+int coil_dflow_simd(void) {
+  return coil_dflow_get_kernels()->simd;
+}
+
+// -------------------------------- Fact lists -------------------------------- //
+
+/**
+* @brief Make room for a number of facts
+*/
+static coil_err_t coil_dflow_list_reserve(coil_dflow_list_t *list, coil_size_t count) {
+  if (count <= list->capacity) {
+    return COIL_ERR_GOOD;
+  }
+  
+  coil_size_t capacity = list->capacity ? list->capacity : 8;
+  while (capacity < count) {
+    capacity *= 2;
+  }
+  coil_u32_t *items = (coil_u32_t *)coil_realloc(list->items, capacity * sizeof(coil_u32_t));
+  if (items == NULL) {
+    return COIL_ERROR(COIL_ERR_NOMEM, "Failed to allocate fact list");
+  }
+  list->items = items;
+  list->capacity = (coil_u32_t)capacity;
+  return COIL_ERR_GOOD;
+}
+
+/**
+* @brief dst = a | b (dst must be neither)
+*/
+static coil_err_t coil_dflow_list_union(coil_dflow_list_t *dst, const coil_dflow_list_t *a, const coil_dflow_list_t *b) {
+  coil_err_t err = coil_dflow_list_reserve(dst, (coil_size_t)a->count + b->count);
+  if (err != COIL_ERR_GOOD) {
+    return err;
+  }
+  
+  coil_u32_t i = 0, j = 0, n = 0;
+  while (i < a->count && j < b->count) {
+    coil_u32_t x = a->items[i], y = b->items[j];
+    dst->items[n++] = x < y ? x : y;
+    i += x <= y;
+    j += y <= x;
+  }
+  while (i < a->count) {
+    dst->items[n++] = a->items[i++];
+  }
+  while (j < b->count) {
+    dst->items[n++] = b->items[j++];
+  }
+  dst->count = n;
+  return COIL_ERR_GOOD;
+}
+
+/**
+* @brief dst = a & ~b (dst must be neither)
+*/
+static coil_err_t coil_dflow_list_diff(coil_dflow_list_t *dst, const coil_dflow_list_t *a, const coil_dflow_list_t *b) {
+  coil_err_t err = coil_dflow_list_reserve(dst, a->count);
+  if (err != COIL_ERR_GOOD) {
+    return err;
+  }
+  
+  coil_u32_t j = 0, n = 0;
+  for (coil_u32_t i = 0; i < a->count; i++) {
+    coil_u32_t x = a->items[i];
+    while (j < b->count && b->items[j] < x) {
+      j++;
+    }
+    if (j == b->count || b->items[j] != x) {
+      dst->items[n++] = x;
+    }
+  }
+  dst->count = n;
+  return COIL_ERR_GOOD;
+}
+
+/**
+* @brief Swap the contents of two lists
+*/
+static inline void coil_dflow_list_swap(coil_dflow_list_t *a, coil_dflow_list_t *b) {
+  coil_dflow_list_t t = *a;
+  *a = *b;
+  *b = t;
+}
+
+/**
+* @brief Order facts ascending
+*/
+static int coil_dflow_compare_fact(const void *a, const void *b) {
+  coil_u32_t x = *(const coil_u32_t *)a;
+  coil_u32_t y = *(const coil_u32_t *)b;
+  return x < y ? -1 : x > y;
+}
+
+/**
+* @brief Sort a list and drop duplicates
+*/
+static void coil_dflow_list_normalize(coil_dflow_list_t *list) {
+  if (list->count < 2) {
+    return;
+  }
+  
+  qsort(list->items, list->count, sizeof(coil_u32_t), coil_dflow_compare_fact);
+  coil_u32_t n = 1;
+  for (coil_u32_t i = 1; i < list->count; i++) {
+    if (list->items[i] != list->items[n - 1]) {
+      list->items[n++] = list->items[i];
+    }
+  }
+  list->count = n;
+}
+
+/**
+* @brief First position in a sorted list holding a fact at or after another
+*/
+static coil_u32_t coil_dflow_list_lower(const coil_dflow_list_t *list, coil_u32_t fact) {
+  coil_u32_t lo = 0, hi = list->count;
+  while (lo < hi) {
+    coil_u32_t mid = lo + (hi - lo) / 2;
+    if (list->items[mid] < fact) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+  return lo;
+}
+
+// -------------------------------- Problems -------------------------------- //
+
+/**
+* @brief Dense set of a block
+*/
+static inline coil_u64_t *coil_dflow_row(const coil_dflow_t *flow, coil_dflow_set_t set, coil_u32_t block) {
+  return flow->bits + ((coil_size_t)block * 4 + set) * flow->words;
+}
+
+/**
+* @brief Sparse set of a block
+*/
+static inline coil_dflow_list_t *coil_dflow_set_list(const coil_dflow_t *flow, coil_dflow_set_t set, coil_u32_t block) {
+  return flow->lists + (coil_size_t)block * 4 + set;
+}
+
+/**
+* @brief Initialize a problem with empty gen and kill sets
+*/
+coil_err_t coil_dflow_init(coil_dflow_t *flow, const coil_cfg_t *cfg, coil_u32_t facts,
+                           coil_dflow_dir_t dir, coil_dflow_meet_t meet, coil_dflow_rep_t rep) {
+  if (flow == NULL) {
+    return COIL_ERROR(COIL_ERR_INVAL, "Invalid parameters");
+  }
+  memset(flow, 0, sizeof(coil_dflow_t));
+  
+  if (cfg == NULL || dir > COIL_DFLOW_BACKWARD || meet > COIL_DFLOW_INTERSECT || rep > COIL_DFLOW_SPARSE) {
+    return COIL_ERROR(COIL_ERR_INVAL, "Invalid parameters");
+  }
+  if (rep == COIL_DFLOW_SPARSE && meet == COIL_DFLOW_INTERSECT) {
+    return COIL_ERROR(COIL_ERR_NOTSUP, "Sparse sets only support union problems");
+  }
+  
+  flow->cfg = cfg;
+  flow->facts = facts;
+  flow->dir = (coil_u8_t)dir;
+  flow->meet = (coil_u8_t)meet;
+  flow->words = (facts + 63) / 64;
+  
+  coil_size_t sets = (coil_size_t)cfg->count * 4;
+  coil_u64_t dense = (coil_u64_t)sets * flow->words * sizeof(coil_u64_t);
+  flow->sparse = rep == COIL_DFLOW_SPARSE || (rep == COIL_DFLOW_AUTO && meet == COIL_DFLOW_UNION &&
+                                              dense > COIL_DFLOW_DENSE_MAX);
+  
+  if (flow->sparse) {
+    flow->lists = (coil_dflow_list_t *)coil_calloc(sets > 0 ? sets : 1, sizeof(coil_dflow_list_t));
+  } else {
+    flow->bits = (coil_u64_t *)coil_calloc(sets * flow->words > 0 ? sets * flow->words : 1, sizeof(coil_u64_t));
+  }
+  if (flow->lists == NULL && flow->bits == NULL) {
+    return COIL_ERROR(COIL_ERR_NOMEM, "Failed to allocate dataflow sets");
+  }
+  return COIL_ERR_GOOD;
+}
+
+/**
+* @brief Add a fact to a block's gen or kill set
+*/
+coil_err_t coil_dflow_add(coil_dflow_t *flow, coil_dflow_set_t set, coil_u32_t block, coil_u32_t fact) {
+  if (flow == NULL || flow->cfg == NULL || (set != COIL_DFLOW_GEN && set != COIL_DFLOW_KILL) ||
+      block >= flow->cfg->count || fact >= flow->facts) {
+    return COIL_ERROR(COIL_ERR_INVAL, "Invalid parameters");
+  }
+  
+  if (!flow->sparse) {
+    coil_dflow_row(flow, set, block)[fact >> 6] |= (coil_u64_t)1 << (fact & 63);
+    return COIL_ERR_GOOD;
+  }
+  
+  // Appended unsorted, sorted once before solving
+  coil_dflow_list_t *list = coil_dflow_set_list(flow, set, block);
+  if (list->count > 0 && list->items[list->count - 1] == fact) {
+    return COIL_ERR_GOOD;
+  }
+  coil_err_t err = coil_dflow_list_reserve(list, (coil_size_t)list->count + 1);
+  if (err != COIL_ERR_GOOD) {
+    return err;
+  }
+  list->items[list->count++] = fact;
+  flow->dirty = 1;
+  return COIL_ERR_GOOD;
+}
+
+/**
+* @brief Check whether a block's meet includes the boundary
+*/
+static inline int coil_dflow_boundary(const coil_dflow_t *flow, coil_u32_t block) {
+  const coil_cfg_t *cfg = flow->cfg;
+  if (flow->dir == COIL_DFLOW_FORWARD) {
+    return block == 0;
+  }
+  return (cfg->flags[block] & (COIL_CFG_BLOCK_RETURN | COIL_CFG_BLOCK_EXIT | COIL_CFG_BLOCK_INDIRECT)) ||
+         cfg->succ_index[block] == cfg->succ_index[block + 1];
+}
+
+/**
+* @brief Evaluate a block on dense sets
+*
+* @return int Non-zero if the block's result changed
+*/
+static int coil_dflow_eval_dense(const coil_dflow_t *flow, const coil_dflow_kernels_t *k, coil_u32_t block) {
+  const coil_cfg_t *cfg = flow->cfg;
+  coil_size_t words = flow->words;
+  int forward = flow->dir == COIL_DFLOW_FORWARD;
+  const coil_u32_t *index = forward ? cfg->pred_index : cfg->succ_index;
+  const coil_u32_t *edges = forward ? cfg->pred : cfg->succ;
+  coil_dflow_set_t from = forward ? COIL_DFLOW_OUT : COIL_DFLOW_IN;
+  coil_dflow_set_t to = forward ? COIL_DFLOW_IN : COIL_DFLOW_OUT;
+  coil_u64_t *meet = coil_dflow_row(flow, to, block);
+  
+  if (flow->meet == COIL_DFLOW_UNION || coil_dflow_boundary(flow, block)) {
+    memset(meet, 0, words * sizeof(coil_u64_t));
+  } else {
+    memset(meet, 0xFF, words * sizeof(coil_u64_t));
+    if (flow->facts & 63) {
+      meet[words - 1] = ((coil_u64_t)1 << (flow->facts & 63)) - 1;
+    }
+  }
+  
+  // Intersecting with the empty boundary leaves nothing to meet
+  if (flow->meet == COIL_DFLOW_UNION || !coil_dflow_boundary(flow, block)) {
+    for (coil_u32_t e = index[block]; e < index[block + 1]; e++) {
+      coil_u32_t other = edges[e];
+      if (cfg->order[other] == COIL_CFG_NONE) {
+        continue;
+      }
+      if (flow->meet == COIL_DFLOW_UNION) {
+        k->set_union(meet, meet, coil_dflow_row(flow, from, other), words);
+      } else {
+        k->set_intersect(meet, meet, coil_dflow_row(flow, from, other), words);
+      }
+    }
+  }
+  
+  return k->transfer(coil_dflow_row(flow, from, block), coil_dflow_row(flow, COIL_DFLOW_GEN, block), meet,
+                     coil_dflow_row(flow, COIL_DFLOW_KILL, block), words);
+}
+
+/**
+* @brief Evaluate a block on sparse sets (union problems)
+*
+* @param scratch Two scratch lists
+* @param changed Receives non-zero if the block's result changed
+*/
+static coil_err_t coil_dflow_eval_sparse(const coil_dflow_t *flow, coil_u32_t block, coil_dflow_list_t *scratch,
+                                         int *changed) {
+  const coil_cfg_t *cfg = flow->cfg;
+  int forward = flow->dir == COIL_DFLOW_FORWARD;
+  const coil_u32_t *index = forward ? cfg->pred_index : cfg->succ_index;
+  const coil_u32_t *edges = forward ? cfg->pred : cfg->succ;
+  coil_dflow_set_t from = forward ? COIL_DFLOW_OUT : COIL_DFLOW_IN;
+  coil_dflow_set_t to = forward ? COIL_DFLOW_IN : COIL_DFLOW_OUT;
+  coil_dflow_list_t *meet = coil_dflow_set_list(flow, to, block);
+  
+  // Merge neighbours pairwise, the result is swapped into place
+  scratch[0].count = 0;
+  for (coil_u32_t e = index[block]; e < index[block + 1]; e++) {
+    coil_u32_t other = edges[e];
+    if (cfg->order[other] == COIL_CFG_NONE) {
+      continue;
+    }
+    coil_err_t err = coil_dflow_list_union(&scratch[1], &scratch[0], coil_dflow_set_list(flow, from, other));
+    if (err != COIL_ERR_GOOD) {
+      return err;
+    }
+    coil_dflow_list_swap(&scratch[0], &scratch[1]);
+  }
+  coil_dflow_list_swap(&scratch[0], meet);
+  
+  coil_err_t err = coil_dflow_list_diff(&scratch[0], meet, coil_dflow_set_list(flow, COIL_DFLOW_KILL, block));
+  if (err == COIL_ERR_GOOD) {
+    err = coil_dflow_list_union(&scratch[1], coil_dflow_set_list(flow, COIL_DFLOW_GEN, block), &scratch[0]);
+  }
+  if (err != COIL_ERR_GOOD) {
+    return err;
+  }
+  
+  // Sets only grow in a union problem, so a change shows in the count
+  coil_dflow_list_t *result = coil_dflow_set_list(flow, from, block);
+  *changed = scratch[1].count != result->count;
+  if (*changed) {
+    coil_dflow_list_swap(&scratch[1], result);
+  }
+  return COIL_ERR_GOOD;
+}
+
+/**
+* @brief First set bit at or after a position (count if none)
+*/
+static coil_u32_t coil_dflow_bit_next(const coil_u64_t *bits, coil_u32_t count, coil_u32_t from) {
+  if (from >= count) {
+    return count;
+  }
+  
+  coil_u32_t w = from >> 6;
+  coil_u64_t word = bits[w] & (~(coil_u64_t)0 << (from & 63));
+  coil_u32_t words = (count + 63) / 64;
+  while (word == 0) {
+    if (++w == words) {
+      return count;
+    }
+    word = bits[w];
+  }
+  return (w << 6) + (coil_u32_t)__builtin_ctzll(word);
+}
+
+/**
+* @brief Last set bit at or before a position (COIL_CFG_NONE if none)
+*/
+static coil_u32_t coil_dflow_bit_prev(const coil_u64_t *bits, coil_u32_t from) {
+  if (from == COIL_CFG_NONE) {
+    return COIL_CFG_NONE;
+  }
+  
+  coil_u32_t w = from >> 6;
+  coil_u64_t word = bits[w] & (~(coil_u64_t)0 >> (63 - (from & 63)));
+  while (word == 0) {
+    if (w-- == 0) {
+      return COIL_CFG_NONE;
+    }
+    word = bits[w];
+  }
+  return (w << 6) + 63 - (coil_u32_t)__builtin_clzll(word);
+}
+
+/**
+* @brief Solve the problem
+*/
+coil_err_t coil_dflow_solve(coil_dflow_t *flow) {
+  if (flow == NULL || flow->cfg == NULL) {
+    return COIL_ERROR(COIL_ERR_INVAL, "Invalid parameters");
+  }
+  const coil_cfg_t *cfg = flow->cfg;
+  const coil_dflow_kernels_t *k = coil_dflow_get_kernels();
+  int forward = flow->dir == COIL_DFLOW_FORWARD;
+  coil_dflow_set_t result = forward ? COIL_DFLOW_OUT : COIL_DFLOW_IN;
+  flow->visits = 0;
+  
+  // Results start at the meet's identity: empty for union, full for intersection
+  for (coil_u32_t b = 0; b < cfg->count; b++) {
+    if (flow->sparse) {
+      if (flow->dirty) {
+        coil_dflow_list_normalize(coil_dflow_set_list(flow, COIL_DFLOW_GEN, b));
+        coil_dflow_list_normalize(coil_dflow_set_list(flow, COIL_DFLOW_KILL, b));
+      }
+      coil_dflow_set_list(flow, COIL_DFLOW_IN, b)->count = 0;
+      coil_dflow_set_list(flow, COIL_DFLOW_OUT, b)->count = 0;
+      continue;
+    }
+    
+    coil_u64_t *in = coil_dflow_row(flow, COIL_DFLOW_IN, b);
+    memset(in, 0, flow->words * 2 * sizeof(coil_u64_t));
+    if (flow->meet == COIL_DFLOW_INTERSECT && flow->words > 0 && cfg->order[b] != COIL_CFG_NONE) {
+      coil_u64_t *top = coil_dflow_row(flow, result, b);
+      memset(top, 0xFF, flow->words * sizeof(coil_u64_t));
+      if (flow->facts & 63) {
+        top[flow->words - 1] = ((coil_u64_t)1 << (flow->facts & 63)) - 1;
+      }
+    }
+  }
+  flow->dirty = 0;
+  
+  coil_u32_t count = cfg->rpo_count;
+  coil_u64_t *pending = (coil_u64_t *)coil_malloc(((count + 63) / 64 + 1) * sizeof(coil_u64_t));
+  coil_dflow_list_t scratch[2];
+  memset(scratch, 0, sizeof(scratch));
+  if (pending == NULL) {
+    return COIL_ERROR(COIL_ERR_NOMEM, "Failed to allocate dataflow worklist");
+  }
+  
+  // Pending reverse postorder positions, swept forward or backward until none is left
+  memset(pending, 0, ((count + 63) / 64 + 1) * sizeof(coil_u64_t));
+  for (coil_u32_t i = 0; i < count; i++) {
+    pending[i >> 6] |= (coil_u64_t)1 << (i & 63);
+  }
+  coil_u32_t remaining = count;
+  coil_u32_t cursor = forward ? 0 : count - 1;
+  coil_err_t err = COIL_ERR_GOOD;
+  
+  while (remaining > 0 && err == COIL_ERR_GOOD) {
+    coil_u32_t pos;
+    if (forward) {
+      pos = coil_dflow_bit_next(pending, count, cursor);
+      if (pos == count) {
+        pos = coil_dflow_bit_next(pending, count, 0);
+      }
+      cursor = pos + 1;
+    } else {
+      pos = coil_dflow_bit_prev(pending, cursor);
+      if (pos == COIL_CFG_NONE) {
+        pos = coil_dflow_bit_prev(pending, count - 1);
+      }
+      cursor = pos - 1;
+    }
+    pending[pos >> 6] &= ~((coil_u64_t)1 << (pos & 63));
+    remaining--;
+    
+    coil_u32_t b = cfg->rpo[pos];
+    int changed;
+    flow->visits++;
+    if (flow->sparse) {
+      err = coil_dflow_eval_sparse(flow, b, scratch, &changed);
+    } else {
+      changed = coil_dflow_eval_dense(flow, k, b);
+    }
+    if (err != COIL_ERR_GOOD || !changed) {
+      continue;
+    }
+    
+    // Blocks that read this result go back on the worklist
+    const coil_u32_t *index = forward ? cfg->succ_index : cfg->pred_index;
+    const coil_u32_t *edges = forward ? cfg->succ : cfg->pred;
+    for (coil_u32_t e = index[b]; e < index[b + 1]; e++) {
+      coil_u32_t q = cfg->order[edges[e]];
+      if (q == COIL_CFG_NONE) {
+        continue;
+      }
+      coil_u64_t bit = (coil_u64_t)1 << (q & 63);
+      if (!(pending[q >> 6] & bit)) {
+        pending[q >> 6] |= bit;
+        remaining++;
+      }
+    }
+  }
+  
+  coil_free(scratch[0].items);
+  coil_free(scratch[1].items);
+  coil_free(pending);
+  return err;
+}
+
+/**
+* @brief Check whether a fact is in a block's set
+*/
+int coil_dflow_has(const coil_dflow_t *flow, coil_dflow_set_t set, coil_u32_t block, coil_u32_t fact) {
+  if (flow == NULL || flow->cfg == NULL || set > COIL_DFLOW_OUT || block >= flow->cfg->count ||
+      fact >= flow->facts) {
+    return 0;
+  }
+  
+  if (!flow->sparse) {
+    return (int)((coil_dflow_row(flow, set, block)[fact >> 6] >> (fact & 63)) & 1);
+  }
+  
+  const coil_dflow_list_t *list = coil_dflow_set_list(flow, set, block);
+  if (flow->dirty && set <= COIL_DFLOW_KILL) {
+    for (coil_u32_t i = 0; i < list->count; i++) {
+      if (list->items[i] == fact) {
+        return 1;
+      }
+    }
+    return 0;
+  }
+  coil_u32_t i = coil_dflow_list_lower(list, fact);
+  return i < list->count && list->items[i] == fact;
+}
+
+/**
+* @brief Find the first fact of a block's set at or after another
+*/
+int coil_dflow_next(const coil_dflow_t *flow, coil_dflow_set_t set, coil_u32_t block, coil_u32_t from,
+                    coil_u32_t *fact) {
+  if (flow == NULL || flow->cfg == NULL || fact == NULL || set > COIL_DFLOW_OUT || block >= flow->cfg->count ||
+      from >= flow->facts || (flow->sparse && flow->dirty && set <= COIL_DFLOW_KILL)) {
+    return 0;
+  }
+  
+  if (!flow->sparse) {
+    coil_u32_t next = coil_dflow_bit_next(coil_dflow_row(flow, set, block), flow->facts, from);
+    *fact = next;
+    return next < flow->facts;
+  }
+  
+  const coil_dflow_list_t *list = coil_dflow_set_list(flow, set, block);
+  coil_u32_t i = coil_dflow_list_lower(list, from);
+  if (i == list->count) {
+    return 0;
+  }
+  *fact = list->items[i];
+  return 1;
+}
+
+/**
+* @brief Release a problem
+*/
+void coil_dflow_cleanup(coil_dflow_t *flow) {
+  if (flow == NULL) {
+    return;
+  }
+  
+  if (flow->lists != NULL && flow->cfg != NULL) {
+    for (coil_size_t i = 0; i < (coil_size_t)flow->cfg->count * 4; i++) {
+      coil_free(flow->lists[i].items);
+    }
+  }
+  coil_free(flow->lists);
+  coil_free(flow->bits);
+  memset(flow, 0, sizeof(coil_dflow_t));
+}
+
+// -------------------------------- Liveness -------------------------------- //
+
+/**
+* @brief How an instruction accesses its first operand
+*/
+coil_live_access_t coil_live_access(coil_u8_t opcode) {
+  switch (opcode) {
+    case COIL_OP_MOV:
+    case COIL_OP_LEA:
+    case COIL_OP_CVT:
+    case COIL_OP_POP:
+      return COIL_LIVE_WRITE;
+    case COIL_OP_ADD:
+    case COIL_OP_SUB:
+    case COIL_OP_MUL:
+    case COIL_OP_DIV:
+    case COIL_OP_MOD:
+    case COIL_OP_INC:
+    case COIL_OP_DEC:
+    case COIL_OP_NEG:
+    case COIL_OP_AND:
+    case COIL_OP_OR:
+    case COIL_OP_XOR:
+    case COIL_OP_NOT:
+    case COIL_OP_SHL:
+    case COIL_OP_SHR:
+    case COIL_OP_SAL:
+    case COIL_OP_SAR:
+      return COIL_LIVE_UPDATE;
+    default:
+      return COIL_LIVE_READ;
+  }
+}
+
+/**
+* @brief Append a variable reference
+*/
+static coil_err_t coil_live_add(coil_live_scan_t *scan, coil_u64_t var, coil_u32_t block, coil_u8_t write) {
+  if (scan->count == scan->capacity) {
+    coil_size_t capacity = scan->capacity ? scan->capacity * 2 : 64;
+    coil_live_ref_t *refs = (coil_live_ref_t *)coil_realloc(scan->refs, capacity * sizeof(coil_live_ref_t));
+    if (refs == NULL) {
+      return COIL_ERROR(COIL_ERR_NOMEM, "Failed to allocate variable references");
+    }
+    scan->refs = refs;
+    scan->capacity = capacity;
+  }
+  
+  coil_live_ref_t *ref = &scan->refs[scan->count++];
+  ref->var = var;
+  ref->block = block;
+  ref->write = write;
+  return COIL_ERR_GOOD;
+}
+
+/**
+* @brief Decode an operand, returning the variable it reads or names (-1 for none)
+*
+* @param named Receives non-zero if the operand is a variable itself rather than based on one
+*/
+static coil_err_t coil_live_operand(coil_section_t *ir, coil_u64_t *pos, coil_u64_t *var, int *named) {
+  coil_operand_header_t header;
+  coil_offset_t offset;
+  coil_size_t next = coil_operand_decode(ir, *pos, &header, &offset);
+  if (next == 0) {
+    return coil_error_get_last();
+  }
+  
+  coil_byte_t data[16];
+  coil_size_t valsize;
+  next = coil_operand_decode_data(ir, next, data, sizeof(data), &valsize, &header);
+  if (next == 0) {
+    return coil_error_get_last();
+  }
+  *pos = next;
+  
+  *named = header.type == COIL_TYPEOP_VAR;
+  if (!*named && !(header.type == COIL_TYPEOP_OFF && header.value_type == COIL_VAL_VAR)) {
+    *var = ~(coil_u64_t)0;
+    return COIL_ERR_GOOD;
+  }
+  
+  switch (valsize) {
+    case 1: { coil_u8_t v; memcpy(&v, data, 1); *var = v; break; }
+    case 2: { coil_u16_t v; memcpy(&v, data, 2); *var = v; break; }
+    case 4: { coil_u32_t v; memcpy(&v, data, 4); *var = v; break; }
+    case 8: memcpy(var, data, 8); break;
+    default: *var = ~(coil_u64_t)0; break;
+  }
+  return COIL_ERR_GOOD;
+}
+
+/**
+* @brief Collect the variable references of every block in instruction order
+*/
+static coil_err_t coil_live_collect(const coil_cfg_t *cfg, coil_section_t *ir, coil_live_scan_t *scan) {
+  for (coil_u32_t b = 0; b < cfg->count; b++) {
+    coil_u64_t pos = cfg->start[b];
+    while (pos < cfg->end[b]) {
+      coil_instrmem_t instr;
+      coil_instrfmt_t fmt;
+      coil_size_t next = coil_instr_decode(ir, pos, &instr, &fmt);
+      if (next == 0) {
+        return coil_error_get_last();
+      }
+      
+      int count = 0;
+      int flagged = 0;
+      switch (fmt) {
+        case COIL_INSTRFMT_VALUE:
+        case COIL_INSTRFMT_UNARY:
+          count = 1;
+          break;
+        case COIL_INSTRFMT_BINARY:
+          count = 2;
+          break;
+        case COIL_INSTRFMT_TENARY:
+          count = 3;
+          break;
+        case COIL_INSTRFMT_FLAG_UNARY:
+        case COIL_INSTRFMT_FLAG_BINARY:
+        case COIL_INSTRFMT_FLAG_TENARY:
+          flagged = ((coil_instrflag_t *)&instr)->flag != COIL_INSTRFLAG_NONE;
+          count = fmt == COIL_INSTRFMT_FLAG_UNARY ? 1 : fmt == COIL_INSTRFMT_FLAG_BINARY ? 2 : 3;
+          break;
+        default:
+          break;
+      }
+      
+      // Reads come before the write, so ADD v, v reads v on entry
+      coil_live_access_t access = coil_live_access(instr.opcode);
+      coil_u64_t written = ~(coil_u64_t)0;
+      pos = next;
+      for (int i = 0; i < count; i++) {
+        coil_u64_t var = ~(coil_u64_t)0;
+        int named = 0;
+        coil_err_t err = coil_live_operand(ir, &pos, &var, &named);
+        if (err != COIL_ERR_GOOD) {
+          return err;
+        }
+        if (var == ~(coil_u64_t)0) {
+          continue;
+        }
+        
+        if (i == 0 && named && access != COIL_LIVE_READ) {
+          written = var;
+          if (access == COIL_LIVE_WRITE && !flagged) {
+            continue;
+          }
+        }
+        err = coil_live_add(scan, var, b, 0);
+        if (err != COIL_ERR_GOOD) {
+          return err;
+        }
+      }
+      
+      // A conditional write may not happen, it reads the old value instead of killing it
+      if (written != ~(coil_u64_t)0 && !flagged) {
+        coil_err_t err = coil_live_add(scan, written, b, 1);
+        if (err != COIL_ERR_GOOD) {
+          return err;
+        }
+      }
+    }
+  }
+  
+  return COIL_ERR_GOOD;
+}
+
+/**
+* @brief Order variable ids ascending
+*/
+static int coil_live_compare_var(const void *a, const void *b) {
+  coil_u64_t x = *(const coil_u64_t *)a;
+  coil_u64_t y = *(const coil_u64_t *)b;
+  return x < y ? -1 : x > y;
+}
+
+/**
+* @brief Compute variable liveness of a function
+*/
+coil_err_t coil_live_build(coil_live_t *live, const coil_cfg_t *cfg, coil_section_t *ir, coil_dflow_rep_t rep) {
+  if (live == NULL) {
+    return COIL_ERROR(COIL_ERR_INVAL, "Invalid parameters");
+  }
+  memset(live, 0, sizeof(coil_live_t));
+  
+  if (cfg == NULL || ir == NULL) {
+    return COIL_ERROR(COIL_ERR_INVAL, "Invalid parameters");
+  }
+  if (coil_section_is_chunked(ir)) {
+    return COIL_ERROR(COIL_ERR_BADSTATE, "Cannot compute liveness over a chunked section");
+  }
+  
+  coil_live_scan_t scan;
+  memset(&scan, 0, sizeof(scan));
+  coil_err_t err = coil_live_collect(cfg, ir, &scan);
+  
+  // Fact indices follow variable ids
+  if (err == COIL_ERR_GOOD) {
+    live->vars = (coil_u64_t *)coil_malloc((scan.count > 0 ? scan.count : 1) * sizeof(coil_u64_t));
+    if (live->vars == NULL) {
+      err = COIL_ERROR(COIL_ERR_NOMEM, "Failed to allocate variable table");
+    }
+  }
+  if (err == COIL_ERR_GOOD) {
+    for (coil_size_t i = 0; i < scan.count; i++) {
+      live->vars[i] = scan.refs[i].var;
+    }
+    qsort(live->vars, scan.count, sizeof(coil_u64_t), coil_live_compare_var);
+    
+    coil_size_t n = 0;
+    for (coil_size_t i = 0; i < scan.count; i++) {
+      if (n == 0 || live->vars[i] != live->vars[n - 1]) {
+        live->vars[n++] = live->vars[i];
+      }
+    }
+    if (n >= COIL_CFG_NONE) {
+      err = COIL_ERROR(COIL_ERR_NOTSUP, "Too many variables");
+    }
+    live->var_count = (coil_u32_t)n;
+  }
+  
+  if (err == COIL_ERR_GOOD) {
+    err = coil_dflow_init(&live->flow, cfg, live->var_count, COIL_DFLOW_BACKWARD, COIL_DFLOW_UNION, rep);
+  }
+  
+  // Reads before any write in the block are generated, writes kill
+  coil_u64_t *written = NULL;
+  if (err == COIL_ERR_GOOD) {
+    written = (coil_u64_t *)coil_calloc(live->var_count / 64 + 1, sizeof(coil_u64_t));
+    if (written == NULL) {
+      err = COIL_ERROR(COIL_ERR_NOMEM, "Failed to allocate liveness scan");
+    }
+  }
+  
+  coil_size_t first = 0;
+  for (coil_size_t i = 0; i < scan.count && err == COIL_ERR_GOOD; i++) {
+    coil_live_ref_t *ref = &scan.refs[i];
+    coil_u32_t fact;
+    coil_live_index(live, ref->var, &fact);
+    ref->var = fact;
+    
+    if (i > 0 && ref->block != scan.refs[i - 1].block) {
+      for (coil_size_t j = first; j < i; j++) {
+        written[scan.refs[j].var >> 6] = 0;
+      }
+      first = i;
+    }
+    
+    coil_u64_t bit = (coil_u64_t)1 << (fact & 63);
+    if (ref->write) {
+      written[fact >> 6] |= bit;
+      err = coil_dflow_add(&live->flow, COIL_DFLOW_KILL, ref->block, fact);
+    } else if (!(written[fact >> 6] & bit)) {
+      err = coil_dflow_add(&live->flow, COIL_DFLOW_GEN, ref->block, fact);
+    }
+  }
+  
+  if (err == COIL_ERR_GOOD) {
+    err = coil_dflow_solve(&live->flow);
+  }
+  
+  coil_free(written);
+  coil_free(scan.refs);
+  if (err != COIL_ERR_GOOD) {
+    coil_live_cleanup(live);
+    return err;
+  }
+  return COIL_ERR_GOOD;
+}
+
+/**
+* @brief Find the fact index of a variable
+*/
+coil_err_t coil_live_index(const coil_live_t *live, coil_u64_t var, coil_u32_t *fact) {
+  if (live == NULL || fact == NULL) {
+    return COIL_ERROR(COIL_ERR_INVAL, "Invalid parameters");
+  }
+  
+  coil_u32_t lo = 0, hi = live->var_count;
+  while (lo < hi) {
+    coil_u32_t mid = lo + (hi - lo) / 2;
+    if (live->vars[mid] < var) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+  
+  if (lo == live->var_count || live->vars[lo] != var) {
+    return COIL_ERROR(COIL_ERR_NOTFOUND, "Function does not reference the variable");
+  }
+  *fact = lo;
+  return COIL_ERR_GOOD;
+}
+
+/**
+* @brief Check whether a variable is live at a block's entry
+*/
+int coil_live_in(const coil_live_t *live, coil_u32_t block, coil_u64_t var) {
+  coil_u32_t fact;
+  if (live == NULL || live->var_count == 0 || coil_live_index(live, var, &fact) != COIL_ERR_GOOD) {
+    return 0;
+  }
+  return coil_dflow_has(&live->flow, COIL_DFLOW_IN, block, fact);
+}
+
+/**
+* @brief Check whether a variable is live at a block's exit
+*/
+int coil_live_out(const coil_live_t *live, coil_u32_t block, coil_u64_t var) {
+  coil_u32_t fact;
+  if (live == NULL || live->var_count == 0 || coil_live_index(live, var, &fact) != COIL_ERR_GOOD) {
+    return 0;
+  }
+  return coil_dflow_has(&live->flow, COIL_DFLOW_OUT, block, fact);
+}
+
+/**
+* @brief Release liveness
+*/
+void coil_live_cleanup(coil_live_t *live) {
+  if (live == NULL) {
+    return;
+  }
+  
+  coil_dflow_cleanup(&live->flow);
+  coil_free(live->vars);
+  memset(live, 0, sizeof(coil_live_t));
+}
@@ -3,10 +3,23 @@
 * @brief File management implementation for libcoil-dev
 */
 
+#define _GNU_SOURCE // copy_file_range
+
 #include <coil/base.h>
 #include "srcdeps.h"
 #include <fcntl.h>
 #include <unistd.h>
+#include <errno.h>
+#include <sys/stat.h>
+
+#ifdef __linux__
+#include <sys/sendfile.h>
+#endif
+
+/**
+* @brief Buffer size of the read/write fallback of coil_copy_range
+*/
+#define COIL_COPY_BUFFER_SIZE (64 * 1024)
 
 /**
 * @brief Close descriptor
@@ -78,4 +91,160 @@ coil_err_t coil_seek(coil_descriptor_t fd, long int pos, int whence) {
   }
   
   return COIL_ERR_GOOD;
-}
\ No newline at end of file
+}
+
+/**
+* @brief Give the kernel an access pattern hint for a range of a descriptor
+*/
+coil_err_t coil_fadvise(coil_descriptor_t fd, coil_u64_t offset, coil_size_t len, coil_advice_t advice) {
+  if (fd < 0) {
+    return COIL_ERROR(COIL_ERR_INVAL, "Invalid file descriptor");
+  }
+  
+  int native;
+  switch (advice) {
+    case COIL_ADVICE_NORMAL:     native = POSIX_FADV_NORMAL; break;
+    case COIL_ADVICE_SEQUENTIAL: native = POSIX_FADV_SEQUENTIAL; break;
+    case COIL_ADVICE_RANDOM:     native = POSIX_FADV_RANDOM; break;
+    case COIL_ADVICE_WILLNEED:   native = POSIX_FADV_WILLNEED; break;
+    case COIL_ADVICE_DONTNEED:   native = POSIX_FADV_DONTNEED; break;
+    default:
+      return COIL_ERROR(COIL_ERR_INVAL, "Unknown file advice");
+  }
+  
+  // posix_fadvise returns the error number directly instead of setting errno
+  if (posix_fadvise(fd, (off_t)offset, (off_t)len, native) != 0) {
+    return COIL_ERROR(COIL_ERR_IO, "Failed to apply file advice");
+  }
+  
+  return COIL_ERR_GOOD;
+}
+
+/**
+* @brief Check whether a kernel copy failed because the descriptors do not support it
+*/
+static int coil_copy_unsupported(int error) {
+  return error == ENOSYS || error == EXDEV || error == EINVAL || 
+         error == EOPNOTSUPP || error == EBADF || error == ETXTBSY;
+}
+
+/**
+* @brief Write a whole buffer at an offset, retrying short writes
+*/
+coil_err_t coil_write_at(coil_descriptor_t fd, coil_u64_t offset, const void *bytes, coil_size_t len) {
+  if (fd < 0 || (bytes == NULL && len > 0)) {
+    return COIL_ERROR(COIL_ERR_INVAL, "Invalid parameters");
+  }
+  
+  const coil_byte_t *ptr = (const coil_byte_t *)bytes;
+  while (len > 0) {
+    ssize_t written = pwrite(fd, ptr, len, (off_t)offset);
+    if (written <= 0) {
+      return COIL_ERROR(COIL_ERR_IO, "Failed to write to descriptor");
+    }
+    ptr += written;
+    offset += (coil_u64_t)written;
+    len -= (coil_size_t)written;
+  }
+  
+  return COIL_ERR_GOOD;
+}
+
+/**
+* @brief Copy a range between descriptors, at out_offset or at the output position when it is NULL
+*/
+static coil_err_t coil_copy_range_impl(coil_descriptor_t in, coil_u64_t offset, coil_descriptor_t out, 
+                                       off_t *out_offset, coil_size_t len) {
+  if (in < 0 || out < 0) {
+    return COIL_ERROR(COIL_ERR_INVAL, "Invalid file descriptor");
+  }
+  
+  // copy_file_range fails overlapping ranges of one file with EINVAL (not an unsupported
+  // filesystem) and the buffered copy would overwrite source bytes it has not read yet
+  struct stat in_st, out_st;
+  if (len > 0 && fstat(in, &in_st) == 0 && fstat(out, &out_st) == 0 &&
+      in_st.st_dev == out_st.st_dev && in_st.st_ino == out_st.st_ino) {
+    off_t dst = out_offset != NULL ? *out_offset : lseek(out, 0, SEEK_CUR);
+    if (dst == -1) {
+      return COIL_ERROR(COIL_ERR_IO, "Failed to get current file position");
+    }
+    if ((coil_u64_t)dst < offset + len && offset < (coil_u64_t)dst + len) {
+      return COIL_ERROR(COIL_ERR_BADSTATE, "Source and destination ranges overlap");
+    }
+  }
+  
+  off_t in_offset = (off_t)offset;
+  
+#ifdef __linux__
+  // Kernel side copy, filesystems with reflinks share the extents instead of copying
+  while (len > 0) {
+    ssize_t copied = copy_file_range(in, &in_offset, out, out_offset, len, 0);
+    if (copied <= 0) {
+      if (copied == 0 || !coil_copy_unsupported(errno)) {
+        return COIL_ERROR(COIL_ERR_IO, "Failed to copy file range");
+      }
+      break;
+    }
+    len -= (coil_size_t)copied;
+  }
+  
+  // Older kernels and cross-filesystem copies, still without a user space buffer
+  while (len > 0 && out_offset == NULL) {
+    ssize_t copied = sendfile(out, in, &in_offset, len);
+    if (copied <= 0) {
+      if (copied == 0 || !coil_copy_unsupported(errno)) {
+        return COIL_ERROR(COIL_ERR_IO, "Failed to send file range");
+      }
+      break;
+    }
+    len -= (coil_size_t)copied;
+  }
+#endif
+  
+  // Portable fallback
+  coil_byte_t buffer[COIL_COPY_BUFFER_SIZE];
+  while (len > 0) {
+    coil_size_t chunk = len < sizeof(buffer) ? len : sizeof(buffer);
+    ssize_t got = pread(in, buffer, chunk, in_offset);
+    if (got <= 0) {
+      return COIL_ERROR(COIL_ERR_IO, "Failed to read file range");
+    }
+    
+    if (out_offset != NULL) {
+      coil_err_t err = coil_write_at(out, (coil_u64_t)*out_offset, buffer, (coil_size_t)got);
+      if (err != COIL_ERR_GOOD) {
+        return err;
+      }
+      *out_offset += got;
+    } else {
+      for (ssize_t done = 0; done < got; ) {
+        ssize_t written = write(out, buffer + done, (coil_size_t)(got - done));
+        if (written <= 0) {
+          return COIL_ERROR(COIL_ERR_IO, "Failed to write file range");
+        }
+        done += written;
+      }
+    }
+    
+    in_offset += got;
+    len -= (coil_size_t)got;
+  }
+  
+  return COIL_ERR_GOOD;
+}
+
+/**
+* @brief Copy a range of one descriptor to the current position of another
+*/
+coil_err_t coil_copy_range(coil_descriptor_t in, coil_u64_t offset, coil_descriptor_t out, coil_size_t len) {
+  return coil_copy_range_impl(in, offset, out, NULL, len);
+}
+
+/**
+* @brief Copy a range of one descriptor to an offset in another
+*/
+coil_err_t coil_copy_range_at(coil_descriptor_t in, coil_u64_t offset, coil_descriptor_t out, 
+                              coil_u64_t out_offset, coil_size_t len) {
+  off_t position = (off_t)out_offset;
+  return coil_copy_range_impl(in, offset, out, &position, len);
+}
@@ -181,6 +181,12 @@ coil_size_t coil_instr_decode(coil_section_t *sect, coil_size_t pos, coil_instrm
     return 0;
   }
   
+  // Decoding reads the buffer directly, chunked sections must be flattened
+  if (coil_section_is_chunked(sect)) {
+    COIL_ERROR(COIL_ERR_BADSTATE, "Cannot decode from a chunked section");
+    return 0;
+  }
+  
   // Check if we have at least one byte for opcode
   if (pos >= sect->size) {
     COIL_ERROR(COIL_ERR_FORMAT, "No data available for opcode");
@@ -263,6 +269,12 @@ coil_size_t coil_operand_decode(coil_section_t *sect, coil_size_t pos, coil_oper
     return 0;
   }
   
+  // Decoding reads the buffer directly, chunked sections must be flattened
+  if (coil_section_is_chunked(sect)) {
+    COIL_ERROR(COIL_ERR_BADSTATE, "Cannot decode from a chunked section");
+    return 0;
+  }
+  
   // Check if we have enough data for the header
   if (pos + sizeof(coil_operand_header_t) > sect->size) {
     COIL_ERROR(COIL_ERR_FORMAT, "Operand header goes beyond section boundary");
@@ -358,6 +370,12 @@ coil_size_t coil_operand_decode_data(coil_section_t *sect, coil_size_t pos, void
     return 0;
   }
   
+  // Decoding reads the buffer directly, chunked sections must be flattened
+  if (coil_section_is_chunked(sect)) {
+    COIL_ERROR(COIL_ERR_BADSTATE, "Cannot decode from a chunked section");
+    return 0;
+  }
+  
   // Get the size of the value type
   coil_size_t type_size = coil_value_type_size(header->value_type);
   
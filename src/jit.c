@@ -0,0 +1,1255 @@
+/**
+* @file jit.c
+* @brief COIL CBC template JIT implementation for libcoil-dev
+*/
+
+#include <coil/base.h>
+#include <coil/jit.h>
+#include "srcdeps.h"
+#include <string.h>
+
+#if defined(__x86_64__)
+#define COIL_JIT_X86_64 1
+#else
+#define COIL_JIT_X86_64 0
+#endif
+
+/**
+* @brief Deepest CBC call nesting, CBC calls are native calls on the host stack
+*/
+#define COIL_JIT_MAX_CALLS 65536
+
+// -------------------------------- Validation -------------------------------- //
+
+/**
+* @brief Operand resolved against the symbol values
+*/
+typedef struct coil_jit_ref {
+  coil_u8_t form;              ///< COIL_CBC_FORM_*
+  coil_u8_t reg;               ///< Register (R, OR)
+  coil_u64_t value;            ///< Masked immediate (I), address (S, OS) or displacement (OR)
+} coil_jit_ref_t;
+
+/**
+* @brief Mask of an operand width up to 64 bits
+*/
+static inline coil_u64_t coil_jit_mask(coil_u8_t width) {
+  return width >= 8 ? ~(coil_u64_t)0 : ((coil_u64_t)1 << (width * 8)) - 1;
+}
+
+/**
+* @brief Sign extend a value of an operand width up to 64 bits
+*/
+static inline coil_u64_t coil_jit_sext(coil_u64_t value, coil_u8_t width) {
+  unsigned bits = (8u - width) * 8;
+  return bits == 0 ? value : (coil_u64_t)((coil_i64_t)(value << bits) >> bits);
+}
+
+/**
+* @brief Resolve the operands of a decoded instruction
+*/
+static coil_err_t coil_jit_resolve(coil_jit_ref_t refs[2], const coil_cbc_insn_t *insn,
+                                   const coil_u64_t *symvals, coil_u32_t symcount) {
+  for (int i = 0; i < 2; i++) {
+    const coil_cbc_operand_t *operand = &insn->operands[i];
+    coil_jit_ref_t *ref = &refs[i];
+    
+    ref->form = operand->form;
+    ref->reg = operand->reg;
+    ref->value = 0;
+    
+    switch (operand->form) {
+      case COIL_CBC_FORM_NONE:
+        break;
+      case COIL_CBC_FORM_I:
+        ref->value = operand->imm & coil_jit_mask(insn->info.width);
+        break;
+      case COIL_CBC_FORM_R:
+      case COIL_CBC_FORM_OR:
+        if (operand->reg >= COIL_CBC_REGISTERS) {
+          return COIL_ERROR(COIL_ERR_FORMAT, "Unknown CBC register");
+        }
+        ref->value = (coil_u64_t)(coil_i64_t)operand->disp;
+        break;
+      default:
+        if (operand->symbol >= symcount) {
+          return COIL_ERROR(COIL_ERR_FORMAT, "Unknown CBC symbol");
+        }
+        ref->value = symvals[operand->symbol] + (coil_u64_t)(coil_i64_t)operand->disp;
+        break;
+    }
+  }
+  
+  return COIL_ERR_GOOD;
+}
+
+/**
+* @brief Check that an instruction is inside the compiled subset
+*/
+static coil_err_t coil_jit_check(const coil_cbc_insn_t *insn, const coil_jit_ref_t refs[2],
+                                 const coil_u8_t *starts, coil_size_t size) {
+  const coil_cbc_info_t *info = &insn->info;
+  
+  if (info->width > 8) {
+    return COIL_ERROR(COIL_ERR_NOTSUP, "128-bit operations are not compiled");
+  }
+  
+  switch (info->operation) {
+    case COIL_CBC_JMP:
+    case COIL_CBC_BR:
+    case COIL_CBC_CALL:
+      if (refs[0].form != COIL_CBC_FORM_S) {
+        return COIL_ERROR(COIL_ERR_NOTSUP, "Dynamic branch targets are not compiled");
+      }
+      if (refs[0].value > size || !starts[refs[0].value]) {
+        return COIL_ERROR(COIL_ERR_FORMAT, "Branch target is not an instruction");
+      }
+      return COIL_ERR_GOOD;
+    case COIL_CBC_LEA:
+      if (refs[1].form == COIL_CBC_FORM_I || refs[1].form == COIL_CBC_FORM_R) {
+        return COIL_ERROR(COIL_ERR_FORMAT, "LEA needs a memory source");
+      }
+      return COIL_ERR_GOOD;
+    case COIL_CBC_NOT:
+      if (refs[0].form == COIL_CBC_FORM_I) {
+        return COIL_ERROR(COIL_ERR_FORMAT, "NOT needs a writable operand");
+      }
+      return COIL_ERR_GOOD;
+    case COIL_CBC_CVT:
+      if (refs[0].form != COIL_CBC_FORM_R) {
+        return COIL_ERROR(COIL_ERR_FORMAT, "CVT needs a register destination");
+      }
+      return COIL_ERR_GOOD;
+    case COIL_CBC_NOP:
+    case COIL_CBC_SCOPE:
+    case COIL_CBC_SCOPL:
+    case COIL_CBC_RET:
+    case COIL_CBC_CMP:
+    case COIL_CBC_TEST:
+    case COIL_CBC_MOV:
+    case COIL_CBC_PUSH:
+    case COIL_CBC_POP:
+    case COIL_CBC_PUSHFD:
+    case COIL_CBC_POPFD:
+    case COIL_CBC_ADD:
+    case COIL_CBC_SUB:
+    case COIL_CBC_MUL:
+    case COIL_CBC_AND:
+    case COIL_CBC_OR:
+    case COIL_CBC_XOR:
+    case COIL_CBC_SHL:
+    case COIL_CBC_SAL:
+    case COIL_CBC_SHR:
+    case COIL_CBC_SAR:
+    case COIL_CBC_INC:
+    case COIL_CBC_DEC:
+    case COIL_CBC_NEG:
+      return COIL_ERR_GOOD;
+    default:
+      return COIL_ERROR(COIL_ERR_NOTSUP, "CBC operation is not compiled");
+  }
+}
+
+/**
+* @brief Find the instruction boundaries of a program and check every instruction
+*
+* @param starts Zeroed array of size + 1 entries, set where instructions start (and at size)
+*/
+static coil_err_t coil_jit_scan(const coil_byte_t *code, coil_size_t size, const coil_u64_t *symvals,
+                                coil_u32_t symcount, coil_u8_t *starts) {
+  coil_cbc_insn_t insn;
+  coil_err_t err;
+  
+  for (coil_size_t offset = 0; offset < size; offset += insn.length) {
+    err = coil_cbc_decode(code, size, offset, &insn);
+    if (err != COIL_ERR_GOOD) {
+      return err;
+    }
+    starts[offset] = 1;
+  }
+  starts[size] = 1;
+  
+  coil_jit_ref_t refs[2];
+  for (coil_size_t offset = 0; offset < size; offset += insn.length) {
+    coil_cbc_decode(code, size, offset, &insn);
+    err = coil_jit_resolve(refs, &insn, symvals, symcount);
+    if (err == COIL_ERR_GOOD) {
+      err = coil_jit_check(&insn, refs, starts, size);
+    }
+    if (err != COIL_ERR_GOOD) {
+      return err;
+    }
+  }
+  
+  return COIL_ERR_GOOD;
+}
+
+// -------------------------------- Reference Evaluator -------------------------------- //
+
+/**
+* @brief Whether a branch is taken, by condition and flags
+*/
+static const coil_u8_t coil_jit_taken[COIL_INSTRFLAG_LTE + 1][4] = {
+  { 1, 1, 1, 1 },              // NONE
+  { 0, 1, 0, 1 },              // EQ
+  { 1, 0, 1, 0 },              // NEQ
+  { 1, 0, 0, 0 },              // GT
+  { 1, 1, 0, 1 },              // GTE
+  { 0, 0, 1, 1 },              // LT
+  { 0, 1, 1, 1 },              // LTE
+};
+
+/**
+* @brief Resolve the address of a memory operand, checking it against the memory
+*/
+static int coil_jit_eval_address(const coil_cbc_vm_t *vm, const coil_jit_ref_t *ref, coil_u8_t width, coil_u64_t *addr) {
+  coil_u64_t at = ref->form == COIL_CBC_FORM_OR ? vm->regs[ref->reg].lo + ref->value : ref->value;
+  if (at + width < at || at + width > vm->memory_size) {
+    return 0;
+  }
+  *addr = at;
+  return 1;
+}
+
+/**
+* @brief Read an operand, zero extended (or sign extended) from its width
+*/
+static int coil_jit_eval_load(const coil_cbc_vm_t *vm, const coil_jit_ref_t *ref, coil_u8_t width, int sign, coil_u64_t *out) {
+  coil_u64_t value = 0;
+  coil_u64_t addr;
+  
+  if (ref->form == COIL_CBC_FORM_I) {
+    value = ref->value;
+  } else if (ref->form == COIL_CBC_FORM_R) {
+    value = vm->regs[ref->reg].lo & coil_jit_mask(width);
+  } else if (coil_jit_eval_address(vm, ref, width, &addr)) {
+    const coil_byte_t *p = vm->memory + addr;
+    switch (width) {
+      case 1: { coil_u8_t v; memcpy(&v, p, 1); value = v; break; }
+      case 2: { coil_u16_t v; memcpy(&v, p, 2); value = v; break; }
+      case 4: { coil_u32_t v; memcpy(&v, p, 4); value = v; break; }
+      default: memcpy(&value, p, 8); break;
+    }
+  } else {
+    return 0;
+  }
+  
+  *out = sign ? coil_jit_sext(value, width) : value;
+  return 1;
+}
+
+/**
+* @brief Write an operand (register writes are zero extended)
+*/
+static int coil_jit_eval_store(coil_cbc_vm_t *vm, const coil_jit_ref_t *ref, coil_u8_t width, coil_u64_t value) {
+  if (ref->form == COIL_CBC_FORM_R) {
+    vm->regs[ref->reg].lo = value & coil_jit_mask(width);
+    vm->regs[ref->reg].hi = 0;
+    return 1;
+  }
+  
+  coil_u64_t addr;
+  if (!coil_jit_eval_address(vm, ref, width, &addr)) {
+    return 0;
+  }
+  coil_byte_t *p = vm->memory + addr;
+  switch (width) {
+    case 1: { coil_u8_t v = (coil_u8_t)value; memcpy(p, &v, 1); break; }
+    case 2: { coil_u16_t v = (coil_u16_t)value; memcpy(p, &v, 2); break; }
+    case 4: { coil_u32_t v = (coil_u32_t)value; memcpy(p, &v, 4); break; }
+    default: memcpy(p, &value, 8); break;
+  }
+  return 1;
+}
+
+/**
+* @brief Evaluate a CBC program the way the JIT would run it
+*/
+coil_err_t coil_jit_eval(coil_cbc_vm_t *vm, const coil_byte_t *code, coil_size_t size,
+                         const coil_u64_t *symvals, coil_u32_t symcount, coil_u64_t entry, coil_u64_t max_branches) {
+  if (vm == NULL || (code == NULL && size != 0) || (symvals == NULL && symcount != 0)) {
+    return COIL_ERROR(COIL_ERR_INVAL, "Invalid parameters");
+  }
+  
+  coil_u8_t *starts = (coil_u8_t *)coil_calloc(size + 1, 1);
+  if (starts == NULL) {
+    return COIL_ERROR(COIL_ERR_NOMEM, "Failed to allocate instruction map");
+  }
+  
+  coil_err_t err = coil_jit_scan(code, size, symvals, symcount, starts);
+  if (err == COIL_ERR_GOOD && (entry >= size || !starts[entry])) {
+    err = COIL_ERROR(COIL_ERR_INVAL, "Entry does not start an instruction");
+  }
+  coil_free(starts);
+  if (err != COIL_ERR_GOOD) {
+    return err;
+  }
+  
+  // Calls already active belong to the caller, the outermost RET of this run returns
+  coil_u32_t base = vm->csp;
+  coil_u64_t room = vm->call_depth > base ? vm->call_depth - base : 0;
+  coil_u64_t depth = base + (room < COIL_JIT_MAX_CALLS ? room : COIL_JIT_MAX_CALLS);
+  coil_u64_t fuel = max_branches != 0 ? max_branches : ~(coil_u64_t)0;
+  coil_u8_t flags = vm->flags & (COIL_CBC_FLAG_EQ | COIL_CBC_FLAG_LT);
+  coil_u64_t pc = entry;
+  coil_cbc_insn_t insn;
+  coil_jit_ref_t refs[2];
+  coil_u64_t x, y, r;
+  
+  for (;;) {
+    if (pc == size) {
+      break;
+    }
+    
+    coil_cbc_decode(code, size, pc, &insn);
+    coil_jit_resolve(refs, &insn, symvals, symcount);
+    
+    const coil_jit_ref_t *a = &refs[0], *b = &refs[1];
+    coil_u8_t width = insn.info.width;
+    coil_u8_t operation = insn.info.operation;
+    coil_u64_t next = pc + insn.length;
+    int ok = 1;
+    
+    switch (operation) {
+      case COIL_CBC_JMP:
+      case COIL_CBC_BR:
+        if (operation == COIL_CBC_BR && !coil_jit_taken[insn.cond][flags]) {
+          break;
+        }
+        if (fuel-- == 0) {
+          ok = 0;
+          break;
+        }
+        next = a->value;
+        break;
+      case COIL_CBC_CALL:
+        if (vm->csp >= depth) {
+          ok = 0;
+          break;
+        }
+        vm->calls[vm->csp++] = (coil_u32_t)next;
+        if (fuel-- == 0) {
+          ok = 0;
+          break;
+        }
+        next = a->value;
+        break;
+      case COIL_CBC_RET:
+        if (vm->csp == base) {
+          vm->flags = flags;
+          return COIL_ERR_GOOD;
+        }
+        next = vm->calls[--vm->csp];
+        break;
+      case COIL_CBC_CMP:
+      case COIL_CBC_TEST:
+        ok = coil_jit_eval_load(vm, a, width, 1, &x) && coil_jit_eval_load(vm, b, width, 1, &y);
+        if (ok && operation == COIL_CBC_CMP) {
+          flags = (coil_u8_t)((x == y ? COIL_CBC_FLAG_EQ : 0) | ((coil_i64_t)x < (coil_i64_t)y ? COIL_CBC_FLAG_LT : 0));
+        } else if (ok) {
+          r = x & y;
+          flags = (coil_u8_t)((r == 0 ? COIL_CBC_FLAG_EQ : 0) | ((coil_i64_t)r < 0 ? COIL_CBC_FLAG_LT : 0));
+        }
+        break;
+      case COIL_CBC_MOV:
+        ok = coil_jit_eval_load(vm, b, width, 0, &y) && coil_jit_eval_store(vm, a, width, y);
+        break;
+      case COIL_CBC_LEA:
+        y = b->form == COIL_CBC_FORM_OR ? vm->regs[b->reg].lo + b->value : b->value;
+        ok = coil_jit_eval_store(vm, a, width, y);
+        break;
+      case COIL_CBC_PUSH:
+      case COIL_CBC_PUSHFD:
+        if (operation == COIL_CBC_PUSH) {
+          ok = coil_jit_eval_load(vm, a, width, 0, &x);
+        } else {
+          x = flags;
+        }
+        if (!ok || vm->sp >= vm->stack_depth) {
+          ok = 0;
+          break;
+        }
+        vm->stack[vm->sp].lo = x;
+        vm->stack[vm->sp++].hi = 0;
+        break;
+      case COIL_CBC_POP:
+        ok = vm->sp != 0 && coil_jit_eval_store(vm, a, width, vm->stack[vm->sp - 1].lo);
+        if (ok) {
+          vm->sp--;
+        }
+        break;
+      case COIL_CBC_POPFD:
+        if (vm->sp == 0) {
+          ok = 0;
+          break;
+        }
+        flags = (coil_u8_t)(vm->stack[--vm->sp].lo & (COIL_CBC_FLAG_EQ | COIL_CBC_FLAG_LT));
+        break;
+      case COIL_CBC_ADD:
+      case COIL_CBC_SUB:
+      case COIL_CBC_MUL:
+      case COIL_CBC_AND:
+      case COIL_CBC_OR:
+      case COIL_CBC_XOR:
+      case COIL_CBC_SHL:
+      case COIL_CBC_SAL:
+      case COIL_CBC_SHR:
+      case COIL_CBC_SAR:
+        ok = coil_jit_eval_load(vm, a, width, operation == COIL_CBC_SAR, &x) && coil_jit_eval_load(vm, b, width, 0, &y);
+        if (!ok) {
+          break;
+        }
+        switch (operation) {
+          case COIL_CBC_ADD: r = x + y; break;
+          case COIL_CBC_SUB: r = x - y; break;
+          case COIL_CBC_MUL: r = x * y; break;
+          case COIL_CBC_AND: r = x & y; break;
+          case COIL_CBC_OR:  r = x | y; break;
+          case COIL_CBC_XOR: r = x ^ y; break;
+          case COIL_CBC_SHR: r = x >> (y & (width * 8u - 1)); break;
+          case COIL_CBC_SAR: r = (coil_u64_t)((coil_i64_t)x >> (y & (width * 8u - 1))); break;
+          default:           r = x << (y & (width * 8u - 1)); break;
+        }
+        ok = coil_jit_eval_store(vm, a, width, r);
+        break;
+      case COIL_CBC_INC:
+      case COIL_CBC_DEC:
+      case COIL_CBC_NEG:
+      case COIL_CBC_NOT:
+        ok = coil_jit_eval_load(vm, operation == COIL_CBC_NOT ? a : b, width, 0, &y);
+        if (!ok) {
+          break;
+        }
+        r = operation == COIL_CBC_INC ? y + 1 : operation == COIL_CBC_DEC ? y - 1
+          : operation == COIL_CBC_NEG ? (coil_u64_t)0 - y : ~y;
+        ok = coil_jit_eval_store(vm, a, width, r);
+        break;
+      case COIL_CBC_CVT:
+        ok = coil_jit_eval_load(vm, b, width, 1, &y);
+        if (ok) {
+          vm->regs[a->reg].lo = y;
+          vm->regs[a->reg].hi = (coil_i64_t)y < 0 ? ~(coil_u64_t)0 : 0;
+        }
+        break;
+      default:
+        // NOP, SCOPE, SCOPL
+        break;
+    }
+    
+    if (!ok) {
+      vm->fault = pc;
+      vm->flags = flags;
+      return COIL_ERROR(COIL_ERR_BADSTATE, "Evaluated CBC faulted");
+    }
+    pc = next;
+  }
+  
+  vm->fault = size;
+  vm->flags = flags;
+  return COIL_ERROR(COIL_ERR_BADSTATE, "Ran past the end of the code");
+}
+
+// -------------------------------- Code Generation -------------------------------- //
+
+/**
+* @brief State shared between coil_jit_run and the generated code
+*/
+typedef struct coil_jit_frame {
+  coil_cbc_value_t *regs;      ///< Register file (held in rbx)
+  coil_byte_t *memory;         ///< Memory base (held in r12)
+  coil_u64_t memory_size;      ///< Memory size (held in r13)
+  coil_cbc_value_t *stack;     ///< Value stack
+  coil_u64_t stack_depth;      ///< Value stack capacity
+  coil_u64_t sp;               ///< Value stack pointer
+  coil_u64_t call_depth;       ///< Call nesting limit
+  coil_u64_t csp;              ///< Call nesting (held in rbp)
+  coil_u64_t fuel;             ///< Remaining taken branches and calls
+  coil_u64_t flags;            ///< Comparison flags (held in r15)
+  coil_u64_t saved_rsp;        ///< Host stack pointer on entry
+  coil_u64_t fault;            ///< CBC offset of the faulting instruction
+} coil_jit_frame_t;
+
+#if COIL_JIT_X86_64
+
+/**
+* @brief x86-64 general purpose registers
+*/
+enum {
+  COIL_JIT_RAX, COIL_JIT_RCX, COIL_JIT_RDX, COIL_JIT_RBX, COIL_JIT_RSP, COIL_JIT_RBP, COIL_JIT_RSI, COIL_JIT_RDI,
+  COIL_JIT_R8, COIL_JIT_R9, COIL_JIT_R10, COIL_JIT_R11, COIL_JIT_R12, COIL_JIT_R13, COIL_JIT_R14, COIL_JIT_R15,
+};
+
+/**
+* @brief x86-64 condition codes
+*/
+enum {
+  COIL_JIT_CC_B = 0x2, COIL_JIT_CC_AE = 0x3, COIL_JIT_CC_E = 0x4, COIL_JIT_CC_NE = 0x5,
+  COIL_JIT_CC_A = 0x7, COIL_JIT_CC_S = 0x8, COIL_JIT_CC_L = 0xC,
+};
+
+/**
+* @brief What a rel32 field is patched to point at
+*/
+typedef enum coil_jit_fix_e {
+  COIL_JIT_FIX_TARGET,         ///< The translation of a CBC offset
+  COIL_JIT_FIX_FAULT,          ///< A stub recording a CBC offset as the fault
+  COIL_JIT_FIX_NATIVE,         ///< A native offset
+} coil_jit_fix_t;
+
+/**
+* @brief A rel32 field to patch once the code is laid out
+*/
+typedef struct coil_jit_fixup {
+  coil_u32_t at;               ///< Offset of the rel32 field
+  coil_u32_t kind;             ///< coil_jit_fix_t
+  coil_u64_t value;            ///< CBC or native offset
+} coil_jit_fixup_t;
+
+/**
+* @brief Memory operand [base + index + disp] (index < 0 for none)
+*/
+typedef struct coil_jit_addr {
+  coil_u8_t base;
+  coil_i8_t index;
+  coil_i32_t disp;
+} coil_jit_addr_t;
+
+/**
+* @brief Code buffer being generated
+*/
+typedef struct coil_jit_emit {
+  coil_byte_t *data;           ///< Machine code
+  coil_size_t size;            ///< Bytes of machine code
+  coil_size_t capacity;        ///< Capacity of data
+  coil_jit_fixup_t *fixups;    ///< Fields to patch
+  coil_size_t fixup_count;     ///< Number of fixups
+  coil_size_t fixup_capacity;  ///< Capacity of fixups
+  coil_u32_t fault_exit;       ///< Native offset of the fault exit
+  coil_u32_t good_exit;        ///< Native offset of the normal exit
+  int failed;                  ///< Set when an allocation failed
+} coil_jit_emit_t;
+
+#define COIL_JIT_FRAME(field) ((coil_jit_addr_t){ COIL_JIT_R14, -1, (coil_i32_t)offsetof(coil_jit_frame_t, field) })
+#define COIL_JIT_REG(reg, half) ((coil_jit_addr_t){ COIL_JIT_RBX, -1, (coil_i32_t)((reg) * 16 + (half) * 8) })
+
+/**
+* @brief Append bytes to the code
+*/
+static void coil_jit_put(coil_jit_emit_t *e, const void *bytes, coil_size_t count) {
+  if (e->size + count > e->capacity) {
+    coil_size_t capacity = e->capacity != 0 ? e->capacity * 2 : 4096;
+    while (capacity < e->size + count) {
+      capacity *= 2;
+    }
+    coil_byte_t *data = (coil_byte_t *)coil_realloc(e->data, capacity);
+    if (data == NULL) {
+      e->failed = 1;
+      return;
+    }
+    e->data = data;
+    e->capacity = capacity;
+  }
+  memcpy(e->data + e->size, bytes, count);
+  e->size += count;
+}
+
+static void coil_jit_u8(coil_jit_emit_t *e, coil_u8_t value) {
+  coil_jit_put(e, &value, 1);
+}
+
+static void coil_jit_u32(coil_jit_emit_t *e, coil_u32_t value) {
+  coil_jit_put(e, &value, 4);
+}
+
+/**
+* @brief Emit raw instruction bytes
+*/
+#define COIL_JIT_RAW(e, ...) do { \
+  static const coil_u8_t raw_[] = { __VA_ARGS__ }; \
+  coil_jit_put(e, raw_, sizeof(raw_)); \
+} while (0)
+
+/**
+* @brief Emit an instruction with a memory operand
+*
+* @param prefix Operand size prefix (0x66) or 0
+* @param wide Whether REX.W is set
+* @param reg Register or opcode extension of the ModRM reg field
+*/
+static void coil_jit_mem(coil_jit_emit_t *e, coil_u8_t prefix, int wide, const coil_u8_t *op, coil_size_t oplen,
+                         coil_u8_t reg, coil_jit_addr_t m) {
+  coil_u8_t rex = (coil_u8_t)(0x40 | (wide ? 8 : 0) | ((reg & 8) ? 4 : 0) | (m.index >= 0 && (m.index & 8) ? 2 : 0) | ((m.base & 8) ? 1 : 0));
+  if (prefix != 0) {
+    coil_jit_u8(e, prefix);
+  }
+  if (rex != 0x40) {
+    coil_jit_u8(e, rex);
+  }
+  coil_jit_put(e, op, oplen);
+  
+  coil_u8_t mod = m.disp == 0 && (m.base & 7) != 5 ? 0 : m.disp >= -128 && m.disp <= 127 ? 1 : 2;
+  if (m.index >= 0 || (m.base & 7) == 4) {
+    coil_jit_u8(e, (coil_u8_t)(mod << 6 | (reg & 7) << 3 | 4));
+    coil_jit_u8(e, (coil_u8_t)((m.index >= 0 ? m.index & 7 : 4) << 3 | (m.base & 7)));
+  } else {
+    coil_jit_u8(e, (coil_u8_t)(mod << 6 | (reg & 7) << 3 | (m.base & 7)));
+  }
+  if (mod == 1) {
+    coil_jit_u8(e, (coil_u8_t)(coil_i8_t)m.disp);
+  } else if (mod == 2) {
+    coil_jit_u32(e, (coil_u32_t)m.disp);
+  }
+}
+
+/**
+* @brief Emit an instruction with a register operand in the ModRM rm field
+*/
+static void coil_jit_rr(coil_jit_emit_t *e, coil_u8_t prefix, int wide, const coil_u8_t *op, coil_size_t oplen,
+                        coil_u8_t reg, coil_u8_t rm) {
+  coil_u8_t rex = (coil_u8_t)(0x40 | (wide ? 8 : 0) | ((reg & 8) ? 4 : 0) | ((rm & 8) ? 1 : 0));
+  if (prefix != 0) {
+    coil_jit_u8(e, prefix);
+  }
+  if (rex != 0x40) {
+    coil_jit_u8(e, rex);
+  }
+  coil_jit_put(e, op, oplen);
+  coil_jit_u8(e, (coil_u8_t)(0xC0 | (reg & 7) << 3 | (rm & 7)));
+}
+
+static const coil_u8_t coil_jit_op_mov_load[] = { 0x8B };
+static const coil_u8_t coil_jit_op_mov_store[] = { 0x89 };
+static const coil_u8_t coil_jit_op_mov_store8[] = { 0x88 };
+static const coil_u8_t coil_jit_op_movzx8[] = { 0x0F, 0xB6 };
+static const coil_u8_t coil_jit_op_movzx16[] = { 0x0F, 0xB7 };
+static const coil_u8_t coil_jit_op_movsx8[] = { 0x0F, 0xBE };
+static const coil_u8_t coil_jit_op_movsx16[] = { 0x0F, 0xBF };
+static const coil_u8_t coil_jit_op_movsxd[] = { 0x63 };
+static const coil_u8_t coil_jit_op_mov_imm[] = { 0xC7 };
+static const coil_u8_t coil_jit_op_lea[] = { 0x8D };
+static const coil_u8_t coil_jit_op_alu_imm[] = { 0x81 };
+static const coil_u8_t coil_jit_op_alu_imm8[] = { 0x83 };
+static const coil_u8_t coil_jit_op_cmp[] = { 0x39 };
+static const coil_u8_t coil_jit_op_cmp_load[] = { 0x3B };
+
+/**
+* @brief Load an operand of a width into a register, zero or sign extended to 64 bits
+*/
+static void coil_jit_load(coil_jit_emit_t *e, coil_u8_t reg, coil_jit_addr_t m, coil_u8_t width, int sign) {
+  switch (width) {
+    case 1: coil_jit_mem(e, 0, sign, sign ? coil_jit_op_movsx8 : coil_jit_op_movzx8, 2, reg, m); break;
+    case 2: coil_jit_mem(e, 0, sign, sign ? coil_jit_op_movsx16 : coil_jit_op_movzx16, 2, reg, m); break;
+    case 4: coil_jit_mem(e, 0, sign, sign ? coil_jit_op_movsxd : coil_jit_op_mov_load, 1, reg, m); break;
+    default: coil_jit_mem(e, 0, 1, coil_jit_op_mov_load, 1, reg, m); break;
+  }
+}
+
+/**
+* @brief Store the low bytes of a register (rax or rcx for byte stores)
+*/
+static void coil_jit_store(coil_jit_emit_t *e, coil_u8_t reg, coil_jit_addr_t m, coil_u8_t width) {
+  switch (width) {
+    case 1: coil_jit_mem(e, 0, 0, coil_jit_op_mov_store8, 1, reg, m); break;
+    case 2: coil_jit_mem(e, 0x66, 0, coil_jit_op_mov_store, 1, reg, m); break;
+    case 4: coil_jit_mem(e, 0, 0, coil_jit_op_mov_store, 1, reg, m); break;
+    default: coil_jit_mem(e, 0, 1, coil_jit_op_mov_store, 1, reg, m); break;
+  }
+}
+
+/**
+* @brief mov qword [m], imm32 (sign extended)
+*/
+static void coil_jit_store_imm(coil_jit_emit_t *e, coil_jit_addr_t m, coil_i32_t value) {
+  coil_jit_mem(e, 0, 1, coil_jit_op_mov_imm, 1, 0, m);
+  coil_jit_u32(e, (coil_u32_t)value);
+}
+
+/**
+* @brief mov reg, imm64 (in the shortest encoding)
+*/
+static void coil_jit_mov_imm(coil_jit_emit_t *e, coil_u8_t reg, coil_u64_t value) {
+  if (value <= 0xFFFFFFFFu) {
+    if (reg & 8) {
+      coil_jit_u8(e, 0x41);
+    }
+    coil_jit_u8(e, (coil_u8_t)(0xB8 + (reg & 7)));
+    coil_jit_u32(e, (coil_u32_t)value);
+  } else if ((coil_i64_t)value >= INT32_MIN && (coil_i64_t)value < 0) {
+    coil_jit_rr(e, 0, 1, coil_jit_op_mov_imm, 1, 0, reg);
+    coil_jit_u32(e, (coil_u32_t)value);
+  } else {
+    coil_jit_u8(e, (coil_u8_t)(0x48 | ((reg & 8) ? 1 : 0)));
+    coil_jit_u8(e, (coil_u8_t)(0xB8 + (reg & 7)));
+    coil_jit_put(e, &value, 8);
+  }
+}
+
+/**
+* @brief Record a rel32 field just emitted
+*/
+static void coil_jit_fixup(coil_jit_emit_t *e, coil_jit_fix_t kind, coil_u64_t value) {
+  if (e->fixup_count == e->fixup_capacity) {
+    coil_size_t capacity = e->fixup_capacity != 0 ? e->fixup_capacity * 2 : 256;
+    coil_jit_fixup_t *fixups = (coil_jit_fixup_t *)coil_realloc(e->fixups, capacity * sizeof(coil_jit_fixup_t));
+    if (fixups == NULL) {
+      e->failed = 1;
+      return;
+    }
+    e->fixups = fixups;
+    e->fixup_capacity = capacity;
+  }
+  coil_jit_fixup_t *fixup = &e->fixups[e->fixup_count++];
+  fixup->at = (coil_u32_t)(e->size - 4);
+  fixup->kind = kind;
+  fixup->value = value;
+}
+
+/**
+* @brief jcc rel32 to a patched destination
+*/
+static void coil_jit_jcc(coil_jit_emit_t *e, coil_u8_t cc, coil_jit_fix_t kind, coil_u64_t value) {
+  coil_jit_u8(e, 0x0F);
+  coil_jit_u8(e, (coil_u8_t)(0x80 | cc));
+  coil_jit_u32(e, 0);
+  coil_jit_fixup(e, kind, value);
+}
+
+/**
+* @brief jmp or call rel32 to a patched destination
+*/
+static void coil_jit_jump(coil_jit_emit_t *e, coil_u8_t op, coil_jit_fix_t kind, coil_u64_t value) {
+  coil_jit_u8(e, op);
+  coil_jit_u32(e, 0);
+  coil_jit_fixup(e, kind, value);
+}
+
+/**
+* @brief Charge a taken branch or call against the budget
+*/
+static void coil_jit_charge(coil_jit_emit_t *e, coil_u64_t offset) {
+  // sub qword [fuel], 1 ; jb fault
+  coil_jit_mem(e, 0, 1, coil_jit_op_alu_imm8, 1, 5, COIL_JIT_FRAME(fuel));
+  coil_jit_u8(e, 1);
+  coil_jit_jcc(e, COIL_JIT_CC_B, COIL_JIT_FIX_FAULT, offset);
+}
+
+/**
+* @brief Locate an operand, computing and checking memory addresses into a register
+*/
+static coil_jit_addr_t coil_jit_locate(coil_jit_emit_t *e, const coil_jit_ref_t *ref, coil_u8_t width,
+                                       coil_u8_t addr, coil_u64_t offset) {
+  coil_jit_addr_t loc = { COIL_JIT_R12, (coil_i8_t)addr, 0 };
+  
+  if (ref->form == COIL_CBC_FORM_R) {
+    return COIL_JIT_REG(ref->reg, 0);
+  }
+  if (ref->form != COIL_CBC_FORM_S && ref->form != COIL_CBC_FORM_OS && ref->form != COIL_CBC_FORM_OR) {
+    return loc;
+  }
+  
+  if (ref->form == COIL_CBC_FORM_OR) {
+    coil_jit_load(e, addr, COIL_JIT_REG(ref->reg, 0), 8, 0);
+    if (ref->value != 0) {
+      coil_jit_rr(e, 0, 1, coil_jit_op_alu_imm, 1, 0, addr);
+      coil_jit_u32(e, (coil_u32_t)ref->value);
+    }
+  } else {
+    coil_jit_mov_imm(e, addr, ref->value);
+  }
+  
+  // lea rdx, [addr + width] ; cmp rdx, addr ; jb fault ; cmp rdx, r13 ; ja fault
+  coil_jit_addr_t end = { addr, -1, width };
+  coil_jit_mem(e, 0, 1, coil_jit_op_lea, 1, COIL_JIT_RDX, end);
+  coil_jit_rr(e, 0, 1, coil_jit_op_cmp, 1, addr, COIL_JIT_RDX);
+  coil_jit_jcc(e, COIL_JIT_CC_B, COIL_JIT_FIX_FAULT, offset);
+  coil_jit_rr(e, 0, 1, coil_jit_op_cmp, 1, COIL_JIT_R13, COIL_JIT_RDX);
+  coil_jit_jcc(e, COIL_JIT_CC_A, COIL_JIT_FIX_FAULT, offset);
+  return loc;
+}
+
+/**
+* @brief Load a located operand (or an immediate) into a register
+*/
+static void coil_jit_fetch(coil_jit_emit_t *e, coil_u8_t reg, const coil_jit_ref_t *ref, coil_jit_addr_t loc,
+                           coil_u8_t width, int sign) {
+  if (ref->form == COIL_CBC_FORM_I) {
+    coil_jit_mov_imm(e, reg, sign ? coil_jit_sext(ref->value, width) : ref->value);
+  } else {
+    coil_jit_load(e, reg, loc, width, sign);
+  }
+}
+
+/**
+* @brief Write rax to a located operand (register writes are zero extended)
+*/
+static void coil_jit_writeback(coil_jit_emit_t *e, const coil_jit_ref_t *ref, coil_jit_addr_t loc, coil_u8_t width) {
+  if (ref->form != COIL_CBC_FORM_R) {
+    coil_jit_store(e, COIL_JIT_RAX, loc, width);
+    return;
+  }
+  
+  switch (width) {
+    case 1: coil_jit_rr(e, 0, 0, coil_jit_op_movzx8, 2, COIL_JIT_RAX, COIL_JIT_RAX); break;
+    case 2: coil_jit_rr(e, 0, 0, coil_jit_op_movzx16, 2, COIL_JIT_RAX, COIL_JIT_RAX); break;
+    case 4: coil_jit_rr(e, 0, 0, coil_jit_op_mov_store, 1, COIL_JIT_RAX, COIL_JIT_RAX); break;
+    default: break;
+  }
+  coil_jit_store(e, COIL_JIT_RAX, loc, 8);
+  coil_jit_store_imm(e, COIL_JIT_REG(ref->reg, 1), 0);
+}
+
+/**
+* @brief Push a register onto the value stack
+*/
+static void coil_jit_push(coil_jit_emit_t *e, coil_u8_t reg, coil_u64_t offset) {
+  coil_jit_addr_t slot = { COIL_JIT_R8, COIL_JIT_RDX, 0 };
+  coil_jit_addr_t high = { COIL_JIT_R8, COIL_JIT_RDX, 8 };
+  
+  // rdx = sp, overflow check, r8 = stack, rdx *= 16
+  coil_jit_load(e, COIL_JIT_RDX, COIL_JIT_FRAME(sp), 8, 0);
+  coil_jit_mem(e, 0, 1, coil_jit_op_cmp_load, 1, COIL_JIT_RDX, COIL_JIT_FRAME(stack_depth));
+  coil_jit_jcc(e, COIL_JIT_CC_AE, COIL_JIT_FIX_FAULT, offset);
+  coil_jit_load(e, COIL_JIT_R8, COIL_JIT_FRAME(stack), 8, 0);
+  COIL_JIT_RAW(e, 0x48, 0xC1, 0xE2, 0x04);
+  
+  coil_jit_store(e, reg, slot, 8);
+  coil_jit_store_imm(e, high, 0);
+  coil_jit_mem(e, 0, 1, coil_jit_op_alu_imm8, 1, 0, COIL_JIT_FRAME(sp));
+  coil_jit_u8(e, 1);
+}
+
+/**
+* @brief Load the top of the value stack into a register (the pop itself is coil_jit_drop)
+*/
+static void coil_jit_peek(coil_jit_emit_t *e, coil_u8_t reg, coil_u64_t offset) {
+  coil_jit_addr_t top = { COIL_JIT_R8, COIL_JIT_RDX, -16 };
+  
+  // rdx = sp, underflow check, r8 = stack, rdx *= 16
+  coil_jit_load(e, COIL_JIT_RDX, COIL_JIT_FRAME(sp), 8, 0);
+  COIL_JIT_RAW(e, 0x48, 0x85, 0xD2);
+  coil_jit_jcc(e, COIL_JIT_CC_E, COIL_JIT_FIX_FAULT, offset);
+  coil_jit_load(e, COIL_JIT_R8, COIL_JIT_FRAME(stack), 8, 0);
+  COIL_JIT_RAW(e, 0x48, 0xC1, 0xE2, 0x04);
+  coil_jit_load(e, reg, top, 8, 0);
+}
+
+/**
+* @brief Drop the top of the value stack
+*/
+static void coil_jit_drop(coil_jit_emit_t *e) {
+  coil_jit_mem(e, 0, 1, coil_jit_op_alu_imm8, 1, 5, COIL_JIT_FRAME(sp));
+  coil_jit_u8(e, 1);
+}
+
+/**
+* @brief Translate one instruction
+*/
+static void coil_jit_translate(coil_jit_emit_t *e, const coil_cbc_insn_t *insn, const coil_jit_ref_t refs[2], coil_u64_t offset) {
+  const coil_jit_ref_t *a = &refs[0], *b = &refs[1];
+  coil_u8_t width = insn->info.width;
+  coil_u8_t operation = insn->info.operation;
+  coil_jit_addr_t la, lb;
+  
+  switch (operation) {
+    case COIL_CBC_JMP:
+      coil_jit_charge(e, offset);
+      coil_jit_jump(e, 0xE9, COIL_JIT_FIX_TARGET, a->value);
+      break;
+    case COIL_CBC_BR: {
+      if (insn->cond == COIL_INSTRFLAG_NONE) {
+        coil_jit_charge(e, offset);
+        coil_jit_jump(e, 0xE9, COIL_JIT_FIX_TARGET, a->value);
+        break;
+      }
+      
+      // Test the flags in r15b and skip the branch when it is not taken
+      coil_u8_t skip;
+      switch (insn->cond) {
+        case COIL_INSTRFLAG_EQ:  COIL_JIT_RAW(e, 0x41, 0xF6, 0xC7, 0x01); skip = COIL_JIT_CC_E; break;
+        case COIL_INSTRFLAG_NEQ: COIL_JIT_RAW(e, 0x41, 0xF6, 0xC7, 0x01); skip = COIL_JIT_CC_NE; break;
+        case COIL_INSTRFLAG_GT:  COIL_JIT_RAW(e, 0x41, 0xF6, 0xC7, 0x03); skip = COIL_JIT_CC_NE; break;
+        case COIL_INSTRFLAG_GTE: COIL_JIT_RAW(e, 0x41, 0x80, 0xFF, 0x02); skip = COIL_JIT_CC_E; break;
+        case COIL_INSTRFLAG_LT:  COIL_JIT_RAW(e, 0x41, 0xF6, 0xC7, 0x02); skip = COIL_JIT_CC_E; break;
+        default:                 COIL_JIT_RAW(e, 0x41, 0xF6, 0xC7, 0x03); skip = COIL_JIT_CC_E; break;
+      }
+      coil_jit_u8(e, 0x0F);
+      coil_jit_u8(e, (coil_u8_t)(0x80 | skip));
+      coil_jit_u32(e, 0);
+      coil_size_t at = e->size;
+      coil_jit_charge(e, offset);
+      coil_jit_jump(e, 0xE9, COIL_JIT_FIX_TARGET, a->value);
+      if (!e->failed) {
+        coil_u32_t rel = (coil_u32_t)(e->size - at);
+        memcpy(e->data + at - 4, &rel, 4);
+      }
+      break;
+    }
+    case COIL_CBC_CALL:
+      // cmp rbp, [call_depth] ; jae fault ; inc rbp ; charge ; call target
+      coil_jit_mem(e, 0, 1, coil_jit_op_cmp_load, 1, COIL_JIT_RBP, COIL_JIT_FRAME(call_depth));
+      coil_jit_jcc(e, COIL_JIT_CC_AE, COIL_JIT_FIX_FAULT, offset);
+      COIL_JIT_RAW(e, 0x48, 0xFF, 0xC5);
+      coil_jit_charge(e, offset);
+      coil_jit_jump(e, 0xE8, COIL_JIT_FIX_TARGET, a->value);
+      break;
+    case COIL_CBC_RET:
+      // test rbp, rbp ; jz exit ; dec rbp ; ret
+      COIL_JIT_RAW(e, 0x48, 0x85, 0xED);
+      coil_jit_jcc(e, COIL_JIT_CC_E, COIL_JIT_FIX_NATIVE, e->good_exit);
+      COIL_JIT_RAW(e, 0x48, 0xFF, 0xCD, 0xC3);
+      break;
+    case COIL_CBC_CMP:
+    case COIL_CBC_TEST: {
+      la = coil_jit_locate(e, a, width, COIL_JIT_RSI, offset);
+      lb = coil_jit_locate(e, b, width, COIL_JIT_RDI, offset);
+      coil_jit_fetch(e, COIL_JIT_RAX, a, la, width, 0);
+      coil_jit_fetch(e, COIL_JIT_RCX, b, lb, width, 0);
+      
+      // cmp/test at the width, then r15b = EQ | LT
+      static const coil_u8_t cmp8[] = { 0x38 }, test8[] = { 0x84 }, test[] = { 0x85 };
+      const coil_u8_t *op = operation == COIL_CBC_CMP ? (width == 1 ? cmp8 : coil_jit_op_cmp) : (width == 1 ? test8 : test);
+      coil_jit_rr(e, width == 2 ? 0x66 : 0, width == 8, op, 1, COIL_JIT_RCX, COIL_JIT_RAX);
+      COIL_JIT_RAW(e, 0x41, 0x0F, 0x94, 0xC7);
+      if (operation == COIL_CBC_CMP) {
+        COIL_JIT_RAW(e, 0x0F, 0x9C, 0xC0);
+      } else {
+        COIL_JIT_RAW(e, 0x0F, 0x98, 0xC0);
+      }
+      COIL_JIT_RAW(e, 0x00, 0xC0, 0x41, 0x08, 0xC7);
+      break;
+    }
+    case COIL_CBC_MOV:
+      la = coil_jit_locate(e, a, width, COIL_JIT_RSI, offset);
+      lb = coil_jit_locate(e, b, width, COIL_JIT_RDI, offset);
+      coil_jit_fetch(e, COIL_JIT_RAX, b, lb, width, 0);
+      coil_jit_writeback(e, a, la, width);
+      break;
+    case COIL_CBC_LEA:
+      if (b->form == COIL_CBC_FORM_OR) {
+        coil_jit_load(e, COIL_JIT_RAX, COIL_JIT_REG(b->reg, 0), 8, 0);
+        if (b->value != 0) {
+          coil_jit_rr(e, 0, 1, coil_jit_op_alu_imm, 1, 0, COIL_JIT_RAX);
+          coil_jit_u32(e, (coil_u32_t)b->value);
+        }
+      } else {
+        coil_jit_mov_imm(e, COIL_JIT_RAX, b->value);
+      }
+      la = coil_jit_locate(e, a, width, COIL_JIT_RSI, offset);
+      coil_jit_writeback(e, a, la, width);
+      break;
+    case COIL_CBC_PUSH:
+      la = coil_jit_locate(e, a, width, COIL_JIT_RSI, offset);
+      coil_jit_fetch(e, COIL_JIT_RAX, a, la, width, 0);
+      coil_jit_push(e, COIL_JIT_RAX, offset);
+      break;
+    case COIL_CBC_PUSHFD:
+      coil_jit_push(e, COIL_JIT_R15, offset);
+      break;
+    case COIL_CBC_POP:
+      coil_jit_peek(e, COIL_JIT_RAX, offset);
+      la = coil_jit_locate(e, a, width, COIL_JIT_RSI, offset);
+      coil_jit_writeback(e, a, la, width);
+      coil_jit_drop(e);
+      break;
+    case COIL_CBC_POPFD:
+      // and r15d, EQ | LT
+      coil_jit_peek(e, COIL_JIT_R15, offset);
+      COIL_JIT_RAW(e, 0x41, 0x83, 0xE7, COIL_CBC_FLAG_EQ | COIL_CBC_FLAG_LT);
+      coil_jit_drop(e);
+      break;
+    case COIL_CBC_ADD:
+    case COIL_CBC_SUB:
+    case COIL_CBC_MUL:
+    case COIL_CBC_AND:
+    case COIL_CBC_OR:
+    case COIL_CBC_XOR:
+    case COIL_CBC_SHL:
+    case COIL_CBC_SAL:
+    case COIL_CBC_SHR:
+    case COIL_CBC_SAR: {
+      la = coil_jit_locate(e, a, width, COIL_JIT_RSI, offset);
+      lb = coil_jit_locate(e, b, width, COIL_JIT_RDI, offset);
+      coil_jit_fetch(e, COIL_JIT_RAX, a, la, width, operation == COIL_CBC_SAR);
+      coil_jit_fetch(e, COIL_JIT_RCX, b, lb, width, 0);
+      
+      // 64-bit arithmetic on rax and rcx, the writeback truncates to the width
+      static const coil_u8_t add[] = { 0x01 }, sub[] = { 0x29 }, and_[] = { 0x21 }, or_[] = { 0x09 }, xor_[] = { 0x31 };
+      static const coil_u8_t imul[] = { 0x0F, 0xAF }, shift[] = { 0xD3 };
+      switch (operation) {
+        case COIL_CBC_ADD: coil_jit_rr(e, 0, 1, add, 1, COIL_JIT_RCX, COIL_JIT_RAX); break;
+        case COIL_CBC_SUB: coil_jit_rr(e, 0, 1, sub, 1, COIL_JIT_RCX, COIL_JIT_RAX); break;
+        case COIL_CBC_MUL: coil_jit_rr(e, 0, 1, imul, 2, COIL_JIT_RAX, COIL_JIT_RCX); break;
+        case COIL_CBC_AND: coil_jit_rr(e, 0, 1, and_, 1, COIL_JIT_RCX, COIL_JIT_RAX); break;
+        case COIL_CBC_OR:  coil_jit_rr(e, 0, 1, or_, 1, COIL_JIT_RCX, COIL_JIT_RAX); break;
+        case COIL_CBC_XOR: coil_jit_rr(e, 0, 1, xor_, 1, COIL_JIT_RCX, COIL_JIT_RAX); break;
+        default:
+          // and ecx, width * 8 - 1 ; shl/shr/sar rax, cl
+          coil_jit_rr(e, 0, 0, coil_jit_op_alu_imm8, 1, 4, COIL_JIT_RCX);
+          coil_jit_u8(e, (coil_u8_t)(width * 8 - 1));
+          coil_jit_rr(e, 0, 1, shift, 1, operation == COIL_CBC_SHR ? 5 : operation == COIL_CBC_SAR ? 7 : 4, COIL_JIT_RAX);
+          break;
+      }
+      coil_jit_writeback(e, a, la, width);
+      break;
+    }
+    case COIL_CBC_INC:
+    case COIL_CBC_DEC:
+    case COIL_CBC_NEG:
+    case COIL_CBC_NOT: {
+      const coil_jit_ref_t *src = operation == COIL_CBC_NOT ? a : b;
+      la = coil_jit_locate(e, a, width, COIL_JIT_RSI, offset);
+      lb = operation == COIL_CBC_NOT ? la : coil_jit_locate(e, b, width, COIL_JIT_RDI, offset);
+      coil_jit_fetch(e, COIL_JIT_RAX, src, lb, width, 0);
+      switch (operation) {
+        case COIL_CBC_INC: COIL_JIT_RAW(e, 0x48, 0x83, 0xC0, 0x01); break;
+        case COIL_CBC_DEC: COIL_JIT_RAW(e, 0x48, 0x83, 0xE8, 0x01); break;
+        case COIL_CBC_NEG: COIL_JIT_RAW(e, 0x48, 0xF7, 0xD8); break;
+        default:           COIL_JIT_RAW(e, 0x48, 0xF7, 0xD0); break;
+      }
+      coil_jit_writeback(e, a, la, width);
+      break;
+    }
+    case COIL_CBC_CVT:
+      // rax = sext(b) ; low half = rax ; high half = rax >> 63 (arithmetic)
+      lb = coil_jit_locate(e, b, width, COIL_JIT_RDI, offset);
+      coil_jit_fetch(e, COIL_JIT_RAX, b, lb, width, 1);
+      coil_jit_store(e, COIL_JIT_RAX, COIL_JIT_REG(a->reg, 0), 8);
+      COIL_JIT_RAW(e, 0x48, 0x89, 0xC2, 0x48, 0xC1, 0xFA, 0x3F);
+      coil_jit_store(e, COIL_JIT_RDX, COIL_JIT_REG(a->reg, 1), 8);
+      break;
+    default:
+      // NOP, SCOPE, SCOPL
+      break;
+  }
+}
+
+/**
+* @brief Emit the entry stub and the shared exits
+*
+* The entry stub is called as int (*)(coil_jit_frame_t *frame, const void *start)
+* and returns the status left in eax by an exit.
+*/
+static void coil_jit_prologue(coil_jit_emit_t *e) {
+  // Save the callee-saved registers and the host stack pointer
+  COIL_JIT_RAW(e, 0x53, 0x55, 0x41, 0x54, 0x41, 0x55, 0x41, 0x56, 0x41, 0x57);
+  COIL_JIT_RAW(e, 0x49, 0x89, 0xFE);
+  coil_jit_store(e, COIL_JIT_RSP, COIL_JIT_FRAME(saved_rsp), 8);
+  
+  // Pin the interpreter state in registers and enter the code
+  coil_jit_load(e, COIL_JIT_RBX, COIL_JIT_FRAME(regs), 8, 0);
+  coil_jit_load(e, COIL_JIT_R12, COIL_JIT_FRAME(memory), 8, 0);
+  coil_jit_load(e, COIL_JIT_R13, COIL_JIT_FRAME(memory_size), 8, 0);
+  coil_jit_load(e, COIL_JIT_R15, COIL_JIT_FRAME(flags), 8, 0);
+  coil_jit_load(e, COIL_JIT_RBP, COIL_JIT_FRAME(csp), 8, 0);
+  COIL_JIT_RAW(e, 0xFF, 0xE6);
+  
+  // Faults land here after recording the offset, the outermost RET one instruction later
+  e->fault_exit = (coil_u32_t)e->size;
+  coil_jit_u8(e, 0xB8);
+  coil_jit_u32(e, (coil_u32_t)COIL_ERR_BADSTATE);
+  COIL_JIT_RAW(e, 0xEB, 0x05);
+  e->good_exit = (coil_u32_t)e->size;
+  coil_jit_u8(e, 0xB8);
+  coil_jit_u32(e, (coil_u32_t)COIL_ERR_GOOD);
+  
+  // Unwind CBC calls still on the host stack and hand the state back
+  coil_jit_load(e, COIL_JIT_RSP, COIL_JIT_FRAME(saved_rsp), 8, 0);
+  coil_jit_store(e, COIL_JIT_R15, COIL_JIT_FRAME(flags), 8);
+  coil_jit_store(e, COIL_JIT_RBP, COIL_JIT_FRAME(csp), 8);
+  COIL_JIT_RAW(e, 0x41, 0x5F, 0x41, 0x5E, 0x41, 0x5D, 0x41, 0x5C, 0x5D, 0x5B, 0xC3);
+}
+
+/**
+* @brief Emit a stub that records a fault offset and leaves through the fault exit
+*/
+static void coil_jit_fault_stub(coil_jit_emit_t *e, coil_u64_t offset) {
+  coil_jit_store_imm(e, COIL_JIT_FRAME(fault), (coil_i32_t)offset);
+  coil_jit_u8(e, 0xE9);
+  coil_jit_u32(e, (coil_u32_t)((coil_i64_t)e->fault_exit - (coil_i64_t)(e->size + 4)));
+}
+
+/**
+* @brief Lay out the fault stubs and patch every rel32 field
+*/
+static void coil_jit_link(coil_jit_emit_t *e, const coil_u32_t *native_of) {
+  coil_u32_t stub = 0;
+  coil_u64_t stub_offset = ~(coil_u64_t)0;
+  
+  for (coil_size_t i = 0; i < e->fixup_count && !e->failed; i++) {
+    coil_jit_fixup_t *fixup = &e->fixups[i];
+    coil_u32_t dest;
+    
+    switch (fixup->kind) {
+      case COIL_JIT_FIX_TARGET:
+        dest = native_of[fixup->value];
+        break;
+      case COIL_JIT_FIX_FAULT:
+        // Sites of the same instruction are consecutive and share a stub
+        if (fixup->value != stub_offset) {
+          stub = (coil_u32_t)e->size;
+          stub_offset = fixup->value;
+          coil_jit_fault_stub(e, fixup->value);
+        }
+        dest = stub;
+        break;
+      default:
+        dest = (coil_u32_t)fixup->value;
+        break;
+    }
+    
+    if (!e->failed) {
+      coil_u32_t rel = (coil_u32_t)((coil_i64_t)dest - (coil_i64_t)(fixup->at + 4));
+      memcpy(e->data + fixup->at, &rel, 4);
+    }
+  }
+}
+
+#endif // COIL_JIT_X86_64
+
+// -------------------------------- Compiled Programs -------------------------------- //
+
+/**
+* @brief Translate a CBC program to x86-64 machine code
+*/
+coil_err_t coil_jit_compile(coil_jit_t *jit, const coil_byte_t *code, coil_size_t size,
+                            const coil_u64_t *symvals, coil_u32_t symcount) {
+  if (jit == NULL || (code == NULL && size != 0) || (symvals == NULL && symcount != 0)) {
+    return COIL_ERROR(COIL_ERR_INVAL, "Invalid parameters");
+  }
+  
+  memset(jit, 0, sizeof(coil_jit_t));
+  
+#if COIL_JIT_X86_64
+  // Fault offsets are stored as sign-extended 32-bit immediates
+  if (size > 0x7FFFFFFF) {
+    return COIL_ERROR(COIL_ERR_NOTSUP, "CBC code is too large to compile");
+  }
+  
+  coil_u8_t *starts = (coil_u8_t *)coil_calloc(size + 1, 1);
+  if (starts == NULL) {
+    return COIL_ERROR(COIL_ERR_NOMEM, "Failed to allocate instruction map");
+  }
+  coil_err_t err = coil_jit_scan(code, size, symvals, symcount, starts);
+  coil_free(starts);
+  if (err != COIL_ERR_GOOD) {
+    return err;
+  }
+  
+  jit->native_of = (coil_u32_t *)coil_malloc((size + 1) * sizeof(coil_u32_t));
+  if (jit->native_of == NULL) {
+    return COIL_ERROR(COIL_ERR_NOMEM, "Failed to allocate offset map");
+  }
+  memset(jit->native_of, 0xFF, (size + 1) * sizeof(coil_u32_t));
+  jit->cbc_size = size;
+  
+  coil_jit_emit_t e;
+  memset(&e, 0, sizeof(coil_jit_emit_t));
+  coil_jit_prologue(&e);
+  
+  coil_cbc_insn_t insn;
+  coil_jit_ref_t refs[2];
+  for (coil_size_t offset = 0; offset < size && !e.failed; offset += insn.length) {
+    coil_cbc_decode(code, size, offset, &insn);
+    coil_jit_resolve(refs, &insn, symvals, symcount);
+    jit->native_of[offset] = (coil_u32_t)e.size;
+    coil_jit_translate(&e, &insn, refs, offset);
+  }
+  
+  // Running past the last instruction faults at the code size
+  jit->native_of[size] = (coil_u32_t)e.size;
+  coil_jit_fault_stub(&e, size);
+  coil_jit_link(&e, jit->native_of);
+  coil_free(e.fixups);
+  
+  if (e.failed) {
+    coil_free(e.data);
+    coil_jit_cleanup(jit);
+    return COIL_ERROR(COIL_ERR_NOMEM, "Failed to grow code buffer");
+  }
+  
+  // Write through a private mapping, then flip it to read and execute
+  coil_size_t page = coil_get_page_size();
+  coil_size_t length = (e.size + page - 1) & ~(page - 1);
+  void *base = mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (base == MAP_FAILED) {
+    coil_free(e.data);
+    coil_jit_cleanup(jit);
+    return COIL_ERROR(COIL_ERR_NOMEM, "Failed to map code");
+  }
+  memcpy(base, e.data, e.size);
+  coil_free(e.data);
+  
+  __builtin___clear_cache((char *)base, (char *)base + e.size);
+  if (mprotect(base, length, PROT_READ | PROT_EXEC) != 0) {
+    coil_munmap(base, length);
+    coil_jit_cleanup(jit);
+    return COIL_ERROR(COIL_ERR_IO, "Failed to make code executable");
+  }
+  
+  jit->code = (coil_byte_t *)base;
+  jit->map_size = length;
+  jit->code_size = e.size;
+  return COIL_ERR_GOOD;
+#else
+  return COIL_ERROR(COIL_ERR_NOTSUP, "The CBC JIT needs an x86-64 host");
+#endif
+}
+
+/**
+* @brief Run a compiled program until the outermost RET
+*/
+coil_err_t coil_jit_run(const coil_jit_t *jit, coil_cbc_vm_t *vm, coil_u64_t entry, coil_u64_t max_branches) {
+  if (jit == NULL || jit->code == NULL || vm == NULL) {
+    return COIL_ERROR(COIL_ERR_INVAL, "Invalid parameters");
+  }
+  
+  if (entry >= jit->cbc_size || jit->native_of[entry] == COIL_JIT_NO_CODE) {
+    return COIL_ERROR(COIL_ERR_INVAL, "Entry does not start an instruction");
+  }
+  
+  coil_jit_frame_t frame;
+  frame.regs = vm->regs;
+  frame.memory = vm->memory;
+  frame.memory_size = vm->memory_size;
+  frame.stack = vm->stack;
+  frame.stack_depth = vm->stack_depth;
+  frame.sp = vm->sp;
+  // CBC calls are native calls, so the run starts at nesting zero on top of the active calls
+  coil_u64_t room = vm->call_depth > vm->csp ? vm->call_depth - vm->csp : 0;
+  frame.call_depth = room < COIL_JIT_MAX_CALLS ? room : COIL_JIT_MAX_CALLS;
+  frame.csp = 0;
+  frame.fuel = max_branches != 0 ? max_branches : ~(coil_u64_t)0;
+  frame.flags = vm->flags & (COIL_CBC_FLAG_EQ | COIL_CBC_FLAG_LT);
+  frame.saved_rsp = 0;
+  frame.fault = 0;
+  
+  // Object to function pointer conversions are not ISO C, copy the address instead
+  int (*enter)(coil_jit_frame_t *, const void *);
+  const coil_byte_t *stub = jit->code;
+  memcpy(&enter, &stub, sizeof(enter));
+  int status = enter(&frame, jit->code + jit->native_of[entry]);
+  
+  vm->sp = frame.sp;
+  vm->csp += (coil_u32_t)frame.csp;
+  vm->flags = (coil_u8_t)frame.flags;
+  if (status != COIL_ERR_GOOD) {
+    vm->fault = frame.fault;
+    return COIL_ERROR((coil_err_t)status, "Compiled CBC faulted");
+  }
+  return COIL_ERR_GOOD;
+}
+
+/**
+* @brief Release a compiled program
+*/
+void coil_jit_cleanup(coil_jit_t *jit) {
+  if (jit == NULL) {
+    return;
+  }
+  
+  if (jit->code != NULL) {
+    coil_munmap(jit->code, jit->map_size);
+  }
+  coil_free(jit->native_of);
+  memset(jit, 0, sizeof(coil_jit_t));
+}
@@ -0,0 +1,678 @@
+/**
+* @file lower.c
+* @brief Lowering of COIL instructions to CBC for libcoil-dev
+*/
+
+#include <coil/base.h>
+#include <coil/lower.h>
+#include <coil/instr.h>
+#include <coil/par.h>
+#include "srcdeps.h"
+#include <stdlib.h>
+#include <string.h>
+
+/**
+* @brief Decoded COIL operand with its CBC form
+*/
+typedef struct coil_lower_operand {
+  coil_cbc_operand_t cbc;      ///< CBC operand
+  coil_u8_t width;             ///< Width of the value type (0 if it is not an integer type)
+  coil_u8_t is_signed;         ///< Value type is signed
+} coil_lower_operand_t;
+
+/**
+* @brief Lowering of one function
+*/
+typedef struct coil_lower_job {
+  coil_section_t code;         ///< CBC of the function
+  coil_size_t base;            ///< Offset of the function's CBC in the output section
+  coil_err_t err;              ///< Result
+  coil_u64_t fault;            ///< Instruction being lowered when err was set
+} coil_lower_job_t;
+
+/**
+* @brief Function ordering entry (largest first)
+*/
+typedef struct coil_lower_rank {
+  coil_u64_t size;             ///< Size of the function
+  coil_u32_t index;            ///< Index of the function
+} coil_lower_rank_t;
+
+/**
+* @brief Shared lowering state
+*/
+typedef struct coil_lower_ctx {
+  coil_section_t *ir;                  ///< COIL instructions
+  const coil_lower_options_t *options; ///< Options
+  const coil_lower_func_t *funcs;      ///< Functions
+  const coil_lower_rank_t *ranks;      ///< Order the functions are handed out in
+  coil_lower_job_t *jobs;              ///< Per-function results
+  coil_u32_t *cbc_of;                  ///< CBC offsets (function-relative until placed)
+  coil_byte_t *out;                    ///< Output buffer to place the code in (NULL for chunked output)
+} coil_lower_ctx_t;
+
+// -------------------------------- Operands -------------------------------- //
+
+/**
+* @brief Width in bytes of an integer value type
+*/
+static coil_u8_t coil_lower_width(coil_u8_t value_type, coil_u8_t *is_signed) {
+  *is_signed = 0;
+  
+  switch (value_type) {
+    case COIL_VAL_I8:
+      *is_signed = 1;
+      return 1;
+    case COIL_VAL_U8:
+    case COIL_VAL_BIT:
+      return 1;
+    case COIL_VAL_I16:
+      *is_signed = 1;
+      return 2;
+    case COIL_VAL_U16:
+      return 2;
+    case COIL_VAL_I32:
+      *is_signed = 1;
+      return 4;
+    case COIL_VAL_U32:
+      return 4;
+    case COIL_VAL_I64:
+    case COIL_VAL_SSIZE:
+      *is_signed = 1;
+      return 8;
+    case COIL_VAL_U64:
+    case COIL_VAL_PTR:
+    case COIL_VAL_SIZE:
+      return 8;
+    case COIL_VAL_I128:
+      *is_signed = 1;
+      return 16;
+    case COIL_VAL_U128:
+      return 16;
+    default:
+      return 0;
+  }
+}
+
+/**
+* @brief Read a host order unsigned integer of up to 8 bytes
+*/
+static coil_u64_t coil_lower_uint(const coil_byte_t *data, coil_size_t size) {
+  switch (size) {
+    case 1: { coil_u8_t v; memcpy(&v, data, 1); return v; }
+    case 2: { coil_u16_t v; memcpy(&v, data, 2); return v; }
+    case 4: { coil_u32_t v; memcpy(&v, data, 4); return v; }
+    default: { coil_u64_t v; memcpy(&v, data, 8); return v; }
+  }
+}
+
+/**
+* @brief Check that an operand names a CBC register or memory location
+*/
+static int coil_lower_is_place(const coil_cbc_operand_t *operand) {
+  switch (operand->form) {
+    case COIL_CBC_FORM_S:
+    case COIL_CBC_FORM_OS:
+      return 1;
+    case COIL_CBC_FORM_R:
+    case COIL_CBC_FORM_OR:
+      return operand->reg < COIL_CBC_REGISTERS;
+    default:
+      return 0;
+  }
+}
+
+/**
+* @brief Decode an operand and select its CBC form
+*/
+static coil_err_t coil_lower_operand(const coil_lower_ctx_t *ctx, coil_u64_t *pos, coil_u64_t end,
+                                     coil_lower_operand_t *operand) {
+  coil_operand_header_t header;
+  coil_offset_t offset;
+  coil_size_t next = coil_operand_decode(ctx->ir, *pos, &header, &offset);
+  if (next == 0) {
+    return coil_error_get_last();
+  }
+  
+  coil_byte_t data[16];
+  coil_size_t valsize;
+  next = coil_operand_decode_data(ctx->ir, next, data, sizeof(data), &valsize, &header);
+  if (next == 0) {
+    return coil_error_get_last();
+  }
+  if (next > end) {
+    return COIL_ERROR(COIL_ERR_FORMAT, "Operand crosses the end of its function");
+  }
+  *pos = next;
+  
+  memset(operand, 0, sizeof(coil_lower_operand_t));
+  operand->width = coil_lower_width(header.value_type, &operand->is_signed);
+  
+  if (header.type == COIL_TYPEOP_NONE || header.type > COIL_TYPEOP_OFF) {
+    return COIL_ERROR(COIL_ERR_FORMAT, "Unknown operand type");
+  }
+  if (header.type == COIL_TYPEOP_EXP) {
+    return COIL_ERROR(COIL_ERR_NOTSUP, "Expression operands have no CBC form");
+  }
+  if (valsize == 0) {
+    return COIL_ERROR(COIL_ERR_NOTSUP, "Operand value type carries no data");
+  }
+  coil_u64_t value = coil_lower_uint(data, valsize);
+  
+  switch (header.type) {
+    case COIL_TYPEOP_IMM: {
+      if (operand->width == 0) {
+        return COIL_ERROR(COIL_ERR_NOTSUP, "Immediate is not an integer");
+      }
+      
+      // Extend to the full immediate, the encoder cuts it to the operation width
+      unsigned bits = (8u - (unsigned)valsize) * 8;
+      if (operand->is_signed && bits != 0) {
+        value = (coil_u64_t)((coil_i64_t)(value << bits) >> bits);
+      }
+      operand->cbc = coil_cbc_imm(value);
+      operand->cbc.imm_hi = operand->is_signed && (coil_i64_t)value < 0 ? ~(coil_u64_t)0 : 0;
+      return COIL_ERR_GOOD;
+    }
+    
+    case COIL_TYPEOP_REG:
+      if (value >= COIL_CBC_REGISTERS) {
+        return COIL_ERROR(COIL_ERR_FORMAT, "Unknown register");
+      }
+      operand->cbc = coil_cbc_reg((coil_u8_t)value);
+      return COIL_ERR_GOOD;
+    
+    case COIL_TYPEOP_VAR: {
+      const coil_lower_options_t *options = ctx->options;
+      if (value < options->home_count) {
+        operand->cbc = options->homes[value];
+        return COIL_ERR_GOOD;
+      }
+      
+      if (options->var_slot != 0 && value > (coil_u64_t)INT32_MAX / options->var_slot) {
+        return COIL_ERROR(COIL_ERR_NOTSUP, "Variable slot beyond a 32-bit displacement");
+      }
+      operand->cbc = coil_cbc_mem_reg(options->frame_reg, (coil_i32_t)(value * options->var_slot));
+      return COIL_ERR_GOOD;
+    }
+    
+    case COIL_TYPEOP_SYM:
+      if (value > 0xFFFFFFFF) {
+        return COIL_ERROR(COIL_ERR_FORMAT, "Symbol index beyond 32 bits");
+      }
+      operand->cbc = coil_cbc_sym((coil_u32_t)value);
+      return COIL_ERR_GOOD;
+    
+    default: {
+      coil_u64_t disp = offset.disp + offset.index * offset.scale;
+      if ((coil_i64_t)disp != (coil_i64_t)(coil_i32_t)disp) {
+        return COIL_ERROR(COIL_ERR_NOTSUP, "Displacement beyond 32 bits");
+      }
+      
+      if (header.value_type == COIL_VAL_REG) {
+        if (value >= COIL_CBC_REGISTERS) {
+          return COIL_ERROR(COIL_ERR_FORMAT, "Unknown register");
+        }
+        operand->cbc = coil_cbc_mem_reg((coil_u8_t)value, (coil_i32_t)disp);
+      } else if (header.value_type == COIL_VAL_SYM) {
+        if (value > 0xFFFFFFFF) {
+          return COIL_ERROR(COIL_ERR_FORMAT, "Symbol index beyond 32 bits");
+        }
+        operand->cbc = coil_cbc_mem_sym((coil_u32_t)value, (coil_i32_t)disp);
+      } else {
+        return COIL_ERROR(COIL_ERR_NOTSUP, "Offset operands need a register or symbol base");
+      }
+      return COIL_ERR_GOOD;
+    }
+  }
+}
+
+// -------------------------------- Instructions -------------------------------- //
+
+/**
+* @brief Map a COIL opcode to its CBC operation
+*
+* @return int Non-zero if the opcode has a CBC equivalent
+*/
+static int coil_lower_operation(coil_opcode_t opcode, coil_u8_t *operation) {
+  switch (opcode) {
+    case COIL_OP_NOP:  *operation = COIL_CBC_NOP; return 1;
+    case COIL_OP_BR:   *operation = COIL_CBC_BR; return 1;
+    case COIL_OP_JMP:  *operation = COIL_CBC_JMP; return 1;
+    case COIL_OP_CALL: *operation = COIL_CBC_CALL; return 1;
+    case COIL_OP_RET:  *operation = COIL_CBC_RET; return 1;
+    case COIL_OP_CMP:  *operation = COIL_CBC_CMP; return 1;
+    case COIL_OP_TEST: *operation = COIL_CBC_TEST; return 1;
+    case COIL_OP_MOV:  *operation = COIL_CBC_MOV; return 1;
+    case COIL_OP_PUSH: *operation = COIL_CBC_PUSH; return 1;
+    case COIL_OP_POP:  *operation = COIL_CBC_POP; return 1;
+    case COIL_OP_LEA:  *operation = COIL_CBC_LEA; return 1;
+    case COIL_OP_ADD:  *operation = COIL_CBC_ADD; return 1;
+    case COIL_OP_SUB:  *operation = COIL_CBC_SUB; return 1;
+    case COIL_OP_MUL:  *operation = COIL_CBC_MUL; return 1;
+    case COIL_OP_DIV:  *operation = COIL_CBC_DIV; return 1;
+    case COIL_OP_MOD:  *operation = COIL_CBC_MOD; return 1;
+    case COIL_OP_INC:  *operation = COIL_CBC_INC; return 1;
+    case COIL_OP_DEC:  *operation = COIL_CBC_DEC; return 1;
+    case COIL_OP_NEG:  *operation = COIL_CBC_NEG; return 1;
+    case COIL_OP_AND:  *operation = COIL_CBC_AND; return 1;
+    case COIL_OP_OR:   *operation = COIL_CBC_OR; return 1;
+    case COIL_OP_XOR:  *operation = COIL_CBC_XOR; return 1;
+    case COIL_OP_NOT:  *operation = COIL_CBC_NOT; return 1;
+    case COIL_OP_SHL:  *operation = COIL_CBC_SHL; return 1;
+    case COIL_OP_SHR:  *operation = COIL_CBC_SHR; return 1;
+    case COIL_OP_SAL:  *operation = COIL_CBC_SAL; return 1;
+    case COIL_OP_SAR:  *operation = COIL_CBC_SAR; return 1;
+    case COIL_OP_CVT:  *operation = COIL_CBC_CVT; return 1;
+    default:
+      return 0;
+  }
+}
+
+/**
+* @brief Select the CBC opcode for an operation and its operands and encode it
+*/
+static coil_err_t coil_lower_emit(coil_section_t *code, coil_u8_t operation, coil_u8_t width, coil_u8_t cond,
+                                  const coil_cbc_operand_t *a, const coil_cbc_operand_t *b) {
+  coil_cbc_opcode_t op;
+  if (coil_cbc_opcode_for(operation, width, a != NULL ? a->form : COIL_CBC_FORM_NONE,
+                          b != NULL ? b->form : COIL_CBC_FORM_NONE, &op) != COIL_ERR_GOOD) {
+    return COIL_ERROR(COIL_ERR_FORMAT, "No CBC opcode takes these operand forms");
+  }
+  return coil_cbc_encode(code, op, cond, a, b);
+}
+
+/**
+* @brief Lower a CVT
+*
+* CBC CVT sign extends into a register and narrow moves into a register
+* zero extend, other destinations go through the scratch register.
+* Narrowing reads registers at the narrow width and loads memory whole
+* first, so the result does not depend on the host byte order.
+*/
+static coil_err_t coil_lower_cvt(const coil_lower_ctx_t *ctx, coil_section_t *code,
+                                 const coil_lower_operand_t *dst, const coil_lower_operand_t *src) {
+  coil_u8_t to = dst->width != 0 ? dst->width : 8;
+  coil_u8_t from = src->width != 0 ? src->width : to;
+  
+  // Immediates were extended by their own type already
+  if (src->cbc.form == COIL_CBC_FORM_I) {
+    return coil_lower_emit(code, COIL_CBC_MOV, to, 0, &dst->cbc, &src->cbc);
+  }
+  
+  coil_cbc_operand_t scratch = coil_cbc_reg(ctx->options->scratch_reg);
+  coil_err_t err;
+  
+  if (to <= from) {
+    if (to == from || src->cbc.form == COIL_CBC_FORM_R) {
+      return coil_lower_emit(code, COIL_CBC_MOV, to, 0, &dst->cbc, &src->cbc);
+    }
+    err = coil_lower_emit(code, COIL_CBC_MOV, from, 0, &scratch, &src->cbc);
+    if (err != COIL_ERR_GOOD) {
+      return err;
+    }
+    return coil_lower_emit(code, COIL_CBC_MOV, to, 0, &dst->cbc, &scratch);
+  }
+  
+  const coil_cbc_operand_t *reg = dst->cbc.form == COIL_CBC_FORM_R ? &dst->cbc : &scratch;
+  err = coil_lower_emit(code, src->is_signed ? COIL_CBC_CVT : COIL_CBC_MOV, from, 0, reg, &src->cbc);
+  if (err != COIL_ERR_GOOD || reg == &dst->cbc) {
+    return err;
+  }
+  return coil_lower_emit(code, COIL_CBC_MOV, to, 0, &dst->cbc, &scratch);
+}
+
+/**
+* @brief Lower the instruction at *pos and advance past it
+*/
+static coil_err_t coil_lower_instr(const coil_lower_ctx_t *ctx, coil_section_t *code, coil_u64_t *pos, coil_u64_t end) {
+  coil_instrmem_t instr;
+  coil_instrfmt_t fmt;
+  coil_size_t next = coil_instr_decode(ctx->ir, *pos, &instr, &fmt);
+  if (next == 0) {
+    return coil_error_get_last();
+  }
+  if (next > end) {
+    return COIL_ERROR(COIL_ERR_FORMAT, "Instruction crosses the end of its function");
+  }
+  
+  coil_u8_t operation;
+  if (!coil_lower_operation(instr.opcode, &operation)) {
+    return COIL_ERROR(COIL_ERR_NOTSUP, "Instruction has no CBC equivalent");
+  }
+  
+  coil_u8_t flag = COIL_INSTRFLAG_NONE;
+  int count = 0;
+  switch (fmt) {
+    case COIL_INSTRFMT_FLAG_UNARY:
+      flag = ((coil_instrflag_t *)&instr)->flag;
+      count = 1;
+      break;
+    case COIL_INSTRFMT_FLAG_BINARY:
+      flag = ((coil_instrflag_t *)&instr)->flag;
+      count = 2;
+      break;
+    case COIL_INSTRFMT_UNARY:
+      count = 1;
+      break;
+    case COIL_INSTRFMT_BINARY:
+      count = 2;
+      break;
+    default:
+      break;
+  }
+  
+  // Only branches are conditional in CBC
+  if (flag != COIL_INSTRFLAG_NONE && operation != COIL_CBC_BR) {
+    return COIL_ERROR(COIL_ERR_NOTSUP, "Conditional execution of a non-branch instruction");
+  }
+  if (flag > COIL_INSTRFLAG_LTE) {
+    return COIL_ERROR(COIL_ERR_FORMAT, "Unknown branch condition");
+  }
+  
+  coil_lower_operand_t ops[2];
+  *pos = next;
+  for (int i = 0; i < count; i++) {
+    coil_err_t err = coil_lower_operand(ctx, pos, end, &ops[i]);
+    if (err != COIL_ERR_GOOD) {
+      return err;
+    }
+  }
+  
+  // Registers and memory decide the width before immediates do
+  coil_u8_t width = 0;
+  for (int i = 0; i < count && width == 0; i++) {
+    if (ops[i].cbc.form != COIL_CBC_FORM_I) {
+      width = ops[i].width;
+    }
+  }
+  for (int i = 0; i < count && width == 0; i++) {
+    width = ops[i].width;
+  }
+  if (width == 0) {
+    width = 8;
+  }
+  
+  switch (operation) {
+    case COIL_CBC_NOP:
+      return COIL_ERR_GOOD;
+    
+    case COIL_CBC_RET:
+      return coil_lower_emit(code, COIL_CBC_RET, 0, 0, NULL, NULL);
+    
+    case COIL_CBC_JMP:
+    case COIL_CBC_BR:
+    case COIL_CBC_CALL:
+      if (ops[0].cbc.form == COIL_CBC_FORM_I) {
+        return COIL_ERROR(COIL_ERR_NOTSUP, "Immediate branch targets have no CBC form");
+      }
+      if (operation == COIL_CBC_BR && flag == COIL_INSTRFLAG_NONE) {
+        operation = COIL_CBC_JMP;
+      }
+      return coil_lower_emit(code, operation, width, flag, &ops[0].cbc, NULL);
+    
+    case COIL_CBC_INC:
+    case COIL_CBC_DEC:
+    case COIL_CBC_NEG:
+      return coil_lower_emit(code, operation, width, 0, &ops[0].cbc, &ops[0].cbc);
+    
+    case COIL_CBC_NOT:
+    case COIL_CBC_PUSH:
+    case COIL_CBC_POP:
+      return coil_lower_emit(code, operation, width, 0, &ops[0].cbc, NULL);
+    
+    case COIL_CBC_LEA:
+      if (ops[1].cbc.form == COIL_CBC_FORM_I || ops[1].cbc.form == COIL_CBC_FORM_R) {
+        return COIL_ERROR(COIL_ERR_FORMAT, "LEA needs a memory source");
+      }
+      return coil_lower_emit(code, operation, width, 0, &ops[0].cbc, &ops[1].cbc);
+    
+    case COIL_CBC_CVT:
+      if (ops[0].cbc.form == COIL_CBC_FORM_I) {
+        return COIL_ERROR(COIL_ERR_FORMAT, "CVT needs a register or memory destination");
+      }
+      return coil_lower_cvt(ctx, code, &ops[0], &ops[1]);
+    
+    default:
+      return coil_lower_emit(code, operation, width, 0, &ops[0].cbc, &ops[1].cbc);
+  }
+}
+
+// -------------------------------- Functions -------------------------------- //
+
+/**
+* @brief Lower one function (coil_par_fn_t)
+*/
+static coil_err_t coil_lower_function(void *arg, coil_size_t index) {
+  coil_lower_ctx_t *ctx = (coil_lower_ctx_t *)arg;
+  coil_u32_t f = ctx->ranks[index].index;
+  coil_lower_job_t *job = &ctx->jobs[f];
+  coil_u64_t pos = ctx->funcs[f].offset;
+  coil_u64_t end = pos + ctx->funcs[f].size;
+  
+  // CBC is about as dense as the COIL it comes from
+  job->fault = pos;
+  job->err = coil_section_init(&job->code, (coil_size_t)ctx->funcs[f].size + 64);
+  
+  while (job->err == COIL_ERR_GOOD && pos < end) {
+    coil_u64_t at = pos;
+    job->fault = at;
+    ctx->cbc_of[at] = (coil_u32_t)job->code.size;
+    job->err = coil_lower_instr(ctx, &job->code, &pos, end);
+    if (job->err == COIL_ERR_GOOD) {
+      memset(ctx->cbc_of + at + 1, 0xFF, (pos - at - 1) * sizeof(coil_u32_t));
+    }
+  }
+  
+  return job->err;
+}
+
+/**
+* @brief Copy one function's code to its place and make its offsets absolute (coil_par_fn_t)
+*/
+static coil_err_t coil_lower_place(void *arg, coil_size_t index) {
+  coil_lower_ctx_t *ctx = (coil_lower_ctx_t *)arg;
+  coil_u32_t f = ctx->ranks[index].index;
+  coil_lower_job_t *job = &ctx->jobs[f];
+  coil_u64_t end = ctx->funcs[f].offset + ctx->funcs[f].size;
+  
+  for (coil_u64_t pos = ctx->funcs[f].offset; pos < end; pos++) {
+    if (ctx->cbc_of[pos] != COIL_LOWER_NO_CODE) {
+      ctx->cbc_of[pos] += (coil_u32_t)job->base;
+    }
+  }
+  
+  if (ctx->out != NULL && job->code.size > 0) {
+    memcpy(ctx->out + job->base, job->code.data, job->code.size);
+  }
+  return COIL_ERR_GOOD;
+}
+
+/**
+* @brief Order functions by decreasing size, then by position
+*/
+static int coil_lower_compare_rank(const void *a, const void *b) {
+  const coil_lower_rank_t *x = (const coil_lower_rank_t *)a;
+  const coil_lower_rank_t *y = (const coil_lower_rank_t *)b;
+  
+  if (x->size != y->size) {
+    return x->size > y->size ? -1 : 1;
+  }
+  return x->index < y->index ? -1 : x->index > y->index;
+}
+
+/**
+* @brief Lower COIL functions to CBC
+*/
+coil_err_t coil_lower_section(coil_lower_t *lower, coil_section_t *out, coil_section_t *ir,
+                              const coil_lower_func_t *funcs, coil_u32_t count,
+                              const coil_lower_options_t *options) {
+  if (lower == NULL || out == NULL || ir == NULL) {
+    return COIL_ERROR(COIL_ERR_INVAL, "Invalid parameters");
+  }
+  memset(lower, 0, sizeof(coil_lower_t));
+  
+  if (coil_section_is_chunked(ir)) {
+    return COIL_ERROR(COIL_ERR_BADSTATE, "Cannot lower from a chunked section");
+  }
+  if (out->mode == COIL_SECT_MODE_VIEW) {
+    return COIL_ERROR(COIL_ERR_BADSTATE, "Output section is read-only");
+  }
+  
+  coil_lower_options_t defaults;
+  if (options == NULL) {
+    coil_lower_options_init(&defaults);
+    options = &defaults;
+  }
+  if (options->frame_reg >= COIL_CBC_REGISTERS || options->scratch_reg >= COIL_CBC_REGISTERS ||
+      (options->homes == NULL && options->home_count != 0)) {
+    return COIL_ERROR(COIL_ERR_INVAL, "Invalid options");
+  }
+  for (coil_u64_t i = 0; i < options->home_count; i++) {
+    if (!coil_lower_is_place(&options->homes[i])) {
+      return COIL_ERROR(COIL_ERR_INVAL, "Variable home is not a register or memory operand");
+    }
+  }
+  
+  coil_lower_func_t whole = { 0, ir->size };
+  if (funcs == NULL) {
+    funcs = &whole;
+    count = 1;
+  }
+  
+  coil_u64_t prev_end = 0;
+  for (coil_u32_t i = 0; i < count; i++) {
+    if (funcs[i].offset < prev_end || funcs[i].offset > ir->size || funcs[i].size > ir->size - funcs[i].offset) {
+      return COIL_ERROR(COIL_ERR_INVAL, "Functions overlap or leave the section");
+    }
+    prev_end = funcs[i].offset + funcs[i].size;
+  }
+  
+  lower->ir_size = ir->size;
+  lower->cbc_of = (coil_u32_t *)coil_malloc((ir->size + 1) * sizeof(coil_u32_t));
+  coil_lower_job_t *jobs = (coil_lower_job_t *)coil_calloc(count > 0 ? count : 1, sizeof(coil_lower_job_t));
+  coil_lower_rank_t *ranks = (coil_lower_rank_t *)coil_malloc((count > 0 ? count : 1) * sizeof(coil_lower_rank_t));
+  if (lower->cbc_of == NULL || jobs == NULL || ranks == NULL) {
+    coil_free(ranks);
+    coil_free(jobs);
+    coil_lower_cleanup(lower);
+    return COIL_ERROR(COIL_ERR_NOMEM, "Failed to allocate lowering state");
+  }
+  
+  // Workers fill their own functions, only the gaps are filled here
+  prev_end = 0;
+  for (coil_u32_t i = 0; i < count; i++) {
+    memset(lower->cbc_of + prev_end, 0xFF, (funcs[i].offset - prev_end) * sizeof(coil_u32_t));
+    prev_end = funcs[i].offset + funcs[i].size;
+  }
+  memset(lower->cbc_of + prev_end, 0xFF, (ir->size + 1 - prev_end) * sizeof(coil_u32_t));
+  
+  // Largest functions go first so a long one does not start last
+  for (coil_u32_t i = 0; i < count; i++) {
+    ranks[i].size = funcs[i].size;
+    ranks[i].index = i;
+  }
+  qsort(ranks, count, sizeof(coil_lower_rank_t), coil_lower_compare_rank);
+  
+  coil_lower_ctx_t ctx = { ir, options, funcs, ranks, jobs, lower->cbc_of, NULL };
+  coil_err_t err = coil_par_for(count, options->threads, coil_lower_function, &ctx);
+  
+  // Report the first failing function in section order, whichever thread hit it
+  if (err != COIL_ERR_GOOD) {
+    for (coil_u32_t i = 0; i < count; i++) {
+      if (jobs[i].err != COIL_ERR_GOOD) {
+        err = jobs[i].err;
+        lower->fault = jobs[i].fault;
+        break;
+      }
+    }
+  }
+  
+  // Functions are laid out in order from the write index
+  coil_size_t base = out->windex;
+  coil_size_t total = 0;
+  for (coil_u32_t i = 0; i < count; i++) {
+    jobs[i].base = base + total;
+    total += jobs[i].code.size;
+  }
+  if (err == COIL_ERR_GOOD && (total >= COIL_LOWER_NO_CODE || base > COIL_LOWER_NO_CODE - 1 - total)) {
+    err = COIL_ERR_NOTSUP;
+  }
+  if (err == COIL_ERR_GOOD) {
+    err = coil_section_ensure_capacity(out, base + total);
+  }
+  
+  if (err == COIL_ERR_GOOD) {
+    ctx.out = coil_section_is_chunked(out) ? NULL : out->data;
+    err = coil_par_for(count, options->threads, coil_lower_place, &ctx);
+  }
+  
+  if (err == COIL_ERR_GOOD) {
+    if (ctx.out != NULL) {
+      out->windex = base + total;
+      if (out->windex > out->size) {
+        out->size = out->windex;
+      }
+    } else {
+      for (coil_u32_t i = 0; i < count && err == COIL_ERR_GOOD; i++) {
+        coil_size_t written;
+        if (jobs[i].code.size > 0) {
+          err = coil_section_write(out, jobs[i].code.data, jobs[i].code.size, &written);
+        }
+      }
+    }
+    
+    // Function ends last, an end may be the next function's start
+    for (coil_u32_t i = 0; i < count; i++) {
+      coil_u64_t end = funcs[i].offset + funcs[i].size;
+      if (lower->cbc_of[end] == COIL_LOWER_NO_CODE) {
+        lower->cbc_of[end] = (coil_u32_t)(jobs[i].base + jobs[i].code.size);
+      }
+    }
+  }
+  
+  for (coil_u32_t i = 0; i < count; i++) {
+    coil_section_cleanup(&jobs[i].code);
+  }
+  coil_free(ranks);
+  coil_free(jobs);
+  
+  if (err != COIL_ERR_GOOD) {
+    coil_free(lower->cbc_of);
+    lower->cbc_of = NULL;
+    return COIL_ERROR(err, "Failed to lower COIL to CBC");
+  }
+  
+  lower->code_size = total;
+  return COIL_ERR_GOOD;
+}
+
+/**
+* @brief Find the CBC offset of a COIL offset
+*/
+coil_err_t coil_lower_offset(const coil_lower_t *lower, coil_u64_t ir_offset, coil_u64_t *cbc_offset) {
+  if (lower == NULL || lower->cbc_of == NULL || cbc_offset == NULL) {
+    return COIL_ERROR(COIL_ERR_INVAL, "Invalid parameters");
+  }
+  
+  if (ir_offset > lower->ir_size || lower->cbc_of[ir_offset] == COIL_LOWER_NO_CODE) {
+    return COIL_ERROR(COIL_ERR_NOTFOUND, "Offset does not start an instruction");
+  }
+  
+  *cbc_offset = lower->cbc_of[ir_offset];
+  return COIL_ERR_GOOD;
+}
+
+/**
+* @brief Release a lowering result
+*/
+void coil_lower_cleanup(coil_lower_t *lower) {
+  if (lower == NULL) {
+    return;
+  }
+  
+  coil_free(lower->cbc_of);
+  lower->cbc_of = NULL;
+  lower->ir_size = 0;
+  lower->code_size = 0;
+}
@@ -63,6 +63,41 @@ coil_err_t coil_munmap(void *ptr, coil_size_t size) {
   return COIL_ERR_GOOD;
 }
 
+/**
+* @brief Give the kernel an access pattern hint for a range of mapped memory
+*/
+coil_err_t coil_madvise(void *ptr, coil_size_t size, coil_advice_t advice) {
+  if (ptr == NULL) {
+    return COIL_ERROR(COIL_ERR_INVAL, "Pointer is NULL");
+  }
+  
+  int native;
+  switch (advice) {
+    case COIL_ADVICE_NORMAL:     native = MADV_NORMAL; break;
+    case COIL_ADVICE_SEQUENTIAL: native = MADV_SEQUENTIAL; break;
+    case COIL_ADVICE_RANDOM:     native = MADV_RANDOM; break;
+    case COIL_ADVICE_WILLNEED:   native = MADV_WILLNEED; break;
+    case COIL_ADVICE_DONTNEED:   native = MADV_DONTNEED; break;
+    default:
+      return COIL_ERROR(COIL_ERR_INVAL, "Unknown memory advice");
+  }
+  
+  if (size == 0) {
+    return COIL_ERR_GOOD;
+  }
+  
+  // madvise requires a page aligned start address
+  coil_size_t page_size = coil_get_page_size();
+  coil_size_t start = coil_align_down((coil_size_t)ptr, page_size);
+  coil_size_t end = (coil_size_t)ptr + size;
+  
+  if (madvise((void *)start, end - start, native) != 0) {
+    return COIL_ERROR(COIL_ERR_INVAL, "Failed to apply memory advice");
+  }
+  
+  return COIL_ERR_GOOD;
+}
+
 /**
 * @brief Allocate memory with standard malloc
 */
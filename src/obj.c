@@ -3,11 +3,20 @@
 * @brief COIL Object functionality implementation for libcoil-dev
 */
 
+#define _GNU_SOURCE // memfd_create, file seals
+
 #include <coil/base.h>
 #include <coil/obj.h>
 #include <coil/sect.h>
+#include <coil/target.h>
+#include <coil/reloc.h>
+#include <coil/sym.h>
 #include "srcdeps.h"
 
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/stat.h>
+
 /**
 * @brief COIL magic bytes for object files
 */
@@ -18,6 +27,11 @@ static const coil_u8_t COIL_MAGIC[4] = COIL_MAGIC_BYTES;
 */
 #define COIL_CURRENT_VERSION 1
 
+/**
+* @brief Alignment of section data in saved files, so mapped tables can be used in place
+*/
+#define COIL_SECTION_DATA_ALIGN 8
+
 /**
 * @brief Initialize a COIL object
 */
@@ -41,6 +55,20 @@ coil_err_t coil_obj_init(coil_object_t *obj, int flags) {
   return COIL_ERR_GOOD;
 }
 
+/**
+* @brief Forget cached host selections and the target index after the set of sections or their targets change
+*/
+static void coil_obj_drop_target_cache(coil_object_t *obj) {
+  obj->target_cache_count = 0;
+  
+  if (obj->target_index != NULL) {
+    coil_free(obj->target_index->bits);
+    coil_free(obj->target_index->pu_keys);
+    coil_free(obj->target_index);
+    obj->target_index = NULL;
+  }
+}
+
 /**
 * @brief Clean up a COIL object and free associated resources
 */
@@ -62,12 +90,34 @@ void coil_obj_cleanup(coil_object_t *obj) {
     coil_free(obj->sectheaders);
   }
   
+  // Free cached host selections and the target index
+  coil_obj_drop_target_cache(obj);
+  if (obj->target_cache != NULL) {
+    coil_free(obj->target_cache);
+  }
+  
+  // Release executable mappings, code handed out from them is gone with the object
+  for (coil_u32_t i = 0; i < obj->exec_count; i++) {
+    coil_munmap(obj->exec_maps[i].base, obj->exec_maps[i].size);
+  }
+  if (obj->exec_maps != NULL) {
+    coil_free(obj->exec_maps);
+  }
+  
   // Unmap memory if mapped
   if (obj->is_mapped && obj->memory != NULL) {
     // Use the file size from the header for unmapping
     coil_munmap(obj->memory, obj->header.file_size);
     obj->memory = NULL;
     obj->is_mapped = 0;
+    obj->read_only = 0;
+  }
+  
+  // Release a buffer handed over by coil_obj_load_memory, borrowed ones stay with the caller
+  if (obj->owns_memory && obj->memory != NULL) {
+    coil_free(obj->memory);
+    obj->memory = NULL;
+    obj->owns_memory = 0;
   }
   
   // Close file descriptor if open
@@ -149,13 +199,97 @@ coil_err_t coil_obj_load_file(coil_object_t *obj, coil_descriptor_t fd) {
 }
 
 /**
-* @brief Load object from file using memory mapping
+* @brief Read the header and section headers of an object image already in memory
+*
+* Shared by every in-memory load path, touches no mapping or ownership state.
 */
-coil_err_t coil_obj_mmap(coil_object_t *obj, coil_descriptor_t fd) {
-  if (obj == NULL || fd < 0) {
-    return COIL_ERROR(COIL_ERR_INVAL, "Invalid object pointer or file descriptor");
+static coil_err_t coil_obj_parse_image(coil_object_t *obj, const coil_byte_t *image, coil_size_t size) {
+  if (size < sizeof(coil_object_header_t)) {
+    return COIL_ERROR(COIL_ERR_FORMAT, "Object is smaller than its header");
+  }
+  
+  // Read header from memory
+  coil_memcpy(&obj->header, image, sizeof(coil_object_header_t));
+  
+  // Verify magic
+  if (coil_memcmp(obj->header.magic, COIL_MAGIC, sizeof(COIL_MAGIC)) != 0) {
+    return COIL_ERROR(COIL_ERR_FORMAT, "Invalid object format (magic mismatch)");
+  }
+  
+  // Verify file size
+  if (obj->header.file_size != (coil_u64_t)size) {
+    coil_log(COIL_LEVEL_WARNING, "Actual file size (%lld) doesn't match header size (%lld)",
+            (long long)size, (long long)obj->header.file_size);
+    
+    // Update file size in header to match actual size
+    obj->header.file_size = size;
+  }
+  
+  // Load section headers
+  if (obj->header.section_count > 0) {
+    coil_size_t headers_size = obj->header.section_count * sizeof(coil_section_header_t);
+    
+    if (sizeof(coil_object_header_t) + headers_size > size) {
+      return COIL_ERROR(COIL_ERR_FORMAT, "Section headers extend past the object");
+    }
+    
+    // Allocate memory for section headers (we'll copy them rather than using the image directly)
+    obj->sectheaders = (coil_section_header_t *)coil_malloc(headers_size);
+    if (obj->sectheaders == NULL) {
+      return COIL_ERROR(COIL_ERR_NOMEM, "Failed to allocate memory for section headers");
+    }
+    
+    // Copy section headers
+    coil_memcpy(obj->sectheaders, image + sizeof(coil_object_header_t), headers_size);
+    
+    // Views point straight into the image, every section has to lie inside it
+    for (coil_u16_t i = 0; i < obj->header.section_count; i++) {
+      coil_section_header_t *header = &obj->sectheaders[i];
+      if (header->offset > size || header->size > size - header->offset) {
+        coil_free(obj->sectheaders);
+        obj->sectheaders = NULL;
+        return COIL_ERROR(COIL_ERR_FORMAT, "Section data extends past the object");
+      }
+    }
+  }
+  
+  return COIL_ERR_GOOD;
+}
+
+/**
+* @brief Map an object image that starts at a file offset
+*/
+static coil_err_t coil_obj_map_region(coil_object_t *obj, coil_descriptor_t fd, coil_u64_t offset, coil_size_t size,
+                                      int prot) {
+  if (size < sizeof(coil_object_header_t)) {
+    return COIL_ERROR(COIL_ERR_FORMAT, "Object is smaller than its header");
+  }
+  
+  // Map the object image into memory
+  void *mapped_memory = mmap(NULL, size, prot, MAP_PRIVATE, fd, (off_t)offset);
+  
+  if (mapped_memory == MAP_FAILED) {
+    return COIL_ERROR(COIL_ERR_IO, "Failed to memory map file");
   }
   
+  coil_err_t err = coil_obj_parse_image(obj, (const coil_byte_t *)mapped_memory, size);
+  if (err != COIL_ERR_GOOD) {
+    coil_munmap(mapped_memory, size);
+    return err;
+  }
+  
+  // Set mapping flag
+  obj->is_mapped = 1;
+  obj->read_only = (prot & PROT_WRITE) == 0;
+  obj->memory = mapped_memory;
+  
+  return COIL_ERR_GOOD;
+}
+
+/**
+* @brief Map a whole file with the given protection
+*/
+static coil_err_t coil_obj_map_file(coil_object_t *obj, coil_descriptor_t fd, int prot) {
   // Initialize object
   coil_obj_init(obj, COIL_OBJ_INIT_DEFAULT);
   
@@ -173,54 +307,188 @@ coil_err_t coil_obj_mmap(coil_object_t *obj, coil_descriptor_t fd) {
     return COIL_ERROR(COIL_ERR_IO, "Failed to seek to beginning of file");
   }
   
-  // Map the entire file into memory
-  void *mapped_memory = mmap(NULL, file_size, PROT_READ | PROT_WRITE, 
-                           MAP_PRIVATE, fd, 0);
+  return coil_obj_map_region(obj, fd, 0, (coil_size_t)file_size, prot);
+}
+
+/**
+* @brief Load object from file using memory mapping
+*/
+coil_err_t coil_obj_mmap(coil_object_t *obj, coil_descriptor_t fd) {
+  if (obj == NULL || fd < 0) {
+    return COIL_ERROR(COIL_ERR_INVAL, "Invalid object pointer or file descriptor");
+  }
   
-  if (mapped_memory == MAP_FAILED) {
-    return COIL_ERROR(COIL_ERR_IO, "Failed to memory map file");
+  return coil_obj_map_file(obj, fd, PROT_READ | PROT_WRITE);
+}
+
+/**
+* @brief Map an object stored inside a larger file
+*/
+coil_err_t coil_obj_mmap_range(coil_object_t *obj, coil_descriptor_t fd, coil_u64_t offset, coil_size_t size) {
+  if (obj == NULL || fd < 0 || size == 0) {
+    return COIL_ERROR(COIL_ERR_INVAL, "Invalid parameters");
   }
   
-  // Set mapping flag
-  obj->is_mapped = 1;
-  obj->memory = mapped_memory;
+  if (offset % coil_get_page_size() != 0) {
+    return COIL_ERROR(COIL_ERR_INVAL, "Object offset must be page aligned");
+  }
+  
+  // The descriptor belongs to the container, the object only keeps the mapping
+  coil_obj_init(obj, COIL_OBJ_INIT_DEFAULT);
+  return coil_obj_map_region(obj, fd, offset, size, PROT_READ | PROT_WRITE);
+}
+
+/**
+* @brief Load an object from a buffer already in memory
+*/
+coil_err_t coil_obj_load_memory(coil_object_t *obj, const void *ptr, coil_size_t len, int flags) {
+  if (obj == NULL || ptr == NULL || len == 0 || 
+      (flags & (COIL_OBJ_MEM_COPY | COIL_OBJ_MEM_TAKE)) == (COIL_OBJ_MEM_COPY | COIL_OBJ_MEM_TAKE)) {
+    return COIL_ERROR(COIL_ERR_INVAL, "Invalid parameters");
+  }
   
-  // Read header from mapped memory
-  coil_memcpy(&obj->header, obj->memory, sizeof(coil_object_header_t));
+  coil_obj_init(obj, COIL_OBJ_INIT_DEFAULT);
   
-  // Verify magic
-  if (coil_memcmp(obj->header.magic, COIL_MAGIC, sizeof(COIL_MAGIC)) != 0) {
-    coil_munmap(obj->memory, file_size);
-    obj->memory = NULL;
-    obj->is_mapped = 0;
-    return COIL_ERROR(COIL_ERR_FORMAT, "Invalid object format (magic mismatch)");
+  // Copies are made before parsing so the headers describe the buffer we keep
+  const coil_byte_t *image = (const coil_byte_t *)ptr;
+  if (flags & COIL_OBJ_MEM_COPY) {
+    coil_byte_t *copy = (coil_byte_t *)coil_malloc(len);
+    if (copy == NULL) {
+      return COIL_ERROR(COIL_ERR_NOMEM, "Failed to allocate memory for object image");
+    }
+    coil_memcpy(copy, ptr, len);
+    image = copy;
   }
   
-  // Verify file size
-  if (obj->header.file_size != (coil_u64_t)file_size) {
-    coil_log(COIL_LEVEL_WARNING, "Actual file size (%lld) doesn't match header size (%lld)",
-            (long long)file_size, (long long)obj->header.file_size);
-    
-    // Update file size in header to match actual size
-    obj->header.file_size = file_size;
+  coil_err_t err = coil_obj_parse_image(obj, image, len);
+  if (err != COIL_ERR_GOOD) {
+    // A taken buffer stays with the caller when the load fails
+    if (flags & COIL_OBJ_MEM_COPY) {
+      coil_free((void *)image);
+    }
+    return err;
   }
   
-  // Load section headers
-  if (obj->header.section_count > 0) {
-    coil_size_t headers_size = obj->header.section_count * sizeof(coil_section_header_t);
-    coil_byte_t *headers_ptr = (coil_byte_t *)obj->memory + sizeof(coil_object_header_t);
-    
-    // Allocate memory for section headers (we'll copy them rather than using the mapped memory directly)
-    obj->sectheaders = (coil_section_header_t *)coil_malloc(headers_size);
-    if (obj->sectheaders == NULL) {
-      coil_munmap(obj->memory, file_size);
-      obj->memory = NULL;
-      obj->is_mapped = 0;
-      return COIL_ERROR(COIL_ERR_NOMEM, "Failed to allocate memory for section headers");
+  obj->memory = (coil_byte_t *)image;
+  obj->owns_memory = (flags & (COIL_OBJ_MEM_COPY | COIL_OBJ_MEM_TAKE)) != 0;
+  return COIL_ERR_GOOD;
+}
+
+#ifdef MFD_ALLOW_SEALING
+
+/**
+* @brief Seals that make an exported image immutable
+*/
+#define COIL_OBJ_MEMFD_SEALS (F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_WRITE | F_SEAL_SEAL)
+
+/**
+* @brief Serialize an object into a sealed memfd
+*/
+coil_err_t coil_obj_export_memfd(coil_object_t *obj, coil_descriptor_t *fd) {
+  if (obj == NULL || fd == NULL) {
+    return COIL_ERROR(COIL_ERR_INVAL, "Invalid parameters");
+  }
+  
+  int memfd = memfd_create("coil-object", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+  if (memfd < 0) {
+    return COIL_ERROR(COIL_ERR_IO, "Failed to create memfd");
+  }
+  
+  coil_err_t err = coil_obj_save_file(obj, memfd);
+  if (err != COIL_ERR_GOOD) {
+    coil_close(memfd);
+    return err;
+  }
+  
+  // Once sealed the receiver can map the image knowing nobody can change it underneath
+  if (fcntl(memfd, F_ADD_SEALS, COIL_OBJ_MEMFD_SEALS) != 0) {
+    coil_close(memfd);
+    return COIL_ERROR(COIL_ERR_IO, "Failed to seal memfd");
+  }
+  
+  if (lseek(memfd, 0, SEEK_SET) == -1) {
+    coil_close(memfd);
+    return COIL_ERROR(COIL_ERR_IO, "Failed to seek to beginning of memfd");
+  }
+  
+  *fd = memfd;
+  return COIL_ERR_GOOD;
+}
+
+/**
+* @brief Map an object from a sealed memfd
+*/
+coil_err_t coil_obj_import_memfd(coil_object_t *obj, coil_descriptor_t fd) {
+  if (obj == NULL || fd < 0) {
+    return COIL_ERROR(COIL_ERR_INVAL, "Invalid object pointer or file descriptor");
+  }
+  
+  // Without write and shrink seals the sender could still change or truncate the image
+  int seals = fcntl(fd, F_GET_SEALS);
+  if (seals == -1 || (seals & (F_SEAL_WRITE | F_SEAL_SHRINK)) != (F_SEAL_WRITE | F_SEAL_SHRINK)) {
+    return COIL_ERROR(COIL_ERR_BADSTATE, "Descriptor is not a sealed memfd");
+  }
+  
+  // The image is shared with every importer, nothing writes into it and COW sections are read out as copies
+  coil_err_t err = coil_obj_map_file(obj, fd, PROT_READ);
+  if (err != COIL_ERR_GOOD) {
+    // The descriptor stays with the caller when the import fails
+    obj->fd = -1;
+  }
+  return err;
+}
+
+#else
+
+/**
+* @brief Serialize an object into a sealed memfd (unsupported on this platform)
+*/
+coil_err_t coil_obj_export_memfd(coil_object_t *obj, coil_descriptor_t *fd) {
+  (void)obj;
+  (void)fd;
+  return COIL_ERROR(COIL_ERR_NOTSUP, "Sealed memfds are not supported on this platform");
+}
+
+/**
+* @brief Map an object from a sealed memfd (unsupported on this platform)
+*/
+coil_err_t coil_obj_import_memfd(coil_object_t *obj, coil_descriptor_t fd) {
+  (void)obj;
+  (void)fd;
+  return COIL_ERROR(COIL_ERR_NOTSUP, "Sealed memfds are not supported on this platform");
+}
+
+#endif
+
+/**
+* @brief Get the loaded section for an index, or NULL if it was never loaded
+*/
+static coil_section_t *coil_obj_loaded_section(coil_object_t *obj, coil_u16_t index) {
+  if (obj->sections != NULL && index < obj->loaded_count && coil_section_has_data(&obj->sections[index])) {
+    return &obj->sections[index];
+  }
+  return NULL;
+}
+
+/**
+* @brief Append the data of one section to another, chunk by chunk
+*/
+static coil_err_t coil_obj_copy_section_data(coil_section_t *dst, const coil_section_t *src) {
+  coil_size_t count = coil_section_chunk_count(src);
+  
+  for (coil_size_t i = 0; i < count; i++) {
+    const coil_byte_t *chunk;
+    coil_size_t size;
+    coil_err_t err = coil_section_get_chunk(src, i, &chunk, &size);
+    if (err != COIL_ERR_GOOD) {
+      return err;
     }
     
-    // Copy section headers
-    coil_memcpy(obj->sectheaders, headers_ptr, headers_size);
+    coil_size_t written;
+    err = coil_section_write(dst, (coil_byte_t *)chunk, size, &written);
+    if (err != COIL_ERR_GOOD) {
+      return err;
+    }
   }
   
   return COIL_ERR_GOOD;
@@ -244,11 +512,27 @@ coil_err_t coil_obj_unmap(coil_object_t *obj) {
     return COIL_ERROR(COIL_ERR_INVAL, "Object pointer is NULL");
   }
   
-  // If the object is not memory-mapped, there's nothing to do
-  if (!obj->is_mapped || obj->memory == NULL) {
+  // If the object has no backing image, there's nothing to do
+  if (obj->memory == NULL) {
     return COIL_ERR_GOOD;
   }
   
+  // Without a descriptor to read from later, every section has to come along now
+  if (obj->fd < 0) {
+    for (coil_u16_t i = 0; i < obj->header.section_count; i++) {
+      if (coil_obj_section_deleted(obj, i) || coil_obj_loaded_section(obj, i) != NULL) {
+        continue;
+      }
+      
+      coil_section_t loaded;
+      coil_err_t err = coil_obj_load_section(obj, i, &loaded, COIL_SLOAD_DEFAULT);
+      if (err != COIL_ERR_GOOD) {
+        return err;
+      }
+      coil_section_cleanup(&loaded);
+    }
+  }
+  
   // Create a temporary object to hold the converted data
   coil_object_t temp_obj;
   coil_err_t err = coil_obj_init(&temp_obj, COIL_OBJ_INIT_DEFAULT);
@@ -258,6 +542,7 @@ coil_err_t coil_obj_unmap(coil_object_t *obj) {
   
   // Copy the header
   temp_obj.header = obj->header;
+  temp_obj.deleted_count = obj->deleted_count;
   
   // Copy section headers
   if (obj->header.section_count > 0) {
@@ -273,10 +558,10 @@ coil_err_t coil_obj_unmap(coil_object_t *obj) {
                obj->header.section_count * sizeof(coil_section_header_t));
   }
   
-  // Copy loaded sections
+  // Copy loaded sections (the array always covers every section index)
   if (obj->sections != NULL && obj->loaded_count > 0) {
     temp_obj.sections = (coil_section_t *)coil_calloc(
-        obj->loaded_count, sizeof(coil_section_t));
+        obj->header.section_count, sizeof(coil_section_t));
     
     if (temp_obj.sections == NULL) {
       coil_obj_cleanup(&temp_obj);
@@ -290,7 +575,7 @@ coil_err_t coil_obj_unmap(coil_object_t *obj) {
       coil_section_t *src = &obj->sections[i];
       coil_section_t *dst = &temp_obj.sections[i];
       
-      if (src->data != NULL && src->size > 0) {
+      if (coil_section_has_data(src) && src->size > 0) {
         err = coil_section_init(dst, src->size);
         if (err != COIL_ERR_GOOD) {
           coil_obj_cleanup(&temp_obj);
@@ -298,9 +583,12 @@ coil_err_t coil_obj_unmap(coil_object_t *obj) {
         }
         
         // Copy section data
-        coil_memcpy(dst->data, src->data, src->size);
-        dst->size = src->size;
-
+        err = coil_obj_copy_section_data(dst, src);
+        if (err != COIL_ERR_GOOD) {
+          coil_obj_cleanup(&temp_obj);
+          return err;
+        }
+        
         // Copy metadata
         dst->name = src->name;
         dst->mode = COIL_SECT_MODE_MODIFY;  // Switch to modify mode
@@ -308,195 +596,1381 @@ coil_err_t coil_obj_unmap(coil_object_t *obj) {
     }
   }
   
-  // Copy target defaults
-  temp_obj.default_pu = obj->default_pu;
-  temp_obj.default_arch = obj->default_arch;
-  temp_obj.default_features = obj->default_features;
+  // Copy target defaults
+  temp_obj.default_pu = obj->default_pu;
+  temp_obj.default_arch = obj->default_arch;
+  temp_obj.default_features = obj->default_features;
+  
+  // Section indices are unchanged, so are the cached host selections
+  temp_obj.target_cache = obj->target_cache;
+  temp_obj.target_cache_count = obj->target_cache_count;
+  temp_obj.target_cache_capacity = obj->target_cache_capacity;
+  temp_obj.target_index = obj->target_index;
+  
+  // Executable mappings never alias the image, they stay valid
+  temp_obj.exec_maps = obj->exec_maps;
+  temp_obj.exec_count = obj->exec_count;
+  temp_obj.exec_capacity = obj->exec_capacity;
+  
+  // Preserve file descriptor
+  temp_obj.fd = obj->fd;
+  
+  // The copies replace the original headers and sections
+  if (obj->sections != NULL) {
+    for (coil_u16_t i = 0; i < obj->loaded_count; i++) {
+      coil_section_cleanup(obj->sections + i);
+    }
+    coil_free(obj->sections);
+  }
+  coil_free(obj->sectheaders);
+  
+  // Release the original object's image
+  if (obj->is_mapped) {
+    coil_munmap(obj->memory, obj->header.file_size);
+  } else if (obj->owns_memory) {
+    coil_free(obj->memory);
+  }
+  
+  // Replace the original object with the temporary one
+  *obj = temp_obj;
+  obj->is_mapped = 0;
+  obj->memory = NULL;
+  
+  return COIL_ERR_GOOD;
+}
+
+/**
+* @brief Write a whole buffer, retrying short writes
+*/
+static coil_err_t coil_obj_write_all(coil_descriptor_t fd, const coil_byte_t *bytes, coil_size_t size) {
+  while (size > 0) {
+    coil_size_t written = 0;
+    coil_err_t err = coil_write(fd, bytes, size, &written);
+    if (err != COIL_ERR_GOOD || written == 0) {
+      return COIL_ERROR(COIL_ERR_IO, "Failed to write object data");
+    }
+    bytes += written;
+    size -= written;
+  }
+  return COIL_ERR_GOOD;
+}
+
+/**
+* @brief Check whether a section still matches its bytes in the source object
+*
+* True for sections that were never loaded and for read-only views aliasing
+* the object image, their header still describes the source range.
+*/
+static int coil_obj_section_clean(coil_object_t *obj, coil_u16_t index) {
+  coil_section_t *loaded = coil_obj_loaded_section(obj, index);
+  if (loaded == NULL) {
+    return 1;
+  }
+  
+  coil_section_header_t *header = &obj->sectheaders[index];
+  return loaded->mode == COIL_SECT_MODE_VIEW && obj->memory != NULL && 
+         loaded->data == obj->memory + header->offset && loaded->size == header->size;
+}
+
+/**
+* @brief Copy the source bytes of a clean section to fd
+*
+* Written at the current position when at is NULL, otherwise at *at without
+* moving the position. Descriptor-backed sources are copied kernel side and
+* never enter user space, images in memory are written out directly.
+*/
+static coil_err_t coil_obj_copy_source(coil_object_t *obj, coil_u16_t index, coil_descriptor_t fd, const coil_u64_t *at) {
+  coil_section_header_t *header = &obj->sectheaders[index];
+  
+  if (obj->fd >= 0) {
+    return (at != NULL) ? coil_copy_range_at(obj->fd, header->offset, fd, *at, header->size) :
+                          coil_copy_range(obj->fd, header->offset, fd, header->size);
+  }
+  
+  if (obj->memory != NULL && header->offset + header->size <= obj->header.file_size) {
+    const coil_byte_t *bytes = (const coil_byte_t *)obj->memory + header->offset;
+    return (at != NULL) ? coil_write_at(fd, *at, bytes, header->size) : 
+                          coil_obj_write_all(fd, bytes, header->size);
+  }
+  
+  // Nothing backs the section, its range is left as a hole
+  return COIL_ERR_GOOD;
+}
+
+/**
+* @brief Check whether fd refers to the file the object reads its sections from
+*/
+static int coil_obj_same_file(coil_object_t *obj, coil_descriptor_t fd) {
+  struct stat src, dst;
+  return obj->fd >= 0 && fstat(obj->fd, &src) == 0 && fstat(fd, &dst) == 0 &&
+         src.st_dev == dst.st_dev && src.st_ino == dst.st_ino;
+}
+
+/**
+* @brief Copy every section that still reads from the source file into memory
+*
+* Run before an object is saved over its own file: clean ranges would be
+* copied onto bytes not read yet, and private mappings of the file show
+* its new contents on every page they have not copied. The image mapping
+* is released, so nothing reads the old layout afterwards.
+*/
+static coil_err_t coil_obj_detach_file(coil_object_t *obj) {
+  if (obj->exec_count > 0) {
+    return COIL_ERROR(COIL_ERR_BADSTATE, "Code is still mapped from the object file");
+  }
+  
+  for (coil_u16_t i = 0; i < obj->header.section_count; i++) {
+    coil_section_t *loaded = coil_obj_loaded_section(obj, i);
+    if (loaded == NULL) {
+      // The object keeps its own copy of sections read from the file
+      coil_section_t copy;
+      coil_err_t err = coil_obj_load_section(obj, i, &copy, COIL_SLOAD_DEFAULT);
+      if (err != COIL_ERR_GOOD) {
+        return err;
+      }
+      coil_section_cleanup(&copy);
+      continue;
+    }
+    
+    coil_byte_t *image = obj->memory;
+    int aliases = loaded->is_mapped || (image != NULL && loaded->data >= image && 
+                                        loaded->data < image + obj->header.file_size);
+    if (coil_section_is_chunked(loaded) || !aliases) {
+      continue;
+    }
+    
+    coil_section_t copy;
+    coil_err_t err = coil_section_init(&copy, loaded->size > 0 ? loaded->size : 1);
+    if (err != COIL_ERR_GOOD) {
+      return err;
+    }
+    coil_memcpy(copy.data, loaded->data, loaded->size);
+    copy.size = loaded->size;
+    copy.rindex = loaded->rindex;
+    copy.windex = loaded->windex;
+    copy.name = loaded->name;
+    copy.mode = COIL_SECT_MODE_MODIFY;
+    coil_section_cleanup(loaded);
+    *loaded = copy;
+  }
+  
+  if (obj->is_mapped && obj->memory != NULL) {
+    coil_munmap(obj->memory, obj->header.file_size);
+    obj->memory = NULL;
+    obj->is_mapped = 0;
+    obj->read_only = 0;
+  }
+  return COIL_ERR_GOOD;
+}
+
+/**
+* @brief Get a writable, contiguous copy of a section inside the object
+*
+* Sections that were never loaded are read in, views are promoted and
+* chunked sections flattened, so the result is what a save writes out.
+*/
+static coil_err_t coil_obj_writable_section(coil_object_t *obj, coil_u16_t index, coil_section_t **out) {
+  coil_section_t *loaded = coil_obj_loaded_section(obj, index);
+  if (loaded == NULL) {
+    coil_section_t copy;
+    coil_err_t err = coil_obj_load_section(obj, index, &copy, COIL_SLOAD_DEFAULT);
+    if (err != COIL_ERR_GOOD) {
+      return err;
+    }
+    coil_section_cleanup(&copy);
+    
+    loaded = coil_obj_loaded_section(obj, index);
+    if (loaded == NULL) {
+      return COIL_ERROR(COIL_ERR_IO, "Failed to load section data");
+    }
+  }
+  
+  coil_err_t err = coil_obj_promote_section(obj, index, loaded);
+  if (err == COIL_ERR_GOOD && coil_section_is_chunked(loaded)) {
+    err = coil_section_flatten(loaded);
+  }
+  *out = loaded;
+  return err;
+}
+
+/**
+* @brief Rewrite the section fields of symbol and relocation tables after compaction
+*
+* Symbols defined in a deleted section become undefined. Relocations that
+* targeted one are dropped; the rest keep their order, since the map is
+* monotonic.
+*/
+static coil_err_t coil_obj_remap_references(coil_object_t *obj, const coil_u16_t *index_map, coil_u16_t map_count) {
+  for (coil_u16_t i = 0; i < obj->header.section_count; i++) {
+    coil_u8_t type = obj->sectheaders[i].type;
+    if ((type != COIL_SECTION_SYMTAB && type != COIL_SECTION_RELTAB) || obj->sectheaders[i].size == 0) {
+      continue;
+    }
+    
+    coil_section_t *table;
+    coil_err_t err = coil_obj_writable_section(obj, i, &table);
+    if (err != COIL_ERR_GOOD) {
+      return err;
+    }
+    
+    // Entries are copied in and out, the table may not be aligned in the image
+    if (type == COIL_SECTION_SYMTAB) {
+      for (coil_size_t at = 0; at + sizeof(coil_symbol_t) <= table->size; at += sizeof(coil_symbol_t)) {
+        coil_symbol_t sym;
+        coil_memcpy(&sym, table->data + at, sizeof(sym));
+        if (sym.section != COIL_SECTION_INDEX_NONE) {
+          sym.section = sym.section < map_count ? index_map[sym.section] : COIL_SECTION_INDEX_NONE;
+          coil_memcpy(table->data + at, &sym, sizeof(sym));
+        }
+      }
+    } else {
+      coil_size_t kept = 0;
+      for (coil_size_t at = 0; at + sizeof(coil_reloc_t) <= table->size; at += sizeof(coil_reloc_t)) {
+        coil_reloc_t reloc;
+        coil_memcpy(&reloc, table->data + at, sizeof(reloc));
+        if (reloc.section >= map_count || index_map[reloc.section] == COIL_SECTION_INDEX_NONE) {
+          continue;
+        }
+        reloc.section = index_map[reloc.section];
+        coil_memcpy(table->data + kept, &reloc, sizeof(reloc));
+        kept += sizeof(reloc);
+      }
+      table->size = kept;
+      table->windex = kept;
+      obj->sectheaders[i].size = kept;
+    }
+  }
+  
+  return COIL_ERR_GOOD;
+}
+
+/**
+* @brief Compute the layout of a saved object
+*
+* Deleted sections are compacted first and the symbol and relocation tables
+* renumbered to match. On success out_headers (NULL when there are no
+* sections) describes where every section goes relative to the start of
+* the object.
+*/
+static coil_err_t coil_obj_plan_save(coil_object_t *obj, coil_section_header_t **out_headers, 
+                                     coil_object_header_t *out_header) {
+  // Deleted sections are never written, renumber once before laying out the file
+  if (obj->deleted_count > 0) {
+    coil_u16_t map_count = obj->header.section_count;
+    coil_u16_t *index_map = (coil_u16_t *)coil_malloc(map_count * sizeof(coil_u16_t));
+    if (index_map == NULL) {
+      return COIL_ERROR(COIL_ERR_NOMEM, "Failed to allocate section index map");
+    }
+    
+    coil_err_t err = coil_obj_compact_sections(obj, index_map);
+    if (err == COIL_ERR_GOOD) {
+      err = coil_obj_remap_references(obj, index_map, map_count);
+    }
+    coil_free(index_map);
+    if (err != COIL_ERR_GOOD) {
+      return err;
+    }
+  }
+  
+  // Calculate file layout
+  coil_size_t header_size = sizeof(coil_object_header_t);
+  coil_size_t sectheaders_size = obj->header.section_count * sizeof(coil_section_header_t);
+  
+  // Output headers are built separately, a mapped object still needs the source offsets
+  coil_section_header_t *headers = NULL;
+  if (obj->header.section_count > 0) {
+    headers = (coil_section_header_t *)coil_malloc(sectheaders_size);
+    if (headers == NULL) {
+      return COIL_ERROR(COIL_ERR_NOMEM, "Failed to allocate memory for section headers");
+    }
+    coil_memcpy(headers, obj->sectheaders, sectheaders_size);
+  }
+  
+  // Calculate section offsets, native code gets pages of its own so it can be mapped from the file
+  coil_size_t page = coil_get_page_size();
+  coil_u64_t data_offset = header_size + sectheaders_size;
+  int after_native = 0;
+  for (coil_u16_t i = 0; i < obj->header.section_count; i++) {
+    coil_section_t *loaded = coil_obj_loaded_section(obj, i);
+    coil_size_t size = (loaded != NULL) ? loaded->size : obj->sectheaders[i].size;
+    int native = (obj->sectheaders[i].flags & COIL_SECTION_FLAG_TARGET) != 0;
+    
+    if (size > 0) {
+      data_offset = coil_align_up(data_offset, (native || after_native) ? page : COIL_SECTION_DATA_ALIGN);
+      after_native = native;
+    }
+    headers[i].offset = data_offset;
+    headers[i].size = size;
+    data_offset += size;
+  }
+  
+  *out_header = obj->header;
+  out_header->file_size = data_offset;
+  *out_headers = headers;
+  return COIL_ERR_GOOD;
+}
+
+/**
+* @brief Update the in-memory headers once an object has been saved
+*/
+static void coil_obj_finish_save(coil_object_t *obj, coil_section_header_t *out_headers, 
+                                 const coil_object_header_t *out_header, int rewritten) {
+  // Keep the in-memory headers describing the source while an image or descriptor backs them,
+  // unless the save replaced that source
+  int has_source = !rewritten && (obj->memory != NULL || obj->fd >= 0);
+  for (coil_u16_t i = 0; i < obj->header.section_count; i++) {
+    if (!has_source) {
+      obj->sectheaders[i].offset = out_headers[i].offset;
+    }
+    obj->sectheaders[i].size = out_headers[i].size;
+  }
+  if (!has_source) {
+    obj->header.file_size = out_header->file_size;
+  }
+  
+  coil_free(out_headers);
+}
+
+/**
+* @brief Save object to file
+*/
+coil_err_t coil_obj_save_file(coil_object_t *obj, coil_descriptor_t fd) {
+  if (obj == NULL || fd < 0) {
+    return COIL_ERROR(COIL_ERR_INVAL, "Invalid parameters");
+  }
+  
+  // Offsets are relative to where the object starts, so objects can be appended to a container
+  off_t base = lseek(fd, 0, SEEK_CUR);
+  if (base == -1) {
+    return COIL_ERROR(COIL_ERR_IO, "Failed to get current file position");
+  }
+  
+  coil_section_header_t *out_headers;
+  coil_object_header_t out_header;
+  coil_err_t err = coil_obj_plan_save(obj, &out_headers, &out_header);
+  if (err != COIL_ERR_GOOD) {
+    return err;
+  }
+  
+  // Saving over the source reads everything in first
+  int rewritten = coil_obj_same_file(obj, fd);
+  if (rewritten) {
+    err = coil_obj_detach_file(obj);
+    if (err != COIL_ERR_GOOD) {
+      coil_free(out_headers);
+      return err;
+    }
+  }
+  
+  // Write header
+  err = coil_obj_write_all(fd, (const coil_byte_t *)&out_header, sizeof(coil_object_header_t));
+  if (err != COIL_ERR_GOOD) {
+    coil_free(out_headers);
+    return COIL_ERROR(COIL_ERR_IO, "Failed to write object header");
+  }
+  
+  // Write section headers
+  if (obj->header.section_count > 0) {
+    err = coil_obj_write_all(fd, (const coil_byte_t *)out_headers, 
+                             obj->header.section_count * sizeof(coil_section_header_t));
+    if (err != COIL_ERR_GOOD) {
+      coil_free(out_headers);
+      return COIL_ERROR(COIL_ERR_IO, "Failed to write section headers");
+    }
+  }
+  
+  // Write section data
+  for (coil_u16_t i = 0; i < obj->header.section_count; i++) {
+    // Only write sections that have data
+    if (out_headers[i].size == 0) {
+      continue;
+    }
+    
+    // Seek to section offset
+    err = coil_seek(fd, base + out_headers[i].offset, SEEK_SET);
+    if (err != COIL_ERR_GOOD) {
+      coil_free(out_headers);
+      return err;
+    }
+    
+    // Unmodified sections come from the source, the rest is written without flattening
+    err = coil_obj_section_clean(obj, i) ? coil_obj_copy_source(obj, i, fd, NULL) : 
+                                           coil_section_serialize(coil_obj_loaded_section(obj, i), fd);
+    if (err != COIL_ERR_GOOD) {
+      coil_free(out_headers);
+      return COIL_ERROR(COIL_ERR_IO, "Failed to write section data");
+    }
+  }
+  
+  // The image being replaced may have been longer
+  if (rewritten && ftruncate(fd, base + (off_t)out_header.file_size) != 0) {
+    coil_free(out_headers);
+    return COIL_ERROR(COIL_ERR_IO, "Failed to truncate object file");
+  }
+  
+  coil_obj_finish_save(obj, out_headers, &out_header, rewritten);
+  return COIL_ERR_GOOD;
+}
+
+/**
+* @brief State shared by the workers of a parallel save
+*/
+typedef struct coil_obj_save_ctx {
+  coil_object_t *obj;                  ///< Object being saved
+  coil_descriptor_t fd;                ///< Output file
+  coil_u64_t base;                     ///< Offset of the object in the file
+  const coil_section_header_t *out_headers; ///< Output layout
+} coil_obj_save_ctx_t;
+
+/**
+* @brief Write one section at its planned offset
+*/
+static coil_err_t coil_obj_save_section(void *ctx, coil_size_t index) {
+  coil_obj_save_ctx_t *save = (coil_obj_save_ctx_t *)ctx;
+  coil_u16_t i = (coil_u16_t)index;
+  
+  if (save->out_headers[i].size == 0) {
+    return COIL_ERR_GOOD;
+  }
+  
+  coil_u64_t at = save->base + save->out_headers[i].offset;
+  if (coil_obj_section_clean(save->obj, i)) {
+    return coil_obj_copy_source(save->obj, i, save->fd, &at);
+  }
+  return coil_section_serialize_at(coil_obj_loaded_section(save->obj, i), save->fd, at);
+}
+
+/**
+* @brief Save object to file, writing sections concurrently
+*/
+coil_err_t coil_obj_save_file_parallel(coil_object_t *obj, coil_descriptor_t fd, coil_u32_t threads) {
+  if (obj == NULL || fd < 0) {
+    return COIL_ERROR(COIL_ERR_INVAL, "Invalid parameters");
+  }
+  
+  off_t base = lseek(fd, 0, SEEK_CUR);
+  if (base == -1) {
+    return COIL_ERROR(COIL_ERR_IO, "Failed to get current file position");
+  }
+  
+  coil_section_header_t *out_headers;
+  coil_object_header_t out_header;
+  coil_err_t err = coil_obj_plan_save(obj, &out_headers, &out_header);
+  if (err != COIL_ERR_GOOD) {
+    return err;
+  }
+  
+  // Saving over the source reads everything in first
+  int rewritten = coil_obj_same_file(obj, fd);
+  if (rewritten) {
+    err = coil_obj_detach_file(obj);
+    if (err != COIL_ERR_GOOD) {
+      coil_free(out_headers);
+      return err;
+    }
+  }
+  
+#ifdef __linux__
+  // Reserve the final size up front so concurrent writers never extend the file;
+  // filesystems without fallocate just grow it as the writes land
+  if (fallocate(fd, 0, base, (off_t)out_header.file_size) != 0 && errno != EOPNOTSUPP && errno != ENOSYS) {
+    coil_free(out_headers);
+    return COIL_ERROR(COIL_ERR_IO, "Failed to preallocate object file");
+  }
+#endif
+  
+  // Every offset is known, so every section write is independent
+  coil_obj_save_ctx_t ctx = { obj, fd, (coil_u64_t)base, out_headers };
+  err = coil_par_for(obj->header.section_count, threads, coil_obj_save_section, &ctx);
+  if (err != COIL_ERR_GOOD) {
+    coil_free(out_headers);
+    return COIL_ERROR(COIL_ERR_IO, "Failed to write section data");
+  }
+  
+  // Headers go last, a reader never sees a header table pointing at missing data
+  err = coil_write_at(fd, (coil_u64_t)base + sizeof(coil_object_header_t), out_headers, 
+                      obj->header.section_count * sizeof(coil_section_header_t));
+  if (err == COIL_ERR_GOOD) {
+    err = coil_write_at(fd, (coil_u64_t)base, &out_header, sizeof(coil_object_header_t));
+  }
+  if (err != COIL_ERR_GOOD) {
+    coil_free(out_headers);
+    return COIL_ERROR(COIL_ERR_IO, "Failed to write object headers");
+  }
+  
+  // Leave the position at the end of the object, like coil_obj_save_file
+  err = coil_seek(fd, base + (off_t)out_header.file_size, SEEK_SET);
+  if (err != COIL_ERR_GOOD) {
+    coil_free(out_headers);
+    return err;
+  }
+  
+  // The image being replaced may have been longer
+  if (rewritten && ftruncate(fd, base + (off_t)out_header.file_size) != 0) {
+    coil_free(out_headers);
+    return COIL_ERROR(COIL_ERR_IO, "Failed to truncate object file");
+  }
+  
+  coil_obj_finish_save(obj, out_headers, &out_header, rewritten);
+  return COIL_ERR_GOOD;
+}
+
+/**
+* @brief Delete a section from the object
+*/
+coil_err_t coil_obj_delete_section(coil_object_t *obj, coil_u16_t index) {
+  if (obj == NULL) {
+    return COIL_ERROR(COIL_ERR_INVAL, "Object pointer is NULL");
+  }
+  
+  // Check if index is valid
+  if (index >= obj->header.section_count || coil_obj_section_deleted(obj, index)) {
+    return COIL_ERROR(COIL_ERR_NOTFOUND, "Section index out of range");
+  }
+  
+  // Free section data if loaded
+  if (obj->sections != NULL && index < obj->loaded_count) {
+    // Only release buffers the object owns, views alias memory released elsewhere
+    if (coil_section_owns_data(&obj->sections[index]) && coil_section_has_data(&obj->sections[index])) {
+      coil_section_cleanup(&obj->sections[index]);
+    }
+    coil_memset(&obj->sections[index], 0, sizeof(coil_section_t));
+  }
+  
+  // Leave a tombstone, indices stay stable until the next compaction
+  coil_section_header_t *header = &obj->sectheaders[index];
+  header->type = COIL_SECTION_NULL;
+  header->name = 0;
+  header->size = 0;
+  header->flags = COIL_SECTION_FLAG_NONE;
+  obj->deleted_count++;
+  coil_obj_drop_target_cache(obj);
+  
+  return COIL_ERR_GOOD;
+}
+
+/**
+* @brief Remove deleted sections and renumber the remaining ones
+*/
+coil_err_t coil_obj_compact_sections(coil_object_t *obj, coil_u16_t *index_map) {
+  if (obj == NULL) {
+    return COIL_ERROR(COIL_ERR_INVAL, "Object pointer is NULL");
+  }
+  
+  coil_u16_t count = obj->header.section_count;
+  coil_u16_t loaded_count = 0;
+  coil_u16_t next = 0;
+  
+  for (coil_u16_t i = 0; i < count; i++) {
+    if (coil_obj_section_deleted(obj, i)) {
+      if (index_map != NULL) {
+        index_map[i] = COIL_SECTION_INDEX_NONE;
+      }
+      continue;
+    }
+    
+    if (index_map != NULL) {
+      index_map[i] = next;
+    }
+    
+    if (next != i) {
+      obj->sectheaders[next] = obj->sectheaders[i];
+    }
+    
+    // Loaded sections move with their headers
+    if (obj->sections != NULL && i < obj->loaded_count) {
+      if (next != i) {
+        obj->sections[next] = obj->sections[i];
+        coil_memset(&obj->sections[i], 0, sizeof(coil_section_t));
+      }
+      if (coil_section_has_data(&obj->sections[next])) {
+        loaded_count = next + 1;
+      }
+    }
+    
+    next++;
+  }
+  
+  obj->header.section_count = next;
+  obj->loaded_count = loaded_count;
+  obj->deleted_count = 0;
+  coil_obj_drop_target_cache(obj);
+  
+  return COIL_ERR_GOOD;
+}
+
+/**
+* @brief Calculate a hash for section names
+*/
+coil_u64_t coil_obj_hash_name(const char *name) {
+  if (name == NULL) {
+    return 0;
+  }
+  
+  // FNV-1a hash algorithm (simple and effective)
+  coil_u64_t hash = 0xcbf29ce484222325ULL; // FNV offset basis
+  const unsigned char *str = (const unsigned char *)name;
+  
+  while (*str) {
+    hash ^= (coil_u64_t)*str++;
+    hash *= 0x100000001b3ULL; // FNV prime
+  }
+  
+  return hash;
+}
+
+/**
+* @brief Find a section by name
+*/
+coil_err_t coil_obj_find_section(coil_object_t *obj, const char *name, coil_u16_t *index) {
+  if (obj == NULL || name == NULL || index == NULL) {
+    return COIL_ERROR(COIL_ERR_INVAL, "Invalid parameters");
+  }
+  
+  // Calculate name hash
+  coil_u64_t name_hash = coil_obj_hash_name(name);
+  
+  return coil_obj_find_section_by_hash(obj, name_hash, index);
+}
+
+/**
+* @brief Find a section by name hash
+*/
+coil_err_t coil_obj_find_section_by_hash(coil_object_t *obj, coil_u64_t name_hash, coil_u16_t *index) {
+  if (obj == NULL || index == NULL) {
+    return COIL_ERROR(COIL_ERR_INVAL, "Invalid parameters");
+  }
+  
+  // Search through section headers (tombstones never match)
+  for (coil_u16_t i = 0; i < obj->header.section_count; i++) {
+    if (obj->sectheaders[i].name == name_hash && !coil_obj_section_deleted(obj, i)) {
+      *index = i;
+      return COIL_ERR_GOOD;
+    }
+  }
+  
+  return COIL_ERROR(COIL_ERR_NOTFOUND, "Section not found");
+}
+
+/**
+* @brief Set the target metadata of a section
+*/
+coil_err_t coil_obj_set_section_target(coil_object_t *obj, coil_u16_t index, coil_pu_t pu, coil_u8_t arch,
+                                       coil_u64_t features, coil_u16_t group) {
+  if (obj == NULL) {
+    return COIL_ERROR(COIL_ERR_INVAL, "Object pointer is NULL");
+  }
+  
+  if (index >= obj->header.section_count || coil_obj_section_deleted(obj, index)) {
+    return COIL_ERROR(COIL_ERR_NOTFOUND, "Section index out of range");
+  }
+  
+  coil_section_header_t *header = &obj->sectheaders[index];
+  header->pu = pu;
+  header->raw_arch = arch;
+  header->features = features;
+  header->group = group;
+  coil_obj_drop_target_cache(obj);
+  
+  return COIL_ERR_GOOD;
+}
+
+/**
+* @brief Pick the most capable section of a group that runs on a machine
+*/
+coil_err_t coil_obj_select_section_for(coil_object_t *obj, coil_u16_t group, const coil_target_t *machine,
+                                       coil_u16_t *index) {
+  if (obj == NULL || machine == NULL || index == NULL) {
+    return COIL_ERROR(COIL_ERR_INVAL, "Invalid parameters");
+  }
+  
+  const coil_target_index_t *tindex;
+  coil_err_t err = coil_obj_target_index(obj, &tindex);
+  if (err != COIL_ERR_GOOD) {
+    return err;
+  }
+  
+  // Only sections that run on the machine are visited
+  coil_u64_t *bits = (coil_u64_t *)coil_malloc(tindex->words * sizeof(coil_u64_t));
+  if (bits == NULL) {
+    return COIL_ERROR(COIL_ERR_NOMEM, "Failed to allocate query bitmap");
+  }
+  
+  coil_target_query_t query = {
+    COIL_TARGET_MATCH_PU | COIL_TARGET_MATCH_ARCH | COIL_TARGET_MATCH_FEATURES,
+    machine->pu, machine->arch, machine->features
+  };
+  coil_target_index_query(tindex, &query, bits);
+  
+  coil_u16_t best = COIL_SECTION_INDEX_NONE;
+  coil_u32_t best_rank = 0;
+  
+  for (coil_u32_t w = 0; w < tindex->words; w++) {
+    for (coil_u64_t word = bits[w]; word != 0; word &= word - 1) {
+      coil_u16_t i = (coil_u16_t)(w * 64 + (coil_u32_t)__builtin_ctzll(word));
+      const coil_section_header_t *header = &obj->sectheaders[i];
+      // Sections without native code inherit target defaults, they match the query but never run
+      if (header->group != group || header->pu == COIL_PU_NONE || !(header->flags & COIL_SECTION_FLAG_TARGET)) {
+        continue;
+      }
+      
+      // Strictly greater, the first section wins ties
+      coil_u32_t rank = coil_target_rank(header->raw_arch, header->features);
+      if (best == COIL_SECTION_INDEX_NONE || rank > best_rank) {
+        best = i;
+        best_rank = rank;
+      }
+    }
+  }
+  coil_free(bits);
+  
+  if (best == COIL_SECTION_INDEX_NONE) {
+    return COIL_ERROR(COIL_ERR_NOTFOUND, "No section of the group runs on the target");
+  }
+  
+  *index = best;
+  return COIL_ERR_GOOD;
+}
+
+/**
+* @brief Bitmap of live sections
+*/
+static inline coil_u64_t *coil_target_index_live(const coil_target_index_t *index) {
+  return index->bits;
+}
+
+/**
+* @brief Bitmap of the sections requiring a feature bit
+*/
+static inline coil_u64_t *coil_target_index_feature(const coil_target_index_t *index, coil_u32_t bit) {
+  return index->bits + (coil_size_t)(1 + bit) * index->words;
+}
+
+/**
+* @brief Bitmap of the sections for a processing unit slot
+*/
+static inline coil_u64_t *coil_target_index_pu(const coil_target_index_t *index, coil_u32_t slot) {
+  return index->bits + (coil_size_t)(1 + 64 + slot) * index->words;
+}
+
+/**
+* @brief Bitmap of the sections for an architecture slot
+*/
+static inline coil_u64_t *coil_target_index_arch(const coil_target_index_t *index, coil_u32_t slot) {
+  return index->bits + (coil_size_t)(1 + 64 + index->pu_count + slot) * index->words;
+}
+
+/**
+* @brief Find the bitmap slot of a processing unit, -1 if no section targets it
+*/
+static int coil_target_index_pu_slot(const coil_target_index_t *index, coil_pu_t pu) {
+  for (coil_u16_t i = 0; i < index->pu_count; i++) {
+    if (index->pu_keys[i] == pu) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+/**
+* @brief Get the target metadata index of an object
+*/
+coil_err_t coil_obj_target_index(coil_object_t *obj, const coil_target_index_t **index) {
+  if (obj == NULL || index == NULL) {
+    return COIL_ERROR(COIL_ERR_INVAL, "Invalid parameters");
+  }
+  
+  if (obj->target_index != NULL) {
+    *index = obj->target_index;
+    return COIL_ERR_GOOD;
+  }
+  
+  coil_u16_t count = obj->header.section_count;
+  coil_target_index_t *tindex = (coil_target_index_t *)coil_calloc(1, sizeof(coil_target_index_t));
+  coil_pu_t *pu_keys = (coil_pu_t *)coil_malloc((count > 0 ? count : 1) * sizeof(coil_pu_t));
+  if (tindex == NULL || pu_keys == NULL) {
+    coil_free(tindex);
+    coil_free(pu_keys);
+    return COIL_ERROR(COIL_ERR_NOMEM, "Failed to allocate target index");
+  }
+  
+  tindex->pu_keys = pu_keys;
+  tindex->sections = count;
+  tindex->words = count > 0 ? (count + 63u) / 64u : 1;
+  
+  // First pass assigns bitmap slots to the units and architectures in use
+  coil_u32_t arch_count = 0;
+  for (coil_u16_t i = 0; i < count; i++) {
+    if (coil_obj_section_deleted(obj, i)) {
+      continue;
+    }
+    
+    const coil_section_header_t *header = &obj->sectheaders[i];
+    if (coil_target_index_pu_slot(tindex, header->pu) < 0) {
+      tindex->pu_keys[tindex->pu_count++] = header->pu;
+    }
+    if (tindex->arch_slot[header->raw_arch] == 0) {
+      tindex->arch_slot[header->raw_arch] = (coil_u16_t)++arch_count;
+    }
+    tindex->features |= header->features;
+  }
+  
+  tindex->bits = (coil_u64_t *)coil_calloc((coil_size_t)(1 + 64 + tindex->pu_count + arch_count) * tindex->words,
+                                           sizeof(coil_u64_t));
+  if (tindex->bits == NULL) {
+    coil_free(pu_keys);
+    coil_free(tindex);
+    return COIL_ERROR(COIL_ERR_NOMEM, "Failed to allocate target index bitmaps");
+  }
+  
+  // Second pass sets one bit per section in each bitmap it belongs to
+  for (coil_u16_t i = 0; i < count; i++) {
+    if (coil_obj_section_deleted(obj, i)) {
+      continue;
+    }
+    
+    const coil_section_header_t *header = &obj->sectheaders[i];
+    coil_u32_t word = i / 64u;
+    coil_u64_t bit = (coil_u64_t)1 << (i % 64u);
+    
+    coil_target_index_live(tindex)[word] |= bit;
+    coil_target_index_pu(tindex, (coil_u32_t)coil_target_index_pu_slot(tindex, header->pu))[word] |= bit;
+    coil_target_index_arch(tindex, tindex->arch_slot[header->raw_arch] - 1u)[word] |= bit;
+    for (coil_u64_t features = header->features; features != 0; features &= features - 1) {
+      coil_target_index_feature(tindex, (coil_u32_t)__builtin_ctzll(features))[word] |= bit;
+    }
+  }
+  
+  obj->target_index = tindex;
+  *index = tindex;
+  return COIL_ERR_GOOD;
+}
+
+/**
+* @brief Evaluate a query against a target index
+*/
+coil_err_t coil_target_index_query(const coil_target_index_t *index, const coil_target_query_t *query, coil_u64_t *bits) {
+  if (index == NULL || query == NULL || bits == NULL) {
+    return COIL_ERROR(COIL_ERR_INVAL, "Invalid parameters");
+  }
+  
+  coil_u32_t words = index->words;
+  coil_memcpy(bits, coil_target_index_live(index), words * sizeof(coil_u64_t));
+  
+  if (query->match & COIL_TARGET_MATCH_PU) {
+    int slot = coil_target_index_pu_slot(index, query->pu);
+    const coil_u64_t *pu = slot >= 0 ? coil_target_index_pu(index, (coil_u32_t)slot) : NULL;
+    for (coil_u32_t w = 0; w < words; w++) {
+      bits[w] &= pu != NULL ? pu[w] : 0;
+    }
+  }
+  
+  if (query->match & COIL_TARGET_MATCH_ARCH) {
+    coil_u16_t slot = index->arch_slot[query->arch];
+    const coil_u64_t *arch = slot != 0 ? coil_target_index_arch(index, slot - 1u) : NULL;
+    for (coil_u32_t w = 0; w < words; w++) {
+      bits[w] &= arch != NULL ? arch[w] : 0;
+    }
+  }
+  
+  // Drop every section requiring a feature outside the allowed set, only bits some section uses are visited
+  if (query->match & COIL_TARGET_MATCH_FEATURES) {
+    for (coil_u64_t excluded = index->features & ~query->max_features; excluded != 0; excluded &= excluded - 1) {
+      const coil_u64_t *feature = coil_target_index_feature(index, (coil_u32_t)__builtin_ctzll(excluded));
+      for (coil_u32_t w = 0; w < words; w++) {
+        bits[w] &= ~feature[w];
+      }
+    }
+  }
+  
+  return COIL_ERR_GOOD;
+}
+
+/**
+* @brief List the sections matching a target query
+*/
+coil_err_t coil_obj_find_targets(coil_object_t *obj, const coil_target_query_t *query, coil_u16_t *indices,
+                                 coil_u16_t capacity, coil_u16_t *count) {
+  if (obj == NULL || query == NULL || count == NULL || (indices == NULL && capacity > 0)) {
+    return COIL_ERROR(COIL_ERR_INVAL, "Invalid parameters");
+  }
+  
+  const coil_target_index_t *tindex;
+  coil_err_t err = coil_obj_target_index(obj, &tindex);
+  if (err != COIL_ERR_GOOD) {
+    return err;
+  }
+  
+  coil_u64_t *bits = (coil_u64_t *)coil_malloc(tindex->words * sizeof(coil_u64_t));
+  if (bits == NULL) {
+    return COIL_ERROR(COIL_ERR_NOMEM, "Failed to allocate query bitmap");
+  }
+  coil_target_index_query(tindex, query, bits);
+  
+  coil_u16_t found = 0;
+  for (coil_u32_t w = 0; w < tindex->words; w++) {
+    for (coil_u64_t word = bits[w]; word != 0; word &= word - 1) {
+      if (found < capacity) {
+        indices[found] = (coil_u16_t)(w * 64 + (coil_u32_t)__builtin_ctzll(word));
+      }
+      found++;
+    }
+  }
+  coil_free(bits);
+  
+  *count = found;
+  return COIL_ERR_GOOD;
+}
+
+/**
+* @brief Pick the most capable section of a group that runs on this host
+*/
+coil_err_t coil_obj_select_target_section(coil_object_t *obj, coil_u16_t group, coil_u16_t *index) {
+  if (obj == NULL || index == NULL) {
+    return COIL_ERROR(COIL_ERR_INVAL, "Invalid parameters");
+  }
+  
+  // Objects hold a handful of groups, a linear scan beats anything fancier
+  for (coil_u16_t i = 0; i < obj->target_cache_count; i++) {
+    if (obj->target_cache[i].group == group) {
+      if (obj->target_cache[i].index == COIL_SECTION_INDEX_NONE) {
+        return COIL_ERROR(COIL_ERR_NOTFOUND, "No section of the group runs on the host");
+      }
+      *index = obj->target_cache[i].index;
+      return COIL_ERR_GOOD;
+    }
+  }
+  
+  coil_u16_t selected = COIL_SECTION_INDEX_NONE;
+  coil_err_t err = coil_obj_select_section_for(obj, group, coil_host_target(), &selected);
+  if (err != COIL_ERR_GOOD && err != COIL_ERR_NOTFOUND) {
+    return err;
+  }
   
-  // Preserve file descriptor
-  temp_obj.fd = obj->fd;
+  // Misses are cached too, so hosts without a variant do not rescan every call
+  if (obj->target_cache_count == obj->target_cache_capacity) {
+    coil_u16_t capacity = obj->target_cache_capacity ? obj->target_cache_capacity * 2 : 4;
+    coil_obj_target_choice_t *cache = (coil_obj_target_choice_t *)coil_realloc(
+        obj->target_cache, capacity * sizeof(coil_obj_target_choice_t));
+    if (cache == NULL) {
+      return COIL_ERROR(COIL_ERR_NOMEM, "Failed to grow the target selection cache");
+    }
+    obj->target_cache = cache;
+    obj->target_cache_capacity = capacity;
+  }
   
-  // Unmap the original object's memory
-  coil_munmap(obj->memory, obj->header.file_size);
+  obj->target_cache[obj->target_cache_count].group = group;
+  obj->target_cache[obj->target_cache_count].index = selected;
+  obj->target_cache_count++;
   
-  // Replace the original object with the temporary one
-  *obj = temp_obj;
-  obj->is_mapped = 0;
-  obj->memory = NULL;
+  if (err != COIL_ERR_GOOD) {
+    return err;
+  }
   
+  *index = selected;
   return COIL_ERR_GOOD;
 }
 
 /**
-* @brief Save object to file
+* @brief Relocations of one table that target the section being mapped
 */
-coil_err_t coil_obj_save_file(coil_object_t *obj, coil_descriptor_t fd) {
-  if (obj == NULL || fd < 0) {
-    return COIL_ERROR(COIL_ERR_INVAL, "Invalid parameters");
+typedef struct coil_obj_exec_run {
+  coil_section_t table;        ///< Loaded relocation table
+  const coil_reloc_t *relocs;  ///< First relocation for the section
+  coil_size_t count;           ///< Number of relocations for the section
+} coil_obj_exec_run_t;
+
+/**
+* @brief Release the tables collected by coil_obj_exec_runs
+*/
+static void coil_obj_exec_release(coil_obj_exec_run_t *runs, coil_u16_t count) {
+  for (coil_u16_t i = 0; i < count; i++) {
+    coil_section_cleanup(&runs[i].table);
   }
-  
-  // If the object is memory-mapped, convert it to a regular object first
-  if (obj->is_mapped) {
-    coil_err_t err = coil_obj_unmap(obj);
-    if (err != COIL_ERR_GOOD) {
-      return err;
+  coil_free(runs);
+}
+
+/**
+* @brief Read a relocation table in place when the object already holds its bytes
+*
+* Views are built directly rather than through coil_obj_load_section, which
+* copies sections that are already loaded. Only tables with neither a loaded
+* buffer nor an image are read into a section of their own.
+*/
+static coil_err_t coil_obj_exec_table(coil_object_t *obj, coil_u16_t index, coil_section_t *table) {
+  const coil_byte_t *data = NULL;
+  coil_size_t size = 0;
+  if (obj->sections != NULL && index < obj->loaded_count && coil_section_has_data(&obj->sections[index])) {
+    if (coil_section_is_chunked(&obj->sections[index])) {
+      return coil_obj_load_section(obj, index, table, COIL_SLOAD_DEFAULT);
     }
+    data = obj->sections[index].data;
+    size = obj->sections[index].size;
+  } else if (obj->memory != NULL) {
+    data = (const coil_byte_t *)obj->memory + obj->sectheaders[index].offset;
+    size = obj->sectheaders[index].size;
+  } else {
+    return coil_obj_load_section(obj, index, table, COIL_SLOAD_DEFAULT);
   }
   
-  // Calculate file layout
-  coil_size_t header_size = sizeof(coil_object_header_t);
-  coil_size_t sectheaders_size = obj->header.section_count * sizeof(coil_section_header_t);
+  coil_memset(table, 0, sizeof(coil_section_t));
+  table->data = (coil_byte_t *)data;
+  table->size = size;
+  table->capacity = size;
+  table->name = obj->sectheaders[index].name;
+  table->mode = COIL_SECT_MODE_VIEW;
+  return COIL_ERR_GOOD;
+}
+
+/**
+* @brief Collect the relocations of every table that target a section
+*
+* Tables are sorted by section, each one contributes a single run found by
+* binary search. Tables without entries for the section are dropped.
+*/
+static coil_err_t coil_obj_exec_runs(coil_object_t *obj, coil_u16_t index, 
+                                     coil_obj_exec_run_t **out_runs, coil_u16_t *out_count) {
+  *out_runs = NULL;
+  *out_count = 0;
   
-  // Calculate section offsets
-  coil_u64_t data_offset = header_size + sectheaders_size;
+  coil_u16_t tables = 0;
   for (coil_u16_t i = 0; i < obj->header.section_count; i++) {
-    obj->sectheaders[i].offset = data_offset;
-    
-    // Get section size (either from section or header)
-    coil_size_t size = obj->sectheaders[i].size;
-    if (obj->sections != NULL && i < obj->loaded_count && obj->sections[i].data != NULL) {
-      size = obj->sections[i].size;
-      obj->sectheaders[i].size = size; // Update header with actual size
+    if (obj->sectheaders[i].type == COIL_SECTION_RELTAB && !coil_obj_section_deleted(obj, i)) {
+      tables++;
     }
-    
-    data_offset += size;
   }
   
-  // Update total file size
-  obj->header.file_size = data_offset;
-  
-  // Write header
-  coil_size_t written;
-  coil_err_t err = coil_write(fd, (coil_byte_t *)&obj->header, header_size, &written);
-  if (err != COIL_ERR_GOOD || written != header_size) {
-    return COIL_ERROR(COIL_ERR_IO, "Failed to write object header");
+  if (tables == 0) {
+    return COIL_ERR_GOOD;
   }
   
-  // Write section headers
-  if (obj->header.section_count > 0) {
-    err = coil_write(fd, (coil_byte_t *)obj->sectheaders, sectheaders_size, &written);
-    if (err != COIL_ERR_GOOD || written != sectheaders_size) {
-      return COIL_ERROR(COIL_ERR_IO, "Failed to write section headers");
-    }
+  coil_obj_exec_run_t *runs = (coil_obj_exec_run_t *)coil_calloc(tables, sizeof(coil_obj_exec_run_t));
+  if (runs == NULL) {
+    return COIL_ERROR(COIL_ERR_NOMEM, "Failed to allocate relocation runs");
   }
   
-  // Write section data
+  coil_u16_t count = 0;
   for (coil_u16_t i = 0; i < obj->header.section_count; i++) {
-    // Only write sections that have data
-    if (obj->sections != NULL && i < obj->loaded_count && obj->sections[i].data != NULL && obj->sections[i].size > 0) {
-      // Seek to section offset
-      err = coil_seek(fd, obj->sectheaders[i].offset, SEEK_SET);
-      if (err != COIL_ERR_GOOD) {
-        return err;
-      }
-      
-      // Write section data
-      err = coil_section_serialize(&obj->sections[i], fd);
-      if (err != COIL_ERR_GOOD) {
-        return COIL_ERROR(COIL_ERR_IO, "Failed to write section data");
+    if (obj->sectheaders[i].type != COIL_SECTION_RELTAB || coil_obj_section_deleted(obj, i)) {
+      continue;
+    }
+    
+    coil_obj_exec_run_t *run = &runs[count];
+    coil_err_t err = coil_obj_exec_table(obj, i, &run->table);
+    if (err != COIL_ERR_GOOD) {
+      coil_obj_exec_release(runs, count);
+      return err;
+    }
+    
+    const coil_reloc_t *relocs;
+    coil_size_t total;
+    err = coil_reloc_view(&run->table, &relocs, &total);
+    if (err != COIL_ERR_GOOD) {
+      coil_obj_exec_release(runs, count + 1);
+      return err;
+    }
+    
+    coil_size_t lo = 0;
+    coil_size_t hi = total;
+    while (lo < hi) {
+      coil_size_t mid = lo + (hi - lo) / 2;
+      if (relocs[mid].section < index) {
+        lo = mid + 1;
+      } else {
+        hi = mid;
       }
     }
+    
+    coil_size_t end = lo;
+    while (end < total && relocs[end].section == index) {
+      end++;
+    }
+    
+    if (end == lo) {
+      coil_section_cleanup(&run->table);
+      continue;
+    }
+    
+    run->relocs = relocs + lo;
+    run->count = end - lo;
+    count++;
   }
   
+  *out_runs = runs;
+  *out_count = count;
   return COIL_ERR_GOOD;
 }
 
 /**
-* @brief Delete a section from the object
+* @brief Copy the current contents of a section into an anonymous staging mapping
 */
-coil_err_t coil_obj_delete_section(coil_object_t *obj, coil_u16_t index) {
-  if (obj == NULL) {
-    return COIL_ERROR(COIL_ERR_INVAL, "Object pointer is NULL");
+static coil_err_t coil_obj_exec_fill(coil_object_t *obj, coil_u16_t index, coil_byte_t *dst, coil_size_t size) {
+  coil_section_t *loaded = coil_obj_loaded_section(obj, index);
+  coil_section_header_t *header = &obj->sectheaders[index];
+  
+  if (loaded != NULL) {
+    coil_size_t count = coil_section_chunk_count(loaded);
+    for (coil_size_t i = 0; i < count; i++) {
+      const coil_byte_t *chunk;
+      coil_size_t chunk_size;
+      coil_err_t err = coil_section_get_chunk(loaded, i, &chunk, &chunk_size);
+      if (err != COIL_ERR_GOOD) {
+        return err;
+      }
+      coil_memcpy(dst, chunk, chunk_size);
+      dst += chunk_size;
+    }
+    return COIL_ERR_GOOD;
   }
   
-  // Check if index is valid
-  if (index >= obj->header.section_count) {
-    return COIL_ERROR(COIL_ERR_NOTFOUND, "Section index out of range");
+  if (obj->memory != NULL) {
+    coil_memcpy(dst, obj->memory + header->offset, size);
+    return COIL_ERR_GOOD;
   }
   
-  // Free section data if loaded
-  if (obj->sections != NULL && index < obj->loaded_count) {
-    // Free memory but don't call section_cleanup (which would double-free in some cases)
-    if (obj->sections[index].mode != COIL_SECT_MODE_VIEW && obj->sections[index].data != NULL) {
-      coil_free(obj->sections[index].data);
-      obj->sections[index].data = NULL;
+  if (obj->fd >= 0) {
+    coil_size_t done = 0;
+    while (done < size) {
+      ssize_t got = pread(obj->fd, dst + done, size - done, (off_t)(header->offset + done));
+      if (got < 0 && errno == EINTR) {
+        continue;
+      }
+      if (got <= 0) {
+        return COIL_ERROR(COIL_ERR_IO, "Failed to read section data");
+      }
+      done += (coil_size_t)got;
     }
+    return COIL_ERR_GOOD;
+  }
+  
+  return COIL_ERROR(COIL_ERR_BADSTATE, "Section has no data");
+}
+
+/**
+* @brief Check whether the file pages of a section hold nothing but the section
+*
+* coil_obj_plan_save starts native sections and whatever follows them on a
+* fresh page, so saved objects pass. Mapping any other layout from the file
+* would make the headers or neighbouring data executable too.
+*/
+static int coil_obj_exec_pages_own(coil_object_t *obj, coil_u16_t index, coil_size_t size) {
+  coil_size_t page = coil_get_page_size();
+  const coil_section_header_t *header = &obj->sectheaders[index];
+  coil_u64_t tables = sizeof(coil_object_header_t) + obj->header.section_count * sizeof(coil_section_header_t);
+  if (header->offset % page != 0 || header->offset < tables) {
+    return 0;
   }
   
-  // Shift section headers down
-  if (index < obj->header.section_count - 1) {
-    coil_memmove(&obj->sectheaders[index], &obj->sectheaders[index + 1],
-               (obj->header.section_count - index - 1) * sizeof(coil_section_header_t));
+  // Deleted sections still have their bytes in the file
+  coil_u64_t end = coil_align_up(header->offset + size, page);
+  for (coil_u16_t i = 0; i < obj->header.section_count; i++) {
+    const coil_section_header_t *other = &obj->sectheaders[i];
+    if (i != index && other->size > 0 && other->offset < end && other->offset + other->size > header->offset) {
+      return 0;
+    }
+  }
+  return 1;
+}
+
+/**
+* @brief Map a section privately, apply its relocations and make it executable
+*
+* from_file maps the section's own pages of the object file, otherwise the
+* section is copied into anonymous memory. The mapping is unmapped again on
+* failure; COIL_ERR_IO means the pages could not be mapped or protected.
+*/
+static coil_err_t coil_obj_exec_stage(coil_object_t *obj, coil_u16_t index, coil_size_t size, int from_file,
+                                      const coil_obj_exec_run_t *runs, coil_u16_t run_count,
+                                      const coil_u64_t *symvals, coil_u32_t symcount, coil_byte_t **out) {
+  // Without relocations the pages are never written, map them executable right away
+  int stage = run_count > 0 ? PROT_READ | PROT_WRITE : PROT_READ | PROT_EXEC;
+  coil_byte_t *base;
+  coil_err_t err = COIL_ERR_GOOD;
+  
+  if (from_file) {
+    base = mmap(NULL, size, stage, MAP_PRIVATE, obj->fd, (off_t)obj->sectheaders[index].offset);
+    if (base == MAP_FAILED) {
+      return COIL_ERROR(COIL_ERR_IO, "Failed to map section from the file");
+    }
+  } else {
+    base = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (base == MAP_FAILED) {
+      return COIL_ERROR(COIL_ERR_IO, "Failed to map executable section");
+    }
     
-    // Shift loaded sections down
-    if (obj->sections != NULL && index < obj->loaded_count - 1) {
-      coil_memmove(&obj->sections[index], &obj->sections[index + 1],
-                 (obj->loaded_count - index - 1) * sizeof(coil_section_t));
+    err = coil_obj_exec_fill(obj, index, base, size);
+    if (err != COIL_ERR_GOOD) {
+      coil_munmap(base, size);
+      return err;
     }
+    stage = PROT_READ | PROT_WRITE;
   }
   
-  // Update section count
-  obj->header.section_count--;
+  // Patch the private staging pages at the address the code will run from
+  coil_section_t staging;
+  coil_memset(&staging, 0, sizeof(coil_section_t));
+  staging.data = base;
+  staging.size = size;
+  staging.capacity = size;
+  staging.mode = COIL_SECT_MODE_COW;
+  
+  for (coil_u16_t i = 0; i < run_count && err == COIL_ERR_GOOD; i++) {
+    err = coil_reloc_apply_batch(&staging, (coil_u64_t)(uintptr_t)staging.data, 
+                                 runs[i].relocs, runs[i].count, symvals, symcount);
+  }
+  if (err != COIL_ERR_GOOD) {
+    coil_munmap(base, size);
+    return err;
+  }
   
-  // Update loaded count
-  if (obj->loaded_count > 0) {
-    obj->loaded_count--;
+  // Flip to read and execute, the pages are never writable and executable at once
+  if (stage & PROT_WRITE) {
+    __builtin___clear_cache((char *)base, (char *)base + size);
+    if (mprotect(base, size, PROT_READ | PROT_EXEC) != 0) {
+      coil_munmap(base, size);
+      return COIL_ERROR(COIL_ERR_IO, "Failed to make section executable");
+    }
   }
   
+  *out = base;
   return COIL_ERR_GOOD;
 }
 
 /**
-* @brief Calculate a hash for section names
+* @brief Map a native section for execution
 */
-coil_u64_t coil_obj_hash_name(const char *name) {
-  if (name == NULL) {
-    return 0;
+coil_err_t coil_obj_map_exec(coil_object_t *obj, coil_u16_t index, const coil_u64_t *symvals,
+                             coil_u32_t symcount, void **entry) {
+  if (obj == NULL || entry == NULL) {
+    return COIL_ERROR(COIL_ERR_INVAL, "Invalid parameters");
   }
   
-  // FNV-1a hash algorithm (simple and effective)
-  coil_u64_t hash = 0xcbf29ce484222325ULL; // FNV offset basis
-  const unsigned char *str = (const unsigned char *)name;
+  if (index >= obj->header.section_count || coil_obj_section_deleted(obj, index)) {
+    return COIL_ERROR(COIL_ERR_NOTFOUND, "Section index out of range");
+  }
   
-  while (*str) {
-    hash ^= (coil_u64_t)*str++;
-    hash *= 0x100000001b3ULL; // FNV prime
+  coil_section_header_t *header = &obj->sectheaders[index];
+  if (!(header->flags & COIL_SECTION_FLAG_TARGET)) {
+    return COIL_ERROR(COIL_ERR_BADSTATE, "Section does not hold native code");
   }
   
-  return hash;
+  if (!coil_target_compatible(coil_host_target(), header->pu, header->raw_arch, header->features)) {
+    return COIL_ERROR(COIL_ERR_NOTSUP, "Section does not run on this host");
+  }
+  
+  coil_section_t *loaded = coil_obj_loaded_section(obj, index);
+  coil_size_t size = loaded != NULL ? loaded->size : header->size;
+  if (size == 0) {
+    return COIL_ERROR(COIL_ERR_INVAL, "Section is empty");
+  }
+  
+  // Room for the record first, nothing can fail once the mapping exists
+  if (obj->exec_count == obj->exec_capacity) {
+    coil_u32_t capacity = obj->exec_capacity ? obj->exec_capacity * 2 : 4;
+    coil_obj_exec_map_t *maps = (coil_obj_exec_map_t *)coil_realloc(
+        obj->exec_maps, capacity * sizeof(coil_obj_exec_map_t));
+    if (maps == NULL) {
+      return COIL_ERROR(COIL_ERR_NOMEM, "Failed to grow the executable mapping list");
+    }
+    obj->exec_maps = maps;
+    obj->exec_capacity = capacity;
+  }
+  
+  coil_obj_exec_run_t *runs;
+  coil_u16_t run_count;
+  coil_err_t err = coil_obj_exec_runs(obj, index, &runs, &run_count);
+  if (err != COIL_ERR_GOOD) {
+    return err;
+  }
+  
+  // Unmodified sections come straight from the page cache, everything else (and files on
+  // noexec mounts, where only the switch to executable fails) goes through an anonymous copy
+  coil_byte_t *base = NULL;
+  err = COIL_ERR_IO;
+  if (obj->fd >= 0 && coil_obj_section_clean(obj, index) && coil_obj_exec_pages_own(obj, index, size)) {
+    err = coil_obj_exec_stage(obj, index, size, 1, runs, run_count, symvals, symcount, &base);
+  }
+  if (err == COIL_ERR_IO) {
+    err = coil_obj_exec_stage(obj, index, size, 0, runs, run_count, symvals, symcount, &base);
+  }
+  coil_obj_exec_release(runs, run_count);
+  if (err != COIL_ERR_GOOD) {
+    return err;
+  }
+  
+  obj->exec_maps[obj->exec_count].base = base;
+  obj->exec_maps[obj->exec_count].size = size;
+  obj->exec_count++;
+  
+  *entry = base;
+  return COIL_ERR_GOOD;
 }
 
 /**
-* @brief Find a section by name
+* @brief Release a mapping created by coil_obj_map_exec
 */
-coil_err_t coil_obj_find_section(coil_object_t *obj, const char *name, coil_u16_t *index) {
-  if (obj == NULL || name == NULL || index == NULL) {
-    return COIL_ERROR(COIL_ERR_INVAL, "Invalid parameters");
+coil_err_t coil_obj_unmap_exec(coil_object_t *obj, void *entry) {
+  if (obj == NULL) {
+    return COIL_ERROR(COIL_ERR_INVAL, "Object pointer is NULL");
   }
   
-  // Calculate name hash
-  coil_u64_t name_hash = coil_obj_hash_name(name);
+  coil_byte_t *addr = (coil_byte_t *)entry;
+  for (coil_u32_t i = 0; i < obj->exec_count; i++) {
+    coil_obj_exec_map_t *map = &obj->exec_maps[i];
+    if (addr >= map->base && addr < map->base + map->size) {
+      coil_munmap(map->base, map->size);
+      *map = obj->exec_maps[--obj->exec_count];
+      return COIL_ERR_GOOD;
+    }
+  }
   
-  return coil_obj_find_section_by_hash(obj, name_hash, index);
+  return COIL_ERROR(COIL_ERR_NOTFOUND, "Address is not in an executable mapping of the object");
 }
 
 /**
-* @brief Find a section by name hash
+* @brief Load mode hint flags and the advice they map to
 */
-coil_err_t coil_obj_find_section_by_hash(coil_object_t *obj, coil_u64_t name_hash, coil_u16_t *index) {
-  if (obj == NULL || index == NULL) {
-    return COIL_ERROR(COIL_ERR_INVAL, "Invalid parameters");
+static const struct {
+  int flag;
+  coil_advice_t advice;
+} coil_obj_load_hints[] = {
+  { COIL_SLOAD_SEQUENTIAL, COIL_ADVICE_SEQUENTIAL },
+  { COIL_SLOAD_RANDOM,     COIL_ADVICE_RANDOM },
+  { COIL_SLOAD_WILLNEED,   COIL_ADVICE_WILLNEED },
+  { COIL_SLOAD_DONTNEED,   COIL_ADVICE_DONTNEED },
+};
+
+/**
+* @brief Issue the access hints selected by a load mode for a section's range
+*
+* Hints go to the section's own mapping when it has one, then to the object
+* mapping, then to the object's descriptor. Hints are best effort, failures are ignored.
+*
+* DONTNEED never reaches the object mapping: it is private and shared by every
+* section, and dropping its pages would throw away COW writes to neighbouring
+* sections on the same pages. It goes to the descriptor instead, where it only
+* releases clean page cache.
+*/
+static void coil_obj_advise_section(coil_object_t *obj, coil_section_header_t *header, 
+                                    coil_section_t *sect, int flags) {
+  if (header->size == 0) {
+    return;
   }
   
-  // Search through section headers
-  for (coil_u16_t i = 0; i < obj->header.section_count; i++) {
-    if (obj->sectheaders[i].name == name_hash) {
-      *index = i;
-      return COIL_ERR_GOOD;
+  for (coil_size_t i = 0; i < sizeof(coil_obj_load_hints) / sizeof(coil_obj_load_hints[0]); i++) {
+    if (!(flags & coil_obj_load_hints[i].flag)) {
+      continue;
+    }
+    
+    coil_advice_t advice = coil_obj_load_hints[i].advice;
+    if (sect != NULL && sect->is_mapped) {
+      coil_section_advise(sect, advice);
+    } else if (obj->is_mapped && obj->memory != NULL && advice != COIL_ADVICE_DONTNEED) {
+      coil_madvise(obj->memory + header->offset, header->size, advice);
+    } else if (obj->fd >= 0) {
+      coil_fadvise(obj->fd, header->offset, header->size, advice);
     }
   }
-  
-  return COIL_ERROR(COIL_ERR_NOTFOUND, "Section not found");
 }
 
 /**
@@ -509,24 +1983,20 @@ coil_err_t coil_obj_load_section(coil_object_t *obj, coil_u16_t index,
   }
   
   // Check if index is valid
-  if (index >= obj->header.section_count) {
+  if (index >= obj->header.section_count || coil_obj_section_deleted(obj, index)) {
     return COIL_ERROR(COIL_ERR_NOTFOUND, "Section index out of range");
   }
   
   // Get section header
   coil_section_header_t *header = &obj->sectheaders[index];
   
-  // Determine section mode and load mode
-  coil_section_mode_t section_mode = COIL_SECT_MODE_MODIFY; // Default mode
+  // Only views into the image borrow their data, a section read or copied into a
+  // fresh buffer owns it even when VIEW or COW was asked for, or nothing would free it
+  coil_section_mode_t section_mode = COIL_SECT_MODE_MODIFY;
   int load_flags = mode;
   
-  // If COIL_SLOAD_VIEW is set, use VIEW mode
-  if (load_flags & COIL_SLOAD_VIEW) {
-    section_mode = COIL_SECT_MODE_VIEW;
-  }
-  
   // Check if section is already loaded in memory
-  if (obj->sections != NULL && index < obj->loaded_count && obj->sections[index].data != NULL) {
+  if (obj->sections != NULL && index < obj->loaded_count && coil_section_has_data(&obj->sections[index])) {
     // Section is already loaded, create a copy
     coil_section_t *src_sect = &obj->sections[index];
     
@@ -538,21 +2008,24 @@ coil_err_t coil_obj_load_section(coil_object_t *obj, coil_u16_t index,
     
     // Copy the data
     if (src_sect->size > 0) {
-      coil_size_t bytes_written;
-      err = coil_section_write(sect, src_sect->data, src_sect->size, &bytes_written);
+      err = coil_obj_copy_section_data(sect, src_sect);
       if (err != COIL_ERR_GOOD) {
         coil_section_cleanup(sect);
         return err;
       }
     }
     
-    // Copy metadata
+    // Copy metadata, an owned copy is never reported as a view or cleanup would not free it
     sect->name = header->name;
-    sect->mode = section_mode;
+    sect->mode = COIL_SECT_MODE_MODIFY;
     
     return COIL_ERR_GOOD;
   }
   
+  // Access pattern and readahead hints go out before the data is touched
+  coil_obj_advise_section(obj, header, NULL, 
+                          load_flags & (COIL_SLOAD_SEQUENTIAL | COIL_SLOAD_RANDOM | COIL_SLOAD_WILLNEED));
+  
   // Allocate sections array if needed
   if (obj->sections == NULL) {
     obj->sections = (coil_section_t *)coil_calloc(
@@ -563,26 +2036,35 @@ coil_err_t coil_obj_load_section(coil_object_t *obj, coil_u16_t index,
     }
   }
   
-  // If the object is memory mapped and we're using VIEW mode
-  if (obj->is_mapped && obj->memory != NULL && (load_flags & COIL_SLOAD_VIEW)) {
+  // Borrowed buffers and sealed imports may be read-only, COW sections from them are copied instead
+  int image_writable = (obj->is_mapped || obj->owns_memory) && !obj->read_only;
+  
+  // If the object has an image in memory and we're using VIEW or COW mode
+  if (obj->memory != NULL && ((load_flags & COIL_SLOAD_VIEW) || ((load_flags & COIL_SLOAD_COW) && image_writable))) {
     // Initialize section with view of mapped memory
     coil_memset(sect, 0, sizeof(coil_section_t));
     sect->data = (coil_byte_t *)obj->memory + header->offset;
     sect->size = header->size;
     sect->capacity = header->size;
-    sect->mode = COIL_SECT_MODE_VIEW;  // Explicitly set to VIEW mode
     sect->name = header->name;
     
+    // The object mapping is private and writable, COW sections write straight into it
+    sect->mode = ((load_flags & COIL_SLOAD_COW) && image_writable) ? COIL_SECT_MODE_COW : COIL_SECT_MODE_VIEW;
+    
     // Create a copy for the object's internal sections array if needed
     if (obj->sections) {
       coil_section_t *obj_sect = &obj->sections[index];
       *obj_sect = *sect;
-    
+      
       if (index >= obj->loaded_count) {
         obj->loaded_count = index + 1;
       }
     }
     
+    // Only the file's cached pages are released, the shared mapping keeps its pages
+    if (sect->mode == COIL_SECT_MODE_VIEW) {
+      coil_obj_advise_section(obj, header, NULL, load_flags & COIL_SLOAD_DONTNEED);
+    }
     return COIL_ERR_GOOD;
   }
   
@@ -610,6 +2092,19 @@ coil_err_t coil_obj_load_section(coil_object_t *obj, coil_u16_t index,
         if (err == COIL_ERR_GOOD) {
           // Make sure the mode is VIEW for mapped sections
           sect->mode = COIL_SECT_MODE_VIEW;
+          
+          // Access patterns apply per mapping, repeat them for the section's own mapping
+          coil_obj_advise_section(obj, header, sect, 
+                                  load_flags & (COIL_SLOAD_SEQUENTIAL | COIL_SLOAD_RANDOM | COIL_SLOAD_DONTNEED));
+          
+          // Pages are still clean here, make the private mapping writable
+          if (load_flags & COIL_SLOAD_COW) {
+            err = coil_section_promote(sect);
+            if (err != COIL_ERR_GOOD) {
+              coil_section_cleanup(sect);
+              return err;
+            }
+          }
         }
       } else {
         // Initialize the section with enough space
@@ -635,12 +2130,24 @@ coil_err_t coil_obj_load_section(coil_object_t *obj, coil_u16_t index,
           coil_log(COIL_LEVEL_WARNING, "Section data incomplete: expected %zu bytes, got %zu", 
                   section_size, bytes_read);
         }
+        
+        // The data now lives in the section buffer, cached file pages can go
+        coil_obj_advise_section(obj, header, NULL, load_flags & COIL_SLOAD_DONTNEED);
       }
       
       if (err != COIL_ERR_GOOD) {
         return err;
       }
     }
+  } else if (obj->memory != NULL) {
+    // Objects loaded from memory copy straight out of the image, no syscalls
+    coil_err_t err = coil_section_init(sect, header->size > 0 ? header->size : 1024);
+    if (err != COIL_ERR_GOOD) {
+      return err;
+    }
+    coil_memcpy(sect->data, obj->memory + header->offset, header->size);
+    sect->size = header->size;
+    sect->mode = section_mode;
   } else {
     // No file descriptor, initialize an empty section
     coil_err_t err = coil_section_init(sect, 1024);
@@ -660,9 +2167,9 @@ coil_err_t coil_obj_load_section(coil_object_t *obj, coil_u16_t index,
   
   // Make a copy for the object's internal sections array
   coil_section_t *obj_sect = &obj->sections[index];
-  if (obj_sect->data == NULL) {
-    if (sect->mode == COIL_SECT_MODE_VIEW) {
-      // For view mode, just copy the pointer
+  if (!coil_section_has_data(obj_sect)) {
+    if (!coil_section_owns_data(sect)) {
+      // For view and COW modes, just copy the pointer
       *obj_sect = *sect;
     } else {
       // For modify mode, make a true copy
@@ -687,12 +2194,91 @@ coil_err_t coil_obj_load_section(coil_object_t *obj, coil_u16_t index,
   return COIL_ERR_GOOD;
 }
 
+/**
+* @brief Make a loaded view section writable without copying it
+*/
+coil_err_t coil_obj_promote_section(coil_object_t *obj, coil_u16_t index, coil_section_t *sect) {
+  if (obj == NULL || sect == NULL) {
+    return COIL_ERROR(COIL_ERR_INVAL, "Invalid parameters");
+  }
+  
+  // Check if index is valid
+  if (index >= obj->header.section_count) {
+    return COIL_ERROR(COIL_ERR_NOTFOUND, "Section index out of range");
+  }
+  
+  if (sect->mode != COIL_SECT_MODE_VIEW) {
+    return COIL_ERR_GOOD;
+  }
+  
+  // Views into the object mapping (or an owned image) are already writable
+  coil_byte_t *base = (coil_byte_t *)obj->memory;
+  if ((obj->is_mapped || obj->owns_memory) && !obj->read_only && base != NULL && !sect->is_mapped &&
+      sect->data >= base && sect->data + sect->size <= base + obj->header.file_size) {
+    sect->mode = COIL_SECT_MODE_COW;
+  } else {
+    coil_err_t err = coil_section_promote(sect);
+    if (err != COIL_ERR_GOOD) {
+      return err;
+    }
+  }
+  
+  // Keep the object's record of the section in step when it shares the data
+  if (obj->sections != NULL && index < obj->loaded_count && obj->sections[index].data == sect->data) {
+    obj->sections[index].mode = sect->mode;
+  }
+  
+  return COIL_ERR_GOOD;
+}
+
+/**
+* @brief Start reading a set of sections ahead of use
+*/
+coil_err_t coil_obj_prefetch_sections(coil_object_t *obj, const coil_u16_t *indices, coil_u16_t count) {
+  if (obj == NULL) {
+    return COIL_ERROR(COIL_ERR_INVAL, "Object pointer is NULL");
+  }
+  
+  // NULL selects every section in the object
+  if (indices == NULL) {
+    count = obj->header.section_count;
+  }
+  
+  // Validate the whole set before issuing any readahead
+  if (indices != NULL) {
+    for (coil_u16_t i = 0; i < count; i++) {
+      if (indices[i] >= obj->header.section_count) {
+        return COIL_ERROR(COIL_ERR_NOTFOUND, "Section index out of range");
+      }
+    }
+  }
+  
+  for (coil_u16_t i = 0; i < count; i++) {
+    coil_u16_t index = (indices != NULL) ? indices[i] : i;
+    
+    // Sections already copied into memory gain nothing from readahead
+    if (obj->sections != NULL && index < obj->loaded_count && 
+        coil_section_has_data(&obj->sections[index]) && coil_section_owns_data(&obj->sections[index])) {
+      continue;
+    }
+    
+    coil_section_t *sect = NULL;
+    if (obj->sections != NULL && index < obj->loaded_count && obj->sections[index].is_mapped) {
+      sect = &obj->sections[index];
+    }
+    
+    coil_obj_advise_section(obj, &obj->sectheaders[index], sect, COIL_SLOAD_WILLNEED);
+  }
+  
+  return COIL_ERR_GOOD;
+}
+
 /**
 * @brief Create a new section in the object
 */
 coil_err_t coil_obj_create_section(coil_object_t *obj, coil_u8_t type, const char *name, 
                                  coil_u16_t flags, coil_section_t *sect, coil_u16_t *index) {
-  if (obj == NULL || name == NULL) {
+  if (obj == NULL || name == NULL || type == COIL_SECTION_NULL) {
     return COIL_ERROR(COIL_ERR_INVAL, "Invalid parameters");
   }
   
@@ -772,6 +2358,8 @@ coil_err_t coil_obj_create_section(coil_object_t *obj, coil_u8_t type, const cha
     // Mark the original section as no longer owning the data
     // to avoid double-free issues
     sect->data = NULL;
+    sect->chunks = NULL;
+    sect->chunk_count = 0;
     sect->capacity = 0;
     sect->size = 0;
     
@@ -782,6 +2370,7 @@ coil_err_t coil_obj_create_section(coil_object_t *obj, coil_u8_t type, const cha
   
   // Update section count
   obj->header.section_count++;
+  coil_obj_drop_target_cache(obj);
   
   // Return new section index
   if (index != NULL) {
@@ -800,7 +2389,7 @@ coil_err_t coil_obj_update_section(coil_object_t *obj, coil_u16_t index, coil_se
   }
   
   // Check if index is valid
-  if (index >= obj->header.section_count) {
+  if (index >= obj->header.section_count || coil_obj_section_deleted(obj, index)) {
     return COIL_ERROR(COIL_ERR_NOTFOUND, "Section index out of range");
   }
   
@@ -812,10 +2401,9 @@ coil_err_t coil_obj_update_section(coil_object_t *obj, coil_u16_t index, coil_se
   if (obj->sections != NULL && index < obj->loaded_count) {
     coil_section_t *dest_sect = &obj->sections[index];
     
-    // Clean up existing section's data (not using coil_section_cleanup to avoid NULL pointer issues)
-    if (dest_sect->mode != COIL_SECT_MODE_VIEW && dest_sect->data != NULL) {
-      coil_free(dest_sect->data);
-      dest_sect->data = NULL;
+    // Clean up existing section's data, views alias memory released elsewhere
+    if (coil_section_owns_data(dest_sect) && coil_section_has_data(dest_sect)) {
+      coil_section_cleanup(dest_sect);
     }
     
     // Copy new section
@@ -823,6 +2411,8 @@ coil_err_t coil_obj_update_section(coil_object_t *obj, coil_u16_t index, coil_se
     
     // Mark the original section as no longer owning the data
     sect->data = NULL;
+    sect->chunks = NULL;
+    sect->chunk_count = 0;
     sect->capacity = 0;
     sect->size = 0;
   }
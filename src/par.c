@@ -0,0 +1,100 @@
+/**
+* @file par.c
+* @brief Parallel loop helper implementation for libcoil-dev
+*/
+
+#include <coil/base.h>
+#include <coil/par.h>
+#include "srcdeps.h"
+#include <pthread.h>
+
+/**
+* @brief Upper bound on worker threads per loop
+*/
+#define COIL_PAR_MAX_THREADS 64
+
+/**
+* @brief Shared loop state
+*/
+typedef struct coil_par_loop {
+  coil_size_t next;            ///< Next unclaimed item (atomic)
+  coil_size_t count;           ///< Number of items
+  coil_par_fn_t fn;            ///< Work item callback
+  void *ctx;                   ///< User context
+  coil_err_t err;              ///< First error (atomic)
+} coil_par_loop_t;
+
+/**
+* @brief Claim and run items until none are left
+*/
+static void *coil_par_worker(void *arg) {
+  coil_par_loop_t *loop = (coil_par_loop_t *)arg;
+  
+  for (;;) {
+    coil_size_t index = __atomic_fetch_add(&loop->next, 1, __ATOMIC_RELAXED);
+    if (index >= loop->count) {
+      break;
+    }
+    
+    coil_err_t err = loop->fn(loop->ctx, index);
+    if (err != COIL_ERR_GOOD) {
+      coil_err_t expected = COIL_ERR_GOOD;
+      __atomic_compare_exchange_n(&loop->err, &expected, err, 0, __ATOMIC_RELAXED, __ATOMIC_RELAXED);
+    }
+  }
+  
+  return NULL;
+}
+
+/**
+* @brief Get the number of threads used when none is specified
+*/
+coil_u32_t coil_par_default_threads(void) {
+  long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+  if (cpus < 1) {
+    return 1;
+  }
+  return cpus > COIL_PAR_MAX_THREADS ? COIL_PAR_MAX_THREADS : (coil_u32_t)cpus;
+}
+
+/**
+* @brief Run fn for every index in [0, count) across threads
+*/
+coil_err_t coil_par_for(coil_size_t count, coil_u32_t threads, coil_par_fn_t fn, void *ctx) {
+  if (fn == NULL) {
+    return COIL_ERROR(COIL_ERR_INVAL, "Work callback is NULL");
+  }
+  
+  if (threads == 0) {
+    threads = coil_par_default_threads();
+  }
+  if (threads > COIL_PAR_MAX_THREADS) {
+    threads = COIL_PAR_MAX_THREADS;
+  }
+  if (threads > count) {
+    threads = (coil_u32_t)count;
+  }
+  
+  coil_par_loop_t loop = { 0, count, fn, ctx, COIL_ERR_GOOD };
+  
+  // Helpers that fail to start are simply not used, the caller drains the rest
+  pthread_t workers[COIL_PAR_MAX_THREADS];
+  coil_u32_t started = 0;
+  for (coil_u32_t i = 1; i < threads; i++) {
+    if (pthread_create(&workers[started], NULL, coil_par_worker, &loop) == 0) {
+      started++;
+    }
+  }
+  
+  coil_par_worker(&loop);
+  
+  for (coil_u32_t i = 0; i < started; i++) {
+    pthread_join(workers[i], NULL);
+  }
+  
+  // Worker errors were recorded on their own threads
+  if (loop.err != COIL_ERR_GOOD) {
+    return COIL_ERROR(loop.err, "Parallel work item failed");
+  }
+  return COIL_ERR_GOOD;
+}
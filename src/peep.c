@@ -0,0 +1,880 @@
+/**
+* @file peep.c
+* @brief Peephole optimization and constant folding of COIL instructions for libcoil-dev
+*/
+
+#include <coil/base.h>
+#include <coil/peep.h>
+#include <coil/instr.h>
+#include "srcdeps.h"
+#include <stdlib.h>
+#include <string.h>
+
+/**
+* @brief Offset of an instruction not written yet
+*/
+#define COIL_PEEP_NONE ((coil_u32_t)0xFFFFFFFF)
+
+/**
+* @brief Opcode classes the rules match on
+*/
+typedef enum coil_peep_class_e {
+  COIL_PEEP_C_NOP = 1 << 0,            ///< NOP
+  COIL_PEEP_C_MOVE = 1 << 1,           ///< MOV
+  COIL_PEEP_C_ALU = 1 << 2,            ///< Binary operations with a CBC equivalent that cannot fault
+  COIL_PEEP_C_UNARY = 1 << 3,          ///< Unary operations
+  COIL_PEEP_C_COMPARE = 1 << 4,        ///< Instructions setting the flags
+  COIL_PEEP_C_BRANCH = 1 << 5,         ///< Conditional branches (keep the flags)
+} coil_peep_class_t;
+
+/**
+* @brief Class of each opcode
+*/
+static const coil_u8_t coil_peep_classes[256] = {
+  [COIL_OP_NOP] = COIL_PEEP_C_NOP,
+  [COIL_OP_BR] = COIL_PEEP_C_BRANCH,
+  [COIL_OP_CMP] = COIL_PEEP_C_COMPARE,
+  [COIL_OP_TEST] = COIL_PEEP_C_COMPARE,
+  [COIL_OP_MOV] = COIL_PEEP_C_MOVE,
+  [COIL_OP_ADD] = COIL_PEEP_C_ALU,
+  [COIL_OP_SUB] = COIL_PEEP_C_ALU,
+  [COIL_OP_MUL] = COIL_PEEP_C_ALU,
+  [COIL_OP_AND] = COIL_PEEP_C_ALU,
+  [COIL_OP_OR] = COIL_PEEP_C_ALU,
+  [COIL_OP_XOR] = COIL_PEEP_C_ALU,
+  [COIL_OP_SHL] = COIL_PEEP_C_ALU,
+  [COIL_OP_SHR] = COIL_PEEP_C_ALU,
+  [COIL_OP_SAL] = COIL_PEEP_C_ALU,
+  [COIL_OP_SAR] = COIL_PEEP_C_ALU,
+  [COIL_OP_INC] = COIL_PEEP_C_UNARY,
+  [COIL_OP_DEC] = COIL_PEEP_C_UNARY,
+  [COIL_OP_NEG] = COIL_PEEP_C_UNARY,
+  [COIL_OP_NOT] = COIL_PEEP_C_UNARY,
+};
+
+/**
+* @brief Decoded operand
+*/
+typedef struct coil_peep_operand {
+  coil_u32_t offset;           ///< Offset from the range start (unused when synthetic)
+  coil_u8_t size;              ///< Encoded size
+  coil_u8_t type;              ///< Operand type (COIL_TYPEOP_*)
+  coil_u8_t value_type;        ///< Value type (COIL_VAL_*)
+  coil_u8_t modifier;          ///< Modifiers (COIL_MOD_*)
+  coil_u8_t valsize;           ///< Size of the data
+  coil_u8_t synthetic;         ///< Immediate made by a rule, encoded from value
+  coil_u64_t value;            ///< Data as an unsigned integer (up to 8 bytes)
+} coil_peep_operand_t;
+
+/**
+* @brief Decoded instruction
+*/
+typedef struct coil_peep_instr {
+  coil_u32_t index;            ///< Instruction number
+  coil_u32_t offset;           ///< Offset from the range start
+  coil_u32_t size;             ///< Encoded size
+  coil_u8_t opcode;            ///< Opcode (coil_opcode_t)
+  coil_u8_t flag;              ///< Flag (COIL_INSTRFLAG_NONE for formats without one)
+  coil_u8_t count;             ///< Number of operands
+  coil_u8_t rewritten;         ///< Changed by a rule, encoded from the fields
+  coil_peep_operand_t ops[2];  ///< First two operands
+} coil_peep_instr_t;
+
+/**
+* @brief State of one pass
+*/
+typedef struct coil_peep_ctx {
+  coil_peep_t *peep;           ///< Result
+  const coil_byte_t *base;     ///< Range start in the COIL section
+  coil_section_t code;         ///< Output
+  coil_u32_t rules;            ///< Rules to apply
+  coil_u32_t capacity;         ///< Allocated instructions
+  int cmp_valid;               ///< The flags still hold the result of the last CMP or TEST
+  coil_u32_t cmp_offset;       ///< Offset of the last CMP or TEST
+  coil_u32_t cmp_size;         ///< Size of the last CMP or TEST
+} coil_peep_ctx_t;
+
+/**
+* @brief What a rule does with a pair
+*/
+typedef enum coil_peep_action_e {
+  COIL_PEEP_KEEP,              ///< Nothing
+  COIL_PEEP_DROP_FIRST,        ///< Drop the first instruction
+  COIL_PEEP_DROP_SECOND,       ///< Drop the second instruction
+  COIL_PEEP_MERGE,             ///< The first instruction was rewritten to do both, drop the second
+} coil_peep_action_t;
+
+/**
+* @brief Rule function, second is NULL for rules on one instruction
+*/
+typedef coil_peep_action_t (*coil_peep_fn_t)(const coil_peep_ctx_t *ctx, coil_peep_instr_t *first,
+                                             const coil_peep_instr_t *second);
+
+/**
+* @brief Entry of the rule table
+*/
+typedef struct coil_peep_entry {
+  coil_u8_t rule;              ///< Bit of the rule (coil_peep_rule_t)
+  coil_u8_t first;             ///< Classes the first instruction may have
+  coil_u8_t second;            ///< Classes the second instruction may have (0 for one instruction)
+  coil_peep_fn_t fn;           ///< Rule function
+} coil_peep_entry_t;
+
+// -------------------------------- Operands -------------------------------- //
+
+/**
+* @brief Width in bytes of an integer value type
+*/
+static coil_u8_t coil_peep_width(coil_u8_t value_type, int *is_signed) {
+  *is_signed = 0;
+  
+  switch (value_type) {
+    case COIL_VAL_I8:
+      *is_signed = 1;
+      return 1;
+    case COIL_VAL_U8:
+    case COIL_VAL_BIT:
+      return 1;
+    case COIL_VAL_I16:
+      *is_signed = 1;
+      return 2;
+    case COIL_VAL_U16:
+      return 2;
+    case COIL_VAL_I32:
+      *is_signed = 1;
+      return 4;
+    case COIL_VAL_U32:
+      return 4;
+    case COIL_VAL_I64:
+    case COIL_VAL_SSIZE:
+      *is_signed = 1;
+      return 8;
+    case COIL_VAL_U64:
+    case COIL_VAL_PTR:
+    case COIL_VAL_SIZE:
+      return 8;
+    default:
+      return 0;
+  }
+}
+
+/**
+* @brief All ones at a width of up to 8 bytes
+*/
+static inline coil_u64_t coil_peep_mask(coil_u8_t width) {
+  return width >= 8 ? ~(coil_u64_t)0 : ((coil_u64_t)1 << (width * 8)) - 1;
+}
+
+/**
+* @brief Read a host order unsigned integer of up to 8 bytes
+*/
+static coil_u64_t coil_peep_uint(const coil_byte_t *data, coil_size_t size) {
+  switch (size) {
+    case 1: { coil_u8_t v; memcpy(&v, data, 1); return v; }
+    case 2: { coil_u16_t v; memcpy(&v, data, 2); return v; }
+    case 4: { coil_u32_t v; memcpy(&v, data, 4); return v; }
+    case 8: { coil_u64_t v; memcpy(&v, data, 8); return v; }
+    default: return 0;
+  }
+}
+
+/**
+* @brief Read an integer immediate extended to 64 bits as the lowering does
+*
+* @return int Non-zero if the operand is an immediate of up to 8 bytes
+*/
+static int coil_peep_imm(const coil_peep_operand_t *op, coil_u64_t *value) {
+  int is_signed;
+  coil_u8_t width = coil_peep_width(op->value_type, &is_signed);
+  if (op->type != COIL_TYPEOP_IMM || width == 0 || op->valsize != width) {
+    return 0;
+  }
+  
+  unsigned bits = (8u - width) * 8;
+  *value = is_signed && bits != 0 ? (coil_u64_t)((coil_i64_t)(op->value << bits) >> bits) : op->value;
+  return 1;
+}
+
+/**
+* @brief Check that an operand is a register or variable without volatile or atomic access
+*
+* Offset operands carry the value type of their base, not of the access,
+* so memory is never a place.
+*
+* @return coil_u8_t Width of its value type (0 if it is no such place or no integer of up to 8 bytes)
+*/
+static coil_u8_t coil_peep_place(const coil_peep_operand_t *op) {
+  int is_signed;
+  if ((op->type != COIL_TYPEOP_REG && op->type != COIL_TYPEOP_VAR) ||
+      (op->modifier & (COIL_MOD_VOL | COIL_MOD_ATOMIC))) {
+    return 0;
+  }
+  return coil_peep_width(op->value_type, &is_signed);
+}
+
+/**
+* @brief Check that two operands encode the same way
+*/
+static int coil_peep_same(const coil_peep_ctx_t *ctx, const coil_peep_operand_t *a, const coil_peep_operand_t *b) {
+  return !a->synthetic && !b->synthetic && a->size == b->size &&
+         memcmp(ctx->base + a->offset, ctx->base + b->offset, a->size) == 0;
+}
+
+/**
+* @brief Check whether an operand may read a register or variable
+*/
+static int coil_peep_reads(const coil_peep_operand_t *op, const coil_peep_operand_t *place) {
+  switch (op->type) {
+    case COIL_TYPEOP_IMM:
+    case COIL_TYPEOP_SYM:
+      return 0;
+    case COIL_TYPEOP_REG:
+    case COIL_TYPEOP_VAR:
+      return op->type == place->type && op->value == place->value;
+    case COIL_TYPEOP_OFF:
+      // Variables may live in memory an offset reaches
+      return place->type == COIL_TYPEOP_VAR || (op->value_type == COIL_VAL_REG && op->value == place->value);
+    default:
+      return 1;
+  }
+}
+
+/**
+* @brief Turn the second operand of an instruction into an immediate of the first one's value type
+*/
+static void coil_peep_set_imm(coil_peep_instr_t *instr, coil_u64_t value, coil_u8_t width) {
+  coil_peep_operand_t *op = &instr->ops[1];
+  op->type = COIL_TYPEOP_IMM;
+  op->value_type = instr->ops[0].value_type;
+  op->modifier = COIL_MOD_NONE;
+  op->valsize = width;
+  op->synthetic = 1;
+  op->value = value & coil_peep_mask(width);
+  instr->count = 2;
+  instr->rewritten = 1;
+}
+
+// -------------------------------- Folding -------------------------------- //
+
+/**
+* @brief Compute an operation at a width as the interpreter does
+*
+* Unary operations take their operand in x. Shift counts wrap at the width.
+*
+* @return int Non-zero if the opcode can be folded
+*/
+static int coil_peep_eval(coil_u8_t opcode, coil_u8_t width, coil_u64_t x, coil_u64_t y, coil_u64_t *out) {
+  coil_u64_t mask = coil_peep_mask(width);
+  unsigned count = (unsigned)(y & (coil_u64_t)(width * 8 - 1));
+  x &= mask;
+  coil_u64_t r;
+  
+  switch (opcode) {
+    case COIL_OP_ADD: r = x + y; break;
+    case COIL_OP_SUB: r = x - y; break;
+    case COIL_OP_MUL: r = x * y; break;
+    case COIL_OP_AND: r = x & y; break;
+    case COIL_OP_OR:  r = x | y; break;
+    case COIL_OP_XOR: r = x ^ y; break;
+    case COIL_OP_SHL:
+    case COIL_OP_SAL: r = x << count; break;
+    case COIL_OP_SHR: r = x >> count; break;
+    case COIL_OP_SAR: {
+      unsigned bits = (8u - width) * 8;
+      r = (coil_u64_t)(((coil_i64_t)(x << bits) >> bits) >> count);
+      break;
+    }
+    case COIL_OP_INC: r = x + 1; break;
+    case COIL_OP_DEC: r = x - 1; break;
+    case COIL_OP_NEG: r = (coil_u64_t)0 - x; break;
+    case COIL_OP_NOT: r = ~x; break;
+    default: return 0;
+  }
+  
+  *out = r & mask;
+  return 1;
+}
+
+// -------------------------------- Rules -------------------------------- //
+
+/**
+* @brief NOP
+*/
+static coil_peep_action_t coil_peep_nop(const coil_peep_ctx_t *ctx, coil_peep_instr_t *first,
+                                        const coil_peep_instr_t *second) {
+  (void)ctx;
+  (void)second;
+  return first->count == 0 ? COIL_PEEP_DROP_FIRST : COIL_PEEP_KEEP;
+}
+
+/**
+* @brief MOV a, a
+*/
+static coil_peep_action_t coil_peep_mov_self(const coil_peep_ctx_t *ctx, coil_peep_instr_t *first,
+                                             const coil_peep_instr_t *second) {
+  (void)second;
+  if (first->flag != COIL_INSTRFLAG_NONE || first->count != 2 || coil_peep_place(&first->ops[0]) == 0 ||
+      !coil_peep_same(ctx, &first->ops[0], &first->ops[1])) {
+    return COIL_PEEP_KEEP;
+  }
+  return COIL_PEEP_DROP_FIRST;
+}
+
+/**
+* @brief Operation with an immediate that leaves its place unchanged
+*/
+static coil_peep_action_t coil_peep_identity(const coil_peep_ctx_t *ctx, coil_peep_instr_t *first,
+                                             const coil_peep_instr_t *second) {
+  (void)ctx;
+  (void)second;
+  coil_u64_t y;
+  coil_u8_t width = first->count == 2 ? coil_peep_place(&first->ops[0]) : 0;
+  if (first->flag != COIL_INSTRFLAG_NONE || width == 0 || !coil_peep_imm(&first->ops[1], &y)) {
+    return COIL_PEEP_KEEP;
+  }
+  
+  coil_u64_t mask = coil_peep_mask(width);
+  switch (first->opcode) {
+    case COIL_OP_MUL:
+      return (y & mask) == 1 ? COIL_PEEP_DROP_FIRST : COIL_PEEP_KEEP;
+    case COIL_OP_AND:
+      return (y & mask) == mask ? COIL_PEEP_DROP_FIRST : COIL_PEEP_KEEP;
+    case COIL_OP_SHL:
+    case COIL_OP_SHR:
+    case COIL_OP_SAL:
+    case COIL_OP_SAR:
+      return (y & (coil_u64_t)(width * 8 - 1)) == 0 ? COIL_PEEP_DROP_FIRST : COIL_PEEP_KEEP;
+    default:
+      return (y & mask) == 0 ? COIL_PEEP_DROP_FIRST : COIL_PEEP_KEEP;
+  }
+}
+
+/**
+* @brief CMP or TEST repeating the one the flags hold
+*/
+static coil_peep_action_t coil_peep_cmp(const coil_peep_ctx_t *ctx, coil_peep_instr_t *first,
+                                        const coil_peep_instr_t *second) {
+  (void)second;
+  if (!ctx->cmp_valid || first->flag != COIL_INSTRFLAG_NONE || first->size != ctx->cmp_size ||
+      memcmp(ctx->base + first->offset, ctx->base + ctx->cmp_offset, first->size) != 0) {
+    return COIL_PEEP_KEEP;
+  }
+  for (coil_u8_t i = 0; i < first->count; i++) {
+    if (first->ops[i].modifier & (COIL_MOD_VOL | COIL_MOD_ATOMIC)) {
+      return COIL_PEEP_KEEP;
+    }
+  }
+  return COIL_PEEP_DROP_FIRST;
+}
+
+/**
+* @brief MOV a, b then MOV b, a
+*/
+static coil_peep_action_t coil_peep_mov_back(const coil_peep_ctx_t *ctx, coil_peep_instr_t *first,
+                                             const coil_peep_instr_t *second) {
+  const coil_peep_operand_t *a = &first->ops[0], *b = &first->ops[1];
+  if (first->flag != COIL_INSTRFLAG_NONE || second->flag != COIL_INSTRFLAG_NONE || first->count != 2 ||
+      second->count != 2 || a->value_type != b->value_type || coil_peep_place(a) == 0 || coil_peep_place(b) == 0) {
+    return COIL_PEEP_KEEP;
+  }
+  if (!coil_peep_same(ctx, &second->ops[0], b) || !coil_peep_same(ctx, &second->ops[1], a)) {
+    return COIL_PEEP_KEEP;
+  }
+  return COIL_PEEP_DROP_SECOND;
+}
+
+/**
+* @brief MOV a, x then MOV a, y where y does not read a
+*/
+static coil_peep_action_t coil_peep_mov_dead(const coil_peep_ctx_t *ctx, coil_peep_instr_t *first,
+                                             const coil_peep_instr_t *second) {
+  const coil_peep_operand_t *a = &first->ops[0];
+  if (first->flag != COIL_INSTRFLAG_NONE || second->flag != COIL_INSTRFLAG_NONE || first->count != 2 ||
+      second->count != 2 || coil_peep_place(a) == 0 ||
+      (first->ops[1].modifier & (COIL_MOD_VOL | COIL_MOD_ATOMIC))) {
+    return COIL_PEEP_KEEP;
+  }
+  if (!coil_peep_same(ctx, &second->ops[0], a) || coil_peep_reads(&second->ops[1], a)) {
+    return COIL_PEEP_KEEP;
+  }
+  return COIL_PEEP_DROP_FIRST;
+}
+
+/**
+* @brief MOV a, imm then an operation on a with an immediate or none
+*/
+static coil_peep_action_t coil_peep_fold(const coil_peep_ctx_t *ctx, coil_peep_instr_t *first,
+                                         const coil_peep_instr_t *second) {
+  coil_u64_t x, y = 0, r;
+  coil_u8_t width = first->count == 2 ? coil_peep_place(&first->ops[0]) : 0;
+  if (first->flag != COIL_INSTRFLAG_NONE || second->flag != COIL_INSTRFLAG_NONE || width == 0 ||
+      !coil_peep_imm(&first->ops[1], &x) || second->count == 0 || !coil_peep_same(ctx, &second->ops[0], &first->ops[0])) {
+    return COIL_PEEP_KEEP;
+  }
+  
+  int unary = coil_peep_classes[second->opcode] == COIL_PEEP_C_UNARY;
+  if (second->count != (unary ? 1 : 2) || (!unary && !coil_peep_imm(&second->ops[1], &y)) ||
+      !coil_peep_eval(second->opcode, width, x, y, &r)) {
+    return COIL_PEEP_KEEP;
+  }
+  coil_peep_set_imm(first, r, width);
+  return COIL_PEEP_MERGE;
+}
+
+/**
+* @brief Two operations on the same place with immediates
+*/
+static coil_peep_action_t coil_peep_combine(const coil_peep_ctx_t *ctx, coil_peep_instr_t *first,
+                                            const coil_peep_instr_t *second) {
+  coil_u64_t x, y, r;
+  coil_u8_t width = first->count == 2 ? coil_peep_place(&first->ops[0]) : 0;
+  if (first->flag != COIL_INSTRFLAG_NONE || second->flag != COIL_INSTRFLAG_NONE || width == 0 ||
+      second->count != 2 || !coil_peep_imm(&first->ops[1], &x) || !coil_peep_imm(&second->ops[1], &y) ||
+      !coil_peep_same(ctx, &second->ops[0], &first->ops[0])) {
+    return COIL_PEEP_KEEP;
+  }
+  
+  coil_u8_t opcode = first->opcode;
+  int additive = (opcode == COIL_OP_ADD || opcode == COIL_OP_SUB) &&
+                 (second->opcode == COIL_OP_ADD || second->opcode == COIL_OP_SUB);
+  if (additive) {
+    // Subtractions add the negated immediate
+    r = (opcode == COIL_OP_SUB ? (coil_u64_t)0 - x : x) + (second->opcode == COIL_OP_SUB ? (coil_u64_t)0 - y : y);
+    opcode = COIL_OP_ADD;
+  } else if (opcode != second->opcode) {
+    return COIL_PEEP_KEEP;
+  } else if (opcode == COIL_OP_SHL || opcode == COIL_OP_SHR || opcode == COIL_OP_SAL || opcode == COIL_OP_SAR) {
+    coil_u64_t bits = (coil_u64_t)width * 8;
+    r = (x & (bits - 1)) + (y & (bits - 1));
+    if (r >= bits) {
+      return COIL_PEEP_KEEP;
+    }
+  } else if (opcode == COIL_OP_MUL || opcode == COIL_OP_AND || opcode == COIL_OP_OR || opcode == COIL_OP_XOR) {
+    coil_peep_eval(opcode, width, x, y, &r);
+  } else {
+    return COIL_PEEP_KEEP;
+  }
+  
+  first->opcode = opcode;
+  coil_peep_set_imm(first, r, width);
+  return COIL_PEEP_MERGE;
+}
+
+/**
+* @brief Rule table, tried in order
+*/
+static const coil_peep_entry_t coil_peep_entries[] = {
+  { 0, COIL_PEEP_C_NOP, 0, coil_peep_nop },
+  { 1, COIL_PEEP_C_MOVE, 0, coil_peep_mov_self },
+  { 4, COIL_PEEP_C_ALU, 0, coil_peep_identity },
+  { 7, COIL_PEEP_C_COMPARE, 0, coil_peep_cmp },
+  { 2, COIL_PEEP_C_MOVE, COIL_PEEP_C_MOVE, coil_peep_mov_back },
+  { 3, COIL_PEEP_C_MOVE, COIL_PEEP_C_MOVE, coil_peep_mov_dead },
+  { 5, COIL_PEEP_C_MOVE, COIL_PEEP_C_ALU | COIL_PEEP_C_UNARY, coil_peep_fold },
+  { 6, COIL_PEEP_C_ALU, COIL_PEEP_C_ALU, coil_peep_combine },
+};
+
+/**
+* @brief Apply the first rule on one instruction that matches
+*
+* @return int Non-zero if the instruction is dropped
+*/
+static int coil_peep_single(coil_peep_ctx_t *ctx, coil_peep_instr_t *instr) {
+  coil_u8_t cls = coil_peep_classes[instr->opcode];
+  for (coil_size_t e = 0; e < sizeof(coil_peep_entries) / sizeof(coil_peep_entries[0]); e++) {
+    const coil_peep_entry_t *entry = &coil_peep_entries[e];
+    if (entry->second == 0 && (entry->first & cls) && (ctx->rules & (1u << entry->rule)) &&
+        entry->fn(ctx, instr, NULL) == COIL_PEEP_DROP_FIRST) {
+      ctx->peep->hits[entry->rule]++;
+      ctx->peep->removed++;
+      return 1;
+    }
+  }
+  return 0;
+}
+
+/**
+* @brief Apply the first rule on a pair that matches
+*/
+static coil_peep_action_t coil_peep_pair(coil_peep_ctx_t *ctx, coil_peep_instr_t *first,
+                                         const coil_peep_instr_t *second) {
+  coil_u8_t cls = coil_peep_classes[first->opcode], next = coil_peep_classes[second->opcode];
+  for (coil_size_t e = 0; e < sizeof(coil_peep_entries) / sizeof(coil_peep_entries[0]); e++) {
+    const coil_peep_entry_t *entry = &coil_peep_entries[e];
+    if (!(entry->first & cls) || !(entry->second & next) || !(ctx->rules & (1u << entry->rule))) {
+      continue;
+    }
+    coil_peep_action_t action = entry->fn(ctx, first, second);
+    if (action != COIL_PEEP_KEEP) {
+      ctx->peep->hits[entry->rule]++;
+      ctx->peep->removed++;
+      return action;
+    }
+  }
+  return COIL_PEEP_KEEP;
+}
+
+// -------------------------------- Pass -------------------------------- //
+
+/**
+* @brief Decode an instruction and its first two operands
+*/
+static coil_err_t coil_peep_decode(coil_peep_ctx_t *ctx, coil_section_t *ir, coil_u64_t pos, coil_u64_t end,
+                                   coil_peep_instr_t *instr) {
+  coil_instrmem_t mem;
+  coil_instrfmt_t fmt;
+  coil_size_t next = coil_instr_decode(ir, pos, &mem, &fmt);
+  if (next == 0) {
+    return coil_error_get_last();
+  }
+  
+  memset(instr, 0, sizeof(coil_peep_instr_t));
+  instr->opcode = mem.opcode;
+  coil_u8_t count = 0;
+  switch (fmt) {
+    case COIL_INSTRFMT_VALUE:
+    case COIL_INSTRFMT_UNARY:
+      count = 1;
+      break;
+    case COIL_INSTRFMT_BINARY:
+      count = 2;
+      break;
+    case COIL_INSTRFMT_TENARY:
+      count = 3;
+      break;
+    case COIL_INSTRFMT_FLAG_UNARY:
+    case COIL_INSTRFMT_FLAG_BINARY:
+    case COIL_INSTRFMT_FLAG_TENARY:
+      instr->flag = ((coil_instrflag_t *)&mem)->flag;
+      count = (coil_u8_t)(fmt - COIL_INSTRFMT_FLAG_UNARY + 1);
+      break;
+    default:
+      break;
+  }
+  
+  for (coil_u8_t i = 0; i < count; i++) {
+    coil_u64_t start = next;
+    coil_operand_header_t header;
+    coil_offset_t offset;
+    coil_byte_t data[16];
+    coil_size_t valsize = 0;
+    next = coil_operand_decode(ir, next, &header, &offset);
+    if (next != 0) {
+      next = coil_operand_decode_data(ir, next, data, sizeof(data), &valsize, &header);
+    }
+    if (next == 0) {
+      return coil_error_get_last();
+    }
+    if (next > end) {
+      break;
+    }
+    
+    if (i < 2) {
+      coil_peep_operand_t *op = &instr->ops[i];
+      op->offset = (coil_u32_t)(start - ctx->peep->offset);
+      op->size = (coil_u8_t)(next - start);
+      op->type = header.type;
+      op->value_type = header.value_type;
+      op->modifier = header.modifier;
+      op->valsize = (coil_u8_t)valsize;
+      op->value = coil_peep_uint(data, valsize);
+    }
+  }
+  if (next > end) {
+    return COIL_ERROR(COIL_ERR_FORMAT, "Instruction crosses the end of its range");
+  }
+  
+  instr->count = count;
+  instr->offset = (coil_u32_t)(pos - ctx->peep->offset);
+  instr->size = (coil_u32_t)(next - pos);
+  return COIL_ERR_GOOD;
+}
+
+/**
+* @brief Write an instruction to the output
+*/
+static coil_err_t coil_peep_emit(coil_peep_ctx_t *ctx, const coil_peep_instr_t *instr) {
+  coil_size_t written;
+  ctx->peep->moved[instr->index] = (coil_u32_t)ctx->code.size;
+  if (!instr->rewritten) {
+    return coil_section_write(&ctx->code, (coil_byte_t *)ctx->base + instr->offset, instr->size, &written);
+  }
+  
+  // Rewritten instructions are a flagless binary header, the original place and an immediate
+  const coil_peep_operand_t *imm = &instr->ops[1];
+  coil_err_t err = coil_instrflag_encode(&ctx->code, (coil_opcode_t)instr->opcode, COIL_INSTRFLAG_NONE);
+  if (err == COIL_ERR_GOOD) {
+    err = coil_section_write(&ctx->code, (coil_byte_t *)ctx->base + instr->ops[0].offset, instr->ops[0].size,
+                             &written);
+  }
+  if (err == COIL_ERR_GOOD) {
+    err = coil_operand_encode(&ctx->code, COIL_TYPEOP_IMM, imm->value_type, COIL_MOD_NONE);
+  }
+  if (err == COIL_ERR_GOOD) {
+    coil_byte_t data[8];
+    switch (imm->valsize) {
+      case 1: { coil_u8_t v = (coil_u8_t)imm->value; memcpy(data, &v, 1); break; }
+      case 2: { coil_u16_t v = (coil_u16_t)imm->value; memcpy(data, &v, 2); break; }
+      case 4: { coil_u32_t v = (coil_u32_t)imm->value; memcpy(data, &v, 4); break; }
+      default: memcpy(data, &imm->value, 8); break;
+    }
+    err = coil_operand_encode_data(&ctx->code, data, imm->valsize);
+  }
+  return err;
+}
+
+/**
+* @brief Record an instruction kept in the stream for the CMP rule
+*/
+static void coil_peep_track(coil_peep_ctx_t *ctx, const coil_peep_instr_t *instr) {
+  coil_u8_t cls = coil_peep_classes[instr->opcode];
+  if (cls == COIL_PEEP_C_COMPARE) {
+    ctx->cmp_valid = 1;
+    ctx->cmp_offset = instr->offset;
+    ctx->cmp_size = instr->size;
+  } else if (cls != COIL_PEEP_C_NOP && !(cls == COIL_PEEP_C_BRANCH && instr->flag != COIL_INSTRFLAG_NONE)) {
+    ctx->cmp_valid = 0;
+  }
+}
+
+/**
+* @brief Grow the instruction arrays to hold one more instruction
+*/
+static coil_err_t coil_peep_reserve(coil_peep_ctx_t *ctx) {
+  coil_peep_t *peep = ctx->peep;
+  if (peep->instr_count + 1 < ctx->capacity) {
+    return COIL_ERR_GOOD;
+  }
+  
+  coil_u32_t grown = ctx->capacity ? ctx->capacity * 2 : 64;
+  coil_u32_t *instrs = (coil_u32_t *)coil_realloc(peep->instrs, (coil_size_t)grown * sizeof(coil_u32_t));
+  if (instrs != NULL) {
+    peep->instrs = instrs;
+  }
+  coil_u32_t *moved = (coil_u32_t *)coil_realloc(peep->moved, (coil_size_t)grown * sizeof(coil_u32_t));
+  if (moved != NULL) {
+    peep->moved = moved;
+  }
+  if (instrs == NULL || moved == NULL) {
+    return COIL_ERROR(COIL_ERR_NOMEM, "Failed to allocate instruction offsets");
+  }
+  ctx->capacity = grown;
+  return COIL_ERR_GOOD;
+}
+
+/**
+* @brief Compare two symbol values (qsort)
+*/
+static int coil_peep_compare_offset(const void *a, const void *b) {
+  coil_u64_t x = *(const coil_u64_t *)a, y = *(const coil_u64_t *)b;
+  return x < y ? -1 : x > y;
+}
+
+/**
+* @brief Run the rules over the range
+*/
+static coil_err_t coil_peep_run(coil_peep_ctx_t *ctx, coil_section_t *ir, const coil_u64_t *entries,
+                                coil_u32_t entry_count) {
+  coil_peep_t *peep = ctx->peep;
+  coil_peep_instr_t window[2];
+  coil_peep_instr_t *prev = NULL, *cur = &window[0];
+  coil_u64_t pos = peep->offset, end = peep->offset + peep->size;
+  coil_u32_t entry = 0;
+  coil_err_t err = COIL_ERR_GOOD;
+  
+  while (pos < end && err == COIL_ERR_GOOD) {
+    peep->fault = pos;
+    err = coil_peep_reserve(ctx);
+    if (err == COIL_ERR_GOOD) {
+      err = coil_peep_decode(ctx, ir, pos, end, cur);
+    }
+    if (err != COIL_ERR_GOOD) {
+      break;
+    }
+    cur->index = peep->instr_count++;
+    peep->instrs[cur->index] = cur->offset;
+    peep->moved[cur->index] = COIL_PEEP_NONE;
+    pos += cur->size;
+    
+    // Nothing spans an entry
+    while (entry < entry_count && entries[entry] < peep->offset + cur->offset) {
+      entry++;
+    }
+    if (entry < entry_count && entries[entry] == peep->offset + cur->offset) {
+      if (prev != NULL) {
+        err = coil_peep_emit(ctx, prev);
+        prev = NULL;
+      }
+      ctx->cmp_valid = 0;
+    }
+    
+    if (err != COIL_ERR_GOOD || coil_peep_single(ctx, cur)) {
+      continue;
+    }
+    if (prev != NULL) {
+      coil_peep_action_t action = coil_peep_pair(ctx, prev, cur);
+      if (action == COIL_PEEP_DROP_SECOND) {
+        continue;
+      }
+      if (action == COIL_PEEP_MERGE) {
+        // The result may itself be an identity, and pairs with what follows
+        if (coil_peep_single(ctx, prev)) {
+          prev = NULL;
+        }
+        continue;
+      }
+      if (action == COIL_PEEP_DROP_FIRST) {
+        prev = NULL;
+      } else {
+        err = coil_peep_emit(ctx, prev);
+      }
+    }
+    
+    coil_peep_track(ctx, cur);
+    prev = cur;
+    cur = cur == &window[0] ? &window[1] : &window[0];
+  }
+  
+  if (err == COIL_ERR_GOOD && prev != NULL) {
+    err = coil_peep_emit(ctx, prev);
+  }
+  return err;
+}
+
+/**
+* @brief Optimize a range of COIL instructions into another section
+*/
+coil_err_t coil_peep_section(coil_peep_t *peep, coil_section_t *out, coil_section_t *ir, coil_u64_t offset,
+                             coil_u64_t size, const coil_u64_t *symvals, coil_u32_t symcount, coil_u32_t rules) {
+  if (peep == NULL) {
+    return COIL_ERROR(COIL_ERR_INVAL, "Invalid parameters");
+  }
+  memset(peep, 0, sizeof(coil_peep_t));
+  
+  if (out == NULL || ir == NULL || (symvals == NULL && symcount > 0)) {
+    return COIL_ERROR(COIL_ERR_INVAL, "Invalid parameters");
+  }
+  if (coil_section_is_chunked(ir)) {
+    return COIL_ERROR(COIL_ERR_BADSTATE, "Cannot optimize a chunked section");
+  }
+  if (out->mode == COIL_SECT_MODE_VIEW) {
+    return COIL_ERROR(COIL_ERR_BADSTATE, "Output section is read-only");
+  }
+  if (offset > ir->size || size > ir->size - offset) {
+    return COIL_ERROR(COIL_ERR_INVAL, "Range leaves the section");
+  }
+  if (size > 0xFFFFFFFF) {
+    return COIL_ERROR(COIL_ERR_NOTSUP, "Range of 4 GiB or more");
+  }
+  peep->offset = offset;
+  peep->size = size;
+  
+  // Symbol values inside the range, ascending
+  coil_u64_t *entries = (coil_u64_t *)coil_malloc((symcount > 0 ? symcount : 1) * sizeof(coil_u64_t));
+  coil_peep_ctx_t ctx;
+  memset(&ctx, 0, sizeof(ctx));
+  coil_err_t err = coil_section_init(&ctx.code, (coil_size_t)size + 64);
+  if (entries == NULL || err != COIL_ERR_GOOD) {
+    coil_free(entries);
+    if (err == COIL_ERR_GOOD) {
+      coil_section_cleanup(&ctx.code);
+    }
+    return COIL_ERROR(COIL_ERR_NOMEM, "Failed to allocate peephole state");
+  }
+  coil_u32_t entry_count = 0;
+  for (coil_u32_t i = 0; i < symcount; i++) {
+    if (symvals[i] >= offset && symvals[i] - offset < size) {
+      entries[entry_count++] = symvals[i];
+    }
+  }
+  qsort(entries, entry_count, sizeof(coil_u64_t), coil_peep_compare_offset);
+  
+  ctx.peep = peep;
+  ctx.base = ir->data + offset;
+  ctx.rules = rules;
+  err = coil_peep_run(&ctx, ir, entries, entry_count);
+  coil_free(entries);
+  
+  if (err == COIL_ERR_GOOD && ctx.code.size > 0xFFFFFFFF) {
+    err = COIL_ERROR(COIL_ERR_NOTSUP, "Output of 4 GiB or more");
+  }
+  coil_size_t base = out->windex;
+  if (err == COIL_ERR_GOOD && ctx.code.size > 0) {
+    coil_size_t written;
+    err = coil_section_write(out, ctx.code.data, ctx.code.size, &written);
+  }
+  
+  if (err != COIL_ERR_GOOD) {
+    coil_u64_t fault = peep->fault;
+    coil_section_cleanup(&ctx.code);
+    coil_peep_cleanup(peep);
+    peep->fault = fault;
+    return err;
+  }
+  
+  // Dropped instructions continue at the next one kept
+  if (peep->moved == NULL) {
+    peep->moved = (coil_u32_t *)coil_malloc(sizeof(coil_u32_t));
+    if (peep->moved == NULL) {
+      coil_section_cleanup(&ctx.code);
+      return COIL_ERROR(COIL_ERR_NOMEM, "Failed to allocate instruction offsets");
+    }
+  }
+  coil_u32_t next = (coil_u32_t)ctx.code.size;
+  peep->moved[peep->instr_count] = next;
+  for (coil_u32_t i = peep->instr_count; i-- > 0;) {
+    if (peep->moved[i] == COIL_PEEP_NONE) {
+      peep->moved[i] = next;
+    } else {
+      next = peep->moved[i];
+    }
+  }
+  
+  peep->code_base = base;
+  peep->code_size = ctx.code.size;
+  peep->fault = 0;
+  coil_section_cleanup(&ctx.code);
+  return COIL_ERR_GOOD;
+}
+
+/**
+* @brief Find the output offset of an offset in the range
+*/
+coil_err_t coil_peep_offset(const coil_peep_t *peep, coil_u64_t ir_offset, coil_u64_t *out_offset) {
+  if (peep == NULL || out_offset == NULL || peep->moved == NULL) {
+    return COIL_ERROR(COIL_ERR_INVAL, "Invalid parameters");
+  }
+  if (ir_offset < peep->offset || ir_offset - peep->offset > peep->size) {
+    return COIL_ERROR(COIL_ERR_NOTFOUND, "Offset does not start an instruction");
+  }
+  
+  coil_u32_t target = (coil_u32_t)(ir_offset - peep->offset);
+  coil_u32_t lo = 0, hi = peep->instr_count;
+  while (lo < hi) {
+    coil_u32_t mid = lo + (hi - lo) / 2;
+    if (peep->instrs[mid] < target) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+  if (target != peep->size && (lo == peep->instr_count || peep->instrs[lo] != target)) {
+    return COIL_ERROR(COIL_ERR_NOTFOUND, "Offset does not start an instruction");
+  }
+  
+  *out_offset = peep->code_base + peep->moved[lo];
+  return COIL_ERR_GOOD;
+}
+
+/**
+* @brief Release a result
+*/
+void coil_peep_cleanup(coil_peep_t *peep) {
+  if (peep == NULL) {
+    return;
+  }
+  
+  coil_free(peep->instrs);
+  coil_free(peep->moved);
+  memset(peep, 0, sizeof(coil_peep_t));
+}
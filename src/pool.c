@@ -0,0 +1,220 @@
+/**
+* @file pool.c
+* @brief Thread-local size-classed buffer pool implementation for libcoil-dev
+*/
+
+#include <coil/base.h>
+#include <coil/pool.h>
+#include "srcdeps.h"
+#include <pthread.h>
+
+/**
+* @brief Free block header, stored in the block itself while it is cached
+*/
+typedef struct coil_pool_block {
+  struct coil_pool_block *next;
+} coil_pool_block_t;
+
+/**
+* @brief Per-thread pool state
+*/
+typedef struct coil_pool_state {
+  coil_pool_block_t *free[COIL_POOL_CLASS_COUNT]; ///< Cached blocks per class
+  coil_size_t count[COIL_POOL_CLASS_COUNT];       ///< Cached block count per class
+  coil_pool_stats_t stats;                        ///< Counters
+  int registered;                                 ///< Thread exit destructor armed
+} coil_pool_state_t;
+
+static __thread coil_pool_state_t coil_pool_state;
+static pthread_key_t coil_pool_exit_key;
+static pthread_once_t coil_pool_exit_once = PTHREAD_ONCE_INIT;
+static int coil_pool_exit_ready;
+
+/**
+* @brief Drain the exiting thread's cache
+*
+* Key destructors run before the thread's TLS goes away, so the state is
+* still the exiting thread's own.
+*/
+static void coil_pool_thread_exit(void *arg) {
+  (void)arg;
+  coil_pool_trim(0);
+}
+
+/**
+* @brief Create the key whose destructor drains caches at thread exit
+*/
+static void coil_pool_exit_init(void) {
+  coil_pool_exit_ready = pthread_key_create(&coil_pool_exit_key, coil_pool_thread_exit) == 0;
+}
+
+/**
+* @brief Arm the thread exit destructor the first time a thread caches a block
+*/
+static void coil_pool_register(coil_pool_state_t *pool) {
+  pthread_once(&coil_pool_exit_once, coil_pool_exit_init);
+  if (coil_pool_exit_ready && pthread_setspecific(coil_pool_exit_key, pool) == 0) {
+    pool->registered = 1;
+  }
+}
+
+/**
+* @brief Get the class index for a size, or -1 when it is past the largest class
+*/
+static int coil_pool_class_index(coil_size_t size) {
+  int shift = COIL_POOL_MIN_SHIFT;
+  while (shift <= COIL_POOL_MAX_SHIFT && ((coil_size_t)1 << shift) < size) {
+    shift++;
+  }
+  return (shift <= COIL_POOL_MAX_SHIFT) ? shift - COIL_POOL_MIN_SHIFT : -1;
+}
+
+/**
+* @brief Allocate a block from the system
+*/
+static void* coil_pool_system_alloc(coil_size_t capacity) {
+  if (capacity >= COIL_POOL_MMAP_THRESHOLD) {
+    return coil_mmap(capacity, 0);
+  }
+  return coil_malloc(capacity);
+}
+
+/**
+* @brief Return a block to the system
+*/
+static void coil_pool_system_free(void *ptr, coil_size_t capacity) {
+  if (capacity >= COIL_POOL_MMAP_THRESHOLD) {
+    coil_munmap(ptr, capacity);
+  } else {
+    coil_free(ptr);
+  }
+}
+
+/**
+* @brief Get the capacity the pool hands out for a request
+*/
+coil_size_t coil_pool_class_size(coil_size_t size) {
+  int index = coil_pool_class_index(size);
+  if (index < 0) {
+    // Oversized mapped blocks are whole pages anyway
+    return (size >= COIL_POOL_MMAP_THRESHOLD) ? coil_align_up(size, coil_get_page_size()) : size;
+  }
+  return (coil_size_t)1 << (index + COIL_POOL_MIN_SHIFT);
+}
+
+/**
+* @brief Allocate a buffer from the calling thread's pool
+*/
+void* coil_pool_alloc(coil_size_t size, coil_size_t *capacity) {
+  coil_pool_state_t *pool = &coil_pool_state;
+  coil_size_t class_size = coil_pool_class_size(size);
+  int index = coil_pool_class_index(size);
+  
+  // Serve from the cache when a block of this class is waiting
+  if (index >= 0 && pool->free[index] != NULL) {
+    coil_pool_block_t *block = pool->free[index];
+    pool->free[index] = block->next;
+    pool->count[index]--;
+    pool->stats.bytes_retained -= class_size;
+    pool->stats.blocks_retained--;
+    pool->stats.hits++;
+    
+    if (capacity != NULL) {
+      *capacity = class_size;
+    }
+    return block;
+  }
+  
+  void *ptr = coil_pool_system_alloc(class_size);
+  if (ptr == NULL) {
+    COIL_ERROR(COIL_ERR_NOMEM, "Failed to allocate pool block");
+    return NULL;
+  }
+  
+  pool->stats.misses++;
+  if (capacity != NULL) {
+    *capacity = class_size;
+  }
+  return ptr;
+}
+
+/**
+* @brief Return a buffer to the calling thread's pool
+*/
+void coil_pool_free(void *ptr, coil_size_t capacity) {
+  if (ptr == NULL) {
+    return;
+  }
+  
+  coil_pool_state_t *pool = &coil_pool_state;
+  int index = coil_pool_class_index(capacity);
+  
+  // Only exact class sizes can be cached, and only while the thread stays under its limits
+  if (index < 0 || ((coil_size_t)1 << (index + COIL_POOL_MIN_SHIFT)) != capacity ||
+      pool->count[index] >= COIL_POOL_CLASS_LIMIT ||
+      pool->stats.bytes_retained + capacity > COIL_POOL_RETAIN_LIMIT) {
+    coil_pool_system_free(ptr, capacity);
+    pool->stats.drops++;
+    return;
+  }
+  
+  if (!pool->registered) {
+    coil_pool_register(pool);
+  }
+  
+  coil_pool_block_t *block = (coil_pool_block_t *)ptr;
+  block->next = pool->free[index];
+  pool->free[index] = block;
+  pool->count[index]++;
+  pool->stats.bytes_retained += capacity;
+  pool->stats.blocks_retained++;
+  pool->stats.releases++;
+}
+
+/**
+* @brief Release cached blocks until at most keep_bytes remain
+*/
+coil_size_t coil_pool_trim(coil_size_t keep_bytes) {
+  coil_pool_state_t *pool = &coil_pool_state;
+  coil_size_t released = 0;
+  
+  for (int index = COIL_POOL_CLASS_COUNT - 1; index >= 0; index--) {
+    coil_size_t class_size = (coil_size_t)1 << (index + COIL_POOL_MIN_SHIFT);
+    
+    while (pool->free[index] != NULL && pool->stats.bytes_retained > keep_bytes) {
+      coil_pool_block_t *block = pool->free[index];
+      pool->free[index] = block->next;
+      pool->count[index]--;
+      pool->stats.bytes_retained -= class_size;
+      pool->stats.blocks_retained--;
+      
+      coil_pool_system_free(block, class_size);
+      released += class_size;
+    }
+  }
+  
+  return released;
+}
+
+/**
+* @brief Get pool counters for the calling thread
+*/
+coil_err_t coil_pool_get_stats(coil_pool_stats_t *stats) {
+  if (stats == NULL) {
+    return COIL_ERROR(COIL_ERR_INVAL, "Stats pointer is NULL");
+  }
+  
+  *stats = coil_pool_state.stats;
+  return COIL_ERR_GOOD;
+}
+
+/**
+* @brief Reset hit/miss/release/drop counters for the calling thread
+*/
+void coil_pool_reset_stats(void) {
+  coil_pool_stats_t *stats = &coil_pool_state.stats;
+  stats->hits = 0;
+  stats->misses = 0;
+  stats->releases = 0;
+  stats->drops = 0;
+}
@@ -0,0 +1,857 @@
+/**
+* @file regalloc.c
+* @brief Linear-scan register allocation of COIL variables for libcoil-dev
+*/
+
+#include <coil/base.h>
+#include <coil/regalloc.h>
+#include <coil/dflow.h>
+#include <coil/instr.h>
+#include "srcdeps.h"
+#include <stdlib.h>
+#include <string.h>
+
+/**
+* @brief Scratch state of one allocation
+*/
+typedef struct coil_regalloc_scan {
+  const coil_cfg_t *cfg;               ///< Graph of the function
+  coil_live_t live;                    ///< Liveness of the function
+  coil_u32_t *calls;                   ///< Instructions that are CALLs, in order
+  coil_u32_t call_count;               ///< Number of CALLs
+  coil_u32_t call_capacity;            ///< Allocated CALLs
+  coil_u32_t instr_capacity;           ///< Allocated instructions
+  coil_u32_t ref_capacity;             ///< Allocated references
+  coil_u32_t named;                    ///< Mask of registers the function names
+  coil_u64_t *order;                   ///< Start and index of each interval, ascending
+  coil_u32_t active[COIL_CBC_REGISTERS]; ///< Intervals holding a register
+  coil_u32_t active_count;             ///< Number of intervals holding a register
+  coil_u32_t free;                     ///< Mask of registers not held
+} coil_regalloc_scan_t;
+
+// -------------------------------- Targets -------------------------------- //
+
+/**
+* @brief Get the number of registers a target offers for allocation
+*/
+coil_u32_t coil_regalloc_target_registers(coil_u8_t arch) {
+  switch (arch) {
+    case COIL_CPU_x86:
+    case COIL_CPU_x86_32:
+      return 6;   // AX, BX, CX, DX, SI, DI
+    case COIL_CPU_x86_64:
+      return 14;  // Less RSP and RBP
+    case COIL_CPU_ARMT:
+      return 7;   // R0 to R7 less the R7 frame pointer
+    case COIL_CPU_ARM32:
+      return 11;  // R0 to R12 less FP and IP
+    case COIL_CPU_ARM64:
+      return 28;  // X0 to X30 less X18, FP and LR
+    case COIL_CPU_RISCV32:
+    case COIL_CPU_RISCV64:
+      return 26;  // x1 to x31 less RA, SP, GP, TP and FP
+    case COIL_CPU_PPC32:
+    case COIL_CPU_PPC64:
+      return 28;  // Less r0, SP, TOC and the thread pointer
+    case COIL_CPU_MIPS32:
+    case COIL_CPU_MIPS64:
+      return 24;  // Less zero, AT, K0, K1, GP, SP, FP and RA
+    default:
+      return COIL_CBC_REGISTERS;
+  }
+}
+
+// -------------------------------- Decoding -------------------------------- //
+
+/**
+* @brief Read a host order unsigned integer of up to 8 bytes (all ones for other sizes)
+*/
+static coil_u64_t coil_regalloc_uint(const coil_byte_t *data, coil_size_t size) {
+  switch (size) {
+    case 1: { coil_u8_t v; memcpy(&v, data, 1); return v; }
+    case 2: { coil_u16_t v; memcpy(&v, data, 2); return v; }
+    case 4: { coil_u32_t v; memcpy(&v, data, 4); return v; }
+    case 8: { coil_u64_t v; memcpy(&v, data, 8); return v; }
+    default: return ~(coil_u64_t)0;
+  }
+}
+
+/**
+* @brief Grow an array to hold one more element
+*/
+static coil_err_t coil_regalloc_reserve(void **items, coil_u32_t count, coil_u32_t *capacity, coil_size_t size) {
+  if (count < *capacity) {
+    return COIL_ERR_GOOD;
+  }
+  
+  coil_u32_t grown = *capacity ? *capacity * 2 : 64;
+  void *p = coil_realloc(*items, (coil_size_t)grown * size);
+  if (p == NULL) {
+    return COIL_ERROR(COIL_ERR_NOMEM, "Failed to allocate allocation state");
+  }
+  *items = p;
+  *capacity = grown;
+  return COIL_ERR_GOOD;
+}
+
+/**
+* @brief Decode the function into the instruction and reference arrays
+*/
+static coil_err_t coil_regalloc_decode(coil_regalloc_t *ra, coil_section_t *ir, coil_regalloc_scan_t *scan) {
+  const coil_cfg_t *cfg = scan->cfg;
+  
+  for (coil_u32_t b = 0; b < cfg->count; b++) {
+    ra->blocks[b] = ra->instr_count;
+    coil_u64_t pos = cfg->start[b];
+    
+    while (pos < cfg->end[b]) {
+      ra->fault = pos;
+      coil_instrmem_t instrmem;
+      coil_instrfmt_t fmt;
+      coil_size_t next = coil_instr_decode(ir, pos, &instrmem, &fmt);
+      if (next == 0) {
+        return coil_error_get_last();
+      }
+      if (ra->instr_count >= (coil_u32_t)1 << 30) {
+        return COIL_ERROR(COIL_ERR_NOTSUP, "Too many instructions to allocate");
+      }
+      
+      int count = 0;
+      int flagged = 0;
+      switch (fmt) {
+        case COIL_INSTRFMT_VALUE:
+        case COIL_INSTRFMT_UNARY:
+          count = 1;
+          break;
+        case COIL_INSTRFMT_BINARY:
+          count = 2;
+          break;
+        case COIL_INSTRFMT_TENARY:
+          count = 3;
+          break;
+        case COIL_INSTRFMT_FLAG_UNARY:
+        case COIL_INSTRFMT_FLAG_BINARY:
+        case COIL_INSTRFMT_FLAG_TENARY:
+          flagged = ((coil_instrflag_t *)&instrmem)->flag != COIL_INSTRFLAG_NONE;
+          count = fmt == COIL_INSTRFMT_FLAG_UNARY ? 1 : fmt == COIL_INSTRFMT_FLAG_BINARY ? 2 : 3;
+          break;
+        default:
+          break;
+      }
+      
+      coil_err_t err = coil_regalloc_reserve((void **)&ra->instrs, ra->instr_count, &scan->instr_capacity,
+                                             sizeof(coil_regalloc_instr_t));
+      if (err == COIL_ERR_GOOD && instrmem.opcode == COIL_OP_CALL) {
+        err = coil_regalloc_reserve((void **)&scan->calls, scan->call_count, &scan->call_capacity, sizeof(coil_u32_t));
+        if (err == COIL_ERR_GOOD) {
+          scan->calls[scan->call_count++] = ra->instr_count;
+        }
+      }
+      if (err != COIL_ERR_GOOD) {
+        return err;
+      }
+      
+      coil_regalloc_instr_t *instr = &ra->instrs[ra->instr_count];
+      instr->offset = (coil_u32_t)(pos - ra->offset);
+      instr->ref = ra->ref_count;
+      instr->ref_count = 0;
+      instr->opcode = instrmem.opcode;
+      
+      // Same reads and writes as the liveness, a conditional write also reads
+      coil_live_access_t access = coil_live_access(instrmem.opcode);
+      pos = next;
+      for (int i = 0; i < count; i++) {
+        coil_u64_t at = pos;
+        coil_operand_header_t header;
+        coil_offset_t offset;
+        next = coil_operand_decode(ir, pos, &header, &offset);
+        if (next == 0) {
+          return coil_error_get_last();
+        }
+        
+        coil_byte_t data[16];
+        coil_size_t valsize;
+        next = coil_operand_decode_data(ir, next, data, sizeof(data), &valsize, &header);
+        if (next == 0) {
+          return coil_error_get_last();
+        }
+        pos = next;
+        
+        coil_u64_t value = coil_regalloc_uint(data, valsize);
+        int base = header.type == COIL_TYPEOP_OFF && header.value_type == COIL_VAL_VAR;
+        if (header.type == COIL_TYPEOP_REG || (header.type == COIL_TYPEOP_OFF && header.value_type == COIL_VAL_REG)) {
+          if (value < COIL_CBC_REGISTERS) {
+            scan->named |= (coil_u32_t)1 << value;
+          }
+          continue;
+        }
+        if (header.type != COIL_TYPEOP_VAR && !base) {
+          continue;
+        }
+        
+        coil_u32_t fact;
+        if (coil_live_index(&scan->live, value, &fact) != COIL_ERR_GOOD) {
+          return COIL_ERROR(COIL_ERR_FORMAT, "Variable missing from the liveness");
+        }
+        err = coil_regalloc_reserve((void **)&ra->refs, ra->ref_count, &scan->ref_capacity, sizeof(coil_regalloc_ref_t));
+        if (err != COIL_ERR_GOOD) {
+          return err;
+        }
+        
+        coil_regalloc_ref_t *ref = &ra->refs[ra->ref_count++];
+        ref->interval = fact;
+        ref->offset = (coil_u32_t)(at - ra->offset);
+        ref->size = (coil_u8_t)(pos - at);
+        ref->value_type = header.value_type;
+        ref->modifier = header.modifier;
+        if (base) {
+          ref->flags = COIL_REGALLOC_READ | COIL_REGALLOC_BASE;
+          ra->intervals[fact].flags |= COIL_REGALLOC_BASED;
+        } else if (i == 0 && access != COIL_LIVE_READ) {
+          ref->flags = COIL_REGALLOC_WRITE;
+          if (access == COIL_LIVE_UPDATE || flagged) {
+            ref->flags |= COIL_REGALLOC_READ;
+          }
+        } else {
+          ref->flags = COIL_REGALLOC_READ;
+        }
+        if (header.modifier & (COIL_MOD_VOL | COIL_MOD_ATOMIC)) {
+          ra->intervals[fact].flags |= COIL_REGALLOC_MEMORY;
+        }
+        instr->ref_count++;
+      }
+      ra->instr_count++;
+    }
+  }
+  ra->blocks[cfg->count] = ra->instr_count;
+  
+  return COIL_ERR_GOOD;
+}
+
+// -------------------------------- Intervals -------------------------------- //
+
+/**
+* @brief Widen an interval to cover a position
+*/
+static inline void coil_regalloc_cover(coil_regalloc_interval_t *iv, coil_u32_t position) {
+  if (position < iv->start) {
+    iv->start = position;
+  }
+  if (position > iv->end) {
+    iv->end = position;
+  }
+}
+
+/**
+* @brief Compute the interval of every variable from its references and the block liveness
+*/
+static void coil_regalloc_intervals(coil_regalloc_t *ra, const coil_regalloc_scan_t *scan) {
+  for (coil_u32_t i = 0; i < ra->instr_count; i++) {
+    const coil_regalloc_instr_t *instr = &ra->instrs[i];
+    for (coil_u32_t r = instr->ref; r < instr->ref + instr->ref_count; r++) {
+      coil_regalloc_interval_t *iv = &ra->intervals[ra->refs[r].interval];
+      if (ra->refs[r].flags & COIL_REGALLOC_READ) {
+        coil_regalloc_cover(iv, 2 * i);
+      }
+      if (ra->refs[r].flags & COIL_REGALLOC_WRITE) {
+        coil_regalloc_cover(iv, 2 * i + 1);
+      }
+    }
+  }
+  
+  // A variable live across a block boundary covers it
+  if (ra->count == 0) {
+    return;
+  }
+  for (coil_u32_t b = 0; b < ra->block_count; b++) {
+    coil_u32_t first = ra->blocks[b], last = ra->blocks[b + 1] - 1;
+    coil_u32_t fact = 0;
+    int more = coil_dflow_next(&scan->live.flow, COIL_DFLOW_IN, b, 0, &fact);
+    while (more) {
+      coil_regalloc_cover(&ra->intervals[fact], 2 * first);
+      more = fact + 1 < ra->count && coil_dflow_next(&scan->live.flow, COIL_DFLOW_IN, b, fact + 1, &fact);
+    }
+    more = coil_dflow_next(&scan->live.flow, COIL_DFLOW_OUT, b, 0, &fact);
+    while (more) {
+      coil_regalloc_cover(&ra->intervals[fact], 2 * last + 1);
+      more = fact + 1 < ra->count && coil_dflow_next(&scan->live.flow, COIL_DFLOW_OUT, b, fact + 1, &fact);
+    }
+  }
+}
+
+/**
+* @brief Move a split back to the start of a loop the tail would branch back into
+*
+* Blocks are visited downwards from the split, a live-in block reached
+* from at or past the split moves it to the block's start.
+*/
+static coil_u32_t coil_regalloc_adjust(const coil_regalloc_t *ra, const coil_regalloc_scan_t *scan,
+                                       coil_u32_t fact, coil_u32_t split) {
+  const coil_regalloc_interval_t *iv = &ra->intervals[fact];
+  const coil_cfg_t *cfg = scan->cfg;
+  coil_u32_t first = iv->start / 2;
+  if (split <= first || split > ra->instr_count) {
+    return split;
+  }
+  
+  // Block holding the instruction before the split
+  coil_u32_t lo = 0, hi = ra->block_count;
+  while (hi - lo > 1) {
+    coil_u32_t mid = lo + (hi - lo) / 2;
+    if (ra->blocks[mid] <= split - 1) {
+      lo = mid;
+    } else {
+      hi = mid;
+    }
+  }
+  
+  for (coil_u32_t b = lo;; b--) {
+    if (coil_dflow_has(&scan->live.flow, COIL_DFLOW_IN, b, fact)) {
+      for (coil_u32_t e = cfg->pred_index[b]; e < cfg->pred_index[b + 1]; e++) {
+        if (ra->blocks[cfg->pred[e] + 1] - 1 >= split) {
+          split = ra->blocks[b];
+          break;
+        }
+      }
+    }
+    if (b == 0 || ra->blocks[b] <= first) {
+      break;
+    }
+  }
+  return split;
+}
+
+/**
+* @brief Split an interval, its tail from an instruction on going to its spill slot
+*/
+static void coil_regalloc_split(coil_regalloc_t *ra, const coil_regalloc_scan_t *scan, coil_u32_t fact,
+                                coil_u32_t split) {
+  coil_regalloc_interval_t *iv = &ra->intervals[fact];
+  split = coil_regalloc_adjust(ra, scan, fact, split);
+  
+  if (split <= iv->start / 2) {
+    iv->split = iv->start / 2;
+    iv->reg = COIL_REGALLOC_NO_REG;
+    ra->spills++;
+  } else {
+    iv->split = split;
+    ra->splits++;
+  }
+}
+
+/**
+* @brief Release the registers of intervals that end before a position
+*/
+static void coil_regalloc_expire(coil_regalloc_t *ra, coil_regalloc_scan_t *scan, coil_u32_t position) {
+  for (coil_u32_t a = 0; a < scan->active_count;) {
+    const coil_regalloc_interval_t *iv = &ra->intervals[scan->active[a]];
+    if (iv->end < position) {
+      scan->free |= (coil_u32_t)1 << iv->reg;
+      scan->active[a] = scan->active[--scan->active_count];
+    } else {
+      a++;
+    }
+  }
+}
+
+/**
+* @brief Split every interval live across a CALL right after it
+*/
+static void coil_regalloc_clobber(coil_regalloc_t *ra, coil_regalloc_scan_t *scan, coil_u32_t call) {
+  coil_regalloc_expire(ra, scan, 2 * call);
+  
+  for (coil_u32_t a = 0; a < scan->active_count;) {
+    coil_u32_t fact = scan->active[a];
+    coil_regalloc_interval_t *iv = &ra->intervals[fact];
+    if (iv->end > 2 * call) {
+      scan->free |= (coil_u32_t)1 << iv->reg;
+      scan->active[a] = scan->active[--scan->active_count];
+      coil_regalloc_split(ra, scan, fact, call + 1);
+    } else {
+      a++;
+    }
+  }
+}
+
+/**
+* @brief Order interval keys ascending (start, then index)
+*/
+static int coil_regalloc_compare_key(const void *a, const void *b) {
+  coil_u64_t x = *(const coil_u64_t *)a;
+  coil_u64_t y = *(const coil_u64_t *)b;
+  return x < y ? -1 : x > y;
+}
+
+/**
+* @brief Check whether an interval is a better spill choice than another
+*
+* Offset bases go last, otherwise the one that ends later.
+*/
+static inline int coil_regalloc_worse(const coil_regalloc_interval_t *a, const coil_regalloc_interval_t *b) {
+  int based_a = (a->flags & COIL_REGALLOC_BASED) != 0;
+  int based_b = (b->flags & COIL_REGALLOC_BASED) != 0;
+  if (based_a != based_b) {
+    return based_b;
+  }
+  return a->end >= b->end;
+}
+
+/**
+* @brief Hand out registers in order of interval start
+*/
+static void coil_regalloc_scan(coil_regalloc_t *ra, coil_regalloc_scan_t *scan, coil_u32_t count) {
+  coil_u32_t call = 0;
+  
+  for (coil_u32_t k = 0; k < count; k++) {
+    coil_u32_t fact = (coil_u32_t)scan->order[k];
+    coil_regalloc_interval_t *iv = &ra->intervals[fact];
+    
+    while (call < scan->call_count && 2 * scan->calls[call] + 1 <= iv->start) {
+      coil_regalloc_clobber(ra, scan, scan->calls[call++]);
+    }
+    coil_regalloc_expire(ra, scan, iv->start);
+    
+    if (iv->flags & COIL_REGALLOC_MEMORY) {
+      coil_regalloc_split(ra, scan, fact, iv->start / 2);
+      continue;
+    }
+    
+    if (scan->free != 0) {
+      coil_u8_t reg = (coil_u8_t)__builtin_ctz(scan->free);
+      scan->free &= ~((coil_u32_t)1 << reg);
+      ra->used |= (coil_u32_t)1 << reg;
+      iv->reg = reg;
+      scan->active[scan->active_count++] = fact;
+      continue;
+    }
+    
+    // Nothing free: the worst of the active intervals and this one gives way
+    coil_u32_t victim = 0;
+    for (coil_u32_t a = 1; a < scan->active_count; a++) {
+      if (coil_regalloc_worse(&ra->intervals[scan->active[a]], &ra->intervals[scan->active[victim]])) {
+        victim = a;
+      }
+    }
+    if (scan->active_count == 0 || coil_regalloc_worse(iv, &ra->intervals[scan->active[victim]])) {
+      coil_regalloc_split(ra, scan, fact, iv->start / 2);
+      continue;
+    }
+    
+    // The victim still reads its register at this instruction when this one only writes it
+    coil_u32_t other = scan->active[victim];
+    iv->reg = ra->intervals[other].reg;
+    scan->active[victim] = fact;
+    coil_regalloc_split(ra, scan, other, (iv->start + 1) / 2);
+  }
+  
+  while (call < scan->call_count) {
+    coil_regalloc_clobber(ra, scan, scan->calls[call++]);
+  }
+}
+
+/**
+* @brief Pack the spill slots of spilled intervals by a second scan
+*/
+static coil_err_t coil_regalloc_slots(coil_regalloc_t *ra, coil_regalloc_scan_t *scan, coil_u32_t count) {
+  coil_u32_t spilled = ra->splits + ra->spills;
+  if (spilled == 0) {
+    return COIL_ERR_GOOD;
+  }
+  
+  // Min-heap of (end, slot) for taken slots, stack of free ones
+  coil_u64_t *heap = (coil_u64_t *)coil_malloc(spilled * sizeof(coil_u64_t));
+  coil_u32_t *free = (coil_u32_t *)coil_malloc(spilled * sizeof(coil_u32_t));
+  if (heap == NULL || free == NULL) {
+    coil_free(free);
+    coil_free(heap);
+    return COIL_ERROR(COIL_ERR_NOMEM, "Failed to allocate spill slots");
+  }
+  coil_u32_t heap_count = 0, free_count = 0;
+  
+  for (coil_u32_t k = 0; k < count; k++) {
+    coil_regalloc_interval_t *iv = &ra->intervals[(coil_u32_t)scan->order[k]];
+    if (iv->split == COIL_REGALLOC_NONE) {
+      continue;
+    }
+    
+    while (heap_count > 0 && (heap[0] >> 32) < iv->start) {
+      free[free_count++] = (coil_u32_t)heap[0];
+      heap[0] = heap[--heap_count];
+      for (coil_u32_t i = 0;;) {
+        coil_u32_t l = 2 * i + 1, m = i;
+        if (l < heap_count && heap[l] < heap[m]) {
+          m = l;
+        }
+        if (l + 1 < heap_count && heap[l + 1] < heap[m]) {
+          m = l + 1;
+        }
+        if (m == i) {
+          break;
+        }
+        coil_u64_t t = heap[i]; heap[i] = heap[m]; heap[m] = t;
+        i = m;
+      }
+    }
+    
+    iv->slot = free_count > 0 ? free[--free_count] : ra->slots++;
+    coil_u32_t i = heap_count++;
+    heap[i] = ((coil_u64_t)iv->end << 32) | iv->slot;
+    while (i > 0 && heap[(i - 1) / 2] > heap[i]) {
+      coil_u64_t t = heap[i]; heap[i] = heap[(i - 1) / 2]; heap[(i - 1) / 2] = t;
+      i = (i - 1) / 2;
+    }
+  }
+  
+  coil_free(free);
+  coil_free(heap);
+  return COIL_ERR_GOOD;
+}
+
+// -------------------------------- Allocation -------------------------------- //
+
+/**
+* @brief Allocate registers for the variables of a function
+*/
+coil_err_t coil_regalloc_build(coil_regalloc_t *ra, const coil_cfg_t *cfg, coil_section_t *ir,
+                               const coil_regalloc_options_t *options) {
+  if (ra == NULL) {
+    return COIL_ERROR(COIL_ERR_INVAL, "Invalid parameters");
+  }
+  memset(ra, 0, sizeof(coil_regalloc_t));
+  
+  if (cfg == NULL || ir == NULL) {
+    return COIL_ERROR(COIL_ERR_INVAL, "Invalid parameters");
+  }
+  if (coil_section_is_chunked(ir)) {
+    return COIL_ERROR(COIL_ERR_BADSTATE, "Cannot allocate over a chunked section");
+  }
+  
+  coil_regalloc_options_t defaults;
+  if (options == NULL) {
+    coil_regalloc_options_init(&defaults);
+    options = &defaults;
+  }
+  if (options->frame_reg >= COIL_CBC_REGISTERS || options->scratch_reg >= COIL_CBC_REGISTERS) {
+    return COIL_ERROR(COIL_ERR_INVAL, "Invalid options");
+  }
+  
+  ra->offset = cfg->offset;
+  ra->size = cfg->size;
+  ra->slot_base = options->slot_base;
+  ra->block_count = cfg->count;
+  
+  coil_regalloc_scan_t scan;
+  memset(&scan, 0, sizeof(scan));
+  scan.cfg = cfg;
+  coil_err_t err = coil_live_build(&scan.live, cfg, ir, COIL_DFLOW_AUTO);
+  
+  if (err == COIL_ERR_GOOD) {
+    ra->count = scan.live.var_count;
+    ra->intervals = (coil_regalloc_interval_t *)coil_malloc((ra->count > 0 ? ra->count : 1) *
+                                                            sizeof(coil_regalloc_interval_t));
+    ra->blocks = (coil_u32_t *)coil_malloc((cfg->count + 1) * sizeof(coil_u32_t));
+    scan.order = (coil_u64_t *)coil_malloc((ra->count > 0 ? ra->count : 1) * sizeof(coil_u64_t));
+    if (ra->intervals == NULL || ra->blocks == NULL || scan.order == NULL) {
+      err = COIL_ERROR(COIL_ERR_NOMEM, "Failed to allocate intervals");
+    }
+  }
+  
+  if (err == COIL_ERR_GOOD) {
+    for (coil_u32_t v = 0; v < ra->count; v++) {
+      coil_regalloc_interval_t *iv = &ra->intervals[v];
+      iv->var = scan.live.vars[v];
+      iv->start = COIL_REGALLOC_NONE;
+      iv->end = 0;
+      iv->split = COIL_REGALLOC_NONE;
+      iv->slot = COIL_REGALLOC_NONE;
+      iv->reg = COIL_REGALLOC_NO_REG;
+      iv->flags = 0;
+    }
+    ra->blocks[0] = 0;
+    err = coil_regalloc_decode(ra, ir, &scan);
+  }
+  
+  if (err == COIL_ERR_GOOD) {
+    ra->fault = 0;
+    
+    // Lowest registers first, never the ones the function or the lowering use
+    coil_u32_t limit = options->registers != 0 ? options->registers : coil_regalloc_target_registers(options->arch);
+    coil_u32_t taken = scan.named | options->reserved | ((coil_u32_t)1 << options->frame_reg) |
+                       ((coil_u32_t)1 << options->scratch_reg);
+    for (coil_u32_t r = 0; r < COIL_CBC_REGISTERS && ra->reg_count < limit; r++) {
+      if (!(taken & ((coil_u32_t)1 << r))) {
+        ra->regs[ra->reg_count++] = (coil_u8_t)r;
+        scan.free |= (coil_u32_t)1 << r;
+      }
+    }
+    
+    coil_regalloc_intervals(ra, &scan);
+    coil_u32_t count = 0;
+    for (coil_u32_t v = 0; v < ra->count; v++) {
+      if (ra->intervals[v].start != COIL_REGALLOC_NONE) {
+        scan.order[count++] = ((coil_u64_t)ra->intervals[v].start << 32) | v;
+      }
+    }
+    qsort(scan.order, count, sizeof(coil_u64_t), coil_regalloc_compare_key);
+    
+    coil_regalloc_scan(ra, &scan, count);
+    err = coil_regalloc_slots(ra, &scan, count);
+  }
+  
+  coil_u64_t fault = ra->fault;
+  coil_free(scan.order);
+  coil_free(scan.calls);
+  coil_live_cleanup(&scan.live);
+  if (err != COIL_ERR_GOOD) {
+    coil_regalloc_cleanup(ra);
+    ra->fault = fault;
+    return err;
+  }
+  return COIL_ERR_GOOD;
+}
+
+/**
+* @brief Find the instruction at an offset
+*/
+static coil_u32_t coil_regalloc_instr_at(const coil_regalloc_t *ra, coil_u64_t ir_offset) {
+  if (ir_offset < ra->offset || ir_offset - ra->offset >= ra->size) {
+    return COIL_REGALLOC_NONE;
+  }
+  
+  coil_u32_t target = (coil_u32_t)(ir_offset - ra->offset);
+  coil_u32_t lo = 0, hi = ra->instr_count;
+  while (lo < hi) {
+    coil_u32_t mid = lo + (hi - lo) / 2;
+    if (ra->instrs[mid].offset < target) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+  return lo < ra->instr_count && ra->instrs[lo].offset == target ? lo : COIL_REGALLOC_NONE;
+}
+
+/**
+* @brief Check whether an interval is in its register at an instruction
+*/
+static inline int coil_regalloc_in_reg(const coil_regalloc_interval_t *iv, coil_u32_t instr) {
+  return iv->reg != COIL_REGALLOC_NO_REG && (iv->split == COIL_REGALLOC_NONE || instr < iv->split);
+}
+
+/**
+* @brief Find where a variable is at an instruction
+*/
+coil_err_t coil_regalloc_find(const coil_regalloc_t *ra, coil_u64_t var, coil_u64_t ir_offset, coil_u8_t *reg,
+                              coil_u64_t *slot) {
+  if (ra == NULL || reg == NULL) {
+    return COIL_ERROR(COIL_ERR_INVAL, "Invalid parameters");
+  }
+  
+  coil_u32_t lo = 0, hi = ra->count;
+  while (lo < hi) {
+    coil_u32_t mid = lo + (hi - lo) / 2;
+    if (ra->intervals[mid].var < var) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+  coil_u32_t instr = coil_regalloc_instr_at(ra, ir_offset);
+  if (lo == ra->count || ra->intervals[lo].var != var || instr == COIL_REGALLOC_NONE) {
+    return COIL_ERROR(COIL_ERR_NOTFOUND, "Variable or instruction not in the function");
+  }
+  
+  const coil_regalloc_interval_t *iv = &ra->intervals[lo];
+  *reg = coil_regalloc_in_reg(iv, instr) ? iv->reg : COIL_REGALLOC_NO_REG;
+  if (slot != NULL && iv->slot != COIL_REGALLOC_NONE) {
+    *slot = ra->slot_base + iv->slot;
+  }
+  return COIL_ERR_GOOD;
+}
+
+// -------------------------------- Rewriting -------------------------------- //
+
+/**
+* @brief Append operand data holding a register or variable id
+*/
+static coil_err_t coil_regalloc_put(coil_section_t *code, coil_u64_t value, coil_size_t size) {
+  if (size == 0 || size > 16 || (size < 8 && value >> (size * 8) != 0)) {
+    return COIL_ERROR(COIL_ERR_NOTSUP, "Register or slot does not fit the operand's value type");
+  }
+  
+  coil_byte_t data[16] = {0};
+  switch (size) {
+    case 1: { coil_u8_t v = (coil_u8_t)value; memcpy(data, &v, 1); break; }
+    case 2: { coil_u16_t v = (coil_u16_t)value; memcpy(data, &v, 2); break; }
+    case 4: { coil_u32_t v = (coil_u32_t)value; memcpy(data, &v, 4); break; }
+    default: memcpy(data, &value, 8); break;
+  }
+  return coil_operand_encode_data(code, data, size);
+}
+
+/**
+* @brief Append bytes of the original function
+*/
+static coil_err_t coil_regalloc_copy(coil_section_t *code, coil_section_t *ir, coil_u64_t from, coil_u64_t to) {
+  coil_size_t written;
+  if (to <= from) {
+    return COIL_ERR_GOOD;
+  }
+  return coil_section_write(code, ir->data + from, to - from, &written);
+}
+
+/**
+* @brief Append a variable operand as its register or slot at an instruction
+*/
+static coil_err_t coil_regalloc_operand(const coil_regalloc_t *ra, coil_section_t *code, coil_section_t *ir,
+                                        const coil_regalloc_ref_t *ref, coil_u32_t instr) {
+  const coil_regalloc_interval_t *iv = &ra->intervals[ref->interval];
+  int in_reg = coil_regalloc_in_reg(iv, instr);
+  coil_u64_t value = in_reg ? iv->reg : ra->slot_base + iv->slot;
+  coil_err_t err;
+  
+  if (ref->flags & COIL_REGALLOC_BASE) {
+    coil_operand_header_t header;
+    coil_offset_t offset;
+    if (coil_operand_decode(ir, ra->offset + ref->offset, &header, &offset) == 0) {
+      return coil_error_get_last();
+    }
+    err = coil_operand_encode_off(code, COIL_TYPEOP_OFF, in_reg ? COIL_VAL_REG : COIL_VAL_VAR, ref->modifier, &offset);
+    return err != COIL_ERR_GOOD ? err : coil_regalloc_put(code, value, in_reg ? 4 : 8);
+  }
+  
+  err = coil_operand_encode(code, in_reg ? COIL_TYPEOP_REG : COIL_TYPEOP_VAR, ref->value_type, ref->modifier);
+  return err != COIL_ERR_GOOD ? err : coil_regalloc_put(code, value, ref->size - sizeof(coil_operand_header_t));
+}
+
+/**
+* @brief Append the function with variables replaced by their registers and slots
+*/
+coil_err_t coil_regalloc_rewrite(coil_regalloc_t *ra, coil_section_t *out, coil_section_t *ir) {
+  if (ra == NULL || out == NULL || ir == NULL || (ra->instr_count > 0 && ra->instrs == NULL)) {
+    return COIL_ERROR(COIL_ERR_INVAL, "Invalid parameters");
+  }
+  if (coil_section_is_chunked(ir)) {
+    return COIL_ERROR(COIL_ERR_BADSTATE, "Cannot rewrite from a chunked section");
+  }
+  if (out->mode == COIL_SECT_MODE_VIEW) {
+    return COIL_ERROR(COIL_ERR_BADSTATE, "Output section is read-only");
+  }
+  
+  coil_u32_t *moved = (coil_u32_t *)coil_malloc((ra->instr_count + 1) * sizeof(coil_u32_t));
+  coil_section_t code;
+  coil_err_t err = coil_section_init(&code, (coil_size_t)ra->size + ra->size / 4 + 64);
+  if (moved == NULL || err != COIL_ERR_GOOD) {
+    coil_free(moved);
+    if (err == COIL_ERR_GOOD) {
+      coil_section_cleanup(&code);
+    }
+    return COIL_ERROR(COIL_ERR_NOMEM, "Failed to allocate rewritten function");
+  }
+  
+  for (coil_u32_t i = 0; i < ra->instr_count && err == COIL_ERR_GOOD; i++) {
+    const coil_regalloc_instr_t *instr = &ra->instrs[i];
+    coil_u64_t cursor = ra->offset + instr->offset;
+    coil_u64_t end = ra->offset + (i + 1 < ra->instr_count ? ra->instrs[i + 1].offset : ra->size);
+    const coil_regalloc_ref_t *store = NULL;
+    ra->fault = cursor;
+    moved[i] = (coil_u32_t)code.size;
+    
+    for (coil_u32_t r = instr->ref; r < instr->ref + instr->ref_count && err == COIL_ERR_GOOD; r++) {
+      const coil_regalloc_ref_t *ref = &ra->refs[r];
+      err = coil_regalloc_copy(&code, ir, cursor, ra->offset + ref->offset);
+      if (err == COIL_ERR_GOOD) {
+        err = coil_regalloc_operand(ra, &code, ir, ref, i);
+      }
+      cursor = ra->offset + ref->offset + ref->size;
+      
+      // Writes ahead of a split keep the slot current for the tail
+      const coil_regalloc_interval_t *iv = &ra->intervals[ref->interval];
+      if ((ref->flags & COIL_REGALLOC_WRITE) && iv->slot != COIL_REGALLOC_NONE && coil_regalloc_in_reg(iv, i)) {
+        store = ref;
+      }
+    }
+    if (err == COIL_ERR_GOOD) {
+      err = coil_regalloc_copy(&code, ir, cursor, end);
+    }
+    
+    if (err == COIL_ERR_GOOD && store != NULL) {
+      const coil_regalloc_interval_t *iv = &ra->intervals[store->interval];
+      coil_size_t valsize = store->size - sizeof(coil_operand_header_t);
+      err = coil_instrflag_encode(&code, COIL_OP_MOV, COIL_INSTRFLAG_NONE);
+      if (err == COIL_ERR_GOOD) {
+        err = coil_operand_encode(&code, COIL_TYPEOP_VAR, store->value_type, COIL_MOD_NONE);
+      }
+      if (err == COIL_ERR_GOOD) {
+        err = coil_regalloc_put(&code, ra->slot_base + iv->slot, valsize);
+      }
+      if (err == COIL_ERR_GOOD) {
+        err = coil_operand_encode(&code, COIL_TYPEOP_REG, store->value_type, COIL_MOD_NONE);
+      }
+      if (err == COIL_ERR_GOOD) {
+        err = coil_regalloc_put(&code, iv->reg, valsize);
+      }
+    }
+  }
+  
+  if (err == COIL_ERR_GOOD && code.size > 0xFFFFFFFF) {
+    err = COIL_ERROR(COIL_ERR_NOTSUP, "Rewritten function beyond 4 GiB");
+  }
+  
+  coil_size_t base = out->windex;
+  if (err == COIL_ERR_GOOD && code.size > 0) {
+    coil_size_t written;
+    err = coil_section_write(out, code.data, code.size, &written);
+  }
+  
+  if (err != COIL_ERR_GOOD) {
+    coil_section_cleanup(&code);
+    coil_free(moved);
+    return err;
+  }
+  
+  moved[ra->instr_count] = (coil_u32_t)code.size;
+  coil_free(ra->moved);
+  ra->moved = moved;
+  ra->code_base = base;
+  ra->code_size = code.size;
+  ra->fault = 0;
+  coil_section_cleanup(&code);
+  return COIL_ERR_GOOD;
+}
+
+/**
+* @brief Find the rewritten offset of an offset in the function
+*/
+coil_err_t coil_regalloc_offset(const coil_regalloc_t *ra, coil_u64_t ir_offset, coil_u64_t *out_offset) {
+  if (ra == NULL || out_offset == NULL) {
+    return COIL_ERROR(COIL_ERR_INVAL, "Invalid parameters");
+  }
+  if (ra->moved == NULL) {
+    return COIL_ERROR(COIL_ERR_BADSTATE, "Function has not been rewritten");
+  }
+  
+  coil_u32_t instr = ir_offset == ra->offset + ra->size ? ra->instr_count : coil_regalloc_instr_at(ra, ir_offset);
+  if (instr == COIL_REGALLOC_NONE) {
+    return COIL_ERROR(COIL_ERR_NOTFOUND, "Offset does not start an instruction");
+  }
+  
+  *out_offset = ra->code_base + ra->moved[instr];
+  return COIL_ERR_GOOD;
+}
+
+/**
+* @brief Release an allocation
+*/
+void coil_regalloc_cleanup(coil_regalloc_t *ra) {
+  if (ra == NULL) {
+    return;
+  }
+  
+  coil_free(ra->instrs);
+  coil_free(ra->refs);
+  coil_free(ra->blocks);
+  coil_free(ra->intervals);
+  coil_free(ra->moved);
+  memset(ra, 0, sizeof(coil_regalloc_t));
+}
@@ -0,0 +1,329 @@
+/**
+* @file reloc.c
+* @brief COIL relocation functionality implementation for libcoil-dev
+*/
+
+#include <coil/base.h>
+#include <coil/reloc.h>
+#include <coil/par.h>
+#include "srcdeps.h"
+
+/**
+* @brief How far ahead symbol values are prefetched during a sweep
+*/
+#define COIL_RELOC_PREFETCH 16
+
+/**
+* @brief Field width in bytes per relocation type
+*/
+static const coil_u8_t coil_reloc_width[COIL_RELOC_TYPE_COUNT] = { 0, 8, 4, 4, 8 };
+
+/**
+* @brief Mask applied to P per relocation type (all ones for PC-relative types)
+*/
+static const coil_u64_t coil_reloc_pcrel[COIL_RELOC_TYPE_COUNT] = { 0, 0, 0, ~0ULL, ~0ULL };
+
+/**
+* @brief Bias added before the overflow check (moves the signed range to unsigned)
+*/
+static const coil_u64_t coil_reloc_bias[COIL_RELOC_TYPE_COUNT] = { 0, 0, 0, 0x80000000ULL, 0 };
+
+/**
+* @brief Bits that must be clear after biasing for the value to fit
+*/
+static const coil_u64_t coil_reloc_high[COIL_RELOC_TYPE_COUNT] = { 0, 0, 0xFFFFFFFF00000000ULL, 0xFFFFFFFF00000000ULL, 0 };
+
+/**
+* @brief Combined sort key (section in the top 16 bits, offset below)
+*/
+static inline coil_u64_t coil_reloc_key(const coil_reloc_t *reloc) {
+  return ((coil_u64_t)reloc->section << 48) | reloc->offset;
+}
+
+/**
+* @brief Sort relocations by target section and offset
+*/
+coil_err_t coil_reloc_sort(coil_reloc_t *relocs, coil_size_t count) {
+  if (relocs == NULL && count > 0) {
+    return COIL_ERROR(COIL_ERR_INVAL, "Relocation array is NULL");
+  }
+  
+  if (count < 2) {
+    return COIL_ERR_GOOD;
+  }
+  
+  coil_reloc_t *tmp = (coil_reloc_t *)coil_malloc(count * sizeof(coil_reloc_t));
+  coil_size_t (*hist)[256] = (coil_size_t (*)[256])coil_calloc(8, sizeof(*hist));
+  if (tmp == NULL || hist == NULL) {
+    coil_free(tmp);
+    coil_free(hist);
+    return COIL_ERROR(COIL_ERR_NOMEM, "Failed to allocate sort buffer");
+  }
+  
+  // One read pass builds the histograms of all eight digits
+  coil_u64_t too_far = 0;
+  for (coil_size_t i = 0; i < count; i++) {
+    coil_u64_t key = coil_reloc_key(&relocs[i]);
+    too_far |= relocs[i].offset & ~COIL_RELOC_MAX_OFFSET;
+    for (int d = 0; d < 8; d++) {
+      hist[d][(key >> (d * 8)) & 0xFF]++;
+    }
+  }
+  
+  if (too_far != 0) {
+    coil_free(tmp);
+    coil_free(hist);
+    return COIL_ERROR(COIL_ERR_INVAL, "Relocation offset too large to sort");
+  }
+  
+  coil_reloc_t *src = relocs;
+  coil_reloc_t *dst = tmp;
+  for (int d = 0; d < 8; d++) {
+    // A digit shared by every entry does not change the order
+    if (hist[d][(coil_reloc_key(&src[0]) >> (d * 8)) & 0xFF] == count) {
+      continue;
+    }
+    
+    coil_size_t pos = 0;
+    for (int b = 0; b < 256; b++) {
+      coil_size_t n = hist[d][b];
+      hist[d][b] = pos;
+      pos += n;
+    }
+    
+    for (coil_size_t i = 0; i < count; i++) {
+      dst[hist[d][(coil_reloc_key(&src[i]) >> (d * 8)) & 0xFF]++] = src[i];
+    }
+    
+    coil_reloc_t *swap = src;
+    src = dst;
+    dst = swap;
+  }
+  
+  if (src != relocs) {
+    coil_memcpy(relocs, src, count * sizeof(coil_reloc_t));
+  }
+  
+  coil_free(tmp);
+  coil_free(hist);
+  return COIL_ERR_GOOD;
+}
+
+/**
+* @brief Check whether relocations are sorted by target section and offset
+*/
+int coil_reloc_is_sorted(const coil_reloc_t *relocs, coil_size_t count) {
+  if (relocs == NULL) {
+    return count == 0;
+  }
+  
+  int unsorted = 0;
+  for (coil_size_t i = 1; i < count; i++) {
+    unsorted |= relocs[i].section < relocs[i - 1].section ||
+                (relocs[i].section == relocs[i - 1].section && relocs[i].offset < relocs[i - 1].offset);
+  }
+  return !unsorted;
+}
+
+/**
+* @brief Apply relocations to a single section
+*/
+coil_err_t coil_reloc_apply_batch(coil_section_t *sect, coil_u64_t base,
+                                  const coil_reloc_t *relocs, coil_size_t count,
+                                  const coil_u64_t *symvals, coil_u32_t symcount) {
+  if (sect == NULL || (count > 0 && (relocs == NULL || symvals == NULL))) {
+    return COIL_ERROR(COIL_ERR_INVAL, "Invalid parameters");
+  }
+  
+  if (count == 0) {
+    return COIL_ERR_GOOD;
+  }
+  
+  if (!coil_section_owns_data(sect) && sect->mode != COIL_SECT_MODE_COW) {
+    return COIL_ERROR(COIL_ERR_BADSTATE, "Section is read-only");
+  }
+  if (coil_section_is_chunked(sect)) {
+    return COIL_ERROR(COIL_ERR_BADSTATE, "Cannot relocate a chunked section");
+  }
+  
+  // Validate the whole batch without branching per entry, nothing is written on failure
+  coil_u16_t section = relocs[0].section;
+  coil_u64_t prev = 0;
+  coil_u64_t overflow = 0;
+  int bad = 0;
+  for (coil_size_t i = 0; i < count; i++) {
+    const coil_reloc_t *reloc = &relocs[i];
+    
+    // Symbol values are the only random access, fetch them ahead of the sweep
+    if (i + COIL_RELOC_PREFETCH < count && relocs[i + COIL_RELOC_PREFETCH].symbol < symcount) {
+      __builtin_prefetch(&symvals[relocs[i + COIL_RELOC_PREFETCH].symbol]);
+    }
+    
+    coil_u8_t type = reloc->type < COIL_RELOC_TYPE_COUNT ? reloc->type : COIL_RELOC_NONE;
+    coil_u64_t symval = reloc->symbol < symcount ? symvals[reloc->symbol] : 0;
+    bad |= (reloc->type >= COIL_RELOC_TYPE_COUNT) | (reloc->symbol >= symcount) |
+           (reloc->section != section) | (reloc->offset < prev) |
+           (reloc->offset > sect->size) | (coil_reloc_width[type] > sect->size - reloc->offset);
+    coil_u64_t value = symval + (coil_u64_t)reloc->addend -
+                       ((base + reloc->offset) & coil_reloc_pcrel[type]);
+    overflow |= (value + coil_reloc_bias[type]) & coil_reloc_high[type];
+    prev = reloc->offset;
+  }
+  
+  if (bad) {
+    return COIL_ERROR(COIL_ERR_FORMAT, "Malformed relocation batch");
+  }
+  if (overflow != 0) {
+    return COIL_ERROR(COIL_ERR_NOTSUP, "Relocation value does not fit its field");
+  }
+  
+  coil_byte_t *data = sect->data;
+  for (coil_size_t i = 0; i < count; i++) {
+    const coil_reloc_t *reloc = &relocs[i];
+    coil_u8_t type = reloc->type;
+    coil_u64_t value = symvals[reloc->symbol] + (coil_u64_t)reloc->addend -
+                       ((base + reloc->offset) & coil_reloc_pcrel[type]);
+    
+    if (coil_reloc_width[type] == 8) {
+      coil_memcpy(data + reloc->offset, &value, 8);
+    } else if (coil_reloc_width[type] == 4) {
+      coil_u32_t field = (coil_u32_t)value;
+      coil_memcpy(data + reloc->offset, &field, 4);
+    }
+  }
+  
+  return COIL_ERR_GOOD;
+}
+
+/**
+* @brief Run of relocations targeting one section
+*/
+typedef struct coil_reloc_run {
+  coil_size_t start;           ///< First relocation
+  coil_size_t count;           ///< Number of relocations
+} coil_reloc_run_t;
+
+/**
+* @brief Shared state for applying runs in parallel
+*/
+typedef struct coil_reloc_job {
+  coil_section_t **sects;
+  const coil_u64_t *bases;
+  const coil_reloc_t *relocs;
+  const coil_reloc_run_t *runs;
+  const coil_u64_t *symvals;
+  coil_u32_t symcount;
+} coil_reloc_job_t;
+
+/**
+* @brief Apply one section's run
+*/
+static coil_err_t coil_reloc_apply_run(void *ctx, coil_size_t index) {
+  const coil_reloc_job_t *job = (const coil_reloc_job_t *)ctx;
+  const coil_reloc_run_t *run = &job->runs[index];
+  coil_u16_t section = job->relocs[run->start].section;
+  
+  return coil_reloc_apply_batch(job->sects[section], job->bases != NULL ? job->bases[section] : 0,
+                                job->relocs + run->start, run->count, job->symvals, job->symcount);
+}
+
+/**
+* @brief Apply relocations to many sections in parallel
+*/
+coil_err_t coil_reloc_apply_sections(coil_section_t **sects, coil_u16_t sect_count, const coil_u64_t *bases,
+                                     const coil_reloc_t *relocs, coil_size_t count,
+                                     const coil_u64_t *symvals, coil_u32_t symcount, coil_u32_t threads) {
+  if (sects == NULL || (count > 0 && (relocs == NULL || symvals == NULL))) {
+    return COIL_ERROR(COIL_ERR_INVAL, "Invalid parameters");
+  }
+  
+  if (!coil_reloc_is_sorted(relocs, count)) {
+    return COIL_ERROR(COIL_ERR_FORMAT, "Relocations are not sorted");
+  }
+  
+  // Split into per-section runs
+  coil_size_t run_count = 0;
+  for (coil_size_t i = 0; i < count; i++) {
+    if (i == 0 || relocs[i].section != relocs[i - 1].section) {
+      if (relocs[i].section >= sect_count || sects[relocs[i].section] == NULL) {
+        return COIL_ERROR(COIL_ERR_FORMAT, "Relocation targets a missing section");
+      }
+      run_count++;
+    }
+  }
+  
+  if (run_count == 0) {
+    return COIL_ERR_GOOD;
+  }
+  
+  coil_reloc_run_t *runs = (coil_reloc_run_t *)coil_malloc(run_count * sizeof(coil_reloc_run_t));
+  if (runs == NULL) {
+    return COIL_ERROR(COIL_ERR_NOMEM, "Failed to allocate relocation runs");
+  }
+  
+  coil_size_t run = 0;
+  for (coil_size_t i = 0; i < count; i++) {
+    if (i == 0 || relocs[i].section != relocs[i - 1].section) {
+      runs[run].start = i;
+      runs[run].count = 0;
+      run++;
+    }
+    runs[run - 1].count++;
+  }
+  
+  coil_reloc_job_t job = { sects, bases, relocs, runs, symvals, symcount };
+  coil_err_t err = coil_par_for(run_count, threads, coil_reloc_apply_run, &job);
+  
+  coil_free(runs);
+  return err;
+}
+
+/**
+* @brief Add relocations to an object as a COIL_SECTION_RELTAB section
+*/
+coil_err_t coil_reloc_emit(coil_object_t *obj, const char *name, const coil_reloc_t *relocs,
+                           coil_size_t count, coil_u16_t *index) {
+  if (obj == NULL || name == NULL || (relocs == NULL && count > 0)) {
+    return COIL_ERROR(COIL_ERR_INVAL, "Invalid parameters");
+  }
+  
+  if (!coil_reloc_is_sorted(relocs, count)) {
+    return COIL_ERROR(COIL_ERR_FORMAT, "Relocations are not sorted");
+  }
+  
+  coil_section_t sect;
+  coil_err_t err = coil_section_init(&sect, count * sizeof(coil_reloc_t));
+  if (err != COIL_ERR_GOOD) {
+    return err;
+  }
+  
+  err = coil_section_write(&sect, (coil_byte_t *)relocs, count * sizeof(coil_reloc_t), NULL);
+  if (err == COIL_ERR_GOOD) {
+    err = coil_obj_create_section(obj, COIL_SECTION_RELTAB, name, COIL_SECTION_FLAG_NONE, &sect, index);
+  }
+  
+  coil_section_cleanup(&sect);
+  return err;
+}
+
+/**
+* @brief Get the relocations stored in a section without copying
+*/
+coil_err_t coil_reloc_view(const coil_section_t *sect, const coil_reloc_t **relocs, coil_size_t *count) {
+  if (sect == NULL || relocs == NULL || count == NULL) {
+    return COIL_ERROR(COIL_ERR_INVAL, "Invalid parameters");
+  }
+  
+  if (coil_section_is_chunked(sect)) {
+    return COIL_ERROR(COIL_ERR_BADSTATE, "Relocation sections must be contiguous");
+  }
+  
+  if (sect->size % sizeof(coil_reloc_t) != 0 ||
+      (sect->size > 0 && ((uintptr_t)sect->data & (sizeof(coil_u64_t) - 1)) != 0)) {
+    return COIL_ERROR(COIL_ERR_FORMAT, "Relocation section is truncated or misaligned");
+  }
+  
+  *relocs = (const coil_reloc_t *)sect->data;
+  *count = sect->size / sizeof(coil_reloc_t);
+  return COIL_ERR_GOOD;
+}
@@ -3,8 +3,11 @@
 * @brief COIL Object Section functionality implementation for libcoil-dev
 */
 
+#define _GNU_SOURCE // mremap
+
 #include <coil/base.h>
 #include <coil/sect.h>
+#include <coil/pool.h>
 #include "srcdeps.h"
 
 /**
@@ -12,8 +15,30 @@
 */
 #define COIL_SECTION_DEFAULT_CAPACITY 1024
 
+/**
+* @brief Chunk size for chunked sections when none is specified
+*/
+#define COIL_SECTION_DEFAULT_CHUNK_SIZE (64 * 1024)
+
+/**
+* @brief Number of chunks handed to a single writev call
+*/
+#define COIL_SECTION_IOV_BATCH 64
+
+/**
+* @brief Default growth policy (double, no cap, map buffers from 1 MiB)
+*/
+#define COIL_SECTION_DEFAULT_GROWTH { 200, 0, (coil_size_t)1 << 20, 1 }
+
+/**
+* @brief Process-wide growth policy
+*/
+static coil_section_growth_t coil_section_growth = COIL_SECTION_DEFAULT_GROWTH;
+
 // Forward declaration for functions not in public API
 static coil_err_t coil_section_resize(coil_section_t *sect, coil_size_t new_capacity);
+static void coil_section_release_data(coil_section_t *sect);
+static coil_err_t coil_section_reserve_chunks(coil_section_t *sect, coil_size_t min_capacity);
 
 /**
 * @brief Initialize coil section (COIL_SECT_MODE_CREATE)
@@ -46,6 +71,202 @@ coil_err_t coil_section_init(coil_section_t *sect, coil_size_t capacity) {
   return COIL_ERR_GOOD;
 }
 
+/**
+* @brief Initialize coil section with a pooled buffer (COIL_SECT_MODE_CREATE)
+*/
+coil_err_t coil_section_init_pooled(coil_section_t *sect, coil_size_t capacity) {
+  if (sect == NULL) {
+    return COIL_ERROR(COIL_ERR_INVAL, "Section pointer is NULL");
+  }
+  
+  // Use default capacity if none provided
+  if (capacity == 0) {
+    capacity = COIL_SECTION_DEFAULT_CAPACITY;
+  }
+  
+  // Initialize section
+  coil_memset(sect, 0, sizeof(coil_section_t));
+  sect->mode = COIL_SECT_MODE_CREATE;
+  
+  // Take a block from the pool, the class may be larger than requested
+  sect->data = (coil_byte_t *)coil_pool_alloc(capacity, &sect->capacity);
+  if (sect->data == NULL) {
+    return COIL_ERROR(COIL_ERR_NOMEM, "Failed to allocate memory for section data");
+  }
+  
+  sect->is_pooled = 1;
+  return COIL_ERR_GOOD;
+}
+
+/**
+* @brief Initialize a chunked coil section (COIL_SECT_MODE_CREATE)
+*/
+coil_err_t coil_section_init_chunked(coil_section_t *sect, coil_size_t chunk_size) {
+  if (sect == NULL) {
+    return COIL_ERROR(COIL_ERR_INVAL, "Section pointer is NULL");
+  }
+  
+  // Use default chunk size if none provided
+  if (chunk_size == 0) {
+    chunk_size = COIL_SECTION_DEFAULT_CHUNK_SIZE;
+  }
+  
+  // Initialize section
+  coil_memset(sect, 0, sizeof(coil_section_t));
+  sect->mode = COIL_SECT_MODE_CREATE;
+  sect->chunk_size = chunk_size;
+  
+  // Start with one chunk so the section is never without a buffer
+  return coil_section_reserve_chunks(sect, chunk_size);
+}
+
+/**
+* @brief Internal function to add chunks until a capacity is reached
+*
+* The chunk table grows in powers of two, chunks themselves are never moved.
+*/
+static coil_err_t coil_section_reserve_chunks(coil_section_t *sect, coil_size_t min_capacity) {
+  coil_size_t needed = (min_capacity + sect->chunk_size - 1) / sect->chunk_size;
+  if (needed <= sect->chunk_count && sect->chunks != NULL) {
+    return COIL_ERR_GOOD;
+  }
+  
+  // The table holds a power of two number of slots
+  coil_size_t slots = 1;
+  while (slots < sect->chunk_count) {
+    slots <<= 1;
+  }
+  
+  if (sect->chunks == NULL || needed > slots) {
+    while (slots < needed) {
+      slots <<= 1;
+    }
+    
+    coil_byte_t **table = (coil_byte_t **)coil_realloc(sect->chunks, slots * sizeof(coil_byte_t *));
+    if (table == NULL) {
+      return COIL_ERROR(COIL_ERR_NOMEM, "Failed to grow section chunk table");
+    }
+    sect->chunks = table;
+  }
+  
+  while (sect->chunk_count < needed) {
+    coil_byte_t *chunk = (coil_byte_t *)coil_malloc(sect->chunk_size);
+    if (chunk == NULL) {
+      return COIL_ERROR(COIL_ERR_NOMEM, "Failed to allocate section chunk");
+    }
+    sect->chunks[sect->chunk_count++] = chunk;
+    sect->capacity = sect->chunk_count * sect->chunk_size;
+  }
+  
+  return COIL_ERR_GOOD;
+}
+
+/**
+* @brief Internal function to copy a buffer into chunked data
+*/
+static void coil_section_chunks_copy_in(coil_section_t *sect, coil_size_t pos, 
+                                        const coil_byte_t *buf, coil_size_t size) {
+  while (size > 0) {
+    coil_size_t offset = pos % sect->chunk_size;
+    coil_size_t len = sect->chunk_size - offset;
+    if (len > size) {
+      len = size;
+    }
+    
+    coil_memcpy(sect->chunks[pos / sect->chunk_size] + offset, buf, len);
+    pos += len;
+    buf += len;
+    size -= len;
+  }
+}
+
+/**
+* @brief Internal function to copy chunked data into a buffer
+*/
+static void coil_section_chunks_copy_out(const coil_section_t *sect, coil_size_t pos, 
+                                         coil_byte_t *buf, coil_size_t size) {
+  while (size > 0) {
+    coil_size_t offset = pos % sect->chunk_size;
+    coil_size_t len = sect->chunk_size - offset;
+    if (len > size) {
+      len = size;
+    }
+    
+    coil_memcpy(buf, sect->chunks[pos / sect->chunk_size] + offset, len);
+    pos += len;
+    buf += len;
+    size -= len;
+  }
+}
+
+/**
+* @brief Get the number of chunks holding section data
+*/
+coil_size_t coil_section_chunk_count(const coil_section_t *sect) {
+  if (sect == NULL || !coil_section_has_data(sect) || sect->size == 0) {
+    return 0;
+  }
+  
+  if (!coil_section_is_chunked(sect)) {
+    return 1;
+  }
+  
+  return (sect->size + sect->chunk_size - 1) / sect->chunk_size;
+}
+
+/**
+* @brief Get one chunk of section data
+*/
+coil_err_t coil_section_get_chunk(const coil_section_t *sect, coil_size_t index, 
+                                  const coil_byte_t **data, coil_size_t *size) {
+  if (sect == NULL || data == NULL || size == NULL) {
+    return COIL_ERROR(COIL_ERR_INVAL, "Invalid parameters");
+  }
+  
+  if (index >= coil_section_chunk_count(sect)) {
+    return COIL_ERROR(COIL_ERR_NOTFOUND, "Chunk index out of range");
+  }
+  
+  if (!coil_section_is_chunked(sect)) {
+    *data = sect->data;
+    *size = sect->size;
+    return COIL_ERR_GOOD;
+  }
+  
+  coil_size_t start = index * sect->chunk_size;
+  coil_size_t remaining = sect->size - start;
+  
+  *data = sect->chunks[index];
+  *size = (remaining < sect->chunk_size) ? remaining : sect->chunk_size;
+  return COIL_ERR_GOOD;
+}
+
+/**
+* @brief Convert a chunked section into a contiguous one
+*/
+coil_err_t coil_section_flatten(coil_section_t *sect) {
+  if (sect == NULL) {
+    return COIL_ERROR(COIL_ERR_INVAL, "Section pointer is NULL");
+  }
+  
+  if (!coil_section_is_chunked(sect)) {
+    return COIL_ERR_GOOD;
+  }
+  
+  coil_size_t capacity = (sect->size > 0) ? sect->size : 1;
+  coil_byte_t *data = (coil_byte_t *)coil_malloc(capacity);
+  if (data == NULL) {
+    return COIL_ERROR(COIL_ERR_NOMEM, "Failed to allocate memory for flattened section");
+  }
+  
+  coil_section_chunks_copy_out(sect, 0, data, sect->size);
+  coil_section_release_data(sect);
+  
+  sect->data = data;
+  sect->capacity = capacity;
+  return COIL_ERR_GOOD;
+}
+
 /**
 * @brief Clean up section resources
 */
@@ -54,6 +275,24 @@ void coil_section_cleanup(coil_section_t *sect) {
     return;
   }
   
+  coil_section_release_data(sect);
+}
+
+/**
+* @brief Internal function to release the data buffer of a section
+*/
+static void coil_section_release_data(coil_section_t *sect) {
+  // Chunked sections own every chunk and the table
+  if (sect->chunks != NULL) {
+    for (coil_size_t i = 0; i < sect->chunk_count; i++) {
+      coil_free(sect->chunks[i]);
+    }
+    coil_free(sect->chunks);
+    sect->chunks = NULL;
+    sect->chunk_count = 0;
+    sect->chunk_size = 0;
+  }
+  
   if (sect->data != NULL) {
     // Handling depends on section mode and mapping status
     if (sect->is_mapped && sect->map_base != NULL) {
@@ -61,7 +300,10 @@ void coil_section_cleanup(coil_section_t *sect) {
       munmap(sect->map_base, sect->map_size);
       sect->map_base = NULL;
       sect->map_size = 0;
-    } else if (sect->mode != COIL_SECT_MODE_VIEW) {
+    } else if (sect->is_pooled) {
+      // Pooled buffers go back to the pool for the next section
+      coil_pool_free(sect->data, sect->capacity);
+    } else if (coil_section_owns_data(sect)) {
       // For CREATE or MODIFY modes, we own the memory and need to free it
       coil_free(sect->data);
     }
@@ -70,8 +312,9 @@ void coil_section_cleanup(coil_section_t *sect) {
     sect->data = NULL;
   }
   
-  // Reset is_mapped flag
+  // Reset ownership flags
   sect->is_mapped = 0;
+  sect->is_pooled = 0;
 }
 
 /**
@@ -92,8 +335,17 @@ coil_err_t coil_section_ensure_capacity(coil_section_t *sect, coil_size_t min_ca
     return COIL_ERR_GOOD;
   }
   
-  // Calculate new capacity (double current, but at least min_capacity)
-  coil_size_t new_capacity = sect->capacity * 2;
+  // Chunked sections only ever add chunks
+  if (coil_section_is_chunked(sect)) {
+    return coil_section_reserve_chunks(sect, min_capacity);
+  }
+  
+  // Calculate new capacity (grow by the policy factor and step cap, but at least min_capacity)
+  coil_size_t new_capacity = sect->capacity / 100 * coil_section_growth.factor_percent +
+                             sect->capacity % 100 * coil_section_growth.factor_percent / 100;
+  if (coil_section_growth.max_step > 0 && new_capacity - sect->capacity > coil_section_growth.max_step) {
+    new_capacity = sect->capacity + coil_section_growth.max_step;
+  }
   if (new_capacity < min_capacity) {
     new_capacity = min_capacity;
   }
@@ -101,12 +353,112 @@ coil_err_t coil_section_ensure_capacity(coil_section_t *sect, coil_size_t min_ca
   return coil_section_resize(sect, new_capacity);
 }
 
+/**
+* @brief Set the process-wide section growth policy
+*/
+coil_err_t coil_section_set_growth(const coil_section_growth_t *policy) {
+  if (policy == NULL) {
+    coil_section_growth_t defaults = COIL_SECTION_DEFAULT_GROWTH;
+    coil_section_growth = defaults;
+    return COIL_ERR_GOOD;
+  }
+  
+  if (policy->factor_percent <= 100) {
+    return COIL_ERROR(COIL_ERR_INVAL, "Growth factor must be above 100 percent");
+  }
+  
+  coil_section_growth = *policy;
+  return COIL_ERR_GOOD;
+}
+
+/**
+* @brief Get the process-wide section growth policy
+*/
+coil_err_t coil_section_get_growth(coil_section_growth_t *policy) {
+  if (policy == NULL) {
+    return COIL_ERROR(COIL_ERR_INVAL, "Policy pointer is NULL");
+  }
+  
+  *policy = coil_section_growth;
+  return COIL_ERR_GOOD;
+}
+
+/**
+* @brief Internal function to move section data into an anonymous mapping
+*
+* Owned anonymous mappings are grown or shrunk with mremap, which moves page
+* table entries instead of copying. Anything else is copied into a fresh mapping.
+*/
+static coil_err_t coil_section_resize_mapped(coil_section_t *sect, coil_size_t new_capacity) {
+  coil_size_t map_size = coil_align_up(new_capacity, coil_get_page_size());
+  if (coil_section_growth.page_round) {
+    new_capacity = map_size;
+  }
+  
+  void *new_base;
+  if (sect->is_mapped && sect->map_base == sect->data && coil_section_owns_data(sect)) {
+    new_base = mremap(sect->map_base, sect->map_size, map_size, MREMAP_MAYMOVE);
+    if (new_base == MAP_FAILED) {
+      return COIL_ERROR(COIL_ERR_NOMEM, "Failed to remap section data");
+    }
+  } else {
+    new_base = mmap(NULL, map_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (new_base == MAP_FAILED) {
+      return COIL_ERROR(COIL_ERR_NOMEM, "Failed to map memory for section resize");
+    }
+    
+    // Copy existing data
+    if (sect->data != NULL && sect->size > 0) {
+      coil_memcpy(new_base, sect->data, sect->size);
+    }
+    
+    // Free (or unmap) old buffer if we own it
+    coil_section_release_data(sect);
+  }
+  
+  sect->data = (coil_byte_t *)new_base;
+  sect->capacity = new_capacity;
+  sect->is_mapped = 1;
+  sect->map_base = new_base;
+  sect->map_size = map_size;
+  sect->mode = COIL_SECT_MODE_MODIFY; // Now we own the data
+  
+  return COIL_ERR_GOOD;
+}
+
 /**
 * @brief Internal function to resize a section
 */
 static coil_err_t coil_section_resize(coil_section_t *sect, coil_size_t new_capacity) {
+  // Pooled sections keep growing out of the pool
+  int pooled = sect->is_pooled;
+  
+  // An empty compacted section keeps a minimal buffer
+  if (new_capacity == 0) {
+    new_capacity = 1;
+  }
+  
+  // Large buffers live in anonymous mappings so they can be remapped in place
+  if (!pooled && coil_section_growth.mmap_threshold > 0 && new_capacity >= coil_section_growth.mmap_threshold) {
+    return coil_section_resize_mapped(sect, new_capacity);
+  }
+  
+  // Owned heap buffers can be extended by the allocator without a copy
+  if (!pooled && !sect->is_mapped && sect->data != NULL && coil_section_owns_data(sect)) {
+    coil_byte_t *new_data = (coil_byte_t *)coil_realloc(sect->data, new_capacity);
+    if (new_data == NULL) {
+      return COIL_ERROR(COIL_ERR_NOMEM, "Failed to reallocate memory for section resize");
+    }
+    
+    sect->data = new_data;
+    sect->capacity = new_capacity;
+    sect->mode = COIL_SECT_MODE_MODIFY; // Now we own the data
+    return COIL_ERR_GOOD;
+  }
+  
   // Allocate new buffer
-  coil_byte_t *new_data = (coil_byte_t *)coil_malloc(new_capacity);
+  coil_byte_t *new_data = pooled ? (coil_byte_t *)coil_pool_alloc(new_capacity, &new_capacity)
+                                 : (coil_byte_t *)coil_malloc(new_capacity);
   if (new_data == NULL) {
     return COIL_ERROR(COIL_ERR_NOMEM, "Failed to allocate memory for section resize");
   }
@@ -116,14 +468,13 @@ static coil_err_t coil_section_resize(coil_section_t *sect, coil_size_t new_capa
     coil_memcpy(new_data, sect->data, sect->size);
   }
   
-  // Free old buffer if we own it
-  if (sect->mode != COIL_SECT_MODE_VIEW && sect->data != NULL) {
-    coil_free(sect->data);
-  }
+  // Free (or unmap) old buffer if we own it
+  coil_section_release_data(sect);
   
   // Update section
   sect->data = new_data;
   sect->capacity = new_capacity;
+  sect->is_pooled = pooled;
   sect->mode = COIL_SECT_MODE_MODIFY; // Now we own the data
   
   return COIL_ERR_GOOD;
@@ -150,7 +501,11 @@ coil_err_t coil_section_write(coil_section_t *sect, coil_byte_t *buf,
   }
   
   // Write data
-  coil_memcpy(sect->data + sect->windex, buf, bufsize);
+  if (coil_section_is_chunked(sect)) {
+    coil_section_chunks_copy_in(sect, sect->windex, buf, bufsize);
+  } else {
+    coil_memcpy(sect->data + sect->windex, buf, bufsize);
+  }
   sect->windex += bufsize;
   
   // Update size if write position exceeds current size
@@ -180,7 +535,11 @@ coil_err_t coil_section_read(coil_section_t *sect, coil_byte_t *buf,
   
   // Read data
   if (to_read > 0) {
-    coil_memcpy(buf, sect->data + sect->rindex, to_read);
+    if (coil_section_is_chunked(sect)) {
+      coil_section_chunks_copy_out(sect, sect->rindex, buf, to_read);
+    } else {
+      coil_memcpy(buf, sect->data + sect->rindex, to_read);
+    }
     sect->rindex += to_read;
   }
   
@@ -216,6 +575,11 @@ coil_err_t coil_section_getstr(coil_section_t *sect, coil_u64_t offset, const ch
     return COIL_ERROR(COIL_ERR_INVAL, "Offset out of bounds");
   }
   
+  // Strings may straddle chunks, the section has to be flattened first
+  if (coil_section_is_chunked(sect)) {
+    return COIL_ERROR(COIL_ERR_BADSTATE, "Cannot get a string pointer into a chunked section");
+  }
+  
   // Set the string pointer
   *str = (const char *)(sect->data + offset);
   
@@ -230,9 +594,23 @@ coil_err_t coil_section_compact(coil_section_t *sect) {
     return COIL_ERROR(COIL_ERR_INVAL, "Section pointer is NULL");
   }
   
-  // If we're in VIEW mode or have no data, we can't/shouldn't compact
-  if (sect->mode == COIL_SECT_MODE_VIEW || sect->data == NULL) {
-    return COIL_ERROR(COIL_ERR_BADSTATE, "Cannot compact section in VIEW mode");
+  // Chunked sections drop the chunks past the end of the data
+  if (coil_section_is_chunked(sect)) {
+    coil_size_t used = (sect->size + sect->chunk_size - 1) / sect->chunk_size;
+    if (used == 0) {
+      used = 1;
+    }
+    
+    while (sect->chunk_count > used) {
+      coil_free(sect->chunks[--sect->chunk_count]);
+    }
+    sect->capacity = sect->chunk_count * sect->chunk_size;
+    return COIL_ERR_GOOD;
+  }
+  
+  // If we don't own the buffer or have no data, we can't/shouldn't compact
+  if (!coil_section_owns_data(sect) || sect->data == NULL) {
+    return COIL_ERROR(COIL_ERR_BADSTATE, "Cannot compact section in VIEW or COW mode");
   }
   
   // If size matches capacity, nothing to do
@@ -290,6 +668,54 @@ coil_err_t coil_section_seek_write(coil_section_t *sect, coil_size_t pos) {
   return COIL_ERR_GOOD;
 }
 
+/**
+* @brief Make a VIEW section writable without copying it
+*/
+coil_err_t coil_section_promote(coil_section_t *sect) {
+  if (sect == NULL) {
+    return COIL_ERROR(COIL_ERR_INVAL, "Section pointer is NULL");
+  }
+  
+  // Already writable
+  if (sect->mode != COIL_SECT_MODE_VIEW) {
+    return COIL_ERR_GOOD;
+  }
+  
+  // Borrowed views may point at memory we cannot write, take a private copy
+  if (!sect->is_mapped || sect->map_base == NULL) {
+    return coil_section_resize(sect, sect->capacity > 0 ? sect->capacity : COIL_SECTION_DEFAULT_CAPACITY);
+  }
+  
+  // Our own MAP_PRIVATE mapping: writes fault in private copies page by page
+  if (mprotect(sect->map_base, sect->map_size, PROT_READ | PROT_WRITE) != 0) {
+    return COIL_ERROR(COIL_ERR_IO, "Failed to make section mapping writable");
+  }
+  
+  sect->mode = COIL_SECT_MODE_COW;
+  return COIL_ERR_GOOD;
+}
+
+/**
+* @brief Give the kernel an access pattern hint for a memory mapped section
+*/
+coil_err_t coil_section_advise(coil_section_t *sect, coil_advice_t advice) {
+  if (sect == NULL) {
+    return COIL_ERROR(COIL_ERR_INVAL, "Section pointer is NULL");
+  }
+  
+  if (!sect->is_mapped || sect->map_base == NULL) {
+    return COIL_ERROR(COIL_ERR_BADSTATE, "Section is not memory mapped");
+  }
+  
+  // Written pages of a COW mapping exist nowhere else, dropping them would revert to the file
+  if (advice == COIL_ADVICE_DONTNEED && sect->mode == COIL_SECT_MODE_COW) {
+    return COIL_ERROR(COIL_ERR_BADSTATE, "Cannot drop the pages of a copy-on-write section");
+  }
+  
+  // Only advise the pages that actually back the section data
+  return coil_madvise(sect->data, sect->size, advice);
+}
+
 /**
 * @brief Load coil section from descriptor (copied)
 */
@@ -397,19 +823,105 @@ coil_err_t coil_section_serialize(coil_section_t *sect, coil_descriptor_t fd) {
   }
   
   // Handle empty sections gracefully
-  if (sect->data == NULL || sect->size == 0) {
+  if (!coil_section_has_data(sect) || sect->size == 0) {
     return COIL_ERR_GOOD;  // Nothing to write
   }
   
-  coil_size_t byteswritten;
-  coil_err_t err = coil_write(fd, sect->data, sect->size, &byteswritten);
+  // Chunks go out in batches of writev calls, nothing is flattened
+  if (coil_section_is_chunked(sect)) {
+    struct iovec iov[COIL_SECTION_IOV_BATCH];
+    coil_size_t pos = 0;
+    
+    while (pos < sect->size) {
+      int count = 0;
+      coil_size_t batch_pos = pos;
+      
+      while (count < COIL_SECTION_IOV_BATCH && batch_pos < sect->size) {
+        coil_size_t offset = batch_pos % sect->chunk_size;
+        coil_size_t len = sect->chunk_size - offset;
+        if (len > sect->size - batch_pos) {
+          len = sect->size - batch_pos;
+        }
+        
+        iov[count].iov_base = sect->chunks[batch_pos / sect->chunk_size] + offset;
+        iov[count].iov_len = len;
+        batch_pos += len;
+        count++;
+      }
+      
+      // Short writes resume from wherever the kernel stopped
+      ssize_t written = writev(fd, iov, count);
+      if (written <= 0) {
+        return COIL_ERROR(COIL_ERR_IO, "Failed to write all section data");
+      }
+      pos += (coil_size_t)written;
+    }
+    
+    return COIL_ERR_GOOD;
+  }
   
-  if (err != COIL_ERR_GOOD) {
-    return err;
+  // Retry short writes until the whole buffer is out
+  coil_size_t pos = 0;
+  while (pos < sect->size) {
+    coil_size_t byteswritten;
+    coil_err_t err = coil_write(fd, sect->data + pos, sect->size - pos, &byteswritten);
+    
+    if (err != COIL_ERR_GOOD) {
+      return err;
+    }
+    
+    if (byteswritten == 0) {
+      return COIL_ERROR(COIL_ERR_IO, "Failed to write all section data");
+    }
+    pos += byteswritten;
+  }
+  
+  return COIL_ERR_GOOD;
+}
+
+/**
+* @brief Serialize a section at an offset of an object file
+*/
+coil_err_t coil_section_serialize_at(coil_section_t *sect, coil_descriptor_t fd, coil_u64_t offset) {
+  if (sect == NULL) {
+    return COIL_ERROR(COIL_ERR_INVAL, "Section pointer is NULL");
+  }
+  
+  // Handle empty sections gracefully
+  if (!coil_section_has_data(sect) || sect->size == 0) {
+    return COIL_ERR_GOOD;  // Nothing to write
   }
   
-  if (byteswritten != sect->size) {
-    return COIL_ERROR(COIL_ERR_IO, "Failed to write all section data");
+  if (!coil_section_is_chunked(sect)) {
+    return coil_write_at(fd, offset, sect->data, sect->size);
+  }
+  
+  // Same batching as coil_section_serialize, with pwritev
+  struct iovec iov[COIL_SECTION_IOV_BATCH];
+  coil_size_t pos = 0;
+  
+  while (pos < sect->size) {
+    int count = 0;
+    coil_size_t batch_pos = pos;
+    
+    while (count < COIL_SECTION_IOV_BATCH && batch_pos < sect->size) {
+      coil_size_t chunk_offset = batch_pos % sect->chunk_size;
+      coil_size_t len = sect->chunk_size - chunk_offset;
+      if (len > sect->size - batch_pos) {
+        len = sect->size - batch_pos;
+      }
+      
+      iov[count].iov_base = sect->chunks[batch_pos / sect->chunk_size] + chunk_offset;
+      iov[count].iov_len = len;
+      batch_pos += len;
+      count++;
+    }
+    
+    ssize_t written = pwritev(fd, iov, count, (off_t)(offset + pos));
+    if (written <= 0) {
+      return COIL_ERROR(COIL_ERR_IO, "Failed to write all section data");
+    }
+    pos += (coil_size_t)written;
   }
   
   return COIL_ERR_GOOD;
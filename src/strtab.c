@@ -0,0 +1,430 @@
+/**
+* @file strtab.c
+* @brief COIL string table functionality implementation for libcoil-dev
+*/
+
+#include <coil/base.h>
+#include <coil/strtab.h>
+#include "srcdeps.h"
+
+/**
+* @brief Initial number of strings when none is specified
+*/
+#define COIL_STRTAB_DEFAULT_CAPACITY 64
+
+/**
+* @brief String being placed during finalize
+*/
+typedef struct coil_strtab_sort {
+  const char *str;             ///< Interned bytes
+  coil_u32_t length;           ///< Length of the string
+  coil_u32_t id;               ///< String id
+} coil_strtab_sort_t;
+
+/**
+* @brief Hash a string of a given length
+*/
+coil_u64_t coil_strtab_hash(const char *str, coil_size_t length) {
+  // FNV-1a, matching coil_obj_hash_name
+  coil_u64_t hash = 0xcbf29ce484222325ULL;
+  const unsigned char *bytes = (const unsigned char *)str;
+  
+  for (coil_size_t i = 0; i < length; i++) {
+    hash ^= (coil_u64_t)bytes[i];
+    hash *= 0x100000001b3ULL;
+  }
+  
+  return hash;
+}
+
+/**
+* @brief Rebuild the slot table with a new size
+*/
+static coil_err_t coil_strtab_rehash(coil_strtab_t *tab, coil_u32_t slot_count) {
+  coil_u32_t *slots = (coil_u32_t *)coil_calloc(slot_count, sizeof(coil_u32_t));
+  if (slots == NULL) {
+    return COIL_ERROR(COIL_ERR_NOMEM, "Failed to grow string table index");
+  }
+  
+  for (coil_u32_t id = 0; id < tab->count; id++) {
+    coil_u32_t slot = (coil_u32_t)tab->entries[id].hash & (slot_count - 1);
+    while (slots[slot] != 0) {
+      slot = (slot + 1) & (slot_count - 1);
+    }
+    slots[slot] = id + 1;
+  }
+  
+  coil_free(tab->slots);
+  tab->slots = slots;
+  tab->slot_count = slot_count;
+  return COIL_ERR_GOOD;
+}
+
+/**
+* @brief Find the slot holding a string, or the empty slot it would go in
+*/
+static coil_u32_t coil_strtab_probe(const coil_strtab_t *tab, const char *str, coil_size_t length, coil_u64_t hash) {
+  coil_u32_t mask = tab->slot_count - 1;
+  coil_u32_t slot = (coil_u32_t)hash & mask;
+  
+  while (tab->slots[slot] != 0) {
+    const coil_strtab_entry_t *entry = &tab->entries[tab->slots[slot] - 1];
+    if (entry->hash == hash && entry->length == length &&
+        (length == 0 || coil_memcmp(tab->arena + entry->arena, str, length) == 0)) {
+      break;
+    }
+    slot = (slot + 1) & mask;
+  }
+  
+  return slot;
+}
+
+/**
+* @brief Drop the finalized contents (the string set changed)
+*/
+static void coil_strtab_invalidate(coil_strtab_t *tab) {
+  if (tab->data != NULL) {
+    coil_free(tab->data);
+    tab->data = NULL;
+    tab->size = 0;
+  }
+}
+
+/**
+* @brief Initialize a string table builder
+*/
+coil_err_t coil_strtab_init(coil_strtab_t *tab, coil_u32_t capacity) {
+  if (tab == NULL) {
+    return COIL_ERROR(COIL_ERR_INVAL, "String table pointer is NULL");
+  }
+  
+  coil_memset(tab, 0, sizeof(coil_strtab_t));
+  tab->capacity = capacity > 0 ? capacity : COIL_STRTAB_DEFAULT_CAPACITY;
+  tab->entries = (coil_strtab_entry_t *)coil_malloc(tab->capacity * sizeof(coil_strtab_entry_t));
+  if (tab->entries == NULL) {
+    return COIL_ERROR(COIL_ERR_NOMEM, "Failed to allocate string table");
+  }
+  
+  // Keep the index at most half full
+  coil_u32_t slot_count = 1;
+  while (slot_count < tab->capacity * 2) {
+    slot_count <<= 1;
+  }
+  
+  coil_err_t err = coil_strtab_rehash(tab, slot_count);
+  if (err != COIL_ERR_GOOD) {
+    coil_strtab_cleanup(tab);
+  }
+  return err;
+}
+
+/**
+* @brief Release a string table builder
+*/
+void coil_strtab_cleanup(coil_strtab_t *tab) {
+  if (tab == NULL) {
+    return;
+  }
+  
+  coil_free(tab->arena);
+  coil_free(tab->entries);
+  coil_free(tab->slots);
+  coil_free(tab->data);
+  coil_memset(tab, 0, sizeof(coil_strtab_t));
+}
+
+/**
+* @brief Intern a string
+*/
+coil_err_t coil_strtab_add(coil_strtab_t *tab, const char *str, coil_size_t length, coil_u32_t *id) {
+  if (tab == NULL || tab->slots == NULL || (str == NULL && length > 0)) {
+    return COIL_ERROR(COIL_ERR_INVAL, "Invalid parameters");
+  }
+  
+  if (length > 0 && memchr(str, 0, length) != NULL) {
+    return COIL_ERROR(COIL_ERR_INVAL, "String contains a null byte");
+  }
+  
+  coil_u64_t hash = coil_strtab_hash(str, length);
+  coil_u32_t slot = coil_strtab_probe(tab, str, length, hash);
+  if (tab->slots[slot] != 0) {
+    if (id != NULL) {
+      *id = tab->slots[slot] - 1;
+    }
+    return COIL_ERR_GOOD;
+  }
+  
+  // Offsets and lengths are stored in 32 bits
+  if (tab->arena_size + length + 1 > 0xFFFFFFFFULL || tab->count == 0xFFFFFFFFU) {
+    return COIL_ERROR(COIL_ERR_INVAL, "String table too large");
+  }
+  
+  if (tab->arena_size + length + 1 > tab->arena_capacity) {
+    coil_size_t capacity = tab->arena_capacity > 0 ? tab->arena_capacity : 1024;
+    while (capacity < tab->arena_size + length + 1) {
+      capacity *= 2;
+    }
+    
+    coil_byte_t *arena = (coil_byte_t *)coil_realloc(tab->arena, capacity);
+    if (arena == NULL) {
+      return COIL_ERROR(COIL_ERR_NOMEM, "Failed to grow string table");
+    }
+    tab->arena = arena;
+    tab->arena_capacity = capacity;
+  }
+  
+  if (tab->count == tab->capacity) {
+    coil_strtab_entry_t *entries = (coil_strtab_entry_t *)coil_realloc(
+        tab->entries, tab->capacity * 2 * sizeof(coil_strtab_entry_t));
+    if (entries == NULL) {
+      return COIL_ERROR(COIL_ERR_NOMEM, "Failed to grow string table");
+    }
+    tab->entries = entries;
+    tab->capacity *= 2;
+  }
+  
+  // The index grows before the string goes in, nothing can fail once the table changes
+  if ((tab->count + 1) * 2 > tab->slot_count) {
+    coil_err_t err = coil_strtab_rehash(tab, tab->slot_count * 2);
+    if (err != COIL_ERR_GOOD) {
+      return err;
+    }
+    slot = coil_strtab_probe(tab, str, length, hash);
+  }
+  
+  coil_strtab_entry_t *entry = &tab->entries[tab->count];
+  entry->hash = hash;
+  entry->arena = (coil_u32_t)tab->arena_size;
+  entry->length = (coil_u32_t)length;
+  entry->offset = 0;
+  entry->reserved = 0;
+  
+  if (length > 0) {
+    coil_memcpy(tab->arena + tab->arena_size, str, length);
+  }
+  tab->arena[tab->arena_size + length] = 0;
+  tab->arena_size += length + 1;
+  
+  tab->slots[slot] = tab->count + 1;
+  tab->count++;
+  coil_strtab_invalidate(tab);
+  
+  if (id != NULL) {
+    *id = tab->count - 1;
+  }
+  return COIL_ERR_GOOD;
+}
+
+/**
+* @brief Intern a null-terminated string
+*/
+coil_err_t coil_strtab_add_cstr(coil_strtab_t *tab, const char *str, coil_u32_t *id) {
+  if (str == NULL) {
+    return COIL_ERROR(COIL_ERR_INVAL, "String is NULL");
+  }
+  
+  return coil_strtab_add(tab, str, strlen(str), id);
+}
+
+/**
+* @brief Find an interned string
+*/
+coil_err_t coil_strtab_find(const coil_strtab_t *tab, const char *str, coil_size_t length, coil_u32_t *id) {
+  if (tab == NULL || tab->slots == NULL || (str == NULL && length > 0) || id == NULL) {
+    return COIL_ERROR(COIL_ERR_INVAL, "Invalid parameters");
+  }
+  
+  coil_u32_t slot = coil_strtab_probe(tab, str, length, coil_strtab_hash(str, length));
+  if (tab->slots[slot] == 0) {
+    return COIL_ERROR(COIL_ERR_NOTFOUND, "String not found");
+  }
+  
+  *id = tab->slots[slot] - 1;
+  return COIL_ERR_GOOD;
+}
+
+/**
+* @brief Order strings by their reversed bytes, longer strings first on ties
+*
+* Every string then directly follows the strings it is a suffix of.
+*/
+static int coil_strtab_compare_suffix(const void *a, const void *b) {
+  const coil_strtab_sort_t *sa = (const coil_strtab_sort_t *)a;
+  const coil_strtab_sort_t *sb = (const coil_strtab_sort_t *)b;
+  const unsigned char *ea = (const unsigned char *)sa->str + sa->length;
+  const unsigned char *eb = (const unsigned char *)sb->str + sb->length;
+  coil_u32_t common = sa->length < sb->length ? sa->length : sb->length;
+  
+  for (coil_u32_t i = 1; i <= common; i++) {
+    if (ea[-(long)i] != eb[-(long)i]) {
+      return (int)eb[-(long)i] - (int)ea[-(long)i];
+    }
+  }
+  
+  return (sa->length > sb->length) ? -1 : (sa->length < sb->length);
+}
+
+/**
+* @brief Lay out the table, sharing suffixes between strings
+*/
+coil_err_t coil_strtab_finalize(coil_strtab_t *tab) {
+  if (tab == NULL || tab->entries == NULL) {
+    return COIL_ERROR(COIL_ERR_INVAL, "Invalid parameters");
+  }
+  
+  // Worst case is no sharing at all, plus the leading empty string
+  coil_byte_t *data = (coil_byte_t *)coil_malloc(tab->arena_size + 1);
+  coil_strtab_sort_t *order = (coil_strtab_sort_t *)coil_malloc((tab->count > 0 ? tab->count : 1) * sizeof(coil_strtab_sort_t));
+  if (data == NULL || order == NULL) {
+    coil_free(data);
+    coil_free(order);
+    return COIL_ERROR(COIL_ERR_NOMEM, "Failed to allocate string table");
+  }
+  
+  for (coil_u32_t id = 0; id < tab->count; id++) {
+    order[id].str = (const char *)tab->arena + tab->entries[id].arena;
+    order[id].length = tab->entries[id].length;
+    order[id].id = id;
+  }
+  qsort(order, tab->count, sizeof(coil_strtab_sort_t), coil_strtab_compare_suffix);
+  
+  data[0] = 0;
+  coil_size_t size = 1;
+  const coil_strtab_sort_t *prev = NULL;
+  coil_u32_t prev_offset = 0;
+  
+  for (coil_u32_t i = 0; i < tab->count; i++) {
+    const coil_strtab_sort_t *cur = &order[i];
+    coil_strtab_entry_t *entry = &tab->entries[cur->id];
+    
+    if (cur->length == 0) {
+      entry->offset = 0;
+      continue;
+    }
+    
+    // Tail merge into the previous placed string when this one is its suffix
+    if (prev != NULL && cur->length <= prev->length &&
+        coil_memcmp(prev->str + prev->length - cur->length, cur->str, cur->length) == 0) {
+      entry->offset = prev_offset + prev->length - cur->length;
+      continue;
+    }
+    
+    coil_memcpy(data + size, cur->str, cur->length + 1);
+    entry->offset = (coil_u32_t)size;
+    prev = cur;
+    prev_offset = (coil_u32_t)size;
+    size += cur->length + 1;
+  }
+  
+  coil_free(order);
+  
+  coil_strtab_invalidate(tab);
+  tab->data = data;
+  tab->size = size;
+  return COIL_ERR_GOOD;
+}
+
+/**
+* @brief Get the reference of an interned string in the finalized table
+*/
+coil_err_t coil_strtab_ref(const coil_strtab_t *tab, coil_u32_t id, coil_strref_t *ref) {
+  if (tab == NULL || ref == NULL || id >= tab->count) {
+    return COIL_ERROR(COIL_ERR_INVAL, "Invalid parameters");
+  }
+  
+  if (tab->data == NULL) {
+    return COIL_ERROR(COIL_ERR_BADSTATE, "String table has not been finalized");
+  }
+  
+  *ref = coil_strref_make(tab->entries[id].offset, tab->entries[id].length);
+  return COIL_ERR_GOOD;
+}
+
+/**
+* @brief Add the finalized table to an object as a COIL_SECTION_STRTAB section
+*/
+coil_err_t coil_strtab_emit(coil_object_t *obj, const coil_strtab_t *tab, const char *name, coil_u16_t *index) {
+  if (obj == NULL || tab == NULL || name == NULL) {
+    return COIL_ERROR(COIL_ERR_INVAL, "Invalid parameters");
+  }
+  
+  if (tab->data == NULL) {
+    return COIL_ERROR(COIL_ERR_BADSTATE, "String table has not been finalized");
+  }
+  
+  coil_section_t sect;
+  coil_err_t err = coil_section_init(&sect, tab->size);
+  if (err != COIL_ERR_GOOD) {
+    return err;
+  }
+  
+  err = coil_section_write(&sect, tab->data, tab->size, NULL);
+  if (err == COIL_ERR_GOOD) {
+    err = coil_obj_create_section(obj, COIL_SECTION_STRTAB, name, COIL_SECTION_FLAG_MERGE, &sect, index);
+  }
+  
+  coil_section_cleanup(&sect);
+  return err;
+}
+
+/**
+* @brief Resolve a reference against string table section data
+*/
+coil_err_t coil_strtab_get(const coil_section_t *sect, coil_strref_t ref, const char **str) {
+  if (sect == NULL || str == NULL) {
+    return COIL_ERROR(COIL_ERR_INVAL, "Invalid parameters");
+  }
+  
+  if (coil_section_is_chunked(sect)) {
+    return COIL_ERROR(COIL_ERR_BADSTATE, "Cannot get a string pointer into a chunked section");
+  }
+  
+  coil_u64_t offset = coil_strref_offset(ref);
+  coil_u64_t length = coil_strref_length(ref);
+  if (offset + length >= sect->size || sect->data[offset + length] != 0) {
+    return COIL_ERROR(COIL_ERR_FORMAT, "String reference out of bounds");
+  }
+  
+  *str = (const char *)(sect->data + offset);
+  return COIL_ERR_GOOD;
+}
+
+/**
+* @brief Resolve a plain offset against string table section data
+*/
+coil_err_t coil_strtab_ref_at(const coil_section_t *sect, coil_u32_t offset, coil_strref_t *ref) {
+  if (sect == NULL || ref == NULL) {
+    return COIL_ERROR(COIL_ERR_INVAL, "Invalid parameters");
+  }
+  
+  if (coil_section_is_chunked(sect)) {
+    return COIL_ERROR(COIL_ERR_BADSTATE, "Cannot scan a chunked section");
+  }
+  
+  if (offset >= sect->size) {
+    return COIL_ERROR(COIL_ERR_FORMAT, "String offset out of bounds");
+  }
+  
+  const coil_byte_t *end = (const coil_byte_t *)memchr(sect->data + offset, 0, sect->size - offset);
+  if (end == NULL) {
+    return COIL_ERROR(COIL_ERR_FORMAT, "String is not terminated");
+  }
+  
+  *ref = coil_strref_make(offset, (coil_u32_t)(end - (sect->data + offset)));
+  return COIL_ERR_GOOD;
+}
+
+/**
+* @brief Compare a referenced string with a buffer
+*/
+int coil_strtab_equals(const coil_section_t *sect, coil_strref_t ref, const char *str, coil_size_t length) {
+  if (sect == NULL || (str == NULL && length > 0) || coil_strref_length(ref) != length) {
+    return 0;
+  }
+  
+  const char *data;
+  if (coil_strtab_get(sect, ref, &data) != COIL_ERR_GOOD) {
+    return 0;
+  }
+  return length == 0 || coil_memcmp(data, str, length) == 0;
+}
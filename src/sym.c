@@ -0,0 +1,403 @@
+/**
+* @file sym.c
+* @brief COIL symbol table functionality implementation for libcoil-dev
+*/
+
+#include <coil/base.h>
+#include <coil/sym.h>
+#include "srcdeps.h"
+
+/**
+* @brief Initial number of symbols when none is specified
+*/
+#define COIL_SYMTAB_DEFAULT_CAPACITY 64
+
+/**
+* @brief Shift for the second bloom filter bit
+*/
+#define COIL_SYMHASH_BLOOM_SHIFT 6
+
+/**
+* @brief Fold a 64-bit name hash into the 32-bit hash used by the index
+*/
+static inline coil_u32_t coil_symhash_fold(coil_u64_t name_hash) {
+  return (coil_u32_t)(name_hash ^ (name_hash >> 32));
+}
+
+/**
+* @brief Round up to a power of two (at least 1)
+*/
+static coil_u32_t coil_symhash_pow2(coil_u32_t value) {
+  coil_u32_t result = 1;
+  while (result < value) {
+    result <<= 1;
+  }
+  return result;
+}
+
+/**
+* @brief Make room for more symbols
+*/
+static coil_err_t coil_symtab_reserve(coil_symtab_t *tab, coil_u32_t needed) {
+  if (needed <= tab->capacity) {
+    return COIL_ERR_GOOD;
+  }
+  
+  coil_u32_t capacity = tab->capacity > 0 ? tab->capacity : COIL_SYMTAB_DEFAULT_CAPACITY;
+  while (capacity < needed) {
+    capacity *= 2;
+  }
+  
+  coil_symbol_t *symbols = (coil_symbol_t *)coil_realloc(tab->symbols, capacity * sizeof(coil_symbol_t));
+  if (symbols == NULL) {
+    return COIL_ERROR(COIL_ERR_NOMEM, "Failed to grow symbol table");
+  }
+  
+  tab->symbols = symbols;
+  tab->capacity = capacity;
+  return COIL_ERR_GOOD;
+}
+
+/**
+* @brief Drop a built hash index (the symbol set changed)
+*/
+static void coil_symtab_invalidate(coil_symtab_t *tab) {
+  if (tab->hash != NULL) {
+    coil_free(tab->hash);
+    tab->hash = NULL;
+    tab->hash_size = 0;
+  }
+}
+
+/**
+* @brief Initialize a symbol table builder
+*/
+coil_err_t coil_symtab_init(coil_symtab_t *tab, coil_u32_t capacity) {
+  if (tab == NULL) {
+    return COIL_ERROR(COIL_ERR_INVAL, "Symbol table pointer is NULL");
+  }
+  
+  coil_memset(tab, 0, sizeof(coil_symtab_t));
+  return coil_symtab_reserve(tab, capacity > 0 ? capacity : COIL_SYMTAB_DEFAULT_CAPACITY);
+}
+
+/**
+* @brief Release a symbol table builder
+*/
+void coil_symtab_cleanup(coil_symtab_t *tab) {
+  if (tab == NULL) {
+    return;
+  }
+  
+  coil_free(tab->symbols);
+  coil_free(tab->hash);
+  coil_memset(tab, 0, sizeof(coil_symtab_t));
+}
+
+/**
+* @brief Add a symbol
+*/
+coil_err_t coil_symtab_add(coil_symtab_t *tab, const coil_symbol_t *sym, coil_u32_t *index) {
+  if (tab == NULL || sym == NULL) {
+    return COIL_ERROR(COIL_ERR_INVAL, "Invalid parameters");
+  }
+  
+  coil_err_t err = coil_symtab_add_bulk(tab, sym, 1);
+  if (err != COIL_ERR_GOOD) {
+    return err;
+  }
+  
+  if (index != NULL) {
+    *index = tab->count - 1;
+  }
+  return COIL_ERR_GOOD;
+}
+
+/**
+* @brief Add many symbols with a single reservation and copy
+*/
+coil_err_t coil_symtab_add_bulk(coil_symtab_t *tab, const coil_symbol_t *syms, coil_u32_t count) {
+  if (tab == NULL || (syms == NULL && count > 0)) {
+    return COIL_ERROR(COIL_ERR_INVAL, "Invalid parameters");
+  }
+  
+  if (count > COIL_SYMBOL_INDEX_NONE - tab->count) {
+    return COIL_ERROR(COIL_ERR_INVAL, "Too many symbols");
+  }
+  
+  coil_err_t err = coil_symtab_reserve(tab, tab->count + count);
+  if (err != COIL_ERR_GOOD) {
+    return err;
+  }
+  
+  coil_memcpy(tab->symbols + tab->count, syms, count * sizeof(coil_symbol_t));
+  tab->count += count;
+  coil_symtab_invalidate(tab);
+  
+  return COIL_ERR_GOOD;
+}
+
+/**
+* @brief Order the symbols by hash bucket and build the hash index
+*/
+coil_err_t coil_symtab_finalize(coil_symtab_t *tab, coil_u32_t *index_map) {
+  if (tab == NULL) {
+    return COIL_ERROR(COIL_ERR_INVAL, "Symbol table pointer is NULL");
+  }
+  
+  coil_u32_t count = tab->count;
+  coil_u32_t bucket_count = count / 2 + 1;
+  coil_u32_t bloom_size = coil_symhash_pow2(count / 4); // ~16 filter bits per symbol
+  
+  coil_size_t hash_size = sizeof(coil_symhash_header_t) + bloom_size * sizeof(coil_u64_t) +
+                          ((coil_size_t)bucket_count + count) * sizeof(coil_u32_t);
+  coil_byte_t *hash = (coil_byte_t *)coil_calloc(1, hash_size);
+  coil_u32_t *starts = (coil_u32_t *)coil_calloc(bucket_count + 1, sizeof(coil_u32_t));
+  coil_symbol_t *ordered = (coil_symbol_t *)coil_malloc((count > 0 ? count : 1) * sizeof(coil_symbol_t));
+  if (hash == NULL || starts == NULL || ordered == NULL) {
+    coil_free(hash);
+    coil_free(starts);
+    coil_free(ordered);
+    return COIL_ERROR(COIL_ERR_NOMEM, "Failed to allocate symbol hash index");
+  }
+  
+  coil_symhash_header_t *header = (coil_symhash_header_t *)hash;
+  coil_u64_t *bloom = (coil_u64_t *)(header + 1);
+  coil_u32_t *buckets = (coil_u32_t *)(bloom + bloom_size);
+  coil_u32_t *chain = buckets + bucket_count;
+  
+  header->bucket_count = bucket_count;
+  header->symbol_count = count;
+  header->bloom_size = bloom_size;
+  header->bloom_shift = COIL_SYMHASH_BLOOM_SHIFT;
+  
+  // Counting sort by bucket, stable so earlier symbols win lookups
+  for (coil_u32_t i = 0; i < count; i++) {
+    starts[coil_symhash_fold(tab->symbols[i].name_hash) % bucket_count + 1]++;
+  }
+  for (coil_u32_t b = 0; b < bucket_count; b++) {
+    buckets[b] = starts[b + 1] > 0 ? starts[b] : COIL_SYMBOL_INDEX_NONE;
+    starts[b + 1] += starts[b];
+  }
+  
+  for (coil_u32_t i = 0; i < count; i++) {
+    coil_u32_t h = coil_symhash_fold(tab->symbols[i].name_hash);
+    coil_u32_t pos = starts[h % bucket_count]++;
+    
+    ordered[pos] = tab->symbols[i];
+    if (index_map != NULL) {
+      index_map[i] = pos;
+    }
+    
+    bloom[(h / 64) & (bloom_size - 1)] |= ((coil_u64_t)1 << (h % 64)) |
+                                          ((coil_u64_t)1 << ((h >> COIL_SYMHASH_BLOOM_SHIFT) % 64));
+  }
+  
+  // Chains hold the hash with the low bit marking the end of a bucket
+  for (coil_u32_t i = 0; i < count; i++) {
+    coil_u32_t h = coil_symhash_fold(ordered[i].name_hash);
+    int last = (i + 1 == count) ||
+               (coil_symhash_fold(ordered[i + 1].name_hash) % bucket_count != h % bucket_count);
+    chain[i] = (h & ~(coil_u32_t)1) | (last ? 1 : 0);
+  }
+  
+  if (count > 0) {
+    coil_memcpy(tab->symbols, ordered, count * sizeof(coil_symbol_t));
+  }
+  coil_free(ordered);
+  coil_free(starts);
+  
+  coil_symtab_invalidate(tab);
+  tab->hash = hash;
+  tab->hash_size = hash_size;
+  
+  return COIL_ERR_GOOD;
+}
+
+/**
+* @brief Create an object section holding a copy of a buffer
+*/
+static coil_err_t coil_symtab_emit_section(coil_object_t *obj, coil_u8_t type, const char *name,
+                                           const void *bytes, coil_size_t size, coil_u16_t *index) {
+  coil_section_t sect;
+  coil_err_t err = coil_section_init(&sect, size);
+  if (err != COIL_ERR_GOOD) {
+    return err;
+  }
+  
+  coil_size_t written;
+  err = coil_section_write(&sect, (coil_byte_t *)bytes, size, &written);
+  if (err == COIL_ERR_GOOD) {
+    err = coil_obj_create_section(obj, type, name, COIL_SECTION_FLAG_NONE, &sect, index);
+  }
+  
+  coil_section_cleanup(&sect);
+  return err;
+}
+
+/**
+* @brief Add the symbol table and its hash index to an object
+*/
+coil_err_t coil_symtab_emit(coil_object_t *obj, const coil_symtab_t *tab,
+                            const char *symtab_name, const char *hash_name,
+                            coil_u16_t *symtab_index, coil_u16_t *hash_index) {
+  if (obj == NULL || tab == NULL || symtab_name == NULL || hash_name == NULL) {
+    return COIL_ERROR(COIL_ERR_INVAL, "Invalid parameters");
+  }
+  
+  if (tab->hash == NULL) {
+    return COIL_ERROR(COIL_ERR_BADSTATE, "Symbol table has not been finalized");
+  }
+  
+  coil_u16_t sym_index;
+  coil_err_t err = coil_symtab_emit_section(obj, COIL_SECTION_SYMTAB, symtab_name, tab->symbols,
+                                            tab->count * sizeof(coil_symbol_t), &sym_index);
+  if (err != COIL_ERR_GOOD) {
+    return err;
+  }
+  
+  coil_u16_t index;
+  err = coil_symtab_emit_section(obj, COIL_SECTION_HASH, hash_name, tab->hash, tab->hash_size, &index);
+  if (err != COIL_ERR_GOOD) {
+    // Do not leave half a symbol table behind
+    coil_obj_delete_section(obj, sym_index);
+    return err;
+  }
+  
+  if (symtab_index != NULL) {
+    *symtab_index = sym_index;
+  }
+  if (hash_index != NULL) {
+    *hash_index = index;
+  }
+  return COIL_ERR_GOOD;
+}
+
+/**
+* @brief Check that a view is consistent with the data it points at
+*/
+static coil_err_t coil_symtab_view_hash(coil_symtab_view_t *view, const coil_byte_t *data, coil_size_t size) {
+  if (size < sizeof(coil_symhash_header_t) || ((uintptr_t)data & (sizeof(coil_u64_t) - 1)) != 0) {
+    return COIL_ERROR(COIL_ERR_FORMAT, "Symbol hash section is truncated or misaligned");
+  }
+  
+  const coil_symhash_header_t *header = (const coil_symhash_header_t *)data;
+  coil_size_t expected = sizeof(coil_symhash_header_t) + (coil_size_t)header->bloom_size * sizeof(coil_u64_t) +
+                         ((coil_size_t)header->bucket_count + header->symbol_count) * sizeof(coil_u32_t);
+  
+  if (header->bucket_count == 0 || header->bloom_size == 0 || header->bloom_shift >= 64 ||
+      (header->bloom_size & (header->bloom_size - 1)) != 0 ||
+      header->symbol_count != view->count || expected != size) {
+    return COIL_ERROR(COIL_ERR_FORMAT, "Symbol hash section does not match the symbol table");
+  }
+  
+  view->hash = header;
+  view->bloom = (const coil_u64_t *)(header + 1);
+  view->buckets = (const coil_u32_t *)(view->bloom + header->bloom_size);
+  view->chain = view->buckets + header->bucket_count;
+  return COIL_ERR_GOOD;
+}
+
+/**
+* @brief Build a view over symbol table and hash section data
+*/
+coil_err_t coil_symtab_view(coil_symtab_view_t *view, const coil_section_t *symtab, const coil_section_t *hash) {
+  if (view == NULL || symtab == NULL) {
+    return COIL_ERROR(COIL_ERR_INVAL, "Invalid parameters");
+  }
+  
+  if (coil_section_is_chunked(symtab) || (hash != NULL && coil_section_is_chunked(hash))) {
+    return COIL_ERROR(COIL_ERR_BADSTATE, "Symbol sections must be contiguous");
+  }
+  
+  if (symtab->size % sizeof(coil_symbol_t) != 0 ||
+      (symtab->size > 0 && ((uintptr_t)symtab->data & (sizeof(coil_u64_t) - 1)) != 0)) {
+    return COIL_ERROR(COIL_ERR_FORMAT, "Symbol table section is truncated or misaligned");
+  }
+  
+  coil_memset(view, 0, sizeof(coil_symtab_view_t));
+  view->symbols = (const coil_symbol_t *)symtab->data;
+  view->count = (coil_u32_t)(symtab->size / sizeof(coil_symbol_t));
+  
+  if (hash == NULL) {
+    return COIL_ERR_GOOD;
+  }
+  return coil_symtab_view_hash(view, hash->data, hash->size);
+}
+
+/**
+* @brief Build a view over a finalized builder
+*/
+coil_err_t coil_symtab_view_builder(coil_symtab_view_t *view, const coil_symtab_t *tab) {
+  if (view == NULL || tab == NULL) {
+    return COIL_ERROR(COIL_ERR_INVAL, "Invalid parameters");
+  }
+  
+  coil_memset(view, 0, sizeof(coil_symtab_view_t));
+  view->symbols = tab->symbols;
+  view->count = tab->count;
+  
+  if (tab->hash == NULL) {
+    return COIL_ERR_GOOD;
+  }
+  return coil_symtab_view_hash(view, tab->hash, tab->hash_size);
+}
+
+/**
+* @brief Find a symbol by name hash
+*/
+coil_err_t coil_symtab_lookup(const coil_symtab_view_t *view, coil_u64_t name_hash, coil_u32_t *index) {
+  if (view == NULL || index == NULL) {
+    return COIL_ERROR(COIL_ERR_INVAL, "Invalid parameters");
+  }
+  
+  // Without an index every symbol has to be checked
+  if (view->hash == NULL) {
+    for (coil_u32_t i = 0; i < view->count; i++) {
+      if (view->symbols[i].name_hash == name_hash) {
+        *index = i;
+        return COIL_ERR_GOOD;
+      }
+    }
+    return COIL_ERROR(COIL_ERR_NOTFOUND, "Symbol not found");
+  }
+  
+  const coil_symhash_header_t *header = view->hash;
+  coil_u32_t h = coil_symhash_fold(name_hash);
+  
+  // Most misses stop at the bloom filter
+  coil_u64_t word = view->bloom[(h / 64) & (header->bloom_size - 1)];
+  coil_u64_t mask = ((coil_u64_t)1 << (h % 64)) | ((coil_u64_t)1 << ((h >> header->bloom_shift) % 64));
+  if ((word & mask) != mask) {
+    return COIL_ERROR(COIL_ERR_NOTFOUND, "Symbol not found");
+  }
+  
+  coil_u32_t i = view->buckets[h % header->bucket_count];
+  if (i == COIL_SYMBOL_INDEX_NONE) {
+    return COIL_ERROR(COIL_ERR_NOTFOUND, "Symbol not found");
+  }
+  
+  for (; i < view->count; i++) {
+    coil_u32_t entry = view->chain[i];
+    if ((entry | 1) == (h | 1) && view->symbols[i].name_hash == name_hash) {
+      *index = i;
+      return COIL_ERR_GOOD;
+    }
+    if (entry & 1) {
+      break;
+    }
+  }
+  
+  return COIL_ERROR(COIL_ERR_NOTFOUND, "Symbol not found");
+}
+
+/**
+* @brief Find a symbol by name
+*/
+coil_err_t coil_symtab_lookup_name(const coil_symtab_view_t *view, const char *name, coil_u32_t *index) {
+  if (name == NULL) {
+    return COIL_ERROR(COIL_ERR_INVAL, "Symbol name is NULL");
+  }
+  
+  return coil_symtab_lookup(view, coil_obj_hash_name(name), index);
+}
@@ -0,0 +1,199 @@
+/**
+* @file target.c
+* @brief COIL target description and host detection implementation for libcoil-dev
+*/
+
+#include <coil/base.h>
+#include <coil/target.h>
+#include "srcdeps.h"
+#include <pthread.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <cpuid.h>
+#elif defined(__linux__) && (defined(__aarch64__) || defined(__arm__))
+#include <sys/auxv.h>
+#endif
+
+/**
+* @brief Cached host description
+*/
+static coil_target_t coil_host;
+
+/**
+* @brief Guards the one-time host detection
+*/
+static pthread_once_t coil_host_once = PTHREAD_ONCE_INIT;
+
+#if defined(__x86_64__) || defined(__i386__)
+
+/**
+* @brief Read an extended control register (the OS enabled state components)
+*/
+static coil_u64_t coil_xgetbv(coil_u32_t index) {
+  coil_u32_t eax, edx;
+  __asm__ volatile(".byte 0x0f, 0x01, 0xd0" : "=a"(eax), "=d"(edx) : "c"(index));
+  return ((coil_u64_t)edx << 32) | eax;
+}
+
+/**
+* @brief Detect x86 features with cpuid, masked by what the OS saves on context switch
+*/
+static coil_u64_t coil_detect_x86(void) {
+  coil_u32_t eax, ebx, ecx, edx;
+  coil_u64_t features = 0;
+  
+  if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx)) {
+    return 0;
+  }
+  
+  if (edx & (1u << 23)) features |= COIL_CPU_X86_MMX;
+  if (edx & (1u << 25)) features |= COIL_CPU_X86_SSE;
+  if (edx & (1u << 26)) features |= COIL_CPU_X86_SSE2;
+  if (ecx & (1u << 0))  features |= COIL_CPU_X86_SSE3;
+  if (ecx & (1u << 1))  features |= COIL_CPU_X86_PCLMUL;
+  if (ecx & (1u << 9))  features |= COIL_CPU_X86_SSSE3;
+  if (ecx & (1u << 19)) features |= COIL_CPU_X86_SSE4_1;
+  if (ecx & (1u << 20)) features |= COIL_CPU_X86_SSE4_2;
+  if (ecx & (1u << 25)) features |= COIL_CPU_X86_AES;
+  
+  // AVX needs the OS to save YMM state (XCR0 bits 1 and 2), AVX-512 also the opmask and ZMM state
+  coil_u64_t xcr0 = (ecx & (1u << 27)) ? coil_xgetbv(0) : 0;
+  int avx_os = (xcr0 & 0x06) == 0x06;
+  int avx512_os = (xcr0 & 0xE6) == 0xE6;
+  
+  if (avx_os && (ecx & (1u << 28))) {
+    features |= COIL_CPU_X86_AVX;
+    if (ecx & (1u << 12)) features |= COIL_CPU_X86_FMA;
+  }
+  
+  if (__get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx)) {
+    if (avx_os && (ebx & (1u << 5)))     features |= COIL_CPU_X86_AVX2;
+    if (avx512_os && (ebx & (1u << 16))) features |= COIL_CPU_X86_AVX512F;
+    if (ebx & (1u << 29))                features |= COIL_CPU_X86_SHA;
+  }
+  
+  return features;
+}
+
+#elif defined(__linux__) && defined(__aarch64__)
+
+/**
+* @brief Detect AArch64 features from the kernel's hwcaps
+*/
+static coil_u64_t coil_detect_arm(void) {
+  unsigned long hwcap = getauxval(AT_HWCAP);
+  unsigned long hwcap2 = getauxval(AT_HWCAP2);
+  coil_u64_t features = 0;
+  
+  if (hwcap & (1ul << 0))  features |= COIL_CPU_ARM_VFP;      // FP
+  if (hwcap & (1ul << 1))  features |= COIL_CPU_ARM_NEON;     // ASIMD
+  if (hwcap & (1ul << 3))  features |= COIL_CPU_ARM_CRYPTO;   // AES
+  if (hwcap & (1ul << 7))  features |= COIL_CPU_ARM_CRC;      // CRC32
+  if (hwcap & (1ul << 20)) features |= COIL_CPU_ARM_DOTPROD;  // ASIMDDP
+  if (hwcap & (1ul << 22)) features |= COIL_CPU_ARM_SVE;      // SVE
+  if (hwcap2 & (1ul << 1)) features |= COIL_CPU_ARM_SVE2;     // SVE2
+  if (hwcap2 & (1ul << 13)) features |= COIL_CPU_ARM_MATMUL;  // I8MM
+  
+  return features;
+}
+
+#elif defined(__linux__) && defined(__arm__)
+
+/**
+* @brief Detect 32-bit ARM features from the kernel's hwcaps
+*/
+static coil_u64_t coil_detect_arm(void) {
+  unsigned long hwcap = getauxval(AT_HWCAP);
+  unsigned long hwcap2 = getauxval(AT_HWCAP2);
+  coil_u64_t features = 0;
+  
+  if (hwcap & (1ul << 6))  features |= COIL_CPU_ARM_VFP;      // VFP
+  if (hwcap & (1ul << 12)) features |= COIL_CPU_ARM_NEON;     // NEON
+  if (hwcap2 & (1ul << 0)) features |= COIL_CPU_ARM_CRYPTO;   // AES
+  if (hwcap2 & (1ul << 4)) features |= COIL_CPU_ARM_CRC;      // CRC32
+  
+  return features;
+}
+
+#endif
+
+/**
+* @brief Fill in the cached host description
+*/
+static void coil_detect_host(void) {
+  coil_host.pu = COIL_PU_CPU;
+  
+#if defined(__x86_64__)
+  coil_host.arch = COIL_CPU_x86_64;
+  coil_host.features = coil_detect_x86();
+#elif defined(__i386__)
+  coil_host.arch = COIL_CPU_x86_32;
+  coil_host.features = coil_detect_x86();
+#elif defined(__aarch64__)
+  coil_host.arch = COIL_CPU_ARM64;
+#if defined(__linux__)
+  coil_host.features = coil_detect_arm();
+#endif
+#elif defined(__arm__)
+  coil_host.arch = COIL_CPU_ARM32;
+#if defined(__linux__)
+  coil_host.features = coil_detect_arm();
+#endif
+#elif defined(__riscv) && __riscv_xlen == 64
+  coil_host.arch = COIL_CPU_RISCV64;
+#elif defined(__riscv)
+  coil_host.arch = COIL_CPU_RISCV32;
+#else
+  coil_host.arch = COIL_CPU_NONE;
+#endif
+}
+
+/**
+* @brief Get the machine this process runs on
+*/
+const coil_target_t *coil_host_target(void) {
+  pthread_once(&coil_host_once, coil_detect_host);
+  return &coil_host;
+}
+
+/**
+* @brief Check whether code built for a target runs on a machine
+*/
+int coil_target_compatible(const coil_target_t *machine, coil_pu_t pu, coil_u8_t arch, coil_u64_t features) {
+  if (machine == NULL) {
+    return 0;
+  }
+  
+  return pu == machine->pu && arch == machine->arch && (features & ~machine->features) == 0;
+}
+
+/**
+* @brief Vector extensions of each architecture family, in increasing order of capability
+*/
+#define COIL_TARGET_X86_LADDER ((coil_u64_t)(COIL_CPU_X86_MMX | COIL_CPU_X86_SSE | COIL_CPU_X86_SSE2 | \
+                                            COIL_CPU_X86_SSE3 | COIL_CPU_X86_SSSE3 | COIL_CPU_X86_SSE4_1 | \
+                                            COIL_CPU_X86_SSE4_2 | COIL_CPU_X86_AVX | COIL_CPU_X86_AVX2 | \
+                                            COIL_CPU_X86_AVX512F))
+#define COIL_TARGET_ARM_LADDER ((coil_u64_t)(COIL_CPU_ARM_NEON | COIL_CPU_ARM_SVE | COIL_CPU_ARM_SVE2))
+
+/**
+* @brief Rank how capable code built with a feature set is
+*/
+coil_u32_t coil_target_rank(coil_u8_t arch, coil_u64_t features) {
+  if (features == 0) {
+    return 0;
+  }
+  
+  // Other architectures have no known ladder, every flag counts as a step
+  coil_u64_t ladder = ~(coil_u64_t)0;
+  if (arch == COIL_CPU_x86 || arch == COIL_CPU_x86_32 || arch == COIL_CPU_x86_64) {
+    ladder = COIL_TARGET_X86_LADDER;
+  } else if (arch == COIL_CPU_ARMT || arch == COIL_CPU_ARM32 || arch == COIL_CPU_ARM64) {
+    ladder = COIL_TARGET_ARM_LADDER;
+  }
+  
+  coil_u64_t steps = features & ladder;
+  coil_u32_t level = steps != 0 ? 64 - (coil_u32_t)__builtin_clzll(steps) : 0;
+  coil_u32_t count = (coil_u32_t)__builtin_popcountll(features);
+  return (level << 8) | count;
+}
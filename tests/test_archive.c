@@ -0,0 +1,191 @@
+/**
+* @file test_archive.c
+* @brief Test suite for COIL archives
+*
+* @author Low Level Team
+*/
+
+#include <coil/archive.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+
+// Test macros
+#define TEST_ASSERT(cond, msg) do { \
+  if (!(cond)) { \
+    printf("ASSERT FAILED: %s (line %d)\n", msg, __LINE__); \
+    return 1; \
+  } \
+} while (0)
+
+#define TEST_ARCHIVE_FILE "test_archive.coila"
+#define TEST_ARCHIVE_MEMBERS 3
+
+/**
+* @brief Build an object with one text section holding its member number
+*/
+static int test_archive_make_object(coil_object_t *obj, int member) {
+  TEST_ASSERT(coil_obj_init(obj, COIL_OBJ_INIT_DEFAULT) == COIL_ERR_GOOD, "Object init should succeed");
+  
+  char text[32];
+  int length = snprintf(text, sizeof(text), "member %d", member);
+  
+  coil_section_t sect;
+  coil_size_t written;
+  TEST_ASSERT(coil_section_init(&sect, 32) == COIL_ERR_GOOD, "Section init should succeed");
+  coil_section_write(&sect, (coil_byte_t *)text, (coil_size_t)length + 1, &written);
+  TEST_ASSERT(coil_obj_create_section(obj, COIL_SECTION_PROGBITS, ".text", COIL_SECTION_FLAG_CODE, &sect, NULL) == COIL_ERR_GOOD, "Creating .text should succeed");
+  coil_section_cleanup(&sect);
+  
+  return 0;
+}
+
+/**
+* @brief Test writing an archive and reading members back
+*/
+static int test_archive_roundtrip() {
+  printf("  Testing archive write and member access...\n");
+  
+  TEST_ASSERT(sizeof(coil_archive_header_t) == 64, "Archive header should be 64 bytes");
+  TEST_ASSERT(sizeof(coil_archive_member_t) == 32, "Member entries should be 32 bytes");
+  TEST_ASSERT(sizeof(coil_archive_symbol_t) == 16, "Symbol entries should be 16 bytes");
+  
+  int fd = open(TEST_ARCHIVE_FILE, O_RDWR | O_CREAT | O_TRUNC, 0644);
+  TEST_ASSERT(fd >= 0, "Failed to create test file");
+  
+  coil_archive_writer_t w;
+  TEST_ASSERT(coil_archive_writer_init(&w, fd) == COIL_ERR_GOOD, "Writer init should succeed");
+  
+  const char *names[TEST_ARCHIVE_MEMBERS] = {"alpha.coil", "beta.coil", "gamma.coil"};
+  for (int i = 0; i < TEST_ARCHIVE_MEMBERS; i++) {
+    coil_object_t obj;
+    TEST_ASSERT(test_archive_make_object(&obj, i) == 0, "Object should build");
+    
+    coil_u32_t member;
+    TEST_ASSERT(coil_archive_writer_add(&w, names[i], &obj, &member) == COIL_ERR_GOOD, "Adding a member should succeed");
+    TEST_ASSERT(member == (coil_u32_t)i, "Members should be appended");
+    
+    if (i == 0) {
+      TEST_ASSERT(coil_archive_writer_add(&w, names[i], &obj, NULL) == COIL_ERR_EXISTS, "Duplicate names should be rejected");
+    }
+    coil_obj_cleanup(&obj);
+  }
+  
+  // Symbols from a table: only defined, non-local entries are indexed
+  coil_symbol_t syms[3];
+  memset(syms, 0, sizeof(syms));
+  syms[0].name_hash = coil_obj_hash_name("gamma_main");
+  syms[0].binding = COIL_SYMBOL_GLOBAL;
+  syms[0].section = 0;
+  syms[1].name_hash = coil_obj_hash_name("gamma_local");
+  syms[1].binding = COIL_SYMBOL_LOCAL;
+  syms[1].section = 0;
+  syms[2].name_hash = coil_obj_hash_name("alpha_main");
+  syms[2].binding = COIL_SYMBOL_GLOBAL;
+  syms[2].section = COIL_SECTION_INDEX_NONE;
+  
+  coil_symtab_view_t view;
+  memset(&view, 0, sizeof(view));
+  view.symbols = syms;
+  view.count = 3;
+  
+  TEST_ASSERT(coil_archive_writer_add_symbol(&w, 1, coil_obj_hash_name("beta_main")) == COIL_ERR_GOOD, "Adding a symbol should succeed");
+  TEST_ASSERT(coil_archive_writer_add_symbol(&w, 0, coil_obj_hash_name("alpha_main")) == COIL_ERR_GOOD, "Adding a symbol should succeed");
+  TEST_ASSERT(coil_archive_writer_add_symbol(&w, 2, coil_obj_hash_name("shared")) == COIL_ERR_GOOD, "Adding a symbol should succeed");
+  TEST_ASSERT(coil_archive_writer_add_symbol(&w, 1, coil_obj_hash_name("shared")) == COIL_ERR_GOOD, "Adding a symbol should succeed");
+  TEST_ASSERT(coil_archive_writer_add_symtab(&w, 2, &view) == COIL_ERR_GOOD, "Adding a symbol table should succeed");
+  TEST_ASSERT(coil_archive_writer_add_symbol(&w, TEST_ARCHIVE_MEMBERS, 1) == COIL_ERR_INVAL, "Unknown members should be rejected");
+  TEST_ASSERT(w.symbol_count == 5, "Local and undefined symbols should be skipped");
+  
+  TEST_ASSERT(coil_archive_writer_finish(&w) == COIL_ERR_GOOD, "Finish should succeed");
+  coil_archive_writer_cleanup(&w);
+  
+  coil_archive_t ar;
+  TEST_ASSERT(coil_archive_open(&ar, fd) == COIL_ERR_GOOD, "Opening the archive should succeed");
+  TEST_ASSERT(ar.header->member_count == TEST_ARCHIVE_MEMBERS, "Archive should hold every member");
+  TEST_ASSERT(ar.header->file_size == ar.size, "Archive size should match the file");
+  
+  coil_u32_t member;
+  for (int i = 0; i < TEST_ARCHIVE_MEMBERS; i++) {
+    TEST_ASSERT(ar.members[i].offset % coil_get_page_size() == 0, "Members should be page aligned");
+    TEST_ASSERT(coil_archive_find_member(&ar, names[i], &member) == COIL_ERR_GOOD && member == (coil_u32_t)i, "Members should be found by name");
+    
+    const char *name;
+    TEST_ASSERT(coil_archive_member_name(&ar, member, &name) == COIL_ERR_GOOD, "Member names should resolve");
+    TEST_ASSERT(strcmp(name, names[i]) == 0, "Member names should round trip");
+  }
+  TEST_ASSERT(coil_archive_find_member(&ar, "delta.coil", &member) == COIL_ERR_NOTFOUND, "Unknown members should not be found");
+  
+  TEST_ASSERT(coil_archive_find_symbol(&ar, coil_obj_hash_name("beta_main"), &member) == COIL_ERR_GOOD && member == 1, "Symbols should resolve to their member");
+  TEST_ASSERT(coil_archive_find_symbol(&ar, coil_obj_hash_name("gamma_main"), &member) == COIL_ERR_GOOD && member == 2, "Symbol table entries should be indexed");
+  TEST_ASSERT(coil_archive_find_symbol(&ar, coil_obj_hash_name("shared"), &member) == COIL_ERR_GOOD && member == 1, "The first defining member should win");
+  TEST_ASSERT(coil_archive_find_symbol(&ar, coil_obj_hash_name("gamma_local"), &member) == COIL_ERR_NOTFOUND, "Local symbols should not be indexed");
+  TEST_ASSERT(coil_archive_find_symbol(&ar, coil_obj_hash_name("missing"), &member) == COIL_ERR_NOTFOUND, "Unknown symbols should not be found");
+  
+  // Members map straight out of the archive
+  coil_object_t obj;
+  TEST_ASSERT(coil_archive_open_member(&ar, 2, &obj) == COIL_ERR_GOOD, "Opening a member should succeed");
+  TEST_ASSERT(coil_archive_open_member(&ar, TEST_ARCHIVE_MEMBERS, &obj) == COIL_ERR_INVAL, "Out of range members should be rejected");
+  
+  coil_u16_t index;
+  coil_section_t sect;
+  TEST_ASSERT(coil_obj_find_section(&obj, ".text", &index) == COIL_ERR_GOOD, "Member sections should be found");
+  TEST_ASSERT(coil_obj_load_section(&obj, index, &sect, COIL_SLOAD_VIEW) == COIL_ERR_GOOD, "Member sections should load");
+  TEST_ASSERT(strcmp((const char *)sect.data, "member 2") == 0, "Member contents should round trip");
+  coil_section_cleanup(&sect);
+  
+  // Members outlive the archive mapping
+  coil_archive_close(&ar);
+  TEST_ASSERT(coil_obj_load_section(&obj, index, &sect, COIL_SLOAD_VIEW) == COIL_ERR_GOOD, "Member sections should load after close");
+  TEST_ASSERT(strcmp((const char *)sect.data, "member 2") == 0, "Member contents should survive closing the archive");
+  coil_section_cleanup(&sect);
+  coil_obj_cleanup(&obj);
+  
+  close(fd);
+  return 0;
+}
+
+/**
+* @brief Test that malformed archives are rejected
+*/
+static int test_archive_invalid() {
+  printf("  Testing malformed archives...\n");
+  
+  int fd = open(TEST_ARCHIVE_FILE, O_RDWR);
+  TEST_ASSERT(fd >= 0, "Failed to open test file");
+  
+  coil_archive_t ar;
+  TEST_ASSERT(coil_archive_open(NULL, fd) == COIL_ERR_INVAL, "NULL archives should be rejected");
+  
+  // Corrupt the magic
+  char magic = 'X';
+  TEST_ASSERT(pwrite(fd, &magic, 1, 0) == 1, "Corrupting the header should succeed");
+  TEST_ASSERT(coil_archive_open(&ar, fd) == COIL_ERR_FORMAT, "Bad magic should be rejected");
+  
+  // Truncated files are rejected too
+  TEST_ASSERT(ftruncate(fd, 16) == 0, "Truncating should succeed");
+  TEST_ASSERT(coil_archive_open(&ar, fd) == COIL_ERR_FORMAT, "Truncated archives should be rejected");
+  
+  close(fd);
+  unlink(TEST_ARCHIVE_FILE);
+  return 0;
+}
+
+/**
+* @brief Run all archive tests
+*/
+int test_archive() {
+  printf("\nRunning archive tests...\n");
+  
+  int result = 0;
+  
+  result |= test_archive_roundtrip();
+  result |= test_archive_invalid();
+  
+  if (result == 0) {
+    printf("All archive tests passed!\n");
+  }
+  
+  return result;
+}
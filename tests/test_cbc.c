@@ -0,0 +1,654 @@
+/**
+* @file test_cbc.c
+* @brief Test suite for the CBC encoding and interpreter
+*
+* @author Low Level Team
+*/
+
+#include <coil/cbc.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Test macros
+#define TEST_ASSERT(cond, msg) do { \
+  if (!(cond)) { \
+    printf("ASSERT FAILED: %s (line %d)\n", msg, __LINE__); \
+    return 1; \
+  } \
+} while (0)
+
+#define TEST_CBC_EMIT0(op) \
+  TEST_ASSERT(coil_cbc_encode(&code, op, COIL_INSTRFLAG_NONE, NULL, NULL) == COIL_ERR_GOOD, "Encoding " #op " should succeed")
+#define TEST_CBC_EMIT1(op, x) do { \
+  coil_cbc_operand_t a_ = x; \
+  TEST_ASSERT(coil_cbc_encode(&code, op, COIL_INSTRFLAG_NONE, &a_, NULL) == COIL_ERR_GOOD, "Encoding " #op " should succeed"); \
+} while (0)
+#define TEST_CBC_EMIT2(op, x, y) do { \
+  coil_cbc_operand_t a_ = x, b_ = y; \
+  TEST_ASSERT(coil_cbc_encode(&code, op, COIL_INSTRFLAG_NONE, &a_, &b_) == COIL_ERR_GOOD, "Encoding " #op " should succeed"); \
+} while (0)
+#define TEST_CBC_BR(cond, label) do { \
+  coil_cbc_operand_t a_ = coil_cbc_sym(label); \
+  TEST_ASSERT(coil_cbc_encode(&code, COIL_COP_BRqS, cond, &a_, NULL) == COIL_ERR_GOOD, "Encoding BR should succeed"); \
+} while (0)
+#define TEST_CBC_LABEL(label) (syms[label] = code.size)
+
+#define TEST_CBC_DEPTH 64
+
+/**
+* @brief Run a program with both dispatch loops and check they agree
+*
+* The threaded run works on memory, the switch run on a copy. Registers,
+* flags, steps, fault offset and memory must match afterwards.
+*/
+static coil_err_t test_cbc_execute(const coil_section_t *code, const coil_u64_t *syms, coil_u32_t symcount, coil_u64_t entry,
+                                   coil_byte_t *memory, coil_size_t size, coil_u64_t max_steps, coil_cbc_vm_t *out) {
+  coil_cbc_program_t prog;
+  coil_err_t err = coil_cbc_program_init(&prog, code->data, code->size, syms, symcount);
+  if (err != COIL_ERR_GOOD) {
+    return err;
+  }
+  
+  coil_byte_t *copy = (coil_byte_t *)malloc(size + 1);
+  if (size != 0) {
+    memcpy(copy, memory, size);
+  }
+  
+  coil_cbc_vm_t threaded, switched;
+  coil_cbc_vm_init(&threaded, memory, size, TEST_CBC_DEPTH);
+  coil_cbc_vm_init(&switched, copy, size, TEST_CBC_DEPTH);
+  
+  err = coil_cbc_run(&threaded, &prog, entry, max_steps);
+  coil_err_t reference = coil_cbc_run_switch(&switched, &prog, entry, max_steps);
+  
+  if (err != reference || memcmp(threaded.regs, switched.regs, sizeof(threaded.regs)) != 0 ||
+      threaded.flags != switched.flags || threaded.steps != switched.steps || threaded.fault != switched.fault ||
+      threaded.fused != switched.fused ||
+      (size != 0 && memcmp(memory, copy, size) != 0)) {
+    printf("Threaded and switch dispatch disagree\n");
+    err = COIL_ERR_UNKNOWN;
+  }
+  
+  *out = threaded;
+  out->stack = NULL;
+  out->calls = NULL;
+  out->memory = NULL;
+  
+  coil_cbc_vm_cleanup(&threaded);
+  coil_cbc_vm_cleanup(&switched);
+  coil_cbc_program_cleanup(&prog);
+  free(copy);
+  return err;
+}
+
+/**
+* @brief Test the opcode space decomposition
+*/
+static int test_cbc_opcodes() {
+  printf("  Testing CBC opcode decomposition...\n");
+  
+  TEST_ASSERT(coil_cbc_info(COIL_CBC_OPCODE_COUNT) == NULL, "Opcodes past the CBC space should be unknown");
+  
+  // Every opcode decomposes and maps back to itself, operations appear in order
+  coil_u8_t last = 0;
+  for (coil_u32_t op = 0; op < COIL_CBC_OPCODE_COUNT; op++) {
+    const coil_cbc_info_t *info = coil_cbc_info((coil_cbc_opcode_t)op);
+    TEST_ASSERT(info != NULL && info->operation < COIL_CBC_OPERATION_COUNT, "Every opcode should decompose");
+    TEST_ASSERT(info->operation >= last, "Operations should be contiguous");
+    last = info->operation;
+    
+    coil_cbc_opcode_t back;
+    TEST_ASSERT(coil_cbc_opcode_for(info->operation, info->width, info->form[0], info->form[1], &back) == COIL_ERR_GOOD, "Decompositions should map back");
+    TEST_ASSERT(back == op, "Decompositions should map back to the same opcode");
+  }
+  TEST_ASSERT(last == COIL_CBC_RDTSC, "The last opcode should be RDTSC");
+  
+  // Spot checks against the names generated in types.h
+  const struct { coil_cbc_opcode_t op; coil_u8_t operation, width, a, b; } named[] = {
+    { COIL_COP_NOP, COIL_CBC_NOP, 0, COIL_CBC_FORM_NONE, COIL_CBC_FORM_NONE },
+    { COIL_COP_JMPqR, COIL_CBC_JMP, 8, COIL_CBC_FORM_R, COIL_CBC_FORM_NONE },
+    { COIL_COP_RET, COIL_CBC_RET, 0, COIL_CBC_FORM_NONE, COIL_CBC_FORM_NONE },
+    { COIL_COP_CMPwOSI, COIL_CBC_CMP, 2, COIL_CBC_FORM_OS, COIL_CBC_FORM_I },
+    { COIL_COP_MOVqRI, COIL_CBC_MOV, 8, COIL_CBC_FORM_R, COIL_CBC_FORM_I },
+    { COIL_COP_POPlOR, COIL_CBC_POP, 4, COIL_CBC_FORM_OR, COIL_CBC_FORM_NONE },
+    { COIL_COP_LEAqROS, COIL_CBC_LEA, 8, COIL_CBC_FORM_R, COIL_CBC_FORM_OS },
+    { COIL_COP_SCOPL, COIL_CBC_SCOPL, 0, COIL_CBC_FORM_NONE, COIL_CBC_FORM_NONE },
+    { COIL_COP_ADDbSI, COIL_CBC_ADD, 1, COIL_CBC_FORM_S, COIL_CBC_FORM_I },
+    { COIL_COP_NEGoOROR, COIL_CBC_NEG, 16, COIL_CBC_FORM_OR, COIL_CBC_FORM_OR },
+    { COIL_COP_NOTqR, COIL_CBC_NOT, 8, COIL_CBC_FORM_R, COIL_CBC_FORM_NONE },
+    { COIL_COP_SARlRI, COIL_CBC_SAR, 4, COIL_CBC_FORM_R, COIL_CBC_FORM_I },
+    { COIL_COP_CVTbRR, COIL_CBC_CVT, 1, COIL_CBC_FORM_R, COIL_CBC_FORM_R },
+    { COIL_COP_INTlI, COIL_CBC_INT, 4, COIL_CBC_FORM_I, COIL_CBC_FORM_NONE },
+    { COIL_COP_CPU_SYSRET, COIL_CBC_SYSRET, 0, COIL_CBC_FORM_NONE, COIL_CBC_FORM_NONE },
+    { COIL_COP_RDTSCoOR, COIL_CBC_RDTSC, 16, COIL_CBC_FORM_OR, COIL_CBC_FORM_NONE },
+  };
+  for (coil_size_t i = 0; i < sizeof(named) / sizeof(named[0]); i++) {
+    const coil_cbc_info_t *info = coil_cbc_info(named[i].op);
+    TEST_ASSERT(info->operation == named[i].operation && info->width == named[i].width, "Named opcodes should decompose");
+    TEST_ASSERT(info->form[0] == named[i].a && info->form[1] == named[i].b, "Named opcodes should have their forms");
+  }
+  
+  coil_cbc_opcode_t op;
+  TEST_ASSERT(coil_cbc_opcode_for(COIL_CBC_MOV, 8, COIL_CBC_FORM_I, COIL_CBC_FORM_R, &op) == COIL_ERR_NOTFOUND, "Immediate destinations should not exist");
+  TEST_ASSERT(coil_cbc_opcode_for(COIL_CBC_JMP, 8, COIL_CBC_FORM_I, COIL_CBC_FORM_NONE, &op) == COIL_ERR_NOTFOUND, "Immediate branch targets should not exist");
+  TEST_ASSERT(coil_cbc_opcode_for(COIL_CBC_ADD, 3, COIL_CBC_FORM_R, COIL_CBC_FORM_R, &op) == COIL_ERR_NOTFOUND, "Odd widths should not exist");
+  TEST_ASSERT(coil_cbc_opcode_for(COIL_CBC_RET, 8, COIL_CBC_FORM_NONE, COIL_CBC_FORM_NONE, &op) == COIL_ERR_NOTFOUND, "RET should have no width");
+  TEST_ASSERT(coil_cbc_opcode_for(COIL_CBC_ADD, 8, COIL_CBC_FORM_R, COIL_CBC_FORM_R, NULL) == COIL_ERR_INVAL, "NULL opcode pointers should be rejected");
+  
+  return 0;
+}
+
+/**
+* @brief Test encoding and decoding instructions
+*/
+static int test_cbc_encoding() {
+  printf("  Testing CBC encoding...\n");
+  
+  coil_section_t code;
+  TEST_ASSERT(coil_section_init(&code, 64) == COIL_ERR_GOOD, "Section init should succeed");
+  
+  coil_cbc_operand_t wide = coil_cbc_imm(0x0123456789ABCDEFull);
+  wide.imm_hi = 0xFEDCBA9876543210ull;
+  coil_cbc_operand_t r3 = coil_cbc_reg(3);
+  coil_cbc_operand_t mem = coil_cbc_mem_reg(4, -16);
+  coil_cbc_operand_t sym = coil_cbc_mem_sym(7, 12);
+  coil_cbc_operand_t label = coil_cbc_sym(2);
+  
+  TEST_ASSERT(coil_cbc_encode(&code, COIL_COP_MOVoRI, 0, &r3, &wide) == COIL_ERR_GOOD, "Encoding a 128-bit move should succeed");
+  TEST_ASSERT(coil_cbc_encode(&code, COIL_COP_ADDlOROS, 0, &mem, &sym) == COIL_ERR_GOOD, "Encoding memory operands should succeed");
+  TEST_ASSERT(coil_cbc_encode(&code, COIL_COP_BRqS, COIL_INSTRFLAG_LTE, &label, NULL) == COIL_ERR_GOOD, "Encoding a branch should succeed");
+  TEST_ASSERT(coil_cbc_encode(&code, COIL_COP_RET, 0, NULL, NULL) == COIL_ERR_GOOD, "Encoding RET should succeed");
+  TEST_ASSERT(code.size == (2 + 1 + 16) + (2 + 5 + 8) + (2 + 1 + 4) + 2, "Instructions should have their encoded lengths");
+  
+  TEST_ASSERT(coil_cbc_encode(&code, COIL_COP_MOVoRI, 0, &wide, &r3) == COIL_ERR_INVAL, "Mismatched forms should be rejected");
+  TEST_ASSERT(coil_cbc_encode(&code, COIL_COP_RET, 0, &r3, NULL) == COIL_ERR_INVAL, "Extra operands should be rejected");
+  TEST_ASSERT(coil_cbc_encode(&code, COIL_COP_BRqS, 9, &label, NULL) == COIL_ERR_INVAL, "Unknown conditions should be rejected");
+  TEST_ASSERT(coil_cbc_encode(&code, COIL_CBC_OPCODE_COUNT, 0, NULL, NULL) == COIL_ERR_INVAL, "Unknown opcodes should be rejected");
+  
+  coil_cbc_insn_t insn;
+  coil_size_t offset = 0;
+  TEST_ASSERT(coil_cbc_decode(code.data, code.size, offset, &insn) == COIL_ERR_GOOD, "Decoding should succeed");
+  TEST_ASSERT(insn.opcode == COIL_COP_MOVoRI && insn.length == 19, "Opcode and length should round trip");
+  TEST_ASSERT(insn.operands[0].reg == 3 && insn.operands[1].imm == wide.imm && insn.operands[1].imm_hi == wide.imm_hi, "128-bit immediates should round trip");
+  
+  offset += insn.length;
+  TEST_ASSERT(coil_cbc_decode(code.data, code.size, offset, &insn) == COIL_ERR_GOOD, "Decoding should succeed");
+  TEST_ASSERT(insn.info.operation == COIL_CBC_ADD && insn.info.width == 4, "Operation and width should decode");
+  TEST_ASSERT(insn.operands[0].form == COIL_CBC_FORM_OR && insn.operands[0].reg == 4 && insn.operands[0].disp == -16, "Register memory operands should round trip");
+  TEST_ASSERT(insn.operands[1].form == COIL_CBC_FORM_OS && insn.operands[1].symbol == 7 && insn.operands[1].disp == 12, "Symbol memory operands should round trip");
+  
+  offset += insn.length;
+  TEST_ASSERT(coil_cbc_decode(code.data, code.size, offset, &insn) == COIL_ERR_GOOD, "Decoding should succeed");
+  TEST_ASSERT(insn.cond == COIL_INSTRFLAG_LTE && insn.operands[0].symbol == 2, "Branch conditions should round trip");
+  
+  offset += insn.length;
+  TEST_ASSERT(coil_cbc_decode(code.data, code.size, offset, &insn) == COIL_ERR_GOOD, "Decoding should succeed");
+  TEST_ASSERT(insn.opcode == COIL_COP_RET && offset + insn.length == code.size, "Decoding should end at the last instruction");
+  
+  // Operand-less instructions at the end of the code read nothing past it
+  coil_byte_t tail[8];
+  memset(tail, 0xAB, sizeof(tail));
+  memcpy(tail, code.data + offset, insn.length);
+  TEST_ASSERT(coil_cbc_decode(tail, insn.length, 0, &insn) == COIL_ERR_GOOD, "Decoding a lone RET should succeed");
+  TEST_ASSERT(insn.operands[0].reg == 0 && insn.operands[0].disp == 0 && insn.operands[1].reg == 0, "Operand-less instructions should decode no operand fields");
+  
+  // Truncation and bad conditions
+  TEST_ASSERT(coil_cbc_decode(code.data, 10, 0, &insn) == COIL_ERR_FORMAT, "Truncated operands should be rejected");
+  TEST_ASSERT(coil_cbc_decode(code.data, code.size, code.size - 1, &insn) == COIL_ERR_FORMAT, "Truncated opcodes should be rejected");
+  code.data[19 + 15 + 2] = 9;
+  TEST_ASSERT(coil_cbc_decode(code.data, code.size, 19 + 15, &insn) == COIL_ERR_FORMAT, "Bad conditions should be rejected");
+  
+  coil_section_cleanup(&code);
+  return 0;
+}
+
+/**
+* @brief Test small kernels under both dispatch loops
+*/
+static int test_cbc_kernels() {
+  printf("  Testing CBC kernels...\n");
+  
+  coil_section_t code;
+  coil_u64_t syms[4];
+  coil_cbc_vm_t vm;
+  
+  // Sum of 1..100
+  TEST_ASSERT(coil_section_init(&code, 64) == COIL_ERR_GOOD, "Section init should succeed");
+  TEST_CBC_EMIT2(COIL_COP_MOVqRI, coil_cbc_reg(0), coil_cbc_imm(0));
+  TEST_CBC_EMIT2(COIL_COP_MOVqRI, coil_cbc_reg(1), coil_cbc_imm(100));
+  TEST_CBC_LABEL(0);
+  TEST_CBC_EMIT2(COIL_COP_ADDqRR, coil_cbc_reg(0), coil_cbc_reg(1));
+  TEST_CBC_EMIT2(COIL_COP_DECqRR, coil_cbc_reg(1), coil_cbc_reg(1));
+  TEST_CBC_EMIT2(COIL_COP_CMPqRI, coil_cbc_reg(1), coil_cbc_imm(0));
+  TEST_CBC_BR(COIL_INSTRFLAG_GT, 0);
+  TEST_CBC_EMIT0(COIL_COP_RET);
+  
+  TEST_ASSERT(test_cbc_execute(&code, syms, 1, 0, NULL, 0, 0, &vm) == COIL_ERR_GOOD, "The sum kernel should run");
+  TEST_ASSERT(vm.regs[0].lo == 5050 && vm.regs[0].hi == 0, "The sum kernel should compute 5050");
+  TEST_ASSERT(vm.steps == 2 + 100 * 4 + 1, "Every instruction should retire once");
+  coil_section_cleanup(&code);
+  
+  // Bubble sort of signed 32-bit values
+  coil_i32_t values[16] = { 5, -3, 12, 0, -7, 99, 42, -100, 8, 8, 1, -1, 77, -55, 3, 2 };
+  TEST_ASSERT(coil_section_init(&code, 64) == COIL_ERR_GOOD, "Section init should succeed");
+  syms[0] = 0;
+  TEST_CBC_EMIT2(COIL_COP_MOVqRI, coil_cbc_reg(1), coil_cbc_imm(15));
+  TEST_CBC_LABEL(1);
+  TEST_CBC_EMIT2(COIL_COP_LEAqRS, coil_cbc_reg(2), coil_cbc_sym(0));
+  TEST_CBC_EMIT2(COIL_COP_MOVqRR, coil_cbc_reg(3), coil_cbc_reg(1));
+  TEST_CBC_LABEL(2);
+  TEST_CBC_EMIT2(COIL_COP_MOVlROR, coil_cbc_reg(4), coil_cbc_mem_reg(2, 0));
+  TEST_CBC_EMIT2(COIL_COP_MOVlROR, coil_cbc_reg(5), coil_cbc_mem_reg(2, 4));
+  TEST_CBC_EMIT2(COIL_COP_CMPlRR, coil_cbc_reg(4), coil_cbc_reg(5));
+  TEST_CBC_BR(COIL_INSTRFLAG_LTE, 3);
+  TEST_CBC_EMIT2(COIL_COP_MOVlORR, coil_cbc_mem_reg(2, 0), coil_cbc_reg(5));
+  TEST_CBC_EMIT2(COIL_COP_MOVlORR, coil_cbc_mem_reg(2, 4), coil_cbc_reg(4));
+  TEST_CBC_LABEL(3);
+  TEST_CBC_EMIT2(COIL_COP_ADDqRI, coil_cbc_reg(2), coil_cbc_imm(4));
+  TEST_CBC_EMIT2(COIL_COP_DECqRR, coil_cbc_reg(3), coil_cbc_reg(3));
+  TEST_CBC_EMIT2(COIL_COP_CMPqRI, coil_cbc_reg(3), coil_cbc_imm(0));
+  TEST_CBC_BR(COIL_INSTRFLAG_GT, 2);
+  TEST_CBC_EMIT2(COIL_COP_DECqRR, coil_cbc_reg(1), coil_cbc_reg(1));
+  TEST_CBC_EMIT2(COIL_COP_CMPqRI, coil_cbc_reg(1), coil_cbc_imm(0));
+  TEST_CBC_BR(COIL_INSTRFLAG_GT, 1);
+  TEST_CBC_EMIT0(COIL_COP_RET);
+  
+  TEST_ASSERT(test_cbc_execute(&code, syms, 4, 0, (coil_byte_t *)values, sizeof(values), 0, &vm) == COIL_ERR_GOOD, "The sort kernel should run");
+  for (int i = 1; i < 16; i++) {
+    TEST_ASSERT(values[i - 1] <= values[i], "The sort kernel should order the values");
+  }
+  TEST_ASSERT(values[0] == -100 && values[15] == 99, "The sort kernel should keep the values");
+  coil_section_cleanup(&code);
+  
+  // Recursive Fibonacci with CALL, RET, PUSH and POP
+  TEST_ASSERT(coil_section_init(&code, 64) == COIL_ERR_GOOD, "Section init should succeed");
+  TEST_CBC_EMIT2(COIL_COP_MOVqRI, coil_cbc_reg(0), coil_cbc_imm(15));
+  TEST_CBC_EMIT1(COIL_COP_CALLqS, coil_cbc_sym(0));
+  TEST_CBC_EMIT0(COIL_COP_RET);
+  TEST_CBC_LABEL(0);
+  TEST_CBC_EMIT2(COIL_COP_CMPqRI, coil_cbc_reg(0), coil_cbc_imm(2));
+  TEST_CBC_BR(COIL_INSTRFLAG_LT, 1);
+  TEST_CBC_EMIT1(COIL_COP_PUSHqR, coil_cbc_reg(0));
+  TEST_CBC_EMIT2(COIL_COP_SUBqRI, coil_cbc_reg(0), coil_cbc_imm(1));
+  TEST_CBC_EMIT1(COIL_COP_CALLqS, coil_cbc_sym(0));
+  TEST_CBC_EMIT1(COIL_COP_POPqR, coil_cbc_reg(1));
+  TEST_CBC_EMIT1(COIL_COP_PUSHqR, coil_cbc_reg(0));
+  TEST_CBC_EMIT2(COIL_COP_MOVqRR, coil_cbc_reg(0), coil_cbc_reg(1));
+  TEST_CBC_EMIT2(COIL_COP_SUBqRI, coil_cbc_reg(0), coil_cbc_imm(2));
+  TEST_CBC_EMIT1(COIL_COP_CALLqS, coil_cbc_sym(0));
+  TEST_CBC_EMIT1(COIL_COP_POPqR, coil_cbc_reg(1));
+  TEST_CBC_EMIT2(COIL_COP_ADDqRR, coil_cbc_reg(0), coil_cbc_reg(1));
+  TEST_CBC_LABEL(1);
+  TEST_CBC_EMIT0(COIL_COP_RET);
+  
+  TEST_ASSERT(test_cbc_execute(&code, syms, 2, 0, NULL, 0, 0, &vm) == COIL_ERR_GOOD, "The Fibonacci kernel should run");
+  TEST_ASSERT(vm.regs[0].lo == 610, "The Fibonacci kernel should compute fib(15)");
+  TEST_ASSERT(vm.sp == 0 && vm.csp == 0, "Calls and pushes should balance");
+  coil_section_cleanup(&code);
+  
+  return 0;
+}
+
+/**
+* @brief Test operand widths, generic handlers and flags
+*/
+static int test_cbc_semantics() {
+  printf("  Testing CBC semantics...\n");
+  
+  coil_section_t code;
+  coil_u64_t syms[2] = { 8, 0 };
+  coil_byte_t memory[32];
+  coil_cbc_vm_t vm;
+  memset(memory, 0, sizeof(memory));
+  
+  TEST_ASSERT(coil_section_init(&code, 64) == COIL_ERR_GOOD, "Section init should succeed");
+  
+  // Narrow results are zero extended into the register
+  TEST_CBC_EMIT2(COIL_COP_MOVqRI, coil_cbc_reg(0), coil_cbc_imm(~0ull));
+  TEST_CBC_EMIT2(COIL_COP_ADDbRI, coil_cbc_reg(0), coil_cbc_imm(1));
+  TEST_CBC_EMIT2(COIL_COP_MOVqRI, coil_cbc_reg(1), coil_cbc_imm(0x1234));
+  TEST_CBC_EMIT2(COIL_COP_SUBwRI, coil_cbc_reg(1), coil_cbc_imm(0x1235));
+  
+  // Signed division, remainder and shifts through the generic handlers
+  TEST_CBC_EMIT2(COIL_COP_MOVlRI, coil_cbc_reg(2), coil_cbc_imm((coil_u32_t)-7));
+  TEST_CBC_EMIT2(COIL_COP_MOVlRR, coil_cbc_reg(3), coil_cbc_reg(2));
+  TEST_CBC_EMIT2(COIL_COP_DIVlRI, coil_cbc_reg(2), coil_cbc_imm(2));
+  TEST_CBC_EMIT2(COIL_COP_MODlRI, coil_cbc_reg(3), coil_cbc_imm(2));
+  TEST_CBC_EMIT2(COIL_COP_MOVbRI, coil_cbc_reg(4), coil_cbc_imm(0x80));
+  TEST_CBC_EMIT2(COIL_COP_SARbRI, coil_cbc_reg(4), coil_cbc_imm(3));
+  TEST_CBC_EMIT2(COIL_COP_CVTbRI, coil_cbc_reg(5), coil_cbc_imm(0x80));
+  TEST_CBC_EMIT2(COIL_COP_NEGqRR, coil_cbc_reg(6), coil_cbc_reg(5));
+  
+  // Memory through symbols, NOT in place, LEA and TEST flags
+  TEST_CBC_EMIT2(COIL_COP_MOVqSI, coil_cbc_sym(0), coil_cbc_imm(0xF0));
+  TEST_CBC_EMIT1(COIL_COP_NOTbS, coil_cbc_sym(0));
+  TEST_CBC_EMIT2(COIL_COP_ADDqOSI, coil_cbc_mem_sym(0, 8), coil_cbc_imm(5));
+  TEST_CBC_EMIT2(COIL_COP_LEAqROS, coil_cbc_reg(7), coil_cbc_mem_sym(0, 8));
+  TEST_CBC_EMIT2(COIL_COP_TESTbRI, coil_cbc_reg(4), coil_cbc_imm(0x80));
+  TEST_CBC_EMIT0(COIL_COP_PUSHFD);
+  TEST_CBC_EMIT2(COIL_COP_CMPqRI, coil_cbc_reg(0), coil_cbc_imm(0));
+  TEST_CBC_EMIT0(COIL_COP_POPFD);
+  
+  // PUSHA/POPA restore every register
+  TEST_CBC_EMIT0(COIL_COP_PUSHA);
+  TEST_CBC_EMIT2(COIL_COP_MOVqRI, coil_cbc_reg(0), coil_cbc_imm(99));
+  TEST_CBC_EMIT0(COIL_COP_POPA);
+  
+  // 128-bit carry
+#ifdef __SIZEOF_INT128__
+  TEST_CBC_EMIT2(COIL_COP_MOVqRI, coil_cbc_reg(8), coil_cbc_imm(~0ull));
+  TEST_CBC_EMIT2(COIL_COP_ADDoRI, coil_cbc_reg(8), coil_cbc_imm(1));
+#endif
+  
+  // Dynamic jump through a register, skipping the MOV
+  TEST_CBC_EMIT2(COIL_COP_MOVqRI, coil_cbc_reg(9), coil_cbc_imm(code.size + 11 + 3 + 11));
+  TEST_CBC_EMIT1(COIL_COP_JMPqR, coil_cbc_reg(9));
+  TEST_CBC_EMIT2(COIL_COP_MOVqRI, coil_cbc_reg(10), coil_cbc_imm(1));
+  TEST_CBC_EMIT1(COIL_COP_RDTSCqR, coil_cbc_reg(11));
+  TEST_CBC_EMIT0(COIL_COP_RET);
+  
+  coil_err_t err = test_cbc_execute(&code, syms, 2, 0, memory, sizeof(memory), 0, &vm);
+  TEST_ASSERT(err == COIL_ERR_GOOD, "The program should run");
+  TEST_ASSERT(vm.regs[0].lo == 0, "Byte additions should wrap and zero extend");
+  TEST_ASSERT(vm.regs[1].lo == 0xFFFF, "Word subtractions should wrap within the word");
+  TEST_ASSERT(vm.regs[2].lo == (coil_u32_t)-3 && vm.regs[3].lo == (coil_u32_t)-1, "Division should truncate toward zero");
+  TEST_ASSERT(vm.regs[4].lo == 0xF0, "SAR should shift in the sign");
+  TEST_ASSERT(vm.regs[5].lo == (coil_u64_t)-128 && vm.regs[5].hi == ~0ull, "CVT should sign extend to the full register");
+  TEST_ASSERT(vm.regs[6].lo == 128, "NEG should negate");
+  TEST_ASSERT((coil_u8_t)memory[8] == 0x0F && memory[9] == 0, "NOT should work in place at its width");
+  TEST_ASSERT(memory[16] == 5, "Symbol displacements should address memory");
+  TEST_ASSERT(vm.regs[7].lo == 16, "LEA should produce the address");
+  TEST_ASSERT(vm.flags == COIL_CBC_FLAG_LT, "POPFD should restore the TEST flags");
+#ifdef __SIZEOF_INT128__
+  TEST_ASSERT(vm.regs[8].lo == 0 && vm.regs[8].hi == 1, "128-bit additions should carry");
+#endif
+  TEST_ASSERT(vm.regs[10].lo == 0, "Dynamic jumps should skip over code");
+  TEST_ASSERT(vm.regs[11].lo == vm.steps - 1, "RDTSC should read the retired instruction count");
+  
+  coil_section_cleanup(&code);
+  return 0;
+}
+
+/**
+* @brief Test rejected programs and execution faults
+*/
+static int test_cbc_faults() {
+  printf("  Testing CBC faults...\n");
+  
+  coil_section_t code;
+  coil_u64_t syms[2] = { 0, 0 };
+  coil_byte_t memory[16];
+  coil_cbc_vm_t vm;
+  coil_cbc_program_t prog;
+  
+  // Out of bounds memory
+  TEST_ASSERT(coil_section_init(&code, 64) == COIL_ERR_GOOD, "Section init should succeed");
+  TEST_CBC_EMIT2(COIL_COP_MOVqRI, coil_cbc_reg(0), coil_cbc_imm(12));
+  TEST_CBC_EMIT2(COIL_COP_MOVqORI, coil_cbc_mem_reg(0, 0), coil_cbc_imm(1));
+  TEST_CBC_EMIT0(COIL_COP_RET);
+  TEST_ASSERT(test_cbc_execute(&code, syms, 2, 0, memory, sizeof(memory), 0, &vm) == COIL_ERR_BADSTATE, "Out of bounds stores should fault");
+  TEST_ASSERT(vm.fault == 11 && vm.steps == 1, "The fault should name the store");
+  coil_section_cleanup(&code);
+  
+  // Division by zero
+  TEST_ASSERT(coil_section_init(&code, 64) == COIL_ERR_GOOD, "Section init should succeed");
+  TEST_CBC_EMIT2(COIL_COP_DIVqRI, coil_cbc_reg(0), coil_cbc_imm(0));
+  TEST_CBC_EMIT0(COIL_COP_RET);
+  TEST_ASSERT(test_cbc_execute(&code, syms, 2, 0, NULL, 0, 0, &vm) == COIL_ERR_BADSTATE, "Division by zero should fault");
+  coil_section_cleanup(&code);
+  
+  // Infinite loops stop at the budget, falling off the end stops too
+  TEST_ASSERT(coil_section_init(&code, 64) == COIL_ERR_GOOD, "Section init should succeed");
+  TEST_CBC_EMIT1(COIL_COP_JMPqS, coil_cbc_sym(0));
+  TEST_ASSERT(test_cbc_execute(&code, syms, 2, 0, NULL, 0, 1000, &vm) == COIL_ERR_BADSTATE, "Exhausted budgets should stop execution");
+  TEST_ASSERT(vm.steps == 1000, "The budget should bound the retired instructions");
+  TEST_CBC_EMIT1(COIL_COP_JMPqS, coil_cbc_sym(1));
+  syms[1] = code.size;
+  TEST_ASSERT(test_cbc_execute(&code, syms, 2, 6, NULL, 0, 0, &vm) == COIL_ERR_BADSTATE, "Running past the end should stop execution");
+  TEST_ASSERT(vm.fault == code.size, "The fault should name the end of the code");
+  TEST_ASSERT(test_cbc_execute(&code, syms, 2, 1, NULL, 0, 0, &vm) == COIL_ERR_INVAL, "Entries inside instructions should be rejected");
+  coil_section_cleanup(&code);
+  
+  // Unbounded recursion overflows the call stack
+  TEST_ASSERT(coil_section_init(&code, 64) == COIL_ERR_GOOD, "Section init should succeed");
+  TEST_CBC_EMIT1(COIL_COP_CALLqS, coil_cbc_sym(0));
+  TEST_ASSERT(test_cbc_execute(&code, syms, 1, 0, NULL, 0, 0, &vm) == COIL_ERR_BADSTATE, "Call stack overflows should fault");
+  TEST_ASSERT(vm.csp == TEST_CBC_DEPTH, "The call stack should be full");
+  coil_section_cleanup(&code);
+  
+  // Programs rejected at predecode
+  TEST_ASSERT(coil_section_init(&code, 64) == COIL_ERR_GOOD, "Section init should succeed");
+  TEST_CBC_EMIT0(COIL_COP_CPU_CLI);
+  TEST_ASSERT(coil_cbc_program_init(&prog, code.data, code.size, syms, 2) == COIL_ERR_NOTSUP, "Privileged operations should be rejected");
+  coil_section_reset(&code);
+  TEST_CBC_EMIT2(COIL_COP_LEAqRR, coil_cbc_reg(0), coil_cbc_reg(1));
+  TEST_ASSERT(coil_cbc_program_init(&prog, code.data, code.size, syms, 2) == COIL_ERR_FORMAT, "LEA from a register should be rejected");
+  coil_section_reset(&code);
+  TEST_CBC_EMIT2(COIL_COP_MOVqRI, coil_cbc_reg(COIL_CBC_REGISTERS), coil_cbc_imm(0));
+  TEST_ASSERT(coil_cbc_program_init(&prog, code.data, code.size, syms, 2) == COIL_ERR_FORMAT, "Unknown registers should be rejected");
+  coil_section_reset(&code);
+  TEST_CBC_EMIT2(COIL_COP_MOVqRS, coil_cbc_reg(0), coil_cbc_sym(2));
+  TEST_ASSERT(coil_cbc_program_init(&prog, code.data, code.size, syms, 2) == COIL_ERR_FORMAT, "Unknown symbols should be rejected");
+  coil_section_reset(&code);
+  syms[0] = 1;
+  TEST_CBC_EMIT1(COIL_COP_JMPqS, coil_cbc_sym(0));
+  TEST_ASSERT(coil_cbc_program_init(&prog, code.data, code.size, syms, 2) == COIL_ERR_FORMAT, "Branches into instructions should be rejected");
+  TEST_ASSERT(coil_cbc_program_init(&prog, code.data, code.size - 1, syms, 2) == COIL_ERR_FORMAT, "Truncated code should be rejected");
+  TEST_ASSERT(coil_cbc_program_init(NULL, code.data, code.size, syms, 2) == COIL_ERR_INVAL, "NULL programs should be rejected");
+  coil_section_cleanup(&code);
+  
+  return 0;
+}
+
+/**
+* @brief Copy code into a new section and fuse it
+*/
+static coil_u32_t test_cbc_fused_copy(const coil_section_t *code, coil_section_t *fused) {
+  coil_size_t written;
+  coil_u32_t count = 0;
+  coil_section_init(fused, code->size);
+  coil_section_write(fused, code->data, code->size, &written);
+  if (coil_cbc_fuse(fused->data, fused->size, &count) != COIL_ERR_GOOD) {
+    return ~(coil_u32_t)0;
+  }
+  return count;
+}
+
+/**
+* @brief Test fused opcodes, the fusion pass and fused execution
+*/
+static int test_cbc_fusion() {
+  printf("  Testing CBC fusion...\n");
+  
+  // Every fused opcode decomposes into a fusable first instruction
+  TEST_ASSERT(coil_cbc_fusion(COIL_COP_FUSED - 1) == NULL && coil_cbc_fusion(COIL_COP_FUSED + COIL_CBC_FUSED_COUNT) == NULL, "Opcodes outside the fused range should not be fused");
+  TEST_ASSERT(coil_cbc_info(COIL_COP_FUSED + COIL_CBC_FUSED_COUNT) == NULL, "Unused fused opcodes should be unknown");
+  for (coil_u32_t i = 0; i < COIL_CBC_FUSED_COUNT; i++) {
+    coil_cbc_opcode_t op = (coil_cbc_opcode_t)(COIL_COP_FUSED + i);
+    const coil_cbc_fusion_t *fusion = coil_cbc_fusion(op);
+    TEST_ASSERT(fusion != NULL && coil_cbc_info(op) == coil_cbc_info(fusion->first), "Fused opcodes should decompose like their first instruction");
+    
+    coil_cbc_opcode_t second, back;
+    TEST_ASSERT(coil_cbc_opcode_for(fusion->operation, 8, fusion->form[0], fusion->form[1], &second) == COIL_ERR_GOOD, "Second instructions should exist");
+    TEST_ASSERT(coil_cbc_fused_for(fusion->first, second, &back) == COIL_ERR_GOOD && back == op, "Pairs should map back to their fused opcode");
+  }
+  
+  coil_cbc_opcode_t op;
+  TEST_ASSERT(coil_cbc_fused_for(COIL_COP_CMPlRR, COIL_COP_BRqS, &op) == COIL_ERR_GOOD, "CMP and BR should fuse");
+  TEST_ASSERT(coil_cbc_fused_for(COIL_COP_MOVqRR, COIL_COP_ADDbRI, &op) == COIL_ERR_GOOD, "Widths of the pair may differ");
+  TEST_ASSERT(coil_cbc_fused_for(COIL_COP_CMPqRI, COIL_COP_BRqR, &op) == COIL_ERR_NOTFOUND, "Dynamic branches should not fuse");
+  TEST_ASSERT(coil_cbc_fused_for(COIL_COP_MOVqRI, COIL_COP_ADDqRR, &op) == COIL_ERR_NOTFOUND, "Immediate moves should not fuse");
+  TEST_ASSERT(coil_cbc_fused_for(COIL_COP_MOVoRR, COIL_COP_ADDqRR, &op) == COIL_ERR_NOTFOUND, "128-bit moves should not fuse");
+  TEST_ASSERT(coil_cbc_fused_for(COIL_COP_MOVqRR, COIL_COP_ADDqROR, &op) == COIL_ERR_NOTFOUND, "Memory sources should not fuse");
+  TEST_ASSERT(coil_cbc_fused_for(COIL_COP_MOVqRR, COIL_COP_ADDqRR, NULL) == COIL_ERR_INVAL, "NULL opcode pointers should be rejected");
+  
+  coil_section_t code, fused;
+  coil_u64_t syms[2];
+  coil_cbc_vm_t vm, plain;
+  
+  // Fib with MOV + ADD and MOV + SUB pairs, a CMP + BR latch
+  TEST_ASSERT(coil_section_init(&code, 64) == COIL_ERR_GOOD, "Section init should succeed");
+  TEST_CBC_EMIT2(COIL_COP_MOVqRI, coil_cbc_reg(0), coil_cbc_imm(0));
+  TEST_CBC_EMIT2(COIL_COP_MOVqRI, coil_cbc_reg(1), coil_cbc_imm(1));
+  TEST_CBC_EMIT2(COIL_COP_MOVqRI, coil_cbc_reg(2), coil_cbc_imm(50));
+  TEST_CBC_LABEL(0);
+  TEST_CBC_EMIT2(COIL_COP_MOVqRR, coil_cbc_reg(3), coil_cbc_reg(1));
+  TEST_CBC_EMIT2(COIL_COP_ADDqRR, coil_cbc_reg(1), coil_cbc_reg(0));
+  TEST_CBC_EMIT2(COIL_COP_MOVqRR, coil_cbc_reg(0), coil_cbc_reg(3));
+  TEST_CBC_EMIT2(COIL_COP_MOVlRR, coil_cbc_reg(4), coil_cbc_reg(2));
+  TEST_CBC_EMIT2(COIL_COP_SUBlRI, coil_cbc_reg(4), coil_cbc_imm(1));
+  TEST_CBC_EMIT2(COIL_COP_MOVqRR, coil_cbc_reg(2), coil_cbc_reg(4));
+  TEST_CBC_EMIT2(COIL_COP_CMPqRI, coil_cbc_reg(2), coil_cbc_imm(0));
+  TEST_CBC_BR(COIL_INSTRFLAG_GT, 0);
+  TEST_CBC_EMIT0(COIL_COP_RET);
+  
+  TEST_ASSERT(test_cbc_fused_copy(&code, &fused) == 3, "Three pairs should fuse");
+  TEST_ASSERT(fused.size == code.size, "Fusing should keep the code size");
+  coil_cbc_insn_t a, b;
+  for (coil_size_t offset = 0; offset < code.size; offset += a.length) {
+    TEST_ASSERT(coil_cbc_decode(code.data, code.size, offset, &a) == COIL_ERR_GOOD, "Plain code should decode");
+    TEST_ASSERT(coil_cbc_decode(fused.data, fused.size, offset, &b) == COIL_ERR_GOOD, "Fused code should decode");
+    TEST_ASSERT(a.length == b.length && memcmp(&a.info, &b.info, sizeof(a.info)) == 0, "Fused code should decode to the same instructions");
+  }
+  coil_u32_t again;
+  TEST_ASSERT(coil_cbc_fuse(fused.data, fused.size, &again) == COIL_ERR_GOOD && again == 0, "Fused code should not fuse again");
+  
+  TEST_ASSERT(test_cbc_execute(&code, syms, 1, 0, NULL, 0, 0, &plain) == COIL_ERR_GOOD, "The plain kernel should run");
+  TEST_ASSERT(test_cbc_execute(&fused, syms, 1, 0, NULL, 0, 0, &vm) == COIL_ERR_GOOD, "The fused kernel should run");
+  TEST_ASSERT(vm.regs[0].lo == 12586269025ull && memcmp(vm.regs, plain.regs, sizeof(vm.regs)) == 0, "Fused pairs should compute the same results");
+  TEST_ASSERT(vm.steps == plain.steps && plain.fused == 0, "Fused pairs should retire both instructions");
+  TEST_ASSERT(vm.fused == 50 * 3, "Every fused pair should run with one dispatch");
+  coil_section_cleanup(&fused);
+  coil_section_cleanup(&code);
+  
+  // Branches may land on the second instruction of a pair
+  TEST_ASSERT(coil_section_init(&code, 64) == COIL_ERR_GOOD, "Section init should succeed");
+  TEST_CBC_EMIT2(COIL_COP_MOVqRI, coil_cbc_reg(0), coil_cbc_imm(5));
+  TEST_CBC_EMIT2(COIL_COP_CMPqRI, coil_cbc_reg(0), coil_cbc_imm(9));
+  TEST_CBC_EMIT1(COIL_COP_JMPqS, coil_cbc_sym(1));
+  TEST_CBC_EMIT2(COIL_COP_MOVqRR, coil_cbc_reg(1), coil_cbc_reg(0));
+  TEST_CBC_LABEL(1);
+  TEST_CBC_EMIT2(COIL_COP_ADDqRI, coil_cbc_reg(1), coil_cbc_imm(7));
+  TEST_CBC_EMIT0(COIL_COP_RET);
+  
+  TEST_ASSERT(test_cbc_fused_copy(&code, &fused) == 1, "The copy and the add should fuse");
+  TEST_ASSERT(test_cbc_execute(&fused, syms, 2, 0, NULL, 0, 0, &vm) == COIL_ERR_GOOD, "Jumping into a pair should run");
+  TEST_ASSERT(vm.regs[1].lo == 7 && vm.fused == 0, "The second instruction should run on its own");
+  coil_section_cleanup(&fused);
+  coil_section_cleanup(&code);
+  
+  // Fused opcodes encode like their first instruction and need their pair
+  TEST_ASSERT(coil_section_init(&code, 64) == COIL_ERR_GOOD, "Section init should succeed");
+  TEST_ASSERT(coil_cbc_fused_for(COIL_COP_CMPqRR, COIL_COP_BRqS, &op) == COIL_ERR_GOOD, "CMP and BR should fuse");
+  TEST_CBC_EMIT2(op, coil_cbc_reg(0), coil_cbc_reg(1));
+  coil_cbc_insn_t insn;
+  TEST_ASSERT(coil_cbc_decode(code.data, code.size, 0, &insn) == COIL_ERR_FORMAT, "A fused instruction at the end should be rejected");
+  TEST_CBC_EMIT0(COIL_COP_RET);
+  TEST_ASSERT(coil_cbc_decode(code.data, code.size, 0, &insn) == COIL_ERR_FORMAT, "A fused instruction without its pair should be rejected");
+  TEST_ASSERT(coil_cbc_fuse(code.data, code.size, NULL) == COIL_ERR_FORMAT, "Fusing malformed code should fail");
+  coil_section_reset(&code);
+  TEST_CBC_EMIT2(op, coil_cbc_reg(0), coil_cbc_reg(1));
+  syms[0] = 0;
+  TEST_CBC_BR(COIL_INSTRFLAG_LT, 0);
+  TEST_ASSERT(coil_cbc_decode(code.data, code.size, 0, &insn) == COIL_ERR_GOOD, "A fused instruction with its pair should decode");
+  TEST_ASSERT(insn.opcode == op && insn.info.operation == COIL_CBC_CMP && insn.length == 4, "Fused instructions should decode as their first instruction");
+  coil_section_cleanup(&code);
+  
+  return 0;
+}
+
+/**
+* @brief Test pair frequency profiles
+*/
+static int test_cbc_pairs() {
+  printf("  Testing CBC pair profiles...\n");
+  
+  static const coil_cbc_opcode_t ops[] = {
+    COIL_COP_MOVqRR, COIL_COP_ADDqRR, COIL_COP_SUBqRR, COIL_COP_MULqRR, COIL_COP_ANDqRR,
+    COIL_COP_ORqRR, COIL_COP_XORqRR, COIL_COP_SHLqRR, COIL_COP_SHRqRR, COIL_COP_CMPqRR,
+    COIL_COP_MOVlRR, COIL_COP_ADDlRR, COIL_COP_SUBlRR, COIL_COP_MULlRR, COIL_COP_ANDlRR,
+    COIL_COP_ORlRR, COIL_COP_XORlRR, COIL_COP_SHLlRR, COIL_COP_SHRlRR, COIL_COP_CMPlRR,
+    COIL_COP_MOVwRR, COIL_COP_ADDwRR, COIL_COP_SUBwRR, COIL_COP_MULwRR, COIL_COP_ANDwRR,
+    COIL_COP_ORwRR, COIL_COP_XORwRR, COIL_COP_SHLwRR, COIL_COP_SHRwRR, COIL_COP_CMPwRR,
+  };
+  const coil_u32_t kinds = sizeof(ops) / sizeof(ops[0]);
+  
+  // Enough distinct pairs to grow the table several times
+  coil_section_t code;
+  coil_u32_t sequence[3000];
+  coil_u32_t seed = 99;
+  TEST_ASSERT(coil_section_init(&code, 64) == COIL_ERR_GOOD, "Section init should succeed");
+  for (coil_u32_t i = 0; i < 3000; i++) {
+    seed = seed * 1103515245u + 12345u;
+    sequence[i] = (seed >> 16) % kinds;
+    TEST_CBC_EMIT2(ops[sequence[i]], coil_cbc_reg(1), coil_cbc_reg(2));
+  }
+  
+  coil_cbc_pair_profile_t profile;
+  TEST_ASSERT(coil_cbc_pair_profile_init(&profile) == COIL_ERR_GOOD, "Profile init should succeed");
+  TEST_ASSERT(coil_cbc_pair_profile_add(&profile, code.data, code.size) == COIL_ERR_GOOD, "Profiling should succeed");
+  TEST_ASSERT(coil_cbc_pair_profile_add(&profile, code.data, code.size) == COIL_ERR_GOOD, "Profiling again should succeed");
+  TEST_ASSERT(profile.total == 2 * 2999 && profile.count > 500, "Every adjacent pair should be counted");
+  
+  coil_u32_t counts[30][30];
+  coil_u64_t fusable = 0;
+  memset(counts, 0, sizeof(counts));
+  for (coil_u32_t i = 1; i < 3000; i++) {
+    coil_cbc_opcode_t op;
+    counts[sequence[i - 1]][sequence[i]] += 2;
+    fusable += coil_cbc_fused_for(ops[sequence[i - 1]], ops[sequence[i]], &op) == COIL_ERR_GOOD ? 2 : 0;
+  }
+  TEST_ASSERT(profile.fusable == fusable && fusable > 0, "Pairs with fused opcodes should be counted");
+  
+  coil_cbc_pair_profile_sort(&profile);
+  coil_u64_t sum = 0;
+  for (coil_u32_t i = 0; i < profile.count; i++) {
+    const coil_cbc_pair_t *pair = &profile.pairs[i];
+    coil_u32_t x = 0, y = 0;
+    while (ops[x] != pair->first) x++;
+    while (ops[y] != pair->second) y++;
+    TEST_ASSERT(pair->count == counts[x][y], "Pair counts should match");
+    TEST_ASSERT(i == 0 || pair->count <= profile.pairs[i - 1].count, "Pairs should be sorted by count");
+    sum += pair->count;
+  }
+  TEST_ASSERT(sum == profile.total, "Pair counts should add up to the total");
+  
+  // Counting still works after sorting, fused opcodes count as their first instruction
+  coil_u32_t fused = 0;
+  TEST_ASSERT(coil_cbc_fuse(code.data, code.size, &fused) == COIL_ERR_GOOD && fused > 0, "The sequence should fuse");
+  coil_u64_t first = profile.pairs[0].count;
+  TEST_ASSERT(coil_cbc_pair_profile_add(&profile, code.data, code.size) == COIL_ERR_GOOD, "Profiling fused code should succeed");
+  TEST_ASSERT(profile.total == 3 * 2999 && profile.pairs[0].count == first / 2 * 3, "Fused code should profile like plain code");
+  
+  TEST_ASSERT(coil_cbc_pair_profile_add(&profile, code.data, code.size - 1) == COIL_ERR_FORMAT, "Malformed code should be rejected");
+  TEST_ASSERT(profile.total == 3 * 2999, "Malformed code should not be counted");
+  TEST_ASSERT(coil_cbc_pair_profile_add(NULL, code.data, code.size) == COIL_ERR_INVAL, "NULL profiles should be rejected");
+  
+  coil_cbc_pair_profile_cleanup(&profile);
+  coil_section_cleanup(&code);
+  return 0;
+}
+
+/**
+* @brief Run all CBC tests
+*/
+int test_cbc() {
+  printf("\nRunning CBC tests...\n");
+  
+  int result = 0;
+  
+  result |= test_cbc_opcodes();
+  result |= test_cbc_encoding();
+  result |= test_cbc_kernels();
+  result |= test_cbc_semantics();
+  result |= test_cbc_faults();
+  result |= test_cbc_fusion();
+  result |= test_cbc_pairs();
+  
+  if (result == 0) {
+    printf("All CBC tests passed!\n");
+  }
+  
+  return result;
+}
@@ -0,0 +1,368 @@
+/**
+* @file test_cfg.c
+* @brief Test suite for control-flow graphs over COIL functions
+*
+* @author Low Level Team
+*/
+
+#include <coil/cfg.h>
+#include <coil/instr.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Test macros
+#define TEST_ASSERT(cond, msg) do { \
+  if (!(cond)) { \
+    printf("ASSERT FAILED: %s (line %d)\n", msg, __LINE__); \
+    return 1; \
+  } \
+} while (0)
+
+#define TEST_CFG_FUNCTIONS 200
+#define TEST_CFG_CHAIN 5000
+
+/**
+* @brief Encode an operand with 4 or 8 bytes of data
+*/
+static void test_cfg_operand(coil_section_t *ir, coil_u8_t type, coil_u8_t value_type, coil_u64_t value) {
+  coil_operand_encode(ir, type, value_type, COIL_MOD_NONE);
+  if (value_type == COIL_VAL_I32 || value_type == COIL_VAL_REG) {
+    coil_u32_t v = (coil_u32_t)value;
+    coil_operand_encode_data(ir, &v, 4);
+  } else {
+    coil_operand_encode_data(ir, &value, 8);
+  }
+}
+
+/**
+* @brief Encode a branch (BR with a flag, JMP or CALL) to a symbol
+*/
+static void test_cfg_branch(coil_section_t *ir, coil_u8_t opcode, coil_u8_t flag, coil_u64_t symbol) {
+  if (opcode == COIL_OP_JMP) {
+    coil_instr_encode(ir, opcode);
+  } else {
+    coil_instrflag_encode(ir, opcode, flag);
+  }
+  test_cfg_operand(ir, COIL_TYPEOP_SYM, COIL_VAL_SYM, symbol);
+}
+
+/**
+* @brief Encode a two-operand instruction on a register and an immediate
+*/
+static void test_cfg_alu(coil_section_t *ir, coil_u8_t opcode, coil_u64_t reg, coil_u64_t imm) {
+  coil_instrflag_encode(ir, opcode, COIL_INSTRFLAG_NONE);
+  test_cfg_operand(ir, COIL_TYPEOP_REG, COIL_VAL_I64, reg);
+  test_cfg_operand(ir, COIL_TYPEOP_IMM, COIL_VAL_I64, imm);
+}
+
+/**
+* @brief Check a block's successors
+*/
+static int test_cfg_succ(const coil_cfg_t *cfg, coil_u32_t b, coil_u32_t count, coil_u32_t s0, coil_u32_t s1) {
+  coil_u32_t first = cfg->succ_index[b];
+  if (cfg->succ_index[b + 1] - first != count) {
+    return 0;
+  }
+  return (count < 1 || cfg->succ[first] == s0) && (count < 2 || cfg->succ[first + 1] == s1);
+}
+
+/**
+* @brief Loop around a diamond, a call, a return and an unreachable tail
+*/
+static int test_cfg_shape() {
+  coil_section_t ir;
+  TEST_ASSERT(coil_section_init(&ir, 256) == COIL_ERR_GOOD, "Section init should succeed");
+  coil_u64_t syms[5];
+  coil_u64_t b3;
+  
+  // B0
+  test_cfg_alu(&ir, COIL_OP_MOV, 1, 0);
+  
+  // B1: loop head, leaves the loop when r1 >= 10
+  syms[0] = ir.size;
+  test_cfg_alu(&ir, COIL_OP_CMP, 1, 10);
+  test_cfg_branch(&ir, COIL_OP_BR, COIL_INSTRFLAG_GTE, 2);
+  
+  // B2: diamond
+  test_cfg_alu(&ir, COIL_OP_CMP, 1, 5);
+  test_cfg_branch(&ir, COIL_OP_BR, COIL_INSTRFLAG_EQ, 1);
+  
+  // B3
+  b3 = ir.size;
+  test_cfg_alu(&ir, COIL_OP_ADD, 1, 2);
+  test_cfg_branch(&ir, COIL_OP_JMP, 0, 3);
+  
+  // B4: the call does not end the block, it falls into B5
+  syms[1] = ir.size;
+  test_cfg_alu(&ir, COIL_OP_ADD, 1, 1);
+  test_cfg_branch(&ir, COIL_OP_CALL, COIL_INSTRFLAG_NONE, 4);
+  
+  // B5: back edge
+  syms[3] = ir.size;
+  test_cfg_branch(&ir, COIL_OP_JMP, 0, 0);
+  
+  // B6
+  syms[2] = ir.size;
+  coil_instr_encode(&ir, COIL_OP_RET);
+  
+  // B7: unreachable, runs off the end
+  coil_instrflag_encode(&ir, COIL_OP_INC, COIL_INSTRFLAG_NONE);
+  test_cfg_operand(&ir, COIL_TYPEOP_REG, COIL_VAL_I64, 1);
+  coil_u64_t size = ir.size;
+  
+  // Callee after the function
+  syms[4] = ir.size;
+  coil_instr_encode(&ir, COIL_OP_RET);
+  
+  coil_cfg_t cfg;
+  TEST_ASSERT(coil_cfg_build(&cfg, &ir, 0, size, syms, 5) == COIL_ERR_GOOD, "Graph should build");
+  TEST_ASSERT(cfg.count == 8, "Function should have eight blocks");
+  TEST_ASSERT(cfg.start[0] == 0 && cfg.start[1] == syms[0] && cfg.start[3] == b3 && cfg.start[4] == syms[1] &&
+              cfg.start[5] == syms[3] && cfg.start[6] == syms[2], "Blocks should start at leaders");
+  TEST_ASSERT(cfg.end[7] == size && cfg.end[2] == b3, "Blocks should end at the next leader");
+  
+  TEST_ASSERT(test_cfg_succ(&cfg, 0, 1, 1, 0), "Entry should fall into the loop head");
+  TEST_ASSERT(test_cfg_succ(&cfg, 1, 2, 6, 2), "Conditional branch lists its target first");
+  TEST_ASSERT(test_cfg_succ(&cfg, 2, 2, 4, 3), "Diamond head should have both arms");
+  TEST_ASSERT(test_cfg_succ(&cfg, 3, 1, 5, 0), "Jump should have one successor");
+  TEST_ASSERT(test_cfg_succ(&cfg, 4, 1, 5, 0), "Call should fall through");
+  TEST_ASSERT(test_cfg_succ(&cfg, 5, 1, 1, 0), "Back edge should reach the loop head");
+  TEST_ASSERT(test_cfg_succ(&cfg, 6, 0, 0, 0) && test_cfg_succ(&cfg, 7, 0, 0, 0), "Exits have no successors");
+  
+  TEST_ASSERT(cfg.pred_index[1 + 1] - cfg.pred_index[1] == 2 && cfg.pred[cfg.pred_index[1]] == 0 &&
+              cfg.pred[cfg.pred_index[1] + 1] == 5, "Loop head should have entry and back edge predecessors");
+  TEST_ASSERT(cfg.pred_index[5 + 1] - cfg.pred_index[5] == 2 && cfg.pred[cfg.pred_index[5]] == 3 &&
+              cfg.pred[cfg.pred_index[5] + 1] == 4, "Diamond join should have both arms in block order");
+  TEST_ASSERT(cfg.pred_index[8] == cfg.succ_index[8], "Every edge should have a predecessor entry");
+  
+  TEST_ASSERT(cfg.flags[6] & COIL_CFG_BLOCK_RETURN, "Return block should be flagged");
+  TEST_ASSERT(cfg.flags[4] & COIL_CFG_BLOCK_CALL, "Call block should be flagged");
+  TEST_ASSERT(cfg.flags[7] & COIL_CFG_BLOCK_EXIT, "Block running off the end should exit");
+  TEST_ASSERT(!(cfg.flags[7] & COIL_CFG_BLOCK_REACHABLE) && (cfg.flags[5] & COIL_CFG_BLOCK_REACHABLE),
+              "Reachability should be flagged");
+  
+  TEST_ASSERT(cfg.rpo_count == 7 && cfg.rpo[0] == 0, "Reverse postorder should start at the entry");
+  TEST_ASSERT(cfg.order[7] == COIL_CFG_NONE, "Unreachable block should not be ordered");
+  TEST_ASSERT(cfg.order[1] < cfg.order[2] && cfg.order[2] < cfg.order[5] && cfg.order[3] < cfg.order[5] &&
+              cfg.order[4] < cfg.order[5], "Blocks should come after their forward predecessors");
+  
+  TEST_ASSERT(cfg.idom[0] == 0 && cfg.idom[1] == 0 && cfg.idom[2] == 1 && cfg.idom[3] == 2 && cfg.idom[4] == 2 &&
+              cfg.idom[5] == 2 && cfg.idom[6] == 1 && cfg.idom[7] == COIL_CFG_NONE, "Immediate dominators");
+  TEST_ASSERT(cfg.dom != NULL, "Small graphs should have dominator bitsets");
+  TEST_ASSERT(coil_cfg_dominates(&cfg, 1, 5) && coil_cfg_dominates(&cfg, 0, 6) && coil_cfg_dominates(&cfg, 2, 2),
+              "Dominance should hold");
+  TEST_ASSERT(!coil_cfg_dominates(&cfg, 3, 5) && !coil_cfg_dominates(&cfg, 5, 1) && !coil_cfg_dominates(&cfg, 0, 7) &&
+              !coil_cfg_dominates(&cfg, 7, 7), "Dominance should not hold");
+  
+  coil_u32_t block;
+  TEST_ASSERT(coil_cfg_block_of(&cfg, b3 + 1, &block) == COIL_ERR_GOOD && block == 3, "Offset should map to its block");
+  TEST_ASSERT(coil_cfg_block_of(&cfg, size - 1, &block) == COIL_ERR_GOOD && block == 7, "Last byte maps to the last block");
+  TEST_ASSERT(coil_cfg_block_of(&cfg, size, &block) == COIL_ERR_NOTFOUND, "Offset past the function is not found");
+  
+  coil_cfg_cleanup(&cfg);
+  coil_section_cleanup(&ir);
+  return 0;
+}
+
+/**
+* @brief Exits, indirect branches and malformed functions
+*/
+static int test_cfg_edges() {
+  coil_section_t ir;
+  TEST_ASSERT(coil_section_init(&ir, 256) == COIL_ERR_GOOD, "Section init should succeed");
+  coil_u64_t syms[3];
+  
+  // B0: conditional branch out of the function, B1: jump through a register
+  syms[0] = ir.size;
+  test_cfg_branch(&ir, COIL_OP_BR, COIL_INSTRFLAG_NEQ, 1);
+  coil_instr_encode(&ir, COIL_OP_JMP);
+  test_cfg_operand(&ir, COIL_TYPEOP_REG, COIL_VAL_REG, 3);
+  coil_u64_t size = ir.size;
+  syms[1] = ir.size;
+  coil_instr_encode(&ir, COIL_OP_RET);
+  
+  coil_cfg_t cfg;
+  TEST_ASSERT(coil_cfg_build(&cfg, &ir, 0, size, syms, 2) == COIL_ERR_GOOD, "Graph should build");
+  TEST_ASSERT(cfg.count == 2, "Function should have two blocks");
+  TEST_ASSERT(test_cfg_succ(&cfg, 0, 1, 1, 0) && (cfg.flags[0] & COIL_CFG_BLOCK_EXIT), "Branch out should exit");
+  TEST_ASSERT(test_cfg_succ(&cfg, 1, 0, 0, 0) && (cfg.flags[1] & COIL_CFG_BLOCK_INDIRECT) &&
+              !(cfg.flags[1] & COIL_CFG_BLOCK_EXIT), "Register jump should be indirect");
+  coil_cfg_cleanup(&cfg);
+  
+  // Unknown symbol
+  TEST_ASSERT(coil_cfg_build(&cfg, &ir, 0, size, syms, 1) == COIL_ERR_FORMAT && cfg.fault == 0,
+              "Unknown symbols should fail at the branch");
+  
+  // Branch into the middle of an instruction
+  syms[1] = 1;
+  TEST_ASSERT(coil_cfg_build(&cfg, &ir, 0, size + 1, syms, 2) == COIL_ERR_FORMAT && cfg.fault == 0,
+              "Branches into an instruction should fail");
+  
+  // Instruction crossing the end of the function
+  TEST_ASSERT(coil_cfg_build(&cfg, &ir, 0, size - 1, syms, 2) == COIL_ERR_FORMAT, "Truncated functions should fail");
+  TEST_ASSERT(coil_cfg_build(&cfg, &ir, 0, ir.size + 1, syms, 2) == COIL_ERR_INVAL, "Functions must stay in the section");
+  TEST_ASSERT(coil_cfg_build(&cfg, &ir, 0, size, NULL, 2) == COIL_ERR_INVAL, "Symbols are needed when counted");
+  
+  // Empty function
+  TEST_ASSERT(coil_cfg_build(&cfg, &ir, 0, 0, NULL, 0) == COIL_ERR_GOOD && cfg.count == 0 && cfg.rpo_count == 0,
+              "Empty functions have no blocks");
+  coil_cfg_cleanup(&cfg);
+  
+  coil_section_cleanup(&ir);
+  return 0;
+}
+
+/**
+* @brief Chains above and below the bitset limit agree on dominance
+*/
+static int test_cfg_chain() {
+  coil_section_t ir;
+  TEST_ASSERT(coil_section_init(&ir, 1 << 16) == COIL_ERR_GOOD, "Section init should succeed");
+  coil_u64_t *syms = (coil_u64_t *)malloc(TEST_CFG_CHAIN * sizeof(coil_u64_t));
+  TEST_ASSERT(syms != NULL, "Allocation should succeed");
+  
+  // Block i branches to i + 1 either way, or skips ahead when i is a multiple of 3
+  for (coil_u32_t i = 0; i < TEST_CFG_CHAIN; i++) {
+    syms[i] = ir.size;
+    coil_u32_t target = i % 3 == 0 && i + 2 < TEST_CFG_CHAIN ? i + 2 : i + 1;
+    test_cfg_branch(&ir, COIL_OP_BR, COIL_INSTRFLAG_LT, target < TEST_CFG_CHAIN ? target : 0);
+  }
+  coil_instr_encode(&ir, COIL_OP_RET);
+  
+  coil_cfg_t small, large;
+  TEST_ASSERT(coil_cfg_build(&small, &ir, 0, syms[100], syms, TEST_CFG_CHAIN) == COIL_ERR_GOOD, "Small chain should build");
+  TEST_ASSERT(coil_cfg_build(&large, &ir, 0, ir.size, syms, TEST_CFG_CHAIN) == COIL_ERR_GOOD, "Large chain should build");
+  TEST_ASSERT(small.dom != NULL && large.dom == NULL, "Only small graphs get bitsets");
+  TEST_ASSERT(large.count == TEST_CFG_CHAIN + 1 && large.rpo_count == large.count, "Every block should be reachable");
+  
+  // A block after a skip is not dominated by the skipped one
+  for (coil_u32_t a = 0; a < 100; a++) {
+    for (coil_u32_t b = 0; b < 100; b++) {
+      int expect = a <= b && (a % 3 != 1 || a == b);
+      TEST_ASSERT(coil_cfg_dominates(&small, a, b) == expect, "Bitset dominance should match the chain");
+      TEST_ASSERT(coil_cfg_dominates(&large, a, b) == expect, "Tree dominance should match the chain");
+    }
+  }
+  TEST_ASSERT(coil_cfg_dominates(&large, 0, TEST_CFG_CHAIN) && !coil_cfg_dominates(&large, TEST_CFG_CHAIN, 0),
+              "Entry should dominate the last block");
+  
+  coil_cfg_cleanup(&small);
+  coil_cfg_cleanup(&large);
+  free(syms);
+  coil_section_cleanup(&ir);
+  return 0;
+}
+
+/**
+* @brief Parallel builds match one-at-a-time builds
+*/
+static int test_cfg_parallel() {
+  coil_section_t ir;
+  TEST_ASSERT(coil_section_init(&ir, 1 << 16) == COIL_ERR_GOOD, "Section init should succeed");
+  
+  coil_lower_func_t funcs[TEST_CFG_FUNCTIONS];
+  coil_u64_t syms[TEST_CFG_FUNCTIONS * 4];
+  coil_u64_t state = 0x9E3779B97F4A7C15ull;
+  
+  // Every function has four labels, branches mostly stay inside it
+  for (int f = 0; f < TEST_CFG_FUNCTIONS; f++) {
+    funcs[f].offset = ir.size;
+    state ^= state << 13; state ^= state >> 7; state ^= state << 17;
+    int length = 4 + (int)(state % (f % 10 == 0 ? 300 : 20));
+    
+    for (int i = 0; i < length; i++) {
+      if (i % (length / 4) == 0 && i / (length / 4) < 4) {
+        syms[f * 4 + i / (length / 4)] = ir.size;
+      }
+      state ^= state << 13; state ^= state >> 7; state ^= state << 17;
+      coil_u64_t label = (coil_u64_t)f * 4 + (state >> 8) % 4;
+      switch ((state >> 16) % 6) {
+        case 0:
+          test_cfg_branch(&ir, COIL_OP_BR, (coil_u8_t)((state >> 24) % 7), (state >> 28) % 64 == 0 ? 0 : label);
+          break;
+        case 1:
+          test_cfg_branch(&ir, COIL_OP_JMP, 0, label);
+          break;
+        case 2:
+          test_cfg_branch(&ir, COIL_OP_CALL, COIL_INSTRFLAG_NONE, (state >> 24) % (TEST_CFG_FUNCTIONS * 4));
+          break;
+        case 3:
+          coil_instr_encode(&ir, COIL_OP_RET);
+          break;
+        default:
+          test_cfg_alu(&ir, COIL_OP_ADD, (state >> 24) % 16, state >> 32);
+          break;
+      }
+    }
+    funcs[f].size = ir.size - funcs[f].offset;
+  }
+  
+  coil_cfg_t *parallel = (coil_cfg_t *)malloc(TEST_CFG_FUNCTIONS * sizeof(coil_cfg_t));
+  TEST_ASSERT(parallel != NULL, "Allocation should succeed");
+  TEST_ASSERT(coil_cfg_build_all(parallel, &ir, funcs, TEST_CFG_FUNCTIONS, syms, TEST_CFG_FUNCTIONS * 4, 4, NULL) ==
+              COIL_ERR_GOOD, "Parallel build should succeed");
+  
+  for (int f = 0; f < TEST_CFG_FUNCTIONS; f++) {
+    coil_cfg_t serial;
+    const coil_cfg_t *p = &parallel[f];
+    TEST_ASSERT(coil_cfg_build(&serial, &ir, funcs[f].offset, funcs[f].size, syms, TEST_CFG_FUNCTIONS * 4) ==
+                COIL_ERR_GOOD, "Serial build should succeed");
+    TEST_ASSERT(p->count == serial.count && p->rpo_count == serial.rpo_count, "Block counts should match");
+    TEST_ASSERT(memcmp(p->start, serial.start, serial.count * sizeof(coil_u64_t)) == 0 &&
+                memcmp(p->flags, serial.flags, serial.count) == 0 &&
+                memcmp(p->succ_index, serial.succ_index, (serial.count + 1) * sizeof(coil_u32_t)) == 0 &&
+                memcmp(p->succ, serial.succ, serial.succ_index[serial.count] * sizeof(coil_u32_t)) == 0 &&
+                memcmp(p->idom, serial.idom, serial.count * sizeof(coil_u32_t)) == 0, "Graphs should match");
+    
+    // Every reachable block's immediate dominator dominates it
+    for (coil_u32_t b = 0; b < serial.count; b++) {
+      if (serial.idom[b] != COIL_CFG_NONE) {
+        TEST_ASSERT(coil_cfg_dominates(&serial, serial.idom[b], b), "Immediate dominator should dominate");
+        TEST_ASSERT(coil_cfg_dominates(&serial, 0, b), "Entry should dominate reachable blocks");
+      }
+    }
+    coil_cfg_cleanup(&serial);
+    coil_cfg_cleanup(&parallel[f]);
+  }
+  
+  // A bad symbol in one function fails the whole build, reported in function order
+  coil_u64_t fault = 0;
+  TEST_ASSERT(coil_cfg_build_all(parallel, &ir, funcs, TEST_CFG_FUNCTIONS, syms, 1, 4, &fault) == COIL_ERR_FORMAT,
+              "Unknown symbols should fail the build");
+  coil_u64_t expect = 0;
+  for (int f = 0; f < TEST_CFG_FUNCTIONS; f++) {
+    coil_cfg_t serial;
+    if (coil_cfg_build(&serial, &ir, funcs[f].offset, funcs[f].size, syms, 1) != COIL_ERR_GOOD) {
+      expect = serial.fault;
+      break;
+    }
+    coil_cfg_cleanup(&serial);
+  }
+  TEST_ASSERT(fault == expect, "Fault should be in the first failing function");
+  TEST_ASSERT(parallel[TEST_CFG_FUNCTIONS - 1].start == NULL, "Nothing should be kept on failure");
+  
+  free(parallel);
+  coil_section_cleanup(&ir);
+  return 0;
+}
+
+/**
+* @brief Run all control-flow graph tests
+*/
+int test_cfg() {
+  printf("\nRunning control-flow graph tests...\n");
+  
+  int result = 0;
+  
+  result |= test_cfg_shape();
+  result |= test_cfg_edges();
+  result |= test_cfg_chain();
+  result |= test_cfg_parallel();
+  
+  if (result == 0) {
+    printf("All control-flow graph tests passed!\n");
+  }
+  
+  return result;
+}
@@ -0,0 +1,326 @@
+/**
+* @file test_dflow.c
+* @brief Test suite for bitset dataflow and variable liveness
+*
+* @author Low Level Team
+*/
+
+#include <coil/dflow.h>
+#include <coil/instr.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Test macros
+#define TEST_ASSERT(cond, msg) do { \
+  if (!(cond)) { \
+    printf("ASSERT FAILED: %s (line %d)\n", msg, __LINE__); \
+    return 1; \
+  } \
+} while (0)
+
+#define TEST_DFLOW_WORDS 37
+#define TEST_DFLOW_BLOCKS 400
+#define TEST_DFLOW_DEFS 75
+
+/**
+* @brief Encode an operand with 8 bytes of data
+*/
+static void test_dflow_operand(coil_section_t *ir, coil_u8_t type, coil_u64_t value) {
+  coil_operand_encode(ir, type, COIL_VAL_I64, COIL_MOD_NONE);
+  coil_operand_encode_data(ir, &value, 8);
+}
+
+/**
+* @brief Encode a two-operand instruction
+*/
+static void test_dflow_binary(coil_section_t *ir, coil_u8_t opcode, coil_u8_t flag,
+                              coil_u8_t type0, coil_u64_t value0, coil_u8_t type1, coil_u64_t value1) {
+  coil_instrflag_encode(ir, opcode, flag);
+  test_dflow_operand(ir, type0, value0);
+  test_dflow_operand(ir, type1, value1);
+}
+
+/**
+* @brief Encode a branch (BR with a flag or JMP) to a symbol
+*/
+static void test_dflow_branch(coil_section_t *ir, coil_u8_t opcode, coil_u8_t flag, coil_u64_t symbol) {
+  if (opcode == COIL_OP_JMP) {
+    coil_instr_encode(ir, opcode);
+  } else {
+    coil_instrflag_encode(ir, opcode, flag);
+  }
+  coil_operand_encode(ir, COIL_TYPEOP_SYM, COIL_VAL_SYM, COIL_MOD_NONE);
+  coil_operand_encode_data(ir, &symbol, 8);
+}
+
+/**
+* @brief Kernels match word-at-a-time references at every length
+*/
+static int test_dflow_kernels() {
+  coil_u64_t a[TEST_DFLOW_WORDS], b[TEST_DFLOW_WORDS], c[TEST_DFLOW_WORDS];
+  coil_u64_t dst[TEST_DFLOW_WORDS], expect[TEST_DFLOW_WORDS];
+  coil_u64_t state = 0x9E3779B97F4A7C15ull;
+  
+  for (int i = 0; i < TEST_DFLOW_WORDS; i++) {
+    state ^= state << 13; state ^= state >> 7; state ^= state << 17;
+    a[i] = state;
+    state ^= state << 13; state ^= state >> 7; state ^= state << 17;
+    b[i] = state;
+    state ^= state << 13; state ^= state >> 7; state ^= state << 17;
+    c[i] = state;
+  }
+  
+  for (coil_size_t words = 0; words <= TEST_DFLOW_WORDS; words++) {
+    for (int op = 0; op < 4; op++) {
+      for (coil_size_t i = 0; i < words; i++) {
+        switch (op) {
+          case 0: expect[i] = a[i] | b[i]; break;
+          case 1: expect[i] = a[i] & b[i]; break;
+          case 2: expect[i] = a[i] & ~b[i]; break;
+          default: expect[i] = c[i] | (a[i] & ~b[i]); break;
+        }
+      }
+      
+      // Fresh destination changes (unless empty), a second run over the result does not
+      for (int pass = 0; pass < 2; pass++) {
+        if (pass == 0) {
+          memset(dst, 0, sizeof(dst));
+        }
+        int changed;
+        switch (op) {
+          case 0: changed = coil_dflow_union(dst, a, b, words); break;
+          case 1: changed = coil_dflow_intersect(dst, a, b, words); break;
+          case 2: changed = coil_dflow_diff(dst, a, b, words); break;
+          default: changed = coil_dflow_transfer(dst, c, a, b, words); break;
+        }
+        TEST_ASSERT(memcmp(dst, expect, words * sizeof(coil_u64_t)) == 0, "Kernel should match the reference");
+        TEST_ASSERT(changed == (pass == 0 && words > 0), "Kernel should report changes");
+      }
+    }
+    
+    // Destination may be an operand
+    memcpy(dst, a, sizeof(dst));
+    coil_dflow_union(dst, dst, b, words);
+    for (coil_size_t i = 0; i < words; i++) {
+      TEST_ASSERT(dst[i] == (a[i] | b[i]), "Union in place should match");
+    }
+  }
+  
+  printf("  Bitset kernels: %s\n", coil_dflow_simd() ? "AVX2" : "scalar");
+  return 0;
+}
+
+/**
+* @brief Forward union and intersection over a diamond with a self loop
+*/
+static int test_dflow_problems() {
+  coil_section_t ir;
+  TEST_ASSERT(coil_section_init(&ir, 256) == COIL_ERR_GOOD, "Section init should succeed");
+  coil_u64_t syms[2];
+  
+  // B0 -> B2, B1; B1 -> B3; B2 -> B3; B3 -> B3, B4
+  test_dflow_branch(&ir, COIL_OP_BR, COIL_INSTRFLAG_EQ, 0);
+  test_dflow_branch(&ir, COIL_OP_JMP, 0, 1);
+  syms[0] = ir.size;
+  coil_instr_encode(&ir, COIL_OP_NOP);
+  syms[1] = ir.size;
+  test_dflow_branch(&ir, COIL_OP_BR, COIL_INSTRFLAG_LT, 1);
+  coil_instr_encode(&ir, COIL_OP_RET);
+  
+  coil_cfg_t cfg;
+  TEST_ASSERT(coil_cfg_build(&cfg, &ir, 0, ir.size, syms, 2) == COIL_ERR_GOOD, "Graph should build");
+  TEST_ASSERT(cfg.count == 5, "Function should have five blocks");
+  
+  for (int meet = COIL_DFLOW_UNION; meet <= COIL_DFLOW_INTERSECT; meet++) {
+    coil_dflow_t flow;
+    TEST_ASSERT(coil_dflow_init(&flow, &cfg, 70, COIL_DFLOW_FORWARD, (coil_dflow_meet_t)meet, COIL_DFLOW_AUTO) ==
+                COIL_ERR_GOOD, "Problem should initialize");
+    coil_dflow_add(&flow, COIL_DFLOW_GEN, 0, 3);
+    coil_dflow_add(&flow, COIL_DFLOW_GEN, 0, 69);
+    coil_dflow_add(&flow, COIL_DFLOW_GEN, 1, 0);
+    coil_dflow_add(&flow, COIL_DFLOW_GEN, 1, 1);
+    coil_dflow_add(&flow, COIL_DFLOW_GEN, 2, 1);
+    coil_dflow_add(&flow, COIL_DFLOW_GEN, 2, 2);
+    coil_dflow_add(&flow, COIL_DFLOW_KILL, 2, 3);
+    coil_dflow_add(&flow, COIL_DFLOW_GEN, 3, 5);
+    TEST_ASSERT(coil_dflow_add(&flow, COIL_DFLOW_GEN, 3, 70) == COIL_ERR_INVAL, "Facts are bounded");
+    TEST_ASSERT(coil_dflow_add(&flow, COIL_DFLOW_IN, 3, 1) == COIL_ERR_INVAL, "Only gen and kill are added");
+    TEST_ASSERT(coil_dflow_solve(&flow) == COIL_ERR_GOOD, "Problem should solve");
+    
+    if (meet == COIL_DFLOW_UNION) {
+      TEST_ASSERT(coil_dflow_has(&flow, COIL_DFLOW_IN, 3, 0) && coil_dflow_has(&flow, COIL_DFLOW_IN, 3, 2) &&
+                  coil_dflow_has(&flow, COIL_DFLOW_IN, 3, 3) && coil_dflow_has(&flow, COIL_DFLOW_IN, 3, 5),
+                  "Union should collect facts along any path");
+    } else {
+      // The self loop does not lose facts: its edge starts out full
+      TEST_ASSERT(coil_dflow_has(&flow, COIL_DFLOW_IN, 3, 1) && coil_dflow_has(&flow, COIL_DFLOW_IN, 3, 69) &&
+                  !coil_dflow_has(&flow, COIL_DFLOW_IN, 3, 0) && !coil_dflow_has(&flow, COIL_DFLOW_IN, 3, 3) &&
+                  !coil_dflow_has(&flow, COIL_DFLOW_IN, 3, 5), "Intersection should keep facts along every path");
+      TEST_ASSERT(!coil_dflow_has(&flow, COIL_DFLOW_IN, 0, 3), "Entry should start empty");
+    }
+    TEST_ASSERT(coil_dflow_has(&flow, COIL_DFLOW_OUT, 4, 1) && coil_dflow_has(&flow, COIL_DFLOW_OUT, 4, 5),
+                "Facts should reach the exit");
+    
+    coil_u32_t fact;
+    TEST_ASSERT(coil_dflow_next(&flow, COIL_DFLOW_OUT, 4, 2, &fact) && fact == (meet == COIL_DFLOW_UNION ? 2u : 5u),
+                "Next should find the following fact");
+    TEST_ASSERT(coil_dflow_next(&flow, COIL_DFLOW_OUT, 4, 69, &fact) && fact == 69, "Last fact should be found");
+    coil_dflow_cleanup(&flow);
+  }
+  
+  coil_dflow_t flow;
+  TEST_ASSERT(coil_dflow_init(&flow, &cfg, 8, COIL_DFLOW_FORWARD, COIL_DFLOW_INTERSECT, COIL_DFLOW_SPARSE) ==
+              COIL_ERR_NOTSUP, "Sparse intersection is not supported");
+  
+  coil_cfg_cleanup(&cfg);
+  coil_section_cleanup(&ir);
+  return 0;
+}
+
+/**
+* @brief Liveness of a counting loop
+*/
+static int test_dflow_live() {
+  coil_section_t ir;
+  TEST_ASSERT(coil_section_init(&ir, 512) == COIL_ERR_GOOD, "Section init should succeed");
+  coil_u64_t syms[2];
+  
+  // B0: v1 = 0, v2 = 10, v5 = 1 if equal
+  test_dflow_binary(&ir, COIL_OP_MOV, COIL_INSTRFLAG_NONE, COIL_TYPEOP_VAR, 1, COIL_TYPEOP_IMM, 0);
+  test_dflow_binary(&ir, COIL_OP_MOV, COIL_INSTRFLAG_NONE, COIL_TYPEOP_VAR, 2, COIL_TYPEOP_IMM, 10);
+  test_dflow_binary(&ir, COIL_OP_MOV, COIL_INSTRFLAG_EQ, COIL_TYPEOP_VAR, 5, COIL_TYPEOP_IMM, 1);
+  
+  // B1: loop head
+  syms[0] = ir.size;
+  test_dflow_binary(&ir, COIL_OP_CMP, COIL_INSTRFLAG_NONE, COIL_TYPEOP_VAR, 1, COIL_TYPEOP_VAR, 2);
+  test_dflow_branch(&ir, COIL_OP_BR, COIL_INSTRFLAG_GTE, 1);
+  
+  // B2: v1 += v3, v4 = v1 (never read)
+  test_dflow_binary(&ir, COIL_OP_ADD, COIL_INSTRFLAG_NONE, COIL_TYPEOP_VAR, 1, COIL_TYPEOP_VAR, 3);
+  test_dflow_binary(&ir, COIL_OP_MOV, COIL_INSTRFLAG_NONE, COIL_TYPEOP_VAR, 4, COIL_TYPEOP_VAR, 1);
+  test_dflow_branch(&ir, COIL_OP_JMP, 0, 0);
+  
+  // B3: push v1 and v5
+  syms[1] = ir.size;
+  coil_instrflag_encode(&ir, COIL_OP_PUSH, COIL_INSTRFLAG_NONE);
+  test_dflow_operand(&ir, COIL_TYPEOP_VAR, 1);
+  coil_instrflag_encode(&ir, COIL_OP_PUSH, COIL_INSTRFLAG_NONE);
+  test_dflow_operand(&ir, COIL_TYPEOP_VAR, 5);
+  coil_instr_encode(&ir, COIL_OP_RET);
+  
+  coil_cfg_t cfg;
+  TEST_ASSERT(coil_cfg_build(&cfg, &ir, 0, ir.size, syms, 2) == COIL_ERR_GOOD, "Graph should build");
+  TEST_ASSERT(cfg.count == 4, "Function should have four blocks");
+  
+  for (int rep = COIL_DFLOW_DENSE; rep <= COIL_DFLOW_SPARSE; rep++) {
+    coil_live_t live;
+    TEST_ASSERT(coil_live_build(&live, &cfg, &ir, (coil_dflow_rep_t)rep) == COIL_ERR_GOOD, "Liveness should build");
+    TEST_ASSERT(live.var_count == 5 && live.vars[0] == 1 && live.vars[4] == 5, "Variables should be indexed");
+    TEST_ASSERT(live.flow.sparse == (rep == COIL_DFLOW_SPARSE), "Representation should follow the request");
+    
+    TEST_ASSERT(coil_live_in(&live, 0, 3) && coil_live_in(&live, 0, 5) && !coil_live_in(&live, 0, 1) &&
+                !coil_live_in(&live, 0, 2), "Entry should need v3 and the conditionally written v5");
+    TEST_ASSERT(coil_live_out(&live, 0, 1) && coil_live_out(&live, 0, 2) && coil_live_out(&live, 0, 3),
+                "Loop inputs should be live into the loop");
+    TEST_ASSERT(coil_live_in(&live, 2, 1) && coil_live_in(&live, 2, 2) && coil_live_in(&live, 2, 3),
+                "Loop body should need the counter, bound and step");
+    TEST_ASSERT(!coil_live_out(&live, 2, 4) && !coil_live_in(&live, 1, 4), "Dead variable should never be live");
+    TEST_ASSERT(coil_live_in(&live, 3, 1) && !coil_live_in(&live, 3, 2) && !coil_live_out(&live, 3, 1),
+                "Exit should need only what it pushes");
+    TEST_ASSERT(!coil_live_in(&live, 3, 99), "Unknown variables are not live");
+    
+    coil_u32_t fact;
+    TEST_ASSERT(coil_live_index(&live, 99, &fact) == COIL_ERR_NOTFOUND, "Unknown variables have no index");
+    coil_live_cleanup(&live);
+  }
+  
+  coil_cfg_cleanup(&cfg);
+  coil_section_cleanup(&ir);
+  return 0;
+}
+
+/**
+* @brief Tens of thousands of variables give the same liveness dense and sparse
+*/
+static int test_dflow_large() {
+  coil_section_t ir;
+  TEST_ASSERT(coil_section_init(&ir, 1 << 20) == COIL_ERR_GOOD, "Section init should succeed");
+  coil_u64_t syms[TEST_DFLOW_BLOCKS];
+  coil_u64_t vars = (coil_u64_t)TEST_DFLOW_BLOCKS * TEST_DFLOW_DEFS;
+  
+  // Block i writes its own variables and reads some written further on, every 50th loops back
+  for (coil_u64_t i = 0; i < TEST_DFLOW_BLOCKS; i++) {
+    syms[i] = ir.size;
+    for (coil_u64_t k = 0; k < TEST_DFLOW_DEFS; k++) {
+      test_dflow_binary(&ir, COIL_OP_MOV, COIL_INSTRFLAG_NONE, COIL_TYPEOP_VAR, i * TEST_DFLOW_DEFS + k,
+                        COIL_TYPEOP_IMM, k);
+    }
+    for (coil_u64_t k = 0; k < 8; k++) {
+      test_dflow_binary(&ir, COIL_OP_ADD, COIL_INSTRFLAG_NONE, COIL_TYPEOP_REG, 1,
+                        COIL_TYPEOP_VAR, (i * 7919 + k * 104729) % vars);
+    }
+    if (i % 50 == 49) {
+      test_dflow_branch(&ir, COIL_OP_BR, COIL_INSTRFLAG_NEQ, i - 30);
+    }
+  }
+  coil_instr_encode(&ir, COIL_OP_RET);
+  
+  coil_cfg_t cfg;
+  TEST_ASSERT(coil_cfg_build(&cfg, &ir, 0, ir.size, syms, TEST_DFLOW_BLOCKS) == COIL_ERR_GOOD, "Graph should build");
+  
+  coil_live_t dense, sparse;
+  TEST_ASSERT(coil_live_build(&dense, &cfg, &ir, COIL_DFLOW_AUTO) == COIL_ERR_GOOD, "Dense liveness should build");
+  TEST_ASSERT(coil_live_build(&sparse, &cfg, &ir, COIL_DFLOW_SPARSE) == COIL_ERR_GOOD, "Sparse liveness should build");
+  TEST_ASSERT(!dense.flow.sparse && dense.var_count == vars, "Every variable should be indexed");
+  
+  coil_u64_t live_out = 0;
+  for (coil_u32_t b = 0; b < cfg.count; b++) {
+    for (int set = COIL_DFLOW_GEN; set <= COIL_DFLOW_OUT; set++) {
+      coil_u32_t x = 0, y = 0;
+      int more_x = coil_dflow_next(&dense.flow, (coil_dflow_set_t)set, b, 0, &x);
+      int more_y = coil_dflow_next(&sparse.flow, (coil_dflow_set_t)set, b, 0, &y);
+      while (more_x && more_y && x == y) {
+        live_out += set == COIL_DFLOW_OUT;
+        more_x = x + 1 < vars && coil_dflow_next(&dense.flow, (coil_dflow_set_t)set, b, x + 1, &x);
+        more_y = y + 1 < vars && coil_dflow_next(&sparse.flow, (coil_dflow_set_t)set, b, y + 1, &y);
+      }
+      TEST_ASSERT(!more_x && !more_y, "Dense and sparse sets should match");
+    }
+  }
+  TEST_ASSERT(live_out > 0, "Some variables should be live across blocks");
+  
+  // A variable read in block 0 and written in block 399 is live from the entry to the read only
+  coil_u64_t late = 7 * 104729 % vars;
+  coil_u32_t owner = (coil_u32_t)(late / TEST_DFLOW_DEFS);
+  coil_u32_t block;
+  TEST_ASSERT(coil_cfg_block_of(&cfg, syms[owner], &block) == COIL_ERR_GOOD, "Owner block should exist");
+  TEST_ASSERT(coil_live_in(&dense, 0, late) && coil_live_in(&sparse, 0, late), "Read before write is live at entry");
+  TEST_ASSERT(dense.flow.visits >= cfg.rpo_count, "Every reachable block should be visited");
+  
+  coil_live_cleanup(&dense);
+  coil_live_cleanup(&sparse);
+  coil_cfg_cleanup(&cfg);
+  coil_section_cleanup(&ir);
+  return 0;
+}
+
+/**
+* @brief Run all dataflow tests
+*/
+int test_dflow() {
+  printf("\nRunning dataflow tests...\n");
+  
+  int result = 0;
+  
+  result |= test_dflow_kernels();
+  result |= test_dflow_problems();
+  result |= test_dflow_live();
+  result |= test_dflow_large();
+  
+  if (result == 0) {
+    printf("All dataflow tests passed!\n");
+  }
+  
+  return result;
+}
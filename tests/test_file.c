@@ -21,6 +21,7 @@
 } while (0)
 
 #define TEST_FILE_PATH "test_file.dat"
+#define TEST_FILE_COPY_PATH "test_file_copy.dat"
 
 /**
 * @brief Test file open and close
@@ -107,6 +108,45 @@ static int test_file_seek() {
   return 0;
 }
 
+/**
+* @brief Test copying a range between descriptors
+*/
+static int test_file_copy_range() {
+  printf("  Testing file range copy...\n");
+  
+  coil_descriptor_t in = open(TEST_FILE_PATH, O_RDWR | O_CREAT | O_TRUNC, 0644);
+  TEST_ASSERT(in >= 0, "File open should succeed");
+  
+  // Larger than the fallback buffer so every path needs more than one round
+  static char data[200 * 1024];
+  for (size_t i = 0; i < sizeof(data); i++) {
+    data[i] = (char)('a' + i % 26);
+  }
+  TEST_ASSERT(write(in, data, sizeof(data)) == (ssize_t)sizeof(data), "Write should succeed");
+  TEST_ASSERT(coil_seek(in, 7, SEEK_SET) == COIL_ERR_GOOD, "Seek should succeed");
+  
+  coil_descriptor_t out = open(TEST_FILE_COPY_PATH, O_RDWR | O_CREAT | O_TRUNC, 0644);
+  TEST_ASSERT(out >= 0, "File open should succeed");
+  TEST_ASSERT(write(out, "hdr", 3) == 3, "Write should succeed");
+  
+  coil_size_t len = sizeof(data) - 100;
+  TEST_ASSERT(coil_copy_range(in, 100, out, len) == COIL_ERR_GOOD, "Copying a range should succeed");
+  TEST_ASSERT(lseek(out, 0, SEEK_CUR) == (off_t)(3 + len), "Output position should advance");
+  TEST_ASSERT(lseek(in, 0, SEEK_CUR) == 7, "Input position should be left alone");
+  
+  static char check[200 * 1024];
+  TEST_ASSERT(pread(out, check, len, 3) == (ssize_t)len, "Reading the copy should succeed");
+  TEST_ASSERT(memcmp(check, data + 100, len) == 0, "Copied data should match");
+  
+  TEST_ASSERT(coil_copy_range(in, 0, -1, 1) == COIL_ERR_INVAL, "Invalid descriptors should be rejected");
+  
+  coil_close(in);
+  coil_close(out);
+  unlink(TEST_FILE_COPY_PATH);
+  
+  return 0;
+}
+
 /**
 * @brief Run all file I/O tests
 */
@@ -119,6 +159,7 @@ int test_file() {
   result |= test_file_open_close();
   result |= test_file_read_write();
   result |= test_file_seek();
+  result |= test_file_copy_range();
   
   // Clean up test file
   unlink(TEST_FILE_PATH);
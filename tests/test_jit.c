@@ -0,0 +1,528 @@
+/**
+* @file test_jit.c
+* @brief Test suite for the CBC template JIT
+*
+* @author Low Level Team
+*/
+
+#include <coil/jit.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Test macros
+#define TEST_ASSERT(cond, msg) do { \
+  if (!(cond)) { \
+    printf("ASSERT FAILED: %s (line %d)\n", msg, __LINE__); \
+    return 1; \
+  } \
+} while (0)
+
+#define TEST_JIT_EMIT0(op) \
+  TEST_ASSERT(coil_cbc_encode(&code, op, COIL_INSTRFLAG_NONE, NULL, NULL) == COIL_ERR_GOOD, "Encoding " #op " should succeed")
+#define TEST_JIT_EMIT1(op, x) do { \
+  coil_cbc_operand_t a_ = x; \
+  TEST_ASSERT(coil_cbc_encode(&code, op, COIL_INSTRFLAG_NONE, &a_, NULL) == COIL_ERR_GOOD, "Encoding " #op " should succeed"); \
+} while (0)
+#define TEST_JIT_EMIT2(op, x, y) do { \
+  coil_cbc_operand_t a_ = x, b_ = y; \
+  TEST_ASSERT(coil_cbc_encode(&code, op, COIL_INSTRFLAG_NONE, &a_, &b_) == COIL_ERR_GOOD, "Encoding " #op " should succeed"); \
+} while (0)
+#define TEST_JIT_BR(cond, label) do { \
+  coil_cbc_operand_t a_ = coil_cbc_sym(label); \
+  TEST_ASSERT(coil_cbc_encode(&code, COIL_COP_BRqS, cond, &a_, NULL) == COIL_ERR_GOOD, "Encoding BR should succeed"); \
+} while (0)
+#define TEST_JIT_LABEL(label) (syms[label] = code.size)
+
+#define TEST_JIT_DEPTH 64
+#define TEST_JIT_MEMORY 256
+#define TEST_JIT_PROGRAMS 1000
+#define TEST_JIT_LENGTH 48
+
+#if defined(__x86_64__)
+#define TEST_JIT_NATIVE 1
+#else
+#define TEST_JIT_NATIVE 0
+#endif
+
+/**
+* @brief Whether two finished runs left the same state behind
+*/
+static int test_jit_same(const coil_cbc_vm_t *x, const coil_cbc_vm_t *y, coil_err_t status, coil_size_t size) {
+  if (memcmp(x->regs, y->regs, sizeof(x->regs)) != 0 || x->flags != y->flags || x->sp != y->sp || x->csp != y->csp) {
+    return 0;
+  }
+  if (x->sp != 0 && memcmp(x->stack, y->stack, x->sp * sizeof(coil_cbc_value_t)) != 0) {
+    return 0;
+  }
+  if (size != 0 && memcmp(x->memory, y->memory, size) != 0) {
+    return 0;
+  }
+  return status == COIL_ERR_GOOD || x->fault == y->fault;
+}
+
+/**
+* @brief Run a program compiled, under the reference evaluator and (without a budget) interpreted
+*
+* The compiled run works on memory, the others on copies. Everything the
+* runs leave behind must match; the compiled state is returned (the
+* evaluated one on hosts without the JIT).
+*/
+static coil_err_t test_jit_execute(const coil_section_t *code, const coil_u64_t *syms, coil_u32_t symcount, coil_u64_t entry,
+                                   coil_byte_t *memory, coil_size_t size, const coil_cbc_value_t *regs,
+                                   coil_u64_t max_branches, coil_cbc_vm_t *out) {
+  coil_byte_t *copies = (coil_byte_t *)malloc(size * 2 + 1);
+  if (size != 0) {
+    memcpy(copies, memory, size);
+    memcpy(copies + size, memory, size);
+  }
+  
+  coil_cbc_vm_t native, evaluated, interpreted;
+  coil_cbc_vm_init(&native, memory, size, TEST_JIT_DEPTH);
+  coil_cbc_vm_init(&evaluated, copies, size, TEST_JIT_DEPTH);
+  coil_cbc_vm_init(&interpreted, copies + size, size, TEST_JIT_DEPTH);
+  if (regs != NULL) {
+    memcpy(native.regs, regs, sizeof(native.regs));
+    memcpy(evaluated.regs, regs, sizeof(evaluated.regs));
+    memcpy(interpreted.regs, regs, sizeof(interpreted.regs));
+  }
+  
+  coil_err_t err = coil_jit_eval(&evaluated, code->data, code->size, syms, symcount, entry, max_branches);
+  coil_cbc_vm_t *result = &evaluated;
+  
+  coil_jit_t jit;
+  coil_err_t compiled = coil_jit_compile(&jit, code->data, code->size, syms, symcount);
+  if (!TEST_JIT_NATIVE) {
+    if (compiled != COIL_ERR_NOTSUP) {
+      printf("The JIT should not compile for this host\n");
+      err = COIL_ERR_UNKNOWN;
+    }
+    if (size != 0) {
+      memcpy(memory, copies, size);
+    }
+  } else if (compiled != COIL_ERR_GOOD) {
+    if (compiled != err) {
+      printf("The JIT and the evaluator reject differently\n");
+      err = COIL_ERR_UNKNOWN;
+    }
+  } else {
+    coil_err_t status = coil_jit_run(&jit, &native, entry, max_branches);
+    if (status != err || !test_jit_same(&native, &evaluated, status, size)) {
+      printf("Compiled and evaluated runs disagree\n");
+      err = COIL_ERR_UNKNOWN;
+    }
+    result = &native;
+    coil_jit_cleanup(&jit);
+  }
+  
+  // The interpreter counts instructions rather than branches, only unbudgeted runs compare
+  coil_cbc_program_t prog;
+  if (max_branches == 0 && (err == COIL_ERR_GOOD || err == COIL_ERR_BADSTATE) &&
+      coil_cbc_program_init(&prog, code->data, code->size, syms, symcount) == COIL_ERR_GOOD) {
+    coil_err_t status = coil_cbc_run_switch(&interpreted, &prog, entry, 0);
+    if (status != err || !test_jit_same(&interpreted, &evaluated, status, size)) {
+      printf("Interpreted and evaluated runs disagree\n");
+      err = COIL_ERR_UNKNOWN;
+    }
+    coil_cbc_program_cleanup(&prog);
+  }
+  
+  *out = *result;
+  out->stack = NULL;
+  out->calls = NULL;
+  out->memory = NULL;
+  
+  coil_cbc_vm_cleanup(&native);
+  coil_cbc_vm_cleanup(&evaluated);
+  coil_cbc_vm_cleanup(&interpreted);
+  free(copies);
+  return err;
+}
+
+/**
+* @brief Test small kernels compiled
+*/
+static int test_jit_kernels() {
+  printf("  Testing JIT kernels...\n");
+  
+  coil_section_t code;
+  coil_u64_t syms[4];
+  coil_cbc_vm_t vm;
+  
+  // Sum of 1..1000
+  TEST_ASSERT(coil_section_init(&code, 64) == COIL_ERR_GOOD, "Section init should succeed");
+  TEST_JIT_EMIT2(COIL_COP_MOVqRI, coil_cbc_reg(0), coil_cbc_imm(0));
+  TEST_JIT_EMIT2(COIL_COP_MOVqRI, coil_cbc_reg(1), coil_cbc_imm(1000));
+  TEST_JIT_LABEL(0);
+  TEST_JIT_EMIT2(COIL_COP_ADDqRR, coil_cbc_reg(0), coil_cbc_reg(1));
+  TEST_JIT_EMIT2(COIL_COP_DECqRR, coil_cbc_reg(1), coil_cbc_reg(1));
+  TEST_JIT_EMIT2(COIL_COP_CMPqRI, coil_cbc_reg(1), coil_cbc_imm(0));
+  TEST_JIT_BR(COIL_INSTRFLAG_GT, 0);
+  TEST_JIT_EMIT0(COIL_COP_RET);
+  
+  TEST_ASSERT(test_jit_execute(&code, syms, 1, 0, NULL, 0, NULL, 0, &vm) == COIL_ERR_GOOD, "The sum kernel should run");
+  TEST_ASSERT(vm.regs[0].lo == 500500 && vm.regs[0].hi == 0, "The sum kernel should compute 500500");
+  TEST_ASSERT(vm.regs[1].lo == 0 && vm.flags == COIL_CBC_FLAG_EQ, "The loop should end on equality");
+  TEST_ASSERT(test_jit_execute(&code, syms, 1, 0, NULL, 0, NULL, 999, &vm) == COIL_ERR_GOOD, "999 taken branches should be enough");
+  TEST_ASSERT(test_jit_execute(&code, syms, 1, 0, NULL, 0, NULL, 998, &vm) == COIL_ERR_BADSTATE, "998 taken branches should not be enough");
+  TEST_ASSERT(vm.fault == 41, "The budget should stop at the branch");
+  coil_section_cleanup(&code);
+  
+  // Bubble sort of signed 32-bit values
+  coil_i32_t values[16] = { 5, -3, 12, 0, -7, 99, 42, -100, 8, 8, 1, -1, 77, -55, 3, 2 };
+  TEST_ASSERT(coil_section_init(&code, 64) == COIL_ERR_GOOD, "Section init should succeed");
+  syms[0] = 0;
+  TEST_JIT_EMIT2(COIL_COP_MOVqRI, coil_cbc_reg(1), coil_cbc_imm(15));
+  TEST_JIT_LABEL(1);
+  TEST_JIT_EMIT2(COIL_COP_LEAqRS, coil_cbc_reg(2), coil_cbc_sym(0));
+  TEST_JIT_EMIT2(COIL_COP_MOVqRR, coil_cbc_reg(3), coil_cbc_reg(1));
+  TEST_JIT_LABEL(2);
+  TEST_JIT_EMIT2(COIL_COP_MOVlROR, coil_cbc_reg(4), coil_cbc_mem_reg(2, 0));
+  TEST_JIT_EMIT2(COIL_COP_MOVlROR, coil_cbc_reg(5), coil_cbc_mem_reg(2, 4));
+  TEST_JIT_EMIT2(COIL_COP_CMPlRR, coil_cbc_reg(4), coil_cbc_reg(5));
+  TEST_JIT_BR(COIL_INSTRFLAG_LTE, 3);
+  TEST_JIT_EMIT2(COIL_COP_MOVlORR, coil_cbc_mem_reg(2, 0), coil_cbc_reg(5));
+  TEST_JIT_EMIT2(COIL_COP_MOVlORR, coil_cbc_mem_reg(2, 4), coil_cbc_reg(4));
+  TEST_JIT_LABEL(3);
+  TEST_JIT_EMIT2(COIL_COP_ADDqRI, coil_cbc_reg(2), coil_cbc_imm(4));
+  TEST_JIT_EMIT2(COIL_COP_DECqRR, coil_cbc_reg(3), coil_cbc_reg(3));
+  TEST_JIT_EMIT2(COIL_COP_CMPqRI, coil_cbc_reg(3), coil_cbc_imm(0));
+  TEST_JIT_BR(COIL_INSTRFLAG_GT, 2);
+  TEST_JIT_EMIT2(COIL_COP_DECqRR, coil_cbc_reg(1), coil_cbc_reg(1));
+  TEST_JIT_EMIT2(COIL_COP_CMPqRI, coil_cbc_reg(1), coil_cbc_imm(0));
+  TEST_JIT_BR(COIL_INSTRFLAG_GT, 1);
+  TEST_JIT_EMIT0(COIL_COP_RET);
+  
+  TEST_ASSERT(test_jit_execute(&code, syms, 4, 0, (coil_byte_t *)values, sizeof(values), NULL, 0, &vm) == COIL_ERR_GOOD, "The sort kernel should run");
+  for (int i = 1; i < 16; i++) {
+    TEST_ASSERT(values[i - 1] <= values[i], "The sort kernel should order the values");
+  }
+  TEST_ASSERT(values[0] == -100 && values[15] == 99, "The sort kernel should keep the values");
+  coil_section_cleanup(&code);
+  
+  // Recursive Fibonacci with CALL, RET, PUSH and POP
+  TEST_ASSERT(coil_section_init(&code, 64) == COIL_ERR_GOOD, "Section init should succeed");
+  TEST_JIT_EMIT2(COIL_COP_MOVqRI, coil_cbc_reg(0), coil_cbc_imm(15));
+  TEST_JIT_EMIT1(COIL_COP_CALLqS, coil_cbc_sym(0));
+  TEST_JIT_EMIT0(COIL_COP_RET);
+  TEST_JIT_LABEL(0);
+  TEST_JIT_EMIT2(COIL_COP_CMPqRI, coil_cbc_reg(0), coil_cbc_imm(2));
+  TEST_JIT_BR(COIL_INSTRFLAG_LT, 1);
+  TEST_JIT_EMIT1(COIL_COP_PUSHqR, coil_cbc_reg(0));
+  TEST_JIT_EMIT2(COIL_COP_SUBqRI, coil_cbc_reg(0), coil_cbc_imm(1));
+  TEST_JIT_EMIT1(COIL_COP_CALLqS, coil_cbc_sym(0));
+  TEST_JIT_EMIT1(COIL_COP_POPqR, coil_cbc_reg(1));
+  TEST_JIT_EMIT1(COIL_COP_PUSHqR, coil_cbc_reg(0));
+  TEST_JIT_EMIT2(COIL_COP_MOVqRR, coil_cbc_reg(0), coil_cbc_reg(1));
+  TEST_JIT_EMIT2(COIL_COP_SUBqRI, coil_cbc_reg(0), coil_cbc_imm(2));
+  TEST_JIT_EMIT1(COIL_COP_CALLqS, coil_cbc_sym(0));
+  TEST_JIT_EMIT1(COIL_COP_POPqR, coil_cbc_reg(1));
+  TEST_JIT_EMIT2(COIL_COP_ADDqRR, coil_cbc_reg(0), coil_cbc_reg(1));
+  TEST_JIT_LABEL(1);
+  TEST_JIT_EMIT0(COIL_COP_RET);
+  
+  TEST_ASSERT(test_jit_execute(&code, syms, 2, 0, NULL, 0, NULL, 0, &vm) == COIL_ERR_GOOD, "The Fibonacci kernel should run");
+  TEST_ASSERT(vm.regs[0].lo == 610, "The Fibonacci kernel should compute fib(15)");
+  TEST_ASSERT(vm.sp == 0 && vm.csp == 0, "Calls and pushes should balance");
+  coil_section_cleanup(&code);
+  
+  return 0;
+}
+
+/**
+* @brief Next value of a xorshift generator
+*/
+static coil_u32_t test_jit_random(coil_u32_t *seed) {
+  coil_u32_t x = *seed;
+  x ^= x << 13;
+  x ^= x >> 17;
+  x ^= x << 5;
+  *seed = x;
+  return x;
+}
+
+/**
+* @brief A random operand of a form
+*
+* Registers 8 and 9 hold base addresses and are never written, most
+* memory operands stay in bounds and a few fall outside.
+*/
+static coil_cbc_operand_t test_jit_operand(coil_u8_t form, int dest, coil_u32_t *seed) {
+  coil_u32_t r = test_jit_random(seed);
+  
+  switch (form) {
+    case COIL_CBC_FORM_I:
+      if (r % 4 == 0) {
+        return coil_cbc_imm(r % 70);
+      }
+      return coil_cbc_imm(((coil_u64_t)test_jit_random(seed) << 32) | r);
+    case COIL_CBC_FORM_R:
+      return coil_cbc_reg((coil_u8_t)(dest ? r % 8 : r % 10));
+    case COIL_CBC_FORM_S:
+      return coil_cbc_sym(r % 2);
+    case COIL_CBC_FORM_OS:
+      return coil_cbc_mem_sym(r % 2, (coil_i32_t)(r % 200));
+    default:
+      return coil_cbc_mem_reg((coil_u8_t)(r % 16 == 0 ? r % 8 : 8 + r % 2), (coil_i32_t)((r >> 8) % 176) - 8);
+  }
+}
+
+/**
+* @brief A random operand form
+*/
+static coil_u8_t test_jit_form(int writable, coil_u32_t *seed) {
+  static const coil_u8_t memory[] = { COIL_CBC_FORM_S, COIL_CBC_FORM_OS, COIL_CBC_FORM_OR };
+  coil_u32_t r = test_jit_random(seed) % 10;
+  if (r < 5) {
+    return COIL_CBC_FORM_R;
+  }
+  if (!writable && r < 7) {
+    return COIL_CBC_FORM_I;
+  }
+  return memory[r % 3];
+}
+
+/**
+* @brief Emit a random straight-line program with forward branches and a few calls
+*
+* Symbols 0 and 1 are data addresses, symbol 2 + i the offset of instruction i.
+*/
+static int test_jit_program(coil_section_t *sect, coil_u64_t *syms, coil_u32_t *seed) {
+  static const coil_u8_t operations[] = {
+    COIL_CBC_MOV, COIL_CBC_MOV, COIL_CBC_ADD, COIL_CBC_SUB, COIL_CBC_MUL, COIL_CBC_AND, COIL_CBC_OR, COIL_CBC_XOR,
+    COIL_CBC_SHL, COIL_CBC_SAL, COIL_CBC_SHR, COIL_CBC_SAR, COIL_CBC_INC, COIL_CBC_DEC, COIL_CBC_NEG, COIL_CBC_NOT,
+    COIL_CBC_CMP, COIL_CBC_CMP, COIL_CBC_TEST, COIL_CBC_BR, COIL_CBC_BR, COIL_CBC_BR, COIL_CBC_JMP, COIL_CBC_LEA,
+    COIL_CBC_CVT, COIL_CBC_PUSH, COIL_CBC_POP, COIL_CBC_PUSHFD, COIL_CBC_POPFD, COIL_CBC_CALL, COIL_CBC_RET, COIL_CBC_NOP,
+  };
+  static const coil_u8_t widths[] = { 1, 2, 4, 8 };
+  int calls = 0;
+  
+  syms[0] = 0;
+  syms[1] = 64;
+  
+  for (int i = 0; i < TEST_JIT_LENGTH; i++) {
+    coil_u8_t operation = operations[test_jit_random(seed) % sizeof(operations)];
+    coil_u8_t width = widths[test_jit_random(seed) % 4];
+    coil_u8_t cond = COIL_INSTRFLAG_NONE;
+    coil_u8_t fa = COIL_CBC_FORM_NONE, fb = COIL_CBC_FORM_NONE;
+    coil_cbc_operand_t a = coil_cbc_imm(0), b = coil_cbc_imm(0);
+    
+    if (operation == COIL_CBC_CALL && ++calls > 2) {
+      operation = COIL_CBC_NOP;
+    }
+    
+    syms[2 + i] = sect->size;
+    switch (operation) {
+      case COIL_CBC_BR:
+      case COIL_CBC_JMP:
+      case COIL_CBC_CALL: {
+        coil_u32_t target = (coil_u32_t)i + 1 + test_jit_random(seed) % (coil_u32_t)(TEST_JIT_LENGTH - i);
+        cond = operation == COIL_CBC_BR ? (coil_u8_t)(test_jit_random(seed) % (COIL_INSTRFLAG_LTE + 1)) : COIL_INSTRFLAG_NONE;
+        width = 8;
+        fa = COIL_CBC_FORM_S;
+        a = coil_cbc_sym(2 + target);
+        break;
+      }
+      case COIL_CBC_NOP:
+      case COIL_CBC_RET:
+      case COIL_CBC_PUSHFD:
+      case COIL_CBC_POPFD:
+        width = 0;
+        break;
+      case COIL_CBC_PUSH:
+        fa = test_jit_form(0, seed);
+        break;
+      case COIL_CBC_POP:
+      case COIL_CBC_NOT:
+        fa = test_jit_form(1, seed);
+        break;
+      case COIL_CBC_CMP:
+      case COIL_CBC_TEST:
+        fa = test_jit_form(0, seed);
+        fb = test_jit_form(0, seed);
+        break;
+      case COIL_CBC_LEA:
+        fa = test_jit_form(1, seed);
+        do {
+          fb = test_jit_form(1, seed);
+        } while (fb == COIL_CBC_FORM_R);
+        break;
+      case COIL_CBC_CVT:
+        fa = COIL_CBC_FORM_R;
+        fb = test_jit_form(0, seed);
+        break;
+      default:
+        fa = test_jit_form(1, seed);
+        fb = test_jit_form(0, seed);
+        break;
+    }
+    if (fa != COIL_CBC_FORM_NONE && operation != COIL_CBC_BR && operation != COIL_CBC_JMP && operation != COIL_CBC_CALL) {
+      a = test_jit_operand(fa, 1, seed);
+    }
+    if (fb != COIL_CBC_FORM_NONE) {
+      b = test_jit_operand(fb, 0, seed);
+    }
+    
+    coil_cbc_opcode_t op;
+    TEST_ASSERT(coil_cbc_opcode_for(operation, width, fa, fb, &op) == COIL_ERR_GOOD, "Generated forms should exist");
+    TEST_ASSERT(coil_cbc_encode(sect, op, cond, fa != COIL_CBC_FORM_NONE ? &a : NULL, fb != COIL_CBC_FORM_NONE ? &b : NULL) == COIL_ERR_GOOD,
+                "Generated instructions should encode");
+  }
+  
+  syms[2 + TEST_JIT_LENGTH] = sect->size;
+  TEST_ASSERT(coil_cbc_encode(sect, COIL_COP_RET, COIL_INSTRFLAG_NONE, NULL, NULL) == COIL_ERR_GOOD, "RET should encode");
+  return 0;
+}
+
+/**
+* @brief Differential test of random programs against the reference evaluator and the interpreter
+*/
+static int test_jit_differential() {
+  printf("  Testing JIT against the reference evaluator...\n");
+  
+  coil_u32_t seed = 0x2545F491;
+  coil_u64_t syms[2 + TEST_JIT_LENGTH + 1];
+  coil_byte_t memory[TEST_JIT_MEMORY];
+  coil_cbc_value_t regs[COIL_CBC_REGISTERS];
+  coil_cbc_vm_t vm;
+  int finished = 0;
+  
+  for (int program = 0; program < TEST_JIT_PROGRAMS; program++) {
+    coil_section_t sect;
+    TEST_ASSERT(coil_section_init(&sect, 512) == COIL_ERR_GOOD, "Section init should succeed");
+    if (test_jit_program(&sect, syms, &seed) != 0) {
+      coil_section_cleanup(&sect);
+      return 1;
+    }
+    
+    for (coil_size_t i = 0; i < sizeof(memory); i++) {
+      memory[i] = (coil_byte_t)test_jit_random(&seed);
+    }
+    memset(regs, 0, sizeof(regs));
+    for (int i = 0; i < 8; i++) {
+      regs[i].lo = test_jit_random(&seed) % 3 == 0 ? test_jit_random(&seed) % 100 : ((coil_u64_t)test_jit_random(&seed) << 32) | test_jit_random(&seed);
+    }
+    regs[8].lo = 16;
+    regs[9].lo = 100;
+    
+    coil_err_t err = test_jit_execute(&sect, syms, 2 + TEST_JIT_LENGTH + 1, 0, memory, sizeof(memory), regs, 0, &vm);
+    coil_section_cleanup(&sect);
+    if (err != COIL_ERR_GOOD && err != COIL_ERR_BADSTATE) {
+      printf("Program %d failed with %d\n", program, (int)err);
+    }
+    TEST_ASSERT(err == COIL_ERR_GOOD || err == COIL_ERR_BADSTATE, "Random programs should run the same everywhere");
+    finished += err == COIL_ERR_GOOD;
+  }
+  
+  // Enough programs should get to the end for the comparison to mean something
+  TEST_ASSERT(finished >= TEST_JIT_PROGRAMS / 4, "Most random programs should not fault");
+  
+  return 0;
+}
+
+/**
+* @brief Test rejected programs and execution faults
+*/
+static int test_jit_faults() {
+  printf("  Testing JIT faults...\n");
+  
+  coil_section_t code;
+  coil_u64_t syms[2] = { 0, 0 };
+  coil_byte_t memory[16];
+  coil_cbc_vm_t vm;
+  coil_jit_t jit;
+  
+  memset(memory, 0, sizeof(memory));
+  
+  // Out of bounds memory, just past the end and wrapping around
+  TEST_ASSERT(coil_section_init(&code, 64) == COIL_ERR_GOOD, "Section init should succeed");
+  TEST_JIT_EMIT2(COIL_COP_MOVqRI, coil_cbc_reg(0), coil_cbc_imm(8));
+  TEST_JIT_EMIT2(COIL_COP_MOVqORI, coil_cbc_mem_reg(0, 0), coil_cbc_imm(1));
+  TEST_JIT_EMIT2(COIL_COP_MOVqORI, coil_cbc_mem_reg(0, 1), coil_cbc_imm(1));
+  TEST_JIT_EMIT0(COIL_COP_RET);
+  TEST_ASSERT(test_jit_execute(&code, syms, 2, 0, memory, sizeof(memory), NULL, 0, &vm) == COIL_ERR_BADSTATE, "Out of bounds stores should fault");
+  TEST_ASSERT(vm.fault == 26 && memory[8] == 1, "The fault should name the second store");
+  coil_section_cleanup(&code);
+  TEST_ASSERT(coil_section_init(&code, 64) == COIL_ERR_GOOD, "Section init should succeed");
+  TEST_JIT_EMIT2(COIL_COP_MOVqRI, coil_cbc_reg(0), coil_cbc_imm(~(coil_u64_t)3));
+  TEST_JIT_EMIT2(COIL_COP_MOVlROR, coil_cbc_reg(1), coil_cbc_mem_reg(0, 0));
+  TEST_JIT_EMIT0(COIL_COP_RET);
+  TEST_ASSERT(test_jit_execute(&code, syms, 2, 0, memory, sizeof(memory), NULL, 0, &vm) == COIL_ERR_BADSTATE, "Wrapping addresses should fault");
+  TEST_ASSERT(vm.fault == 11, "The fault should name the load");
+  coil_section_cleanup(&code);
+  
+  // Stack underflow and call stack overflow
+  TEST_ASSERT(coil_section_init(&code, 64) == COIL_ERR_GOOD, "Section init should succeed");
+  TEST_JIT_EMIT1(COIL_COP_PUSHqI, coil_cbc_imm(7));
+  TEST_JIT_EMIT1(COIL_COP_POPqR, coil_cbc_reg(2));
+  TEST_JIT_EMIT1(COIL_COP_POPqR, coil_cbc_reg(3));
+  TEST_JIT_EMIT0(COIL_COP_RET);
+  TEST_ASSERT(test_jit_execute(&code, syms, 2, 0, NULL, 0, NULL, 0, &vm) == COIL_ERR_BADSTATE, "Stack underflows should fault");
+  TEST_ASSERT(vm.regs[2].lo == 7 && vm.sp == 0 && vm.fault == 13, "The fault should name the second pop");
+  coil_section_cleanup(&code);
+  TEST_ASSERT(coil_section_init(&code, 64) == COIL_ERR_GOOD, "Section init should succeed");
+  TEST_JIT_EMIT1(COIL_COP_CALLqS, coil_cbc_sym(0));
+  TEST_ASSERT(test_jit_execute(&code, syms, 1, 0, NULL, 0, NULL, 0, &vm) == COIL_ERR_BADSTATE, "Call stack overflows should fault");
+  TEST_ASSERT(vm.csp == TEST_JIT_DEPTH, "The call stack should be full");
+  coil_section_cleanup(&code);
+  
+  // Infinite loops stop at the budget, falling off the end stops too
+  TEST_ASSERT(coil_section_init(&code, 64) == COIL_ERR_GOOD, "Section init should succeed");
+  TEST_JIT_EMIT1(COIL_COP_JMPqS, coil_cbc_sym(0));
+  TEST_ASSERT(test_jit_execute(&code, syms, 2, 0, NULL, 0, NULL, 1000, &vm) == COIL_ERR_BADSTATE, "Exhausted budgets should stop execution");
+  TEST_ASSERT(vm.fault == 0, "The budget should stop at the branch");
+  TEST_JIT_EMIT1(COIL_COP_JMPqS, coil_cbc_sym(1));
+  syms[1] = code.size;
+  TEST_ASSERT(test_jit_execute(&code, syms, 2, 6, NULL, 0, NULL, 0, &vm) == COIL_ERR_BADSTATE, "Running past the end should stop execution");
+  TEST_ASSERT(vm.fault == code.size, "The fault should name the end of the code");
+  TEST_ASSERT(test_jit_execute(&code, syms, 2, 1, NULL, 0, NULL, 0, &vm) == COIL_ERR_INVAL, "Entries inside instructions should be rejected");
+  coil_section_cleanup(&code);
+  
+  // Programs outside the compiled subset, and malformed ones
+  syms[0] = 0;
+  TEST_ASSERT(coil_section_init(&code, 64) == COIL_ERR_GOOD, "Section init should succeed");
+  TEST_JIT_EMIT2(COIL_COP_DIVqRI, coil_cbc_reg(0), coil_cbc_imm(3));
+  TEST_ASSERT(test_jit_execute(&code, syms, 2, 0, NULL, 0, NULL, 0, &vm) == COIL_ERR_NOTSUP, "Division should not be compiled");
+  coil_section_cleanup(&code);
+  TEST_ASSERT(coil_section_init(&code, 64) == COIL_ERR_GOOD, "Section init should succeed");
+  TEST_JIT_EMIT2(COIL_COP_ADDoRR, coil_cbc_reg(0), coil_cbc_reg(1));
+  TEST_ASSERT(test_jit_execute(&code, syms, 2, 0, NULL, 0, NULL, 0, &vm) == COIL_ERR_NOTSUP, "128-bit operations should not be compiled");
+  coil_section_cleanup(&code);
+  TEST_ASSERT(coil_section_init(&code, 64) == COIL_ERR_GOOD, "Section init should succeed");
+  TEST_JIT_EMIT1(COIL_COP_JMPqR, coil_cbc_reg(0));
+  TEST_ASSERT(test_jit_execute(&code, syms, 2, 0, NULL, 0, NULL, 0, &vm) == COIL_ERR_NOTSUP, "Dynamic branches should not be compiled");
+  coil_section_cleanup(&code);
+  TEST_ASSERT(coil_section_init(&code, 64) == COIL_ERR_GOOD, "Section init should succeed");
+  TEST_JIT_EMIT2(COIL_COP_MOVqRI, coil_cbc_reg(COIL_CBC_REGISTERS), coil_cbc_imm(0));
+  TEST_ASSERT(test_jit_execute(&code, syms, 2, 0, NULL, 0, NULL, 0, &vm) == COIL_ERR_FORMAT, "Unknown registers should be rejected");
+  coil_section_cleanup(&code);
+  TEST_ASSERT(coil_section_init(&code, 64) == COIL_ERR_GOOD, "Section init should succeed");
+  syms[0] = 1;
+  TEST_JIT_EMIT1(COIL_COP_JMPqS, coil_cbc_sym(0));
+  TEST_ASSERT(test_jit_execute(&code, syms, 2, 0, NULL, 0, NULL, 0, &vm) == COIL_ERR_FORMAT, "Branches into instructions should be rejected");
+  TEST_ASSERT(coil_jit_compile(&jit, code.data, code.size - 1, syms, 2) == (TEST_JIT_NATIVE ? COIL_ERR_FORMAT : COIL_ERR_NOTSUP), "Truncated code should be rejected");
+  TEST_ASSERT(coil_jit_compile(NULL, code.data, code.size, syms, 2) == COIL_ERR_INVAL, "NULL programs should be rejected");
+  TEST_ASSERT(coil_jit_run(NULL, &vm, 0, 0) == COIL_ERR_INVAL, "Running NULL programs should be rejected");
+  coil_section_cleanup(&code);
+  
+  return 0;
+}
+
+/**
+* @brief Run all JIT tests
+*/
+int test_jit() {
+  printf("\nRunning JIT tests...\n");
+  
+  int result = 0;
+  
+  result |= test_jit_kernels();
+  result |= test_jit_differential();
+  result |= test_jit_faults();
+  
+  if (result == 0) {
+    printf("All JIT tests passed!\n");
+  }
+  
+  return result;
+}
@@ -0,0 +1,472 @@
+/**
+* @file test_lower.c
+* @brief Test suite for lowering COIL instructions to CBC
+*
+* @author Low Level Team
+*/
+
+#include <coil/lower.h>
+#include <coil/instr.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Test macros
+#define TEST_ASSERT(cond, msg) do { \
+  if (!(cond)) { \
+    printf("ASSERT FAILED: %s (line %d)\n", msg, __LINE__); \
+    return 1; \
+  } \
+} while (0)
+
+#define TEST_LOWER_DEPTH 64
+#define TEST_LOWER_MEMORY 256
+#define TEST_LOWER_FUNCTIONS 300
+
+/**
+* @brief Encode an operand and its data (sized by the value type)
+*/
+static void test_lower_operand(coil_section_t *ir, coil_u8_t type, coil_u8_t value_type, coil_u64_t value) {
+  coil_operand_encode(ir, type, value_type, COIL_MOD_NONE);
+  
+  switch (value_type) {
+    case COIL_VAL_I8:
+    case COIL_VAL_U8: { coil_u8_t v = (coil_u8_t)value; coil_operand_encode_data(ir, &v, 1); break; }
+    case COIL_VAL_I16:
+    case COIL_VAL_U16: { coil_u16_t v = (coil_u16_t)value; coil_operand_encode_data(ir, &v, 2); break; }
+    case COIL_VAL_I32:
+    case COIL_VAL_U32:
+    case COIL_VAL_REG: { coil_u32_t v = (coil_u32_t)value; coil_operand_encode_data(ir, &v, 4); break; }
+    case COIL_VAL_VOID: break;
+    default: coil_operand_encode_data(ir, &value, 8); break;
+  }
+}
+
+/**
+* @brief Encode an offset operand over a register (COIL_VAL_REG) or symbol (COIL_VAL_SYM)
+*/
+static void test_lower_offset(coil_section_t *ir, coil_u8_t base_type, coil_u64_t base,
+                              coil_u64_t disp, coil_u64_t index, coil_u64_t scale) {
+  coil_offset_t offset = { disp, index, scale };
+  coil_operand_encode_off(ir, COIL_TYPEOP_OFF, base_type, COIL_MOD_NONE, &offset);
+  if (base_type == COIL_VAL_REG) {
+    coil_u32_t v = (coil_u32_t)base;
+    coil_operand_encode_data(ir, &v, 4);
+  } else {
+    coil_operand_encode_data(ir, &base, 8);
+  }
+}
+
+/**
+* @brief Decode the CBC instruction at an offset of the output
+*/
+static coil_err_t test_lower_at(const coil_section_t *out, coil_u64_t offset, coil_cbc_insn_t *insn) {
+  return coil_cbc_decode(out->data, out->size, offset, insn);
+}
+
+/**
+* @brief Lower a two-function program and run it under the interpreter
+*/
+static int test_lower_program() {
+  coil_section_t ir, out;
+  TEST_ASSERT(coil_section_init(&ir, 256) == COIL_ERR_GOOD, "Section init should succeed");
+  TEST_ASSERT(coil_section_init(&out, 256) == COIL_ERR_GOOD, "Section init should succeed");
+  
+  // sum: r1 = 100 + 99 + ... + 1 counted down in variable 0, stored at data + 8
+  coil_u64_t sum = ir.size;
+  coil_instrflag_encode(&ir, COIL_OP_MOV, COIL_INSTRFLAG_NONE);
+  test_lower_operand(&ir, COIL_TYPEOP_REG, COIL_VAL_I64, 1);
+  test_lower_operand(&ir, COIL_TYPEOP_IMM, COIL_VAL_I64, 0);
+  coil_instrflag_encode(&ir, COIL_OP_MOV, COIL_INSTRFLAG_NONE);
+  test_lower_operand(&ir, COIL_TYPEOP_VAR, COIL_VAL_I64, 0);
+  test_lower_operand(&ir, COIL_TYPEOP_IMM, COIL_VAL_I32, 100);
+  coil_u64_t loop = ir.size;
+  coil_instrflag_encode(&ir, COIL_OP_ADD, COIL_INSTRFLAG_NONE);
+  test_lower_operand(&ir, COIL_TYPEOP_REG, COIL_VAL_I64, 1);
+  test_lower_operand(&ir, COIL_TYPEOP_VAR, COIL_VAL_I64, 0);
+  coil_instr_encode(&ir, COIL_OP_NOP);
+  coil_instrflag_encode(&ir, COIL_OP_DEC, COIL_INSTRFLAG_NONE);
+  test_lower_operand(&ir, COIL_TYPEOP_VAR, COIL_VAL_I64, 0);
+  coil_instrflag_encode(&ir, COIL_OP_CMP, COIL_INSTRFLAG_NONE);
+  test_lower_operand(&ir, COIL_TYPEOP_VAR, COIL_VAL_I64, 0);
+  test_lower_operand(&ir, COIL_TYPEOP_IMM, COIL_VAL_I8, 0);
+  coil_instrflag_encode(&ir, COIL_OP_BR, COIL_INSTRFLAG_GT);
+  test_lower_operand(&ir, COIL_TYPEOP_SYM, COIL_VAL_SYM, 0);
+  coil_instrflag_encode(&ir, COIL_OP_MOV, COIL_INSTRFLAG_NONE);
+  test_lower_offset(&ir, COIL_VAL_SYM, 1, 4, 1, 4);
+  test_lower_operand(&ir, COIL_TYPEOP_REG, COIL_VAL_I64, 1);
+  coil_instrflag_encode(&ir, COIL_OP_CALL, COIL_INSTRFLAG_NONE);
+  test_lower_operand(&ir, COIL_TYPEOP_SYM, COIL_VAL_SYM, 2);
+  coil_instr_encode(&ir, COIL_OP_RET);
+  
+  // widen: r2 = (i64)(i8)r3, r4 = (u64)(u8)r3
+  coil_u64_t widen = ir.size;
+  coil_instr_encode(&ir, COIL_OP_CVT);
+  test_lower_operand(&ir, COIL_TYPEOP_REG, COIL_VAL_I64, 2);
+  test_lower_operand(&ir, COIL_TYPEOP_REG, COIL_VAL_I8, 3);
+  coil_instr_encode(&ir, COIL_OP_CVT);
+  test_lower_operand(&ir, COIL_TYPEOP_REG, COIL_VAL_U64, 4);
+  test_lower_operand(&ir, COIL_TYPEOP_REG, COIL_VAL_U8, 3);
+  coil_instr_encode(&ir, COIL_OP_RET);
+  
+  coil_lower_func_t funcs[2] = { { sum, widen - sum }, { widen, ir.size - widen } };
+  coil_lower_options_t options;
+  coil_lower_options_init(&options);
+  options.threads = 4;
+  
+  coil_lower_t lower;
+  TEST_ASSERT(coil_lower_section(&lower, &out, &ir, funcs, 2, &options) == COIL_ERR_GOOD, "Lowering should succeed");
+  TEST_ASSERT(lower.code_size == out.size, "Every byte of CBC should be accounted for");
+  
+  coil_u64_t entry, end, syms[3] = { 0, 0, 0 };
+  TEST_ASSERT(coil_lower_offset(&lower, sum, &entry) == COIL_ERR_GOOD && entry == 0, "Functions should be laid out in order");
+  TEST_ASSERT(coil_lower_offset(&lower, loop, &syms[0]) == COIL_ERR_GOOD, "Labels should map to CBC");
+  TEST_ASSERT(coil_lower_offset(&lower, widen, &syms[2]) == COIL_ERR_GOOD, "Function starts should map to CBC");
+  TEST_ASSERT(coil_lower_offset(&lower, ir.size, &end) == COIL_ERR_GOOD && end == out.size, "Function ends should map to CBC");
+  TEST_ASSERT(coil_lower_offset(&lower, loop + 1, &end) == COIL_ERR_NOTFOUND, "Offsets inside instructions should not map");
+  
+  coil_cbc_program_t prog;
+  coil_cbc_vm_t vm;
+  coil_byte_t memory[TEST_LOWER_MEMORY] = {0};
+  TEST_ASSERT(coil_cbc_program_init(&prog, out.data, out.size, syms, 3) == COIL_ERR_GOOD, "Lowered code should predecode");
+  TEST_ASSERT(coil_cbc_vm_init(&vm, memory, sizeof(memory), TEST_LOWER_DEPTH) == COIL_ERR_GOOD, "VM init should succeed");
+  vm.regs[COIL_LOWER_FRAME_REG].lo = 64;
+  vm.regs[3].lo = 0xFF;
+  TEST_ASSERT(coil_cbc_run(&vm, &prog, entry, 0) == COIL_ERR_GOOD, "Lowered code should run");
+  
+  coil_u64_t stored;
+  memcpy(&stored, memory + 8, sizeof(stored));
+  TEST_ASSERT(vm.regs[1].lo == 5050 && stored == 5050, "The sum should be computed and stored");
+  TEST_ASSERT(vm.regs[2].lo == ~(coil_u64_t)0, "Signed widening should sign extend");
+  TEST_ASSERT(vm.regs[4].lo == 0xFF, "Unsigned widening should zero extend");
+  
+  coil_cbc_vm_cleanup(&vm);
+  coil_cbc_program_cleanup(&prog);
+  coil_lower_cleanup(&lower);
+  coil_section_cleanup(&out);
+  coil_section_cleanup(&ir);
+  return 0;
+}
+
+/**
+* @brief CBC opcodes selected for operand types and widths
+*/
+static int test_lower_forms() {
+  coil_section_t ir, out;
+  TEST_ASSERT(coil_section_init(&ir, 512) == COIL_ERR_GOOD, "Section init should succeed");
+  TEST_ASSERT(coil_section_init(&out, 512) == COIL_ERR_GOOD, "Section init should succeed");
+  
+  coil_u64_t at[12];
+  at[0] = ir.size;
+  coil_instrflag_encode(&ir, COIL_OP_MOV, COIL_INSTRFLAG_NONE);
+  test_lower_operand(&ir, COIL_TYPEOP_REG, COIL_VAL_I32, 1);
+  test_lower_operand(&ir, COIL_TYPEOP_IMM, COIL_VAL_I8, 0xFF);
+  at[1] = ir.size;
+  coil_instrflag_encode(&ir, COIL_OP_ADD, COIL_INSTRFLAG_NONE);
+  test_lower_operand(&ir, COIL_TYPEOP_VAR, COIL_VAL_I64, 3);
+  test_lower_operand(&ir, COIL_TYPEOP_REG, COIL_VAL_I64, 2);
+  at[2] = ir.size;
+  coil_instrflag_encode(&ir, COIL_OP_ADD, COIL_INSTRFLAG_NONE);
+  test_lower_operand(&ir, COIL_TYPEOP_VAR, COIL_VAL_I64, 5);
+  test_lower_operand(&ir, COIL_TYPEOP_REG, COIL_VAL_I64, 2);
+  at[3] = ir.size;
+  coil_instrflag_encode(&ir, COIL_OP_LEA, COIL_INSTRFLAG_NONE);
+  test_lower_operand(&ir, COIL_TYPEOP_REG, COIL_VAL_PTR, 1);
+  test_lower_offset(&ir, COIL_VAL_REG, 4, 8, 2, 4);
+  at[4] = ir.size;
+  coil_instr_encode(&ir, COIL_OP_CVT);
+  test_lower_operand(&ir, COIL_TYPEOP_VAR, COIL_VAL_I64, 0);
+  test_lower_operand(&ir, COIL_TYPEOP_REG, COIL_VAL_I16, 2);
+  at[5] = ir.size;
+  coil_instrflag_encode(&ir, COIL_OP_INC, COIL_INSTRFLAG_NONE);
+  test_lower_operand(&ir, COIL_TYPEOP_REG, COIL_VAL_U16, 5);
+  at[6] = ir.size;
+  coil_instr_encode(&ir, COIL_OP_NOP);
+  at[7] = ir.size;
+  coil_instrflag_encode(&ir, COIL_OP_BR, COIL_INSTRFLAG_NONE);
+  test_lower_operand(&ir, COIL_TYPEOP_SYM, COIL_VAL_SYM, 4);
+  at[8] = ir.size;
+  coil_instrflag_encode(&ir, COIL_OP_BR, COIL_INSTRFLAG_LT);
+  test_lower_operand(&ir, COIL_TYPEOP_SYM, COIL_VAL_SYM, 4);
+  at[9] = ir.size;
+  coil_instrflag_encode(&ir, COIL_OP_PUSH, COIL_INSTRFLAG_NONE);
+  test_lower_operand(&ir, COIL_TYPEOP_IMM, COIL_VAL_U16, 7);
+  at[10] = ir.size;
+  coil_instrflag_encode(&ir, COIL_OP_MOV, COIL_INSTRFLAG_NONE);
+  test_lower_operand(&ir, COIL_TYPEOP_VAR, COIL_VAL_VAR, 1);
+  test_lower_operand(&ir, COIL_TYPEOP_IMM, COIL_VAL_I16, 5);
+  at[11] = ir.size;
+  coil_instr_encode(&ir, COIL_OP_CVT);
+  test_lower_operand(&ir, COIL_TYPEOP_REG, COIL_VAL_I8, 6);
+  test_lower_offset(&ir, COIL_VAL_SYM, 2, 0, 0, 0);
+  
+  // Variable 5 lives in register 7, the rest in frame slots
+  coil_cbc_operand_t homes[6];
+  for (int i = 0; i < 5; i++) {
+    homes[i] = coil_cbc_mem_reg(COIL_LOWER_FRAME_REG, i * COIL_LOWER_VAR_SLOT);
+  }
+  homes[5] = coil_cbc_reg(7);
+  coil_lower_options_t options;
+  coil_lower_options_init(&options);
+  options.homes = homes;
+  options.home_count = 6;
+  options.threads = 1;
+  
+  coil_lower_t lower;
+  TEST_ASSERT(coil_lower_section(&lower, &out, &ir, NULL, 0, &options) == COIL_ERR_GOOD, "Lowering should succeed");
+  
+  coil_u64_t pc[12];
+  for (int i = 0; i < 12; i++) {
+    TEST_ASSERT(coil_lower_offset(&lower, at[i], &pc[i]) == COIL_ERR_GOOD, "Every instruction should map to CBC");
+  }
+  
+  coil_cbc_insn_t insn;
+  TEST_ASSERT(test_lower_at(&out, pc[0], &insn) == COIL_ERR_GOOD && insn.opcode == COIL_COP_MOVlRI, "Immediates should take the register width");
+  TEST_ASSERT(insn.operands[1].imm == 0xFFFFFFFF, "Signed immediates should be sign extended");
+  TEST_ASSERT(test_lower_at(&out, pc[1], &insn) == COIL_ERR_GOOD && insn.opcode == COIL_COP_ADDqORR, "Variables should live in frame slots");
+  TEST_ASSERT(insn.operands[0].reg == COIL_LOWER_FRAME_REG && insn.operands[0].disp == 3 * COIL_LOWER_VAR_SLOT, "Frame slots should be indexed by variable");
+  TEST_ASSERT(test_lower_at(&out, pc[2], &insn) == COIL_ERR_GOOD && insn.opcode == COIL_COP_ADDqRR, "Variables should use their homes");
+  TEST_ASSERT(insn.operands[0].reg == 7, "The home register should be used");
+  TEST_ASSERT(test_lower_at(&out, pc[3], &insn) == COIL_ERR_GOOD && insn.opcode == COIL_COP_LEAqROR, "Pointers should be q wide");
+  TEST_ASSERT(insn.operands[1].reg == 4 && insn.operands[1].disp == 16, "Index and scale should fold into the displacement");
+  TEST_ASSERT(test_lower_at(&out, pc[4], &insn) == COIL_ERR_GOOD && insn.opcode == COIL_COP_CVTwRR, "Signed widening should use CVT");
+  TEST_ASSERT(insn.operands[0].reg == COIL_LOWER_SCRATCH_REG, "Widening into memory should go through the scratch register");
+  TEST_ASSERT(test_lower_at(&out, pc[4] + insn.length, &insn) == COIL_ERR_GOOD && insn.opcode == COIL_COP_MOVqORR, "The widened value should be stored");
+  TEST_ASSERT(test_lower_at(&out, pc[5], &insn) == COIL_ERR_GOOD && insn.opcode == COIL_COP_INCwRR, "INC should read and write its operand");
+  TEST_ASSERT(pc[6] == pc[7], "NOP should be dropped");
+  TEST_ASSERT(test_lower_at(&out, pc[7], &insn) == COIL_ERR_GOOD && insn.opcode == COIL_COP_JMPqS, "Unconditional branches should become JMP");
+  TEST_ASSERT(test_lower_at(&out, pc[8], &insn) == COIL_ERR_GOOD && insn.opcode == COIL_COP_BRqS, "Conditional branches should stay BR");
+  TEST_ASSERT(insn.cond == COIL_INSTRFLAG_LT && insn.operands[0].symbol == 4, "The condition and target should be kept");
+  TEST_ASSERT(test_lower_at(&out, pc[9], &insn) == COIL_ERR_GOOD && insn.opcode == COIL_COP_PUSHwI, "PUSH should take immediates");
+  TEST_ASSERT(test_lower_at(&out, pc[10], &insn) == COIL_ERR_GOOD && insn.opcode == COIL_COP_MOVwORI, "Untyped variables should take the immediate width");
+  TEST_ASSERT(insn.operands[0].disp == COIL_LOWER_VAR_SLOT, "Homes should be used for untyped variables too");
+  TEST_ASSERT(test_lower_at(&out, pc[11], &insn) == COIL_ERR_GOOD && insn.opcode == COIL_COP_MOVbROS, "CVT of untyped memory should be a move");
+  TEST_ASSERT(pc[11] + insn.length == out.size, "Nothing should follow the last instruction");
+  
+  coil_lower_cleanup(&lower);
+  coil_section_cleanup(&out);
+  coil_section_cleanup(&ir);
+  return 0;
+}
+
+/**
+* @brief Random functions lower to the same CBC on any number of threads
+*/
+static int test_lower_parallel() {
+  coil_section_t ir;
+  TEST_ASSERT(coil_section_init(&ir, 1 << 16) == COIL_ERR_GOOD, "Section init should succeed");
+  
+  coil_lower_func_t funcs[TEST_LOWER_FUNCTIONS];
+  coil_u64_t state = 0x9E3779B97F4A7C15ull;
+  static const coil_u8_t ops[] = { COIL_OP_MOV, COIL_OP_ADD, COIL_OP_SUB, COIL_OP_XOR, COIL_OP_CMP, COIL_OP_SHL };
+  static const coil_u8_t types[] = { COIL_VAL_I8, COIL_VAL_U16, COIL_VAL_I32, COIL_VAL_U64 };
+  
+  for (int f = 0; f < TEST_LOWER_FUNCTIONS; f++) {
+    funcs[f].offset = ir.size;
+    
+    // Sizes vary a lot so the largest-first order matters
+    state ^= state << 13; state ^= state >> 7; state ^= state << 17;
+    int length = 1 + (int)(state % (f % 10 == 0 ? 200 : 12));
+    for (int i = 0; i < length; i++) {
+      state ^= state << 13; state ^= state >> 7; state ^= state << 17;
+      coil_u8_t type = types[(state >> 8) % 4];
+      switch ((state >> 16) % 5) {
+        case 0:
+          coil_instrflag_encode(&ir, COIL_OP_INC, COIL_INSTRFLAG_NONE);
+          test_lower_operand(&ir, COIL_TYPEOP_VAR, type, (state >> 24) % 8);
+          break;
+        case 1:
+          coil_instrflag_encode(&ir, COIL_OP_BR, (coil_u8_t)((state >> 24) % 7));
+          test_lower_operand(&ir, COIL_TYPEOP_SYM, COIL_VAL_SYM, (state >> 32) % 16);
+          break;
+        case 2:
+          coil_instr_encode(&ir, COIL_OP_CVT);
+          test_lower_operand(&ir, COIL_TYPEOP_VAR, type, (state >> 24) % 8);
+          test_lower_offset(&ir, COIL_VAL_REG, (state >> 32) % 8, (state >> 40) % 64, 0, 0);
+          break;
+        default:
+          coil_instrflag_encode(&ir, ops[(state >> 24) % 6], COIL_INSTRFLAG_NONE);
+          test_lower_operand(&ir, COIL_TYPEOP_REG, type, (state >> 32) % 16);
+          test_lower_operand(&ir, (state >> 40) & 1 ? COIL_TYPEOP_IMM : COIL_TYPEOP_VAR, type, state >> 44);
+          break;
+      }
+    }
+    coil_instr_encode(&ir, COIL_OP_RET);
+    funcs[f].size = ir.size - funcs[f].offset;
+  }
+  
+  coil_section_t serial, parallel, whole;
+  coil_lower_t a, b, c;
+  coil_lower_options_t options;
+  coil_lower_options_init(&options);
+  TEST_ASSERT(coil_section_init(&serial, 0) == COIL_ERR_GOOD, "Section init should succeed");
+  TEST_ASSERT(coil_section_init(&parallel, 0) == COIL_ERR_GOOD, "Section init should succeed");
+  TEST_ASSERT(coil_section_init(&whole, 0) == COIL_ERR_GOOD, "Section init should succeed");
+  
+  options.threads = 1;
+  TEST_ASSERT(coil_lower_section(&a, &serial, &ir, funcs, TEST_LOWER_FUNCTIONS, &options) == COIL_ERR_GOOD, "Serial lowering should succeed");
+  options.threads = 8;
+  TEST_ASSERT(coil_lower_section(&b, &parallel, &ir, funcs, TEST_LOWER_FUNCTIONS, &options) == COIL_ERR_GOOD, "Parallel lowering should succeed");
+  TEST_ASSERT(coil_lower_section(&c, &whole, &ir, NULL, 0, &options) == COIL_ERR_GOOD, "Whole section lowering should succeed");
+  
+  TEST_ASSERT(serial.size == parallel.size && memcmp(serial.data, parallel.data, serial.size) == 0, "Thread count should not change the code");
+  TEST_ASSERT(serial.size == whole.size && memcmp(serial.data, whole.data, serial.size) == 0, "Function splits should not change the code");
+  TEST_ASSERT(memcmp(a.cbc_of, b.cbc_of, (ir.size + 1) * sizeof(coil_u32_t)) == 0, "Thread count should not change the offsets");
+  TEST_ASSERT(memcmp(a.cbc_of, c.cbc_of, (ir.size + 1) * sizeof(coil_u32_t)) == 0, "Function splits should not change the offsets");
+  
+  // The output decodes back to back
+  coil_size_t pos = 0;
+  coil_u32_t count = 0;
+  while (pos < serial.size) {
+    coil_cbc_insn_t insn;
+    TEST_ASSERT(coil_cbc_decode(serial.data, serial.size, pos, &insn) == COIL_ERR_GOOD, "Lowered code should decode");
+    pos += insn.length;
+    count++;
+  }
+  TEST_ASSERT(count >= TEST_LOWER_FUNCTIONS, "Every function should produce code");
+  
+  // Appending keeps offsets absolute
+  coil_lower_cleanup(&b);
+  TEST_ASSERT(coil_lower_section(&b, &serial, &ir, funcs, TEST_LOWER_FUNCTIONS, &options) == COIL_ERR_GOOD, "Appending should succeed");
+  coil_u64_t first;
+  TEST_ASSERT(coil_lower_offset(&b, funcs[0].offset, &first) == COIL_ERR_GOOD && first == a.code_size, "Appended code should start at the write index");
+  
+  coil_lower_cleanup(&a);
+  coil_lower_cleanup(&b);
+  coil_lower_cleanup(&c);
+  coil_section_cleanup(&serial);
+  coil_section_cleanup(&parallel);
+  coil_section_cleanup(&whole);
+  coil_section_cleanup(&ir);
+  return 0;
+}
+
+/**
+* @brief Lower a single instruction built by the caller
+*/
+static coil_err_t test_lower_one(coil_section_t *ir, const coil_lower_options_t *options) {
+  coil_section_t out;
+  coil_lower_t lower;
+  coil_section_init(&out, 0);
+  coil_err_t err = coil_lower_section(&lower, &out, ir, NULL, 0, options);
+  coil_lower_cleanup(&lower);
+  coil_section_cleanup(&out);
+  coil_section_cleanup(ir);
+  coil_section_init(ir, 64);
+  return err;
+}
+
+/**
+* @brief Instructions without a CBC equivalent and malformed input
+*/
+static int test_lower_errors() {
+  coil_section_t ir;
+  TEST_ASSERT(coil_section_init(&ir, 64) == COIL_ERR_GOOD, "Section init should succeed");
+  
+  coil_instrflag_encode(&ir, COIL_OP_SPARAM, COIL_INSTRFLAG_NONE);
+  TEST_ASSERT(test_lower_one(&ir, NULL) == COIL_ERR_NOTSUP, "ABI directives should not lower");
+  coil_instrflag_encode(&ir, COIL_OP_MOV, COIL_INSTRFLAG_EQ);
+  test_lower_operand(&ir, COIL_TYPEOP_REG, COIL_VAL_I32, 1);
+  test_lower_operand(&ir, COIL_TYPEOP_REG, COIL_VAL_I32, 2);
+  TEST_ASSERT(test_lower_one(&ir, NULL) == COIL_ERR_NOTSUP, "Conditional moves should not lower");
+  coil_instr_encode(&ir, COIL_OP_JMP);
+  test_lower_operand(&ir, COIL_TYPEOP_IMM, COIL_VAL_U32, 0);
+  TEST_ASSERT(test_lower_one(&ir, NULL) == COIL_ERR_NOTSUP, "Immediate branch targets should not lower");
+  coil_instrflag_encode(&ir, COIL_OP_PUSH, COIL_INSTRFLAG_NONE);
+  test_lower_operand(&ir, COIL_TYPEOP_EXP, COIL_VAL_EXP, 0);
+  TEST_ASSERT(test_lower_one(&ir, NULL) == COIL_ERR_NOTSUP, "Expression operands should not lower");
+  coil_instrflag_encode(&ir, COIL_OP_PUSH, COIL_INSTRFLAG_NONE);
+  test_lower_operand(&ir, COIL_TYPEOP_IMM, COIL_VAL_VOID, 0);
+  TEST_ASSERT(test_lower_one(&ir, NULL) == COIL_ERR_NOTSUP, "Data-less immediates should not lower");
+  coil_instrflag_encode(&ir, COIL_OP_PUSH, COIL_INSTRFLAG_NONE);
+  test_lower_offset(&ir, COIL_VAL_REG, 1, 0x80000000ull, 0, 0);
+  TEST_ASSERT(test_lower_one(&ir, NULL) == COIL_ERR_NOTSUP, "Wide displacements should not lower");
+  
+  coil_instrflag_encode(&ir, COIL_OP_PUSH, COIL_INSTRFLAG_NONE);
+  test_lower_operand(&ir, COIL_TYPEOP_REG, COIL_VAL_I32, COIL_CBC_REGISTERS);
+  TEST_ASSERT(test_lower_one(&ir, NULL) == COIL_ERR_FORMAT, "Unknown registers should be rejected");
+  coil_instrflag_encode(&ir, COIL_OP_MOV, COIL_INSTRFLAG_NONE);
+  test_lower_operand(&ir, COIL_TYPEOP_IMM, COIL_VAL_I32, 1);
+  test_lower_operand(&ir, COIL_TYPEOP_REG, COIL_VAL_I32, 2);
+  TEST_ASSERT(test_lower_one(&ir, NULL) == COIL_ERR_FORMAT, "Immediate destinations should be rejected");
+  coil_instrflag_encode(&ir, COIL_OP_LEA, COIL_INSTRFLAG_NONE);
+  test_lower_operand(&ir, COIL_TYPEOP_REG, COIL_VAL_PTR, 1);
+  test_lower_operand(&ir, COIL_TYPEOP_REG, COIL_VAL_PTR, 2);
+  TEST_ASSERT(test_lower_one(&ir, NULL) == COIL_ERR_FORMAT, "LEA of a register should be rejected");
+  coil_instrflag_encode(&ir, COIL_OP_BR, COIL_INSTRFLAG_LTE + 1);
+  test_lower_operand(&ir, COIL_TYPEOP_SYM, COIL_VAL_SYM, 0);
+  TEST_ASSERT(test_lower_one(&ir, NULL) == COIL_ERR_FORMAT, "Unknown conditions should be rejected");
+  coil_instr_encode(&ir, 0x30);
+  TEST_ASSERT(test_lower_one(&ir, NULL) == COIL_ERR_FORMAT, "Unknown opcodes should be rejected");
+  coil_instrflag_encode(&ir, COIL_OP_PUSH, COIL_INSTRFLAG_NONE);
+  TEST_ASSERT(test_lower_one(&ir, NULL) == COIL_ERR_FORMAT, "Truncated instructions should be rejected");
+  
+  // The first failure in section order is reported and nothing is written
+  coil_section_t out;
+  coil_lower_t lower;
+  TEST_ASSERT(coil_section_init(&out, 0) == COIL_ERR_GOOD, "Section init should succeed");
+  coil_instr_encode(&ir, COIL_OP_RET);
+  coil_u64_t second = ir.size;
+  coil_instr_encode(&ir, COIL_OP_NOP);
+  coil_u64_t bad = ir.size;
+  coil_instrflag_encode(&ir, COIL_OP_PUSH, COIL_INSTRFLAG_NONE);
+  test_lower_operand(&ir, COIL_TYPEOP_REG, COIL_VAL_U8, 99);
+  coil_u64_t third = ir.size;
+  coil_instrflag_encode(&ir, COIL_OP_SRET, COIL_INSTRFLAG_NONE);
+  coil_lower_func_t funcs[3] = { { 0, second }, { second, third - second }, { third, ir.size - third } };
+  TEST_ASSERT(coil_lower_section(&lower, &out, &ir, funcs, 3, NULL) == COIL_ERR_FORMAT, "Failures should be reported");
+  TEST_ASSERT(lower.fault == bad && out.size == 0 && lower.cbc_of == NULL, "The failing instruction should be named and nothing written");
+  
+  funcs[0].size = 2;
+  TEST_ASSERT(coil_lower_section(&lower, &out, &ir, funcs, 3, NULL) == COIL_ERR_INVAL, "Overlapping functions should be rejected");
+  funcs[0].size = second;
+  funcs[2].size = ir.size;
+  TEST_ASSERT(coil_lower_section(&lower, &out, &ir, funcs, 3, NULL) == COIL_ERR_INVAL, "Functions past the section should be rejected");
+  funcs[2].size = ir.size - third;
+  funcs[1].size = bad - second + 2;
+  TEST_ASSERT(coil_lower_section(&lower, &out, &ir, funcs, 2, NULL) == COIL_ERR_FORMAT && lower.fault == bad,
+              "Instructions crossing the function end should be rejected");
+  
+  coil_lower_options_t options;
+  coil_lower_options_init(&options);
+  options.frame_reg = COIL_CBC_REGISTERS;
+  TEST_ASSERT(coil_lower_section(&lower, &out, &ir, NULL, 0, &options) == COIL_ERR_INVAL, "Bad registers in options should be rejected");
+  coil_cbc_operand_t home = coil_cbc_imm(0);
+  coil_lower_options_init(&options);
+  options.homes = &home;
+  options.home_count = 1;
+  TEST_ASSERT(coil_lower_section(&lower, &out, &ir, NULL, 0, &options) == COIL_ERR_INVAL, "Immediate homes should be rejected");
+  TEST_ASSERT(coil_lower_section(NULL, &out, &ir, NULL, 0, NULL) == COIL_ERR_INVAL, "NULL results should be rejected");
+  coil_u64_t offset;
+  TEST_ASSERT(coil_lower_offset(&lower, 0, &offset) == COIL_ERR_INVAL, "Failed results should have no offsets");
+  
+  coil_section_t chunked;
+  TEST_ASSERT(coil_section_init_chunked(&chunked, 64) == COIL_ERR_GOOD, "Chunked section init should succeed");
+  coil_instr_encode(&chunked, COIL_OP_RET);
+  TEST_ASSERT(coil_lower_section(&lower, &out, &chunked, NULL, 0, NULL) == COIL_ERR_BADSTATE, "Chunked input should be rejected");
+  
+  coil_section_cleanup(&chunked);
+  coil_section_cleanup(&out);
+  coil_section_cleanup(&ir);
+  return 0;
+}
+
+/**
+* @brief Run all lowering tests
+*/
+int test_lower() {
+  printf("\nRunning lowering tests...\n");
+  
+  int result = 0;
+  
+  result |= test_lower_program();
+  result |= test_lower_forms();
+  result |= test_lower_parallel();
+  result |= test_lower_errors();
+  
+  if (result == 0) {
+    printf("All lowering tests passed!\n");
+  }
+  
+  return result;
+}
@@ -11,12 +11,24 @@
 
 extern int test_err();
 extern int test_mem();
+extern int test_pool();
 extern int test_log();
 extern int test_file();
 extern int test_section();
 extern int test_object();
+extern int test_strtab();
+extern int test_sym();
+extern int test_reloc();
+extern int test_archive();
 extern int test_instr();
 extern int test_mmap();
+extern int test_cbc();
+extern int test_jit();
+extern int test_lower();
+extern int test_cfg();
+extern int test_dflow();
+extern int test_regalloc();
+extern int test_peep();
 
 /**
 * @brief Run all test suites and report results
@@ -42,6 +54,13 @@ int main(int argc, char *argv[]) {
     printf("Memory module tests PASSED\n");
   }
   
+  if (test_pool() != 0) {
+    printf("Pool module tests FAILED\n");
+    failed++;
+  } else {
+    printf("Pool module tests PASSED\n");
+  }
+  
   if (test_log() != 0) {
     printf("Logging module tests FAILED\n");
     failed++;
@@ -70,6 +89,34 @@ int main(int argc, char *argv[]) {
     printf("Object module tests PASSED\n");
   }
   
+  if (test_strtab() != 0) {
+    printf("String table tests FAILED\n");
+    failed++;
+  } else {
+    printf("String table tests PASSED\n");
+  }
+  
+  if (test_sym() != 0) {
+    printf("Symbol table tests FAILED\n");
+    failed++;
+  } else {
+    printf("Symbol table tests PASSED\n");
+  }
+  
+  if (test_reloc() != 0) {
+    printf("Relocation tests FAILED\n");
+    failed++;
+  } else {
+    printf("Relocation tests PASSED\n");
+  }
+  
+  if (test_archive() != 0) {
+    printf("Archive tests FAILED\n");
+    failed++;
+  } else {
+    printf("Archive tests PASSED\n");
+  }
+  
   if (test_instr() != 0) {
     printf("Instruction module tests FAILED\n");
     failed++;
@@ -84,6 +131,55 @@ int main(int argc, char *argv[]) {
     printf("Memory mapping tests PASSED\n");
   }
   
+  if (test_cbc() != 0) {
+    printf("CBC tests FAILED\n");
+    failed++;
+  } else {
+    printf("CBC tests PASSED\n");
+  }
+  
+  if (test_jit() != 0) {
+    printf("JIT tests FAILED\n");
+    failed++;
+  } else {
+    printf("JIT tests PASSED\n");
+  }
+  
+  if (test_lower() != 0) {
+    printf("Lowering tests FAILED\n");
+    failed++;
+  } else {
+    printf("Lowering tests PASSED\n");
+  }
+  
+  if (test_cfg() != 0) {
+    printf("Control-flow graph tests FAILED\n");
+    failed++;
+  } else {
+    printf("Control-flow graph tests PASSED\n");
+  }
+  
+  if (test_dflow() != 0) {
+    printf("Dataflow tests FAILED\n");
+    failed++;
+  } else {
+    printf("Dataflow tests PASSED\n");
+  }
+  
+  if (test_regalloc() != 0) {
+    printf("Register allocation tests FAILED\n");
+    failed++;
+  } else {
+    printf("Register allocation tests PASSED\n");
+  }
+  
+  if (test_peep() != 0) {
+    printf("Peephole tests FAILED\n");
+    failed++;
+  } else {
+    printf("Peephole tests PASSED\n");
+  }
+  
   // Print summary
   printf("\nTest Summary: ");
   if (failed == 0) {
@@ -126,6 +126,12 @@ static int test_mmap() {
   // Test we can write to the memory
   memset(mem, 0xAA, page_size);
   
+  // Test access hints, including an unaligned start inside the mapping
+  TEST_ASSERT(coil_madvise(mem, page_size, COIL_ADVICE_SEQUENTIAL) == COIL_ERR_GOOD, "madvise sequential should succeed");
+  TEST_ASSERT(coil_madvise((char *)mem + 100, 200, COIL_ADVICE_WILLNEED) == COIL_ERR_GOOD, "madvise on unaligned range should succeed");
+  TEST_ASSERT(coil_madvise(mem, page_size, (coil_advice_t)42) == COIL_ERR_INVAL, "madvise with unknown advice should fail");
+  TEST_ASSERT(coil_madvise(NULL, page_size, COIL_ADVICE_NORMAL) == COIL_ERR_INVAL, "madvise with NULL should fail");
+  
   // Test freeing
   TEST_ASSERT(coil_munmap(mem, page_size) == COIL_ERR_GOOD, "munmap should succeed");
   
@@ -6,6 +6,7 @@
 */
 
 #include <coil/obj.h>
+#include <coil/reloc.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -13,6 +14,7 @@
 #include <fcntl.h>
 #include <sys/mman.h>
 #include <sys/stat.h>
+#include <sys/wait.h>
 
 // Test macros
 #define TEST_ASSERT(cond, msg) do { \
@@ -24,6 +26,8 @@
 
 #define TEST_MMAP_OBJECT_FILE "test_mmap.coil"
 #define TEST_MMAP_SECTION_FILE "test_mmap_section.dat"
+#define TEST_MMAP_COW_FILE "test_mmap_cow.coil"
+#define TEST_MMAP_EXEC_FILE "test_mmap_exec.coil"
 
 /**
 * @brief Create a test object file
@@ -66,9 +70,9 @@ static int create_test_object_file() {
     
     // Add the section to the object
     coil_u16_t sect_index;
-    coil_u8_t section_type = (i == 3) ? COIL_SECTION_NATIVE : COIL_SECTION_PROGBITS;
+    coil_u8_t section_type = COIL_SECTION_PROGBITS;
     coil_u16_t section_flags = (i == 0) ? COIL_SECTION_FLAG_CODE : 
-                               (i == 3) ? COIL_SECTION_FLAG_NATIVE : COIL_SECTION_FLAG_NONE;
+                               (i == 3) ? COIL_SECTION_FLAG_TARGET : COIL_SECTION_FLAG_NONE;
     
     err = coil_obj_create_section(&obj, section_type, section_names[i], 
                                  section_flags, &sect, &sect_index);
@@ -195,6 +199,189 @@ static int test_object_mmap() {
   return 0;
 }
 
+/**
+* @brief Test loading an object from a buffer without a descriptor
+*/
+static int test_object_memory() {
+  printf("  Testing in-memory object loading...\n");
+  
+  // Stage the object image in memory, as an artifact cache would hand it over
+  int fd = open(TEST_MMAP_OBJECT_FILE, O_RDONLY);
+  TEST_ASSERT(fd >= 0, "File open should succeed");
+  struct stat st;
+  TEST_ASSERT(fstat(fd, &st) == 0, "fstat should succeed");
+  coil_size_t size = (coil_size_t)st.st_size;
+  coil_byte_t *image = (coil_byte_t *)coil_malloc(size);
+  TEST_ASSERT(image != NULL, "Allocation should succeed");
+  TEST_ASSERT(read(fd, image, size) == (ssize_t)size, "Reading the image should succeed");
+  close(fd);
+  
+  const char *expected = "This is section 1 content - Testing memory mapping functionality";
+  const char *expected2 = "Section 2 has different content - COIL library rocks";
+  
+  // Borrowed: views alias the caller's buffer
+  coil_object_t obj;
+  coil_err_t err = coil_obj_load_memory(&obj, image, size, COIL_OBJ_MEM_BORROW);
+  TEST_ASSERT(err == COIL_ERR_GOOD, "Loading a borrowed image should succeed");
+  TEST_ASSERT(obj.fd < 0 && !obj.is_mapped && !obj.owns_memory, "Borrowed objects have no descriptor, mapping or ownership");
+  TEST_ASSERT(obj.header.section_count == 4, "Should have 4 sections");
+  
+  coil_section_t sect;
+  err = coil_obj_load_section(&obj, 0, &sect, COIL_SLOAD_VIEW);
+  TEST_ASSERT(err == COIL_ERR_GOOD && sect.mode == COIL_SECT_MODE_VIEW, "Loading a view should succeed");
+  TEST_ASSERT(sect.data >= image && sect.data < image + size, "Views should point into the buffer");
+  TEST_ASSERT(sect.size == strlen(expected) && memcmp(sect.data, expected, sect.size) == 0, "View content should match");
+  coil_section_cleanup(&sect);
+  
+  // COW on a borrowed buffer copies rather than writing into it
+  err = coil_obj_load_section(&obj, 1, &sect, COIL_SLOAD_COW);
+  TEST_ASSERT(err == COIL_ERR_GOOD && sect.mode == COIL_SECT_MODE_MODIFY, "COW on a borrowed image should copy");
+  TEST_ASSERT(sect.data < image || sect.data >= image + size, "Copies should not alias the buffer");
+  TEST_ASSERT(memcmp(sect.data, expected2, sect.size) == 0, "Copied content should match");
+  sect.data[0] = 's';
+  coil_section_cleanup(&sect);
+  
+  coil_u16_t index;
+  TEST_ASSERT(coil_obj_find_section(&obj, ".native", &index) == COIL_ERR_GOOD, "Finding a section should succeed");
+  err = coil_obj_load_section(&obj, index, &sect, COIL_SLOAD_DEFAULT);
+  TEST_ASSERT(err == COIL_ERR_GOOD && sect.size > 0, "Copying a section out of the image should succeed");
+  coil_section_cleanup(&sect);
+  
+  // Detaching copies every section, the buffer is no longer needed afterwards
+  TEST_ASSERT(coil_obj_unmap(&obj) == COIL_ERR_GOOD, "Detaching from the buffer should succeed");
+  TEST_ASSERT(obj.memory == NULL, "memory should be NULL after detaching");
+  err = coil_obj_load_section(&obj, 1, &sect, COIL_SLOAD_DEFAULT);
+  TEST_ASSERT(err == COIL_ERR_GOOD && memcmp(sect.data, expected2, sect.size) == 0, "Sections should survive detaching");
+  coil_section_cleanup(&sect);
+  coil_obj_cleanup(&obj);
+  TEST_ASSERT(memcmp(image, "COIL", 4) == 0, "Borrowed buffers should stay with the caller");
+  
+  // Copied: the caller's buffer can change right after the load
+  err = coil_obj_load_memory(&obj, image, size, COIL_OBJ_MEM_COPY);
+  TEST_ASSERT(err == COIL_ERR_GOOD && obj.owns_memory, "Loading a copy should succeed");
+  coil_memset(image + sizeof(coil_object_header_t), 0, size - sizeof(coil_object_header_t));
+  err = coil_obj_load_section(&obj, 0, &sect, COIL_SLOAD_VIEW);
+  TEST_ASSERT(err == COIL_ERR_GOOD && memcmp(sect.data, expected, sect.size) == 0, "Copies should be independent of the buffer");
+  coil_section_cleanup(&sect);
+  
+  // Owned images are writable, COW views write in place
+  err = coil_obj_load_section(&obj, 1, &sect, COIL_SLOAD_COW);
+  TEST_ASSERT(err == COIL_ERR_GOOD && sect.mode == COIL_SECT_MODE_COW, "COW on an owned image should not copy");
+  TEST_ASSERT(sect.data >= obj.memory && sect.data < obj.memory + obj.header.file_size, "COW views should alias the image");
+  coil_section_cleanup(&sect);
+  
+  // Keep a heap copy of the image to hand over
+  coil_u64_t image_size = obj.header.file_size;
+  coil_byte_t *saved = (coil_byte_t *)coil_malloc(image_size);
+  TEST_ASSERT(saved != NULL, "Allocation should succeed");
+  coil_memcpy(saved, obj.memory, image_size);
+  coil_obj_cleanup(&obj);
+  coil_free(image);
+  
+  // Taken: the object frees the buffer
+  err = coil_obj_load_memory(&obj, saved, image_size, COIL_OBJ_MEM_TAKE);
+  TEST_ASSERT(err == COIL_ERR_GOOD && obj.owns_memory && obj.memory == saved, "Taking over a buffer should not copy");
+  err = coil_obj_load_section(&obj, 3, &sect, COIL_SLOAD_VIEW);
+  TEST_ASSERT(err == COIL_ERR_GOOD && sect.data >= saved, "Views should point into the taken buffer");
+  coil_section_cleanup(&sect);
+  coil_obj_cleanup(&obj);
+  
+  // Malformed images are rejected
+  coil_byte_t bad[sizeof(coil_object_header_t) + sizeof(coil_section_header_t)];
+  coil_memset(bad, 0, sizeof(bad));
+  TEST_ASSERT(coil_obj_load_memory(&obj, bad, sizeof(bad), COIL_OBJ_MEM_BORROW) == COIL_ERR_FORMAT, "Bad magic should be rejected");
+  
+  coil_object_header_t *header = (coil_object_header_t *)bad;
+  coil_memcpy(header->magic, "COIL", 4);
+  header->section_count = 1;
+  header->file_size = sizeof(bad);
+  coil_section_header_t *sh = (coil_section_header_t *)(bad + sizeof(coil_object_header_t));
+  sh->offset = sizeof(bad);
+  sh->size = 16;
+  TEST_ASSERT(coil_obj_load_memory(&obj, bad, sizeof(bad), COIL_OBJ_MEM_BORROW) == COIL_ERR_FORMAT, "Sections past the image should be rejected");
+  TEST_ASSERT(coil_obj_load_memory(&obj, bad, 4, COIL_OBJ_MEM_BORROW) == COIL_ERR_FORMAT, "Truncated images should be rejected");
+  TEST_ASSERT(coil_obj_load_memory(&obj, NULL, 4, COIL_OBJ_MEM_BORROW) == COIL_ERR_INVAL, "NULL images should be rejected");
+  TEST_ASSERT(coil_obj_load_memory(&obj, bad, sizeof(bad), COIL_OBJ_MEM_COPY | COIL_OBJ_MEM_TAKE) == COIL_ERR_INVAL, "Conflicting flags should be rejected");
+  
+  return 0;
+}
+
+/**
+* @brief Test handing an object to another process through a sealed memfd
+*/
+static int test_object_memfd() {
+  printf("  Testing memfd object handoff...\n");
+  
+  int fd = open(TEST_MMAP_OBJECT_FILE, O_RDWR);
+  TEST_ASSERT(fd >= 0, "File open should succeed");
+  
+  coil_object_t obj;
+  TEST_ASSERT(coil_obj_mmap(&obj, fd) == COIL_ERR_GOOD, "Memory mapping object should succeed");
+  
+  coil_descriptor_t memfd;
+  coil_err_t err = coil_obj_export_memfd(&obj, &memfd);
+  coil_obj_cleanup(&obj);
+  if (err == COIL_ERR_NOTSUP) {
+    printf("  Sealed memfds not supported, skipping\n");
+    return 0;
+  }
+  TEST_ASSERT(err == COIL_ERR_GOOD, "Exporting to a memfd should succeed");
+  
+  // The image is immutable once exported
+  TEST_ASSERT(write(memfd, "X", 1) == -1, "Writes to a sealed memfd should fail");
+  TEST_ASSERT(ftruncate(memfd, 0) == -1, "Truncating a sealed memfd should fail");
+  
+  const char *expected = "Section 2 has different content - COIL library rocks";
+  
+  // The next pipeline stage maps the same pages
+  pid_t pid = fork();
+  TEST_ASSERT(pid >= 0, "fork should succeed");
+  if (pid == 0) {
+    coil_object_t child;
+    coil_section_t sect;
+    int ok = coil_obj_import_memfd(&child, memfd) == COIL_ERR_GOOD &&
+             coil_obj_load_section(&child, 1, &sect, COIL_SLOAD_VIEW) == COIL_ERR_GOOD &&
+             sect.size == strlen(expected) && memcmp(sect.data, expected, sect.size) == 0;
+    _exit(ok ? 0 : 1);
+  }
+  
+  int status;
+  TEST_ASSERT(waitpid(pid, &status, 0) == pid, "waitpid should succeed");
+  TEST_ASSERT(WIFEXITED(status) && WEXITSTATUS(status) == 0, "Child should read the exported object");
+  
+  // COW sections stay private to the importer
+  err = coil_obj_import_memfd(&obj, memfd);
+  TEST_ASSERT(err == COIL_ERR_GOOD && obj.fd == memfd, "Importing should take over the descriptor");
+  TEST_ASSERT(obj.read_only, "Imported images should be mapped read-only");
+  coil_section_t sect;
+  err = coil_obj_load_section(&obj, 1, &sect, COIL_SLOAD_COW);
+  TEST_ASSERT(err == COIL_ERR_GOOD && coil_section_owns_data(&sect), "COW sections should load as private copies");
+  TEST_ASSERT(sect.data != obj.memory + obj.sectheaders[1].offset, "COW sections should not alias the image");
+  sect.data[0] = 's';
+  coil_section_cleanup(&sect);
+  
+  // Promoting a view copies it out of the read-only image as well
+  coil_section_t view;
+  TEST_ASSERT(coil_obj_load_section(&obj, 2, &view, COIL_SLOAD_VIEW) == COIL_ERR_GOOD, "View sections should load");
+  TEST_ASSERT(coil_obj_promote_section(&obj, 2, &view) == COIL_ERR_GOOD, "Promoting a view should succeed");
+  TEST_ASSERT(view.data != obj.memory + obj.sectheaders[2].offset, "Promoted views should not alias the image");
+  view.data[0] = 's';
+  coil_section_cleanup(&view);
+  
+  char first;
+  TEST_ASSERT(pread(memfd, &first, 1, obj.sectheaders[1].offset) == 1 && first == 'S', "COW writes should not reach the memfd");
+  TEST_ASSERT(obj.memory[obj.sectheaders[2].offset] == 'T', "Writes should not reach the mapped image");
+  coil_obj_cleanup(&obj);
+  
+  // Plain files carry no seals
+  fd = open(TEST_MMAP_OBJECT_FILE, O_RDONLY);
+  TEST_ASSERT(fd >= 0, "File open should succeed");
+  TEST_ASSERT(coil_obj_import_memfd(&obj, fd) == COIL_ERR_BADSTATE, "Unsealed descriptors should be rejected");
+  close(fd);
+  
+  return 0;
+}
+
 /**
 * @brief Test memory mapping a section directly
 */
@@ -249,6 +436,320 @@ static int test_section_mmap() {
   return 0;
 }
 
+/**
+* @brief Test access hints on section loads and prefetching
+*/
+static int test_load_hints() {
+  printf("  Testing load hints and prefetching...\n");
+  
+  // Mapped object: hints go to the object mapping
+  int fd = open(TEST_MMAP_OBJECT_FILE, O_RDWR);
+  TEST_ASSERT(fd >= 0, "File open should succeed");
+  
+  coil_object_t obj;
+  coil_err_t err = coil_obj_mmap(&obj, fd);
+  TEST_ASSERT(err == COIL_ERR_GOOD, "Memory mapping object should succeed");
+  
+  err = coil_obj_prefetch_sections(&obj, NULL, 0);
+  TEST_ASSERT(err == COIL_ERR_GOOD, "Prefetching all sections should succeed");
+  
+  coil_u16_t bad_index = 42;
+  err = coil_obj_prefetch_sections(&obj, &bad_index, 1);
+  TEST_ASSERT(err == COIL_ERR_NOTFOUND, "Prefetching an unknown section should fail");
+  
+  coil_section_t sect;
+  err = coil_obj_load_section(&obj, 1, &sect, COIL_SLOAD_VIEW | COIL_SLOAD_SEQUENTIAL | COIL_SLOAD_WILLNEED);
+  TEST_ASSERT(err == COIL_ERR_GOOD, "Loading a view with hints should succeed");
+  
+  const char *expected = "Section 2 has different content - COIL library rocks";
+  TEST_ASSERT(sect.size == strlen(expected), "Hinted view size should match");
+  TEST_ASSERT(memcmp(sect.data, expected, sect.size) == 0, "Hinted view content should match");
+  
+  coil_section_cleanup(&sect);
+  coil_obj_cleanup(&obj);
+  
+  // Descriptor backed object: hints go through posix_fadvise
+  fd = open(TEST_MMAP_OBJECT_FILE, O_RDONLY);
+  TEST_ASSERT(fd >= 0, "File open should succeed");
+  
+  err = coil_obj_load_file(&obj, fd);
+  TEST_ASSERT(err == COIL_ERR_GOOD, "Loading object should succeed");
+  
+  coil_u16_t wanted[2] = { 2, 3 };
+  err = coil_obj_prefetch_sections(&obj, wanted, 2);
+  TEST_ASSERT(err == COIL_ERR_GOOD, "Prefetching selected sections should succeed");
+  
+  err = coil_obj_load_section(&obj, 2, &sect, COIL_SLOAD_RANDOM | COIL_SLOAD_DONTNEED);
+  TEST_ASSERT(err == COIL_ERR_GOOD, "Loading a copy with hints should succeed");
+  
+  expected = "The third section contains some technical data: [0x1234, 0x5678, 0xABCD]";
+  TEST_ASSERT(sect.size == strlen(expected), "Hinted copy size should match");
+  TEST_ASSERT(memcmp(sect.data, expected, sect.size) == 0, "Hinted copy content should match");
+  coil_section_cleanup(&sect);
+  
+  err = coil_obj_load_section(&obj, 3, &sect, COIL_SLOAD_MMAP | COIL_SLOAD_RANDOM);
+  TEST_ASSERT(err == COIL_ERR_GOOD, "Loading a mapped section with hints should succeed");
+  TEST_ASSERT(coil_section_advise(&sect, COIL_ADVICE_WILLNEED) == COIL_ERR_GOOD, "Advising a mapped section should succeed");
+  
+  coil_section_t heap_sect;
+  err = coil_section_init(&heap_sect, 64);
+  TEST_ASSERT(err == COIL_ERR_GOOD, "Section initialization should succeed");
+  TEST_ASSERT(coil_section_advise(&heap_sect, COIL_ADVICE_WILLNEED) == COIL_ERR_BADSTATE, "Advising a heap section should fail");
+  
+  coil_section_cleanup(&heap_sect);
+  coil_obj_cleanup(&obj);
+  
+  return 0;
+}
+
+/**
+* @brief Test copy-on-write promotion of mapped sections
+*/
+static int test_cow_sections() {
+  printf("  Testing copy-on-write sections...\n");
+  
+  // Patch a mapped object in place and save it without unmapping
+  int fd = open(TEST_MMAP_OBJECT_FILE, O_RDONLY);
+  TEST_ASSERT(fd >= 0, "File open should succeed");
+  
+  coil_object_t obj;
+  coil_err_t err = coil_obj_mmap(&obj, fd);
+  TEST_ASSERT(err == COIL_ERR_GOOD, "Memory mapping object should succeed");
+  
+  coil_section_t sect;
+  err = coil_obj_load_section(&obj, 1, &sect, COIL_SLOAD_COW);
+  TEST_ASSERT(err == COIL_ERR_GOOD, "Loading a COW section should succeed");
+  TEST_ASSERT(sect.mode == COIL_SECT_MODE_COW, "Section should be in COW mode");
+  
+  coil_size_t written;
+  err = coil_section_write(&sect, (coil_byte_t *)"SECTION", 7, &written);
+  TEST_ASSERT(err == COIL_ERR_GOOD && written == 7, "Writing a COW section should succeed");
+  TEST_ASSERT(sect.mode == COIL_SECT_MODE_COW, "In place writes should keep COW mode");
+  
+  // Releasing a neighbour on the same page keeps the private write
+  coil_size_t page_size = coil_get_page_size();
+  TEST_ASSERT(obj.sectheaders[1].offset / page_size == obj.sectheaders[2].offset / page_size, 
+              "Sections 1 and 2 should share a page");
+  
+  coil_section_t view;
+  err = coil_obj_load_section(&obj, 2, &view, COIL_SLOAD_VIEW | COIL_SLOAD_DONTNEED);
+  TEST_ASSERT(err == COIL_ERR_GOOD, "Loading a view should succeed");
+  TEST_ASSERT(memcmp(sect.data, "SECTION", 7) == 0, "DONTNEED on a neighbour should keep COW writes");
+  TEST_ASSERT(coil_section_write(&view, (coil_byte_t *)"X", 1, &written) == COIL_ERR_BADSTATE, 
+              "Writing a view should fail");
+  
+  err = coil_obj_promote_section(&obj, 2, &view);
+  TEST_ASSERT(err == COIL_ERR_GOOD, "Promoting a view should succeed");
+  TEST_ASSERT(view.mode == COIL_SECT_MODE_COW, "Promoted view should be in COW mode");
+  
+  err = coil_section_seek_write(&view, 4);
+  TEST_ASSERT(err == COIL_ERR_GOOD, "Seeking a COW section should succeed");
+  err = coil_section_write(&view, (coil_byte_t *)"THIRD", 5, &written);
+  TEST_ASSERT(err == COIL_ERR_GOOD, "Writing a promoted view should succeed");
+  
+  int out = open(TEST_MMAP_COW_FILE, O_RDWR | O_CREAT | O_TRUNC, 0644);
+  TEST_ASSERT(out >= 0, "Output file open should succeed");
+  
+  err = coil_obj_save_file(&obj, out);
+  TEST_ASSERT(err == COIL_ERR_GOOD, "Saving a mapped object should succeed");
+  TEST_ASSERT(obj.is_mapped, "Saving should not unmap the object");
+  
+  coil_section_cleanup(&view);
+  coil_section_cleanup(&sect);
+  coil_obj_cleanup(&obj);
+  close(out);
+  
+  // Reload the saved copy, untouched sections must have been streamed through
+  fd = open(TEST_MMAP_COW_FILE, O_RDONLY);
+  TEST_ASSERT(fd >= 0, "Saved file open should succeed");
+  
+  err = coil_obj_mmap(&obj, fd);
+  TEST_ASSERT(err == COIL_ERR_GOOD, "Memory mapping saved object should succeed");
+  TEST_ASSERT(obj.header.section_count == 4, "Saved object should keep every section");
+  
+  const char *expected[] = {
+    "This is section 1 content - Testing memory mapping functionality",
+    "SECTION 2 has different content - COIL library rocks",
+    "The THIRD section contains some technical data: [0x1234, 0x5678, 0xABCD]",
+    "This section will contain some native code (though it's just text for testing)"
+  };
+  
+  for (coil_u16_t i = 0; i < 4; i++) {
+    err = coil_obj_load_section(&obj, i, &sect, COIL_SLOAD_VIEW);
+    TEST_ASSERT(err == COIL_ERR_GOOD, "Loading saved section should succeed");
+    TEST_ASSERT(sect.size == strlen(expected[i]), "Saved section size should match");
+    TEST_ASSERT(memcmp(sect.data, expected[i], sect.size) == 0, "Saved section content should match");
+    coil_section_cleanup(&sect);
+  }
+  
+  coil_obj_cleanup(&obj);
+  
+  // The source file is untouched by private writes
+  fd = open(TEST_MMAP_OBJECT_FILE, O_RDONLY);
+  TEST_ASSERT(fd >= 0, "File open should succeed");
+  
+  err = coil_obj_load_file(&obj, fd);
+  TEST_ASSERT(err == COIL_ERR_GOOD, "Loading object should succeed");
+  
+  // A section with its own mapping becomes writable in place
+  err = coil_obj_load_section(&obj, 3, &sect, COIL_SLOAD_MMAP | COIL_SLOAD_COW);
+  TEST_ASSERT(err == COIL_ERR_GOOD, "Loading a mapped COW section should succeed");
+  TEST_ASSERT(sect.mode == COIL_SECT_MODE_COW && sect.is_mapped, "Section should be a COW mapping");
+  TEST_ASSERT(memcmp(sect.data, "This section", 12) == 0, "Source file should be unchanged");
+  
+  coil_byte_t *mapped = sect.data;
+  err = coil_section_write(&sect, (coil_byte_t *)"That", 4, &written);
+  TEST_ASSERT(err == COIL_ERR_GOOD, "Writing a COW mapping should succeed");
+  TEST_ASSERT(sect.data == mapped, "In place writes should not move the data");
+  
+  // Dropping the pages would lose the private writes
+  TEST_ASSERT(coil_section_advise(&sect, COIL_ADVICE_DONTNEED) == COIL_ERR_BADSTATE, "COW sections should refuse DONTNEED");
+  TEST_ASSERT(coil_section_advise(&sect, COIL_ADVICE_WILLNEED) == COIL_ERR_GOOD, "Other hints should still apply");
+  TEST_ASSERT(memcmp(sect.data, "That", 4) == 0, "Private writes should survive advice");
+  
+  // Growing past the mapping copies the section into an owned buffer
+  coil_size_t size = sect.size;
+  err = coil_section_seek_write(&sect, size);
+  TEST_ASSERT(err == COIL_ERR_GOOD, "Seeking to the end should succeed");
+  err = coil_section_write(&sect, (coil_byte_t *)"!", 1, &written);
+  TEST_ASSERT(err == COIL_ERR_GOOD, "Growing a COW section should succeed");
+  TEST_ASSERT(sect.mode == COIL_SECT_MODE_MODIFY && !sect.is_mapped, "Grown section should own its data");
+  TEST_ASSERT(sect.size == size + 1, "Grown section size should match");
+  TEST_ASSERT(memcmp(sect.data, "That section", 12) == 0 && sect.data[size] == '!', 
+              "Grown section content should match");
+  
+  coil_section_cleanup(&sect);
+  
+  // Already writable sections are left alone
+  err = coil_section_init(&sect, 64);
+  TEST_ASSERT(err == COIL_ERR_GOOD, "Section initialization should succeed");
+  TEST_ASSERT(coil_section_promote(&sect) == COIL_ERR_GOOD && sect.mode == COIL_SECT_MODE_CREATE, 
+              "Promoting a writable section should be a no-op");
+  coil_section_cleanup(&sect);
+  
+  coil_obj_cleanup(&obj);
+  unlink(TEST_MMAP_COW_FILE);
+  
+  return 0;
+}
+
+/**
+* @brief Call mapped code returning an int (mov eax, imm32; ret on x86)
+*/
+static int test_exec_call(void *entry) {
+#if defined(__x86_64__) || defined(__i386__)
+  int (*fn)(void);
+  memcpy(&fn, &entry, sizeof(fn));
+  return fn();
+#else
+  (void)entry;
+  return 42;
+#endif
+}
+
+/**
+* @brief Add a native code section to an object
+*/
+static int test_exec_section(coil_object_t *obj, const char *name, const coil_byte_t *code, coil_size_t size, coil_u16_t *index) {
+  coil_section_t sect;
+  coil_size_t written;
+  TEST_ASSERT(coil_section_init(&sect, size) == COIL_ERR_GOOD, "Section initialization should succeed");
+  TEST_ASSERT(coil_section_write(&sect, (coil_byte_t *)code, size, &written) == COIL_ERR_GOOD, "Section write should succeed");
+  TEST_ASSERT(coil_obj_create_section(obj, COIL_SECTION_PROGBITS, name, COIL_SECTION_FLAG_CODE | COIL_SECTION_FLAG_TARGET, &sect, index) == COIL_ERR_GOOD, "Creating a native section should succeed");
+  coil_section_cleanup(&sect);
+  return 0;
+}
+
+/**
+* @brief Test mapping native sections for execution
+*/
+static int test_object_exec() {
+  printf("  Testing executable section mappings...\n");
+  
+  const coil_target_t *host = coil_host_target();
+  const coil_byte_t fixed[] = {(coil_byte_t)0xB8, 42, 0, 0, 0, (coil_byte_t)0xC3};
+  const coil_byte_t patched[] = {(coil_byte_t)0xB8, 0, 0, 0, 0, (coil_byte_t)0xC3};
+  coil_u64_t symvals[1] = {37};
+  
+  coil_object_t obj;
+  TEST_ASSERT(coil_obj_init(&obj, COIL_OBJ_INIT_DEFAULT) == COIL_ERR_GOOD, "Object init should succeed");
+  TEST_ASSERT(coil_obj_set_target_defaults(&obj, host->pu, host->arch, 0) == COIL_ERR_GOOD, "Setting target defaults should succeed");
+  
+  coil_u16_t fixed_index, patched_index, data_index;
+  TEST_ASSERT(test_exec_section(&obj, ".text.fixed", fixed, sizeof(fixed), &fixed_index) == 0, "Fixed code should be added");
+  TEST_ASSERT(test_exec_section(&obj, ".text.patched", patched, sizeof(patched), &patched_index) == 0, "Patched code should be added");
+  TEST_ASSERT(coil_obj_create_section(&obj, COIL_SECTION_PROGBITS, ".data", COIL_SECTION_FLAG_NONE, NULL, &data_index) == COIL_ERR_GOOD, "Creating data should succeed");
+  
+  // The immediate of the second routine is S + A
+  coil_reloc_t reloc;
+  memset(&reloc, 0, sizeof(reloc));
+  reloc.offset = 1;
+  reloc.addend = 5;
+  reloc.symbol = 0;
+  reloc.section = patched_index;
+  reloc.type = COIL_RELOC_ABS32;
+  TEST_ASSERT(coil_reloc_emit(&obj, ".rela.text", &reloc, 1, NULL) == COIL_ERR_GOOD, "Emitting relocations should succeed");
+  
+  // Objects without a file go through an anonymous copy
+  void *entry;
+  TEST_ASSERT(coil_obj_map_exec(&obj, fixed_index, NULL, 0, &entry) == COIL_ERR_GOOD, "Mapping fixed code should succeed");
+  TEST_ASSERT(test_exec_call(entry) == 42, "Fixed code should run");
+  TEST_ASSERT(coil_obj_map_exec(&obj, patched_index, symvals, 1, &entry) == COIL_ERR_GOOD, "Mapping patched code should succeed");
+  TEST_ASSERT(test_exec_call(entry) == 42, "Patched code should see its relocation");
+  TEST_ASSERT(obj.exec_count == 2, "Mappings should be tracked by the object");
+  
+  TEST_ASSERT(coil_obj_map_exec(&obj, data_index, NULL, 0, &entry) == COIL_ERR_BADSTATE, "Data sections should not be executable");
+  TEST_ASSERT(coil_obj_map_exec(&obj, patched_index, NULL, 0, &entry) == COIL_ERR_INVAL, "Relocations need symbol values");
+  TEST_ASSERT(obj.exec_count == 2, "Failed mappings should not be tracked");
+  
+  int fd = open(TEST_MMAP_EXEC_FILE, O_RDWR | O_CREAT | O_TRUNC, 0644);
+  TEST_ASSERT(fd >= 0, "File open should succeed");
+  TEST_ASSERT(coil_obj_save_file(&obj, fd) == COIL_ERR_GOOD, "Saving should succeed");
+  close(fd);
+  
+  // Other hosts cannot run the code
+  TEST_ASSERT(coil_obj_set_section_target(&obj, fixed_index, host->pu, (coil_u8_t)(host->arch + 1), 0, 0) == COIL_ERR_GOOD, "Retargeting should succeed");
+  TEST_ASSERT(coil_obj_map_exec(&obj, fixed_index, NULL, 0, &entry) == COIL_ERR_NOTSUP, "Foreign code should not be mapped");
+  coil_obj_cleanup(&obj);
+  
+  // Mapped objects map clean sections straight from the file
+  fd = open(TEST_MMAP_EXEC_FILE, O_RDONLY);
+  TEST_ASSERT(fd >= 0, "File open should succeed");
+  TEST_ASSERT(coil_obj_mmap(&obj, fd) == COIL_ERR_GOOD, "Memory mapping object should succeed");
+  
+  // Native code and the data after it start on a fresh page, no page is shared with the code
+  coil_size_t page = coil_get_page_size();
+  TEST_ASSERT(obj.sectheaders[fixed_index].offset % page == 0, "Native sections should be page aligned");
+  TEST_ASSERT(obj.sectheaders[patched_index].offset % page == 0, "Native sections should be page aligned");
+  TEST_ASSERT(obj.sectheaders[patched_index].offset >= obj.sectheaders[fixed_index].offset + page, "Native sections should not share pages");
+  TEST_ASSERT(obj.sectheaders[data_index].size == 0 || obj.sectheaders[data_index].offset % page == 0, "Data after native code should start a page");
+  TEST_ASSERT(coil_obj_map_exec(&obj, fixed_index, NULL, 0, &entry) == COIL_ERR_GOOD, "Mapping fixed code from the file should succeed");
+  TEST_ASSERT(((uintptr_t)entry & (page - 1)) == 0, "Executable mappings should start on a page");
+  TEST_ASSERT(test_exec_call(entry) == 42, "Fixed code from the file should run");
+  
+  void *patched_entry;
+  symvals[0] = 95;
+  TEST_ASSERT(coil_obj_map_exec(&obj, patched_index, symvals, 1, &patched_entry) == COIL_ERR_GOOD, "Mapping patched code from the file should succeed");
+  TEST_ASSERT(test_exec_call(patched_entry) == 100, "Relocations should be applied to the private mapping");
+  TEST_ASSERT(coil_obj_map_exec(&obj, patched_index, symvals, 0, &patched_entry) == COIL_ERR_FORMAT, "Unknown symbols should be rejected");
+  
+  // The image itself is untouched by relocation
+  coil_section_t sect;
+  TEST_ASSERT(coil_obj_load_section(&obj, patched_index, &sect, COIL_SLOAD_VIEW) == COIL_ERR_GOOD, "Loading the section should succeed");
+  TEST_ASSERT(memcmp(sect.data, patched, sizeof(patched)) == 0, "Relocations should not reach the object image");
+  coil_section_cleanup(&sect);
+  
+  TEST_ASSERT(coil_obj_unmap_exec(&obj, entry) == COIL_ERR_GOOD, "Unmapping should succeed");
+  TEST_ASSERT(coil_obj_unmap_exec(&obj, entry) == COIL_ERR_NOTFOUND, "Mappings should only be released once");
+  TEST_ASSERT(obj.exec_count == 1, "Released mappings should be forgotten");
+  
+  // The remaining mapping goes with the object
+  coil_obj_cleanup(&obj);
+  unlink(TEST_MMAP_EXEC_FILE);
+  
+  return 0;
+}
+
 /**
 * @brief Run all memory mapping tests
 */
@@ -263,7 +764,12 @@ int test_mmap() {
   
   // Run individual test functions
   result |= test_object_mmap();
+  result |= test_object_memory();
+  result |= test_object_memfd();
   result |= test_section_mmap();
+  result |= test_load_hints();
+  result |= test_cow_sections();
+  result |= test_object_exec();
   
   // Clean up test files
   unlink(TEST_MMAP_OBJECT_FILE);
@@ -6,6 +6,8 @@
 */
 
 #include <coil/obj.h>
+#include <coil/sym.h>
+#include <coil/reloc.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -21,6 +23,7 @@
 } while (0)
 
 #define TEST_OBJECT_FILE "test_object.coil"
+#define TEST_OBJECT_COPY_FILE "test_object_copy.coil"
 
 /**
 * @brief Test object initialization and cleanup
@@ -121,10 +124,31 @@ static int test_object_sections() {
   coil_section_cleanup(&sect2);
   coil_section_cleanup(&loaded_sect);
   
-  // Delete a section
+  // Delete a section, the other one keeps its index until compaction
   err = coil_obj_delete_section(&obj, sect_index);
   TEST_ASSERT(err == COIL_ERR_GOOD, "Deleting section should succeed");
+  TEST_ASSERT(obj.header.section_count == 2, "Deleting should leave a tombstone");
+  TEST_ASSERT(coil_obj_section_deleted(&obj, sect_index), "Deleted section should be a tombstone");
+  TEST_ASSERT(coil_obj_delete_section(&obj, sect_index) == COIL_ERR_NOTFOUND, "Deleting twice should fail");
+  TEST_ASSERT(coil_obj_load_section(&obj, sect_index, &loaded_sect, COIL_SLOAD_DEFAULT) == COIL_ERR_NOTFOUND, 
+              "Loading a deleted section should fail");
+  
+  TEST_ASSERT(coil_obj_find_section(&obj, ".text", &found_index) == COIL_ERR_NOTFOUND, 
+              "Deleted sections should not be found");
+  err = coil_obj_find_section(&obj, ".strtab", &found_index);
+  TEST_ASSERT(err == COIL_ERR_GOOD && found_index == sect_index2, "Other sections should keep their index");
+  
+  coil_u16_t index_map[2];
+  err = coil_obj_compact_sections(&obj, index_map);
+  TEST_ASSERT(err == COIL_ERR_GOOD, "Compacting sections should succeed");
   TEST_ASSERT(obj.header.section_count == 1, "Section count should be 1");
+  TEST_ASSERT(index_map[sect_index] == COIL_SECTION_INDEX_NONE, "Deleted section should map to none");
+  TEST_ASSERT(index_map[sect_index2] == 0, "Remaining section should be renumbered");
+  
+  err = coil_obj_load_section(&obj, index_map[sect_index2], &loaded_sect, COIL_SLOAD_DEFAULT);
+  TEST_ASSERT(err == COIL_ERR_GOOD, "Loading the renumbered section should succeed");
+  TEST_ASSERT(loaded_sect.size == test_len2, "Renumbered section data should move with it");
+  coil_section_cleanup(&loaded_sect);
   
   // Clean up the object
   coil_obj_cleanup(&obj);
@@ -184,7 +208,7 @@ static int test_target_metadata() {
                               COIL_SECTION_FLAG_CODE | COIL_SECTION_FLAG_TARGET, 
                               &native_sect, &sect_index);
   TEST_ASSERT(err == COIL_ERR_GOOD, "Creating native code section should succeed");
-
+  
   // Set different target defaults (for ARM64)
   err = coil_obj_set_target_defaults(&obj, COIL_PU_CPU, COIL_CPU_ARM64, COIL_CPU_ARM_NEON);
   TEST_ASSERT(err == COIL_ERR_GOOD, "Setting ARM64 target defaults should succeed");
@@ -279,6 +303,184 @@ static int test_target_metadata() {
   return 0;
 }
 
+/**
+* @brief Test picking the best native variant of a group for a machine
+*/
+static int test_target_selection() {
+  printf("  Testing native section variant selection...\n");
+  
+  TEST_ASSERT(sizeof(coil_section_header_t) == 48, "Section headers should stay 48 bytes");
+  
+  coil_object_t obj;
+  TEST_ASSERT(coil_obj_init(&obj, COIL_OBJ_INIT_DEFAULT) == COIL_ERR_GOOD, "Object init should succeed");
+  
+  // Group 1 holds SSE2, AVX2 and AVX-512 builds of one routine plus an ARM build
+  const char *names[4] = {".kernel.sse2", ".kernel.avx2", ".kernel.avx512", ".kernel.neon"};
+  coil_u8_t archs[4] = {COIL_CPU_x86_64, COIL_CPU_x86_64, COIL_CPU_x86_64, COIL_CPU_ARM64};
+  coil_u64_t features[4] = {
+    COIL_CPU_X86_SSE2,
+    COIL_CPU_X86_SSE2 | COIL_CPU_X86_AVX | COIL_CPU_X86_AVX2,
+    COIL_CPU_X86_SSE2 | COIL_CPU_X86_AVX | COIL_CPU_X86_AVX2 | COIL_CPU_X86_AVX512F,
+    COIL_CPU_ARM_NEON,
+  };
+  coil_u16_t index[4];
+  
+  for (int i = 0; i < 4; i++) {
+    TEST_ASSERT(coil_obj_create_section(&obj, COIL_SECTION_PROGBITS, names[i], COIL_SECTION_FLAG_CODE | COIL_SECTION_FLAG_TARGET, NULL, &index[i]) == COIL_ERR_GOOD, "Creating a variant should succeed");
+    TEST_ASSERT(obj.sectheaders[index[i]].group == 0, "Sections should start in group 0");
+    TEST_ASSERT(coil_obj_set_section_target(&obj, index[i], COIL_PU_CPU, archs[i], features[i], 1) == COIL_ERR_GOOD, "Setting the target should succeed");
+  }
+  TEST_ASSERT(coil_obj_set_section_target(&obj, 4, COIL_PU_CPU, COIL_CPU_x86_64, 0, 1) == COIL_ERR_NOTFOUND, "Unknown sections should be rejected");
+  
+  coil_target_t machine = {COIL_PU_CPU, COIL_CPU_x86_64, COIL_CPU_X86_SSE2 | COIL_CPU_X86_AVX | COIL_CPU_X86_AVX2 | COIL_CPU_X86_AES};
+  coil_u16_t selected;
+  TEST_ASSERT(coil_obj_select_section_for(&obj, 1, &machine, &selected) == COIL_ERR_GOOD, "A variant should run on the machine");
+  TEST_ASSERT(selected == index[1], "The AVX2 build should win without AVX-512");
+  
+  machine.features |= COIL_CPU_X86_AVX512F;
+  TEST_ASSERT(coil_obj_select_section_for(&obj, 1, &machine, &selected) == COIL_ERR_GOOD && selected == index[2], "The AVX-512 build should win when available");
+  
+  machine.features = COIL_CPU_X86_SSE2;
+  TEST_ASSERT(coil_obj_select_section_for(&obj, 1, &machine, &selected) == COIL_ERR_GOOD && selected == index[0], "The baseline build should run everywhere");
+  
+  machine.features = COIL_CPU_X86_MMX;
+  TEST_ASSERT(coil_obj_select_section_for(&obj, 1, &machine, &selected) == COIL_ERR_NOTFOUND, "No variant should run without SSE2");
+  TEST_ASSERT(coil_obj_select_section_for(&obj, 2, &machine, &selected) == COIL_ERR_NOTFOUND, "Empty groups should have no variant");
+  
+  machine.arch = COIL_CPU_ARM64;
+  machine.features = COIL_CPU_ARM_NEON | COIL_CPU_ARM_CRC;
+  TEST_ASSERT(coil_obj_select_section_for(&obj, 1, &machine, &selected) == COIL_ERR_GOOD && selected == index[3], "Architectures should be matched exactly");
+  
+  // Deleted variants are never selected
+  TEST_ASSERT(coil_obj_delete_section(&obj, index[3]) == COIL_ERR_GOOD, "Deleting a variant should succeed");
+  TEST_ASSERT(coil_obj_select_section_for(&obj, 1, &machine, &selected) == COIL_ERR_NOTFOUND, "Deleted variants should be skipped");
+  
+  // The host selection agrees with an explicit selection for the host and is cached
+  const coil_target_t *host = coil_host_target();
+  TEST_ASSERT(host == coil_host_target(), "Host detection should run once");
+  TEST_ASSERT(host->pu == COIL_PU_CPU, "The host should be a CPU");
+  
+  coil_u16_t expected = COIL_SECTION_INDEX_NONE;
+  coil_err_t expected_err = coil_obj_select_section_for(&obj, 1, host, &expected);
+  coil_err_t err = coil_obj_select_target_section(&obj, 1, &selected);
+  TEST_ASSERT(err == expected_err, "Host selection should match an explicit selection");
+  TEST_ASSERT(err != COIL_ERR_GOOD || selected == expected, "Host selection should pick the same variant");
+  TEST_ASSERT(obj.target_cache_count == 1, "The host selection should be cached");
+  TEST_ASSERT(coil_obj_select_target_section(&obj, 1, &selected) == expected_err, "Cached selections should give the same answer");
+  TEST_ASSERT(obj.target_cache_count == 1, "Cached selections should be reused");
+  
+  // Retargeting drops the cache
+  TEST_ASSERT(coil_obj_set_section_target(&obj, index[0], COIL_PU_CPU, host->arch, 0, 1) == COIL_ERR_GOOD, "Retargeting should succeed");
+  TEST_ASSERT(obj.target_cache_count == 0, "Retargeting should drop cached selections");
+  TEST_ASSERT(coil_obj_select_target_section(&obj, 1, &selected) == COIL_ERR_GOOD, "A featureless build should run on the host");
+  
+  // Sections without native code pick up the host defaults in group 0 but are never selected
+  coil_u16_t plain, native;
+  TEST_ASSERT(coil_obj_set_target_defaults(&obj, host->pu, host->arch, 0) == COIL_ERR_GOOD, "Setting target defaults should succeed");
+  TEST_ASSERT(coil_obj_create_section(&obj, COIL_SECTION_SYMTAB, ".symtab", COIL_SECTION_FLAG_NONE, NULL, &plain) == COIL_ERR_GOOD, "Creating a symbol table should succeed");
+  TEST_ASSERT(coil_obj_create_section(&obj, COIL_SECTION_PROGBITS, ".data", COIL_SECTION_FLAG_WRITE, NULL, NULL) == COIL_ERR_GOOD, "Creating a data section should succeed");
+  TEST_ASSERT(obj.sectheaders[plain].group == 0 && obj.sectheaders[plain].pu == host->pu, "Defaults should apply to every new section");
+  TEST_ASSERT(coil_obj_select_section_for(&obj, 0, host, &selected) == COIL_ERR_NOTFOUND, "Non-native sections should not be selected");
+  TEST_ASSERT(coil_obj_create_section(&obj, COIL_SECTION_PROGBITS, ".text", COIL_SECTION_FLAG_CODE | COIL_SECTION_FLAG_TARGET, NULL, &native) == COIL_ERR_GOOD, "Creating a native section should succeed");
+  TEST_ASSERT(coil_obj_select_section_for(&obj, 0, host, &selected) == COIL_ERR_GOOD && selected == native, "Only the native section should be selected");
+  
+  coil_obj_cleanup(&obj);
+  return 0;
+}
+
+/**
+* @brief Brute-force reference for target queries
+*/
+static coil_u16_t test_target_scan(coil_object_t *obj, const coil_target_query_t *query, coil_u16_t *indices) {
+  coil_u16_t count = 0;
+  for (coil_u16_t i = 0; i < obj->header.section_count; i++) {
+    const coil_section_header_t *header = &obj->sectheaders[i];
+    if (coil_obj_section_deleted(obj, i)) {
+      continue;
+    }
+    if ((query->match & COIL_TARGET_MATCH_PU) && header->pu != query->pu) {
+      continue;
+    }
+    if ((query->match & COIL_TARGET_MATCH_ARCH) && header->raw_arch != query->arch) {
+      continue;
+    }
+    if ((query->match & COIL_TARGET_MATCH_FEATURES) && (header->features & ~query->max_features) != 0) {
+      continue;
+    }
+    indices[count++] = i;
+  }
+  return count;
+}
+
+/**
+* @brief Test the target metadata index against a header scan
+*/
+static int test_target_index() {
+  printf("  Testing target metadata index queries...\n");
+  
+  coil_object_t obj;
+  TEST_ASSERT(coil_obj_init(&obj, COIL_OBJ_INIT_DEFAULT) == COIL_ERR_GOOD, "Object init should succeed");
+  
+  // A few hundred variants spread over units, architectures and feature sets
+  const coil_u16_t count = 300;
+  coil_pu_t pus[3] = {COIL_PU_CPU, COIL_PU_GPU, COIL_PU_NONE};
+  coil_u8_t archs[4] = {COIL_CPU_x86_64, COIL_CPU_ARM64, COIL_CPU_x86_32, COIL_GPU_NV_CU};
+  for (coil_u16_t i = 0; i < count; i++) {
+    char name[32];
+    snprintf(name, sizeof(name), ".variant.%u", (unsigned)i);
+    coil_u64_t features = ((coil_u64_t)(i * 2654435761u) & 0x3FF) | (i % 37 == 0 ? (coil_u64_t)1 << 63 : 0);
+    TEST_ASSERT(coil_obj_set_target_defaults(&obj, pus[i % 3], archs[i % 4], features) == COIL_ERR_GOOD, "Setting defaults should succeed");
+    TEST_ASSERT(coil_obj_create_section(&obj, COIL_SECTION_PROGBITS, name, COIL_SECTION_FLAG_TARGET, NULL, NULL) == COIL_ERR_GOOD, "Creating a variant should succeed");
+  }
+  for (coil_u16_t i = 5; i < count; i += 17) {
+    TEST_ASSERT(coil_obj_delete_section(&obj, i) == COIL_ERR_GOOD, "Deleting a variant should succeed");
+  }
+  
+  const coil_target_index_t *index;
+  TEST_ASSERT(coil_obj_target_index(&obj, &index) == COIL_ERR_GOOD, "Building the index should succeed");
+  TEST_ASSERT(index->words == (count + 63) / 64, "Bitmaps should cover every section");
+  const coil_target_index_t *again;
+  TEST_ASSERT(coil_obj_target_index(&obj, &again) == COIL_ERR_GOOD && again == index, "The index should be cached");
+  
+  coil_target_query_t queries[] = {
+    {COIL_TARGET_MATCH_PU, COIL_PU_GPU, 0, 0},
+    {COIL_TARGET_MATCH_ARCH, 0, COIL_CPU_ARM64, 0},
+    {COIL_TARGET_MATCH_PU | COIL_TARGET_MATCH_ARCH | COIL_TARGET_MATCH_FEATURES, COIL_PU_CPU, COIL_CPU_x86_64, 0x0FF},
+    {COIL_TARGET_MATCH_FEATURES, 0, 0, 0},
+    {COIL_TARGET_MATCH_FEATURES, 0, 0, ~(coil_u64_t)0},
+    {COIL_TARGET_MATCH_PU, COIL_PU_FPGA, 0, 0},
+    {COIL_TARGET_MATCH_ARCH, 0, 0x7F, 0},
+    {0, 0, 0, 0},
+  };
+  
+  coil_u16_t expected[300];
+  coil_u16_t found[300];
+  for (coil_size_t q = 0; q < sizeof(queries) / sizeof(queries[0]); q++) {
+    coil_u16_t expected_count = test_target_scan(&obj, &queries[q], expected);
+    coil_u16_t found_count;
+    TEST_ASSERT(coil_obj_find_targets(&obj, &queries[q], found, count, &found_count) == COIL_ERR_GOOD, "Queries should succeed");
+    TEST_ASSERT(found_count == expected_count, "Query should match as many sections as a scan");
+    TEST_ASSERT(memcmp(found, expected, found_count * sizeof(coil_u16_t)) == 0, "Query should match the same sections as a scan");
+  }
+  
+  // Short buffers still report the full count
+  coil_u16_t total;
+  TEST_ASSERT(coil_obj_find_targets(&obj, &queries[7], found, 4, &total) == COIL_ERR_GOOD, "Short queries should succeed");
+  TEST_ASSERT(total == test_target_scan(&obj, &queries[7], expected) && memcmp(found, expected, 4 * sizeof(coil_u16_t)) == 0, "Short queries should report every match");
+  TEST_ASSERT(coil_obj_find_targets(&obj, &queries[7], NULL, 0, &total) == COIL_ERR_GOOD, "Counting queries should succeed");
+  TEST_ASSERT(coil_obj_find_targets(&obj, &queries[7], NULL, 4, &total) == COIL_ERR_INVAL, "Missing buffers should be rejected");
+  
+  // Changes drop the index, the next query sees them
+  TEST_ASSERT(coil_obj_set_section_target(&obj, 0, COIL_PU_FPGA, 0, 0, 0) == COIL_ERR_GOOD, "Retargeting should succeed");
+  TEST_ASSERT(obj.target_index == NULL, "Retargeting should drop the index");
+  TEST_ASSERT(coil_obj_find_targets(&obj, &queries[5], found, count, &total) == COIL_ERR_GOOD && total == 1 && found[0] == 0, "Queries should see retargeted sections");
+  TEST_ASSERT(coil_obj_create_section(&obj, COIL_SECTION_PROGBITS, ".late", COIL_SECTION_FLAG_NONE, NULL, NULL) == COIL_ERR_GOOD, "Creating a section should succeed");
+  TEST_ASSERT(obj.target_index == NULL, "New sections should drop the index");
+  
+  coil_obj_cleanup(&obj);
+  return 0;
+}
+
 /**
 * @brief Test object file I/O
 */
@@ -309,6 +511,14 @@ static int test_object_file_io() {
                               COIL_SECTION_FLAG_WRITE, &sect, &sect_index);
   TEST_ASSERT(err == COIL_ERR_GOOD, "Creating section should succeed");
   
+  // A deleted scratch section is compacted away when saving
+  coil_u16_t scratch_index;
+  err = coil_obj_create_section(&obj, COIL_SECTION_DEBUG, ".scratch", 
+                              COIL_SECTION_FLAG_NONE, NULL, &scratch_index);
+  TEST_ASSERT(err == COIL_ERR_GOOD, "Creating scratch section should succeed");
+  err = coil_obj_delete_section(&obj, scratch_index);
+  TEST_ASSERT(err == COIL_ERR_GOOD, "Deleting scratch section should succeed");
+  
   // Open a file for writing
   int fd = open(TEST_OBJECT_FILE, O_RDWR | O_CREAT | O_TRUNC, 0644);
   TEST_ASSERT(fd >= 0, "File open should succeed");
@@ -356,6 +566,302 @@ static int test_object_file_io() {
   return 0;
 }
 
+/**
+* @brief Test rewriting a loaded object without loading its unmodified sections
+*/
+static int test_object_rewrite() {
+  printf("  Testing object rewrite from source...\n");
+  
+  // A large blob, a small section that gets modified and one that is left alone
+  coil_size_t blob_size = 256 * 1024 + 3;
+  coil_byte_t *blob = (coil_byte_t *)malloc(blob_size);
+  TEST_ASSERT(blob != NULL, "Allocation should succeed");
+  for (coil_size_t i = 0; i < blob_size; i++) {
+    blob[i] = (coil_byte_t)(i * 31 % 127);
+  }
+  
+  coil_object_t obj;
+  TEST_ASSERT(coil_obj_init(&obj, COIL_OBJ_INIT_DEFAULT) == COIL_ERR_GOOD, "Object initialization should succeed");
+  
+  const char *names[] = {".blob", ".data", ".note"};
+  const coil_byte_t *contents[] = {blob, (const coil_byte_t *)"before", (const coil_byte_t *)"untouched"};
+  coil_size_t sizes[] = {blob_size, 6, 9};
+  for (int i = 0; i < 3; i++) {
+    coil_section_t sect;
+    coil_size_t written;
+    TEST_ASSERT(coil_section_init(&sect, sizes[i]) == COIL_ERR_GOOD, "Section initialization should succeed");
+    TEST_ASSERT(coil_section_write(&sect, (coil_byte_t *)contents[i], sizes[i], &written) == COIL_ERR_GOOD, "Section write should succeed");
+    TEST_ASSERT(coil_obj_create_section(&obj, COIL_SECTION_PROGBITS, names[i], COIL_SECTION_FLAG_NONE, &sect, NULL) == COIL_ERR_GOOD, "Creating section should succeed");
+    coil_section_cleanup(&sect);
+  }
+  
+  int fd = open(TEST_OBJECT_FILE, O_RDWR | O_CREAT | O_TRUNC, 0644);
+  TEST_ASSERT(fd >= 0, "File open should succeed");
+  TEST_ASSERT(coil_obj_save_file(&obj, fd) == COIL_ERR_GOOD, "Saving object should succeed");
+  close(fd);
+  coil_obj_cleanup(&obj);
+  
+  // Only the modified section is loaded, the others are copied from the source descriptor
+  fd = open(TEST_OBJECT_FILE, O_RDONLY);
+  TEST_ASSERT(fd >= 0, "File open for reading should succeed");
+  TEST_ASSERT(coil_obj_load_file(&obj, fd) == COIL_ERR_GOOD, "Loading object should succeed");
+  
+  coil_section_t sect;
+  coil_size_t written;
+  TEST_ASSERT(coil_obj_load_section(&obj, 1, &sect, COIL_SLOAD_DEFAULT) == COIL_ERR_GOOD, "Loading section should succeed");
+  sect.windex = 0;
+  sect.size = 0;
+  TEST_ASSERT(coil_section_write(&sect, (coil_byte_t *)"after!!", 7, &written) == COIL_ERR_GOOD, "Section write should succeed");
+  TEST_ASSERT(coil_obj_update_section(&obj, 1, &sect) == COIL_ERR_GOOD, "Updating section should succeed");
+  coil_section_cleanup(&sect);
+  
+  int out = open(TEST_OBJECT_COPY_FILE, O_RDWR | O_CREAT | O_TRUNC, 0644);
+  TEST_ASSERT(out >= 0, "File open should succeed");
+  TEST_ASSERT(coil_obj_save_file(&obj, out) == COIL_ERR_GOOD, "Saving the rewritten object should succeed");
+  
+  // The source ranges stay valid, saving again still copies the right bytes
+  TEST_ASSERT(coil_seek(out, 0, SEEK_SET) == COIL_ERR_GOOD, "Seek should succeed");
+  TEST_ASSERT(coil_obj_save_file(&obj, out) == COIL_ERR_GOOD, "Saving twice should succeed");
+  close(out);
+  coil_obj_cleanup(&obj);
+  
+  out = open(TEST_OBJECT_COPY_FILE, O_RDONLY);
+  TEST_ASSERT(out >= 0, "File open for reading should succeed");
+  TEST_ASSERT(coil_obj_mmap(&obj, out) == COIL_ERR_GOOD, "Mapping the rewritten object should succeed");
+  
+  const coil_byte_t *expected[] = {blob, (const coil_byte_t *)"after!!", (const coil_byte_t *)"untouched"};
+  coil_size_t expected_sizes[] = {blob_size, 7, 9};
+  for (coil_u16_t i = 0; i < 3; i++) {
+    TEST_ASSERT(coil_obj_load_section(&obj, i, &sect, COIL_SLOAD_VIEW) == COIL_ERR_GOOD, "Loading section should succeed");
+    TEST_ASSERT(sect.size == expected_sizes[i], "Rewritten section size should match");
+    TEST_ASSERT(memcmp(sect.data, expected[i], sect.size) == 0, "Rewritten section data should match");
+    coil_section_cleanup(&sect);
+  }
+  
+  coil_obj_cleanup(&obj);
+  unlink(TEST_OBJECT_COPY_FILE);
+  
+  // Saving over the mapped source: growing the first section moves the blob onto bytes not yet copied
+  TEST_ASSERT(coil_obj_init(&obj, COIL_OBJ_INIT_DEFAULT) == COIL_ERR_GOOD, "Object initialization should succeed");
+  const char *grown_names[] = {".head", ".blob"};
+  const coil_byte_t *grown_contents[] = {(const coil_byte_t *)"head", blob};
+  coil_size_t grown_sizes[] = {4, blob_size};
+  for (int i = 0; i < 2; i++) {
+    TEST_ASSERT(coil_section_init(&sect, grown_sizes[i]) == COIL_ERR_GOOD, "Section initialization should succeed");
+    TEST_ASSERT(coil_section_write(&sect, (coil_byte_t *)grown_contents[i], grown_sizes[i], &written) == COIL_ERR_GOOD, "Section write should succeed");
+    TEST_ASSERT(coil_obj_create_section(&obj, COIL_SECTION_PROGBITS, grown_names[i], COIL_SECTION_FLAG_NONE, &sect, NULL) == COIL_ERR_GOOD, "Creating section should succeed");
+    coil_section_cleanup(&sect);
+  }
+  fd = open(TEST_OBJECT_FILE, O_RDWR | O_CREAT | O_TRUNC, 0644);
+  TEST_ASSERT(fd >= 0, "File open should succeed");
+  TEST_ASSERT(coil_obj_save_file(&obj, fd) == COIL_ERR_GOOD, "Saving object should succeed");
+  close(fd);
+  coil_obj_cleanup(&obj);
+  
+  fd = open(TEST_OBJECT_FILE, O_RDWR);
+  TEST_ASSERT(fd >= 0, "File open should succeed");
+  TEST_ASSERT(coil_obj_mmap(&obj, fd) == COIL_ERR_GOOD, "Mapping the object should succeed");
+  coil_section_t view;
+  TEST_ASSERT(coil_obj_load_section(&obj, 1, &view, COIL_SLOAD_VIEW) == COIL_ERR_GOOD, "Loading a view should succeed");
+  TEST_ASSERT(coil_obj_load_section(&obj, 0, &sect, COIL_SLOAD_DEFAULT) == COIL_ERR_GOOD, "Loading section should succeed");
+  coil_byte_t *pad = (coil_byte_t *)calloc(4000, 1);
+  TEST_ASSERT(pad != NULL, "Allocation should succeed");
+  sect.windex = sect.size;
+  TEST_ASSERT(coil_section_write(&sect, pad, 4000, &written) == COIL_ERR_GOOD, "Section write should succeed");
+  free(pad);
+  TEST_ASSERT(coil_obj_update_section(&obj, 0, &sect) == COIL_ERR_GOOD, "Updating section should succeed");
+  coil_section_cleanup(&sect);
+  
+  TEST_ASSERT(coil_seek(fd, 0, SEEK_SET) == COIL_ERR_GOOD, "Seek should succeed");
+  TEST_ASSERT(coil_obj_save_file(&obj, fd) == COIL_ERR_GOOD, "Saving over the source should succeed");
+  TEST_ASSERT(obj.memory == NULL, "Saving over the source should release the old image");
+  coil_obj_cleanup(&obj);
+  
+  fd = open(TEST_OBJECT_FILE, O_RDONLY);
+  TEST_ASSERT(fd >= 0, "File open for reading should succeed");
+  TEST_ASSERT(coil_obj_mmap(&obj, fd) == COIL_ERR_GOOD, "Mapping the saved object should succeed");
+  TEST_ASSERT(coil_obj_load_section(&obj, 0, &sect, COIL_SLOAD_VIEW) == COIL_ERR_GOOD && sect.size == 4004, "The grown section should be saved");
+  TEST_ASSERT(coil_obj_load_section(&obj, 1, &sect, COIL_SLOAD_VIEW) == COIL_ERR_GOOD, "Loading section should succeed");
+  TEST_ASSERT(sect.size == blob_size && memcmp(sect.data, blob, blob_size) == 0, "Sections after it should survive the rewrite");
+  coil_obj_cleanup(&obj);
+  
+  // Overlapping ranges of one file are refused rather than copied onto themselves
+  fd = open(TEST_OBJECT_FILE, O_RDWR);
+  TEST_ASSERT(fd >= 0, "File open should succeed");
+  TEST_ASSERT(coil_copy_range_at(fd, 0, fd, 16, 64) == COIL_ERR_BADSTATE, "Overlapping copies should be rejected");
+  TEST_ASSERT(coil_copy_range_at(fd, 0, fd, 64, 64) == COIL_ERR_GOOD, "Disjoint copies within a file should succeed");
+  close(fd);
+  free(blob);
+  
+  return 0;
+}
+
+/**
+* @brief Test that a parallel save writes the same file as a serial one
+*/
+static int test_object_parallel_save() {
+  printf("  Testing parallel object save...\n");
+  
+  coil_object_t obj;
+  TEST_ASSERT(coil_obj_init(&obj, COIL_OBJ_INIT_DEFAULT) == COIL_ERR_GOOD, "Object initialization should succeed");
+  
+  // Uneven section sizes, an empty section and a chunked one
+  char name[32];
+  coil_byte_t fill[4096];
+  for (int i = 0; i < 24; i++) {
+    coil_section_t sect;
+    coil_size_t written;
+    if (i == 5) {
+      TEST_ASSERT(coil_section_init_chunked(&sect, 1024) == COIL_ERR_GOOD, "Chunked section initialization should succeed");
+    } else {
+      TEST_ASSERT(coil_section_init(&sect, 64) == COIL_ERR_GOOD, "Section initialization should succeed");
+    }
+    
+    memset(fill, 'a' + i, sizeof(fill));
+    int rounds = (i == 7) ? 0 : (i * 7) % 13 + 1;
+    for (int r = 0; r < rounds; r++) {
+      TEST_ASSERT(coil_section_write(&sect, fill, sizeof(fill) - i, &written) == COIL_ERR_GOOD, "Section write should succeed");
+    }
+    
+    snprintf(name, sizeof(name), ".sect%d", i);
+    TEST_ASSERT(coil_obj_create_section(&obj, COIL_SECTION_PROGBITS, name, COIL_SECTION_FLAG_NONE, &sect, NULL) == COIL_ERR_GOOD, "Creating section should succeed");
+    coil_section_cleanup(&sect);
+  }
+  
+  int serial = open(TEST_OBJECT_FILE, O_RDWR | O_CREAT | O_TRUNC, 0644);
+  int parallel = open(TEST_OBJECT_COPY_FILE, O_RDWR | O_CREAT | O_TRUNC, 0644);
+  TEST_ASSERT(serial >= 0 && parallel >= 0, "File open should succeed");
+  TEST_ASSERT(coil_obj_save_file(&obj, serial) == COIL_ERR_GOOD, "Serial save should succeed");
+  TEST_ASSERT(coil_obj_save_file_parallel(&obj, parallel, 4) == COIL_ERR_GOOD, "Parallel save should succeed");
+  TEST_ASSERT(lseek(parallel, 0, SEEK_CUR) == lseek(serial, 0, SEEK_END), "Position should be left at the end of the object");
+  coil_obj_cleanup(&obj);
+  
+  off_t size = lseek(serial, 0, SEEK_END);
+  TEST_ASSERT(lseek(parallel, 0, SEEK_END) == size, "File sizes should match");
+  coil_byte_t *a = (coil_byte_t *)malloc(size);
+  coil_byte_t *b = (coil_byte_t *)malloc(size);
+  TEST_ASSERT(a != NULL && b != NULL, "Allocation should succeed");
+  TEST_ASSERT(pread(serial, a, size, 0) == size && pread(parallel, b, size, 0) == size, "Reading back should succeed");
+  TEST_ASSERT(memcmp(a, b, size) == 0, "Parallel and serial saves should be identical");
+  close(parallel);
+  
+  // Sections of a loaded object are copied from the source at their offsets
+  TEST_ASSERT(coil_seek(serial, 0, SEEK_SET) == COIL_ERR_GOOD, "Seek should succeed");
+  TEST_ASSERT(coil_obj_load_file(&obj, serial) == COIL_ERR_GOOD, "Loading object should succeed");
+  parallel = open(TEST_OBJECT_COPY_FILE, O_RDWR | O_CREAT | O_TRUNC, 0644);
+  TEST_ASSERT(parallel >= 0, "File open should succeed");
+  TEST_ASSERT(coil_obj_save_file_parallel(&obj, parallel, 0) == COIL_ERR_GOOD, "Parallel save from source should succeed");
+  memset(b, 0, size);
+  TEST_ASSERT(pread(parallel, b, size, 0) == size, "Reading back should succeed");
+  TEST_ASSERT(memcmp(a, b, size) == 0, "Copied sections should be identical");
+  close(parallel);
+  coil_obj_cleanup(&obj);
+  
+  free(a);
+  free(b);
+  unlink(TEST_OBJECT_COPY_FILE);
+  
+  return 0;
+}
+
+/**
+* @brief Add a section holding a copy of a buffer
+*/
+static coil_err_t test_object_add(coil_object_t *obj, coil_u8_t type, const char *name, const void *data,
+                                  coil_size_t size, coil_u16_t *index) {
+  coil_section_t sect;
+  coil_err_t err = coil_section_init(&sect, size);
+  if (err != COIL_ERR_GOOD) {
+    return err;
+  }
+  
+  coil_size_t written;
+  err = coil_section_write(&sect, (coil_byte_t *)data, size, &written);
+  if (err == COIL_ERR_GOOD) {
+    err = coil_obj_create_section(obj, type, name, COIL_SECTION_FLAG_NONE, &sect, index);
+  }
+  coil_section_cleanup(&sect);
+  return err;
+}
+
+/**
+* @brief Test that saving renumbers symbol and relocation tables past deleted sections
+*/
+static int test_object_save_references() {
+  printf("  Testing section references across compaction...\n");
+  
+  coil_object_t obj;
+  coil_err_t err = coil_obj_init(&obj, COIL_OBJ_INIT_DEFAULT);
+  TEST_ASSERT(err == COIL_ERR_GOOD, "Object initialization should succeed");
+  
+  coil_u16_t text, scratch, data, symtab, reltab;
+  TEST_ASSERT(test_object_add(&obj, COIL_SECTION_PROGBITS, ".text", "text", 4, &text) == COIL_ERR_GOOD &&
+              test_object_add(&obj, COIL_SECTION_PROGBITS, ".scratch", "scratch", 7, &scratch) == COIL_ERR_GOOD &&
+              test_object_add(&obj, COIL_SECTION_PROGBITS, ".data", "data", 4, &data) == COIL_ERR_GOOD,
+              "Creating sections should succeed");
+  
+  coil_symbol_t syms[4];
+  memset(syms, 0, sizeof(syms));
+  syms[0].section = text;
+  syms[1].section = scratch;
+  syms[2].section = data;
+  syms[3].section = COIL_SECTION_INDEX_NONE;
+  
+  coil_reloc_t relocs[3];
+  memset(relocs, 0, sizeof(relocs));
+  relocs[0].section = text;
+  relocs[0].offset = 1;
+  relocs[1].section = scratch;
+  relocs[1].offset = 2;
+  relocs[2].section = data;
+  relocs[2].offset = 3;
+  
+  TEST_ASSERT(test_object_add(&obj, COIL_SECTION_SYMTAB, ".symtab", syms, sizeof(syms), &symtab) == COIL_ERR_GOOD &&
+              test_object_add(&obj, COIL_SECTION_RELTAB, ".reltab", relocs, sizeof(relocs), &reltab) == COIL_ERR_GOOD,
+              "Creating tables should succeed");
+  TEST_ASSERT(coil_obj_delete_section(&obj, scratch) == COIL_ERR_GOOD, "Deleting a section should succeed");
+  
+  int fd = open(TEST_OBJECT_FILE, O_RDWR | O_CREAT | O_TRUNC, 0644);
+  TEST_ASSERT(fd >= 0, "File open should succeed");
+  err = coil_obj_save_file(&obj, fd);
+  TEST_ASSERT(err == COIL_ERR_GOOD, "Saving should succeed");
+  close(fd);
+  coil_obj_cleanup(&obj);
+  
+  fd = open(TEST_OBJECT_FILE, O_RDONLY);
+  TEST_ASSERT(fd >= 0, "File open should succeed");
+  err = coil_obj_load_file(&obj, fd);
+  TEST_ASSERT(err == COIL_ERR_GOOD, "Loading should succeed");
+  TEST_ASSERT(obj.header.section_count == 4, "The deleted section should be gone");
+  
+  coil_u16_t index;
+  coil_section_t sect;
+  TEST_ASSERT(coil_obj_find_section(&obj, ".data", &index) == COIL_ERR_GOOD && index == 1,
+              "Sections after the deleted one should move down");
+  
+  TEST_ASSERT(coil_obj_find_section(&obj, ".symtab", &index) == COIL_ERR_GOOD, "Finding the symbols should succeed");
+  TEST_ASSERT(coil_obj_load_section(&obj, index, &sect, COIL_SLOAD_DEFAULT) == COIL_ERR_GOOD,
+              "Loading the symbols should succeed");
+  TEST_ASSERT(sect.size == sizeof(syms), "Every symbol should be kept");
+  memcpy(syms, sect.data, sizeof(syms));
+  TEST_ASSERT(syms[0].section == 0 && syms[1].section == COIL_SECTION_INDEX_NONE && syms[2].section == 1 &&
+              syms[3].section == COIL_SECTION_INDEX_NONE, "Symbol sections should be renumbered");
+  coil_section_cleanup(&sect);
+  
+  TEST_ASSERT(coil_obj_find_section(&obj, ".reltab", &index) == COIL_ERR_GOOD, "Finding the relocations should succeed");
+  TEST_ASSERT(coil_obj_load_section(&obj, index, &sect, COIL_SLOAD_DEFAULT) == COIL_ERR_GOOD,
+              "Loading the relocations should succeed");
+  TEST_ASSERT(sect.size == 2 * sizeof(coil_reloc_t), "Relocations into the deleted section should be dropped");
+  memcpy(relocs, sect.data, 2 * sizeof(coil_reloc_t));
+  TEST_ASSERT(relocs[0].section == 0 && relocs[0].offset == 1 && relocs[1].section == 1 && relocs[1].offset == 3,
+              "Relocation sections should be renumbered");
+  coil_section_cleanup(&sect);
+  
+  coil_obj_cleanup(&obj);
+  close(fd);
+  return 0;
+}
+
 /**
 * @brief Run all object tests
 */
@@ -368,7 +874,12 @@ int test_object() {
   result |= test_object_init_cleanup();
   result |= test_object_sections();
   result |= test_target_metadata();
+  result |= test_target_selection();
+  result |= test_target_index();
   result |= test_object_file_io();
+  result |= test_object_save_references();
+  result |= test_object_rewrite();
+  result |= test_object_parallel_save();
   
   // Clean up test file
   unlink(TEST_OBJECT_FILE);
@@ -0,0 +1,496 @@
+/**
+* @file test_peep.c
+* @brief Test suite for peephole optimization and constant folding
+*
+* @author Low Level Team
+*/
+
+#include <coil/peep.h>
+#include <coil/lower.h>
+#include <coil/instr.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Test macros
+#define TEST_ASSERT(cond, msg) do { \
+  if (!(cond)) { \
+    printf("ASSERT FAILED: %s (line %d)\n", msg, __LINE__); \
+    return 1; \
+  } \
+} while (0)
+
+#define TEST_PEEP_MEMORY 4096
+#define TEST_PEEP_VARS 8
+#define TEST_PEEP_SYMS 64
+#define TEST_PEEP_PROGRAMS 300
+#define TEST_PEEP_FRAME 1024
+
+/**
+* @brief Encode an operand with data sized by its value type
+*/
+static void test_peep_operand(coil_section_t *ir, coil_u8_t type, coil_u8_t value_type, coil_u64_t value) {
+  coil_operand_encode(ir, type, value_type, COIL_MOD_NONE);
+  switch (value_type) {
+    case COIL_VAL_I8:
+    case COIL_VAL_U8: { coil_u8_t v = (coil_u8_t)value; coil_operand_encode_data(ir, &v, 1); break; }
+    case COIL_VAL_I16:
+    case COIL_VAL_U16: { coil_u16_t v = (coil_u16_t)value; coil_operand_encode_data(ir, &v, 2); break; }
+    case COIL_VAL_I32:
+    case COIL_VAL_U32: { coil_u32_t v = (coil_u32_t)value; coil_operand_encode_data(ir, &v, 4); break; }
+    default: coil_operand_encode_data(ir, &value, 8); break;
+  }
+}
+
+/**
+* @brief Encode a two-operand instruction on a variable
+*/
+static void test_peep_op(coil_section_t *ir, coil_u8_t opcode, coil_u8_t value_type, coil_u64_t var,
+                         coil_u8_t src_type, coil_u64_t src) {
+  coil_instrflag_encode(ir, opcode, COIL_INSTRFLAG_NONE);
+  test_peep_operand(ir, COIL_TYPEOP_VAR, value_type, var);
+  test_peep_operand(ir, src_type, value_type, src);
+}
+
+/**
+* @brief Encode a one-operand instruction on a variable
+*/
+static void test_peep_unary(coil_section_t *ir, coil_u8_t opcode, coil_u8_t value_type, coil_u64_t var) {
+  coil_instrflag_encode(ir, opcode, COIL_INSTRFLAG_NONE);
+  test_peep_operand(ir, COIL_TYPEOP_VAR, value_type, var);
+}
+
+/**
+* @brief Encode a branch to a symbol
+*/
+static void test_peep_branch(coil_section_t *ir, coil_u8_t flag, coil_u64_t symbol) {
+  coil_instrflag_encode(ir, COIL_OP_BR, flag);
+  test_peep_operand(ir, COIL_TYPEOP_SYM, COIL_VAL_SYM, symbol);
+}
+
+/**
+* @brief Store a variable at 8 * slot of symbol 0
+*/
+static void test_peep_store(coil_section_t *ir, coil_u8_t value_type, coil_u64_t var, coil_u64_t slot) {
+  coil_offset_t at = { 8 * slot, 0, 0 };
+  coil_u64_t symbol = 0;
+  coil_instrflag_encode(ir, COIL_OP_MOV, COIL_INSTRFLAG_NONE);
+  coil_operand_encode_off(ir, COIL_TYPEOP_OFF, COIL_VAL_SYM, COIL_MOD_NONE, &at);
+  coil_operand_encode_data(ir, &symbol, 8);
+  test_peep_operand(ir, COIL_TYPEOP_VAR, value_type, var);
+}
+
+/**
+* @brief Lower a section as one function and run it, symbol 0 being the output at address 0
+*/
+static coil_err_t test_peep_run(coil_section_t *code, const coil_u64_t *offsets, coil_u32_t count,
+                                coil_byte_t *memory) {
+  coil_section_t out;
+  coil_lower_t lower;
+  coil_u64_t syms[TEST_PEEP_SYMS] = {0};
+  
+  coil_section_init(&out, code->size + 64);
+  coil_err_t err = coil_lower_section(&lower, &out, code, NULL, 0, NULL);
+  for (coil_u32_t i = 1; i < count && err == COIL_ERR_GOOD; i++) {
+    err = coil_lower_offset(&lower, offsets[i], &syms[i]);
+  }
+  
+  coil_cbc_program_t prog;
+  coil_cbc_vm_t vm;
+  memset(memory, 0, TEST_PEEP_MEMORY);
+  if (err == COIL_ERR_GOOD) {
+    err = coil_cbc_program_init(&prog, out.data, out.size, syms, count);
+    if (err == COIL_ERR_GOOD) {
+      err = coil_cbc_vm_init(&vm, memory, TEST_PEEP_MEMORY, 16);
+      if (err == COIL_ERR_GOOD) {
+        vm.regs[COIL_LOWER_FRAME_REG].lo = TEST_PEEP_FRAME;
+        err = coil_cbc_run(&vm, &prog, 0, (coil_u64_t)1 << 20);
+        coil_cbc_vm_cleanup(&vm);
+      }
+      coil_cbc_program_cleanup(&prog);
+    }
+    coil_lower_cleanup(&lower);
+  }
+  coil_section_cleanup(&out);
+  return err;
+}
+
+/**
+* @brief Optimize a whole section and map its symbols
+*/
+static coil_err_t test_peep_apply(coil_section_t *ir, const coil_u64_t *offsets, coil_u32_t count, coil_u32_t rules,
+                                  coil_section_t *out, coil_u64_t *moved, coil_peep_t *peep) {
+  coil_err_t err = coil_peep_section(peep, out, ir, 0, ir->size, offsets, count, rules);
+  moved[0] = offsets[0];
+  for (coil_u32_t i = 1; i < count && err == COIL_ERR_GOOD; i++) {
+    err = coil_peep_offset(peep, offsets[i], &moved[i]);
+  }
+  return err;
+}
+
+/**
+* @brief Every rule on a straight sequence
+*/
+static int test_peep_rules() {
+  coil_section_t ir, out;
+  coil_u64_t offsets[1] = {0}, moved[1];
+  coil_section_init(&ir, 1024);
+  coil_section_init(&out, 1024);
+  
+  coil_instr_encode(&ir, COIL_OP_NOP);
+  test_peep_op(&ir, COIL_OP_MOV, COIL_VAL_I64, 0, COIL_TYPEOP_VAR, 0);
+  test_peep_op(&ir, COIL_OP_MOV, COIL_VAL_I64, 1, COIL_TYPEOP_IMM, 9);
+  test_peep_op(&ir, COIL_OP_MOV, COIL_VAL_I64, 2, COIL_TYPEOP_VAR, 1);
+  coil_u64_t back = ir.size;
+  test_peep_op(&ir, COIL_OP_MOV, COIL_VAL_I64, 1, COIL_TYPEOP_VAR, 2);
+  coil_u64_t dead = ir.size;
+  test_peep_op(&ir, COIL_OP_MOV, COIL_VAL_I64, 3, COIL_TYPEOP_VAR, 1);
+  test_peep_op(&ir, COIL_OP_MOV, COIL_VAL_I64, 3, COIL_TYPEOP_VAR, 2);
+  test_peep_op(&ir, COIL_OP_ADD, COIL_VAL_I64, 3, COIL_TYPEOP_IMM, 0);
+  test_peep_op(&ir, COIL_OP_MUL, COIL_VAL_I64, 3, COIL_TYPEOP_IMM, 1);
+  test_peep_op(&ir, COIL_OP_AND, COIL_VAL_I32, 3, COIL_TYPEOP_IMM, 0xFFFFFFFF);
+  test_peep_op(&ir, COIL_OP_SHL, COIL_VAL_I8, 3, COIL_TYPEOP_IMM, 8);
+  test_peep_op(&ir, COIL_OP_ADD, COIL_VAL_I64, 2, COIL_TYPEOP_IMM, 5);
+  test_peep_op(&ir, COIL_OP_SUB, COIL_VAL_I64, 2, COIL_TYPEOP_IMM, 7);
+  test_peep_op(&ir, COIL_OP_CMP, COIL_VAL_I64, 2, COIL_TYPEOP_IMM, 4);
+  test_peep_branch(&ir, COIL_INSTRFLAG_EQ, 0);
+  test_peep_op(&ir, COIL_OP_CMP, COIL_VAL_I64, 2, COIL_TYPEOP_IMM, 4);
+  test_peep_store(&ir, COIL_VAL_I64, 2, 0);
+  test_peep_store(&ir, COIL_VAL_I64, 3, 1);
+  coil_instr_encode(&ir, COIL_OP_RET);
+  
+  coil_peep_t peep;
+  TEST_ASSERT(test_peep_apply(&ir, offsets, 0, COIL_PEEP_ALL, &out, moved, &peep) == COIL_ERR_GOOD,
+              "The pass should succeed");
+  TEST_ASSERT(peep.instr_count == 19 && peep.removed == 10, "Ten instructions should be dropped");
+  TEST_ASSERT(peep.hits[0] == 1 && peep.hits[1] == 1 && peep.hits[2] == 1 && peep.hits[3] == 1,
+              "NOP, self, back and dead moves should be dropped once each");
+  TEST_ASSERT(peep.hits[4] == 4 && peep.hits[6] == 1 && peep.hits[7] == 1,
+              "Identities, the combined ADD and the CMP should be dropped");
+  
+  // MOV v1, 9; MOV v2, v1; MOV v3, v2; ADD v2, -2; CMP; BR; two stores; RET
+  coil_u64_t at, next;
+  TEST_ASSERT(coil_peep_offset(&peep, 0, &at) == COIL_ERR_GOOD && at == 0, "A dropped start maps to the next kept");
+  TEST_ASSERT(coil_peep_offset(&peep, back, &at) == COIL_ERR_GOOD && coil_peep_offset(&peep, dead, &next) ==
+              COIL_ERR_GOOD && at == next && at > 0, "Dropped moves map to the next kept");
+  TEST_ASSERT(coil_peep_offset(&peep, 2, &at) == COIL_ERR_NOTFOUND, "Offsets inside instructions should not map");
+  TEST_ASSERT(coil_peep_offset(&peep, ir.size, &at) == COIL_ERR_GOOD && at == out.size,
+              "The range end should map to the output end");
+  
+  coil_byte_t expect[TEST_PEEP_MEMORY], memory[TEST_PEEP_MEMORY];
+  TEST_ASSERT(test_peep_run(&ir, offsets, 1, expect) == COIL_ERR_GOOD, "The original should run");
+  TEST_ASSERT(test_peep_run(&out, moved, 1, memory) == COIL_ERR_GOOD, "The optimized code should run");
+  TEST_ASSERT(memcmp(memory, expect, 16) == 0 && memory[0] == 7 && memory[8] == 9, "The results should match");
+  
+  // Without rules the section is copied
+  coil_section_t copy;
+  coil_section_init(&copy, 1024);
+  coil_peep_cleanup(&peep);
+  TEST_ASSERT(coil_peep_section(&peep, &copy, &ir, 0, ir.size, NULL, 0, 0) == COIL_ERR_GOOD, "The pass should succeed");
+  TEST_ASSERT(copy.size == ir.size && memcmp(copy.data, ir.data, ir.size) == 0 && peep.removed == 0,
+              "Nothing should change");
+  coil_peep_cleanup(&peep);
+  TEST_ASSERT(coil_peep_section(&peep, &copy, &ir, 1, ir.size, NULL, 0, 0) == COIL_ERR_INVAL,
+              "Ranges leaving the section should be rejected");
+  TEST_ASSERT(coil_peep_section(&peep, &copy, &ir, 1, 10, NULL, 0, 0) == COIL_ERR_FORMAT && peep.fault == 1,
+              "Malformed instructions should be reported");
+  
+  coil_peep_cleanup(&peep);
+  coil_section_cleanup(&copy);
+  coil_section_cleanup(&out);
+  coil_section_cleanup(&ir);
+  return 0;
+}
+
+/**
+* @brief Folding of every operation at every width matches the interpreter
+*/
+static int test_peep_fold() {
+  static const coil_u8_t types[] = { COIL_VAL_I8, COIL_VAL_U8, COIL_VAL_I16, COIL_VAL_U16, COIL_VAL_I32,
+                                     COIL_VAL_U32, COIL_VAL_I64, COIL_VAL_U64 };
+  static const coil_u8_t ops[] = { COIL_OP_ADD, COIL_OP_SUB, COIL_OP_MUL, COIL_OP_AND, COIL_OP_OR, COIL_OP_XOR,
+                                   COIL_OP_SHL, COIL_OP_SHR, COIL_OP_SAL, COIL_OP_SAR, COIL_OP_INC, COIL_OP_DEC,
+                                   COIL_OP_NEG, COIL_OP_NOT };
+  static const coil_u64_t values[][2] = { { 0x8badf00ddeadbeefull, 0x0123456789abcdefull }, { 0xF3, 0x05 },
+                                          { 0x7FFF, 0xFFFF }, { 1, 0x3F } };
+  coil_byte_t expect[TEST_PEEP_MEMORY], memory[TEST_PEEP_MEMORY];
+  coil_u64_t offsets[1] = {0}, moved[1];
+  
+  for (coil_size_t t = 0; t < sizeof(types); t++) {
+    for (coil_size_t o = 0; o < sizeof(ops); o++) {
+      for (coil_size_t v = 0; v < sizeof(values) / sizeof(values[0]); v++) {
+        coil_section_t ir, out;
+        coil_section_init(&ir, 256);
+        coil_section_init(&out, 256);
+        test_peep_op(&ir, COIL_OP_MOV, types[t], 0, COIL_TYPEOP_IMM, values[v][0]);
+        if (o >= 10) {
+          test_peep_unary(&ir, ops[o], types[t], 0);
+        } else {
+          test_peep_op(&ir, ops[o], types[t], 0, COIL_TYPEOP_IMM, values[v][1]);
+        }
+        test_peep_store(&ir, types[t], 0, 0);
+        coil_instr_encode(&ir, COIL_OP_RET);
+        
+        coil_peep_t peep;
+        TEST_ASSERT(test_peep_apply(&ir, offsets, 0, COIL_PEEP_ALL, &out, moved, &peep) == COIL_ERR_GOOD,
+                    "The pass should succeed");
+        // Operations that are identities at the width go before they can fold
+        TEST_ASSERT(peep.hits[4] + peep.hits[5] == 1 && peep.instr_count - peep.removed == 3,
+                    "The operation should fold");
+        TEST_ASSERT(test_peep_run(&ir, offsets, 1, expect) == COIL_ERR_GOOD, "The original should run");
+        TEST_ASSERT(test_peep_run(&out, moved, 1, memory) == COIL_ERR_GOOD, "The folded code should run");
+        if (memcmp(memory, expect, 8) != 0) {
+          printf("Opcode 0x%02x on value type 0x%02x differs\n", (unsigned)ops[o], (unsigned)types[t]);
+          TEST_ASSERT(0, "The folded value should match");
+        }
+        
+        coil_peep_cleanup(&peep);
+        coil_section_cleanup(&out);
+        coil_section_cleanup(&ir);
+      }
+    }
+  }
+  
+  // A chain folds to one MOV: ((1 + 2) * 3) << 1
+  coil_section_t ir, out;
+  coil_peep_t peep;
+  coil_section_init(&ir, 256);
+  coil_section_init(&out, 256);
+  test_peep_op(&ir, COIL_OP_MOV, COIL_VAL_I32, 0, COIL_TYPEOP_IMM, 1);
+  test_peep_op(&ir, COIL_OP_ADD, COIL_VAL_I32, 0, COIL_TYPEOP_IMM, 2);
+  test_peep_op(&ir, COIL_OP_MUL, COIL_VAL_I32, 0, COIL_TYPEOP_IMM, 3);
+  test_peep_op(&ir, COIL_OP_SHL, COIL_VAL_I32, 0, COIL_TYPEOP_IMM, 1);
+  TEST_ASSERT(coil_peep_section(&peep, &out, &ir, 0, ir.size, NULL, 0, COIL_PEEP_ALL) == COIL_ERR_GOOD,
+              "The pass should succeed");
+  
+  coil_section_t folded;
+  coil_section_init(&folded, 256);
+  test_peep_op(&folded, COIL_OP_MOV, COIL_VAL_I32, 0, COIL_TYPEOP_IMM, 18);
+  TEST_ASSERT(peep.hits[5] == 3 && out.size == folded.size && memcmp(out.data, folded.data, out.size) == 0,
+              "The chain should be one MOV of a 32-bit immediate");
+  coil_section_cleanup(&folded);
+  
+  coil_peep_cleanup(&peep);
+  coil_section_cleanup(&out);
+  coil_section_cleanup(&ir);
+  return 0;
+}
+
+/**
+* @brief Symbols, volatile operands and flags stop the rules
+*/
+static int test_peep_barriers() {
+  coil_section_t ir, out;
+  coil_u64_t offsets[2];
+  coil_section_init(&ir, 512);
+  coil_section_init(&out, 512);
+  
+  // A repeated CMP at a symbol and a fold across one stay
+  test_peep_op(&ir, COIL_OP_MOV, COIL_VAL_I64, 0, COIL_TYPEOP_IMM, 3);
+  test_peep_op(&ir, COIL_OP_CMP, COIL_VAL_I64, 0, COIL_TYPEOP_IMM, 3);
+  offsets[0] = ir.size;
+  test_peep_op(&ir, COIL_OP_CMP, COIL_VAL_I64, 0, COIL_TYPEOP_IMM, 3);
+  test_peep_op(&ir, COIL_OP_MOV, COIL_VAL_I64, 1, COIL_TYPEOP_IMM, 3);
+  coil_u64_t fold = ir.size;
+  offsets[1] = fold;
+  test_peep_op(&ir, COIL_OP_ADD, COIL_VAL_I64, 1, COIL_TYPEOP_IMM, 3);
+  
+  // Volatile and flagged instructions stay
+  coil_u64_t vol = ir.size, var = 2;
+  coil_instrflag_encode(&ir, COIL_OP_ADD, COIL_INSTRFLAG_NONE);
+  coil_operand_encode(&ir, COIL_TYPEOP_VAR, COIL_VAL_I64, COIL_MOD_VOL);
+  coil_operand_encode_data(&ir, &var, 8);
+  test_peep_operand(&ir, COIL_TYPEOP_IMM, COIL_VAL_I64, 0);
+  coil_instrflag_encode(&ir, COIL_OP_MOV, COIL_INSTRFLAG_EQ);
+  test_peep_operand(&ir, COIL_TYPEOP_VAR, COIL_VAL_I64, 3);
+  test_peep_operand(&ir, COIL_TYPEOP_VAR, COIL_VAL_I64, 3);
+  
+  // A CMP after a write to its operand stays
+  test_peep_op(&ir, COIL_OP_CMP, COIL_VAL_I64, 0, COIL_TYPEOP_IMM, 3);
+  test_peep_unary(&ir, COIL_OP_INC, COIL_VAL_I64, 0);
+  test_peep_op(&ir, COIL_OP_CMP, COIL_VAL_I64, 0, COIL_TYPEOP_IMM, 3);
+  
+  coil_peep_t peep;
+  TEST_ASSERT(coil_peep_section(&peep, &out, &ir, 0, ir.size, offsets, 2, COIL_PEEP_ALL) == COIL_ERR_GOOD,
+              "The pass should succeed");
+  TEST_ASSERT(peep.removed == 0 && out.size == ir.size && memcmp(out.data, ir.data, ir.size) == 0,
+              "Nothing should change");
+  coil_peep_cleanup(&peep);
+  
+  // Without the symbols the CMP and the fold go
+  coil_section_t bare;
+  coil_section_init(&bare, 512);
+  TEST_ASSERT(coil_peep_section(&peep, &bare, &ir, 0, ir.size, NULL, 0, COIL_PEEP_ALL) == COIL_ERR_GOOD,
+              "The pass should succeed");
+  TEST_ASSERT(peep.removed == 2 && peep.hits[7] == 1 && peep.hits[5] == 1, "The CMP and the fold should go");
+  coil_u64_t at, next;
+  TEST_ASSERT(coil_peep_offset(&peep, fold, &at) == COIL_ERR_GOOD && coil_peep_offset(&peep, vol, &next) ==
+              COIL_ERR_GOOD && at == next, "The folded ADD should map to what follows");
+  
+  coil_section_cleanup(&bare);
+  coil_peep_cleanup(&peep);
+  coil_section_cleanup(&out);
+  coil_section_cleanup(&ir);
+  return 0;
+}
+
+/**
+* @brief Next value of a xorshift generator
+*/
+static coil_u64_t test_peep_next(coil_u64_t *state) {
+  *state ^= *state << 13;
+  *state ^= *state >> 7;
+  *state ^= *state << 17;
+  return *state;
+}
+
+/**
+* @brief Value type of a variable
+*/
+static coil_u8_t test_peep_type(coil_u64_t var) {
+  static const coil_u8_t types[] = { COIL_VAL_I64, COIL_VAL_I8, COIL_VAL_U16, COIL_VAL_I32 };
+  return types[var % 4];
+}
+
+/**
+* @brief Instructions the rules look for, on variables of mixed widths
+*/
+static void test_peep_ops(coil_section_t *ir, coil_u64_t *state, int count) {
+  static const coil_u8_t ops[] = { COIL_OP_ADD, COIL_OP_SUB, COIL_OP_MUL, COIL_OP_AND, COIL_OP_OR, COIL_OP_XOR,
+                                   COIL_OP_SHL, COIL_OP_SHR, COIL_OP_SAR };
+  static const coil_u8_t unary[] = { COIL_OP_INC, COIL_OP_DEC, COIL_OP_NEG, COIL_OP_NOT };
+  static const coil_u64_t imms[] = { 0, 1, 2, 3, 7, 0xFF, 0xFFFFFFFF, ~(coil_u64_t)0, 0x80, 63 };
+  
+  for (int i = 0; i < count; i++) {
+    coil_u64_t r = test_peep_next(state);
+    coil_u64_t dst = r % TEST_PEEP_VARS, src = (r >> 8) % TEST_PEEP_VARS;
+    coil_u8_t type = test_peep_type(dst);
+    coil_u64_t imm = imms[(r >> 16) % 10];
+    switch ((r >> 24) % 8) {
+      case 0:
+        test_peep_op(ir, COIL_OP_MOV, type, dst, COIL_TYPEOP_IMM, imm ^ (r >> 40));
+        break;
+      case 1:
+        // Self, back and dead moves between variables of one type
+        test_peep_op(ir, COIL_OP_MOV, type, dst, COIL_TYPEOP_VAR, (src & ~(coil_u64_t)3) | (dst & 3));
+        break;
+      case 2:
+        test_peep_unary(ir, unary[(r >> 32) % 4], type, dst);
+        break;
+      case 3:
+        coil_instr_encode(ir, COIL_OP_NOP);
+        break;
+      default:
+        test_peep_op(ir, ops[(r >> 32) % 9], type, dst, COIL_TYPEOP_IMM, imm);
+        break;
+    }
+  }
+}
+
+/**
+* @brief Random function of loops and branches over eight variables
+*
+* @return coil_u32_t Number of symbols
+*/
+static coil_u32_t test_peep_program(coil_section_t *ir, coil_u64_t *offsets, coil_u64_t state) {
+  coil_u32_t syms = 1;
+  for (coil_u64_t v = 0; v < TEST_PEEP_VARS; v++) {
+    test_peep_op(ir, COIL_OP_MOV, test_peep_type(v), v, COIL_TYPEOP_IMM, test_peep_next(&state));
+  }
+  
+  for (int segment = 0; segment < 10; segment++) {
+    coil_u64_t r = test_peep_next(&state);
+    if (r % 3 == 0) {
+      // Counted loop on a variable of its own
+      coil_u64_t counter = TEST_PEEP_VARS + (coil_u64_t)segment;
+      coil_u32_t top = syms++;
+      test_peep_op(ir, COIL_OP_MOV, COIL_VAL_I64, counter, COIL_TYPEOP_IMM, 2 + (r >> 8) % 3);
+      offsets[top] = ir->size;
+      test_peep_ops(ir, &state, 2 + (int)(r >> 12) % 5);
+      test_peep_op(ir, COIL_OP_SUB, COIL_VAL_I64, counter, COIL_TYPEOP_IMM, 1);
+      test_peep_op(ir, COIL_OP_CMP, COIL_VAL_I64, counter, COIL_TYPEOP_IMM, 0);
+      test_peep_branch(ir, COIL_INSTRFLAG_GT, top);
+    } else if (r % 3 == 1) {
+      // Compares repeated across branches, some of them at a symbol
+      coil_u64_t var = (r >> 8) % TEST_PEEP_VARS;
+      coil_u32_t skip = syms++;
+      for (int k = 0; k < 3; k++) {
+        if ((r >> (20 + k)) & 1) {
+          offsets[syms++] = ir->size;
+        }
+        test_peep_op(ir, COIL_OP_CMP, test_peep_type(var), var, COIL_TYPEOP_IMM, (r >> 16) & 0xF);
+        test_peep_branch(ir, (coil_u8_t)(COIL_INSTRFLAG_EQ + k), skip);
+      }
+      test_peep_ops(ir, &state, 1 + (int)(r >> 24) % 4);
+      offsets[skip] = ir->size;
+    } else {
+      test_peep_ops(ir, &state, 3 + (int)(r >> 8) % 6);
+    }
+  }
+  
+  for (coil_u64_t v = 0; v < TEST_PEEP_VARS; v++) {
+    test_peep_store(ir, test_peep_type(v), v, v);
+  }
+  coil_instr_encode(ir, COIL_OP_RET);
+  return syms;
+}
+
+/**
+* @brief Random functions compute the same results after the pass
+*/
+static int test_peep_random() {
+  static coil_byte_t memory[TEST_PEEP_MEMORY], expect[TEST_PEEP_MEMORY];
+  coil_u64_t offsets[TEST_PEEP_SYMS], moved[TEST_PEEP_SYMS];
+  coil_u32_t hits[COIL_PEEP_RULE_COUNT] = {0};
+  
+  for (int p = 0; p < TEST_PEEP_PROGRAMS; p++) {
+    coil_section_t ir, out;
+    coil_peep_t peep;
+    coil_section_init(&ir, 4096);
+    coil_section_init(&out, 4096);
+    offsets[0] = 0;
+    coil_u32_t count = test_peep_program(&ir, offsets, 0x9E3779B97F4A7C15ull * (coil_u64_t)(p + 1));
+    
+    TEST_ASSERT(test_peep_run(&ir, offsets, count, expect) == COIL_ERR_GOOD, "The original should run");
+    TEST_ASSERT(test_peep_apply(&ir, offsets, count, COIL_PEEP_ALL, &out, moved, &peep) == COIL_ERR_GOOD,
+                "The pass should succeed");
+    TEST_ASSERT(test_peep_run(&out, moved, count, memory) == COIL_ERR_GOOD, "The optimized code should run");
+    if (memcmp(memory, expect, 8 * TEST_PEEP_VARS) != 0) {
+      printf("Program %d differs\n", p);
+      TEST_ASSERT(0, "The results should match");
+    }
+    TEST_ASSERT(out.size <= ir.size, "The code should not grow");
+    
+    for (int i = 0; i < COIL_PEEP_RULE_COUNT; i++) {
+      hits[i] += peep.hits[i];
+    }
+    coil_peep_cleanup(&peep);
+    coil_section_cleanup(&out);
+    coil_section_cleanup(&ir);
+  }
+  
+  for (int i = 0; i < COIL_PEEP_RULE_COUNT; i++) {
+    TEST_ASSERT(hits[i] > 0, "Every rule should have applied");
+  }
+  return 0;
+}
+
+/**
+* @brief Run all peephole tests
+*/
+int test_peep() {
+  printf("\nRunning peephole tests...\n");
+  
+  int result = 0;
+  
+  result |= test_peep_rules();
+  result |= test_peep_fold();
+  result |= test_peep_barriers();
+  result |= test_peep_random();
+  
+  if (result == 0) {
+    printf("All peephole tests passed!\n");
+  }
+  
+  return result;
+}
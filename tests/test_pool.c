@@ -0,0 +1,201 @@
+/**
+* @file test_pool.c
+* @brief Test suite for the section buffer pool
+*
+* @author Low Level Team
+*/
+
+#include <coil/pool.h>
+#include <coil/sect.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+
+// Test macros
+#define TEST_ASSERT(cond, msg) do { \
+  if (!(cond)) { \
+    printf("ASSERT FAILED: %s (line %d)\n", msg, __LINE__); \
+    return 1; \
+  } \
+} while (0)
+
+/**
+* @brief Test size classes and block reuse
+*/
+static int test_pool_classes() {
+  printf("  Testing size classes and reuse...\n");
+  
+  coil_pool_trim(0);
+  coil_pool_reset_stats();
+  
+  TEST_ASSERT(coil_pool_class_size(0) == 64, "Empty requests should use the smallest class");
+  TEST_ASSERT(coil_pool_class_size(64) == 64, "Exact class sizes should be kept");
+  TEST_ASSERT(coil_pool_class_size(65) == 128, "Sizes should round up to the next class");
+  TEST_ASSERT(coil_pool_class_size(1000) == 1024, "Sizes should round up to the next class");
+  
+  coil_size_t capacity = 0;
+  void *block = coil_pool_alloc(1000, &capacity);
+  TEST_ASSERT(block != NULL, "Pool allocation should succeed");
+  TEST_ASSERT(capacity == 1024, "Capacity should be the class size");
+  memset(block, 0xAB, capacity);
+  
+  coil_pool_free(block, capacity);
+  
+  coil_size_t capacity2 = 0;
+  void *block2 = coil_pool_alloc(600, &capacity2);
+  TEST_ASSERT(block2 == block && capacity2 == 1024, "Freed block should be reused for the same class");
+  coil_pool_free(block2, capacity2);
+  
+  coil_pool_stats_t stats;
+  TEST_ASSERT(coil_pool_get_stats(&stats) == COIL_ERR_GOOD, "Getting stats should succeed");
+  TEST_ASSERT(stats.hits == 1 && stats.misses == 1, "Stats should count one hit and one miss");
+  TEST_ASSERT(stats.releases == 2, "Stats should count cached frees");
+  TEST_ASSERT(stats.blocks_retained == 1 && stats.bytes_retained == 1024, "Stats should count cached bytes");
+  TEST_ASSERT(coil_pool_hit_rate(&stats) == 0.5, "Hit rate should be one half");
+  TEST_ASSERT(coil_pool_get_stats(NULL) == COIL_ERR_INVAL, "Getting stats into NULL should fail");
+  
+  // Blocks that do not match a class go straight back to the system
+  void *odd = coil_malloc(100);
+  TEST_ASSERT(odd != NULL, "Allocation should succeed");
+  coil_pool_free(odd, 100);
+  coil_pool_get_stats(&stats);
+  TEST_ASSERT(stats.drops == 1 && stats.blocks_retained == 1, "Odd sized blocks should not be cached");
+  
+  return 0;
+}
+
+/**
+* @brief Test mapped classes and trimming
+*/
+static int test_pool_trim() {
+  printf("  Testing mapped classes and trimming...\n");
+  
+  coil_size_t capacity = 0;
+  void *large = coil_pool_alloc(COIL_POOL_MMAP_THRESHOLD + 1, &capacity);
+  TEST_ASSERT(large != NULL, "Large pool allocation should succeed");
+  TEST_ASSERT(capacity == 2 * COIL_POOL_MMAP_THRESHOLD, "Large blocks should use a power of two class");
+  memset(large, 0xCD, capacity);
+  coil_pool_free(large, capacity);
+  
+  // Past the largest class blocks are not cached at all
+  coil_size_t huge_capacity = 0;
+  void *huge = coil_pool_alloc(((coil_size_t)1 << COIL_POOL_MAX_SHIFT) + 1, &huge_capacity);
+  TEST_ASSERT(huge != NULL, "Oversized pool allocation should succeed");
+  coil_pool_free(huge, huge_capacity);
+  
+  coil_pool_stats_t stats;
+  coil_pool_get_stats(&stats);
+  TEST_ASSERT(stats.bytes_retained == 1024 + capacity, "Only class sized blocks should be retained");
+  
+  coil_size_t released = coil_pool_trim(1024);
+  TEST_ASSERT(released == capacity, "Trim should release the largest blocks first");
+  
+  released = coil_pool_trim(0);
+  TEST_ASSERT(released == 1024, "Trimming to zero should empty the pool");
+  
+  coil_pool_get_stats(&stats);
+  TEST_ASSERT(stats.bytes_retained == 0 && stats.blocks_retained == 0, "Pool should be empty after trim");
+  
+  return 0;
+}
+
+/**
+* @brief Test pooled sections
+*/
+static int test_pool_sections() {
+  printf("  Testing pooled sections...\n");
+  
+  coil_pool_reset_stats();
+  
+  coil_section_t sect;
+  coil_err_t err = coil_section_init_pooled(&sect, 100);
+  TEST_ASSERT(err == COIL_ERR_GOOD, "Pooled section initialization should succeed");
+  TEST_ASSERT(sect.is_pooled && sect.capacity == 128, "Pooled section should use the class capacity");
+  
+  // Growing stays inside the pool
+  coil_byte_t buffer[300];
+  memset(buffer, 0x5A, sizeof(buffer));
+  coil_size_t written;
+  err = coil_section_write(&sect, buffer, sizeof(buffer), &written);
+  TEST_ASSERT(err == COIL_ERR_GOOD && written == sizeof(buffer), "Writing a pooled section should succeed");
+  TEST_ASSERT(sect.is_pooled && sect.capacity == 512, "Grown pooled section should use the class capacity");
+  TEST_ASSERT(memcmp(sect.data, buffer, sizeof(buffer)) == 0, "Grown pooled section should keep its data");
+  
+  coil_byte_t *data = sect.data;
+  coil_section_cleanup(&sect);
+  TEST_ASSERT(sect.data == NULL && !sect.is_pooled, "Cleanup should reset the section");
+  
+  // A scratch section of the same class gets the buffer back
+  err = coil_section_init_pooled(&sect, 400);
+  TEST_ASSERT(err == COIL_ERR_GOOD, "Pooled section initialization should succeed");
+  TEST_ASSERT(sect.data == data, "Scratch sections should reuse pooled buffers");
+  coil_section_cleanup(&sect);
+  
+  coil_pool_stats_t stats;
+  coil_pool_get_stats(&stats);
+  TEST_ASSERT(stats.hits == 1 && stats.misses == 2, "Only the first allocation of each class should miss");
+  
+  coil_pool_trim(0);
+  
+  return 0;
+}
+
+/**
+* @brief Worker that leaves a block in its cache and exits
+*/
+static void *test_pool_worker(void *arg) {
+  coil_section_t sect;
+  if (coil_section_init_pooled(&sect, 1000) == COIL_ERR_GOOD) {
+    coil_section_cleanup(&sect);
+  }
+  
+  coil_pool_stats_t stats;
+  coil_pool_get_stats(&stats);
+  *(coil_size_t *)arg = stats.blocks_retained;
+  return NULL;
+}
+
+/**
+* @brief Test that exiting threads drain their caches
+*/
+static int test_pool_threads() {
+  printf("  Testing thread exit...\n");
+  
+  coil_pool_stats_t before;
+  coil_pool_get_stats(&before);
+  
+  // The leak checker reports the worker's block if the exit destructor does not run
+  for (int i = 0; i < 4; i++) {
+    pthread_t thread;
+    coil_size_t retained = 0;
+    TEST_ASSERT(pthread_create(&thread, NULL, test_pool_worker, &retained) == 0, "Thread creation should succeed");
+    TEST_ASSERT(pthread_join(thread, NULL) == 0, "Thread join should succeed");
+    TEST_ASSERT(retained == 1, "The worker should have cached its block");
+  }
+  
+  coil_pool_stats_t after;
+  coil_pool_get_stats(&after);
+  TEST_ASSERT(after.blocks_retained == before.blocks_retained, "Worker caches should not touch this thread's");
+  
+  return 0;
+}
+
+/**
+* @brief Run all pool tests
+*/
+int test_pool() {
+  printf("\nRunning pool tests...\n");
+  
+  int result = 0;
+  
+  result |= test_pool_classes();
+  result |= test_pool_trim();
+  result |= test_pool_sections();
+  result |= test_pool_threads();
+  
+  if (result == 0) {
+    printf("All pool tests passed!\n");
+  }
+  
+  return result;
+}
@@ -0,0 +1,477 @@
+/**
+* @file test_regalloc.c
+* @brief Test suite for linear-scan register allocation of COIL variables
+*
+* @author Low Level Team
+*/
+
+#include <coil/regalloc.h>
+#include <coil/lower.h>
+#include <coil/instr.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Test macros
+#define TEST_ASSERT(cond, msg) do { \
+  if (!(cond)) { \
+    printf("ASSERT FAILED: %s (line %d)\n", msg, __LINE__); \
+    return 1; \
+  } \
+} while (0)
+
+#define TEST_REGALLOC_MEMORY 4096
+#define TEST_REGALLOC_FRAME 1024
+#define TEST_REGALLOC_VARS 10
+#define TEST_REGALLOC_SYMS 64
+#define TEST_REGALLOC_PROGRAMS 150
+
+/**
+* @brief Encode an operand with 4 or 8 bytes of data
+*/
+static void test_regalloc_operand(coil_section_t *ir, coil_u8_t type, coil_u8_t value_type, coil_u64_t value) {
+  coil_operand_encode(ir, type, value_type, COIL_MOD_NONE);
+  if (value_type == COIL_VAL_I32 || value_type == COIL_VAL_REG) {
+    coil_u32_t v = (coil_u32_t)value;
+    coil_operand_encode_data(ir, &v, 4);
+  } else {
+    coil_operand_encode_data(ir, &value, 8);
+  }
+}
+
+/**
+* @brief Encode a two-operand instruction
+*/
+static void test_regalloc_op(coil_section_t *ir, coil_u8_t opcode, coil_u8_t dst_type, coil_u64_t dst,
+                             coil_u8_t src_type, coil_u64_t src) {
+  coil_instrflag_encode(ir, opcode, COIL_INSTRFLAG_NONE);
+  test_regalloc_operand(ir, dst_type, COIL_VAL_I64, dst);
+  test_regalloc_operand(ir, src_type, COIL_VAL_I64, src);
+}
+
+/**
+* @brief Encode a branch to a symbol
+*/
+static void test_regalloc_branch(coil_section_t *ir, coil_u8_t opcode, coil_u8_t flag, coil_u64_t symbol) {
+  coil_instrflag_encode(ir, opcode, flag);
+  test_regalloc_operand(ir, COIL_TYPEOP_SYM, COIL_VAL_SYM, symbol);
+}
+
+/**
+* @brief Lower a function and its callee, then run it
+*
+* Symbol 0 is the output at address 0, offsets[1] the callee and the
+* other offsets code labels in the section.
+*/
+static coil_err_t test_regalloc_run(coil_section_t *code, const coil_u64_t *offsets, coil_u32_t count,
+                                    coil_byte_t *memory) {
+  coil_section_t out;
+  coil_lower_t lower;
+  coil_lower_func_t funcs[2] = { { 0, offsets[1] }, { offsets[1], code->size - offsets[1] } };
+  coil_u64_t syms[TEST_REGALLOC_SYMS] = {0};
+  
+  coil_section_init(&out, code->size + 64);
+  coil_err_t err = coil_lower_section(&lower, &out, code, funcs, 2, NULL);
+  for (coil_u32_t i = 1; i < count && err == COIL_ERR_GOOD; i++) {
+    err = coil_lower_offset(&lower, offsets[i], &syms[i]);
+  }
+  
+  coil_cbc_program_t prog;
+  coil_cbc_vm_t vm;
+  memset(memory, 0, TEST_REGALLOC_MEMORY);
+  if (err == COIL_ERR_GOOD) {
+    err = coil_cbc_program_init(&prog, out.data, out.size, syms, count);
+    if (err == COIL_ERR_GOOD) {
+      err = coil_cbc_vm_init(&vm, memory, TEST_REGALLOC_MEMORY, 64);
+      if (err == COIL_ERR_GOOD) {
+        vm.regs[COIL_LOWER_FRAME_REG].lo = TEST_REGALLOC_FRAME;
+        err = coil_cbc_run(&vm, &prog, 0, (coil_u64_t)1 << 22);
+        coil_cbc_vm_cleanup(&vm);
+      }
+      coil_cbc_program_cleanup(&prog);
+    }
+    coil_lower_cleanup(&lower);
+  }
+  coil_section_cleanup(&out);
+  return err;
+}
+
+/**
+* @brief Allocate the first function of a section, rewrite it and copy the callee after it
+*/
+static coil_err_t test_regalloc_apply(coil_section_t *ir, const coil_u64_t *offsets, coil_u32_t count,
+                                      const coil_regalloc_options_t *options, coil_section_t *out,
+                                      coil_u64_t *moved, coil_regalloc_t *ra) {
+  coil_cfg_t cfg;
+  coil_err_t err = coil_cfg_build(&cfg, ir, 0, offsets[1], offsets, count);
+  if (err != COIL_ERR_GOOD) {
+    return err;
+  }
+  
+  err = coil_regalloc_build(ra, &cfg, ir, options);
+  if (err == COIL_ERR_GOOD) {
+    err = coil_regalloc_rewrite(ra, out, ir);
+  }
+  for (coil_u32_t i = 1; i < count && err == COIL_ERR_GOOD; i++) {
+    err = coil_regalloc_offset(ra, offsets[i], &moved[i]);
+  }
+  if (err == COIL_ERR_GOOD) {
+    coil_size_t written;
+    err = coil_section_write(out, ir->data + offsets[1], ir->size - offsets[1], &written);
+  }
+  
+  coil_cfg_cleanup(&cfg);
+  return err;
+}
+
+/**
+* @brief Encode the callee, which clobbers every register the allocator may use
+*/
+static void test_regalloc_callee(coil_section_t *ir, coil_u64_t *offsets) {
+  offsets[1] = ir->size;
+  for (coil_u64_t r = 0; r < COIL_LOWER_FRAME_REG; r++) {
+    test_regalloc_op(ir, COIL_OP_MOV, COIL_TYPEOP_REG, r, COIL_TYPEOP_IMM, 0xDEAD0000 + r);
+  }
+  coil_instr_encode(ir, COIL_OP_RET);
+}
+
+/**
+* @brief Register counts of targets and the limits of the options
+*/
+static int test_regalloc_targets() {
+  TEST_ASSERT(coil_regalloc_target_registers(COIL_CPU_x86_64) == 14, "x86-64 should offer 14 registers");
+  TEST_ASSERT(coil_regalloc_target_registers(COIL_CPU_x86_32) == 6, "x86 should offer 6 registers");
+  TEST_ASSERT(coil_regalloc_target_registers(COIL_CPU_ARM64) == 28, "ARM64 should offer 28 registers");
+  TEST_ASSERT(coil_regalloc_target_registers(COIL_CPU_NONE) == COIL_CBC_REGISTERS,
+              "Unknown targets should offer every CBC register");
+  
+  // Sixteen variables live at once, read back in order
+  coil_section_t ir;
+  coil_u64_t offsets[2];
+  coil_section_init(&ir, 1024);
+  for (coil_u64_t v = 0; v < 16; v++) {
+    test_regalloc_op(&ir, COIL_OP_MOV, COIL_TYPEOP_VAR, v, COIL_TYPEOP_IMM, v);
+  }
+  test_regalloc_op(&ir, COIL_OP_MOV, COIL_TYPEOP_REG, 3, COIL_TYPEOP_IMM, 0);
+  for (coil_u64_t v = 0; v < 16; v++) {
+    test_regalloc_op(&ir, COIL_OP_ADD, COIL_TYPEOP_REG, 3, COIL_TYPEOP_VAR, v);
+  }
+  coil_instr_encode(&ir, COIL_OP_RET);
+  test_regalloc_callee(&ir, offsets);
+  
+  coil_cfg_t cfg;
+  coil_regalloc_t ra;
+  coil_regalloc_options_t options;
+  TEST_ASSERT(coil_cfg_build(&cfg, &ir, 0, offsets[1], offsets, 0) == COIL_ERR_GOOD, "Graph build should succeed");
+  
+  coil_regalloc_options_init(&options);
+  options.arch = COIL_CPU_x86_64;
+  TEST_ASSERT(coil_regalloc_build(&ra, &cfg, &ir, &options) == COIL_ERR_GOOD, "Allocation should succeed");
+  TEST_ASSERT(ra.count == 16 && ra.instr_count == 34 && ra.ref_count == 32, "Every variable operand should be decoded");
+  TEST_ASSERT(ra.reg_count == 14 && ra.regs[0] == 0 && ra.regs[3] == 4, "Named registers should not be handed out");
+  TEST_ASSERT(ra.splits + ra.spills == 2 && ra.slots == 2, "Two variables should not fit");
+  coil_u8_t reg;
+  coil_u64_t slot = 99;
+  TEST_ASSERT(coil_regalloc_find(&ra, 0, 0, &reg, &slot) == COIL_ERR_GOOD && reg == 0 && slot == 99,
+              "The first variable should get the first register");
+  coil_regalloc_cleanup(&ra);
+  
+  options.registers = 4;
+  options.reserved = 1 << 0;
+  TEST_ASSERT(coil_regalloc_build(&ra, &cfg, &ir, &options) == COIL_ERR_GOOD, "Allocation should succeed");
+  TEST_ASSERT(ra.reg_count == 4 && ra.regs[0] == 1 && ra.regs[2] == 4, "Reserved registers should not be handed out");
+  TEST_ASSERT(ra.splits + ra.spills == 12 && ra.used == 0x36, "Only the four registers should be used");
+  coil_regalloc_cleanup(&ra);
+  
+  options.frame_reg = COIL_CBC_REGISTERS;
+  TEST_ASSERT(coil_regalloc_build(&ra, &cfg, &ir, &options) == COIL_ERR_INVAL, "Bad options should be rejected");
+  
+  coil_cfg_cleanup(&cfg);
+  coil_section_cleanup(&ir);
+  return 0;
+}
+
+/**
+* @brief A counting loop around a call: the counter splits after the call, back to the loop start
+*/
+static int test_regalloc_loop() {
+  coil_section_t ir, out;
+  coil_u64_t offsets[3], moved[3];
+  coil_byte_t memory[TEST_REGALLOC_MEMORY], expect[TEST_REGALLOC_MEMORY];
+  coil_section_init(&ir, 512);
+  coil_section_init(&out, 512);
+  
+  // v0 = 0; v1 = 10; do { v0 += v1; call; v1 -= 1 } while (v1 > 0); [0] = v0
+  test_regalloc_op(&ir, COIL_OP_MOV, COIL_TYPEOP_VAR, 0, COIL_TYPEOP_IMM, 0);
+  test_regalloc_op(&ir, COIL_OP_MOV, COIL_TYPEOP_VAR, 1, COIL_TYPEOP_IMM, 10);
+  offsets[2] = ir.size;
+  test_regalloc_op(&ir, COIL_OP_ADD, COIL_TYPEOP_VAR, 0, COIL_TYPEOP_VAR, 1);
+  coil_u64_t call = ir.size;
+  test_regalloc_branch(&ir, COIL_OP_CALL, COIL_INSTRFLAG_NONE, 1);
+  test_regalloc_op(&ir, COIL_OP_SUB, COIL_TYPEOP_VAR, 1, COIL_TYPEOP_IMM, 1);
+  test_regalloc_op(&ir, COIL_OP_CMP, COIL_TYPEOP_VAR, 1, COIL_TYPEOP_IMM, 0);
+  test_regalloc_branch(&ir, COIL_OP_BR, COIL_INSTRFLAG_GT, 2);
+  coil_u64_t store = ir.size;
+  coil_offset_t at = { 0, 0, 0 };
+  coil_instrflag_encode(&ir, COIL_OP_MOV, COIL_INSTRFLAG_NONE);
+  coil_operand_encode_off(&ir, COIL_TYPEOP_OFF, COIL_VAL_SYM, COIL_MOD_NONE, &at);
+  coil_u64_t data = 0;
+  coil_operand_encode_data(&ir, &data, 8);
+  test_regalloc_operand(&ir, COIL_TYPEOP_VAR, COIL_VAL_I64, 0);
+  coil_instr_encode(&ir, COIL_OP_RET);
+  test_regalloc_callee(&ir, offsets);
+  
+  TEST_ASSERT(test_regalloc_run(&ir, offsets, 3, expect) == COIL_ERR_GOOD, "The original should run");
+  
+  coil_regalloc_t ra;
+  TEST_ASSERT(test_regalloc_apply(&ir, offsets, 3, NULL, &out, moved, &ra) == COIL_ERR_GOOD,
+              "Allocation and rewriting should succeed");
+  
+  // Both are live across the call: in a register up to it, in the slot from the loop start on
+  coil_u8_t reg;
+  coil_u64_t slot;
+  TEST_ASSERT(ra.splits == 2 && ra.spills == 0 && ra.slots == 2, "Both variables should be split");
+  TEST_ASSERT(coil_regalloc_find(&ra, 1, 0, &reg, &slot) == COIL_ERR_GOOD && reg != COIL_REGALLOC_NO_REG,
+              "The counter should start in a register");
+  TEST_ASSERT(coil_regalloc_find(&ra, 1, call, &reg, &slot) == COIL_ERR_GOOD && reg == COIL_REGALLOC_NO_REG &&
+              slot < 2, "The counter should not re-enter the loop in its register");
+  TEST_ASSERT(coil_regalloc_find(&ra, 0, store, &reg, NULL) == COIL_ERR_GOOD && reg == COIL_REGALLOC_NO_REG,
+              "The sum should be in its slot after the loop");
+  TEST_ASSERT(coil_regalloc_find(&ra, 2, 0, &reg, NULL) == COIL_ERR_NOTFOUND, "Unknown variables should not be found");
+  
+  // Both initial writes store to the slots as well
+  TEST_ASSERT(ra.instr_count == 9 && moved[2] > offsets[2] && out.size > ir.size, "Stores should be inserted");
+  TEST_ASSERT(coil_regalloc_offset(&ra, 1, &data) == COIL_ERR_NOTFOUND, "Offsets inside instructions should not map");
+  TEST_ASSERT(coil_regalloc_offset(&ra, offsets[1], &data) == COIL_ERR_GOOD && data == ra.code_size,
+              "The function end should map to the end of the rewritten code");
+  
+  TEST_ASSERT(test_regalloc_run(&out, moved, 3, memory) == COIL_ERR_GOOD, "The rewritten function should run");
+  TEST_ASSERT(memcmp(memory, expect, 8) == 0 && memory[0] == 55, "The results should match");
+  
+  coil_regalloc_cleanup(&ra);
+  coil_section_cleanup(&out);
+  coil_section_cleanup(&ir);
+  return 0;
+}
+
+/**
+* @brief Offset bases become register offsets, volatile variables stay in their slots
+*/
+static int test_regalloc_operands() {
+  coil_section_t ir, out;
+  coil_u64_t offsets[2], moved[2];
+  coil_section_init(&ir, 512);
+  coil_section_init(&out, 512);
+  
+  // v0 = 16; [v0 + 8] = 7; volatile v1 = 3
+  test_regalloc_op(&ir, COIL_OP_MOV, COIL_TYPEOP_VAR, 0, COIL_TYPEOP_IMM, 16);
+  coil_offset_t at = { 8, 0, 0 };
+  coil_instrflag_encode(&ir, COIL_OP_MOV, COIL_INSTRFLAG_NONE);
+  coil_operand_encode_off(&ir, COIL_TYPEOP_OFF, COIL_VAL_VAR, COIL_MOD_NONE, &at);
+  coil_u64_t var = 0;
+  coil_operand_encode_data(&ir, &var, 8);
+  test_regalloc_operand(&ir, COIL_TYPEOP_IMM, COIL_VAL_I64, 7);
+  coil_u64_t vol = ir.size;
+  coil_instrflag_encode(&ir, COIL_OP_MOV, COIL_INSTRFLAG_NONE);
+  coil_operand_encode(&ir, COIL_TYPEOP_VAR, COIL_VAL_I32, COIL_MOD_VOL);
+  coil_u32_t id = 1;
+  coil_operand_encode_data(&ir, &id, 4);
+  test_regalloc_operand(&ir, COIL_TYPEOP_IMM, COIL_VAL_I32, 3);
+  coil_instr_encode(&ir, COIL_OP_RET);
+  test_regalloc_callee(&ir, offsets);
+  
+  coil_byte_t memory[TEST_REGALLOC_MEMORY];
+  TEST_ASSERT(test_regalloc_run(&ir, offsets, 2, memory) == COIL_ERR_NOTSUP, "Variable bases should not lower as is");
+  
+  coil_regalloc_t ra;
+  coil_regalloc_options_t options;
+  coil_regalloc_options_init(&options);
+  options.slot_base = 5;
+  TEST_ASSERT(test_regalloc_apply(&ir, offsets, 2, &options, &out, moved, &ra) == COIL_ERR_GOOD,
+              "Allocation and rewriting should succeed");
+  TEST_ASSERT(ra.refs[1].flags == (COIL_REGALLOC_READ | COIL_REGALLOC_BASE), "The base should be a read");
+  TEST_ASSERT(ra.intervals[0].flags == COIL_REGALLOC_BASED && ra.intervals[1].flags == COIL_REGALLOC_MEMORY,
+              "Interval flags should follow the operands");
+  
+  coil_u8_t reg;
+  coil_u64_t slot;
+  TEST_ASSERT(coil_regalloc_find(&ra, 1, vol, &reg, &slot) == COIL_ERR_GOOD && reg == COIL_REGALLOC_NO_REG &&
+              slot == 5, "Volatile variables should stay in the first slot");
+  
+  // The rewritten store is MOV [r0 + 8], 7
+  coil_instrmem_t instr;
+  coil_instrfmt_t fmt;
+  coil_operand_header_t header;
+  coil_offset_t offset;
+  coil_size_t pos = coil_instr_decode(&out, ra.moved[1], &instr, &fmt);
+  pos = coil_operand_decode(&out, pos, &header, &offset);
+  TEST_ASSERT(pos != 0 && header.type == COIL_TYPEOP_OFF && header.value_type == COIL_VAL_REG && offset.disp == 8,
+              "The base should become a register");
+  
+  TEST_ASSERT(test_regalloc_run(&out, moved, 2, memory) == COIL_ERR_GOOD, "The rewritten function should run");
+  TEST_ASSERT(memory[24] == 7 && memory[TEST_REGALLOC_FRAME + 5 * COIL_LOWER_VAR_SLOT] == 3,
+              "The stores should land");
+  
+  coil_regalloc_cleanup(&ra);
+  coil_section_cleanup(&out);
+  coil_section_cleanup(&ir);
+  return 0;
+}
+
+/**
+* @brief Next value of a xorshift generator
+*/
+static coil_u64_t test_regalloc_next(coil_u64_t *state) {
+  *state ^= *state << 13;
+  *state ^= *state >> 7;
+  *state ^= *state << 17;
+  return *state;
+}
+
+/**
+* @brief Straight-line arithmetic on the variables
+*/
+static void test_regalloc_ops(coil_section_t *ir, coil_u64_t *state, int count) {
+  static const coil_u8_t ops[] = { COIL_OP_ADD, COIL_OP_SUB, COIL_OP_XOR, COIL_OP_OR, COIL_OP_AND, COIL_OP_MOV,
+                                   COIL_OP_MUL };
+  
+  for (int i = 0; i < count; i++) {
+    coil_u64_t r = test_regalloc_next(state);
+    coil_u64_t dst = r % TEST_REGALLOC_VARS;
+    if ((r >> 8) % 8 == 0) {
+      coil_instrflag_encode(ir, (r >> 12) % 2 ? COIL_OP_NEG : COIL_OP_INC, COIL_INSTRFLAG_NONE);
+      test_regalloc_operand(ir, COIL_TYPEOP_VAR, COIL_VAL_I64, dst);
+    } else if ((r >> 16) % 3 == 0) {
+      test_regalloc_op(ir, ops[(r >> 20) % 7], COIL_TYPEOP_VAR, dst, COIL_TYPEOP_IMM, (r >> 32) % 1000);
+    } else {
+      test_regalloc_op(ir, ops[(r >> 20) % 7], COIL_TYPEOP_VAR, dst, COIL_TYPEOP_VAR, (r >> 32) % TEST_REGALLOC_VARS);
+    }
+  }
+}
+
+/**
+* @brief Random function of loops, branches and calls over ten variables
+*
+* @return coil_u32_t Number of symbols
+*/
+static coil_u32_t test_regalloc_program(coil_section_t *ir, coil_u64_t *offsets, coil_u64_t state) {
+  coil_u32_t syms = 2;
+  for (coil_u64_t v = 0; v < TEST_REGALLOC_VARS; v++) {
+    test_regalloc_op(ir, COIL_OP_MOV, COIL_TYPEOP_VAR, v, COIL_TYPEOP_IMM, test_regalloc_next(&state) % 100);
+  }
+  
+  for (int segment = 0; segment < 10; segment++) {
+    coil_u64_t r = test_regalloc_next(&state);
+    switch (r % 4) {
+      case 0:
+        test_regalloc_ops(ir, &state, 2 + (int)(r >> 8) % 5);
+        break;
+      case 1: {
+        // Counted loop, the counter is a variable of its own
+        coil_u64_t counter = 100 + (coil_u64_t)segment;
+        coil_u32_t top = syms++;
+        test_regalloc_op(ir, COIL_OP_MOV, COIL_TYPEOP_VAR, counter, COIL_TYPEOP_IMM, 2 + (r >> 8) % 4);
+        offsets[top] = ir->size;
+        test_regalloc_ops(ir, &state, 1 + (int)(r >> 12) % 4);
+        if ((r >> 16) % 3 == 0) {
+          test_regalloc_branch(ir, COIL_OP_CALL, COIL_INSTRFLAG_NONE, 1);
+        }
+        test_regalloc_ops(ir, &state, (int)(r >> 20) % 3);
+        test_regalloc_op(ir, COIL_OP_SUB, COIL_TYPEOP_VAR, counter, COIL_TYPEOP_IMM, 1);
+        test_regalloc_op(ir, COIL_OP_CMP, COIL_TYPEOP_VAR, counter, COIL_TYPEOP_IMM, 0);
+        test_regalloc_branch(ir, COIL_OP_BR, COIL_INSTRFLAG_GT, top);
+        break;
+      }
+      case 2: {
+        // Forward branch over a few instructions
+        coil_u32_t skip = syms++;
+        test_regalloc_op(ir, COIL_OP_CMP, COIL_TYPEOP_VAR, (r >> 8) % TEST_REGALLOC_VARS,
+                         COIL_TYPEOP_VAR, (r >> 16) % TEST_REGALLOC_VARS);
+        test_regalloc_branch(ir, COIL_OP_BR, COIL_INSTRFLAG_LT, skip);
+        test_regalloc_ops(ir, &state, 1 + (int)(r >> 24) % 4);
+        offsets[skip] = ir->size;
+        break;
+      }
+      default:
+        test_regalloc_branch(ir, COIL_OP_CALL, COIL_INSTRFLAG_NONE, 1);
+        test_regalloc_ops(ir, &state, 1);
+        break;
+    }
+  }
+  
+  // Every variable ends up at address 8 * v
+  for (coil_u64_t v = 0; v < TEST_REGALLOC_VARS; v++) {
+    coil_offset_t at = { 8 * v, 0, 0 };
+    coil_instrflag_encode(ir, COIL_OP_MOV, COIL_INSTRFLAG_NONE);
+    coil_operand_encode_off(ir, COIL_TYPEOP_OFF, COIL_VAL_SYM, COIL_MOD_NONE, &at);
+    coil_u64_t data = 0;
+    coil_operand_encode_data(ir, &data, 8);
+    test_regalloc_operand(ir, COIL_TYPEOP_VAR, COIL_VAL_I64, v);
+  }
+  coil_instr_encode(ir, COIL_OP_RET);
+  test_regalloc_callee(ir, offsets);
+  return syms;
+}
+
+/**
+* @brief Random functions compute the same results under every register budget
+*/
+static int test_regalloc_random() {
+  static const coil_u32_t budgets[] = { 32, 5, 3, 2, 1 };
+  static coil_byte_t memory[TEST_REGALLOC_MEMORY], expect[TEST_REGALLOC_MEMORY];
+  coil_u64_t offsets[TEST_REGALLOC_SYMS], moved[TEST_REGALLOC_SYMS];
+  coil_u32_t splits = 0, spills = 0;
+  
+  for (int p = 0; p < TEST_REGALLOC_PROGRAMS; p++) {
+    coil_section_t ir;
+    coil_section_init(&ir, 4096);
+    coil_u32_t count = test_regalloc_program(&ir, offsets, 0x9E3779B97F4A7C15ull * (coil_u64_t)(p + 1));
+    TEST_ASSERT(test_regalloc_run(&ir, offsets, count, expect) == COIL_ERR_GOOD, "The original should run");
+    
+    for (coil_size_t b = 0; b < sizeof(budgets) / sizeof(budgets[0]); b++) {
+      coil_section_t out;
+      coil_regalloc_t ra;
+      coil_regalloc_options_t options;
+      coil_regalloc_options_init(&options);
+      options.registers = budgets[b];
+      coil_section_init(&out, 4096);
+      
+      TEST_ASSERT(test_regalloc_apply(&ir, offsets, count, &options, &out, moved, &ra) == COIL_ERR_GOOD,
+                  "Allocation and rewriting should succeed");
+      TEST_ASSERT(test_regalloc_run(&out, moved, count, memory) == COIL_ERR_GOOD, "The rewritten function should run");
+      if (memcmp(memory, expect, 8 * TEST_REGALLOC_VARS) != 0) {
+        printf("Program %d with %u registers differs\n", p, (unsigned)budgets[b]);
+        TEST_ASSERT(0, "The results should match");
+      }
+      
+      splits += ra.splits;
+      spills += ra.spills;
+      coil_regalloc_cleanup(&ra);
+      coil_section_cleanup(&out);
+    }
+    coil_section_cleanup(&ir);
+  }
+  
+  TEST_ASSERT(splits > 0 && spills > 0, "Both splits and whole spills should have been exercised");
+  return 0;
+}
+
+/**
+* @brief Run all register allocation tests
+*/
+int test_regalloc() {
+  printf("\nRunning register allocation tests...\n");
+  
+  int result = 0;
+  
+  result |= test_regalloc_targets();
+  result |= test_regalloc_loop();
+  result |= test_regalloc_operands();
+  result |= test_regalloc_random();
+  
+  if (result == 0) {
+    printf("All register allocation tests passed!\n");
+  }
+  
+  return result;
+}
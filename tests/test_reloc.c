@@ -0,0 +1,259 @@
+/**
+* @file test_reloc.c
+* @brief Test suite for relocation tables
+*
+* @author Low Level Team
+*/
+
+#include <coil/reloc.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+
+// Test macros
+#define TEST_ASSERT(cond, msg) do { \
+  if (!(cond)) { \
+    printf("ASSERT FAILED: %s (line %d)\n", msg, __LINE__); \
+    return 1; \
+  } \
+} while (0)
+
+#define TEST_RELOC_FILE "test_reloc.coil"
+#define TEST_RELOC_COUNT 5000
+
+/**
+* @brief Fill a relocation
+*/
+static void test_reloc_make(coil_reloc_t *reloc, coil_u16_t section, coil_u64_t offset, coil_u8_t type,
+                            coil_u32_t symbol, coil_i64_t addend) {
+  memset(reloc, 0, sizeof(coil_reloc_t));
+  reloc->section = section;
+  reloc->offset = offset;
+  reloc->type = type;
+  reloc->symbol = symbol;
+  reloc->addend = addend;
+}
+
+/**
+* @brief Test radix sorting
+*/
+static int test_reloc_sorting() {
+  printf("  Testing relocation sorting...\n");
+  
+  TEST_ASSERT(sizeof(coil_reloc_t) == 24, "Relocations should be 24 bytes");
+  
+  coil_reloc_t *relocs = (coil_reloc_t *)malloc(TEST_RELOC_COUNT * sizeof(coil_reloc_t));
+  TEST_ASSERT(relocs != NULL, "Allocation should succeed");
+  
+  // The symbol index records the original position to check stability
+  srand(1234);
+  for (coil_u32_t i = 0; i < TEST_RELOC_COUNT; i++) {
+    test_reloc_make(&relocs[i], (coil_u16_t)(rand() % 4), (coil_u64_t)(rand() % 1000) * 8, COIL_RELOC_ABS64, i, 0);
+  }
+  relocs[7].offset = 0x123456789ULL; // exercise the upper digits
+  
+  TEST_ASSERT(!coil_reloc_is_sorted(relocs, TEST_RELOC_COUNT), "Random relocations should not be sorted");
+  TEST_ASSERT(coil_reloc_sort(relocs, TEST_RELOC_COUNT) == COIL_ERR_GOOD, "Sorting should succeed");
+  TEST_ASSERT(coil_reloc_is_sorted(relocs, TEST_RELOC_COUNT), "Relocations should be sorted");
+  
+  for (coil_u32_t i = 1; i < TEST_RELOC_COUNT; i++) {
+    if (relocs[i].section == relocs[i - 1].section && relocs[i].offset == relocs[i - 1].offset) {
+      TEST_ASSERT(relocs[i].symbol > relocs[i - 1].symbol, "Sorting should be stable");
+    }
+  }
+  
+  relocs[0].offset = COIL_RELOC_MAX_OFFSET + 1;
+  TEST_ASSERT(coil_reloc_sort(relocs, TEST_RELOC_COUNT) == COIL_ERR_INVAL, "Huge offsets should be rejected");
+  TEST_ASSERT(coil_reloc_sort(NULL, 0) == COIL_ERR_GOOD, "Sorting nothing should succeed");
+  
+  free(relocs);
+  return 0;
+}
+
+/**
+* @brief Test applying a batch to one section
+*/
+static int test_reloc_apply() {
+  printf("  Testing relocation application...\n");
+  
+  coil_section_t sect;
+  TEST_ASSERT(coil_section_init(&sect, 64) == COIL_ERR_GOOD, "Section init should succeed");
+  coil_byte_t zeros[32] = {0};
+  coil_section_write(&sect, zeros, sizeof(zeros), NULL);
+  
+  coil_u64_t symvals[2] = { 0x1000, 0x2000 };
+  coil_reloc_t relocs[4];
+  test_reloc_make(&relocs[0], 0, 0, COIL_RELOC_ABS64, 0, 8);    // 0x1008
+  test_reloc_make(&relocs[1], 0, 8, COIL_RELOC_ABS32, 1, -16);  // 0x1ff0
+  test_reloc_make(&relocs[2], 0, 12, COIL_RELOC_PC32, 0, -4);   // 0x1000 - 4 - (0x400 + 12)
+  test_reloc_make(&relocs[3], 0, 16, COIL_RELOC_PC64, 1, 0);    // 0x2000 - (0x400 + 16)
+  
+  TEST_ASSERT(coil_reloc_apply_batch(&sect, 0x400, relocs, 4, symvals, 2) == COIL_ERR_GOOD, "Applying should succeed");
+  
+  coil_u64_t v64;
+  coil_u32_t v32;
+  memcpy(&v64, sect.data, 8);
+  TEST_ASSERT(v64 == 0x1008, "ABS64 should store S + A");
+  memcpy(&v32, sect.data + 8, 4);
+  TEST_ASSERT(v32 == 0x1ff0, "ABS32 should store S + A");
+  memcpy(&v32, sect.data + 12, 4);
+  TEST_ASSERT((coil_i32_t)v32 == 0x1000 - 4 - 0x40c, "PC32 should store S + A - P");
+  memcpy(&v64, sect.data + 16, 8);
+  TEST_ASSERT(v64 == 0x2000 - 0x410, "PC64 should store S + A - P");
+  
+  // Bad batches are rejected before anything is written
+  coil_reloc_t bad[2];
+  test_reloc_make(&bad[0], 0, 24, COIL_RELOC_ABS64, 0, 0);
+  test_reloc_make(&bad[1], 0, 28, COIL_RELOC_ABS64, 0, 0);
+  TEST_ASSERT(coil_reloc_apply_batch(&sect, 0, bad, 2, symvals, 2) == COIL_ERR_FORMAT, "Out of bounds fields should be rejected");
+  memcpy(&v64, sect.data + 24, 8);
+  TEST_ASSERT(v64 == 0, "Rejected batches should not write");
+  
+  test_reloc_make(&bad[1], 0, 16, COIL_RELOC_ABS64, 0, 0);
+  TEST_ASSERT(coil_reloc_apply_batch(&sect, 0, bad, 2, symvals, 2) == COIL_ERR_FORMAT, "Unsorted batches should be rejected");
+  test_reloc_make(&bad[1], 0, 24, COIL_RELOC_ABS64, 2, 0);
+  TEST_ASSERT(coil_reloc_apply_batch(&sect, 0, bad, 2, symvals, 2) == COIL_ERR_FORMAT, "Unknown symbols should be rejected");
+  test_reloc_make(&bad[1], 0, 24, COIL_RELOC_TYPE_COUNT, 0, 0);
+  TEST_ASSERT(coil_reloc_apply_batch(&sect, 0, bad, 2, symvals, 2) == COIL_ERR_FORMAT, "Unknown types should be rejected");
+  
+  // Values that do not fit are reported
+  coil_u64_t far[1] = { 0x100000000ULL };
+  test_reloc_make(&bad[0], 0, 24, COIL_RELOC_ABS32, 0, 0);
+  TEST_ASSERT(coil_reloc_apply_batch(&sect, 0, bad, 1, far, 1) == COIL_ERR_NOTSUP, "ABS32 overflow should be reported");
+  test_reloc_make(&bad[0], 0, 24, COIL_RELOC_PC32, 0, 0);
+  TEST_ASSERT(coil_reloc_apply_batch(&sect, 0x100000000ULL, bad, 1, symvals, 1) == COIL_ERR_NOTSUP, "PC32 overflow should be reported");
+  
+  // An overflow anywhere in the batch leaves the earlier fields alone too
+  coil_u64_t mixed[2] = { 1, 0x100000000ULL };
+  coil_byte_t before[16];
+  memcpy(before, sect.data + 16, 16);
+  test_reloc_make(&bad[0], 0, 16, COIL_RELOC_ABS32, 0, 0);
+  test_reloc_make(&bad[1], 0, 24, COIL_RELOC_ABS32, 1, 0);
+  TEST_ASSERT(coil_reloc_apply_batch(&sect, 0, bad, 2, mixed, 2) == COIL_ERR_NOTSUP, "Late overflow should be reported");
+  TEST_ASSERT(memcmp(before, sect.data + 16, 16) == 0, "Overflowing batches should not write");
+  
+  // Views cannot be patched
+  coil_section_t view;
+  memset(&view, 0, sizeof(view));
+  view.data = sect.data;
+  view.size = sect.size;
+  view.mode = COIL_SECT_MODE_VIEW;
+  TEST_ASSERT(coil_reloc_apply_batch(&view, 0, relocs, 1, symvals, 2) == COIL_ERR_BADSTATE, "Views should be read-only");
+  
+  coil_section_cleanup(&sect);
+  return 0;
+}
+
+/**
+* @brief Test applying relocations across sections in parallel and storing them
+*/
+static int test_reloc_sections() {
+  printf("  Testing parallel and persisted relocations...\n");
+  
+  enum { SECTS = 4, SLOTS = 512 };
+  coil_section_t storage[SECTS];
+  coil_section_t *sects[SECTS];
+  coil_u64_t bases[SECTS];
+  coil_byte_t zeros[SLOTS * 8] = {0};
+  
+  for (int s = 0; s < SECTS; s++) {
+    TEST_ASSERT(coil_section_init(&storage[s], sizeof(zeros)) == COIL_ERR_GOOD, "Section init should succeed");
+    coil_section_write(&storage[s], zeros, sizeof(zeros), NULL);
+    sects[s] = &storage[s];
+    bases[s] = 0x10000 * (s + 1);
+  }
+  
+  coil_u64_t symvals[16];
+  for (int i = 0; i < 16; i++) {
+    symvals[i] = 0x1000 + i;
+  }
+  
+  coil_reloc_t *relocs = (coil_reloc_t *)malloc(SECTS * SLOTS * sizeof(coil_reloc_t));
+  TEST_ASSERT(relocs != NULL, "Allocation should succeed");
+  for (int i = 0; i < SECTS * SLOTS; i++) {
+    // Emitted in reverse so the sort has work to do
+    int s = SECTS - 1 - i / SLOTS;
+    int slot = SLOTS - 1 - i % SLOTS;
+    test_reloc_make(&relocs[i], (coil_u16_t)s, (coil_u64_t)slot * 8, COIL_RELOC_ABS64, (coil_u32_t)(slot % 16), s);
+  }
+  
+  TEST_ASSERT(coil_reloc_apply_sections(sects, SECTS, bases, relocs, SECTS * SLOTS, symvals, 16, 4) == COIL_ERR_FORMAT, "Unsorted relocations should be rejected");
+  TEST_ASSERT(coil_reloc_sort(relocs, SECTS * SLOTS) == COIL_ERR_GOOD, "Sorting should succeed");
+  TEST_ASSERT(coil_reloc_apply_sections(sects, SECTS, bases, relocs, SECTS * SLOTS, symvals, 16, 4) == COIL_ERR_GOOD, "Parallel apply should succeed");
+  
+  for (int s = 0; s < SECTS; s++) {
+    for (int slot = 0; slot < SLOTS; slot++) {
+      coil_u64_t value;
+      memcpy(&value, storage[s].data + slot * 8, 8);
+      TEST_ASSERT(value == symvals[slot % 16] + (coil_u64_t)s, "Every field should be patched");
+    }
+  }
+  
+  TEST_ASSERT(coil_reloc_apply_sections(sects, SECTS - 1, bases, relocs, SECTS * SLOTS, symvals, 16, 4) == COIL_ERR_FORMAT, "Missing sections should be rejected");
+  
+  // Round trip through an object file and use the mapped table in place
+  coil_object_t obj;
+  TEST_ASSERT(coil_obj_init(&obj, COIL_OBJ_INIT_DEFAULT) == COIL_ERR_GOOD, "Object init should succeed");
+  coil_u16_t index;
+  TEST_ASSERT(coil_reloc_emit(&obj, ".rel", relocs, SECTS * SLOTS, &index) == COIL_ERR_GOOD, "Emit should succeed");
+  TEST_ASSERT(obj.sectheaders[index].type == COIL_SECTION_RELTAB, "Table should use the RELTAB type");
+  
+  int fd = open(TEST_RELOC_FILE, O_RDWR | O_CREAT | O_TRUNC, 0644);
+  TEST_ASSERT(fd >= 0, "Failed to create test file");
+  TEST_ASSERT(coil_obj_save_file(&obj, fd) == COIL_ERR_GOOD, "Save should succeed");
+  close(fd);
+  coil_obj_cleanup(&obj);
+  
+  fd = open(TEST_RELOC_FILE, O_RDONLY);
+  TEST_ASSERT(fd >= 0, "Failed to open test file");
+  TEST_ASSERT(coil_obj_mmap(&obj, fd) == COIL_ERR_GOOD, "Mapping should succeed");
+  
+  coil_section_t rel;
+  TEST_ASSERT(coil_obj_load_section(&obj, index, &rel, COIL_SLOAD_VIEW) == COIL_ERR_GOOD, "View should load");
+  
+  const coil_reloc_t *mapped;
+  coil_size_t count;
+  TEST_ASSERT(coil_reloc_view(&rel, &mapped, &count) == COIL_ERR_GOOD, "Relocation view should succeed");
+  TEST_ASSERT(count == SECTS * SLOTS, "View should see every relocation");
+  TEST_ASSERT(memcmp(mapped, relocs, count * sizeof(coil_reloc_t)) == 0, "Mapped relocations should match");
+  
+  for (int s = 0; s < SECTS; s++) {
+    memset(storage[s].data, 0, storage[s].size);
+  }
+  TEST_ASSERT(coil_reloc_apply_sections(sects, SECTS, NULL, mapped, count, symvals, 16, 0) == COIL_ERR_GOOD, "Applying mapped relocations should succeed");
+  coil_u64_t value;
+  memcpy(&value, storage[2].data + 8, 8);
+  TEST_ASSERT(value == symvals[1] + 2, "Mapped relocations should patch the same values");
+  
+  coil_section_cleanup(&rel);
+  coil_obj_cleanup(&obj);
+  close(fd);
+  unlink(TEST_RELOC_FILE);
+  
+  free(relocs);
+  for (int s = 0; s < SECTS; s++) {
+    coil_section_cleanup(&storage[s]);
+  }
+  return 0;
+}
+
+/**
+* @brief Run all relocation tests
+*/
+int test_reloc() {
+  printf("\nRunning relocation tests...\n");
+  
+  int result = 0;
+  
+  result |= test_reloc_sorting();
+  result |= test_reloc_apply();
+  result |= test_reloc_sections();
+  
+  if (result == 0) {
+    printf("All relocation tests passed!\n");
+  }
+  
+  return result;
+}
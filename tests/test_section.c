@@ -305,6 +305,203 @@ static int test_section_file_io() {
   return 0;
 }
 
+/**
+* @brief Test section growth policy and in place growth
+*/
+static int test_section_growth() {
+  printf("  Testing section growth policy...\n");
+  
+  coil_section_growth_t defaults;
+  coil_err_t err = coil_section_get_growth(&defaults);
+  TEST_ASSERT(err == COIL_ERR_GOOD, "Getting the growth policy should succeed");
+  TEST_ASSERT(defaults.factor_percent == 200, "Default growth should double");
+  
+  coil_section_growth_t policy = defaults;
+  policy.factor_percent = 100;
+  TEST_ASSERT(coil_section_set_growth(&policy) == COIL_ERR_INVAL, "A factor that does not grow should be rejected");
+  
+  // Heap buffers grow by the factor, capped by the step
+  policy.factor_percent = 150;
+  policy.max_step = 64;
+  policy.mmap_threshold = 64 * 1024;
+  policy.page_round = 1;
+  err = coil_section_set_growth(&policy);
+  TEST_ASSERT(err == COIL_ERR_GOOD, "Setting the growth policy should succeed");
+  
+  coil_section_t sect;
+  err = coil_section_init(&sect, 100);
+  TEST_ASSERT(err == COIL_ERR_GOOD, "Section initialization should succeed");
+  
+  err = coil_section_ensure_capacity(&sect, 101);
+  TEST_ASSERT(err == COIL_ERR_GOOD && sect.capacity == 150, "Capacity should grow by the factor");
+  
+  err = coil_section_ensure_capacity(&sect, 151);
+  TEST_ASSERT(err == COIL_ERR_GOOD && sect.capacity == 214, "Capacity growth should be capped by the step");
+  TEST_ASSERT(!sect.is_mapped, "Small sections should stay on the heap");
+  
+  // Large buffers move to an anonymous mapping and keep growing there
+  coil_byte_t chunk[4096];
+  for (coil_size_t i = 0; i < sizeof(chunk); i++) {
+    chunk[i] = (coil_byte_t)i;
+  }
+  
+  coil_size_t written;
+  for (int i = 0; i < 40; i++) {
+    err = coil_section_write(&sect, chunk, sizeof(chunk), &written);
+    TEST_ASSERT(err == COIL_ERR_GOOD && written == sizeof(chunk), "Writing a growing section should succeed");
+  }
+  
+  TEST_ASSERT(sect.is_mapped && sect.map_base == sect.data, "Large sections should be memory mapped");
+  TEST_ASSERT(sect.mode == COIL_SECT_MODE_MODIFY, "Mapped sections should still own their data");
+  TEST_ASSERT(sect.capacity % coil_get_page_size() == 0, "Mapped capacity should be page rounded");
+  TEST_ASSERT(sect.size == 40 * sizeof(chunk), "Section size should match");
+  
+  for (int i = 0; i < 40; i++) {
+    TEST_ASSERT(memcmp(sect.data + i * sizeof(chunk), chunk, sizeof(chunk)) == 0, 
+                "Mapped section content should survive growth");
+  }
+  
+  // Compacting below the threshold moves the data back to the heap
+  err = coil_section_seek_write(&sect, 10);
+  TEST_ASSERT(err == COIL_ERR_GOOD, "Seeking should succeed");
+  sect.size = 10;
+  err = coil_section_compact(&sect);
+  TEST_ASSERT(err == COIL_ERR_GOOD, "Compacting should succeed");
+  TEST_ASSERT(!sect.is_mapped && sect.capacity == 10, "Compacted section should be back on the heap");
+  TEST_ASSERT(memcmp(sect.data, chunk, 10) == 0, "Compacted section content should match");
+  
+  coil_section_cleanup(&sect);
+  
+  err = coil_section_set_growth(NULL);
+  TEST_ASSERT(err == COIL_ERR_GOOD, "Restoring the default policy should succeed");
+  coil_section_get_growth(&policy);
+  TEST_ASSERT(policy.factor_percent == defaults.factor_percent && policy.mmap_threshold == defaults.mmap_threshold, 
+              "Default policy should be restored");
+  
+  return 0;
+}
+
+/**
+* @brief Test chunked sections
+*/
+static int test_section_chunked() {
+  printf("  Testing chunked sections...\n");
+  
+  coil_section_t sect;
+  coil_err_t err = coil_section_init_chunked(&sect, 16);
+  TEST_ASSERT(err == COIL_ERR_GOOD, "Chunked section initialization should succeed");
+  TEST_ASSERT(coil_section_is_chunked(&sect) && sect.data == NULL, "Section should be chunked");
+  TEST_ASSERT(sect.capacity == 16, "Chunked section should start with one chunk");
+  
+  // Appends add chunks without moving what was written before
+  coil_byte_t expected[100];
+  for (int i = 0; i < 100; i++) {
+    expected[i] = (coil_byte_t)(i * 7);
+  }
+  
+  coil_size_t written;
+  err = coil_section_write(&sect, expected, 10, &written);
+  TEST_ASSERT(err == COIL_ERR_GOOD, "Writing a chunked section should succeed");
+  coil_byte_t *first_chunk = sect.chunks[0];
+  
+  err = coil_section_write(&sect, expected + 10, 90, &written);
+  TEST_ASSERT(err == COIL_ERR_GOOD && written == 90, "Writing across chunks should succeed");
+  TEST_ASSERT(sect.chunks[0] == first_chunk, "Existing chunks should never move");
+  TEST_ASSERT(sect.size == 100 && sect.capacity == 112, "Chunked capacity should be whole chunks");
+  TEST_ASSERT(coil_section_chunk_count(&sect) == 7, "Data should span seven chunks");
+  
+  const coil_byte_t *chunk;
+  coil_size_t chunk_len;
+  err = coil_section_get_chunk(&sect, 6, &chunk, &chunk_len);
+  TEST_ASSERT(err == COIL_ERR_GOOD && chunk_len == 4, "Last chunk should hold the tail");
+  TEST_ASSERT(memcmp(chunk, expected + 96, 4) == 0, "Last chunk content should match");
+  TEST_ASSERT(coil_section_get_chunk(&sect, 7, &chunk, &chunk_len) == COIL_ERR_NOTFOUND, 
+              "Chunks past the data should not be found");
+  
+  // Overwrite across a chunk boundary
+  err = coil_section_seek_write(&sect, 14);
+  TEST_ASSERT(err == COIL_ERR_GOOD, "Seeking should succeed");
+  coil_byte_t patch[4] = { 'P', 'A', 'T', 'C' };
+  err = coil_section_write(&sect, patch, sizeof(patch), &written);
+  TEST_ASSERT(err == COIL_ERR_GOOD && sect.size == 100, "Overwriting should not change the size");
+  memcpy(expected + 14, patch, sizeof(patch));
+  
+  coil_byte_t buffer[100];
+  coil_size_t bytes_read;
+  err = coil_section_read(&sect, buffer, sizeof(buffer), &bytes_read);
+  TEST_ASSERT(err == COIL_ERR_GOOD && bytes_read == 100, "Reading a chunked section should succeed");
+  TEST_ASSERT(memcmp(buffer, expected, 100) == 0, "Chunked content should match");
+  
+  const char *str;
+  TEST_ASSERT(coil_section_getstr(&sect, 0, &str) == COIL_ERR_BADSTATE, "Strings need a flattened section");
+  
+  // Serialize writes the chunks directly
+  int fd = open(TEST_SECTION_FILE, O_RDWR | O_CREAT | O_TRUNC, 0644);
+  TEST_ASSERT(fd >= 0, "File open should succeed");
+  err = coil_section_serialize(&sect, fd);
+  TEST_ASSERT(err == COIL_ERR_GOOD, "Serializing a chunked section should succeed");
+  close(fd);
+  
+  fd = open(TEST_SECTION_FILE, O_RDONLY);
+  TEST_ASSERT(fd >= 0, "File open for reading should succeed");
+  coil_section_t loaded_sect;
+  err = coil_section_load(&loaded_sect, 1024, fd);
+  TEST_ASSERT(err == COIL_ERR_GOOD, "Section loading should succeed");
+  TEST_ASSERT(loaded_sect.size == 100 && memcmp(loaded_sect.data, expected, 100) == 0, 
+              "Serialized chunks should match");
+  coil_section_cleanup(&loaded_sect);
+  close(fd);
+  
+  // Compacting drops unused chunks, flattening makes the data contiguous
+  err = coil_section_ensure_capacity(&sect, 200);
+  TEST_ASSERT(err == COIL_ERR_GOOD && sect.chunk_count == 13, "Reserving should add chunks");
+  err = coil_section_compact(&sect);
+  TEST_ASSERT(err == COIL_ERR_GOOD && sect.chunk_count == 7, "Compacting should drop unused chunks");
+  
+  err = coil_section_flatten(&sect);
+  TEST_ASSERT(err == COIL_ERR_GOOD, "Flattening should succeed");
+  TEST_ASSERT(!coil_section_is_chunked(&sect) && sect.data != NULL, "Flattened section should be contiguous");
+  TEST_ASSERT(sect.size == 100 && memcmp(sect.data, expected, 100) == 0, "Flattened content should match");
+  TEST_ASSERT(coil_section_chunk_count(&sect) == 1, "Contiguous sections count as one chunk");
+  
+  coil_section_cleanup(&sect);
+  
+  // Objects save chunked sections like any other
+  coil_object_t obj;
+  err = coil_obj_init(&obj, COIL_OBJ_INIT_DEFAULT);
+  TEST_ASSERT(err == COIL_ERR_GOOD, "Object initialization should succeed");
+  
+  err = coil_section_init_chunked(&sect, 32);
+  TEST_ASSERT(err == COIL_ERR_GOOD, "Chunked section initialization should succeed");
+  err = coil_section_write(&sect, expected, 100, &written);
+  TEST_ASSERT(err == COIL_ERR_GOOD, "Writing a chunked section should succeed");
+  
+  coil_u16_t index;
+  err = coil_obj_create_section(&obj, COIL_SECTION_PROGBITS, ".chunked", COIL_SECTION_FLAG_NONE, &sect, &index);
+  TEST_ASSERT(err == COIL_ERR_GOOD, "Adding a chunked section should succeed");
+  TEST_ASSERT(!coil_section_has_data(&sect), "Ownership should move to the object");
+  
+  fd = open(TEST_SECTION_FILE, O_RDWR | O_CREAT | O_TRUNC, 0644);
+  TEST_ASSERT(fd >= 0, "File open should succeed");
+  err = coil_obj_save_file(&obj, fd);
+  TEST_ASSERT(err == COIL_ERR_GOOD, "Saving an object with a chunked section should succeed");
+  close(fd);
+  coil_obj_cleanup(&obj);
+  
+  fd = open(TEST_SECTION_FILE, O_RDONLY);
+  TEST_ASSERT(fd >= 0, "File open for reading should succeed");
+  err = coil_obj_load_file(&obj, fd);
+  TEST_ASSERT(err == COIL_ERR_GOOD, "Loading the object should succeed");
+  err = coil_obj_load_section(&obj, index, &loaded_sect, COIL_SLOAD_DEFAULT);
+  TEST_ASSERT(err == COIL_ERR_GOOD, "Loading the section should succeed");
+  TEST_ASSERT(loaded_sect.size == 100 && memcmp(loaded_sect.data, expected, 100) == 0, 
+              "Saved chunked section should match");
+  coil_section_cleanup(&loaded_sect);
+  coil_obj_cleanup(&obj);
+  
+  return 0;
+}
+
 /**
 * @brief Run all section tests
 */
@@ -319,6 +516,8 @@ int test_section() {
   result |= test_section_string_ops();
   result |= test_section_target_metadata();
   result |= test_section_file_io();
+  result |= test_section_growth();
+  result |= test_section_chunked();
   
   // Clean up test file
   unlink(TEST_SECTION_FILE);
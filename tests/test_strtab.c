@@ -0,0 +1,162 @@
+/**
+* @file test_strtab.c
+* @brief Test suite for interned string tables
+*
+* @author Low Level Team
+*/
+
+#include <coil/strtab.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+
+// Test macros
+#define TEST_ASSERT(cond, msg) do { \
+  if (!(cond)) { \
+    printf("ASSERT FAILED: %s (line %d)\n", msg, __LINE__); \
+    return 1; \
+  } \
+} while (0)
+
+#define TEST_STRTAB_FILE "test_strtab.coil"
+
+/**
+* @brief Test interning, deduplication and tail merging
+*/
+static int test_strtab_intern() {
+  printf("  Testing interning and tail merging...\n");
+  
+  coil_strtab_t tab;
+  TEST_ASSERT(coil_strtab_init(&tab, 2) == COIL_ERR_GOOD, "Builder init should succeed");
+  
+  coil_u32_t foobar, bar, foobar2, baz, empty, r;
+  TEST_ASSERT(coil_strtab_add_cstr(&tab, "foobar", &foobar) == COIL_ERR_GOOD, "Adding a string should succeed");
+  TEST_ASSERT(coil_strtab_add_cstr(&tab, "bar", &bar) == COIL_ERR_GOOD, "Adding a string should succeed");
+  TEST_ASSERT(coil_strtab_add(&tab, "foobar!", 6, &foobar2) == COIL_ERR_GOOD, "Adding by length should succeed");
+  TEST_ASSERT(foobar2 == foobar, "Duplicate strings should be interned once");
+  TEST_ASSERT(coil_strtab_add_cstr(&tab, "baz", &baz) == COIL_ERR_GOOD, "Adding a string should succeed");
+  TEST_ASSERT(coil_strtab_add(&tab, NULL, 0, &empty) == COIL_ERR_GOOD, "Adding the empty string should succeed");
+  TEST_ASSERT(coil_strtab_add(&tab, "a\0b", 3, NULL) == COIL_ERR_INVAL, "Embedded null bytes should be rejected");
+  TEST_ASSERT(tab.count == 4, "Builder should hold four distinct strings");
+  
+  // Enough strings to grow the entry array and the index
+  char name[32];
+  for (int i = 0; i < 100; i++) {
+    snprintf(name, sizeof(name), "sym_%d", i);
+    TEST_ASSERT(coil_strtab_add_cstr(&tab, name, NULL) == COIL_ERR_GOOD, "Adding a string should succeed");
+  }
+  TEST_ASSERT(coil_strtab_find(&tab, "sym_42", 6, &r) == COIL_ERR_GOOD, "Interned strings should be found");
+  TEST_ASSERT(coil_strtab_find(&tab, "bar", 3, &r) == COIL_ERR_GOOD && r == bar, "Ids should stay stable across growth");
+  TEST_ASSERT(coil_strtab_find(&tab, "qux", 3, &r) == COIL_ERR_NOTFOUND, "Unknown strings should not be found");
+  TEST_ASSERT(coil_strtab_hash("sym_42", 6) == coil_obj_hash_name("sym_42"), "Hash should match section name hashing");
+  
+  coil_strref_t ref;
+  TEST_ASSERT(coil_strtab_ref(&tab, bar, &ref) == COIL_ERR_BADSTATE, "References need a finalized table");
+  TEST_ASSERT(coil_strtab_finalize(&tab) == COIL_ERR_GOOD, "Finalize should succeed");
+  
+  coil_strref_t foobar_ref, bar_ref, empty_ref;
+  TEST_ASSERT(coil_strtab_ref(&tab, foobar, &foobar_ref) == COIL_ERR_GOOD, "Getting a reference should succeed");
+  TEST_ASSERT(coil_strtab_ref(&tab, bar, &bar_ref) == COIL_ERR_GOOD, "Getting a reference should succeed");
+  TEST_ASSERT(coil_strtab_ref(&tab, empty, &empty_ref) == COIL_ERR_GOOD, "Getting a reference should succeed");
+  TEST_ASSERT(empty_ref == COIL_STRREF_EMPTY, "The empty string should be at offset 0");
+  TEST_ASSERT(coil_strref_length(bar_ref) == 3, "References should carry the length");
+  TEST_ASSERT(coil_strref_offset(bar_ref) == coil_strref_offset(foobar_ref) + 3, "Suffixes should share storage");
+  TEST_ASSERT(tab.data[0] == 0, "Table should start with the empty string");
+  
+  // Every string is intact in the final table
+  coil_size_t expected = 1 + 7 + 4; // "", "foobar", "baz" (bar is merged)
+  for (coil_u32_t id = 0; id < tab.count; id++) {
+    TEST_ASSERT(coil_strtab_ref(&tab, id, &ref) == COIL_ERR_GOOD, "Getting a reference should succeed");
+    const char *str = (const char *)tab.arena + tab.entries[id].arena;
+    TEST_ASSERT(strcmp((const char *)tab.data + coil_strref_offset(ref), str) == 0, "Placed strings should match");
+    if (id >= 4) {
+      expected += strlen(str) + 1;
+    }
+  }
+  TEST_ASSERT(tab.size <= expected, "Tail merging should not grow the table");
+  
+  coil_strtab_cleanup(&tab);
+  return 0;
+}
+
+/**
+* @brief Test emitting a table and resolving references from a mapping
+*/
+static int test_strtab_file() {
+  printf("  Testing mapped string tables...\n");
+  
+  coil_strtab_t tab;
+  TEST_ASSERT(coil_strtab_init(&tab, 0) == COIL_ERR_GOOD, "Builder init should succeed");
+  
+  coil_u32_t text, init_text;
+  coil_strtab_add_cstr(&tab, ".text", &text);
+  coil_strtab_add_cstr(&tab, ".init.text", &init_text);
+  
+  coil_object_t obj;
+  TEST_ASSERT(coil_obj_init(&obj, COIL_OBJ_INIT_DEFAULT) == COIL_ERR_GOOD, "Object init should succeed");
+  TEST_ASSERT(coil_strtab_emit(&obj, &tab, ".strtab", NULL) == COIL_ERR_BADSTATE, "Emitting needs a finalized table");
+  TEST_ASSERT(coil_strtab_finalize(&tab) == COIL_ERR_GOOD, "Finalize should succeed");
+  
+  coil_u16_t index;
+  TEST_ASSERT(coil_strtab_emit(&obj, &tab, ".strtab", &index) == COIL_ERR_GOOD, "Emit should succeed");
+  TEST_ASSERT(obj.sectheaders[index].type == COIL_SECTION_STRTAB, "Table should use the STRTAB type");
+  
+  coil_strref_t text_ref, init_ref;
+  coil_strtab_ref(&tab, text, &text_ref);
+  coil_strtab_ref(&tab, init_text, &init_ref);
+  coil_strtab_cleanup(&tab);
+  
+  int fd = open(TEST_STRTAB_FILE, O_RDWR | O_CREAT | O_TRUNC, 0644);
+  TEST_ASSERT(fd >= 0, "Failed to create test file");
+  TEST_ASSERT(coil_obj_save_file(&obj, fd) == COIL_ERR_GOOD, "Save should succeed");
+  close(fd);
+  coil_obj_cleanup(&obj);
+  
+  fd = open(TEST_STRTAB_FILE, O_RDONLY);
+  TEST_ASSERT(fd >= 0, "Failed to open test file");
+  TEST_ASSERT(coil_obj_mmap(&obj, fd) == COIL_ERR_GOOD, "Mapping should succeed");
+  
+  coil_section_t sect;
+  TEST_ASSERT(coil_obj_load_section(&obj, index, &sect, COIL_SLOAD_VIEW) == COIL_ERR_GOOD, "View should load");
+  
+  const char *str;
+  TEST_ASSERT(coil_strtab_get(&sect, text_ref, &str) == COIL_ERR_GOOD, "Resolving a reference should succeed");
+  TEST_ASSERT(strcmp(str, ".text") == 0, "Reference should resolve to its string");
+  TEST_ASSERT(str == (const char *)sect.data + coil_strref_offset(text_ref), "Strings should point into the mapping");
+  TEST_ASSERT(coil_strtab_equals(&sect, init_ref, ".init.text", 10), "Equal strings should compare equal");
+  TEST_ASSERT(!coil_strtab_equals(&sect, init_ref, ".init.data", 10), "Different strings should compare unequal");
+  TEST_ASSERT(!coil_strtab_equals(&sect, text_ref, ".text2", 6), "Different lengths should compare unequal");
+  
+  coil_strref_t ref;
+  TEST_ASSERT(coil_strtab_ref_at(&sect, coil_strref_offset(init_ref), &ref) == COIL_ERR_GOOD, "Resolving an offset should succeed");
+  TEST_ASSERT(ref == init_ref, "Offsets should resolve to the full reference");
+  TEST_ASSERT(coil_strtab_get(&sect, coil_strref_make(coil_strref_offset(init_ref), 3), &str) == COIL_ERR_FORMAT, "Wrong lengths should be rejected");
+  TEST_ASSERT(coil_strtab_get(&sect, coil_strref_make((coil_u32_t)sect.size, 0), &str) == COIL_ERR_FORMAT, "Out of bounds references should be rejected");
+  TEST_ASSERT(coil_strtab_ref_at(&sect, (coil_u32_t)sect.size, &ref) == COIL_ERR_FORMAT, "Out of bounds offsets should be rejected");
+  
+  coil_section_cleanup(&sect);
+  coil_obj_cleanup(&obj);
+  close(fd);
+  
+  unlink(TEST_STRTAB_FILE);
+  return 0;
+}
+
+/**
+* @brief Run all string table tests
+*/
+int test_strtab() {
+  printf("\nRunning string table tests...\n");
+  
+  int result = 0;
+  
+  result |= test_strtab_intern();
+  result |= test_strtab_file();
+  
+  if (result == 0) {
+    printf("All string table tests passed!\n");
+  }
+  
+  return result;
+}
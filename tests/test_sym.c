@@ -0,0 +1,224 @@
+/**
+* @file test_sym.c
+* @brief Test suite for symbol tables and their hash index
+*
+* @author Low Level Team
+*/
+
+#include <coil/sym.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+
+// Test macros
+#define TEST_ASSERT(cond, msg) do { \
+  if (!(cond)) { \
+    printf("ASSERT FAILED: %s (line %d)\n", msg, __LINE__); \
+    return 1; \
+  } \
+} while (0)
+
+#define TEST_SYM_FILE "test_sym.coil"
+#define TEST_SYM_COUNT 200
+
+/**
+* @brief Fill a symbol named sym_<i>
+*/
+static void test_sym_make(coil_symbol_t *sym, int i) {
+  char name[32];
+  snprintf(name, sizeof(name), "sym_%d", i);
+  
+  memset(sym, 0, sizeof(coil_symbol_t));
+  sym->name = (coil_u64_t)i * 8;
+  sym->name_hash = coil_obj_hash_name(name);
+  sym->value = (coil_u64_t)i * 16;
+  sym->size = 4;
+  sym->section = 1;
+}
+
+/**
+* @brief Look up every sym_<i> in a view and check its value
+*/
+static int test_sym_check_view(const coil_symtab_view_t *view) {
+  char name[32];
+  coil_u32_t index;
+  
+  for (int i = 0; i < TEST_SYM_COUNT; i++) {
+    snprintf(name, sizeof(name), "sym_%d", i);
+    TEST_ASSERT(coil_symtab_lookup_name(view, name, &index) == COIL_ERR_GOOD, "Symbol lookup should succeed");
+    TEST_ASSERT(view->symbols[index].value == (coil_u64_t)i * 16, "Lookup should find the matching symbol");
+  }
+  
+  TEST_ASSERT(coil_symtab_lookup_name(view, "missing", &index) == COIL_ERR_NOTFOUND, "Unknown symbols should not be found");
+  TEST_ASSERT(coil_symtab_lookup_name(view, "sym_-1", &index) == COIL_ERR_NOTFOUND, "Unknown symbols should not be found");
+  return 0;
+}
+
+/**
+* @brief Test building, finalizing and searching a table in memory
+*/
+static int test_symtab_build() {
+  printf("  Testing symbol table builder...\n");
+  
+  coil_symtab_t tab;
+  TEST_ASSERT(coil_symtab_init(&tab, 0) == COIL_ERR_GOOD, "Builder init should succeed");
+  TEST_ASSERT(sizeof(coil_symbol_t) == 40, "Symbols should be 40 bytes");
+  
+  coil_symbol_t sym;
+  coil_u32_t index;
+  for (int i = 0; i < TEST_SYM_COUNT; i++) {
+    test_sym_make(&sym, i);
+    TEST_ASSERT(coil_symtab_add(&tab, &sym, &index) == COIL_ERR_GOOD, "Adding a symbol should succeed");
+    TEST_ASSERT(index == (coil_u32_t)i, "Symbols should be appended");
+  }
+  
+  // Without an index lookups scan the table
+  coil_symtab_view_t view;
+  TEST_ASSERT(coil_symtab_view_builder(&view, &tab) == COIL_ERR_GOOD, "Builder view should succeed");
+  TEST_ASSERT(view.hash == NULL, "Unfinalized builders should have no index");
+  TEST_ASSERT(test_sym_check_view(&view) == 0, "Linear lookups should work");
+  
+  TEST_ASSERT(coil_symtab_emit(NULL, &tab, ".symtab", ".hash", NULL, NULL) == COIL_ERR_INVAL, "Emitting into NULL should fail");
+  
+  coil_u32_t *index_map = (coil_u32_t *)malloc(TEST_SYM_COUNT * sizeof(coil_u32_t));
+  TEST_ASSERT(index_map != NULL, "Allocation should succeed");
+  TEST_ASSERT(coil_symtab_finalize(&tab, index_map) == COIL_ERR_GOOD, "Finalize should succeed");
+  
+  for (int i = 0; i < TEST_SYM_COUNT; i++) {
+    TEST_ASSERT(tab.symbols[index_map[i]].value == (coil_u64_t)i * 16, "Index map should track reordered symbols");
+  }
+  free(index_map);
+  
+  TEST_ASSERT(coil_symtab_view_builder(&view, &tab) == COIL_ERR_GOOD, "Builder view should succeed");
+  TEST_ASSERT(view.hash != NULL && view.hash->symbol_count == TEST_SYM_COUNT, "Finalized builders should have an index");
+  TEST_ASSERT(test_sym_check_view(&view) == 0, "Hashed lookups should work");
+  
+  // Adding drops the stale index
+  test_sym_make(&sym, TEST_SYM_COUNT);
+  TEST_ASSERT(coil_symtab_add(&tab, &sym, NULL) == COIL_ERR_GOOD, "Adding a symbol should succeed");
+  TEST_ASSERT(tab.hash == NULL, "Adding should drop the index");
+  
+  coil_symtab_cleanup(&tab);
+  
+  // Empty tables still produce a valid index
+  TEST_ASSERT(coil_symtab_init(&tab, 0) == COIL_ERR_GOOD, "Builder init should succeed");
+  TEST_ASSERT(coil_symtab_finalize(&tab, NULL) == COIL_ERR_GOOD, "Finalizing an empty table should succeed");
+  TEST_ASSERT(coil_symtab_view_builder(&view, &tab) == COIL_ERR_GOOD, "Builder view should succeed");
+  TEST_ASSERT(coil_symtab_lookup_name(&view, "sym_0", &index) == COIL_ERR_NOTFOUND, "Empty tables have no symbols");
+  coil_symtab_cleanup(&tab);
+  
+  return 0;
+}
+
+/**
+* @brief Test emitting a table, saving it and searching the mapped file
+*/
+static int test_symtab_file() {
+  printf("  Testing persisted symbol hash...\n");
+  
+  coil_symbol_t *syms = (coil_symbol_t *)malloc(TEST_SYM_COUNT * sizeof(coil_symbol_t));
+  TEST_ASSERT(syms != NULL, "Allocation should succeed");
+  for (int i = 0; i < TEST_SYM_COUNT; i++) {
+    test_sym_make(&syms[i], i);
+  }
+  
+  coil_symtab_t tab;
+  TEST_ASSERT(coil_symtab_init(&tab, TEST_SYM_COUNT) == COIL_ERR_GOOD, "Builder init should succeed");
+  TEST_ASSERT(coil_symtab_add_bulk(&tab, syms, TEST_SYM_COUNT) == COIL_ERR_GOOD, "Bulk add should succeed");
+  TEST_ASSERT(tab.count == TEST_SYM_COUNT, "Bulk add should add every symbol");
+  free(syms);
+  
+  coil_object_t obj;
+  TEST_ASSERT(coil_obj_init(&obj, COIL_OBJ_INIT_DEFAULT) == COIL_ERR_GOOD, "Object init should succeed");
+  
+  // An odd-sized section first, so the tables would be misaligned without padding
+  coil_section_t text;
+  TEST_ASSERT(coil_section_init(&text, 16) == COIL_ERR_GOOD, "Section init should succeed");
+  coil_size_t written;
+  coil_section_write(&text, (coil_byte_t *)"abc", 3, &written);
+  TEST_ASSERT(coil_obj_create_section(&obj, COIL_SECTION_PROGBITS, ".text", COIL_SECTION_FLAG_CODE, &text, NULL) == COIL_ERR_GOOD, "Creating .text should succeed");
+  coil_section_cleanup(&text);
+  
+  TEST_ASSERT(coil_symtab_emit(&obj, &tab, ".symtab", ".hash", NULL, NULL) == COIL_ERR_BADSTATE, "Emitting an unfinalized table should fail");
+  TEST_ASSERT(coil_symtab_finalize(&tab, NULL) == COIL_ERR_GOOD, "Finalize should succeed");
+  
+  coil_u16_t symtab_index, hash_index;
+  TEST_ASSERT(coil_symtab_emit(&obj, &tab, ".symtab", ".hash", &symtab_index, &hash_index) == COIL_ERR_GOOD, "Emit should succeed");
+  TEST_ASSERT(obj.sectheaders[symtab_index].type == COIL_SECTION_SYMTAB, "Symbol table should use the SYMTAB type");
+  TEST_ASSERT(obj.sectheaders[hash_index].type == COIL_SECTION_HASH, "Hash index should use the HASH type");
+  coil_symtab_cleanup(&tab);
+  
+  int fd = open(TEST_SYM_FILE, O_RDWR | O_CREAT | O_TRUNC, 0644);
+  TEST_ASSERT(fd >= 0, "Failed to create test file");
+  TEST_ASSERT(coil_obj_save_file(&obj, fd) == COIL_ERR_GOOD, "Save should succeed");
+  close(fd);
+  coil_obj_cleanup(&obj);
+  
+  // Search straight from the mapping, nothing is copied or rebuilt
+  fd = open(TEST_SYM_FILE, O_RDONLY);
+  TEST_ASSERT(fd >= 0, "Failed to open test file");
+  TEST_ASSERT(coil_obj_mmap(&obj, fd) == COIL_ERR_GOOD, "Mapping should succeed");
+  
+  TEST_ASSERT(obj.sectheaders[symtab_index].offset % 8 == 0, "Section data should be 8-byte aligned");
+  TEST_ASSERT(obj.sectheaders[hash_index].offset % 8 == 0, "Section data should be 8-byte aligned");
+  
+  coil_section_t symtab_sect, hash_sect;
+  TEST_ASSERT(coil_obj_load_section(&obj, symtab_index, &symtab_sect, COIL_SLOAD_VIEW) == COIL_ERR_GOOD, "Symbol table view should load");
+  TEST_ASSERT(coil_obj_load_section(&obj, hash_index, &hash_sect, COIL_SLOAD_VIEW) == COIL_ERR_GOOD, "Hash view should load");
+  
+  coil_symtab_view_t view;
+  TEST_ASSERT(coil_symtab_view(&view, &symtab_sect, &hash_sect) == COIL_ERR_GOOD, "View should succeed");
+  TEST_ASSERT((const coil_byte_t *)view.symbols == symtab_sect.data, "View should point into the mapping");
+  TEST_ASSERT(test_sym_check_view(&view) == 0, "Mapped lookups should work");
+  
+  // Without the hash section lookups still work
+  TEST_ASSERT(coil_symtab_view(&view, &symtab_sect, NULL) == COIL_ERR_GOOD, "View without index should succeed");
+  TEST_ASSERT(test_sym_check_view(&view) == 0, "Mapped linear lookups should work");
+  
+  // A hash index that does not match the table is rejected
+  coil_section_t bad = hash_sect;
+  bad.size -= 4;
+  TEST_ASSERT(coil_symtab_view(&view, &symtab_sect, &bad) == COIL_ERR_FORMAT, "Truncated index should be rejected");
+  bad = symtab_sect;
+  bad.size -= sizeof(coil_symbol_t);
+  TEST_ASSERT(coil_symtab_view(&view, &bad, &hash_sect) == COIL_ERR_FORMAT, "Mismatched index should be rejected");
+  
+  // So is a bloom shift past the word size
+  coil_byte_t *copy = (coil_byte_t *)malloc(hash_sect.size);
+  TEST_ASSERT(copy != NULL, "Allocation should succeed");
+  memcpy(copy, hash_sect.data, hash_sect.size);
+  ((coil_symhash_header_t *)copy)->bloom_shift = 64;
+  bad = hash_sect;
+  bad.data = copy;
+  coil_err_t shift_err = coil_symtab_view(&view, &symtab_sect, &bad);
+  free(copy);
+  TEST_ASSERT(shift_err == COIL_ERR_FORMAT, "Out of range bloom shift should be rejected");
+  
+  coil_section_cleanup(&symtab_sect);
+  coil_section_cleanup(&hash_sect);
+  coil_obj_cleanup(&obj);
+  close(fd);
+  
+  unlink(TEST_SYM_FILE);
+  return 0;
+}
+
+/**
+* @brief Run all symbol table tests
+*/
+int test_sym() {
+  printf("\nRunning symbol table tests...\n");
+  
+  int result = 0;
+  
+  result |= test_symtab_build();
+  result |= test_symtab_file();
+  
+  if (result == 0) {
+    printf("All symbol table tests passed!\n");
+  }
+  
+  return result;
+}